@@ -1,4 +1,66 @@
+int
+drop_piece_on_grid(Grid *g, play_piece *pp, int col, int row, int rot);
+void
+ai_take_counters(AI_Counters *c);
+void
+ai_counters_mark(AI_Counters *mark);
+void
+ai_counters_add(AI_Counters *into, const AI_Counters *mark);
+void
+weight_boards(Grid_Masks *m, int n, int *scores);
+void
+ai_set_profile(const AI_Weights *w);
+void
+ai_get_profile(AI_Weights *w);
+void
+ai_set_thread_weights(const AI_Weights *w);
+void
+ai_weights_get(const AI_Weights *w, double *v);
+void
+ai_weights_set(AI_Weights *w, const double *v);
+int
+ai_load_weights(const char *filespec, AI_Weights *w);
+int
+ai_save_weights(const char *filespec, const AI_Weights *w, const char *comment);
+AI_Batch *
+ai_batch_new(Grid *g, int max);
+void
+ai_batch_free(AI_Batch *b);
+void
+ai_batch_drop(AI_Batch *b, Grid *g, play_piece *pp, AI_Placement *p, int n);
+int
+ai_batch_all(AI_Batch *b, Grid *g, play_piece *pp, int row);
+void
+ai_batch_weigh(AI_Batch *b, int *scores);
+void
+ai_batch_eval(AI_Batch *b, double *scores);
+void
+ai_free_model(AI_Model *m);
+AI_Model *
+ai_load_model(const char *filespec);
+void
+ai_set_model(AI_Model *m);
+void
+ai_batch_learned(AI_Batch *b, double *scores);
 
+int
+ai_plan(Grid *g, play_piece *pp, int bw, int col, int y, int rot,
+	AI_Placement *goal, int fall, AI_Plan *plan);
+void *
+ai_new_piece(AI_Player *ai, void *state, Grid *g, play_piece *pp,
+	AI_Placement *played);
+void
+ai_counters_sum(AI_Counters *into, const AI_Counters *c);
+void
+ai_counters_print(FILE *f, const char *name, const AI_Counters *c);
+int
+ai_think(AI_Player *ai, AI_Counters *c, void *state, Grid *g, 
+	play_piece *cp, play_piece *np, int col, int row, int rot);
+int
+ai_spawn(Grid *g, play_piece *pp, int bw, int *col, int *y, int *rot);
+int
+ai_step(Grid *g, play_piece *pp, int bw, Command m, int fall,
+	int *col, int *y, int *rot);
 AI_Players *
 AI_Players_Setup(void);
 int
@@ -0,0 +1,2 @@
+int
+bench_play(Bench *b, AI_Players *ai, piece_style *ps, color_style *cs);
@@ -0,0 +1,7 @@
+int
+book_load(const char *filespec);
+int
+book_lookup(Grid *g, int pieces, play_piece *cp, play_piece *np, 
+	AI_Placement *goal);
+int
+book_make(Book *b, AI_Players *ai, piece_style *ps, color_style *cs);
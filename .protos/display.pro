@@ -12,26 +12,32 @@ setup_colors(SDL_Surface *screen);
 #define DRAW_CLEAR	(1<<4)
 #define DRAW_HUGE	(1<<5)
 #define DRAW_LARGE	(1<<6)
-#define DRAW_GRID_0	(1<<7)
+#define DRAW_SMALL	(1<<8)
 int
 draw_string(char *text, SDL_Color sc, int x, int y, int flags);
 int
-give_notice(char *s, int quit_possible);
+give_notice(Session *s, char *msg, int quit_possible);
 void
 draw_bordered_rect(SDL_Rect *orig, SDL_Rect *border, int thick);
 void
 draw_pre_bordered_rect(SDL_Rect *border, int thick);
 void
 setup_layers(SDL_Surface * screen);
+int
+free_for_all_room(SDL_Surface *screen, int blockWidth, int w, int h);
 void
-draw_background(SDL_Surface *screen, int blockWidth, Grid g[],
+draw_background(Session *s, SDL_Surface *screen, int blockWidth, Grid g[],
 	int level[], int my_adj[], int their_adj[], char *name[]);
 void
-draw_pause(int on);
+draw_pause(Session *s, int on);
+void
+draw_clock(Session *s, int seconds);
+void
+draw_score_as(Session *s, int i, int score);
 void
-draw_clock(int seconds);
+draw_score(Session *s, SDL_Surface *screen, int i);
 void
-draw_score(SDL_Surface *screen, int i);
+draw_ai_overlay(Session *s, int P, char *line[], int n);
 void
-draw_next_piece(SDL_Surface *screen, piece_style *ps, color_style *cs,
-	play_piece *cp, play_piece *np, int P);
+draw_next_piece(Session *s, SDL_Surface *screen, piece_style *ps,
+	color_style *cs, play_piece *cp, play_piece *np, int P);
@@ -1,11 +1,22 @@
 
 void
 cleanup_grid(Grid *g);
+void
+grid_masks(Grid *g, Grid_Masks *m);
+Grid
+generate_board_r(int w, int h, int level, Uint32 *seed);
 Grid
 generate_board(int w, int h, int level);
 void
+free_board(Grid *g);
+void
+add_garbage_r(Grid *g, Uint32 *seed);
+void
 add_garbage(Grid *g);
 void
+draw_grid_block(SDL_Surface *screen, color_style *cs, Grid *g, int i, int j,
+	int dy);
+void
 draw_grid(SDL_Surface *screen, color_style *cs, Grid *g, int draw);
 void
 draw_falling(SDL_Surface *screen, int blockWidth, Grid *g, int offset);
@@ -0,0 +1,6 @@
+void
+idle_setup(void);
+void
+idle_wake(void);
+int
+idle_wait(int ms, int sock);
@@ -0,0 +1,6 @@
+void
+latency_add(Latency *h, Uint32 us);
+Uint32
+latency_at(const Latency *h, double fraction);
+void
+latency_write(FILE *fout, const char *name, const Latency *h);
@@ -5,6 +5,8 @@ color_styles
 load_color_styles(SDL_Surface * screen);
 play_piece
 generate_piece(piece_style *ps, color_style *cs, unsigned int seq);
+play_piece
+generate_piece_r(piece_style *ps, color_style *cs, Uint32 *seed);
 void
 draw_play_piece(SDL_Surface *screen, color_style *cs, 
 	play_piece *o_pp, int o_x, int o_y, int o_rot,	/* old */
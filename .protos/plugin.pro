@@ -0,0 +1,4 @@
+void
+plugin_set_dir(char *dir);
+int
+plugin_load_all(AI_Players *ais);
@@ -0,0 +1,14 @@
+int
+render_start(Session *s, Grid g[], color_style *cs[], int nboard);
+void
+render_stop(void);
+Render_Frame *
+render_frame(void);
+void
+render_publish(void);
+void
+render_lock(void);
+void
+render_unlock(void);
+void
+render_pause(int on);
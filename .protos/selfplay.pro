@@ -0,0 +1,2 @@
+int
+selfplay_play(Selfplay *s, AI_Players *ai, piece_style *ps, color_style *cs);
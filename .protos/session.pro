@@ -0,0 +1,4 @@
+void
+session_init(Session *s, GT gametype);
+void
+session_free(Session *s);
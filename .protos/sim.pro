@@ -0,0 +1,36 @@
+int
+sim_num_cpus(void);
+void
+sim_start(void);
+void
+sim_batch_start(Sim_Batch *b, void (*job)(void *arg, int i), void *arg, int n);
+int
+sim_batch_done(Sim_Batch *b);
+void
+sim_batch_wait(Sim_Batch *b);
+void
+sim_run(void (*job)(void *arg, int i), void *arg, int n);
+Grid *
+sim_scratch(int which, int w, int h);
+void
+sim_copy_grid(Grid *to, Grid *from);
+void
+sim_set_styles(piece_style *ps, color_style *cs);
+int
+sim_get_styles(piece_style **ps, color_style **cs);
+void
+sim_virtual_clock(int on);
+Uint32
+sim_ticks(void);
+Uint32
+sim_peek_ticks(void);
+double
+sim_now(void);
+int
+sim_fall(int level);
+int
+sim_decide(AI_Player *ai, void **state, Grid *g, play_piece *cp, 
+	play_piece *np, AI_Placement *played, int pieces, int bw, int fall, 
+	int *col, int *row, int *rot);
+int
+sim_play_game(Sim_Game *sg);
@@ -8,6 +8,8 @@ play_sound(sound_style *ss, int which, int delay);
 void
 stop_all_playing(void);
 void
+sound_mute(int on);
+void
 play_all_sounds(sound_style *ss);
 sound_styles
 load_sound_styles(int sound_wanted);
@@ -0,0 +1,14 @@
+void
+timer_init(Timer_Queue *q, int max);
+void
+timer_free(Timer_Queue *q);
+void
+timer_set(Timer_Queue *q, int id, Uint32 when);
+void
+timer_cancel(Timer_Queue *q, int id);
+Uint32
+timer_when(Timer_Queue *q, int id);
+int
+timer_due(Timer_Queue *q, int id, Uint32 now);
+int
+timer_next(Timer_Queue *q, Uint32 *when);
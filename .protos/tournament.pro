@@ -0,0 +1,3 @@
+int
+tournament_play(Tournament *t, AI_Players *ai, piece_style *ps,
+	color_style *cs);
@@ -0,0 +1,2 @@
+int
+tune_play(Tuner *t, AI_Players *ais, piece_style *ps, color_style *cs);
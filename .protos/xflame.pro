@@ -1,4 +1,5 @@
-
+int
+atris_flame_wait(void);
 void 
 atris_run_flame(void);
 void
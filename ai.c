@@ -15,6 +15,9 @@
 #include "sound.h"
 #include "ai.h"
 #include "menu.h"
+#include "options.h"
+#include "sim.h"
+#include "plugin.h"
 
 #include ".protos/event.pro"
 #include ".protos/identity.pro"
@@ -33,6 +36,27 @@ typedef struct wessy_struct {
     Grid tg;
 } Wessy_State;
 
+/*
+ * Every placement of one piece that Double-Think has looked at: where it
+ * went, what the board looks like afterwards and how good that board is
+ * by itself. order[] lists the placements from best to worst once the
+ * ply is complete.
+ */
+typedef struct double_ply_struct {
+    int n, max;		/* placements tried, room for */
+    int *col;
+    int *rot;
+    int *weight;
+    int *order;
+    Grid *board;
+    Grid_Masks *masks;
+} Double_Ply;
+
+typedef enum {
+    DOUBLE_ALPHA,	/* dropping the current piece everywhere */
+    DOUBLE_BETA,	/* dropping the next piece after the best of those */
+} Double_Stage;
+
 typedef struct double_struct {
     int know_what_to_do;
 
@@ -40,18 +64,27 @@ typedef struct double_struct {
     int desired_rot;
     int best_weight;
 
-    int stage_alpha;
-    int cur_alpha_col;
-    int cur_alpha_rot;
-    Grid ag;
-    int cur_beta_col;
-    int cur_beta_rot;
-    Grid tg;
+    Double_Stage stage;
+    int next_try;	/* which (col,rot) to drop next */
+    int expanding;	/* which alpha placement beta is working under */
+    int chosen;		/* alpha placement we are heading for, or -1 */
+    int reusable;	/* cont() handed us last turn's beta placements */
+    play_piece chosen_np; /* the next piece when we chose */
+
+    Double_Ply alpha;	/* current piece */
+    Double_Ply beta;	/* next piece, under alpha.order[expanding] */
+    Double_Ply best_beta; /* next piece, under the chosen placement */
 } Double_State;
 
+/* alpha placements worth expanding, best static weight first */
+#define DOUBLE_KEEP	8
+
 #define WES_MIN_COL -4
 static int weight_board(Grid *g);
 
+/* what the AIs have been up to on this thread */
+static __thread AI_Counters ai_counters;
+
 /***************************************************************************
  * The code here determines what the board would look like after all the
  * color-sliding and tetris-clearing that would happen if you pasted the
@@ -59,13 +92,15 @@ static int weight_board(Grid *g);
  * rotation (current_rot). You are welcome to copy it. 
  *
  * Returns -1 on failure or the number of lines cleared.
- ***************************************************************************/
+ *********************************************************************PROTO*/
 int
 drop_piece_on_grid(Grid *g, play_piece *pp, int col, int row, int rot)
 {
     int should_we_loop = 0;
     int lines_cleared = 0;
+    int rounds = 0;
 
+    ai_counters.drops++;
     if (!valid_position(pp, col, row, rot, g))
 	return -1;
 
@@ -97,20 +132,156 @@ drop_piece_on_grid(Grid *g, play_piece *pp, int col, int row, int rot)
 
 	if (determine_falling(g)) {
 	    do { 
+		ai_counters.gravity++;
 		fall_down(g);
 		cleanup_grid(g);
 		run_gravity(g);
 	    } while (determine_falling(g));
 	    should_we_loop = 1;
+	    rounds++;
 	}
     } while (should_we_loop);
     /* 
      * Simulation code ends here. 
      * *-*-*-*
      */
+    ai_counters.cascade[min(rounds, AI_CASCADE_MAX-1)]++;
     return lines_cleared;
 }
 
+/***************************************************************************
+ *      ai_take_counters()
+ * Hands over this thread's AI_Counters and starts them again from zero.
+ *********************************************************************PROTO*/
+void
+ai_take_counters(AI_Counters *c)
+{
+    *c = ai_counters;
+    memset(&ai_counters, 0, sizeof(ai_counters));
+}
+
+/***************************************************************************
+ *      ai_counters_mark()
+ * Remembers where this thread's AI_Counters are up to, for
+ * ai_counters_add().
+ *********************************************************************PROTO*/
+void
+ai_counters_mark(AI_Counters *mark)
+{
+    *mark = ai_counters;
+}
+
+/***************************************************************************
+ *      counters_add()
+ * Adds plus - minus to *into, field by field. A new AI_Counters field
+ * has to be added here too.
+ ***************************************************************************/
+static void
+counters_add(AI_Counters *into, const AI_Counters *plus, 
+	const AI_Counters *minus)
+{
+    int i;
+
+    into->decisions += plus->decisions - minus->decisions;
+    into->candidates += plus->candidates - minus->candidates;
+    into->drops += plus->drops - minus->drops;
+    into->gravity += plus->gravity - minus->gravity;
+    for (i=0; i<AI_CASCADE_MAX; i++)
+	into->cascade[i] += plus->cascade[i] - minus->cascade[i];
+    into->evals += plus->evals - minus->evals;
+    into->thinks += plus->thinks - minus->thinks;
+    into->settled += plus->settled - minus->settled;
+    into->overruns += plus->overruns - minus->overruns;
+    into->think_ticks += plus->think_ticks - minus->think_ticks;
+}
+
+/***************************************************************************
+ *      ai_counters_add()
+ * Adds what this thread has done since ai_counters_mark() to *into: that
+ * is how one player's share of the work gets to its own books.
+ *********************************************************************PROTO*/
+void
+ai_counters_add(AI_Counters *into, const AI_Counters *mark)
+{
+    counters_add(into, &ai_counters, mark);
+}
+
+/***************************************************************************
+ *      double_ply_alloc()
+ * Room for every placement of one piece on a grid like g.
+ ***************************************************************************/
+static void
+double_ply_alloc(Double_Ply *p, Grid *g)
+{
+    int i, max = 4 * (g->w - WES_MIN_COL);
+
+    p->n = 0;
+    p->max = max;
+    Calloc(p->col, int *, max * sizeof(*p->col));
+    Calloc(p->rot, int *, max * sizeof(*p->rot));
+    Calloc(p->weight, int *, max * sizeof(*p->weight));
+    Calloc(p->order, int *, max * sizeof(*p->order));
+    Calloc(p->board, Grid *, max * sizeof(*p->board));
+    Calloc(p->masks, Grid_Masks *, max * sizeof(*p->masks));
+    for (i=0; i<max; i++)
+	p->board[i] = generate_board(g->w, g->h, 0);
+}
+
+/***************************************************************************
+ *      double_ply_try()
+ * Drops the piece at the given spot on a copy of g and remembers the
+ * result if it is a legal placement and there is room for it.
+ ***************************************************************************/
+static void
+double_ply_try(Double_Ply *p, Grid *g, play_piece *pp, int col, int row,
+	int rot)
+{
+    Grid *t;
+
+    if (p->n >= p->max)
+	return;
+    t = &p->board[p->n];
+    ai_counters.candidates++;
+    memcpy(t->contents, g->contents, (g->w * g->h * sizeof(t->contents[0])));
+    memcpy(t->fall, g->fall, (g->w * g->h * sizeof(t->fall[0])));
+
+    if (drop_piece_on_grid(t, pp, col, row, rot) != -1) {
+	p->col[p->n] = col;
+	p->rot[p->n] = rot;
+	grid_masks(t, &p->masks[p->n]);
+	p->n++;
+    }
+}
+
+/***************************************************************************
+ *      double_ply_finish()
+ * Weighs every placement in one batch and sorts them, best first.
+ ***************************************************************************/
+static void
+double_ply_finish(Double_Ply *p)
+{
+    int i, j;
+
+    weight_boards(p->masks, p->n, p->weight);
+    for (i=0; i<p->n; i++) {
+	int k = i;
+	for (j=i; j>0 && p->weight[p->order[j-1]] > p->weight[k]; j--)
+	    p->order[j] = p->order[j-1];
+	p->order[j] = k;
+    }
+}
+
+/***************************************************************************
+ *      double_ply_swap()
+ ***************************************************************************/
+static void
+double_ply_swap(Double_Ply *a, Double_Ply *b)
+{
+    Double_Ply t = *a;
+    *a = *b;
+    *b = t;
+}
+
 /***************************************************************************
  *      double_ai_reset()
  **************************************************************************/
@@ -123,105 +294,207 @@ double_ai_reset(void *state, Grid *g)
     if (state == NULL) {
 	/* first time we've been called ... */
 	Calloc(retval, Double_State *, sizeof(Double_State));
+	double_ply_alloc(&retval->alpha, g);
+	double_ply_alloc(&retval->beta, g);
+	double_ply_alloc(&retval->best_beta, g);
+	retval->chosen = -1;
     } else
 	retval = state;
     Assert(retval);
+
+    retval->reusable = 0;
     retval->know_what_to_do=0;
     retval->desired_col = g->w / 2;
     retval->desired_rot = 0;
     retval->best_weight = 1<<30;
-    retval->stage_alpha = 1;
-    retval->cur_alpha_col = WES_MIN_COL;
-    retval->cur_alpha_rot = 0;
-    retval->cur_beta_col = WES_MIN_COL;
-    retval->cur_beta_rot = 0;
-
-    if (retval->tg.contents == NULL)
-	retval->tg = generate_board(g->w, g->h, 0); 
-    if (retval->ag.contents == NULL)
-	retval->ag = generate_board(g->w, g->h, 0); 
+    retval->stage = DOUBLE_ALPHA;
+    retval->next_try = 0;
+    retval->expanding = 0;
+    retval->chosen = -1;
+    retval->alpha.n = 0;
+    retval->beta.n = 0;
 
     return retval;
 }
 
 /***************************************************************************
+ *      double_ai_cont()
+ * If the last piece went where we meant it to, nothing else happened to
+ * the board in the meantime and the new piece is the "next" one we
+ * planned with, the placements we tried for it are still good: they
+ * become this turn's alpha placements, already weighed and sorted, and
+ * we head for the best of them at once while double_ai_think() looks a
+ * piece further ahead.
+ **************************************************************************/
+static void *
+double_ai_cont(void *state, Grid *g, play_piece *pp, AI_Placement *played)
+{
+    Double_State *ds = (Double_State *) state;
+    int c = ds->chosen;
+    int carry = c >= 0 && ds->best_beta.n > 0 &&
+	played->col == ds->alpha.col[c] && played->rot == ds->alpha.rot[c] &&
+	pp->base == ds->chosen_np.base && 
+	pp->special == ds->chosen_np.special &&
+	!memcmp(pp->colormap, ds->chosen_np.colormap, sizeof(pp->colormap)) &&
+	!memcmp(ds->alpha.board[c].contents, g->contents,
+		g->w * g->h * sizeof(g->contents[0]));
+
+    double_ai_reset(ds, g);
+    if (carry) {
+	double_ply_swap(&ds->alpha, &ds->best_beta);
+	ds->best_beta.n = 0;
+	ds->desired_col = ds->alpha.col[ds->alpha.order[0]];
+	ds->desired_rot = ds->alpha.rot[ds->alpha.order[0]];
+	ds->reusable = 1;
+    }
+    return ds;
+}
+
+/***************************************************************************
+ *      double_ply_free()
+ ***************************************************************************/
+static void
+double_ply_free(Double_Ply *p)
+{
+    int i;
+
+    for (i=0; i<p->max; i++)
+	free_board(&p->board[i]);
+    Free(p->col); Free(p->rot); Free(p->weight); Free(p->order);
+    Free(p->board); Free(p->masks);
+}
+
+/***************************************************************************
+ *      double_ai_release()
+ **************************************************************************/
+static void
+double_ai_release(void *state)
+{
+    Double_State *ds = (Double_State *) state;
+
+    double_ply_free(&ds->alpha);
+    double_ply_free(&ds->beta);
+    double_ply_free(&ds->best_beta);
+    free(ds);
+}
+
+/***************************************************************************
+ *      double_ai_decide()
+ * Settles on alpha placement i.
+ ***************************************************************************/
+static void
+double_ai_decide(Double_State *ds, int i, int weight)
+{
+    ds->best_weight = weight;
+    ds->desired_col = ds->alpha.col[i];
+    ds->desired_rot = ds->alpha.rot[i];
+    ds->chosen = i;
+    ds->best_beta.n = 0;	/* until double_ai_think() says otherwise */
+}
+
+/***************************************************************************
+ *      double_ai_think()
+ * Ruminates for Double-Think.
  *
+ * Each placement of the current piece (alpha) is weighed by itself
+ * first. Only the DOUBLE_KEEP best of those are expanded by trying every
+ * placement of the next piece (beta) on top of them; the alpha placement
+ * whose best beta follow-up is lightest wins. The beta placements behind
+ * the winner are kept for double_ai_cont() to carry over.
  ***************************************************************************/
 static void
 double_ai_think(void *data, Grid *g, play_piece *pp, play_piece *np, 
 	int col, int row, int rot)
 {
     Double_State *ds = (Double_State *)data;
-    Uint32 incoming_time = SDL_GetTicks();
+    Uint32 incoming_time = sim_ticks();
+    int ncols = g->w - WES_MIN_COL;
 
     Assert(ds);
 
-    for (;SDL_GetTicks() == incoming_time;) {
+    if (ds->reusable) {
+	/* keep the placements cont() gave us that we can reach from here */
+	int i, n = ds->alpha.n;
+	ds->reusable = 0;
+	ds->alpha.n = 0;
+	for (i=0; i<n; i++) {
+	    int k = ds->alpha.order[i];
+	    if (valid_position(pp, ds->alpha.col[k], row,
+			ds->alpha.rot[k], g)) 
+		ds->alpha.order[ds->alpha.n++] = k;
+	}
+	if (ds->alpha.n > 0) {
+	    ds->stage = DOUBLE_BETA;
+	    ds->next_try = 0;
+	    ds->expanding = 0;
+	    ds->beta.n = 0;
+	}
+	if (ds->stage == DOUBLE_BETA) {
+	    /* alpha.order[] now holds exactly the placements to consider */
+	    int k = ds->alpha.order[0];
+	    if (ds->alpha.weight[k] <= 0) {
+		double_ai_decide(ds, k, ds->alpha.weight[k]);
+		ds->know_what_to_do = 1;
+	    }
+	} else 
+	    ds->alpha.n = 0;
+    }
+
+    for (;sim_ticks() == incoming_time;) {
 	if (ds->know_what_to_do) 
 	    return;
 
-	if (ds->stage_alpha) {
-	    memcpy(ds->ag.contents, g->contents, (g->w * g->h * sizeof(ds->ag.contents[0])));
-	    memcpy(ds->ag.fall, g->fall, (g->w * g->h * sizeof(ds->ag.fall[0])));
-
-	    if ( drop_piece_on_grid(&ds->ag, pp, ds->cur_alpha_col, row,
-		    ds->cur_alpha_rot) != -1) {
-		int weight;
-		/* success */
-		ds->cur_beta_col = WES_MIN_COL;
-		ds->cur_beta_rot = 0;
-
-		ds->stage_alpha = 0;
-
-		weight = weight_board(&ds->ag);
-		if (weight <= 0) {
-		    ds->best_weight = weight;
-		    ds->desired_col = ds->cur_alpha_col;
-		    ds->desired_rot = ds->cur_alpha_rot;
-		    ds->know_what_to_do = 1;
-		}
-	    } else {
-		/* advance alpha */
-		if (++ds->cur_alpha_col == g->w) {
-		    ds->cur_alpha_col = WES_MIN_COL;
-		    if (++ds->cur_alpha_rot == 4) {
-			ds->cur_alpha_rot = 0;
-			ds->know_what_to_do = 1;
-		    }
-		}
+	if (ds->stage == DOUBLE_ALPHA) {
+	    if (ds->next_try < 4 * ncols) {
+		double_ply_try(&ds->alpha, g, pp, 
+			WES_MIN_COL + ds->next_try % ncols, row,
+			ds->next_try / ncols);
+		ds->next_try++;
+		continue;
+	    } 
+	    double_ply_finish(&ds->alpha);
+	    if (ds->alpha.n == 0) {
+		ds->know_what_to_do = 1;
+		return;
+	    }
+	    if (ds->alpha.weight[ds->alpha.order[0]] <= 0) {
+		/* you'll win! */
+		double_ai_decide(ds, ds->alpha.order[0],
+			ds->alpha.weight[ds->alpha.order[0]]);
+		ds->know_what_to_do = 1;
+		return;
 	    }
+	    ds->stage = DOUBLE_BETA;
+	    ds->next_try = 0;
+	    ds->expanding = 0;
+	    ds->beta.n = 0;
 	} else {
 	    /* stage beta */
-	    int weight;
-	    
-	    memcpy(ds->tg.contents, ds->ag.contents, (ds->ag.w * ds->ag.h * sizeof(ds->ag.contents[0])));
-	    memcpy(ds->tg.fall, ds->ag.fall, (ds->ag.w * ds->ag.h * sizeof(ds->ag.fall[0])));
-
-	    if (drop_piece_on_grid(&ds->tg, np, ds->cur_beta_col, row,
-		    ds->cur_beta_rot) != -1) {
-		/* success */
-		weight = 1+weight_board(&ds->tg);
+	    int a = ds->alpha.order[ds->expanding];
+
+	    if (ds->next_try < 4 * ncols) {
+		double_ply_try(&ds->beta, &ds->alpha.board[a], np, 
+			WES_MIN_COL + ds->next_try % ncols, row,
+			ds->next_try / ncols);
+		ds->next_try++;
+		continue;
+	    }
+	    double_ply_finish(&ds->beta);
+	    if (ds->beta.n > 0) {
+		int weight = 1 + ds->beta.weight[ds->beta.order[0]];
 		if (weight < ds->best_weight) {
-		    ds->best_weight = weight;
-		    ds->desired_col = ds->cur_alpha_col;
-		    ds->desired_rot = ds->cur_alpha_rot;
+		    double_ai_decide(ds, a, weight);
+		    ds->chosen_np = *np;
+		    double_ply_swap(&ds->beta, &ds->best_beta);
 		}
 	    }
-
-	    if (++ds->cur_beta_col == g->w) {
-		ds->cur_beta_col = WES_MIN_COL;
-		if (++ds->cur_beta_rot == 2) {
-		    ds->cur_beta_rot = 0;
-
-		    ds->stage_alpha = 1;
-		    if (++ds->cur_alpha_col == g->w) {
-			ds->cur_alpha_col = WES_MIN_COL;
-			if (++ds->cur_alpha_rot == 4) {
-			    ds->cur_alpha_rot = 0;
-			    ds->know_what_to_do = 1;
-			}
-		    }
-		}
+	    ds->beta.n = 0;
+	    ds->next_try = 0;
+	    if (++ds->expanding == min(ds->alpha.n, DOUBLE_KEEP)) {
+		if (ds->chosen < 0)	/* nothing fits after any of them */
+		    double_ai_decide(ds, ds->alpha.order[0],
+			    ds->alpha.weight[ds->alpha.order[0]]);
+		ds->know_what_to_do = 1;
 	    }
 	} /* endof: stage beta */
     } /* for: iterations */
@@ -250,56 +523,182 @@ double_ai_move(void *state, Grid *g, play_piece *pp, play_piece *np,
 	return MOVE_NONE;
 }
 
-/***************************************************************************
- *      weight_board()
- * Determines the value the AI places on the given board configuration.
- * This is a Wes-specific function that is used to evaluate the result of
- * a possible AI choice. In the end, the choice with the best weight is
- * selected.
- ***************************************************************************/
-static int
-weight_board(Grid *g)
+/*
+ * The batch evaluators below score MASK_LANES (ai.h) boards side by side,
+ * one board per vector lane. GCC turns these into SSE/NEON instructions
+ * where the machine has them and into plain loops where it does not.
+ */
+typedef int	Lane_Int  __attribute__ ((vector_size (4 * MASK_LANES)));
+typedef Uint32	Lane_Mask __attribute__ ((vector_size (4 * MASK_LANES)));
+
+/* the lane-wise version of MASK_POPCOUNT() */
+static Lane_Int
+lane_popcount(Lane_Mask v)
+{
+    v = v - ((v >> 1) & 0x55555555);
+    v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+    v = (v + (v >> 4)) & 0x0F0F0F0F;
+    return (Lane_Int) ((v * 0x01010101) >> 24);
+}
+
+/*
+ * MASK_LANES boards of the same size side by side, laid out as Grid_Masks
+ * has them: lane i of occupied[x] is column x of board i. The lane-wise
+ * evaluators work on these, wherever the boards came from.
+ */
+typedef struct lane_masks_struct {
+    int w, h;
+    Lane_Mask occupied[GRID_MASK_MAX_W];
+    Lane_Mask garbage[GRID_MASK_MAX_W];
+    Lane_Mask same_left[GRID_MASK_MAX_W];
+} Lane_Masks;
+
+/* puts boards m[0] .. m[MASK_LANES-1] side by side */
+static void
+lane_masks(Lane_Masks *l, Grid_Masks *m[MASK_LANES])
 {
-    int x,y;
-    int w = 0;
-    int holes = 0;
-    int same_color = 0;
-    int garbage = 0;
+    int x, i;
+
+    l->w = m[0]->w;
+    l->h = m[0]->h;
+    for (i=0; i<MASK_LANES; i++) 
+	Assert(m[i]->w == l->w && m[i]->h == l->h);
+    for (x=0; x<l->w; x++)
+	for (i=0; i<MASK_LANES; i++) {
+	    l->occupied[x][i] = m[i]->occupied[x];
+	    l->garbage[x][i] = m[i]->garbage[x];
+	    l->same_left[x][i] = m[i]->same_left[x];
+	}
+}
 
+/*
+ * The weights the evaluators go by. The profile is what everybody uses
+ * unless a thread says otherwise (the tuner gives every candidate its
+ * own); --profile=FILE replaces it at startup.
+ */
+static AI_Weights ai_profile = {
     /* favor the vast extremes ... */
-    int badness[10] =  { 7, 9, 9, 9, 9,  9, 9, 9, 9, 7};
+    { 7, 9, 9, 9, 9,  9, 9, 9, 9, 7},	/* badness */
+    6,		/* hole */
+    4,		/* same_color */
+    1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0,	/* Kiri's */
+};
+static __thread const AI_Weights *ai_thread_weights = NULL;
+#define AI_WEIGHTS()	(ai_thread_weights ? ai_thread_weights : &ai_profile)
+
+/* the parameter vector, in profile-file names */
+static const char *ai_weight_name[AI_WEIGHTS_N] = {
+    "badness_0", "badness_1", "badness_2", "badness_3", "badness_4",
+    "badness_5", "badness_6", "badness_7", "badness_8", "badness_9",
+    "hole", "same_color",
+    "max_height", "avg_height", "bumpiness", "holes", "canyons",
+    "garbage", "row", "lines",
+};
+
+/***************************************************************************
+ *      weight_lanes()
+ * Determines the value the AI places on MASK_LANES board configurations
+ * at once: out[i] is that of board i. This is a Wes-specific function
+ * that is used to evaluate the result of a possible AI choice. In the
+ * end, the choice with the best weight is selected. Walks each column
+ * from the bottom up, carrying one running "possible_holes" count per
+ * lane.
+ ***************************************************************************/
+static void
+weight_lanes(Lane_Masks *l, int *out)
+{
+    const AI_Weights *wt = AI_WEIGHTS();
+    int W = l->w, H = l->h;
+    int x,y,i;
+    Lane_Int w = { 0 }, holes = { 0 }, same_color = { 0 }, garbage = { 0 };
 
     /* 
      * Simple Heuristic: highly placed blocks are bad, as are "holes":
-     * blank areas with blocks above them.
+     * blank areas with blocks above them. A hole is charged to the first
+     * non-garbage block above it.
      */
-    for (x=0; x<g->w; x++) {
-	int possible_holes = 0;
-	for (y=g->h-1; y>=0; y--) {
-	    int what;
-	    if ((what = GRID_CONTENT(*g,x,y))) {
-		w += 2 * (g->h - y) * badness[x] / 3;
-		if (possible_holes) {
-		    if (what != 1) 
-			holes += 3 * ((g->h - y)) * g->w * possible_holes;
-		    possible_holes = 0;
-		}
+    for (x=0; x<W; x++) {
+	Lane_Mask occ = l->occupied[x], garb = l->garbage[x];
+	Lane_Int possible_holes = { 0 };
 
-		if (x > 1 && what)
-		    if (GRID_CONTENT(*g,x-1,y) == what)
-			same_color++;
-		if (what == 1)
-		    garbage++;
-	    } else {
-		possible_holes++;
-	    }
+	garbage += lane_popcount(garb);
+	if (x > 1)
+	    same_color += lane_popcount(l->same_left[x]);
+
+	for (y=H-1; y>=0; y--) {
+	    Lane_Int block = -(Lane_Int) ((occ >> y) & 1);
+	    Lane_Int solid = block & ~(-(Lane_Int) ((garb >> y) & 1));
+
+	    w += block & (2 * (H - y) * wt->badness[x] / 3);
+	    holes += solid & (possible_holes * ((H - y) * W));
+	    possible_holes = (possible_holes + 1) & ~block;
 	}
     }
-    w += holes * 2;
-    w += same_color * 4;
-    if (garbage == 0) w = 0;	/* you'll win! */
+    w += holes * wt->hole;
+    w += same_color * wt->same_color;
+    w &= (garbage != 0);	/* you'll win! */
+
+    for (i=0; i<MASK_LANES; i++)
+	out[i] = w[i];
+}
+
+/***************************************************************************
+ *      weight_masks()
+ * weight_lanes() for a single board.
+ ***************************************************************************/
+static int
+weight_masks(Grid_Masks *m)
+{
+    Grid_Masks *lane[MASK_LANES];
+    Lane_Masks l;
+    int out[MASK_LANES];
+    int i;
+
+    ai_counters.evals++;
+    for (i=0; i<MASK_LANES; i++)
+	lane[i] = m;
+    lane_masks(&l, lane);
+    weight_lanes(&l, out);
+    return out[0];
+}
+
+/***************************************************************************
+ *      weight_board()
+ * weight_masks() for a plain grid.
+ ***************************************************************************/
+static int
+weight_board(Grid *g)
+{
+    Grid_Masks m;
+
+    grid_masks(g, &m);
+    return weight_masks(&m);
+}
 
-    return w;
+/***************************************************************************
+ *      weight_boards()
+ * weight_board() for many boards at once: scores[i] is the weight of the
+ * board summarized in m[i]. The boards must all be the same size.
+ *********************************************************************PROTO*/
+void
+weight_boards(Grid_Masks *m, int n, int *scores)
+{
+    int i,j;
+
+    ai_counters.evals += n;
+    for (i=0; i<n; i+=MASK_LANES) {
+	Grid_Masks *lane[MASK_LANES];
+	Lane_Masks l;
+	int out[MASK_LANES];
+
+	/* short final batches just repeat their last board */
+	for (j=0; j<MASK_LANES; j++)
+	    lane[j] = &m[min(i+j, n-1)];
+	lane_masks(&l, lane);
+	weight_lanes(&l, out);
+	for (j=0; j<MASK_LANES && i+j<n; j++)
+	    scores[i+j] = out[j];
+    }
 }
 
 /***************************************************************************
@@ -308,7 +707,7 @@ weight_board(Grid *g)
  *
  * This function is called every so (about every fall_event_interval) by
  * event_loop(). The AI is expected to think for < 1 "tick" (as in,
- * SDL_GetTicks()). 
+ * sim_ticks()). 
  *
  * Input:
  * 	Grid *g		Your side of the board. The currently piece (the
@@ -334,11 +733,11 @@ wes_ai_think(void *data, Grid *g, play_piece *pp, play_piece *np,
 {
     int weight;
     Wessy_State *ws = (Wessy_State *)data;
-    Uint32 incoming_time = SDL_GetTicks();
+    Uint32 incoming_time = sim_ticks();
 
     Assert(ws);
 
-    for (;SDL_GetTicks() == incoming_time;) {
+    for (;sim_ticks() == incoming_time;) {
 
 	if (ws->know_what_to_do) 
 	    return;
@@ -346,6 +745,7 @@ wes_ai_think(void *data, Grid *g, play_piece *pp, play_piece *np,
 	memcpy(ws->tg.contents, g->contents, (g->w * g->h * sizeof(ws->tg.contents[0])));
 	memcpy(ws->tg.fall, g->fall, (g->w * g->h * sizeof(ws->tg.fall[0])));
 	/* what would happen if we dropped ourselves on cc, current_rot now? */
+	ai_counters.candidates++;
 	if (drop_piece_on_grid(&ws->tg, pp, ws->cc, row, ws->current_rot) != -1) {
 	    weight = weight_board(&ws->tg);
 
@@ -376,13 +776,13 @@ beginner_ai_think(void *data, Grid *g, play_piece *pp, play_piece *np,
 
     Assert(ws);
 
-    if (ws->know_what_to_do || (SDL_GetTicks() & 3)) 
+    if (ws->know_what_to_do || (sim_ticks() & 3)) 
 	return;
 
     memcpy(ws->tg.contents, g->contents, (g->w * g->h * sizeof(ws->tg.contents[0])));
     memcpy(ws->tg.fall, g->fall, (g->w * g->h * sizeof(ws->tg.fall[0])));
     /* what would happen if we dropped ourselves on cc, current_rot now? */
-
+    ai_counters.candidates++;
     if (drop_piece_on_grid(&ws->tg, pp, ws->cc, row, ws->current_rot) != -1) {
 
 	weight = weight_board(&ws->tg);
@@ -435,6 +835,19 @@ wes_ai_reset(void *state, Grid *g)
     return retval;
 }
 
+/***************************************************************************
+ *      wes_ai_release()
+ ***************************************************************************/
+static void
+wes_ai_release(void *state)
+{
+    Wessy_State *ws = (Wessy_State *) state;
+
+    if (ws->tg.contents)
+	free_board(&ws->tg);
+    free(ws);
+}
+
 /***************************************************************************
  *      wes_ai_move()
  * Determines the AI's next move. All of the inputs are as for ai_think().
@@ -489,148 +902,759 @@ typedef struct Aliz_State_struct {
 
 
 /*******************************************************************
- *   evalBoard()
- * Evaluates the 'value' of a given board configuration.
- * Return values range from 0 (in theory) to g->h + <something>.
- * The lowest value is the best.
+ *   evalSum()
+ * Puts the pieces of evalLanes() together, weighted by the profile.
+ *******************************************************************/
+static double evalSum(int maxHeight, double avgHeight, int minHeight,
+    int nHoles, int nCanyons, int nGarbage, int h, int row, int nLines)
+{
+  const AI_Weights *wt = AI_WEIGHTS();
+
+  return wt->max_height * maxHeight*h + wt->avg_height * avgHeight +
+    wt->bumpiness * (maxHeight - minHeight) + wt->holes * nHoles +
+    wt->canyons * nCanyons + wt->garbage * nGarbage + 
+    wt->row * (h - row) - wt->lines * nLines*nLines;
+}
+
+/*******************************************************************
+ *   evalLanes()
+ * Evaluates the 'value' of MASK_LANES board configurations at once:
+ * out[i] is that of board i after clearing nLines[i] lines with a
+ * piece that landed on row[i]. Return values range from 0 (in theory)
+ * to h + <something>. The lowest value is the best. The canyon sum
+ * walks the rows instead of the set bits so that every lane does the
+ * same work.
  * Check separately for garbage?
  *******************************************************************/
-static double evalBoard(Grid* g, int nLines, int row)
+static void evalLanes(Lane_Masks* l, int nLines[MASK_LANES],
+    int row[MASK_LANES], double *out)
 {
   /* Return the max height plus the number of holes under blocks */
   /* Should encourage smaller heights */
-  int x, y, z;
-  int maxHeight = 0, minHeight = g->h;
-  int nHoles = 0, nGarbage = 0, nCanyons = 0;
-  double avgHeight = 0;
-  int nColumns = g->w;
+  int W = l->w, H = l->h;
+  int x, y, i;
+  Lane_Int maxHeight = { 0 }, minHeight = { 0 }, sumHeight = { 0 };
+  Lane_Int nHoles = { 0 }, nGarbage = { 0 }, nCanyons = { 0 };
+  Lane_Mask range;
 
   /* Find the minimum, maximum, and average height */
-  for (x=0; x<g->w; x++) {
-    int height = g->h;
-    char gc;
-    for (y=0; y<g->h; y++) {
-      gc = GRID_CONTENT(*g, x, y);
-      if (gc == 0) height--;
-      else {
-	/* garbage */
-	if (gc == 1) nGarbage++;
-	/* Penalize for holes under blocks */
-	for (z=y+1; z<g->h; z++) {
-	  char gc2 = GRID_CONTENT(*g, x, z);
-	  /* count the holes under here */
-	  if (gc2 == 0) {
-	    nHoles += 2; /* these count for double! */
-	  }
-	  else if (gc2 == 1) nGarbage++;
-	}
-	break;
-      }
+  minHeight += H;
+  for (x=0; x<W; x++) {
+    Lane_Mask occ = l->occupied[x];
+    Lane_Int height = { 0 }, seen = { 0 };
+
+    /* height is the number of rows from the first block down */
+    for (y=0; y<H; y++) {
+      seen |= -(Lane_Int) ((occ >> y) & 1);
+      height -= seen;
+    }
+    /* Penalize for holes under blocks: these count for double! */
+    nHoles += 2 * (height - lane_popcount(occ));
+    nGarbage += lane_popcount(l->garbage[x]);
+    sumHeight += height;
+    {
+      Lane_Int up = (height > maxHeight), down = (height < minHeight);
+      maxHeight = (height & up) | (maxHeight & ~up);
+      minHeight = (height & down) | (minHeight & ~down);
     }
-    avgHeight += height;
-    if (height > maxHeight) maxHeight = height;
-    if (height < minHeight) minHeight = height;
   }
-  avgHeight /= nColumns;
+  nHoles *= H;
 
-  nHoles *= g->h;
-  
   /* Find the number of holes lower than the maxHeight */
-  for (x=0; x<g->w; x++) {
-    for (y=g->h-maxHeight; y<g->h; y++) {
-      /* count the canyons under here */
-      if (GRID_CONTENT(*g, x, y) == 0&&
-	  ((x == 0 || GRID_CONTENT(*g, x-1, y)) &&
-	   (x == g->w-1 || GRID_CONTENT(*g, x+1, y))))
-	nCanyons += y;
-      }
+  range = ((Lane_Mask) { 0 } + 1) << (Lane_Mask) (H - maxHeight);
+  range = ~(range - 1) & ((1U << H) - 1);
+  for (x=0; x<W; x++) {
+    Lane_Mask canyon = range & ~l->occupied[x];
+    if (x > 0) canyon &= l->occupied[x-1];
+    if (x < W-1) canyon &= l->occupied[x+1];
+    for (y=0; y<H; y++)
+      nCanyons += -(Lane_Int) ((canyon >> y) & 1) & y;
   }
 
-#ifdef DEBUG
-  printf("*** %d holes ", nHoles);
-#endif
-  
-  return (double)(maxHeight*(g->h) + avgHeight + (maxHeight - minHeight) +
-		  nHoles + nCanyons + nGarbage + (g->h - row)
-		  - nLines*nLines);
+  for (i=0; i<MASK_LANES; i++) {
+    double avgHeight = (double)sumHeight[i] / W;
+    out[i] = evalSum(maxHeight[i], avgHeight, minHeight[i], nHoles[i],
+	nCanyons[i], nGarbage[i], H, row[i], nLines[i]);
+  }
 }
 
 /*******************************************************************
- *   cogitate()
- * Kiri's AI 'thinking' function.  Again, called once 'every so'
- * by event_loop().  
+ *   evalMasks()
+ * evalLanes() for a single board.
  *******************************************************************/
-static void 
-alizCogitate(void *state, Grid* g, play_piece* pp, play_piece* np, 
-	int col, int row, int rot)
+static double evalMasks(Grid_Masks* m, int nLines, int row)
 {
-  Aliz_State *as = (Aliz_State *)state;
-  double eval, evalLeft = -1, evalRight = -1;
-  int nLines;
-
-  Assert(as);
-    
-  if (as->foundBest) return;
-  
-  memcpy(as->kg.contents, g->contents, (g->w * g->h * sizeof(as->kg.contents[0])));
-  memcpy(as->kg.fall, g->fall, (g->w * g->h * sizeof(*as->kg.fall)));
-
-  if (as->bestEval == -1) {
-    /* It's our first think! */
-    as->checkColumn = col; /* check this column first */
-    as->checkRotation = 0; /* check no rotation (it's easy!) */
-    as->checkSides = 0; /* middle */
-  }
-  else {
-    /* Try the next thing */
-    as->checkRotation = (as->checkRotation+1)%4;
-    if (as->checkRotation == 0) {
-      /* Try a new column */
-      /* Go all the way left first */
-      if (as->checkColumn == col || as->checkColumn < col) {
-	as->checkColumn--;
-	if (!valid_position(pp, as->checkColumn, row,
-			    as->checkRotation, &as->kg)) {
-	  as->checkColumn = col + 1;
-	  if (!valid_position(pp, as->checkColumn, row,
-			      as->checkRotation, &as->kg)) {
-	    /* skip this one */
-	    return;
-	  }
-	}
-      }
-      else {
-	/* Now go all the way to the right */
-	as->checkColumn++;
-	if (!valid_position(pp, as->checkColumn, row,
-			    as->checkRotation, &as->kg)) {
-	  /* skip this one */
-	  return;
-	}
-      }
-    } else if (!valid_position(pp, as->checkColumn, row,
-			       as->checkRotation, &as->kg)) {
-      /* as->checkRotation != 0 */
-      if (as->checkColumn >= g->w && as->checkRotation == 3) {
-	/* final one */
-	as->foundBest = TRUE;
-#ifdef DEBUG
-	printf("Aliz: Found best! (last checked %d, %d)\n",
-	       as->checkColumn, as->checkRotation);
-#endif
-	return;
-      }
-      /* Trying a specific rotation; skip this one */
-      else return;
-    }
+  Grid_Masks *lane[MASK_LANES];
+  Lane_Masks l;
+  int lines[MASK_LANES], rows[MASK_LANES];
+  double out[MASK_LANES];
+  int i;
+
+  ai_counters.evals++;
+  for (i=0; i<MASK_LANES; i++) {
+    lane[i] = m;
+    lines[i] = nLines;
+    rows[i] = row;
   }
-#ifdef DEBUG
-  printf("Aliz: trying (col %d, rot %d) ", as->checkColumn, as->checkRotation);
-#endif
+  lane_masks(&l, lane);
+  evalLanes(&l, lines, rows, out);
+  return out[0];
+}
 
-  /* Check for impending doom */
-  if (GRID_CONTENT(*g, col, row+1)) {
-#ifdef DEBUG
+/*******************************************************************
+ *   evalBoard()
+ * evalMasks() for a plain grid.
+ *******************************************************************/
+static double evalBoard(Grid* g, int nLines, int row)
+{
+  Grid_Masks m;
+
+  grid_masks(g, &m);
+  return evalMasks(&m, nLines, row);
+}
+
+/***************************************************************************
+ *      ai_set_profile()
+ * Makes w the weights every AI goes by.
+ *********************************************************************PROTO*/
+void
+ai_set_profile(const AI_Weights *w)
+{
+    ai_profile = *w;
+}
+
+/***************************************************************************
+ *      ai_get_profile()
+ *********************************************************************PROTO*/
+void
+ai_get_profile(AI_Weights *w)
+{
+    *w = ai_profile;
+}
+
+/***************************************************************************
+ *      ai_set_thread_weights()
+ * The AIs on this thread go by w instead of the profile (NULL to stop).
+ * w must stay put until then.
+ *********************************************************************PROTO*/
+void
+ai_set_thread_weights(const AI_Weights *w)
+{
+    ai_thread_weights = w;
+}
+
+/***************************************************************************
+ *      ai_weights_get()
+ * Flattens w into AI_WEIGHTS_N numbers, in profile-file order.
+ *********************************************************************PROTO*/
+void
+ai_weights_get(const AI_Weights *w, double *v)
+{
+    int i;
+
+    for (i=0; i<AI_BADNESS_W; i++)
+	v[i] = w->badness[i];
+    v[i++] = w->hole;
+    v[i++] = w->same_color;
+    v[i++] = w->max_height;
+    v[i++] = w->avg_height;
+    v[i++] = w->bumpiness;
+    v[i++] = w->holes;
+    v[i++] = w->canyons;
+    v[i++] = w->garbage;
+    v[i++] = w->row;
+    v[i++] = w->lines;
+    Assert(i == AI_WEIGHTS_N);
+}
+
+/***************************************************************************
+ *      ai_weights_set()
+ * The other way around. Wes's weights are whole numbers and none of them
+ * may be negative.
+ *********************************************************************PROTO*/
+void
+ai_weights_set(AI_Weights *w, const double *v)
+{
+    int i;
+
+    for (i=0; i<AI_BADNESS_W; i++)
+	w->badness[i] = (int) (max(v[i], 0.0) + 0.5);
+    w->hole = (int) (max(v[i], 0.0) + 0.5); i++;
+    w->same_color = (int) (max(v[i], 0.0) + 0.5); i++;
+    w->max_height = max(v[i], 0.0); i++;
+    w->avg_height = max(v[i], 0.0); i++;
+    w->bumpiness = max(v[i], 0.0); i++;
+    w->holes = max(v[i], 0.0); i++;
+    w->canyons = max(v[i], 0.0); i++;
+    w->garbage = max(v[i], 0.0); i++;
+    w->row = max(v[i], 0.0); i++;
+    w->lines = max(v[i], 0.0); i++;
+    Assert(i == AI_WEIGHTS_N);
+}
+
+/***************************************************************************
+ *      ai_load_weights()
+ * Reads an AI profile: "name = value" lines, '#' for comments. Anything
+ * the file does not mention keeps the value it had in w. Returns 0 if the
+ * file cannot be read.
+ *********************************************************************PROTO*/
+int
+ai_load_weights(const char *filespec, AI_Weights *w)
+{
+    FILE *fin = fopen(filespec, "rt");
+    char buf[1024], name[1024];
+    double v[AI_WEIGHTS_N], x;
+    int i;
+
+    if (!fin) {
+	Debug("Cannot read AI profile [%s]\n", filespec);
+	return 0;
+    }
+    ai_weights_get(w, v);
+    while (fgets(buf, sizeof(buf), fin)) {
+	if (buf[0] == '#' || buf[0] == '\n')
+	    continue;
+	if (sscanf(buf, "%s = %lf", name, &x) != 2) {
+	    Debug("Unable to parse profile line\n%s", buf);
+	    continue;
+	}
+	for (i=0; i<AI_WEIGHTS_N; i++)
+	    if (!strcasecmp(name, ai_weight_name[i])) {
+		v[i] = x;
+		break;
+	    }
+	if (i == AI_WEIGHTS_N)
+	    Debug("Unknown AI weight [%s]\n", name);
+    }
+    fclose(fin);
+    ai_weights_set(w, v);
+    Debug("AI profile [%s] loaded.\n", filespec);
+    return 1;
+}
+
+/***************************************************************************
+ *      ai_save_weights()
+ * Writes w out as an AI profile that ai_load_weights() can read. The
+ * comment goes at the top. Returns 0 if the file cannot be written.
+ *********************************************************************PROTO*/
+int
+ai_save_weights(const char *filespec, const AI_Weights *w, const char *comment)
+{
+    FILE *fout = fopen(filespec, "wt");
+    double v[AI_WEIGHTS_N];
+    int i;
+
+    if (!fout) {
+	Debug("Cannot write AI profile [%s]\n", filespec);
+	return 0;
+    }
+    ai_weights_get(w, v);
+    fprintf(fout, "# Alizarin Tetris AI profile: use it with --profile=%s\n",
+	    filespec);
+    if (comment)
+	fprintf(fout, "# %s\n", comment);
+    for (i=0; i<AI_WEIGHTS_N; i++)
+	fprintf(fout, "%s = %.6g\n", ai_weight_name[i], v[i]);
+    fclose(fout);
+    return 1;
+}
+
+/***************************************************************************
+ *      ai_batch_new()
+ * Room for "max" boards the size of g.
+ *********************************************************************PROTO*/
+AI_Batch *
+ai_batch_new(Grid *g, int max)
+{
+    AI_Batch *b;
+
+    Assert(g->w <= GRID_MASK_MAX_W && g->h <= GRID_MASK_MAX_H && max > 0);
+    /* whole vectors only, so the evaluators never read past the end */
+    max = (max + MASK_LANES - 1) / MASK_LANES * MASK_LANES;
+
+    Calloc(b, AI_Batch *, sizeof(AI_Batch));
+    b->max = max;
+    b->w = g->w;
+    b->h = g->h;
+    Calloc(b->occupied, Uint32 *, g->h * max * sizeof(Uint32));
+    Calloc(b->garbage, Uint32 *, g->h * max * sizeof(Uint32));
+    Calloc(b->same_left, Uint32 *, g->h * max * sizeof(Uint32));
+    Calloc(b->place, AI_Placement *, max * sizeof(AI_Placement));
+    Calloc(b->lines, int *, max * sizeof(int));
+    return b;
+}
+
+/***************************************************************************
+ *      ai_batch_free()
+ * Gives back everything ai_batch_new() took.
+ *********************************************************************PROTO*/
+void
+ai_batch_free(AI_Batch *b)
+{
+    free(b->occupied);
+    free(b->garbage);
+    free(b->same_left);
+    free(b->place);
+    free(b->lines);
+    free(b);
+}
+
+/***************************************************************************
+ *      ai_batch_drop()
+ * Simulates n placements of pp on g and stores the resulting boards in
+ * the batch (replacing whatever was there). Uses the SIM_SCRATCH_BATCH
+ * scratch grid of the calling thread.
+ *********************************************************************PROTO*/
+void
+ai_batch_drop(AI_Batch *b, Grid *g, play_piece *pp, AI_Placement *p, int n)
+{
+    Grid *t = sim_scratch(SIM_SCRATCH_BATCH, g->w, g->h);
+    int i, x, y;
+
+    Assert(n <= b->max && g->w == b->w && g->h == b->h);
+    ai_counters.candidates += n;
+    b->n = n;
+    for (i=0; i<b->max; i++) {
+	int fits = 0;
+
+	if (i < n) {
+	    sim_copy_grid(t, g);
+	    b->place[i] = p[i];
+	    b->lines[i] = drop_piece_on_grid(t, pp, p[i].col, p[i].row, p[i].rot);
+	    fits = (b->lines[i] != -1);
+	}
+	for (y=0; y<g->h; y++) {
+	    unsigned char *row = &GRID_CONTENT(*t,0,y);
+	    Uint32 occ = 0, garb = 0, same = 0;
+	    if (fits) 
+		for (x=0; x<g->w; x++) {
+		    if (row[x]) occ |= 1U << x;
+		    if (row[x] == 1) garb |= 1U << x;
+		    if (x > 0 && row[x] && row[x-1] == row[x]) same |= 1U << x;
+		}
+	    b->occupied[y * b->max + i] = occ;
+	    b->garbage[y * b->max + i] = garb;
+	    b->same_left[y * b->max + i] = same;
+	}
+    }
+}
+
+/***************************************************************************
+ *      ai_batch_all()
+ * ai_batch_drop() for every column and rotation, falling from "row".
+ * Returns the number of placements tried.
+ *********************************************************************PROTO*/
+int
+ai_batch_all(AI_Batch *b, Grid *g, play_piece *pp, int row)
+{
+    int ncols = g->w - WES_MIN_COL;
+    int i, n = min(4 * ncols, b->max);
+    AI_Placement p[4 * (32 - WES_MIN_COL)];
+
+    for (i=0; i<n; i++) {
+	p[i].col = WES_MIN_COL + i % ncols;
+	p[i].row = row;
+	p[i].rot = i / ncols;
+    }
+    ai_batch_drop(b, g, pp, p, n);
+    return n;
+}
+
+/* loads lanes i .. i+MASK_LANES-1 of row y of one of the batch arrays */
+static Lane_Mask
+batch_lanes(AI_Batch *b, Uint32 *a, int y, int i)
+{
+    Lane_Mask v;
+    memcpy(&v, &a[y * b->max + i], sizeof(v));
+    return v;
+}
+
+/*
+ * boards i .. i+MASK_LANES-1 of the batch, turned on their side: the
+ * batch keeps rows and the lane-wise evaluators want columns
+ */
+static void
+batch_masks(AI_Batch *b, int i, Lane_Masks *l)
+{
+    int x, y;
+
+    l->w = b->w;
+    l->h = b->h;
+    memset(l->occupied, 0, sizeof(l->occupied));
+    memset(l->garbage, 0, sizeof(l->garbage));
+    memset(l->same_left, 0, sizeof(l->same_left));
+    for (y=0; y<b->h; y++) {
+	Lane_Mask occ = batch_lanes(b, b->occupied, y, i);
+	Lane_Mask garb = batch_lanes(b, b->garbage, y, i);
+	Lane_Mask same = batch_lanes(b, b->same_left, y, i);
+
+	for (x=0; x<b->w; x++) {
+	    l->occupied[x] |= ((occ >> x) & 1) << y;
+	    l->garbage[x] |= ((garb >> x) & 1) << y;
+	    l->same_left[x] |= ((same >> x) & 1) << y;
+	}
+    }
+}
+
+/***************************************************************************
+ *      ai_batch_weigh()
+ * weight_board() for every board in the batch, MASK_LANES at a time.
+ * Placements that did not fit get AI_BATCH_INVALID.
+ *********************************************************************PROTO*/
+void
+ai_batch_weigh(AI_Batch *b, int *scores)
+{
+    int i, j;
+
+    ai_counters.evals += b->n;
+    for (i=0; i<b->n; i+=MASK_LANES) {
+	Lane_Masks l;
+	int out[MASK_LANES];
+
+	batch_masks(b, i, &l);
+	weight_lanes(&l, out);
+	for (j=0; j<MASK_LANES && i+j<b->n; j++)
+	    scores[i+j] = (b->lines[i+j] == -1) ? AI_BATCH_INVALID : out[j];
+    }
+}
+
+/***************************************************************************
+ *      ai_batch_eval()
+ * evalBoard() for every board in the batch, MASK_LANES at a time, using
+ * the lines each placement cleared and the row it fell from. Placements
+ * that did not fit get AI_BATCH_INVALID.
+ *********************************************************************PROTO*/
+void
+ai_batch_eval(AI_Batch *b, double *scores)
+{
+    int i, j;
+
+    ai_counters.evals += b->n;
+    for (i=0; i<b->n; i+=MASK_LANES) {
+	Lane_Masks l;
+	int row[MASK_LANES];
+	double out[MASK_LANES];
+
+	batch_masks(b, i, &l);
+	for (j=0; j<MASK_LANES; j++)
+	    row[j] = b->place[i+j].row;
+	evalLanes(&l, &b->lines[i], row, out);
+	for (j=0; j<MASK_LANES && i+j<b->n; j++)
+	    scores[i+j] = (b->lines[i+j] == -1) ? AI_BATCH_INVALID : out[j];
+    }
+}
+
+/*
+ * The learned evaluator. Its features come out of the batch a row at a
+ * time, MASK_LANES boards at a time, and the model is
+ * run on all of those boards at once: every weight is loaded once and
+ * multiplied into a whole vector of boards.
+ */
+typedef float	Lane_Float __attribute__ ((vector_size (4 * MASK_LANES)));
+
+#define AI_MODEL_MAX_FEATURES	(32 + AI_MODEL_EXTRA)
+
+static AI_Model *ai_model = NULL;	/* --model=FILE */
+
+static Lane_Int
+lane_min(Lane_Int a, Lane_Int b)
+{
+    Lane_Int lt = (a < b);
+    return (a & lt) | (b & ~lt);
+}
+
+static Lane_Int
+lane_max(Lane_Int a, Lane_Int b)
+{
+    Lane_Int gt = (a > b);
+    return (a & gt) | (b & ~gt);
+}
+
+static Lane_Float
+lane_float(Lane_Int v)
+{
+    Lane_Float f;
+    int j;
+    for (j=0; j<MASK_LANES; j++)
+	f[j] = (float) v[j];
+    return f;
+}
+
+/***************************************************************************
+ *      ai_model_builtin()
+ * The model we use when none was loaded, or the one that was is for
+ * another board width: linear, on the raw features. The arrays must have
+ * room for w + AI_MODEL_EXTRA floats.
+ ***************************************************************************/
+static void
+ai_model_builtin(AI_Model *m, int w, float *mean, float *scale, float *wt)
+{
+    static const float extra[AI_MODEL_EXTRA] = {
+	10.0,	/* holes */
+	0.5,	/* bumpiness */
+	0.0,	/* tallest column */
+	0.5,	/* wells */
+	0.0,	/* pairs of like colors */
+	1.0,	/* garbage */
+	0.0,	/* lines */
+    };
+    int k;
+
+    m->features = w + AI_MODEL_EXTRA;
+    m->hidden = 0;
+    for (k=0; k<m->features; k++) {
+	mean[k] = 0.0;
+	scale[k] = 1.0;
+	wt[k] = (k < w) ? 1.0 : extra[k - w];
+    }
+    m->mean = mean;
+    m->scale = scale;
+    m->w1 = wt;
+    m->b1 = m->w2 = NULL;
+    m->b2 = 0.0;
+}
+
+/***************************************************************************
+ *      ai_free_model()
+ * Gives back everything ai_load_model() took.
+ *********************************************************************PROTO*/
+void
+ai_free_model(AI_Model *m)
+{
+    if (!m)
+	return;
+    Free(m->mean); Free(m->scale); Free(m->w1); Free(m->b1); Free(m->w2);
+    free(m);
+}
+
+/* reads n floats, 0 if the file ran out */
+static int
+ai_model_read(FILE *fin, float **v, int n)
+{
+    Calloc(*v, float *, max(n, 1) * sizeof(float));
+    return fread(*v, sizeof(float), n, fin) == (size_t) n;
+}
+
+/***************************************************************************
+ *      ai_load_model()
+ * Reads a model file (see AI_Model). Returns NULL if the file cannot be
+ * read or is not one.
+ *********************************************************************PROTO*/
+AI_Model *
+ai_load_model(const char *filespec)
+{
+    FILE *fin = fopen(filespec, "rb");
+    char magic[8];
+    int head[2], F, ok;
+    AI_Model *m;
+
+    if (!fin) {
+	Debug("Cannot read AI model [%s]\n", filespec);
+	return NULL;
+    }
+    if (fread(magic, 1, 8, fin) != 8 || memcmp(magic, AI_MODEL_MAGIC, 8) ||
+	    fread(head, sizeof(int), 2, fin) != 2 ||
+	    head[0] <= AI_MODEL_EXTRA || head[0] > AI_MODEL_MAX_FEATURES ||
+	    head[1] < 0 || head[1] > AI_MODEL_MAX_HIDDEN) {
+	Debug("[%s] is not an AI model.\n", filespec);
+	fclose(fin);
+	return NULL;
+    }
+    Calloc(m, AI_Model *, sizeof(AI_Model));
+    F = m->features = head[0];
+    m->hidden = head[1];
+    ok = ai_model_read(fin, &m->mean, F) && ai_model_read(fin, &m->scale, F);
+    if (m->hidden == 0)
+	ok = ok && ai_model_read(fin, &m->w1, F);
+    else 
+	ok = ok && ai_model_read(fin, &m->w1, m->hidden * F) &&
+	    ai_model_read(fin, &m->b1, m->hidden) &&
+	    ai_model_read(fin, &m->w2, m->hidden);
+    ok = ok && fread(&m->b2, sizeof(float), 1, fin) == 1;
+    fclose(fin);
+    if (!ok) {
+	Debug("AI model [%s] is cut short.\n", filespec);
+	ai_free_model(m);
+	return NULL;
+    }
+    Debug("AI model [%s] loaded (%d features, %d hidden).\n", filespec,
+	    m->features, m->hidden);
+    return m;
+}
+
+/***************************************************************************
+ *      ai_set_model()
+ * The learned evaluator goes by m from now on (NULL for the built-in
+ * one). Call it before any AI starts thinking; the old model is not
+ * freed.
+ *********************************************************************PROTO*/
+void
+ai_set_model(AI_Model *m)
+{
+    ai_model = m;
+}
+
+/***************************************************************************
+ *      ai_batch_learned()
+ * The learned evaluator (see AI_Model) for every board in the batch,
+ * MASK_LANES at a time. Placements that did not fit get AI_BATCH_INVALID.
+ *********************************************************************PROTO*/
+void
+ai_batch_learned(AI_Batch *b, double *scores)
+{
+    int W = b->w, H = b->h, F = W + AI_MODEL_EXTRA;
+    const AI_Model *m = ai_model;
+    AI_Model builtin;
+    float mean[AI_MODEL_MAX_FEATURES], scale[AI_MODEL_MAX_FEATURES];
+    float wt[AI_MODEL_MAX_FEATURES];
+    int i, j, k, x, y;
+
+    if (m == NULL || m->features != F) {
+	ai_model_builtin(&builtin, W, mean, scale, wt);
+	m = &builtin;
+    }
+
+    ai_counters.evals += b->n;
+    for (i=0; i<b->n; i+=MASK_LANES) {
+	Lane_Int height[32], holes = { 0 }, same = { 0 }, garbage = { 0 };
+	Lane_Int bump = { 0 }, tallest = { 0 }, wells = { 0 }, lines;
+	Lane_Int edge = (Lane_Int) { 0 } + H;
+	Lane_Mask seen = { 0 };
+	Lane_Float f[AI_MODEL_MAX_FEATURES], out;
+
+	/* 
+	 * A column is as tall as the number of rows at or below its top
+	 * block, so the heights fall out of a running "seen" mask.
+	 */
+	memset(height, 0, sizeof(height));
+	for (y=0; y<H; y++) {
+	    Lane_Mask occ = batch_lanes(b, b->occupied, y, i);
+	    seen |= occ;
+	    holes += lane_popcount(seen & ~occ);
+	    garbage += lane_popcount(batch_lanes(b, b->garbage, y, i));
+	    same += lane_popcount(batch_lanes(b, b->same_left, y, i));
+	    for (x=0; x<W; x++)
+		height[x] += (Lane_Int) ((seen >> x) & 1);
+	}
+	for (x=0; x<W; x++) {
+	    Lane_Int left = x > 0 ? height[x-1] : edge;
+	    Lane_Int right = x < W-1 ? height[x+1] : edge;
+	    Lane_Int zero = { 0 };
+
+	    tallest = lane_max(tallest, height[x]);
+	    wells += lane_max(lane_min(left, right) - height[x], zero);
+	    if (x < W-1)
+		bump += lane_max(height[x] - right, right - height[x]);
+	    f[x] = lane_float(height[x]);
+	}
+	memcpy(&lines, &b->lines[i], sizeof(lines));
+	f[W] = lane_float(holes);
+	f[W+1] = lane_float(bump);
+	f[W+2] = lane_float(tallest);
+	f[W+3] = lane_float(wells);
+	f[W+4] = lane_float(same);
+	f[W+5] = lane_float(garbage);
+	f[W+6] = lane_float(lane_max(lines, (Lane_Int) { 0 }));
+
+	for (k=0; k<F; k++)
+	    f[k] = (f[k] - m->mean[k]) * m->scale[k];
+
+	out = (Lane_Float) { 0 } + m->b2;
+	if (m->hidden == 0) 
+	    for (k=0; k<F; k++)
+		out += m->w1[k] * f[k];
+	else for (j=0; j<m->hidden; j++) {
+	    const float *row = &m->w1[j * F];
+	    Lane_Float a = (Lane_Float) { 0 } + m->b1[j];
+
+	    for (k=0; k<F; k++)
+		a += row[k] * f[k];
+	    /* rectify: keep the lanes that are above zero */
+	    a = (Lane_Float) ((Lane_Int) a & (a > 0));
+	    out += m->w2[j] * a;
+	}
+
+	for (j=0; j<MASK_LANES && i+j<b->n; j++)
+	    scores[i+j] = (b->lines[i+j] == -1) ? AI_BATCH_INVALID : out[j];
+    }
+}
+
+/*******************************************************************
+ *   cogitate()
+ * Kiri's AI 'thinking' function.  Again, called once 'every so'
+ * by event_loop().  
+ *******************************************************************/
+static void 
+alizCogitate(void *state, Grid* g, play_piece* pp, play_piece* np, 
+	int col, int row, int rot)
+{
+  Aliz_State *as = (Aliz_State *)state;
+  double eval, evalLeft = -1, evalRight = -1;
+  int nLines;
+
+  Assert(as);
+    
+  if (as->foundBest) return;
+  
+  memcpy(as->kg.contents, g->contents, (g->w * g->h * sizeof(as->kg.contents[0])));
+  memcpy(as->kg.fall, g->fall, (g->w * g->h * sizeof(*as->kg.fall)));
+
+  if (as->bestEval == -1) {
+    /* It's our first think! */
+    as->checkColumn = col; /* check this column first */
+    as->checkRotation = 0; /* check no rotation (it's easy!) */
+    as->checkSides = 0; /* middle */
+  }
+  else {
+    /* Try the next thing */
+    as->checkRotation = (as->checkRotation+1)%4;
+    if (as->checkRotation == 0) {
+      /* Try a new column */
+      /* Go all the way left first */
+      if (as->checkColumn == col || as->checkColumn < col) {
+	as->checkColumn--;
+	if (!valid_position(pp, as->checkColumn, row,
+			    as->checkRotation, &as->kg)) {
+	  as->checkColumn = col + 1;
+	  if (!valid_position(pp, as->checkColumn, row,
+			      as->checkRotation, &as->kg)) {
+	    /* skip this one */
+	    return;
+	  }
+	}
+      }
+      else {
+	/* Now go all the way to the right */
+	as->checkColumn++;
+	if (!valid_position(pp, as->checkColumn, row,
+			    as->checkRotation, &as->kg)) {
+	  /* skip this one */
+	  return;
+	}
+      }
+    } else if (!valid_position(pp, as->checkColumn, row,
+			       as->checkRotation, &as->kg)) {
+      /* as->checkRotation != 0 */
+      if (as->checkColumn >= g->w && as->checkRotation == 3) {
+	/* final one */
+	as->foundBest = TRUE;
+#ifdef DEBUG
+	printf("Aliz: Found best! (last checked %d, %d)\n",
+	       as->checkColumn, as->checkRotation);
+#endif
+	return;
+      }
+      /* Trying a specific rotation; skip this one */
+      else return;
+    }
+  }
+#ifdef DEBUG
+  printf("Aliz: trying (col %d, rot %d) ", as->checkColumn, as->checkRotation);
+#endif
+
+  /* Check for impending doom */
+  if (GRID_CONTENT(*g, col, row+1)) {
+#ifdef DEBUG
     printf("Aliz: panic! about to crash, ");
 #endif
    
@@ -662,6 +1686,7 @@ alizCogitate(void *state, Grid* g, play_piece* pp, play_piece* np,
   }
 
   /************** Test the current choice ****************/
+  ai_counters.candidates++;
   nLines = drop_piece_on_grid(&as->kg, pp, as->checkColumn, row, 
 			      as->checkRotation);
   if (nLines != -1) {	/* invalid place to drop something */
@@ -769,18 +1794,71 @@ alizReset(void *state, Grid *g)
 }
 
 /*******************************************************************
- *   alizMove()
- * Kiri's AI 'move' function.  Possible retvals:
- * 	MOVE_NONE	Do nothing, fall normally.
- * 	MOVE_LEFT	[Try to] Move one column to the left.
- * 	MOVE_RIGHT	[Try to] Move one column to the right.
- * 	MOVE_ROTATE	[Try to] Rotate the piece.
- * 	MOVE_DOWN	Fall down really quickly.
- *********************************************************************/
-static Command 
-alizMove(void *state, Grid* g, play_piece* pp, play_piece* np, int col, int row, int rot)
+ *   alizRelease()
+ * Kiri's AI 'release' function.
+ *******************************************************************/
+static void
+alizRelease(void *state)
 {
-    Aliz_State *as = (Aliz_State *)state;
+  Aliz_State *as = (Aliz_State *)state;
+
+  if (as->kg.contents) free_board(&as->kg);
+  free(as);
+}
+
+/*******************************************************************
+ *   alizEvaluate()
+ * Kiri's AI 'evaluate' function: evalBoard() for a whole batch.
+ *******************************************************************/
+static void
+alizEvaluate(void *state, AI_Batch *b, double *scores)
+{
+  ai_batch_eval(b, scores);
+}
+
+/*******************************************************************
+ *   alizTarget()
+ * Kiri's AI 'target' function: where the piece should end up once
+ * we have found the best spot, slips included. A slip drops the piece
+ * in the goal column and then slides it one column over at the
+ * bottom, tucking it under whatever hangs over that column.
+ *******************************************************************/
+static int
+alizTarget(void *state, Grid* g, play_piece* pp, int row, AI_Placement *goal)
+{
+  Aliz_State *as = (Aliz_State *)state;
+  int land = row;
+  Assert(as);
+
+  goal->col = as->goalColumn;
+  goal->rot = as->goalRotation;
+  goal->row = -1;
+  if (!as->foundBest) return 0;
+  if (as->goalSides == 0 || 
+      !valid_position(pp, goal->col, row, goal->rot, g)) return 1;
+
+  while (valid_position(pp, goal->col, land+1, goal->rot, g)) land++;
+  if (valid_position(pp, goal->col + as->goalSides, land, goal->rot, g)) {
+    goal->col += as->goalSides;
+    while (valid_position(pp, goal->col, land+1, goal->rot, g)) land++;
+    goal->row = land;
+  }
+  return 1;
+}
+
+/*******************************************************************
+ *   alizMove()
+ * Kiri's AI 'move' function.  Possible retvals:
+ * 	MOVE_NONE	Do nothing, fall normally.
+ * 	MOVE_LEFT	[Try to] Move one column to the left.
+ * 	MOVE_RIGHT	[Try to] Move one column to the right.
+ * 	MOVE_ROTATE	[Try to] Rotate the piece.
+ * 	MOVE_DOWN	Fall down really quickly.
+ *********************************************************************/
+static Command 
+alizMove(void *state, Grid* g, play_piece* pp, play_piece* np, int col, int row, int rot)
+{
+    Aliz_State *as = (Aliz_State *)state;
     Assert(as);
   if (rot == as->goalRotation) {
     if (col == as->goalColumn) {
@@ -799,6 +1877,846 @@ alizMove(void *state, Grid* g, play_piece* pp, play_piece* np, int col, int row,
   
 }
 
+/***************************************************************************
+ * The Gambler: Double-Think's two-piece search, with the boards it likes
+ * best played out a few more pieces into the future. Those extra pieces
+ * are drawn from the same distribution generate_piece() deals from
+ * (specials included), and each candidate's rollouts are averaged. All
+ * of the dropping happens on the simulation pool, so think() only starts
+ * batches and checks on them.
+ ***************************************************************************/
+#define MONTE_KEEP	4	/* candidates that get rollouts */
+#define MONTE_DEPTH	2	/* random pieces per rollout */
+#define MONTE_LOST	(1<<24)	/* weight of a rollout that topped out */
+
+typedef enum {
+    MONTE_IDLE,		/* nothing started yet */
+    MONTE_PLACING,	/* two-piece search running */
+    MONTE_ROLLING,	/* rollouts running */
+} Monte_Stage;
+
+typedef struct monte_struct {
+    int know_what_to_do;
+    int desired_col;
+    int desired_rot;
+
+    Monte_Stage stage;
+    Sim_Batch batch;
+    volatile int cancel;	/* reset() arrived mid-batch */
+
+    /* what we are thinking about, copied for the pool */
+    Grid g;
+    play_piece pp;
+    play_piece np;
+    int row;
+    piece_style *ps;
+    color_style *cs;
+    int rollouts;
+    Uint32 seed;	/* common to every candidate of one choice */
+
+    /* one per placement of pp */
+    int nplace;
+    int *weight;	/* after pp and the best np, or -1 if pp won't fit */
+    Grid *after;	/* the board that weight is for */
+    int *order;
+    int kept;
+
+    int *outcome;	/* kept * rollouts */
+} Monte_State;
+
+/***************************************************************************
+ *      monte_greedy()
+ * Drops pp wherever it leaves "from" lightest, leaving that board in "to".
+ * Returns its weight or -1 if pp does not fit anywhere. All of the
+ * placements are weighed in one batch.
+ ***************************************************************************/
+static int
+monte_greedy(Grid *from, Grid *to, play_piece *pp, int row)
+{
+    static __thread AI_Batch *b = NULL;
+    static __thread int *w = NULL;
+    int i, n, best = -1;
+
+    if (b == NULL || b->w != from->w || b->h != from->h) {
+	b = ai_batch_new(from, 4 * (from->w - WES_MIN_COL));
+	Realloc(w, int *, b->max * sizeof(int));
+    }
+    n = ai_batch_all(b, from, pp, row);
+    ai_batch_weigh(b, w);
+    for (i=0; i<n; i++) 
+	if (w[i] != AI_BATCH_INVALID && (best == -1 || w[i] < w[best]))
+	    best = i;
+    if (best == -1)
+	return -1;
+    sim_copy_grid(to, from);
+    drop_piece_on_grid(to, pp, b->place[best].col, row, b->place[best].rot);
+    return w[best];
+}
+
+/***************************************************************************
+ *      monte_place_job()
+ * Pool job: placement i of pp, followed by the best placement of np.
+ ***************************************************************************/
+static void
+monte_place_job(void *arg, int i)
+{
+    Monte_State *ms = (Monte_State *)arg;
+    int ncols = ms->g.w - WES_MIN_COL;
+    Grid *a = sim_scratch(0, ms->g.w, ms->g.h);
+    int w;
+
+    ms->weight[i] = -1;
+    if (ms->cancel) 
+	return;
+    ai_counters.candidates++;
+    sim_copy_grid(a, &ms->g);
+    if (drop_piece_on_grid(a, &ms->pp, WES_MIN_COL + i % ncols, ms->row,
+		i / ncols) == -1)
+	return;
+    sim_copy_grid(&ms->after[i], a);
+    if ((w = weight_board(a)) <= 0) {
+	ms->weight[i] = 0;	/* you'll win! */
+	return;
+    }
+    w = monte_greedy(a, &ms->after[i], &ms->np, ms->row);
+    ms->weight[i] = (w == -1) ? MONTE_LOST : 1 + w;
+}
+
+/***************************************************************************
+ *      monte_roll_job()
+ * Pool job: one rollout from one of the kept candidates.
+ ***************************************************************************/
+static void
+monte_roll_job(void *arg, int j)
+{
+    Monte_State *ms = (Monte_State *)arg;
+    int c = ms->order[j / ms->rollouts];
+    Uint32 seed = ms->seed + 7919 * (j % ms->rollouts);
+    Grid *cur = sim_scratch(2, ms->g.w, ms->g.h);
+    Grid *next = sim_scratch(3, ms->g.w, ms->g.h);
+    int d, w = ms->weight[c];
+
+    if (ms->cancel) 
+	return;
+    sim_copy_grid(cur, &ms->after[c]);
+    for (d=0; d<MONTE_DEPTH && w > 0 && w < MONTE_LOST; d++) {
+	play_piece pp = generate_piece_r(ms->ps, ms->cs, &seed);
+	Grid *t;
+
+	w = monte_greedy(cur, next, &pp, 0);
+	if (w == -1)
+	    w = MONTE_LOST;
+	t = cur; cur = next; next = t;
+    }
+    ms->outcome[j] = w;
+}
+
+/***************************************************************************
+ *      weight_evaluate()
+ * AI_Player evaluate() for the AIs that go by weight_board().
+ ***************************************************************************/
+static void
+weight_evaluate(void *state, AI_Batch *b, double *scores)
+{
+    int w[b->max];
+    int i;
+
+    ai_batch_weigh(b, w);
+    for (i=0; i<b->n; i++)
+	scores[i] = w[i];
+}
+
+/***************************************************************************
+ *      monte_ai_reset()
+ ***************************************************************************/
+static void *
+monte_ai_reset(void *state, Grid *g)
+{
+    Monte_State *retval;
+    int i;
+
+    if (state == NULL) {
+	Calloc(retval, Monte_State *, sizeof(Monte_State));
+	retval->g = generate_board(g->w, g->h, 0);
+	retval->nplace = 4 * (g->w - WES_MIN_COL);
+	Calloc(retval->weight, int *, retval->nplace * sizeof(int));
+	Calloc(retval->order, int *, retval->nplace * sizeof(int));
+	Calloc(retval->after, Grid *, retval->nplace * sizeof(Grid));
+	for (i=0; i<retval->nplace; i++) 
+	    retval->after[i] = generate_board(g->w, g->h, 0);
+    } else
+	retval = state;
+    Assert(retval);
+
+    /* the pool may still be working on the last piece */
+    if (retval->stage != MONTE_IDLE) {
+	retval->cancel = 1;
+	sim_batch_wait(&retval->batch);
+	retval->cancel = 0;
+    }
+    retval->stage = MONTE_IDLE;
+    retval->know_what_to_do = 0;
+    retval->desired_col = g->w / 2;
+    retval->desired_rot = 0;
+    return retval;
+}
+
+/***************************************************************************
+ *      monte_ai_release()
+ ***************************************************************************/
+static void
+monte_ai_release(void *state)
+{
+    Monte_State *ms = (Monte_State *) state;
+    int i;
+
+    if (ms->stage != MONTE_IDLE) {
+	ms->cancel = 1;
+	sim_batch_wait(&ms->batch);
+    }
+    free_board(&ms->g);
+    for (i=0; i<ms->nplace; i++) 
+	free_board(&ms->after[i]);
+    Free(ms->after); Free(ms->weight); Free(ms->order); Free(ms->outcome);
+    free(ms);
+}
+
+/***************************************************************************
+ *      monte_ai_think()
+ ***************************************************************************/
+static void
+monte_ai_think(void *data, Grid *g, play_piece *pp, play_piece *np, 
+	int col, int row, int rot)
+{
+    Monte_State *ms = (Monte_State *)data;
+    int i, j;
+
+    Assert(ms);
+    if (ms->know_what_to_do)
+	return;
+
+    switch (ms->stage) {
+	case MONTE_IDLE:
+	    sim_copy_grid(&ms->g, g);
+	    ms->pp = *pp;
+	    ms->np = *np;
+	    ms->row = row;
+	    ms->rollouts = Options.ai_rollouts > 0 ? Options.ai_rollouts : 1;
+	    if (!sim_get_styles(&ms->ps, &ms->cs))
+		ms->rollouts = 0;	/* no idea what is coming */
+	    /* the same position always gets the same rollouts */
+	    ms->seed = 1;
+	    for (i=0; i<g->w * g->h; i++) 
+		ms->seed = ms->seed * 69069 + g->contents[i];
+	    for (i=1; i<=pp->base->num_color; i++) 
+		ms->seed = ms->seed * 69069 + pp->colormap[i];
+	    for (i=1; i<=np->base->num_color; i++) 
+		ms->seed = ms->seed * 69069 + np->colormap[i];
+	    ms->seed |= 1;
+	    ms->stage = MONTE_PLACING;
+	    sim_batch_start(&ms->batch, monte_place_job, ms, ms->nplace);
+	    return;
+
+	case MONTE_PLACING:
+	    if (!sim_batch_done(&ms->batch))
+		return;
+	    ms->kept = 0;
+	    for (i=0; i<ms->nplace; i++) {
+		if (ms->weight[i] == -1) 
+		    continue;
+		for (j=ms->kept; j>0 && ms->weight[ms->order[j-1]] > ms->weight[i]; j--)
+		    ms->order[j] = ms->order[j-1];
+		ms->order[j] = i;
+		ms->kept++;
+	    }
+	    if (ms->kept == 0) {
+		ms->know_what_to_do = 1;	/* nothing fits: good luck */
+		return;
+	    }
+	    ms->desired_col = WES_MIN_COL + ms->order[0] % (g->w - WES_MIN_COL);
+	    ms->desired_rot = ms->order[0] / (g->w - WES_MIN_COL);
+	    if (ms->weight[ms->order[0]] == 0 || ms->rollouts == 0) {
+		ms->know_what_to_do = 1;
+		return;
+	    }
+	    ms->kept = min(ms->kept, MONTE_KEEP);
+	    Realloc(ms->outcome, int *, ms->kept * ms->rollouts * sizeof(int));
+	    ms->stage = MONTE_ROLLING;
+	    sim_batch_start(&ms->batch, monte_roll_job, ms, 
+		    ms->kept * ms->rollouts);
+	    return;
+
+	case MONTE_ROLLING: {
+	    double best = 0;
+	    if (!sim_batch_done(&ms->batch))
+		return;
+	    for (i=0; i<ms->kept; i++) {
+		double sum = 0;
+		for (j=0; j<ms->rollouts; j++)
+		    sum += ms->outcome[i * ms->rollouts + j];
+		if (i == 0 || sum < best) {
+		    best = sum;
+		    ms->desired_col = WES_MIN_COL + 
+			ms->order[i] % (g->w - WES_MIN_COL);
+		    ms->desired_rot = ms->order[i] / (g->w - WES_MIN_COL);
+		}
+	    }
+	    ms->know_what_to_do = 1;
+	    return;
+	}
+    }
+}
+
+/***************************************************************************
+ *      monte_ai_move()
+ ***************************************************************************/
+static Command
+monte_ai_move(void *state, Grid *g, play_piece *pp, play_piece *np, 
+	int col, int row, int rot)
+{
+    Monte_State *ms = (Monte_State *) state;
+
+    if (rot != ms->desired_rot)
+	return MOVE_ROTATE;
+    else if (col > ms->desired_col) 
+	return MOVE_LEFT;
+    else if (col < ms->desired_col) 
+	return MOVE_RIGHT;
+    else if (ms->know_what_to_do) {
+	return MOVE_DOWN;
+    } else 
+	return MOVE_NONE;
+}
+
+/***************************************************************************
+ * Input planning. The planner works in the event loop's own units: the
+ * piece sits on a column and falls a pixel at a time, so y is measured
+ * in pixels from the top of the board and a row is blockWidth pixels
+ * tall. Moves are tried exactly the way event_loop() tries them,
+ * including the rotation kicks and the half-block slide for left and
+ * right.
+ ***************************************************************************/
+
+/* the row a pixel falls in, rounded like screen_to_grid_coords() */
+static int
+plan_row(int y, int bw)
+{
+    if (y < 0) y -= bw - 1;
+    return y / bw;
+}
+
+/* valid_screen_position() in board pixels */
+static int
+plan_valid(play_piece *pp, Grid *g, int bw, int col, int y, int rot)
+{
+    int row = plan_row(y, bw), row2 = plan_row(y + bw - 1, bw);
+
+    if (!valid_position(pp, col, row, rot, g))
+	return 0;
+    return (row == row2) || valid_position(pp, col, row2, rot, g);
+}
+
+/* where a valid piece comes to rest if nobody touches it */
+static int
+plan_land(play_piece *pp, Grid *g, int bw, int col, int y, int rot)
+{
+    int row = plan_row(y, bw);
+
+    while (valid_position(pp, col, row+1, rot, g))
+	row++;
+    return max(row * bw, y);
+}
+
+/* does this move work from (col,y,rot), and where does it leave us? */
+static int
+plan_move(play_piece *pp, Grid *g, int bw, Command m, int *col, int *y,
+	int *rot)
+{
+    int i, r = (*rot + 1) % 4;
+
+    switch (m) {
+	case MOVE_NONE:
+	    return 1;
+	case MOVE_ROTATE:
+	    if (plan_valid(pp, g, bw, *col, *y, r)) {
+		*rot = r; return 1;
+	    } else if (plan_valid(pp, g, bw, *col - 1, *y, r)) {
+		*rot = r; (*col)--; return 1;
+	    } else if (plan_valid(pp, g, bw, *col + 1, *y, r)) {
+		*rot = r; (*col)++; return 1;
+	    } else if (plan_valid(pp, g, bw, *col, *y + bw, r)) {
+		*rot = r; *y += bw; return 1;
+	    } else if (Options.upward_rotation &&
+		    plan_valid(pp, g, bw, *col, *y - bw, r)) {
+		*rot = r; *y -= bw; return 1;
+	    }
+	    return 0;
+	case MOVE_LEFT: 
+	case MOVE_RIGHT: {
+	    int to = *col + (m == MOVE_LEFT ? -1 : 1);
+	    for (i=0; i<10; i++) 
+		if (plan_valid(pp, g, bw, to, *y + i, *rot)) {
+		    *col = to; *y += i; return 1;
+		}
+	    return 0;
+	}
+	default:
+	    return 0;
+    }
+}
+
+/***************************************************************************
+ *      ai_plan()
+ * Finds the shortest sequence of inputs that brings pp from (col,y,rot)
+ * to rest at goal, given that it falls "fall" pixels between one input
+ * and the next. y is in pixels from the top of the board and bw is the
+ * height of a row. Tucks under overhangs and kicks off walls come out of
+ * the search on their own. Returns the number of inputs (also left in
+ * plan->n, which is capped at AI_PLAN_MAX) or -1 if goal cannot be
+ * reached.
+ *********************************************************************PROTO*/
+int
+ai_plan(Grid *g, play_piece *pp, int bw, int col, int y, int rot,
+	AI_Placement *goal, int fall, AI_Plan *plan)
+{
+    static __thread int *from = NULL, *queue = NULL;
+    static __thread int room = 0;
+    static const Command moves[4] = 
+	{ MOVE_ROTATE, MOVE_LEFT, MOVE_RIGHT, MOVE_NONE };
+    int ncols = g->w - WES_MIN_COL;
+    int ybase = min(y, 0) - 4 * bw;	/* the kicks can lift us this far */
+    int ny = g->h * bw - ybase + 1;
+    int states = ncols * 4 * ny;
+    int goal_y = -1;
+    int head = 0, tail = 0, found = -1, i, k, n;
+
+#define PLAN_INDEX(c,yy,r)	((((c) - WES_MIN_COL) * 4 + (r)) * ny + (yy) - ybase)
+
+    plan->n = 0;
+    if (col < WES_MIN_COL || col >= g->w || 
+	    !plan_valid(pp, g, bw, col, y, rot))
+	return -1;
+    if (goal->row >= 0) 
+	goal_y = goal->row * bw;
+    else if (plan_valid(pp, g, bw, goal->col, y, goal->rot))
+	goal_y = plan_land(pp, g, bw, goal->col, y, goal->rot);
+
+    if (states > room) {
+	Realloc(from, int *, states * sizeof(int));
+	Realloc(queue, int *, states * sizeof(int));
+	room = states;
+    }
+    /* from[s] is 1 + (the state we came from) * 4 + (the move), or 0 */
+    memset(from, 0, states * sizeof(int));
+
+    i = PLAN_INDEX(col, y, rot);
+    from[i] = -1;	/* the start */
+    queue[tail++] = i;
+
+    while (head < tail) {
+	int s = queue[head++];
+	int c = s / (4 * ny) + WES_MIN_COL;
+	int r = (s / ny) % 4;
+	int yy = s % ny + ybase;
+	int land = plan_land(pp, g, bw, c, yy, r);
+	int m;
+
+	if (c == goal->col && r == goal->rot && 
+		(goal_y < 0 || land == goal_y)) {
+	    found = s;
+	    break;
+	}
+	for (m=0; m<4; m++) {
+	    int c2 = c, y2 = yy, r2 = r, t;
+	    if (!plan_move(pp, g, bw, moves[m], &c2, &y2, &r2))
+		continue;
+	    if (c2 < WES_MIN_COL || c2 >= g->w || y2 < ybase)
+		continue;
+	    /* gravity until the next input */
+	    y2 = min(y2 + fall, plan_land(pp, g, bw, c2, y2, r2));
+	    t = PLAN_INDEX(c2, y2, r2);
+	    if (from[t]) 
+		continue;
+	    from[t] = 1 + s * 4 + m;
+	    queue[tail++] = t;
+	}
+    }
+    if (found < 0) 
+	return -1;
+
+    /* count the moves back to the start, then fill them in backwards */
+    n = 0;
+    for (i = found; from[i] != -1; i = (from[i] - 1) / 4) 
+	n++;
+    k = n;
+    for (i = found; from[i] != -1; i = (from[i] - 1) / 4) 
+	if (--k < AI_PLAN_MAX)
+	    plan->move[k] = moves[(from[i] - 1) % 4];
+    /* and then drop it, unless it is already sitting there */
+    if (found % ny + ybase != plan_land(pp, g, bw, goal->col, 
+		found % ny + ybase, goal->rot)) {
+	if (n < AI_PLAN_MAX) 
+	    plan->move[n] = MOVE_DOWN;
+	n++;
+    }
+    plan->n = min(n, AI_PLAN_MAX);
+#undef PLAN_INDEX
+    return n;
+}
+
+/***************************************************************************
+ *      ai_new_piece()
+ * Gets the AI ready for piece pp. played says where the last piece went,
+ * or is NULL if there was no last piece (a new game, say): an AI with a
+ * cont() hook may then carry its search over instead of starting again.
+ * Returns the new state.
+ *********************************************************************PROTO*/
+void *
+ai_new_piece(AI_Player *ai, void *state, Grid *g, play_piece *pp,
+	AI_Placement *played)
+{
+    ai_counters.decisions++;
+    if (ai->cont && state && played)
+	return ai->cont(state, g, pp, played);
+    return ai->reset(state, g);
+}
+
+/***************************************************************************
+ *      ai_counters_sum()
+ * Adds c to *into.
+ *********************************************************************PROTO*/
+void
+ai_counters_sum(AI_Counters *into, const AI_Counters *c)
+{
+    AI_Counters zero;
+
+    memset(&zero, 0, sizeof(zero));
+    counters_add(into, c, &zero);
+}
+
+/***************************************************************************
+ *      ai_counters_print()
+ * One line of a table of where the AIs spent their time, most of it per
+ * piece; name NULL prints the heading instead.
+ *********************************************************************PROTO*/
+void
+ai_counters_print(FILE *f, const char *name, const AI_Counters *c)
+{
+    double pieces = c && c->decisions ? c->decisions : 1.0;
+
+    if (name == NULL) {
+	fprintf(f, "%-16s %9s %9s %9s %9s %9s %9s %9s %9s\n", "AI",
+		"Cand/pc", "Drops/pc", "Grav/drop", "Evals/pc", "Thinks/pc",
+		"Settled%", "Overruns", "Ticks/pc");
+	return;
+    }
+    fprintf(f, "%-16.16s %9.1f %9.1f %9.3f %9.1f %9.1f %8.1f%% %9lu %9.1f\n",
+	    name, c->candidates / pieces, c->drops / pieces,
+	    c->drops ? (double) c->gravity / c->drops : 0.0,
+	    c->evals / pieces, c->thinks / pieces,
+	    c->thinks ? 100.0 * c->settled / c->thinks : 0.0,
+	    c->overruns, c->think_ticks / pieces);
+}
+
+/***************************************************************************
+ *      ai_think()
+ * Calls ai->think() and keeps the books on it: a call that tried no
+ * placements and scored no boards counts as "settled" (the AI had made
+ * up its mind, or was waiting on the pool), one that ran past
+ * AI_THINK_SLICE as an overrun. If c is not NULL the work done in the
+ * call is added to it as well. Returns 0 if the call was settled, so the
+ * caller need not offer the AI more time just yet.
+ *********************************************************************PROTO*/
+int
+ai_think(AI_Player *ai, AI_Counters *c, void *state, Grid *g, 
+	play_piece *cp, play_piece *np, int col, int row, int rot)
+{
+    AI_Counters mark = ai_counters;
+    Uint32 start = sim_peek_ticks(), took;
+    int busy = 0;
+
+    ai->think(state, g, cp, np, col, row, rot);
+
+    took = sim_peek_ticks() - start;
+    ai_counters.thinks++;
+    ai_counters.think_ticks += took;
+    if (took > AI_THINK_SLICE)
+	ai_counters.overruns++;
+    if (ai_counters.candidates == mark.candidates &&
+	    ai_counters.evals == mark.evals &&
+	    ai_counters.drops == mark.drops)
+	ai_counters.settled++;
+    else
+	busy = 1;
+    if (c)
+	ai_counters_add(c, &mark);
+    return busy;
+}
+
+/***************************************************************************
+ *      ai_spawn()
+ * Where a new piece comes onto the board: the middle column, as high as
+ * it fits and in the first rotation that does, the way the event loop
+ * places it. y is in pixels from the top of the board. Returns 0 if the
+ * piece does not fit anywhere (the game is lost).
+ *********************************************************************PROTO*/
+int
+ai_spawn(Grid *g, play_piece *pp, int bw, int *col, int *y, int *rot)
+{
+    int Y, R;
+
+    *col = g->w / 2;
+    for (Y = 0; Y >= -2; Y--)
+	for (R = 0; R <= 3; R++) 
+	    if (plan_valid(pp, g, bw, *col, Y * bw, R)) {
+		*y = Y * bw;
+		*rot = R;
+		return 1;
+	    }
+    return 0;
+}
+
+/***************************************************************************
+ *      ai_step()
+ * Carries out one input the way the event loop would and then lets the
+ * piece fall "fall" pixels. Returns 1 once the piece is resting on
+ * something.
+ *********************************************************************PROTO*/
+int
+ai_step(Grid *g, play_piece *pp, int bw, Command m, int fall,
+	int *col, int *y, int *rot)
+{
+    int land;
+
+    if (m == MOVE_DOWN) 
+	fall = g->h * bw;
+    else 
+	plan_move(pp, g, bw, m, col, y, rot);
+    land = plan_land(pp, g, bw, *col, *y, *rot);
+    *y = min(*y + fall, land);
+    return *y == land;
+}
+
+/***************************************************************************
+ *      wes_ai_target()
+ ***************************************************************************/
+static int
+wes_ai_target(void *state, Grid *g, play_piece *pp, int row, 
+	AI_Placement *goal)
+{
+    Wessy_State *ws = (Wessy_State *) state;
+
+    goal->col = ws->desired_column;
+    goal->rot = ws->desired_rot;
+    goal->row = -1;
+    return ws->know_what_to_do;
+}
+
+/***************************************************************************
+ *      double_ai_target()
+ ***************************************************************************/
+static int
+double_ai_target(void *state, Grid *g, play_piece *pp, int row, 
+	AI_Placement *goal)
+{
+    Double_State *ds = (Double_State *) state;
+
+    goal->col = ds->desired_col;
+    goal->rot = ds->desired_rot;
+    goal->row = -1;
+    return ds->know_what_to_do;
+}
+
+/***************************************************************************
+ *      monte_ai_target()
+ ***************************************************************************/
+static int
+monte_ai_target(void *state, Grid *g, play_piece *pp, int row, 
+	AI_Placement *goal)
+{
+    Monte_State *ms = (Monte_State *) state;
+
+    goal->col = ms->desired_col;
+    goal->rot = ms->desired_rot;
+    goal->row = -1;
+    return ms->know_what_to_do;
+}
+
+/*
+ * Scholar goes by the learned evaluator, two pieces deep and leaving
+ * nothing out: every placement of the next piece after every placement
+ * of the current one. Each placement of the current piece (alpha) gets
+ * one batch of next-piece placements (beta), so think() does a batch
+ * at a time.
+ */
+typedef struct scholar_struct {
+    int know_what_to_do;
+    int desired_col;
+    int desired_rot;
+
+    int n;		/* alpha placements, or -1 before we try them */
+    int expanding;	/* the next one to look under */
+    int best;		/* alpha placement we like, or -1 */
+    double best_score;
+    AI_Batch *alpha;
+    AI_Batch *beta;
+    double *alpha_score;
+    double *beta_score;
+    Grid t;		/* the board under alpha placement "expanding" */
+} Scholar_State;
+
+/* how much worse an alpha placement the next piece cannot follow is */
+#define SCHOLAR_STUCK	1e6
+
+/***************************************************************************
+ *      scholar_ai_reset()
+ ***************************************************************************/
+static void *
+scholar_ai_reset(void *state, Grid *g)
+{
+    Scholar_State *ss = (Scholar_State *) state;
+
+    if (ss == NULL) {
+	int n = 4 * (g->w - WES_MIN_COL);
+	Calloc(ss, Scholar_State *, sizeof(Scholar_State));
+	ss->alpha = ai_batch_new(g, n);
+	ss->beta = ai_batch_new(g, n);
+	Calloc(ss->alpha_score, double *, ss->alpha->max * sizeof(double));
+	Calloc(ss->beta_score, double *, ss->beta->max * sizeof(double));
+	ss->t = generate_board(g->w, g->h, 0);
+    }
+    ss->know_what_to_do = 0;
+    ss->desired_col = g->w / 2;
+    ss->desired_rot = 0;
+    ss->n = -1;
+    return ss;
+}
+
+/***************************************************************************
+ *      scholar_ai_release()
+ ***************************************************************************/
+static void
+scholar_ai_release(void *state)
+{
+    Scholar_State *ss = (Scholar_State *) state;
+
+    ai_batch_free(ss->alpha);
+    ai_batch_free(ss->beta);
+    Free(ss->alpha_score); Free(ss->beta_score);
+    free_board(&ss->t);
+    free(ss);
+}
+
+/***************************************************************************
+ *      scholar_ai_think()
+ * The alpha placement whose best beta follow-up scores lowest wins; one
+ * with no follow-up at all only wins if nothing else fits.
+ ***************************************************************************/
+static void
+scholar_ai_think(void *data, Grid *g, play_piece *pp, play_piece *np, 
+	int col, int row, int rot)
+{
+    Scholar_State *ss = (Scholar_State *) data;
+    Uint32 incoming_time = sim_ticks();
+
+    Assert(ss);
+    if (ss->know_what_to_do)
+	return;
+
+    if (ss->n < 0) {
+	ss->n = ai_batch_all(ss->alpha, g, pp, row);
+	ai_batch_learned(ss->alpha, ss->alpha_score);
+	ss->expanding = 0;
+	ss->best = -1;
+	ss->best_score = 0.0;
+    }
+
+    do {
+	int a, i, nb;
+	double score;
+
+	if (ss->expanding == ss->n) {
+	    if (ss->best >= 0) {
+		ss->desired_col = ss->alpha->place[ss->best].col;
+		ss->desired_rot = ss->alpha->place[ss->best].rot;
+	    } else {
+		ss->desired_col = col;
+		ss->desired_rot = rot;
+	    }
+	    ss->know_what_to_do = 1;
+	    return;
+	}
+	a = ss->expanding++;
+	if (ss->alpha->lines[a] == -1)
+	    continue;
+
+	score = ss->alpha_score[a] + SCHOLAR_STUCK;
+	if (np) {
+	    AI_Placement *p = &ss->alpha->place[a];
+
+	    sim_copy_grid(&ss->t, g);
+	    drop_piece_on_grid(&ss->t, pp, p->col, p->row, p->rot);
+	    /* the next piece comes in at the top */
+	    nb = ai_batch_all(ss->beta, &ss->t, np, 0);
+	    ai_batch_learned(ss->beta, ss->beta_score);
+	    for (i=0; i<nb; i++)
+		if (ss->beta->lines[i] != -1 && ss->beta_score[i] < score)
+		    score = ss->beta_score[i];
+	} else
+	    score = ss->alpha_score[a];
+
+	if (ss->best < 0 || score < ss->best_score) {
+	    ss->best = a;
+	    ss->best_score = score;
+	}
+    } while (sim_ticks() == incoming_time);
+}
+
+/***************************************************************************
+ *      scholar_ai_move()
+ ***************************************************************************/
+static Command
+scholar_ai_move(void *state, Grid *g, play_piece *pp, play_piece *np, 
+	int col, int row, int rot)
+{
+    Scholar_State *ss = (Scholar_State *) state;
+
+    if (rot != ss->desired_rot)
+	return MOVE_ROTATE;
+    else if (col > ss->desired_col) 
+	return MOVE_LEFT;
+    else if (col < ss->desired_col) 
+	return MOVE_RIGHT;
+    else if (ss->know_what_to_do) 
+	return MOVE_DOWN;
+    else 
+	return MOVE_NONE;
+}
+
+/***************************************************************************
+ *      scholar_ai_target()
+ ***************************************************************************/
+static int
+scholar_ai_target(void *state, Grid *g, play_piece *pp, int row, 
+	AI_Placement *goal)
+{
+    Scholar_State *ss = (Scholar_State *) state;
+
+    goal->col = ss->desired_col;
+    goal->rot = ss->desired_rot;
+    goal->row = -1;
+    return ss->know_what_to_do;
+}
+
+/***************************************************************************
+ *      scholar_evaluate()
+ ***************************************************************************/
+static void
+scholar_evaluate(void *state, AI_Batch *b, double *scores)
+{
+    ai_batch_learned(b, scores);
+}
+
 /*************************************************************************
  *   AI_Players_Setup()
  * This function creates a structure describing all of the available AI
@@ -812,7 +2730,7 @@ AI_Players_Setup(void)
 
     Calloc(retval, AI_Players *, sizeof(AI_Players));
 
-    retval->n = 4;	/* change this to add another */
+    retval->n = 6;	/* change this to add another */
     Calloc(retval->player, AI_Player *, sizeof(AI_Player) * retval->n);
     i = 0;
 
@@ -821,6 +2739,9 @@ AI_Players_Setup(void)
     retval->player[i].move 	= wes_ai_move;
     retval->player[i].think 	= beginner_ai_think;
     retval->player[i].reset	= wes_ai_reset;
+    retval->player[i].evaluate	= weight_evaluate;
+    retval->player[i].target	= wes_ai_target;
+    retval->player[i].release	= wes_ai_release;
     i++;
 
     retval->player[i].name 	= "Lightning";
@@ -828,6 +2749,9 @@ AI_Players_Setup(void)
     retval->player[i].move 	= wes_ai_move;
     retval->player[i].think 	= wes_ai_think;
     retval->player[i].reset	= wes_ai_reset;
+    retval->player[i].evaluate	= weight_evaluate;
+    retval->player[i].target	= wes_ai_target;
+    retval->player[i].release	= wes_ai_release;
     i++;
 
     retval->player[i].name	= "Aliz";
@@ -835,6 +2759,9 @@ AI_Players_Setup(void)
     retval->player[i].move 	= alizMove;
     retval->player[i].think 	= alizCogitate;
     retval->player[i].reset	= alizReset;
+    retval->player[i].evaluate	= alizEvaluate;
+    retval->player[i].target	= alizTarget;
+    retval->player[i].release	= alizRelease;
     i++;
 
     retval->player[i].name	= "Double-Think";
@@ -842,7 +2769,33 @@ AI_Players_Setup(void)
     retval->player[i].move 	= double_ai_move;
     retval->player[i].think 	= double_ai_think;
     retval->player[i].reset	= double_ai_reset;
+    retval->player[i].evaluate	= weight_evaluate;
+    retval->player[i].target	= double_ai_target;
+    retval->player[i].release	= double_ai_release;
+    retval->player[i].cont	= double_ai_cont;
     i++;
+
+    retval->player[i].name	= "Gambler";
+    retval->player[i].msg	= "Plays the odds on every piece.";
+    retval->player[i].move 	= monte_ai_move;
+    retval->player[i].think 	= monte_ai_think;
+    retval->player[i].reset	= monte_ai_reset;
+    retval->player[i].evaluate	= weight_evaluate;
+    retval->player[i].target	= monte_ai_target;
+    retval->player[i].release	= monte_ai_release;
+    i++;
+
+    retval->player[i].name	= "Scholar";
+    retval->player[i].msg	= "Learned it all from a book.";
+    retval->player[i].move 	= scholar_ai_move;
+    retval->player[i].think 	= scholar_ai_think;
+    retval->player[i].reset	= scholar_ai_reset;
+    retval->player[i].evaluate	= scholar_evaluate;
+    retval->player[i].target	= scholar_ai_target;
+    retval->player[i].release	= scholar_ai_release;
+    i++;
+
+    plugin_load_all(retval);
     
     Debug("AI Players Initialized (%d AIs).\n",retval->n);
 
@@ -22,7 +22,129 @@ typedef enum {
     MOVE_DOWN		= 4,
 } Command;
 
-/* An AI player has a name and must implement these three functions. */
+/* One way to put a piece down: where it starts falling straight down. */
+typedef struct AI_Placement_struct {
+    int col;
+    int row;
+    int rot;
+} AI_Placement;
+
+/*
+ * The boards that come out of a batch of placements, structure-of-arrays:
+ * row y of board i is occupied[y * max + i] (one bit per column), so a
+ * single row of many boards sits in consecutive words and the evaluators
+ * can score several boards per instruction. garbage[] and same_left[]
+ * are laid out the same way; see Grid_Masks for what the bits mean.
+ * The evaluators score MASK_LANES boards at a time, and max is always a
+ * multiple of that.
+ */
+#define MASK_LANES	4
+typedef struct AI_Batch_struct {
+    int n;		/* boards in use */
+    int max;		/* room for this many */
+    int w;
+    int h;
+    Uint32 *occupied;
+    Uint32 *garbage;
+    Uint32 *same_left;
+    AI_Placement *place;	/* what made board i */
+    int *lines;		/* lines it cleared, -1 if the piece did not fit */
+} AI_Batch;
+
+/*
+ * What the board evaluators go by: weight_board() (Wes's AIs) charges
+ * badness[x] per block in column x times its height, "hole" per hole and
+ * "same_color" per pair of like colors, and evalBoard() (Kiri's) adds up
+ * the rest, one factor per term. An AI profile file holds one of these.
+ */
+#define AI_BADNESS_W	10
+#define AI_WEIGHTS_N	(AI_BADNESS_W + 10)
+typedef struct AI_Weights_struct {
+    int badness[AI_BADNESS_W];
+    int hole;
+    int same_color;
+
+    double max_height;
+    double avg_height;
+    double bumpiness;
+    double holes;
+    double canyons;
+    double garbage;
+    double row;
+    double lines;
+} AI_Weights;
+
+/*
+ * Where an AI's time goes. The counters are kept per thread, by
+ * ai_new_piece(), ai_think() and wherever the work is done; see
+ * ai_counters_mark() and ai_counters_add() for giving each player its
+ * share, and ai_take_counters(). cascade[] says, for the pieces that fit,
+ * how many rounds of falling and clearing each drop set off (the last
+ * bucket counts that many or more).
+ */
+#define AI_CASCADE_MAX	8
+#define AI_THINK_SLICE	1	/* ticks one think() call should take */
+typedef struct AI_Counters_struct {
+    unsigned long decisions;	/* pieces handed to the AI */
+    unsigned long candidates;	/* placements it considered */
+    unsigned long drops;	/* drop_piece_on_grid() calls */
+    unsigned long gravity;	/* steps of falling in those */
+    unsigned long cascade[AI_CASCADE_MAX];
+    unsigned long evals;	/* boards scored */
+    unsigned long thinks;	/* think() calls */
+    unsigned long settled;	/* ... that found its mind made up */
+    unsigned long overruns;	/* ... that took over AI_THINK_SLICE */
+    unsigned long think_ticks;	/* spent in think() */
+} AI_Counters;
+
+/*
+ * A learned board evaluator (see ai_batch_learned()). Each board becomes
+ * w + AI_MODEL_EXTRA numbers: the height of every column, then holes,
+ * bumpiness, the tallest column, well depth, pairs of like colors,
+ * garbage left and lines cleared. Those are normalized, (x - mean) *
+ * scale, and go through either one linear layer (hidden == 0) or one
+ * layer of "hidden" rectified units and then a linear one. The output is
+ * how bad the board is.
+ *
+ * A model file is, in the machine's own byte order: the 8 bytes of
+ * AI_MODEL_MAGIC, int32 features, int32 hidden, then float32 mean[features],
+ * scale[features] and either w[features], b (linear) or
+ * w1[hidden][features], b1[hidden], w2[hidden], b2.
+ */
+#define AI_MODEL_MAGIC		"ATRISNN1"
+#define AI_MODEL_EXTRA		7
+#define AI_MODEL_MAX_HIDDEN	256
+typedef struct AI_Model_struct {
+    int features;
+    int hidden;		/* 0 for a linear model */
+    float *mean;	/* [features] */
+    float *scale;	/* [features] */
+    float *w1;		/* [hidden][features], or [features] if linear */
+    float *b1;		/* [hidden] */
+    float *w2;		/* [hidden] */
+    float b2;
+} AI_Model;
+
+/* score given to placements that do not fit */
+#define AI_BATCH_INVALID	(1<<30)
+
+/* The inputs that take a falling piece to where its AI wants it. */
+#define AI_PLAN_MAX	64
+typedef struct AI_Plan_struct {
+    int n;
+    Command move[AI_PLAN_MAX];
+} AI_Plan;
+
+/* An AI player has a name and must implement these three functions. 
+ * evaluate() is optional: it scores a whole batch of boards the way this
+ * AI would (lower is better). So is target(): once it returns 1 the event
+ * loop steers the piece to *goal by itself (goal->row is the row the piece
+ * should come to rest on, or -1 for "straight down") and stops calling
+ * move(). And so is release(), which frees a state that reset() made.
+ * cont() is optional too: when the last piece was played, it is called
+ * instead of reset() with the new piece (the old "next" one) and where
+ * the last piece went, so an AI that looked ahead can carry its search
+ * over. It returns the state just as reset() does. See ai_new_piece(). */
 typedef struct AI_Player_struct {
     char *name;	
     char *msg;
@@ -31,6 +153,11 @@ typedef struct AI_Player_struct {
     void (*think)  (void *state, Grid *, play_piece *, play_piece *,
 		    int , int , int );
     void * (*reset)  (void *state, Grid *);
+    void (*evaluate)(void *state, AI_Batch *, double *scores);
+    int (*target)(void *state, Grid *, play_piece *, int row, 
+		    AI_Placement *goal);
+    void (*release)(void *state);
+    void * (*cont)(void *state, Grid *, play_piece *, AI_Placement *played);
     int delay_factor;	
 } AI_Player;
 
@@ -0,0 +1,112 @@
+/*
+ *                               Alizarin Tetris
+ * The interface for AI players that live in shared objects.
+ *
+ * At startup every "*.so" in the plugin directory (see plugin_set_dir())
+ * is opened and its AI_PLUGIN_ENTRY function is called with i = 0, 1, 2
+ * ... until it returns NULL; each AI_Plugin it hands back becomes one more
+ * AI_Player. Build one against the game's own headers:
+ *
+ *	cc -shared -fPIC -I/path/to/atris `sdl-config --cflags` my_ai.c \
+ *	    -o my_ai.so
+ *
+ * A plugin sees the game through an AI_View: const pointers straight at
+ * the board and pieces the game is using, nothing copied. It must not
+ * write through them. To try a move it asks the host (AI_Host) for a
+ * board of its own, or for a batch, and uses the same gravity, clearing
+ * and batch evaluators as the built-in players.
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+#pragma once
+#ifndef __AI_PLUGIN_H
+#define __AI_PLUGIN_H
+#include "ai.h"
+
+/* bumped whenever AI_View, AI_Host, AI_Plugin or AI_Layout change shape */
+#define AI_PLUGIN_ABI	2
+#define AI_PLUGIN_ENTRY	"atris_ai_plugin"
+
+/*
+ * The game's own structures that plugins read directly, as they were
+ * when the plugin (or the game) was built. Both sides fill this in with
+ * AI_PLUGIN_LAYOUT, and the game turns away a plugin whose layout is not
+ * its own. A change to one of these structures that keeps its size (two
+ * fields swapped, say) still has to bump AI_PLUGIN_ABI.
+ */
+typedef struct AI_Layout_struct {
+    Uint32 grid;	/* sizeof(Grid) */
+    Uint32 piece;	/* sizeof(piece), what play_piece's base is */
+    Uint32 play_piece;	/* sizeof(play_piece) */
+    Uint32 masks;	/* sizeof(Grid_Masks) */
+    Uint32 batch;	/* sizeof(AI_Batch) */
+    Uint32 lanes;	/* MASK_LANES */
+} AI_Layout;
+
+#define AI_PLUGIN_LAYOUT	{ sizeof(Grid), sizeof(piece), \
+	sizeof(play_piece), sizeof(Grid_Masks), sizeof(AI_Batch), MASK_LANES }
+
+/* What the AI is shown. The piece's shape in each rotation is in
+ * cp->base->bitmap[rot] (see BITMAP() in piece.h). */
+typedef struct AI_View_struct {
+    const Grid *g;		/* the board */
+    const play_piece *cp;	/* the falling piece */
+    const play_piece *np;	/* the one after it */
+    int col;			/* where the falling piece is now */
+    int row;
+    int rot;
+} AI_View;
+
+/* What the game does for a plugin. */
+typedef struct AI_Host_struct {
+    int abi;
+    AI_Layout layout;		/* AI_PLUGIN_LAYOUT */
+
+    /* boards of the plugin's own, like "like" (w, h and contents) */
+    void (*board_new)(Grid *g, const Grid *like);
+    void (*board_copy)(Grid *to, const Grid *from);
+    void (*board_free)(Grid *g);
+
+    /* the rules: valid() is 1 if the piece fits there, drop() puts it down
+     * and lets everything fall and clear (lines cleared or -1) */
+    int (*valid)(const Grid *g, const play_piece *pp, int col, int row,
+	    int rot);
+    int (*drop)(Grid *g, const play_piece *pp, int col, int row, int rot);
+    void (*masks)(const Grid *g, Grid_Masks *m);
+
+    /* many placements at once, and the built-in evaluators for them;
+     * lower scores are better */
+    AI_Batch * (*batch_new)(const Grid *like, int max);
+    void (*batch_free)(AI_Batch *b);
+    void (*batch_drop)(AI_Batch *b, const Grid *g, const play_piece *pp,
+	    const AI_Placement *p, int n);
+    int (*batch_all)(AI_Batch *b, const Grid *g, const play_piece *pp,
+	    int row);
+    void (*batch_weigh)(AI_Batch *b, int *scores);	/* Wes's */
+    void (*batch_eval)(AI_Batch *b, double *scores);	/* Kiri's */
+
+    /* the clock to think by: headless games run on a virtual one */
+    Uint32 (*ticks)(void);
+} AI_Host;
+
+/* What a plugin does for the game: AI_Player's functions, plus reset()
+ * being told who its host is. target() only knows the board, the piece
+ * and its row (np is NULL, col and rot -1). move() may be NULL if there
+ * is a target(), and evaluate() and release() may always be NULL. */
+typedef struct AI_Plugin_struct {
+    int abi;			/* AI_PLUGIN_ABI */
+    AI_Layout layout;		/* AI_PLUGIN_LAYOUT */
+    const char *name;
+    const char *msg;
+    void * (*reset)(void *state, const Grid *g, const AI_Host *host);
+    void (*think)(void *state, const AI_View *v);
+    Command (*move)(void *state, const AI_View *v);
+    int (*target)(void *state, const AI_View *v, AI_Placement *goal);
+    void (*evaluate)(void *state, AI_Batch *b, double *scores);
+    void (*release)(void *state);
+} AI_Plugin;
+
+/* what AI_PLUGIN_ENTRY must look like */
+typedef const AI_Plugin * (*AI_Plugin_Entry)(const AI_Host *host, int i);
+
+#endif
@@ -14,6 +14,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <math.h>
+#include <dlfcn.h>
 char *error_msg = NULL;
 #include <sys/types.h>
 #include <unistd.h>
@@ -50,11 +52,22 @@ char *error_msg = NULL;
 #endif
 
 #include <time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #define ID_FILENAME	"Atris.Players"
 #include <SDL/SDL.h>
 #include <SDL/SDL_main.h>
 #include <SDL/SDL_ttf.h>
+#ifdef SDL_VIDEO_DRIVER_X11
+#include <SDL/SDL_syswm.h>	/* see idle_setup() */
+#endif
+#if HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#if HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
 #define ATRIS_LIBDIR "$(prefix)/games/atris"
 #if HAVE_SYS_SOCKET_H
 #	include <sys/socket.h>
@@ -74,6 +87,19 @@ char *error_msg = NULL;
 #include "sound.h"
 #include "identity.h"
 #include "options.h"
+#include "sim.h"
+#include "tournament.h"
+#include "tune.h"
+#include "bench.h"
+#include "ai_plugin.h"
+#include "plugin.h"
+#include "selfplay.h"
+#include "book.h"
+#include "timer.h"
+#include "latency.h"
+#include "idle.h"
+#include "render.h"
+#include "session.h"
 
 
 /* function prototypes */
@@ -90,11 +116,10 @@ char *error_msg = NULL;
 
 #define NUM_HIGH_SCORES 10 /* number of scores to save */
 
-static color_style *event_cs[2];	/* pass these to event_loop */
-static sound_style *event_ss[2];
-static AI_Player *event_ai[2];
-static char *event_name[2];
-extern int Score[2];
+static color_style *event_cs[MAX_PLAYERS];	/* pass these to event_loop */
+static sound_style *event_ss[MAX_PLAYERS];
+static AI_Player *event_ai[MAX_PLAYERS];
+static char *event_name[MAX_PLAYERS];
 
 /***************************************************************************
  *      Panic()
@@ -137,6 +162,46 @@ usage(void)
 	   "\t-d=X --depth=X\t\tSet color detph (bpp) to X.\n"
 	   "\t-r=X --repeat=X\t\tSet the keyboard repeat delay to X.\n"
 	   "\t\t\t\t(1 = Slow Repeat, 16 = Fast Repeat)\n"
+	   "\t--rollouts=X\t\tGambler AI plays X games out per choice.\n"
+	   "\t--threads=X\t\tUse X AI threads (0 = one per processor).\n"
+	   "\t--ai-overlay\t\tShow what each AI is doing under its name.\n"
+	   "\t--no-render-thread\tDraw the boards between moves instead of on\n"
+	   "\t\t\t\ta thread of their own.\n"
+	   "\t--turbo[=X]\t\tPlay AI vs. AI and the demo as fast as they will\n"
+	   "\t\t\t\tgo, silently, drawing every Xth step (64).\n"
+	   "\t--no-turbo\t\tPlay them at human speed.\n"
+	   "\t--players=X\t\tAI vs. AI is a free-for-all between X AIs,\n"
+	   "\t\t\t\tHuman vs. AI between you and X-1 of them\n"
+	   "\t\t\t\t(2 up to what fits on the screen, default 2).\n"
+	   "\t--tournament[=X]\tPlay X games (default 20) between every two\n"
+	   "\t\t\t\tAIs without a display, report and quit.\n"
+	   "\t--level=X\t\tTournament, tuning or self-play level (default\n"
+	   "\t\t\t\t4; self-play goes through levels 1-9).\n"
+	   "\t--seed=X\t\tTournament, tuning or self-play seed (default 1).\n"
+	   "\t--tune=wes|aliz\t\tTune Wes's or Kiri's AI weights without a\n"
+	   "\t\t\t\tdisplay, save them and quit.\n"
+	   "\t--generations=X\t\tTuning generations (default 30).\n"
+	   "\t--games=X\t\tTuning games per candidate (default 40).\n"
+	   "\t--tune-out=FILE\t\tWhere the tuned weights go (atris.profile).\n"
+	   "\t--profile=FILE\t\tLoad AI weights from FILE.\n"
+	   "\t--model=FILE\t\tLoad the learned evaluator from FILE.\n"
+	   "\t--plugins=DIR\t\tLoad AI plugins from DIR (default plugins/).\n"
+	   "\t--bench[=X]\t\tTime every AI on X positions (default 500)\n"
+	   "\t\t\t\tand quit.\n"
+	   "\t--bench-out=FILE\tWhere the timings go (bench.json).\n"
+	   "\t--selfplay[=X]\t\tPlay X games (default 1000) between the AIs\n"
+	   "\t\t\t\twithout a display, record every move for\n"
+	   "\t\t\t\ttraining and quit.\n"
+	   "\t--selfplay-ai=NAME\tOnly let NAME play, against itself.\n"
+	   "\t--selfplay-out=PREFIX\tWhere the records go (selfplay.NN.rec\n"
+	   "\t\t\t\tand selfplay.NN.idx).\n"
+	   "\t--shards=X\t\tSelf-play files written at once (default:\n"
+	   "\t\t\t\tone per CPU).\n"
+	   "\t--book=FILE\t\tPlay the openings from the book in FILE.\n"
+	   "\t--make-book[=X]\t\tWork out the first pieces on X boards (default\n"
+	   "\t\t\t\t20000) without a display, save them and quit.\n"
+	   "\t--book-ai=NAME\t\tWho works them out (Double-Think).\n"
+	   "\t--book-out=FILE\t\tWhere the book goes (atris.book).\n"
 	   );
     exit(1);
 }
@@ -169,6 +234,12 @@ save_options(char *filespec)
 	    "long_settle = %d\n"
 	    "# upward_rotation = 0 or 1\n"
 	    "upward_rotation = %d\n"
+	    "# ai_rollouts = games the Gambler AI plays out per choice\n"
+	    "ai_rollouts = %d\n"
+	    "# ai_threads = AI simulation threads (0 = one per processor)\n"
+	    "ai_threads = %d\n"
+	    "# turbo = 0, or draw AI-only games every N steps, flat out\n"
+	    "turbo = %d\n"
 	    "#\n"
 	    "color_style = %d\n"
 	    "sound_style = %d\n"
@@ -180,6 +251,7 @@ save_options(char *filespec)
 	    Options.key_repeat_delay, Options.special_wanted,
 	    Options.faster_levels, Options.long_settle_delay,
 	    Options.upward_rotation,
+	    Options.ai_rollouts, Options.ai_threads, Options.turbo,
 	    Options.named_color, Options.named_sound, Options.named_piece,
 	    Options.named_game);
     fclose(fout);
@@ -205,6 +277,12 @@ load_options(char * filespec)
     Options.faster_levels = FALSE;
     Options.upward_rotation = TRUE;
     Options.long_settle_delay = TRUE;
+    Options.ai_rollouts = 16;
+    Options.ai_threads = 0;
+    Options.ai_overlay = FALSE;
+    Options.render_thread = TRUE;
+    Options.turbo = 0;
+    Options.players = 2;
     Options.named_color = -1;
     Options.named_sound = -1;
     Options.named_piece = -1;
@@ -241,6 +319,15 @@ load_options(char * filespec)
 	    sscanf(buf,"%s = %d",cmd,&Options.long_settle_delay);
 	} else if (!strcasecmp(cmd,"upward_rotation")) {
 	    sscanf(buf,"%s = %d",cmd,&Options.upward_rotation);
+	} else if (!strcasecmp(cmd,"ai_rollouts")) {
+	    sscanf(buf,"%s = %d",cmd,&Options.ai_rollouts);
+	    if (Options.ai_rollouts < 1) Options.ai_rollouts = 1;
+	} else if (!strcasecmp(cmd,"ai_threads")) {
+	    sscanf(buf,"%s = %d",cmd,&Options.ai_threads);
+	    if (Options.ai_threads < 0) Options.ai_threads = 0;
+	} else if (!strcasecmp(cmd,"turbo")) {
+	    sscanf(buf,"%s = %d",cmd,&Options.turbo);
+	    if (Options.turbo < 0) Options.turbo = 0;
 	} else if (!strcasecmp(cmd,"color_style")) {
 	    sscanf(buf,"%s = %d",cmd,&Options.named_color);
 	} else if (!strcasecmp(cmd,"sound_style")) {
@@ -258,6 +345,33 @@ load_options(char * filespec)
     return;
 }
 
+/* set by --tournament, --tune, --bench and friends */
+static Tournament tourney = { 0, 4, 1, 1000 };
+static Tuner tuner = { TUNE_NONE, 30, 40, 4, 1, 1000, "atris.profile" };
+static Bench bench = { 0, 1, "bench.json" };
+static Selfplay selfplay = { 0, 0, 1, 1000, 0, NULL, "selfplay" };
+static Book book = { 0, 0, 1, 3, "Double-Think", "atris.book" };
+static char *profile_file = NULL;
+static char *model_file = NULL;
+static char *book_file = NULL;
+
+/***************************************************************************
+ *      cwd_path()
+ * Files named on the command line are relative to where we started, not
+ * to ATRIS_LIBDIR: pin them down before we go there.
+ ***************************************************************************/
+static char *
+cwd_path(char *file)
+{
+    char dir[1024], *retval;
+
+    if (file[0] == '/' || !getcwd(dir, sizeof(dir)))
+	return file;
+    Malloc(retval, char *, strlen(dir) + strlen(file) + 2);
+    sprintf(retval, "%s/%s", dir, file);
+    return retval;
+}
+
 /***************************************************************************
  *      parse_options()
  * Check the command-line arguments.
@@ -290,6 +404,89 @@ parse_options(int argc, char *argv[])
 	    sscanf(strchr(argv[i],'=')+1,"%d",&Options.key_repeat_delay);
 	    if (Options.key_repeat_delay < 1) Options.key_repeat_delay = 1;
 	    if (Options.key_repeat_delay > 32) Options.key_repeat_delay = 32;
+	} else if (!strncmp(argv[i],"--rollouts=", 11)) {
+	    sscanf(strchr(argv[i],'=')+1,"%d",&Options.ai_rollouts);
+	    if (Options.ai_rollouts < 1) Options.ai_rollouts = 1;
+	} else if (!strncmp(argv[i],"--threads=", 10)) {
+	    sscanf(strchr(argv[i],'=')+1,"%d",&Options.ai_threads);
+	    if (Options.ai_threads < 0) Options.ai_threads = 0;
+	} else if (!strcmp(argv[i],"--ai-overlay")) {
+	    Options.ai_overlay = TRUE;
+	} else if (!strcmp(argv[i],"--render-thread")) {
+	    Options.render_thread = TRUE;
+	} else if (!strcmp(argv[i],"--no-render-thread")) {
+	    Options.render_thread = FALSE;
+	} else if (!strcmp(argv[i],"--turbo")) {
+	    Options.turbo = TURBO_EVERY;
+	} else if (!strncmp(argv[i],"--turbo=", 8)) {
+	    sscanf(strchr(argv[i],'=')+1,"%d",&Options.turbo);
+	    if (Options.turbo < 1) Options.turbo = 1;
+	} else if (!strcmp(argv[i],"--no-turbo")) {
+	    Options.turbo = 0;
+	} else if (!strncmp(argv[i],"--players=", 10)) {
+	    sscanf(strchr(argv[i],'=')+1,"%d",&Options.players);
+	    if (Options.players < 2) Options.players = 2;
+	    if (Options.players > MAX_PLAYERS) Options.players = MAX_PLAYERS;
+	} else if (!strcmp(argv[i],"--tournament")) {
+	    tourney.games = 20;
+	} else if (!strncmp(argv[i],"--tournament=", 13)) {
+	    sscanf(strchr(argv[i],'=')+1,"%d",&tourney.games);
+	    if (tourney.games < 1) tourney.games = 1;
+	} else if (!strncmp(argv[i],"--level=", 8)) {
+	    sscanf(strchr(argv[i],'=')+1,"%d",&tourney.level);
+	    if (tourney.level < 0) tourney.level = 0;
+	    tuner.level = selfplay.level = book.level = tourney.level;
+	} else if (!strncmp(argv[i],"--seed=", 7)) {
+	    sscanf(strchr(argv[i],'=')+1,"%u",&tourney.seed);
+	    if (tourney.seed == 0) tourney.seed = 1;
+	    tuner.seed = bench.seed = selfplay.seed = book.seed = tourney.seed;
+	} else if (!strcmp(argv[i],"--tune=wes")) {
+	    tuner.family = TUNE_WES;
+	} else if (!strcmp(argv[i],"--tune=aliz")) {
+	    tuner.family = TUNE_ALIZ;
+	} else if (!strncmp(argv[i],"--generations=", 14)) {
+	    sscanf(strchr(argv[i],'=')+1,"%d",&tuner.generations);
+	    if (tuner.generations < 1) tuner.generations = 1;
+	} else if (!strncmp(argv[i],"--games=", 8)) {
+	    sscanf(strchr(argv[i],'=')+1,"%d",&tuner.games);
+	    if (tuner.games < 2) tuner.games = 2;
+	} else if (!strncmp(argv[i],"--tune-out=", 11)) {
+	    tuner.out = strchr(argv[i],'=')+1;
+	} else if (!strcmp(argv[i],"--bench")) {
+	    bench.positions = 500;
+	} else if (!strncmp(argv[i],"--bench=", 8)) {
+	    sscanf(strchr(argv[i],'=')+1,"%d",&bench.positions);
+	    if (bench.positions < 1) bench.positions = 1;
+	} else if (!strncmp(argv[i],"--bench-out=", 12)) {
+	    bench.out = strchr(argv[i],'=')+1;
+	} else if (!strcmp(argv[i],"--selfplay")) {
+	    selfplay.games = 1000;
+	} else if (!strncmp(argv[i],"--selfplay=", 11)) {
+	    sscanf(strchr(argv[i],'=')+1,"%d",&selfplay.games);
+	    if (selfplay.games < 1) selfplay.games = 1;
+	} else if (!strncmp(argv[i],"--selfplay-ai=", 14)) {
+	    selfplay.ai = strchr(argv[i],'=')+1;
+	} else if (!strncmp(argv[i],"--selfplay-out=", 15)) {
+	    selfplay.out = strchr(argv[i],'=')+1;
+	} else if (!strncmp(argv[i],"--shards=", 9)) {
+	    sscanf(strchr(argv[i],'=')+1,"%d",&selfplay.shards);
+	} else if (!strcmp(argv[i],"--make-book")) {
+	    book.positions = 20000;
+	} else if (!strncmp(argv[i],"--make-book=", 12)) {
+	    sscanf(strchr(argv[i],'=')+1,"%d",&book.positions);
+	    if (book.positions < 1) book.positions = 1;
+	} else if (!strncmp(argv[i],"--book-ai=", 10)) {
+	    book.ai = strchr(argv[i],'=')+1;
+	} else if (!strncmp(argv[i],"--book-out=", 11)) {
+	    book.out = strchr(argv[i],'=')+1;
+	} else if (!strncmp(argv[i],"--book=", 7)) {
+	    book_file = strchr(argv[i],'=')+1;
+	} else if (!strncmp(argv[i],"--plugins=", 10)) {
+	    plugin_set_dir(cwd_path(strchr(argv[i],'=')+1));
+	} else if (!strncmp(argv[i],"--profile=", 10)) {
+	    profile_file = strchr(argv[i],'=')+1;
+	} else if (!strncmp(argv[i],"--model=", 8)) {
+	    model_file = strchr(argv[i],'=')+1;
 	} else {
 	    Debug("option not understood: [%s]\n",argv[i]);
 	    usage();
@@ -368,11 +565,12 @@ level_adjust(int a[3], int b[3], int level[2], int match)
  * minutes per level, but the limit isn't deadly. Complex adjustment rules.
  ***************************************************************************/
 static void
-play_TWO_PLAYERS(color_styles cs, piece_styles ps, sound_styles ss,
-    Grid g[2], person *p1, person *p2)
+play_TWO_PLAYERS(Session *s, color_styles cs, piece_styles ps,
+    sound_styles ss, Grid g[2], person *p1, person *p2)
 {
     int curtimeleft;
     int match;
+    int who[2] = { HUMAN_PLAYER, HUMAN_PLAYER };
     int adjustment[2] = {-1, -1};	/* result of playing a match */
     int my_adj[3];			/* my three winnings so far */
     int their_adj[3];			/* their three winnings so far */
@@ -402,8 +600,8 @@ play_TWO_PLAYERS(color_styles cs, piece_styles ps, sound_styles ss,
 	event_name[1] = p2->name;
 
 	/* draw the background */
-	draw_background(screen, cs.style[0]->w, g, level, my_adj, their_adj,
-		event_name);
+	draw_background(s, screen, cs.style[0]->w, g, level, my_adj,
+		their_adj, event_name);
 
 	/* start the fun! */
 	curtimeleft = 120;
@@ -411,11 +609,11 @@ play_TWO_PLAYERS(color_styles cs, piece_styles ps, sound_styles ss,
 	event_cs[0] = event_cs[1] = cs.style[cs.choice];
 	event_ss[0] = event_ss[1] = ss.style[ss.choice];
 
-	if (event_loop(screen, ps.style[ps.choice], 
+	if (event_loop(s, screen, ps.style[ps.choice], 
 		event_cs, event_ss, g,
 		level, 0, &curtimeleft, 0, adjustment, NULL,
-		our_time, HUMAN_PLAYER, HUMAN_PLAYER, NULL) >= 0) {
-	    draw_background(screen, cs.style[0]->w,g,level,my_adj,their_adj,
+		our_time, who, NULL) >= 0) {
+	    draw_background(s, screen, cs.style[0]->w,g,level,my_adj,their_adj,
 		    event_name);
 	    SDL_Delay(1000);
 	}
@@ -429,107 +627,220 @@ play_TWO_PLAYERS(color_styles cs, piece_styles ps, sound_styles ss,
 	p2->level = level[1];
 
 	/* show them what's what! */
-	draw_background(screen, cs.style[0]->w,g,level,my_adj,their_adj, 
+	draw_background(s, screen, cs.style[0]->w,g,level,my_adj,their_adj, 
 		event_name);
-	draw_score(screen,0);
-	draw_score(screen,1);
-	done = give_notice(NULL,1);
+	draw_score(s, screen,0);
+	draw_score(s, screen,1);
+	done = give_notice(s, NULL,1);
     } /* end: while !done */
     return;
 }
 
 /***************************************************************************
  *      play_AI_VS_AI()
- * Play the AI_VS_AI-style game. Two AI's duke it out! Winnings and scores
- * are collected. 
+ * Play the AI_VS_AI-style game. The AIs aip[0] to aip[n-1] duke it out,
+ * every one for itself! Winnings and scores are collected. 
  ***************************************************************************/
 static void
-play_AI_VS_AI(color_styles cs, piece_styles ps, sound_styles ss,
-    Grid g[2], AI_Player *p1, AI_Player *p2)
+play_AI_VS_AI(Session *s, color_styles cs, piece_styles ps,
+    sound_styles ss, Grid g[], AI_Player *aip[], int n)
 {
     int curtimeleft;
-    int match;
-    int level[2];			/* level array: me + dummy slot */
-    int adjustment[2] = {-1, -1};	/* result of playing a match */
-    int my_adj[3];			/* my three winnings so far */
-    int their_adj[3];			/* their three winnings so far */
+    int i;
+    int level[MAX_PLAYERS];		/* everyone plays the same one */
+    int adjustment[MAX_PLAYERS];	/* result of playing a match */
+    int who[MAX_PLAYERS];
+    int results[MAX_PLAYERS][3];	/* everyone's winnings so far */
     int done = 0;
     time_t our_time;
-    int p1_results[3] = {0, 0, 0};
-    int p2_results[3] = {0, 0, 0};
 
-    my_adj[0] = -1; my_adj[1] = -1; my_adj[2] = -1;
-    their_adj[0] = -1; their_adj[1] = -1; their_adj[2] = -1; 
-    match = 0;
+    Assert(n >= 2 && n <= MAX_PLAYERS);
+    /* only as many as there is room to show */
+    n = max(2, min(n, free_for_all_room(screen, cs.style[0]->w, 10, 20)));
+    memset(results, 0, sizeof(results));
+    s->boards = n;
+    for (i=0; i<n; i++)
+	who[i] = AI_PLAYER;
 
     /* start the games */
     while (!done) { 
 
 	time(&our_time);
 	/* make the boards */
-	level[0] = level[1] = Options.faster_levels ? 1+ZEROTO(8) :
+	level[0] = Options.faster_levels ? 1+ZEROTO(8) :
 	    2+ZEROTO(16);
-	
 
+	for (i=0; i<n; i++) {
+	    level[i] = level[0];
+	    SeedRandom(our_time);
+	    g[i] = generate_board(10,20,level[0]);
+	    event_name[i] = aip[i]->name;
+	}
 	SeedRandom(our_time);
-	g[0] = generate_board(10,20,level[0]);
-	SeedRandom(our_time);
-	g[1] = generate_board(10,20,level[0]);
-	SeedRandom(our_time);
-
-	event_name[0] = p1->name;
-	event_name[1] = p2->name;
 
 	/* draw the background */
-	draw_background(screen, cs.style[0]->w, g, level, 
-		p1_results, p2_results, event_name); 
+	draw_background(s, screen, cs.style[0]->w, g, level, 
+		results[0], results[1], event_name); 
 	/* start the fun! */
 	curtimeleft = 120;
 
-	event_cs[0] = cs.style[cs.choice];
-	event_cs[1] = cs.style[ZEROTO(cs.num_style)];
-	event_ss[0] = event_ss[1] = ss.style[ss.choice];
-	event_ai[0] = p1; event_ai[1] = p2;
+	for (i=0; i<n; i++) {
+	    event_cs[i] = i ? cs.style[ZEROTO(cs.num_style)] :
+		cs.style[cs.choice];
+	    event_ss[i] = ss.style[ss.choice];
+	    event_ai[i] = aip[i];
+	}
 
-	if (event_loop(screen, ps.style[ps.choice], 
+	if (event_loop(s, screen, ps.style[ps.choice], 
 		event_cs, event_ss, g,
 		level, 0, &curtimeleft, 0, adjustment, NULL,
-		our_time, AI_PLAYER, AI_PLAYER, event_ai) < 0) {
+		our_time, who, event_ai) < 0) {
 	    return;
 	}
 
-	if (adjustment[0] != -1)
-	    p1_results[ adjustment[0] ] ++;
-	if (adjustment[1] != -1) 
-	    p2_results[ adjustment[1] ] ++;
+	for (i=0; i<n; i++)
+	    if (adjustment[i] != -1)
+		results[i][ adjustment[i] ] ++;
 
 	/* show them what's what! */
-	draw_background(screen, cs.style[0]->w, g, level,
-		p1_results, p2_results, event_name);
-	draw_score(screen,0);
-	draw_score(screen,1);
+	draw_background(s, screen, cs.style[0]->w, g, level,
+		results[0], results[1], event_name);
+	for (i=0; i<s->layout.boards; i++)
+	    draw_score(s, screen, i);
     } /* end: while !done */
     return;
 }
 
+/***************************************************************************
+ *      headless_setup()
+ * Gets the styles and the AIs ready for the off-screen modes. No video or
+ * audio is ever opened, so these run anywhere.
+ ***************************************************************************/
+static AI_Players *
+headless_setup(Uint32 seed, piece_style **psp, color_style **csp)
+{
+    color_styles cs;
+    piece_styles ps;
+    AI_Players *ai;
+
+    if (chdir(ATRIS_LIBDIR)) {
+	Debug("WARNING: cannot change directory to [%s]\n", ATRIS_LIBDIR);
+	Debug("WARNING: playing in current directory instead\n");
+    } 
+    ps = load_piece_styles();
+    cs = load_color_styles(NULL);
+    if (Options.named_color >= 0 && Options.named_color <
+	    cs.num_style) cs.choice = Options.named_color;
+    if (Options.named_piece >= 0 && Options.named_piece <
+	    ps.num_style) ps.choice = Options.named_piece;
+    ai = AI_Players_Setup();
+    SeedRandom(seed);
+
+    *psp = ps.style[ps.choice];
+    *csp = cs.style[cs.choice];
+    return ai;
+}
+
+/***************************************************************************
+ *      play_TOURNAMENT()
+ * Every AI plays every other one, off-screen, and we print the results.
+ ***************************************************************************/
+static int
+play_TOURNAMENT(void)
+{
+    piece_style *ps;
+    color_style *cs;
+    AI_Players *ai = headless_setup(tourney.seed, &ps, &cs);
+
+    return tournament_play(&tourney, ai, ps, cs);
+}
+
+/***************************************************************************
+ *      play_TUNE()
+ * Tunes the AI weights off-screen and saves the best ones we find. 
+ ***************************************************************************/
+static int
+play_TUNE(void)
+{
+    piece_style *ps;
+    color_style *cs;
+    AI_Players *ai = headless_setup(tuner.seed, &ps, &cs);
+
+    return tune_play(&tuner, ai, ps, cs);
+}
+
+/***************************************************************************
+ *      play_BENCH()
+ * Times every AI on the benchmark positions.
+ ***************************************************************************/
+static int
+play_BENCH(void)
+{
+    piece_style *ps;
+    color_style *cs;
+    AI_Players *ai = headless_setup(bench.seed, &ps, &cs);
+
+    return bench_play(&bench, ai, ps, cs);
+}
+
+/***************************************************************************
+ *      play_SELFPLAY()
+ * Records the AIs playing each other, off-screen, for training.
+ ***************************************************************************/
+static int
+play_SELFPLAY(void)
+{
+    piece_style *ps;
+    color_style *cs;
+    AI_Players *ai = headless_setup(selfplay.seed, &ps, &cs);
+
+    return selfplay_play(&selfplay, ai, ps, cs);
+}
+
+/***************************************************************************
+ *      play_BOOK()
+ * Works out the opening book, off-screen.
+ ***************************************************************************/
+static int
+play_BOOK(void)
+{
+    piece_style *ps;
+    color_style *cs;
+    AI_Players *ai = headless_setup(book.seed, &ps, &cs);
+
+    return book_make(&book, ai, ps, cs);
+}
+
 /***************************************************************************
  *      play_SINGLE_VS_AI()
- * Play the SINGLE_VS_AI-style game. You and someone else both have two
- * minutes per level, but the limit isn't deadly. Complex adjustment rules.
+ * Play the SINGLE_VS_AI-style game. You and the AIs aip[1] to aip[n-1] all
+ * have two minutes per level, but the limit isn't deadly. Complex
+ * adjustment rules: with more than one AI you are measured against the
+ * best of them.
  ***************************************************************************/
 static int
-play_SINGLE_VS_AI(color_styles cs, piece_styles ps, sound_styles ss,
-    Grid g[2], person *p, AI_Player *aip)
+play_SINGLE_VS_AI(Session *s, color_styles cs, piece_styles ps,
+    sound_styles ss, Grid g[], person *p, AI_Player *aip[], int n)
 {
     int curtimeleft;
     int match;
-    int level[2];			/* level array: me + dummy slot */
-    int adjustment[2] = {-1, -1};	/* result of playing a match */
+    int i;
+    int who[MAX_PLAYERS];
+    int level[MAX_PLAYERS];		/* level array: me + the AIs */
+    int adjustment[MAX_PLAYERS];	/* result of playing a match */
     int my_adj[3];			/* my three winnings so far */
     int their_adj[3];			/* their three winnings so far */
     int done = 0;
     time_t our_time;
 
+    Assert(n >= 2 && n <= MAX_PLAYERS);
+    /* only as many as there is room to show */
+    n = max(2, min(n, free_for_all_room(screen, cs.style[0]->w, 10, 20)));
+    s->boards = n;
+    who[0] = HUMAN_PLAYER;
+    for (i=1; i<n; i++)
+	who[i] = AI_PLAYER;
+
     my_adj[0] = my_adj[1] = my_adj[2] = -1;
     their_adj[0] = their_adj[1] = their_adj[2] = -1;
     match = 0;
@@ -539,49 +850,54 @@ play_SINGLE_VS_AI(color_styles cs, piece_styles ps, sound_styles ss,
     while (!done) { 
 	time(&our_time);
 	/* make the boards */
-	level[1] = level[0];
-
-	SeedRandom(our_time);
-	g[0] = generate_board(10,20,level[0]);
-	SeedRandom(our_time);
-	g[1] = generate_board(10,20,level[0]);
+	for (i=0; i<n; i++) {
+	    level[i] = level[0];
+	    SeedRandom(our_time);
+	    g[i] = generate_board(10,20,level[0]);
+	    event_name[i] = i ? aip[i]->name : p->name;
+	}
 	SeedRandom(our_time);
 
-	event_name[0] = p->name;
-	event_name[1] = aip->name;
-
 	/* draw the background */
-	draw_background(screen, cs.style[0]->w, g, level, my_adj, their_adj,
-		event_name);
+	draw_background(s, screen, cs.style[0]->w, g, level, my_adj,
+		their_adj, event_name);
 
 	/* start the fun! */
 	curtimeleft = 120;
 
-	event_cs[0] = cs.style[cs.choice];
-	event_cs[1] = cs.style[ZEROTO(cs.num_style)];
-	event_ss[0] = event_ss[1] = ss.style[ss.choice];
-	event_ai[0] = NULL; event_ai[1] = aip;
+	for (i=0; i<n; i++) {
+	    event_cs[i] = i ? cs.style[ZEROTO(cs.num_style)] :
+		cs.style[cs.choice];
+	    event_ss[i] = ss.style[ss.choice];
+	    event_ai[i] = i ? aip[i] : NULL;
+	    adjustment[i] = -1;
+	}
 
-	if (event_loop(screen, ps.style[ps.choice], 
+	if (event_loop(s, screen, ps.style[ps.choice], 
 		event_cs, event_ss, g,
 		level, 0, &curtimeleft, 0, adjustment, NULL,
-		our_time, HUMAN_PLAYER, AI_PLAYER, event_ai) >= 0) {
-	    draw_background(screen, cs.style[0]->w,g,level,my_adj,their_adj,
+		our_time, who, event_ai) >= 0) {
+	    draw_background(s, screen, cs.style[0]->w,g,level,my_adj,their_adj,
 		    event_name);
-	    draw_score(screen,0);
-	    draw_score(screen,1);
+	    for (i=0; i<s->layout.boards; i++)
+		draw_score(s, screen, i);
 	    SDL_Delay(1000);
 	}
 	my_adj[match] = adjustment[0];
+	/* the field did as well as its best */
 	their_adj[match] = adjustment[1];
+	for (i=2; i<n; i++)
+	    if (adjustment[i] != -1 && (their_adj[match] == -1 ||
+			adjustment[i] < their_adj[match]))
+		their_adj[match] = adjustment[i];
 	match = level_adjust(my_adj, their_adj, level, match);
 
 	/* show them what's what! */
-	draw_background(screen, cs.style[0]->w,g,level,my_adj,their_adj,
+	draw_background(s, screen, cs.style[0]->w,g,level,my_adj,their_adj,
 		event_name);
-	draw_score(screen,0);
-	draw_score(screen,1);
-	done = give_notice(NULL, 1);
+	for (i=0; i<s->layout.boards; i++)
+	    draw_score(s, screen, i);
+	done = give_notice(s, NULL, 1);
     } /* end: while !done */
     return level[0];
 }
@@ -593,10 +909,11 @@ play_SINGLE_VS_AI(color_styles cs, piece_styles ps, sound_styles ss,
  * per level, but the limit isn't deadly. Complex adjustment rules. :-)
  ***************************************************************************/
 static int
-play_NETWORK(color_styles cs, piece_styles ps, sound_styles ss,
-    Grid g[2], person *p, char *hostname) 
+play_NETWORK(Session *s, color_styles cs, piece_styles ps,
+    sound_styles ss, Grid g[2], person *p, char *hostname) 
 {
     int curtimeleft;
+    int who[2] = { HUMAN_PLAYER, NETWORK_PLAYER };
     extern char *error_msg;
     int server;
     int match;
@@ -727,8 +1044,8 @@ play_NETWORK(color_styles cs, piece_styles ps, sound_styles ss,
 	event_name[1] = their_name;
 
 	/* draw the background */
-	draw_background(screen, cs.style[0]->w, g, level, my_adj, their_adj,
-		event_name);
+	draw_background(s, screen, cs.style[0]->w, g, level, my_adj,
+		their_adj, event_name);
 
 	/* start the fun! */
 	curtimeleft = 120;
@@ -737,16 +1054,16 @@ play_NETWORK(color_styles cs, piece_styles ps, sound_styles ss,
 	event_cs[1] = cs.style[their_cs_choice];
 	event_ss[0] = event_ss[1] = ss.style[ss.choice];
 
-	event_loop(screen, ps.style[ps.choice], 
+	event_loop(s, screen, ps.style[ps.choice], 
 		event_cs, event_ss, g,
 		level, sock, &curtimeleft, 0, adjustment, NULL,
-		our_time, HUMAN_PLAYER, NETWORK_PLAYER, NULL);
-	SEND(&Score[0],sizeof(Score[0]));
-	RECV(&Score[1],sizeof(Score[1]));
-	draw_background(screen, cs.style[0]->w,g,level,my_adj,their_adj,
+		our_time, who, NULL);
+	SEND(&s->score[0],sizeof(s->score[0]));
+	RECV(&s->score[1],sizeof(s->score[1]));
+	draw_background(s, screen, cs.style[0]->w,g,level,my_adj,their_adj,
 		event_name);
-	draw_score(screen,0);
-	draw_score(screen,1);
+	draw_score(s, screen,0);
+	draw_score(s, screen,1);
 	SDL_Delay(1000);
 	my_adj[match] = adjustment[0];
 	their_adj[match] = adjustment[1];
@@ -758,14 +1075,14 @@ play_NETWORK(color_styles cs, piece_styles ps, sound_styles ss,
 	    SEND(&msg,sizeof(msg));
 	    RECV(&msg,sizeof(msg));
 	    if (msg != CLIENT_SYNC) {
-		give_notice("Network Error: Syncronization Failed", 0);
+		give_notice(s, "Network Error: Syncronization Failed", 0);
 		goto done;
 	    }
 	} else {
 	    unsigned int msg;
 	    RECV(&msg,sizeof(msg));
 	    if (msg != SERVER_SYNC) {
-		give_notice("Network Error: Syncronization Failed", 1);
+		give_notice(s, "Network Error: Syncronization Failed", 1);
 		goto done;
 	    }
 	    msg = CLIENT_SYNC;
@@ -775,19 +1092,20 @@ play_NETWORK(color_styles cs, piece_styles ps, sound_styles ss,
 	/* don't even talk to me about three-way handshakes ... */
 
 	/* show them what's what! */
-	draw_background(screen, cs.style[0]->w,g,level,my_adj,their_adj,
+	draw_background(s, screen, cs.style[0]->w,g,level,my_adj,their_adj,
 		event_name);
-	draw_score(screen,0);
-	draw_score(screen,1);
+	draw_score(s, screen,0);
+	draw_score(s, screen,1);
 	if (server) {
-	    done = give_notice(NULL, 1);
+	    done = give_notice(s, NULL, 1);
 	    SEND(&done,sizeof(done));
 	} else {
 	    SDL_Event event;
-	    draw_string("Waiting for the", color_blue, 0, 0,
-		    DRAW_CENTER|DRAW_ABOVE |DRAW_UPDATE|DRAW_GRID_0);
-	    draw_string("Server to go on.", color_blue, 0, 0, DRAW_CENTER
-		    |DRAW_UPDATE|DRAW_GRID_0);
+	    SDL_Rect *r = &s->layout.grid[0];
+	    draw_string("Waiting for the", color_blue, r->x + r->w / 2,
+		    r->y + r->h / 2, DRAW_CENTER|DRAW_ABOVE |DRAW_UPDATE);
+	    draw_string("Server to go on.", color_blue, r->x + r->w / 2,
+		    r->y + r->h / 2, DRAW_CENTER |DRAW_UPDATE);
 	    RECV(&done,sizeof(done));
 	    while (SDL_PollEvent(&event))
 		/* do nothing */ ;
@@ -805,7 +1123,7 @@ error:
 	sprintf(message,"Network Error: %s",strerror(errno));
 known_error: 
     clear_screen_to_flame();
-    give_notice(message, 0);
+    give_notice(s, message, 0);
 done: 
     close(sock);
     return level[0];
@@ -817,10 +1135,11 @@ done:
  * get many points. Returns the final level.
  ***************************************************************************/
 static int
-play_MARATHON(color_styles cs, piece_styles ps, sound_styles ss,
-    Grid g[2], person *p) 
+play_MARATHON(Session *s, color_styles cs, piece_styles ps,
+    sound_styles ss, Grid g[2], person *p) 
 {
     int curtimeleft;
+    int who[1] = { HUMAN_PLAYER };
     int level[2];			/* level array: me + dummy slot */
     int adjustment[2] = {-1, -1};	/* result of playing a match */
     int my_adj[3];			/* my three winnings so far */
@@ -829,7 +1148,7 @@ play_MARATHON(color_styles cs, piece_styles ps, sound_styles ss,
 
     level[0] = p->level;		/* starting level */
     SeedRandom(0);
-    Score[0] = 0;		/* global variable! */
+    s->score[0] = 0;
 
     my_adj[0] = -1; my_adj[1] = -1; my_adj[2] = -1;
     while (1) {	
@@ -842,34 +1161,34 @@ play_MARATHON(color_styles cs, piece_styles ps, sound_styles ss,
 
 	event_name[0] = p->name;
 
-	draw_background(screen, cs.style[0]->w, g, level, my_adj, NULL, 
+	draw_background(s, screen, cs.style[0]->w, g, level, my_adj, NULL, 
 		event_name);
 	/* get the result, but don't update level yet */
 
 	event_cs[0] = event_cs[1] = cs.style[cs.choice];
 	event_ss[0] = event_ss[1] = ss.style[ss.choice];
 
-	result = event_loop(screen, ps.style[ps.choice], 
+	result = event_loop(s, screen, ps.style[ps.choice], 
 		event_cs, event_ss, g,
 		level, 0, &curtimeleft, 1, adjustment, NULL,
-		time(NULL), HUMAN_PLAYER, NO_PLAYER, NULL);
+		time(NULL), who, NULL);
 	if (result < 0) { 	/* explicit quit */
 	    return level[0];
 	}
 	/* reset board */
 	my_adj[0] = adjustment[0];
 	/* display those mighty accomplishments winnings */
-	draw_background(screen, cs.style[0]->w ,g, level,my_adj,NULL,
+	draw_background(s, screen, cs.style[0]->w ,g, level,my_adj,NULL,
 		event_name);
-	draw_score(screen,0);
+	draw_score(s, screen,0);
 	if (adjustment[0] != ADJUST_UP) {
-	    give_notice("Game Over!", 0);
+	    give_notice(s, "Game Over!", 0);
 	    return level[0];
 	}
 	my_adj[0] = -1;
 	level[0]++;
 	sprintf(message,"Up to Level %d!",level[0]);
-	if (give_notice(message, 1)) {
+	if (give_notice(s, message, 1)) {
 	    return level[0];
 	}
     }
@@ -881,11 +1200,12 @@ play_MARATHON(color_styles cs, piece_styles ps, sound_styles ss,
  * matches. Returns the final level.
  ***************************************************************************/
 static int
-play_SINGLE(color_styles cs, piece_styles ps, sound_styles ss,
-    Grid g[], person *p)
+play_SINGLE(Session *s, color_styles cs, piece_styles ps,
+    sound_styles ss, Grid g[], person *p)
 {
     int curtimeleft;
     int match;
+    int who[1] = { HUMAN_PLAYER };
     int level[2];			/* level array: me + dummy slot */
     int adjustment[2] = {-1, -1};	/* result of playing a match */
     int my_adj[3];			/* my three winnings so far */
@@ -894,7 +1214,7 @@ play_SINGLE(color_styles cs, piece_styles ps, sound_styles ss,
 
     level[0] = p->level;	/* starting level */
     SeedRandom(0);
-    Score[0] = 0;		/* global variable! */
+    s->score[0] = 0;
 
     while (1) {	
 	/* until they give up by pressing 'q'! */
@@ -909,26 +1229,26 @@ play_SINGLE(color_styles cs, piece_styles ps, sound_styles ss,
 	    event_name[0] = p->name;
 
 	    /* draw the background */
-	    draw_background(screen, cs.style[0]->w, g, level, my_adj, NULL,
+	    draw_background(s, screen, cs.style[0]->w, g, level, my_adj, NULL,
 		    event_name);
 	    /* get the result, but don't update level yet */
 
 	    event_cs[0] = event_cs[1] = cs.style[cs.choice];
 	    event_ss[0] = event_ss[1] = ss.style[ss.choice];
 
-	    result = event_loop(screen, ps.style[ps.choice], 
+	    result = event_loop(s, screen, ps.style[ps.choice], 
 		    event_cs, event_ss, g,
 		    level, 0, &curtimeleft, 1, adjustment, NULL,
-		    time(NULL), HUMAN_PLAYER, NO_PLAYER, NULL);
+		    time(NULL), who, NULL);
 	    if (result < 0) { 	/* explicit quit */
 		return level[0];
 	    }
 	    /* reset board */
 	    my_adj[match] = adjustment[0];
 	    /* display those mighty accomplishments winnings */
-	    draw_background(screen, cs.style[0]->w,g, level,my_adj,NULL,
+	    draw_background(s, screen, cs.style[0]->w,g, level,my_adj,NULL,
 		    event_name);
-	    draw_score(screen,0);
+	    draw_score(s, screen,0);
 	    message[0] = 0;
 	    if (match == 2) {
 		if (my_adj[0] == ADJUST_UP && my_adj[1] == ADJUST_UP &&
@@ -942,7 +1262,7 @@ play_SINGLE(color_styles cs, piece_styles ps, sound_styles ss,
 		    sprintf(message,"Down to level %d!",level[0]);
 		}
 	    }
-	    if (give_notice(message, 1) == 1) { /* explicit quit */
+	    if (give_notice(s, message, 1) == 1) { /* explicit quit */
 		return level[0];
 	    }
 	}
@@ -978,6 +1298,27 @@ typedef struct wessy_struct {
     Grid tg;
 } Wessy_State;
 
+/*
+ * Every placement of one piece that Double-Think has looked at: where it
+ * went, what the board looks like afterwards and how good that board is
+ * by itself. order[] lists the placements from best to worst once the
+ * ply is complete.
+ */
+typedef struct double_ply_struct {
+    int n, max;		/* placements tried, room for */
+    int *col;
+    int *rot;
+    int *weight;
+    int *order;
+    Grid *board;
+    Grid_Masks *masks;
+} Double_Ply;
+
+typedef enum {
+    DOUBLE_ALPHA,	/* dropping the current piece everywhere */
+    DOUBLE_BETA,	/* dropping the next piece after the best of those */
+} Double_Stage;
+
 typedef struct double_struct {
     int know_what_to_do;
 
@@ -985,18 +1326,27 @@ typedef struct double_struct {
     int desired_rot;
     int best_weight;
 
-    int stage_alpha;
-    int cur_alpha_col;
-    int cur_alpha_rot;
-    Grid ag;
-    int cur_beta_col;
-    int cur_beta_rot;
-    Grid tg;
+    Double_Stage stage;
+    int next_try;	/* which (col,rot) to drop next */
+    int expanding;	/* which alpha placement beta is working under */
+    int chosen;		/* alpha placement we are heading for, or -1 */
+    int reusable;	/* cont() handed us last turn's beta placements */
+    play_piece chosen_np; /* the next piece when we chose */
+
+    Double_Ply alpha;	/* current piece */
+    Double_Ply beta;	/* next piece, under alpha.order[expanding] */
+    Double_Ply best_beta; /* next piece, under the chosen placement */
 } Double_State;
 
+/* alpha placements worth expanding, best static weight first */
+#define DOUBLE_KEEP	8
+
 #define WES_MIN_COL -4
 static int weight_board(Grid *g);
 
+/* what the AIs have been up to on this thread */
+static __thread AI_Counters ai_counters;
+
 /***************************************************************************
  * The code here determines what the board would look like after all the
  * color-sliding and tetris-clearing that would happen if you pasted the
@@ -1004,13 +1354,15 @@ static int weight_board(Grid *g);
  * rotation (current_rot). You are welcome to copy it. 
  *
  * Returns -1 on failure or the number of lines cleared.
- ***************************************************************************/
+ *********************************************************************PROTO*/
 int
 drop_piece_on_grid(Grid *g, play_piece *pp, int col, int row, int rot)
 {
     int should_we_loop = 0;
     int lines_cleared = 0;
+    int rounds = 0;
 
+    ai_counters.drops++;
     if (!valid_position(pp, col, row, rot, g))
 	return -1;
 
@@ -1042,20 +1394,156 @@ drop_piece_on_grid(Grid *g, play_piece *pp, int col, int row, int rot)
 
 	if (determine_falling(g)) {
 	    do { 
+		ai_counters.gravity++;
 		fall_down(g);
 		cleanup_grid(g);
 		run_gravity(g);
 	    } while (determine_falling(g));
 	    should_we_loop = 1;
+	    rounds++;
 	}
     } while (should_we_loop);
     /* 
      * Simulation code ends here. 
      * *-*-*-*
      */
+    ai_counters.cascade[min(rounds, AI_CASCADE_MAX-1)]++;
     return lines_cleared;
 }
 
+/***************************************************************************
+ *      ai_take_counters()
+ * Hands over this thread's AI_Counters and starts them again from zero.
+ *********************************************************************PROTO*/
+void
+ai_take_counters(AI_Counters *c)
+{
+    *c = ai_counters;
+    memset(&ai_counters, 0, sizeof(ai_counters));
+}
+
+/***************************************************************************
+ *      ai_counters_mark()
+ * Remembers where this thread's AI_Counters are up to, for
+ * ai_counters_add().
+ *********************************************************************PROTO*/
+void
+ai_counters_mark(AI_Counters *mark)
+{
+    *mark = ai_counters;
+}
+
+/***************************************************************************
+ *      counters_add()
+ * Adds plus - minus to *into, field by field. A new AI_Counters field
+ * has to be added here too.
+ ***************************************************************************/
+static void
+counters_add(AI_Counters *into, const AI_Counters *plus, 
+	const AI_Counters *minus)
+{
+    int i;
+
+    into->decisions += plus->decisions - minus->decisions;
+    into->candidates += plus->candidates - minus->candidates;
+    into->drops += plus->drops - minus->drops;
+    into->gravity += plus->gravity - minus->gravity;
+    for (i=0; i<AI_CASCADE_MAX; i++)
+	into->cascade[i] += plus->cascade[i] - minus->cascade[i];
+    into->evals += plus->evals - minus->evals;
+    into->thinks += plus->thinks - minus->thinks;
+    into->settled += plus->settled - minus->settled;
+    into->overruns += plus->overruns - minus->overruns;
+    into->think_ticks += plus->think_ticks - minus->think_ticks;
+}
+
+/***************************************************************************
+ *      ai_counters_add()
+ * Adds what this thread has done since ai_counters_mark() to *into: that
+ * is how one player's share of the work gets to its own books.
+ *********************************************************************PROTO*/
+void
+ai_counters_add(AI_Counters *into, const AI_Counters *mark)
+{
+    counters_add(into, &ai_counters, mark);
+}
+
+/***************************************************************************
+ *      double_ply_alloc()
+ * Room for every placement of one piece on a grid like g.
+ ***************************************************************************/
+static void
+double_ply_alloc(Double_Ply *p, Grid *g)
+{
+    int i, max = 4 * (g->w - WES_MIN_COL);
+
+    p->n = 0;
+    p->max = max;
+    Calloc(p->col, int *, max * sizeof(*p->col));
+    Calloc(p->rot, int *, max * sizeof(*p->rot));
+    Calloc(p->weight, int *, max * sizeof(*p->weight));
+    Calloc(p->order, int *, max * sizeof(*p->order));
+    Calloc(p->board, Grid *, max * sizeof(*p->board));
+    Calloc(p->masks, Grid_Masks *, max * sizeof(*p->masks));
+    for (i=0; i<max; i++)
+	p->board[i] = generate_board(g->w, g->h, 0);
+}
+
+/***************************************************************************
+ *      double_ply_try()
+ * Drops the piece at the given spot on a copy of g and remembers the
+ * result if it is a legal placement and there is room for it.
+ ***************************************************************************/
+static void
+double_ply_try(Double_Ply *p, Grid *g, play_piece *pp, int col, int row,
+	int rot)
+{
+    Grid *t;
+
+    if (p->n >= p->max)
+	return;
+    t = &p->board[p->n];
+    ai_counters.candidates++;
+    memcpy(t->contents, g->contents, (g->w * g->h * sizeof(t->contents[0])));
+    memcpy(t->fall, g->fall, (g->w * g->h * sizeof(t->fall[0])));
+
+    if (drop_piece_on_grid(t, pp, col, row, rot) != -1) {
+	p->col[p->n] = col;
+	p->rot[p->n] = rot;
+	grid_masks(t, &p->masks[p->n]);
+	p->n++;
+    }
+}
+
+/***************************************************************************
+ *      double_ply_finish()
+ * Weighs every placement in one batch and sorts them, best first.
+ ***************************************************************************/
+static void
+double_ply_finish(Double_Ply *p)
+{
+    int i, j;
+
+    weight_boards(p->masks, p->n, p->weight);
+    for (i=0; i<p->n; i++) {
+	int k = i;
+	for (j=i; j>0 && p->weight[p->order[j-1]] > p->weight[k]; j--)
+	    p->order[j] = p->order[j-1];
+	p->order[j] = k;
+    }
+}
+
+/***************************************************************************
+ *      double_ply_swap()
+ ***************************************************************************/
+static void
+double_ply_swap(Double_Ply *a, Double_Ply *b)
+{
+    Double_Ply t = *a;
+    *a = *b;
+    *b = t;
+}
+
 /***************************************************************************
  *      double_ai_reset()
  **************************************************************************/
@@ -1068,105 +1556,207 @@ double_ai_reset(void *state, Grid *g)
     if (state == NULL) {
 	/* first time we've been called ... */
 	Calloc(retval, Double_State *, sizeof(Double_State));
+	double_ply_alloc(&retval->alpha, g);
+	double_ply_alloc(&retval->beta, g);
+	double_ply_alloc(&retval->best_beta, g);
+	retval->chosen = -1;
     } else
 	retval = state;
     Assert(retval);
+
+    retval->reusable = 0;
     retval->know_what_to_do=0;
     retval->desired_col = g->w / 2;
     retval->desired_rot = 0;
     retval->best_weight = 1<<30;
-    retval->stage_alpha = 1;
-    retval->cur_alpha_col = WES_MIN_COL;
-    retval->cur_alpha_rot = 0;
-    retval->cur_beta_col = WES_MIN_COL;
-    retval->cur_beta_rot = 0;
-
-    if (retval->tg.contents == NULL)
-	retval->tg = generate_board(g->w, g->h, 0); 
-    if (retval->ag.contents == NULL)
-	retval->ag = generate_board(g->w, g->h, 0); 
+    retval->stage = DOUBLE_ALPHA;
+    retval->next_try = 0;
+    retval->expanding = 0;
+    retval->chosen = -1;
+    retval->alpha.n = 0;
+    retval->beta.n = 0;
 
     return retval;
 }
 
 /***************************************************************************
- *
+ *      double_ai_cont()
+ * If the last piece went where we meant it to, nothing else happened to
+ * the board in the meantime and the new piece is the "next" one we
+ * planned with, the placements we tried for it are still good: they
+ * become this turn's alpha placements, already weighed and sorted, and
+ * we head for the best of them at once while double_ai_think() looks a
+ * piece further ahead.
+ **************************************************************************/
+static void *
+double_ai_cont(void *state, Grid *g, play_piece *pp, AI_Placement *played)
+{
+    Double_State *ds = (Double_State *) state;
+    int c = ds->chosen;
+    int carry = c >= 0 && ds->best_beta.n > 0 &&
+	played->col == ds->alpha.col[c] && played->rot == ds->alpha.rot[c] &&
+	pp->base == ds->chosen_np.base && 
+	pp->special == ds->chosen_np.special &&
+	!memcmp(pp->colormap, ds->chosen_np.colormap, sizeof(pp->colormap)) &&
+	!memcmp(ds->alpha.board[c].contents, g->contents,
+		g->w * g->h * sizeof(g->contents[0]));
+
+    double_ai_reset(ds, g);
+    if (carry) {
+	double_ply_swap(&ds->alpha, &ds->best_beta);
+	ds->best_beta.n = 0;
+	ds->desired_col = ds->alpha.col[ds->alpha.order[0]];
+	ds->desired_rot = ds->alpha.rot[ds->alpha.order[0]];
+	ds->reusable = 1;
+    }
+    return ds;
+}
+
+/***************************************************************************
+ *      double_ply_free()
+ ***************************************************************************/
+static void
+double_ply_free(Double_Ply *p)
+{
+    int i;
+
+    for (i=0; i<p->max; i++)
+	free_board(&p->board[i]);
+    Free(p->col); Free(p->rot); Free(p->weight); Free(p->order);
+    Free(p->board); Free(p->masks);
+}
+
+/***************************************************************************
+ *      double_ai_release()
+ **************************************************************************/
+static void
+double_ai_release(void *state)
+{
+    Double_State *ds = (Double_State *) state;
+
+    double_ply_free(&ds->alpha);
+    double_ply_free(&ds->beta);
+    double_ply_free(&ds->best_beta);
+    free(ds);
+}
+
+/***************************************************************************
+ *      double_ai_decide()
+ * Settles on alpha placement i.
+ ***************************************************************************/
+static void
+double_ai_decide(Double_State *ds, int i, int weight)
+{
+    ds->best_weight = weight;
+    ds->desired_col = ds->alpha.col[i];
+    ds->desired_rot = ds->alpha.rot[i];
+    ds->chosen = i;
+    ds->best_beta.n = 0;	/* until double_ai_think() says otherwise */
+}
+
+/***************************************************************************
+ *      double_ai_think()
+ * Ruminates for Double-Think.
+ *
+ * Each placement of the current piece (alpha) is weighed by itself
+ * first. Only the DOUBLE_KEEP best of those are expanded by trying every
+ * placement of the next piece (beta) on top of them; the alpha placement
+ * whose best beta follow-up is lightest wins. The beta placements behind
+ * the winner are kept for double_ai_cont() to carry over.
  ***************************************************************************/
 static void
 double_ai_think(void *data, Grid *g, play_piece *pp, play_piece *np, 
 	int col, int row, int rot)
 {
     Double_State *ds = (Double_State *)data;
-    Uint32 incoming_time = SDL_GetTicks();
+    Uint32 incoming_time = sim_ticks();
+    int ncols = g->w - WES_MIN_COL;
 
     Assert(ds);
 
-    for (;SDL_GetTicks() == incoming_time;) {
+    if (ds->reusable) {
+	/* keep the placements cont() gave us that we can reach from here */
+	int i, n = ds->alpha.n;
+	ds->reusable = 0;
+	ds->alpha.n = 0;
+	for (i=0; i<n; i++) {
+	    int k = ds->alpha.order[i];
+	    if (valid_position(pp, ds->alpha.col[k], row,
+			ds->alpha.rot[k], g)) 
+		ds->alpha.order[ds->alpha.n++] = k;
+	}
+	if (ds->alpha.n > 0) {
+	    ds->stage = DOUBLE_BETA;
+	    ds->next_try = 0;
+	    ds->expanding = 0;
+	    ds->beta.n = 0;
+	}
+	if (ds->stage == DOUBLE_BETA) {
+	    /* alpha.order[] now holds exactly the placements to consider */
+	    int k = ds->alpha.order[0];
+	    if (ds->alpha.weight[k] <= 0) {
+		double_ai_decide(ds, k, ds->alpha.weight[k]);
+		ds->know_what_to_do = 1;
+	    }
+	} else 
+	    ds->alpha.n = 0;
+    }
+
+    for (;sim_ticks() == incoming_time;) {
 	if (ds->know_what_to_do) 
 	    return;
 
-	if (ds->stage_alpha) {
-	    memcpy(ds->ag.contents, g->contents, (g->w * g->h * sizeof(ds->ag.contents[0])));
-	    memcpy(ds->ag.fall, g->fall, (g->w * g->h * sizeof(ds->ag.fall[0])));
-
-	    if ( drop_piece_on_grid(&ds->ag, pp, ds->cur_alpha_col, row,
-		    ds->cur_alpha_rot) != -1) {
-		int weight;
-		/* success */
-		ds->cur_beta_col = WES_MIN_COL;
-		ds->cur_beta_rot = 0;
-
-		ds->stage_alpha = 0;
-
-		weight = weight_board(&ds->ag);
-		if (weight <= 0) {
-		    ds->best_weight = weight;
-		    ds->desired_col = ds->cur_alpha_col;
-		    ds->desired_rot = ds->cur_alpha_rot;
-		    ds->know_what_to_do = 1;
-		}
-	    } else {
-		/* advance alpha */
-		if (++ds->cur_alpha_col == g->w) {
-		    ds->cur_alpha_col = WES_MIN_COL;
-		    if (++ds->cur_alpha_rot == 4) {
-			ds->cur_alpha_rot = 0;
-			ds->know_what_to_do = 1;
-		    }
-		}
+	if (ds->stage == DOUBLE_ALPHA) {
+	    if (ds->next_try < 4 * ncols) {
+		double_ply_try(&ds->alpha, g, pp, 
+			WES_MIN_COL + ds->next_try % ncols, row,
+			ds->next_try / ncols);
+		ds->next_try++;
+		continue;
+	    } 
+	    double_ply_finish(&ds->alpha);
+	    if (ds->alpha.n == 0) {
+		ds->know_what_to_do = 1;
+		return;
+	    }
+	    if (ds->alpha.weight[ds->alpha.order[0]] <= 0) {
+		/* you'll win! */
+		double_ai_decide(ds, ds->alpha.order[0],
+			ds->alpha.weight[ds->alpha.order[0]]);
+		ds->know_what_to_do = 1;
+		return;
 	    }
+	    ds->stage = DOUBLE_BETA;
+	    ds->next_try = 0;
+	    ds->expanding = 0;
+	    ds->beta.n = 0;
 	} else {
 	    /* stage beta */
-	    int weight;
-	    
-	    memcpy(ds->tg.contents, ds->ag.contents, (ds->ag.w * ds->ag.h * sizeof(ds->ag.contents[0])));
-	    memcpy(ds->tg.fall, ds->ag.fall, (ds->ag.w * ds->ag.h * sizeof(ds->ag.fall[0])));
+	    int a = ds->alpha.order[ds->expanding];
 
-	    if (drop_piece_on_grid(&ds->tg, np, ds->cur_beta_col, row,
-		    ds->cur_beta_rot) != -1) {
-		/* success */
-		weight = 1+weight_board(&ds->tg);
+	    if (ds->next_try < 4 * ncols) {
+		double_ply_try(&ds->beta, &ds->alpha.board[a], np, 
+			WES_MIN_COL + ds->next_try % ncols, row,
+			ds->next_try / ncols);
+		ds->next_try++;
+		continue;
+	    }
+	    double_ply_finish(&ds->beta);
+	    if (ds->beta.n > 0) {
+		int weight = 1 + ds->beta.weight[ds->beta.order[0]];
 		if (weight < ds->best_weight) {
-		    ds->best_weight = weight;
-		    ds->desired_col = ds->cur_alpha_col;
-		    ds->desired_rot = ds->cur_alpha_rot;
+		    double_ai_decide(ds, a, weight);
+		    ds->chosen_np = *np;
+		    double_ply_swap(&ds->beta, &ds->best_beta);
 		}
 	    }
-
-	    if (++ds->cur_beta_col == g->w) {
-		ds->cur_beta_col = WES_MIN_COL;
-		if (++ds->cur_beta_rot == 2) {
-		    ds->cur_beta_rot = 0;
-
-		    ds->stage_alpha = 1;
-		    if (++ds->cur_alpha_col == g->w) {
-			ds->cur_alpha_col = WES_MIN_COL;
-			if (++ds->cur_alpha_rot == 4) {
-			    ds->cur_alpha_rot = 0;
-			    ds->know_what_to_do = 1;
-			}
-		    }
-		}
+	    ds->beta.n = 0;
+	    ds->next_try = 0;
+	    if (++ds->expanding == min(ds->alpha.n, DOUBLE_KEEP)) {
+		if (ds->chosen < 0)	/* nothing fits after any of them */
+		    double_ai_decide(ds, ds->alpha.order[0],
+			    ds->alpha.weight[ds->alpha.order[0]]);
+		ds->know_what_to_do = 1;
 	    }
 	} /* endof: stage beta */
     } /* for: iterations */
@@ -1195,56 +1785,182 @@ double_ai_move(void *state, Grid *g, play_piece *pp, play_piece *np,
 	return MOVE_NONE;
 }
 
-/***************************************************************************
- *      weight_board()
- * Determines the value the AI places on the given board configuration.
- * This is a Wes-specific function that is used to evaluate the result of
- * a possible AI choice. In the end, the choice with the best weight is
- * selected.
- ***************************************************************************/
-static int
-weight_board(Grid *g)
+/*
+ * The batch evaluators below score MASK_LANES (ai.h) boards side by side,
+ * one board per vector lane. GCC turns these into SSE/NEON instructions
+ * where the machine has them and into plain loops where it does not.
+ */
+typedef int	Lane_Int  __attribute__ ((vector_size (4 * MASK_LANES)));
+typedef Uint32	Lane_Mask __attribute__ ((vector_size (4 * MASK_LANES)));
+
+/* the lane-wise version of MASK_POPCOUNT() */
+static Lane_Int
+lane_popcount(Lane_Mask v)
 {
-    int x,y;
-    int w = 0;
-    int holes = 0;
-    int same_color = 0;
-    int garbage = 0;
+    v = v - ((v >> 1) & 0x55555555);
+    v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+    v = (v + (v >> 4)) & 0x0F0F0F0F;
+    return (Lane_Int) ((v * 0x01010101) >> 24);
+}
+
+/*
+ * MASK_LANES boards of the same size side by side, laid out as Grid_Masks
+ * has them: lane i of occupied[x] is column x of board i. The lane-wise
+ * evaluators work on these, wherever the boards came from.
+ */
+typedef struct lane_masks_struct {
+    int w, h;
+    Lane_Mask occupied[GRID_MASK_MAX_W];
+    Lane_Mask garbage[GRID_MASK_MAX_W];
+    Lane_Mask same_left[GRID_MASK_MAX_W];
+} Lane_Masks;
+
+/* puts boards m[0] .. m[MASK_LANES-1] side by side */
+static void
+lane_masks(Lane_Masks *l, Grid_Masks *m[MASK_LANES])
+{
+    int x, i;
+
+    l->w = m[0]->w;
+    l->h = m[0]->h;
+    for (i=0; i<MASK_LANES; i++) 
+	Assert(m[i]->w == l->w && m[i]->h == l->h);
+    for (x=0; x<l->w; x++)
+	for (i=0; i<MASK_LANES; i++) {
+	    l->occupied[x][i] = m[i]->occupied[x];
+	    l->garbage[x][i] = m[i]->garbage[x];
+	    l->same_left[x][i] = m[i]->same_left[x];
+	}
+}
 
+/*
+ * The weights the evaluators go by. The profile is what everybody uses
+ * unless a thread says otherwise (the tuner gives every candidate its
+ * own); --profile=FILE replaces it at startup.
+ */
+static AI_Weights ai_profile = {
     /* favor the vast extremes ... */
-    int badness[10] =  { 7, 9, 9, 9, 9,  9, 9, 9, 9, 7};
+    { 7, 9, 9, 9, 9,  9, 9, 9, 9, 7},	/* badness */
+    6,		/* hole */
+    4,		/* same_color */
+    1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0,	/* Kiri's */
+};
+static __thread const AI_Weights *ai_thread_weights = NULL;
+#define AI_WEIGHTS()	(ai_thread_weights ? ai_thread_weights : &ai_profile)
+
+/* the parameter vector, in profile-file names */
+static const char *ai_weight_name[AI_WEIGHTS_N] = {
+    "badness_0", "badness_1", "badness_2", "badness_3", "badness_4",
+    "badness_5", "badness_6", "badness_7", "badness_8", "badness_9",
+    "hole", "same_color",
+    "max_height", "avg_height", "bumpiness", "holes", "canyons",
+    "garbage", "row", "lines",
+};
+
+/***************************************************************************
+ *      weight_lanes()
+ * Determines the value the AI places on MASK_LANES board configurations
+ * at once: out[i] is that of board i. This is a Wes-specific function
+ * that is used to evaluate the result of a possible AI choice. In the
+ * end, the choice with the best weight is selected. Walks each column
+ * from the bottom up, carrying one running "possible_holes" count per
+ * lane.
+ ***************************************************************************/
+static void
+weight_lanes(Lane_Masks *l, int *out)
+{
+    const AI_Weights *wt = AI_WEIGHTS();
+    int W = l->w, H = l->h;
+    int x,y,i;
+    Lane_Int w = { 0 }, holes = { 0 }, same_color = { 0 }, garbage = { 0 };
 
     /* 
      * Simple Heuristic: highly placed blocks are bad, as are "holes":
-     * blank areas with blocks above them.
+     * blank areas with blocks above them. A hole is charged to the first
+     * non-garbage block above it.
      */
-    for (x=0; x<g->w; x++) {
-	int possible_holes = 0;
-	for (y=g->h-1; y>=0; y--) {
-	    int what;
-	    if ((what = GRID_CONTENT(*g,x,y))) {
-		w += 2 * (g->h - y) * badness[x] / 3;
-		if (possible_holes) {
-		    if (what != 1) 
-			holes += 3 * ((g->h - y)) * g->w * possible_holes;
-		    possible_holes = 0;
-		}
+    for (x=0; x<W; x++) {
+	Lane_Mask occ = l->occupied[x], garb = l->garbage[x];
+	Lane_Int possible_holes = { 0 };
 
-		if (x > 1 && what)
-		    if (GRID_CONTENT(*g,x-1,y) == what)
-			same_color++;
-		if (what == 1)
-		    garbage++;
-	    } else {
-		possible_holes++;
-	    }
+	garbage += lane_popcount(garb);
+	if (x > 1)
+	    same_color += lane_popcount(l->same_left[x]);
+
+	for (y=H-1; y>=0; y--) {
+	    Lane_Int block = -(Lane_Int) ((occ >> y) & 1);
+	    Lane_Int solid = block & ~(-(Lane_Int) ((garb >> y) & 1));
+
+	    w += block & (2 * (H - y) * wt->badness[x] / 3);
+	    holes += solid & (possible_holes * ((H - y) * W));
+	    possible_holes = (possible_holes + 1) & ~block;
 	}
     }
-    w += holes * 2;
-    w += same_color * 4;
-    if (garbage == 0) w = 0;	/* you'll win! */
+    w += holes * wt->hole;
+    w += same_color * wt->same_color;
+    w &= (garbage != 0);	/* you'll win! */
+
+    for (i=0; i<MASK_LANES; i++)
+	out[i] = w[i];
+}
+
+/***************************************************************************
+ *      weight_masks()
+ * weight_lanes() for a single board.
+ ***************************************************************************/
+static int
+weight_masks(Grid_Masks *m)
+{
+    Grid_Masks *lane[MASK_LANES];
+    Lane_Masks l;
+    int out[MASK_LANES];
+    int i;
+
+    ai_counters.evals++;
+    for (i=0; i<MASK_LANES; i++)
+	lane[i] = m;
+    lane_masks(&l, lane);
+    weight_lanes(&l, out);
+    return out[0];
+}
+
+/***************************************************************************
+ *      weight_board()
+ * weight_masks() for a plain grid.
+ ***************************************************************************/
+static int
+weight_board(Grid *g)
+{
+    Grid_Masks m;
+
+    grid_masks(g, &m);
+    return weight_masks(&m);
+}
+
+/***************************************************************************
+ *      weight_boards()
+ * weight_board() for many boards at once: scores[i] is the weight of the
+ * board summarized in m[i]. The boards must all be the same size.
+ *********************************************************************PROTO*/
+void
+weight_boards(Grid_Masks *m, int n, int *scores)
+{
+    int i,j;
 
-    return w;
+    ai_counters.evals += n;
+    for (i=0; i<n; i+=MASK_LANES) {
+	Grid_Masks *lane[MASK_LANES];
+	Lane_Masks l;
+	int out[MASK_LANES];
+
+	/* short final batches just repeat their last board */
+	for (j=0; j<MASK_LANES; j++)
+	    lane[j] = &m[min(i+j, n-1)];
+	lane_masks(&l, lane);
+	weight_lanes(&l, out);
+	for (j=0; j<MASK_LANES && i+j<n; j++)
+	    scores[i+j] = out[j];
+    }
 }
 
 /***************************************************************************
@@ -1253,7 +1969,7 @@ weight_board(Grid *g)
  *
  * This function is called every so (about every fall_event_interval) by
  * event_loop(). The AI is expected to think for < 1 "tick" (as in,
- * SDL_GetTicks()). 
+ * sim_ticks()). 
  *
  * Input:
  * 	Grid *g		Your side of the board. The currently piece (the
@@ -1279,11 +1995,11 @@ wes_ai_think(void *data, Grid *g, play_piece *pp, play_piece *np,
 {
     int weight;
     Wessy_State *ws = (Wessy_State *)data;
-    Uint32 incoming_time = SDL_GetTicks();
+    Uint32 incoming_time = sim_ticks();
 
     Assert(ws);
 
-    for (;SDL_GetTicks() == incoming_time;) {
+    for (;sim_ticks() == incoming_time;) {
 
 	if (ws->know_what_to_do) 
 	    return;
@@ -1291,6 +2007,7 @@ wes_ai_think(void *data, Grid *g, play_piece *pp, play_piece *np,
 	memcpy(ws->tg.contents, g->contents, (g->w * g->h * sizeof(ws->tg.contents[0])));
 	memcpy(ws->tg.fall, g->fall, (g->w * g->h * sizeof(ws->tg.fall[0])));
 	/* what would happen if we dropped ourselves on cc, current_rot now? */
+	ai_counters.candidates++;
 	if (drop_piece_on_grid(&ws->tg, pp, ws->cc, row, ws->current_rot) != -1) {
 	    weight = weight_board(&ws->tg);
 
@@ -1321,13 +2038,13 @@ beginner_ai_think(void *data, Grid *g, play_piece *pp, play_piece *np,
 
     Assert(ws);
 
-    if (ws->know_what_to_do || (SDL_GetTicks() & 3)) 
+    if (ws->know_what_to_do || (sim_ticks() & 3)) 
 	return;
 
     memcpy(ws->tg.contents, g->contents, (g->w * g->h * sizeof(ws->tg.contents[0])));
     memcpy(ws->tg.fall, g->fall, (g->w * g->h * sizeof(ws->tg.fall[0])));
     /* what would happen if we dropped ourselves on cc, current_rot now? */
-
+    ai_counters.candidates++;
     if (drop_piece_on_grid(&ws->tg, pp, ws->cc, row, ws->current_rot) != -1) {
 
 	weight = weight_board(&ws->tg);
@@ -1380,6 +2097,19 @@ wes_ai_reset(void *state, Grid *g)
     return retval;
 }
 
+/***************************************************************************
+ *      wes_ai_release()
+ ***************************************************************************/
+static void
+wes_ai_release(void *state)
+{
+    Wessy_State *ws = (Wessy_State *) state;
+
+    if (ws->tg.contents)
+	free_board(&ws->tg);
+    free(ws);
+}
+
 /***************************************************************************
  *      wes_ai_move()
  * Determines the AI's next move. All of the inputs are as for ai_think().
@@ -1434,4330 +2164,7978 @@ typedef struct Aliz_State_struct {
 
 
 /*******************************************************************
- *   evalBoard()
- * Evaluates the 'value' of a given board configuration.
- * Return values range from 0 (in theory) to g->h + <something>.
- * The lowest value is the best.
+ *   evalSum()
+ * Puts the pieces of evalLanes() together, weighted by the profile.
+ *******************************************************************/
+static double evalSum(int maxHeight, double avgHeight, int minHeight,
+    int nHoles, int nCanyons, int nGarbage, int h, int row, int nLines)
+{
+  const AI_Weights *wt = AI_WEIGHTS();
+
+  return wt->max_height * maxHeight*h + wt->avg_height * avgHeight +
+    wt->bumpiness * (maxHeight - minHeight) + wt->holes * nHoles +
+    wt->canyons * nCanyons + wt->garbage * nGarbage + 
+    wt->row * (h - row) - wt->lines * nLines*nLines;
+}
+
+/*******************************************************************
+ *   evalLanes()
+ * Evaluates the 'value' of MASK_LANES board configurations at once:
+ * out[i] is that of board i after clearing nLines[i] lines with a
+ * piece that landed on row[i]. Return values range from 0 (in theory)
+ * to h + <something>. The lowest value is the best. The canyon sum
+ * walks the rows instead of the set bits so that every lane does the
+ * same work.
  * Check separately for garbage?
  *******************************************************************/
-static double evalBoard(Grid* g, int nLines, int row)
+static void evalLanes(Lane_Masks* l, int nLines[MASK_LANES],
+    int row[MASK_LANES], double *out)
 {
   /* Return the max height plus the number of holes under blocks */
   /* Should encourage smaller heights */
-  int x, y, z;
-  int maxHeight = 0, minHeight = g->h;
-  int nHoles = 0, nGarbage = 0, nCanyons = 0;
-  double avgHeight = 0;
-  int nColumns = g->w;
+  int W = l->w, H = l->h;
+  int x, y, i;
+  Lane_Int maxHeight = { 0 }, minHeight = { 0 }, sumHeight = { 0 };
+  Lane_Int nHoles = { 0 }, nGarbage = { 0 }, nCanyons = { 0 };
+  Lane_Mask range;
 
   /* Find the minimum, maximum, and average height */
-  for (x=0; x<g->w; x++) {
-    int height = g->h;
-    char gc;
-    for (y=0; y<g->h; y++) {
-      gc = GRID_CONTENT(*g, x, y);
-      if (gc == 0) height--;
-      else {
-	/* garbage */
-	if (gc == 1) nGarbage++;
-	/* Penalize for holes under blocks */
-	for (z=y+1; z<g->h; z++) {
-	  char gc2 = GRID_CONTENT(*g, x, z);
-	  /* count the holes under here */
-	  if (gc2 == 0) {
-	    nHoles += 2; /* these count for double! */
-	  }
-	  else if (gc2 == 1) nGarbage++;
-	}
-	break;
-      }
+  minHeight += H;
+  for (x=0; x<W; x++) {
+    Lane_Mask occ = l->occupied[x];
+    Lane_Int height = { 0 }, seen = { 0 };
+
+    /* height is the number of rows from the first block down */
+    for (y=0; y<H; y++) {
+      seen |= -(Lane_Int) ((occ >> y) & 1);
+      height -= seen;
+    }
+    /* Penalize for holes under blocks: these count for double! */
+    nHoles += 2 * (height - lane_popcount(occ));
+    nGarbage += lane_popcount(l->garbage[x]);
+    sumHeight += height;
+    {
+      Lane_Int up = (height > maxHeight), down = (height < minHeight);
+      maxHeight = (height & up) | (maxHeight & ~up);
+      minHeight = (height & down) | (minHeight & ~down);
     }
-    avgHeight += height;
-    if (height > maxHeight) maxHeight = height;
-    if (height < minHeight) minHeight = height;
   }
-  avgHeight /= nColumns;
+  nHoles *= H;
 
-  nHoles *= g->h;
-  
   /* Find the number of holes lower than the maxHeight */
-  for (x=0; x<g->w; x++) {
-    for (y=g->h-maxHeight; y<g->h; y++) {
-      /* count the canyons under here */
-      if (GRID_CONTENT(*g, x, y) == 0&&
-	  ((x == 0 || GRID_CONTENT(*g, x-1, y)) &&
-	   (x == g->w-1 || GRID_CONTENT(*g, x+1, y))))
-	nCanyons += y;
-      }
+  range = ((Lane_Mask) { 0 } + 1) << (Lane_Mask) (H - maxHeight);
+  range = ~(range - 1) & ((1U << H) - 1);
+  for (x=0; x<W; x++) {
+    Lane_Mask canyon = range & ~l->occupied[x];
+    if (x > 0) canyon &= l->occupied[x-1];
+    if (x < W-1) canyon &= l->occupied[x+1];
+    for (y=0; y<H; y++)
+      nCanyons += -(Lane_Int) ((canyon >> y) & 1) & y;
   }
 
-#ifdef DEBUG
-  printf("*** %d holes ", nHoles);
-#endif
-  
-  return (double)(maxHeight*(g->h) + avgHeight + (maxHeight - minHeight) +
-		  nHoles + nCanyons + nGarbage + (g->h - row)
-		  - nLines*nLines);
+  for (i=0; i<MASK_LANES; i++) {
+    double avgHeight = (double)sumHeight[i] / W;
+    out[i] = evalSum(maxHeight[i], avgHeight, minHeight[i], nHoles[i],
+	nCanyons[i], nGarbage[i], H, row[i], nLines[i]);
+  }
 }
 
 /*******************************************************************
- *   cogitate()
- * Kiri's AI 'thinking' function.  Again, called once 'every so'
- * by event_loop().  
+ *   evalMasks()
+ * evalLanes() for a single board.
  *******************************************************************/
-static void 
-alizCogitate(void *state, Grid* g, play_piece* pp, play_piece* np, 
-	int col, int row, int rot)
+static double evalMasks(Grid_Masks* m, int nLines, int row)
 {
-  Aliz_State *as = (Aliz_State *)state;
-  double eval, evalLeft = -1, evalRight = -1;
-  int nLines;
-
-  Assert(as);
-    
-  if (as->foundBest) return;
-  
-  memcpy(as->kg.contents, g->contents, (g->w * g->h * sizeof(as->kg.contents[0])));
-  memcpy(as->kg.fall, g->fall, (g->w * g->h * sizeof(*as->kg.fall)));
-
-  if (as->bestEval == -1) {
-    /* It's our first think! */
-    as->checkColumn = col; /* check this column first */
-    as->checkRotation = 0; /* check no rotation (it's easy!) */
-    as->checkSides = 0; /* middle */
-  }
-  else {
-    /* Try the next thing */
-    as->checkRotation = (as->checkRotation+1)%4;
-    if (as->checkRotation == 0) {
-      /* Try a new column */
-      /* Go all the way left first */
-      if (as->checkColumn == col || as->checkColumn < col) {
-	as->checkColumn--;
-	if (!valid_position(pp, as->checkColumn, row,
-			    as->checkRotation, &as->kg)) {
-	  as->checkColumn = col + 1;
-	  if (!valid_position(pp, as->checkColumn, row,
-			      as->checkRotation, &as->kg)) {
-	    /* skip this one */
-	    return;
-	  }
-	}
-      }
-      else {
-	/* Now go all the way to the right */
-	as->checkColumn++;
-	if (!valid_position(pp, as->checkColumn, row,
-			    as->checkRotation, &as->kg)) {
-	  /* skip this one */
-	  return;
-	}
-      }
-    } else if (!valid_position(pp, as->checkColumn, row,
-			       as->checkRotation, &as->kg)) {
-      /* as->checkRotation != 0 */
-      if (as->checkColumn >= g->w && as->checkRotation == 3) {
-	/* final one */
-	as->foundBest = TRUE;
-#ifdef DEBUG
-	printf("Aliz: Found best! (last checked %d, %d)\n",
-	       as->checkColumn, as->checkRotation);
-#endif
-	return;
-      }
-      /* Trying a specific rotation; skip this one */
-      else return;
-    }
-  }
-#ifdef DEBUG
-  printf("Aliz: trying (col %d, rot %d) ", as->checkColumn, as->checkRotation);
-#endif
+  Grid_Masks *lane[MASK_LANES];
+  Lane_Masks l;
+  int lines[MASK_LANES], rows[MASK_LANES];
+  double out[MASK_LANES];
+  int i;
 
-  /* Check for impending doom */
-  if (GRID_CONTENT(*g, col, row+1)) {
-#ifdef DEBUG
-    printf("Aliz: panic! about to crash, ");
-#endif
-   
-    /* something right below us, so move the direction with more space */
-    if (col > g->w - col) {
-      /* go left, leave rotation as is */
-      as->goalColumn = col/2;
-      /* wessy commentary: you might want to set goalRotation to the
-       * current rotation so that your next move (the panic flight) will
-       * be a motion, not a rotation) ...
-       */
-      as->goalRotation = as->checkRotation;
-#ifdef DEBUG
-      printf("moving left.\n");
-#endif
-    }
-    else {
-      /* go right, leave rotation as is */
-      as->goalColumn = col + (g->w - col)/2;
-      as->goalRotation = as->checkRotation;
-#ifdef DEBUG
-      printf("moving right.\n");
-#endif
-    }
-#ifdef DEBUG
-    printf(" NEW goal: col %d, rot %d\n", as->goalColumn, as->goalRotation);
-#endif
-    return;
+  ai_counters.evals++;
+  for (i=0; i<MASK_LANES; i++) {
+    lane[i] = m;
+    lines[i] = nLines;
+    rows[i] = row;
   }
+  lane_masks(&l, lane);
+  evalLanes(&l, lines, rows, out);
+  return out[0];
+}
 
-  /************** Test the current choice ****************/
-  nLines = drop_piece_on_grid(&as->kg, pp, as->checkColumn, row, 
-			      as->checkRotation);
-  if (nLines != -1) {	/* invalid place to drop something */
-    eval = evalBoard(&as->kg, nLines, row);
-#ifdef DEBUG
-    printf(": eval = %.3f", eval);
-#endif
-    if (as->bestEval == -1 || eval < as->bestEval) {
-      as->bestEval = eval;
-      as->goalColumn = as->checkColumn;
-      as->goalRotation = as->checkRotation;
-#ifdef DEBUG
-      printf(" **");
-#endif
-      
-      /* See if we should try to slide left */
-      if (as->checkColumn > 0 && !GRID_CONTENT(*g, as->checkColumn-1, row)) {
-	int y;
-	for (y=row; y>=0; y--)
-	  /* worth trying if there's something above it */
-	  if (GRID_CONTENT(*g, as->checkColumn-1, y)) break;
-	if (y >= 0 && valid_position(pp, as->checkColumn-1, row,
-				     as->checkRotation, &as->kg)) {
-	  printf("Aliz: Trying to slip left.\n");
-	  /* get a fresh copy */
-	  memcpy(as->kg.contents, g->contents, (g->w * g->h * sizeof(as->kg.contents[0])));
-	  memcpy(as->kg.fall, g->fall, (g->w * g->h * sizeof(*as->kg.fall)));
-	  paste_on_board(pp, as->checkColumn-1, row,
-			 as->checkRotation, &as->kg);
-	  /* nLines is the same */
-	  evalLeft = evalBoard(&as->kg, nLines, row);
-	}
-      }
-
-      /* See if we should try to slide left */
-      if (as->checkColumn < g->w-1 && !GRID_CONTENT(*g, as->checkColumn+1, row)) {
-	int y;
-	for (y=row; y>=0; y--)
-	  /* worth trying if there's something above it */
-	  if (GRID_CONTENT(*g, as->checkColumn+1, y)) break;
-	if (y >= 0 && valid_position(pp, as->checkColumn+1, row,
-				     as->checkRotation, &as->kg)) {
-	  printf("Aliz: Trying to slip right.\n");
-	  /* get a fresh copy */
-	  memcpy(as->kg.contents, g->contents, (g->w * g->h * sizeof(as->kg.contents[0])));
-	  memcpy(as->kg.fall, g->fall, (g->w * g->h * sizeof(*as->kg.fall)));
-	  paste_on_board(pp, as->checkColumn+1, row,
-			 as->checkRotation, &as->kg);
-	  /* nLines is the same */
-	  evalRight = evalBoard(&as->kg, nLines, row);
-	}
-      }
+/*******************************************************************
+ *   evalBoard()
+ * evalMasks() for a plain grid.
+ *******************************************************************/
+static double evalBoard(Grid* g, int nLines, int row)
+{
+  Grid_Masks m;
 
-      if (evalLeft >= 0 && evalLeft < as->bestEval && evalLeft <= evalRight) {
-	as->goalColumn = as->checkColumn;
-	as->goalSides = -1;
-	printf(": eval = %.3f left **", eval);
-      } else if (evalRight >= 0 && evalRight < as->bestEval && evalRight < evalLeft) {
-	as->goalColumn = as->checkColumn;
-	as->goalSides = 1;
-	printf(": eval = %.3f right **", eval);
-      }
-      else {
-#ifdef DEBUG
-	printf(": eval = %.3f", eval);
-#endif
-	if (as->bestEval == -1 || eval < as->bestEval) {
-	  as->bestEval = eval;
-	  as->goalColumn = as->checkColumn;
-	  as->goalRotation = as->checkRotation;
-	  as->goalSides = as->checkSides;
-	}
-      }
-    }
-#ifdef DEBUG
-    printf("\n");
-#endif
-  }
-    
+  grid_masks(g, &m);
+  return evalMasks(&m, nLines, row);
 }
 
-/*******************************************************************
- *   alizReset()
- * Clear all of Kiri's globals.
- *********************************************************************/
-static void *
-alizReset(void *state, Grid *g)
+/***************************************************************************
+ *      ai_set_profile()
+ * Makes w the weights every AI goes by.
+ *********************************************************************PROTO*/
+void
+ai_set_profile(const AI_Weights *w)
 {
-    Aliz_State *as;
+    ai_profile = *w;
+}
 
-    if (state == NULL) {
-	/* first time we have been called (this game) */
-	Calloc(as, Aliz_State *,sizeof(Aliz_State));
-    } else
-	as = (Aliz_State *)state;
-    Assert(as);
+/***************************************************************************
+ *      ai_get_profile()
+ *********************************************************************PROTO*/
+void
+ai_get_profile(AI_Weights *w)
+{
+    *w = ai_profile;
+}
 
-#ifdef DEBUG
-    printf("Aliz: Clearing state.\n");
-#endif
-    as->bestEval = -1;
-    as->foundBest = FALSE;
-    if (as->kg.contents == NULL) as->kg = generate_board(g->w, g->h, 0);
-    return as;
+/***************************************************************************
+ *      ai_set_thread_weights()
+ * The AIs on this thread go by w instead of the profile (NULL to stop).
+ * w must stay put until then.
+ *********************************************************************PROTO*/
+void
+ai_set_thread_weights(const AI_Weights *w)
+{
+    ai_thread_weights = w;
 }
 
-/*******************************************************************
- *   alizMove()
- * Kiri's AI 'move' function.  Possible retvals:
- * 	MOVE_NONE	Do nothing, fall normally.
- * 	MOVE_LEFT	[Try to] Move one column to the left.
- * 	MOVE_RIGHT	[Try to] Move one column to the right.
- * 	MOVE_ROTATE	[Try to] Rotate the piece.
- * 	MOVE_DOWN	Fall down really quickly.
- *********************************************************************/
-static Command 
-alizMove(void *state, Grid* g, play_piece* pp, play_piece* np, int col, int row, int rot)
+/***************************************************************************
+ *      ai_weights_get()
+ * Flattens w into AI_WEIGHTS_N numbers, in profile-file order.
+ *********************************************************************PROTO*/
+void
+ai_weights_get(const AI_Weights *w, double *v)
 {
-    Aliz_State *as = (Aliz_State *)state;
-    Assert(as);
-  if (rot == as->goalRotation) {
-    if (col == as->goalColumn) {
-      if (as->foundBest) {
-	if (GRID_CONTENT(*g, col, row+1)) {
-	  if (as->goalSides == -1) return MOVE_LEFT;
-	  else if (as->goalSides == 1) return MOVE_RIGHT;
-	}
-	return MOVE_DOWN;
-      }
-      else return MOVE_NONE;
-    } else if (col < as->goalColumn) return MOVE_RIGHT;
-    else return MOVE_LEFT;
-  } else return MOVE_ROTATE;
+    int i;
 
-  
+    for (i=0; i<AI_BADNESS_W; i++)
+	v[i] = w->badness[i];
+    v[i++] = w->hole;
+    v[i++] = w->same_color;
+    v[i++] = w->max_height;
+    v[i++] = w->avg_height;
+    v[i++] = w->bumpiness;
+    v[i++] = w->holes;
+    v[i++] = w->canyons;
+    v[i++] = w->garbage;
+    v[i++] = w->row;
+    v[i++] = w->lines;
+    Assert(i == AI_WEIGHTS_N);
 }
 
-/*************************************************************************
- *   AI_Players_Setup()
- * This function creates a structure describing all of the available AI
- * players.
- *******************************************************************PROTO*/
-AI_Players *
-AI_Players_Setup(void)
+/***************************************************************************
+ *      ai_weights_set()
+ * The other way around. Wes's weights are whole numbers and none of them
+ * may be negative.
+ *********************************************************************PROTO*/
+void
+ai_weights_set(AI_Weights *w, const double *v)
 {
     int i;
-    AI_Players *retval;
 
-    Calloc(retval, AI_Players *, sizeof(AI_Players));
+    for (i=0; i<AI_BADNESS_W; i++)
+	w->badness[i] = (int) (max(v[i], 0.0) + 0.5);
+    w->hole = (int) (max(v[i], 0.0) + 0.5); i++;
+    w->same_color = (int) (max(v[i], 0.0) + 0.5); i++;
+    w->max_height = max(v[i], 0.0); i++;
+    w->avg_height = max(v[i], 0.0); i++;
+    w->bumpiness = max(v[i], 0.0); i++;
+    w->holes = max(v[i], 0.0); i++;
+    w->canyons = max(v[i], 0.0); i++;
+    w->garbage = max(v[i], 0.0); i++;
+    w->row = max(v[i], 0.0); i++;
+    w->lines = max(v[i], 0.0); i++;
+    Assert(i == AI_WEIGHTS_N);
+}
 
-    retval->n = 4;	/* change this to add another */
-    Calloc(retval->player, AI_Player *, sizeof(AI_Player) * retval->n);
-    i = 0;
+/***************************************************************************
+ *      ai_load_weights()
+ * Reads an AI profile: "name = value" lines, '#' for comments. Anything
+ * the file does not mention keeps the value it had in w. Returns 0 if the
+ * file cannot be read.
+ *********************************************************************PROTO*/
+int
+ai_load_weights(const char *filespec, AI_Weights *w)
+{
+    FILE *fin = fopen(filespec, "rt");
+    char buf[1024], name[1024];
+    double v[AI_WEIGHTS_N], x;
+    int i;
 
-    retval->player[i].name 	= "Simple Robot";
-    retval->player[i].msg	= "An introductory opponent.";
-    retval->player[i].move 	= wes_ai_move;
-    retval->player[i].think 	= beginner_ai_think;
-    retval->player[i].reset	= wes_ai_reset;
-    i++;
+    if (!fin) {
+	Debug("Cannot read AI profile [%s]\n", filespec);
+	return 0;
+    }
+    ai_weights_get(w, v);
+    while (fgets(buf, sizeof(buf), fin)) {
+	if (buf[0] == '#' || buf[0] == '\n')
+	    continue;
+	if (sscanf(buf, "%s = %lf", name, &x) != 2) {
+	    Debug("Unable to parse profile line\n%s", buf);
+	    continue;
+	}
+	for (i=0; i<AI_WEIGHTS_N; i++)
+	    if (!strcasecmp(name, ai_weight_name[i])) {
+		v[i] = x;
+		break;
+	    }
+	if (i == AI_WEIGHTS_N)
+	    Debug("Unknown AI weight [%s]\n", name);
+    }
+    fclose(fin);
+    ai_weights_set(w, v);
+    Debug("AI profile [%s] loaded.\n", filespec);
+    return 1;
+}
 
-    retval->player[i].name 	= "Lightning";
-    retval->player[i].msg	= "Warp-speed heuristics.";
-    retval->player[i].move 	= wes_ai_move;
-    retval->player[i].think 	= wes_ai_think;
-    retval->player[i].reset	= wes_ai_reset;
-    i++;
+/***************************************************************************
+ *      ai_save_weights()
+ * Writes w out as an AI profile that ai_load_weights() can read. The
+ * comment goes at the top. Returns 0 if the file cannot be written.
+ *********************************************************************PROTO*/
+int
+ai_save_weights(const char *filespec, const AI_Weights *w, const char *comment)
+{
+    FILE *fout = fopen(filespec, "wt");
+    double v[AI_WEIGHTS_N];
+    int i;
 
-    retval->player[i].name	= "Aliz";
-    retval->player[i].msg	= "Kiri's codified wit and wisdom.";
-    retval->player[i].move 	= alizMove;
-    retval->player[i].think 	= alizCogitate;
-    retval->player[i].reset	= alizReset;
-    i++;
+    if (!fout) {
+	Debug("Cannot write AI profile [%s]\n", filespec);
+	return 0;
+    }
+    ai_weights_get(w, v);
+    fprintf(fout, "# Alizarin Tetris AI profile: use it with --profile=%s\n",
+	    filespec);
+    if (comment)
+	fprintf(fout, "# %s\n", comment);
+    for (i=0; i<AI_WEIGHTS_N; i++)
+	fprintf(fout, "%s = %.6g\n", ai_weight_name[i], v[i]);
+    fclose(fout);
+    return 1;
+}
 
-    retval->player[i].name	= "Double-Think";
-    retval->player[i].msg	= "Brilliant but slow.";
-    retval->player[i].move 	= double_ai_move;
-    retval->player[i].think 	= double_ai_think;
-    retval->player[i].reset	= double_ai_reset;
-    i++;
-    
-    Debug("AI Players Initialized (%d AIs).\n",retval->n);
+/***************************************************************************
+ *      ai_batch_new()
+ * Room for "max" boards the size of g.
+ *********************************************************************PROTO*/
+AI_Batch *
+ai_batch_new(Grid *g, int max)
+{
+    AI_Batch *b;
 
-    return retval;
+    Assert(g->w <= GRID_MASK_MAX_W && g->h <= GRID_MASK_MAX_H && max > 0);
+    /* whole vectors only, so the evaluators never read past the end */
+    max = (max + MASK_LANES - 1) / MASK_LANES * MASK_LANES;
+
+    Calloc(b, AI_Batch *, sizeof(AI_Batch));
+    b->max = max;
+    b->w = g->w;
+    b->h = g->h;
+    Calloc(b->occupied, Uint32 *, g->h * max * sizeof(Uint32));
+    Calloc(b->garbage, Uint32 *, g->h * max * sizeof(Uint32));
+    Calloc(b->same_left, Uint32 *, g->h * max * sizeof(Uint32));
+    Calloc(b->place, AI_Placement *, max * sizeof(AI_Placement));
+    Calloc(b->lines, int *, max * sizeof(int));
+    return b;
 }
 
 /***************************************************************************
- *      pick_key_repeat()
- * Ask the player to select a keyboard repeat rate. 
+ *      ai_batch_free()
+ * Gives back everything ai_batch_new() took.
  *********************************************************************PROTO*/
-int
-pick_key_repeat(SDL_Surface * screen) 
+void
+ai_batch_free(AI_Batch *b)
 {
-    char *factor;
-    int retval;
+    free(b->occupied);
+    free(b->garbage);
+    free(b->same_left);
+    free(b->place);
+    free(b->lines);
+    free(b);
+}
 
-    clear_screen_to_flame();
-    draw_string("(1 = Slow Repeat, 16 = Default, 32 = Fastest)",
-	    color_purple, screen->w/2,
-	    screen->h/2, DRAW_UPDATE | DRAW_CENTER | DRAW_ABOVE);
-    draw_string("Keyboard repeat delay factor:", color_purple,
-	    screen->w/2, screen->h/2, DRAW_UPDATE | DRAW_LEFT);
-    factor = input_string(screen, screen->w/2, screen->h/2, 0);
-    retval = 0;
-    sscanf(factor,"%d",&retval);
-    free(factor);
-    if (retval < 1) retval = 1;
-    if (retval > 32) retval = 32;
-    clear_screen_to_flame();
-    return retval;
+/***************************************************************************
+ *      ai_batch_drop()
+ * Simulates n placements of pp on g and stores the resulting boards in
+ * the batch (replacing whatever was there). Uses the SIM_SCRATCH_BATCH
+ * scratch grid of the calling thread.
+ *********************************************************************PROTO*/
+void
+ai_batch_drop(AI_Batch *b, Grid *g, play_piece *pp, AI_Placement *p, int n)
+{
+    Grid *t = sim_scratch(SIM_SCRATCH_BATCH, g->w, g->h);
+    int i, x, y;
+
+    Assert(n <= b->max && g->w == b->w && g->h == b->h);
+    ai_counters.candidates += n;
+    b->n = n;
+    for (i=0; i<b->max; i++) {
+	int fits = 0;
+
+	if (i < n) {
+	    sim_copy_grid(t, g);
+	    b->place[i] = p[i];
+	    b->lines[i] = drop_piece_on_grid(t, pp, p[i].col, p[i].row, p[i].rot);
+	    fits = (b->lines[i] != -1);
+	}
+	for (y=0; y<g->h; y++) {
+	    unsigned char *row = &GRID_CONTENT(*t,0,y);
+	    Uint32 occ = 0, garb = 0, same = 0;
+	    if (fits) 
+		for (x=0; x<g->w; x++) {
+		    if (row[x]) occ |= 1U << x;
+		    if (row[x] == 1) garb |= 1U << x;
+		    if (x > 0 && row[x] && row[x-1] == row[x]) same |= 1U << x;
+		}
+	    b->occupied[y * b->max + i] = occ;
+	    b->garbage[y * b->max + i] = garb;
+	    b->same_left[y * b->max + i] = same;
+	}
+    }
 }
 
 /***************************************************************************
- *      pick_ai_factor()
- * Asks the player to choose an AI delay factor.
+ *      ai_batch_all()
+ * ai_batch_drop() for every column and rotation, falling from "row".
+ * Returns the number of placements tried.
  *********************************************************************PROTO*/
 int
-pick_ai_factor(SDL_Surface * screen) 
+ai_batch_all(AI_Batch *b, Grid *g, play_piece *pp, int row)
 {
-    char *factor;
-    int retval;
+    int ncols = g->w - WES_MIN_COL;
+    int i, n = min(4 * ncols, b->max);
+    AI_Placement p[4 * (32 - WES_MIN_COL)];
 
-    clear_screen_to_flame();
-    draw_string("(1 = Impossible, 100 = Easy, 0 = Set Automatically)",
-	    color_purple, screen->w/2,
-	    screen->h/2, DRAW_UPDATE | DRAW_CENTER | DRAW_ABOVE);
-    draw_string("Pick an AI delay factor:", color_purple,
-	    screen->w/2, screen->h/2, DRAW_UPDATE | DRAW_LEFT);
-    factor = input_string(screen, screen->w/2, screen->h/2, 0);
-    retval = 0;
-    sscanf(factor,"%d",&retval);
-    free(factor);
-    if (retval < 0) retval = 0;
-    if (retval > 100) retval = 100;
-    return retval;
+    for (i=0; i<n; i++) {
+	p[i].col = WES_MIN_COL + i % ncols;
+	p[i].row = row;
+	p[i].rot = i / ncols;
+    }
+    ai_batch_drop(b, g, pp, p, n);
+    return n;
+}
+
+/* loads lanes i .. i+MASK_LANES-1 of row y of one of the batch arrays */
+static Lane_Mask
+batch_lanes(AI_Batch *b, Uint32 *a, int y, int i)
+{
+    Lane_Mask v;
+    memcpy(&v, &a[y * b->max + i], sizeof(v));
+    return v;
 }
 
+/*
+ * boards i .. i+MASK_LANES-1 of the batch, turned on their side: the
+ * batch keeps rows and the lane-wise evaluators want columns
+ */
+static void
+batch_masks(AI_Batch *b, int i, Lane_Masks *l)
+{
+    int x, y;
+
+    l->w = b->w;
+    l->h = b->h;
+    memset(l->occupied, 0, sizeof(l->occupied));
+    memset(l->garbage, 0, sizeof(l->garbage));
+    memset(l->same_left, 0, sizeof(l->same_left));
+    for (y=0; y<b->h; y++) {
+	Lane_Mask occ = batch_lanes(b, b->occupied, y, i);
+	Lane_Mask garb = batch_lanes(b, b->garbage, y, i);
+	Lane_Mask same = batch_lanes(b, b->same_left, y, i);
+
+	for (x=0; x<b->w; x++) {
+	    l->occupied[x] |= ((occ >> x) & 1) << y;
+	    l->garbage[x] |= ((garb >> x) & 1) << y;
+	    l->same_left[x] |= ((same >> x) & 1) << y;
+	}
+    }
+}
 
 /***************************************************************************
- *      pick_an_ai()
- * Asks the player to choose an AI.
- *
- * Returns -1 on "cancel". 
+ *      ai_batch_weigh()
+ * weight_board() for every board in the batch, MASK_LANES at a time.
+ * Placements that did not fit get AI_BATCH_INVALID.
  *********************************************************************PROTO*/
-int 
-pick_an_ai(SDL_Surface *screen, char *msg, AI_Players *AI)
+void
+ai_batch_weigh(AI_Batch *b, int *scores)
 {
-    WalkRadioGroup *wrg;
-    int i, text_h;
-    int retval;
-    SDL_Event event;
+    int i, j;
 
-    wrg = create_single_wrg( AI->n + 1 );
-    for (i=0; i<AI->n ; i++) {
-	char buf[1024];
-	sprintf(buf,"\"%s\" : %s", AI->player[i].name, AI->player[i].msg);
-	wrg->wr[0].label[i] = strdup(buf);
+    ai_counters.evals += b->n;
+    for (i=0; i<b->n; i+=MASK_LANES) {
+	Lane_Masks l;
+	int out[MASK_LANES];
+
+	batch_masks(b, i, &l);
+	weight_lanes(&l, out);
+	for (j=0; j<MASK_LANES && i+j<b->n; j++)
+	    scores[i+j] = (b->lines[i+j] == -1) ? AI_BATCH_INVALID : out[j];
     }
+}
 
-    wrg->wr[0].label[AI->n] = "-- Cancel --";
+/***************************************************************************
+ *      ai_batch_eval()
+ * evalBoard() for every board in the batch, MASK_LANES at a time, using
+ * the lines each placement cleared and the row it fell from. Placements
+ * that did not fit get AI_BATCH_INVALID.
+ *********************************************************************PROTO*/
+void
+ai_batch_eval(AI_Batch *b, double *scores)
+{
+    int i, j;
 
-    wrg->wr[0].defaultchoice = retval = 0;
+    ai_counters.evals += b->n;
+    for (i=0; i<b->n; i+=MASK_LANES) {
+	Lane_Masks l;
+	int row[MASK_LANES];
+	double out[MASK_LANES];
 
-    if (wrg->wr[0].defaultchoice > AI->n) 
-	PANIC("not enough choices!");
-    
-    setup_radio(&wrg->wr[0]);
+	batch_masks(b, i, &l);
+	for (j=0; j<MASK_LANES; j++)
+	    row[j] = b->place[i+j].row;
+	evalLanes(&l, &b->lines[i], row, out);
+	for (j=0; j<MASK_LANES && i+j<b->n; j++)
+	    scores[i+j] = (b->lines[i+j] == -1) ? AI_BATCH_INVALID : out[j];
+    }
+}
 
-    wrg->wr[0].x = (screen->w - wrg->wr[0].area.w) / 2;
-    wrg->wr[0].y = (screen->h - wrg->wr[0].area.h) / 2;
+/*
+ * The learned evaluator. Its features come out of the batch a row at a
+ * time, MASK_LANES boards at a time, and the model is
+ * run on all of those boards at once: every weight is loaded once and
+ * multiplied into a whole vector of boards.
+ */
+typedef float	Lane_Float __attribute__ ((vector_size (4 * MASK_LANES)));
 
-    clear_screen_to_flame();
+#define AI_MODEL_MAX_FEATURES	(32 + AI_MODEL_EXTRA)
 
-    text_h = draw_string(msg, color_ai_menu, ( screen->w ) / 2,
-	    wrg->wr[0].y - 30, DRAW_UPDATE | DRAW_CENTER);
+static AI_Model *ai_model = NULL;	/* --model=FILE */
 
-    draw_string("Choose a Computer Player", color_ai_menu, (screen->w ) /
-	    2, (wrg->wr[0].y - 30) - text_h, DRAW_UPDATE | DRAW_CENTER);
+static Lane_Int
+lane_min(Lane_Int a, Lane_Int b)
+{
+    Lane_Int lt = (a < b);
+    return (a & lt) | (b & ~lt);
+}
 
-    draw_radio(&wrg->wr[0], 1);
+static Lane_Int
+lane_max(Lane_Int a, Lane_Int b)
+{
+    Lane_Int gt = (a > b);
+    return (a & gt) | (b & ~gt);
+}
 
-    while (1) {
-	int retval;
-	poll_and_flame(&event);
+static Lane_Float
+lane_float(Lane_Int v)
+{
+    Lane_Float f;
+    int j;
+    for (j=0; j<MASK_LANES; j++)
+	f[j] = (float) v[j];
+    return f;
+}
 
-	retval = handle_radio_event(wrg,&event);
-	if (retval == -1)
-	    continue;
-	if (retval == AI->n)
-	    return -1;
-	return retval;
-    }
+/***************************************************************************
+ *      ai_model_builtin()
+ * The model we use when none was loaded, or the one that was is for
+ * another board width: linear, on the raw features. The arrays must have
+ * room for w + AI_MODEL_EXTRA floats.
+ ***************************************************************************/
+static void
+ai_model_builtin(AI_Model *m, int w, float *mean, float *scale, float *wt)
+{
+    static const float extra[AI_MODEL_EXTRA] = {
+	10.0,	/* holes */
+	0.5,	/* bumpiness */
+	0.0,	/* tallest column */
+	0.5,	/* wells */
+	0.0,	/* pairs of like colors */
+	1.0,	/* garbage */
+	0.0,	/* lines */
+    };
+    int k;
+
+    m->features = w + AI_MODEL_EXTRA;
+    m->hidden = 0;
+    for (k=0; k<m->features; k++) {
+	mean[k] = 0.0;
+	scale[k] = 1.0;
+	wt[k] = (k < w) ? 1.0 : extra[k - w];
+    }
+    m->mean = mean;
+    m->scale = scale;
+    m->w1 = wt;
+    m->b1 = m->w2 = NULL;
+    m->b2 = 0.0;
 }
 
+/***************************************************************************
+ *      ai_free_model()
+ * Gives back everything ai_load_model() took.
+ *********************************************************************PROTO*/
+void
+ai_free_model(AI_Model *m)
+{
+    if (!m)
+	return;
+    Free(m->mean); Free(m->scale); Free(m->w1); Free(m->b1); Free(m->w2);
+    free(m);
+}
 
-/*
- * $Log: ai.c,v $
- * Revision 1.27  2001/01/05 21:12:31  weimer
- * advance to atris 1.0.5, add support for ".atrisrc" and changing the
- * keyboard repeat rate
- *
- * Revision 1.26  2000/11/06 04:06:44  weimer
- * option menu
- *
- * Revision 1.25  2000/11/06 01:22:40  wkiri
- * Updated menu system.
- *
- * Revision 1.24  2000/11/06 00:24:01  weimer
- * add WalkRadioGroup modifications (inactive field for Kiri) and some support
- * for special pieces
- *
- * Revision 1.23  2000/11/02 03:06:20  weimer
- * better interface for walk-radio menus: we are now ready for Kiri to change
- * them to add run-time options ...
- *
- * Revision 1.22  2000/11/01 04:39:41  weimer
- * clear the little scoring spot correctly, updates for making a no-sound
- * distribution
- *
- * Revision 1.21  2000/11/01 03:53:06  weimer
- * modifications for version 1.0.1: you can pick your starting level, you can
- * pick the AI difficulty factor, the game is better about placing new pieces
- * when there is garbage, when things fall out of your control they now fall
- * at a uniform rate ...
- *
- * Revision 1.20  2000/10/29 21:23:28  weimer
- * One last round of header-file changes to reflect my newest and greatest
- * knowledge of autoconf/automake. Now if you fail to have some bizarro
- * function, we try to go on anyway unless it is vastly needed.
- *
- * Revision 1.19  2000/10/29 19:04:32  weimer
- * minor highscore handling changes: new filename, use the draw_string() and
- * draw_bordered_rect() and input_string() interfaces, handle the widget layer
- * and the flame layer, etc. Also fix a minor bug where you would be prevented
- * from settling if you pressed a key even if it didn't really move you. :-)
- *
- * Revision 1.18  2000/10/29 17:23:13  weimer
- * incorporate "xflame" flaming background for added spiffiness ...
- *
- * Revision 1.17  2000/10/28 21:30:34  wkiri
- * Kiri AI rules!
- *
- * Revision 1.16  2000/10/21 01:14:42  weimer
- * massic autoconf/automake restructure ...
- *
- * Revision 1.15  2000/10/20 01:32:09  weimer
- * Minor play issue problems -- time is now truly a hard limit!
- *
- * Revision 1.14  2000/10/18 23:57:49  weimer
- * general fixup, color changes, display changes.
- * Notable: "Safe" Blits and Updates now perform "clipping". No more X errors,
- * we hope!
- *
- * Revision 1.13  2000/10/18 02:04:02  weimer
- * playability changes ...
- *
- * Revision 1.12  2000/10/14 16:17:41  weimer
- * level adjustment changes, added some new AIs, etc.
- *
- * Revision 1.11  2000/10/14 03:36:22  weimer
- * wessy AI changes: resource management
- *
- * Revision 1.10  2000/10/14 02:56:37  wkiri
- * Kiri AI gets another leg up.
- *
- * Revision 1.9  2000/10/14 01:56:35  weimer
- * remove dates from identity files
- *
- * Revision 1.8  2000/10/14 01:56:10  wkiri
- * Kiri AI comes of age!
- *
- * Revision 1.7  2000/10/14 01:24:34  weimer
- * fixed error with not advancing levels when fighting AI
- *
- * Revision 1.6  2000/10/13 22:34:26  weimer
- * minor wessy AI changes
- *
- * Revision 1.5  2000/10/13 21:16:43  wkiri
- * Aliz AI evolves!
- *
- * Revision 1.4  2000/10/13 16:37:39  weimer
- * Changed the AI so that it now passes state around via void pointers, rather
- * than using global variables. This allows the same AI to play itself. Also
- * changed the "AI vs. AI" display so that you can keep track of total wins
- * and losses.
- *
- * Revision 1.3  2000/10/13 15:41:53  weimer
- * revamped AI support, now you can pick your AI and have AI duels (such fun!)
- * the mighty Aliz AI still crashes a bit, though ... :-)
- *
- * Revision 1.2  2000/10/13 03:02:05  wkiri
- * Added Aliz (Kiri AI) to ai.c.
- * Note event.c currently calls Aliz, not Wessy AI.
- *
- * Revision 1.1  2000/10/12 19:19:43  weimer
- * Sigh!
- *
- */
-
-/***************************************************************************
- *      button()
- * Create a new button and return it.
- *********************************************************************PROTO*/
-ATButton* button(char* text, Uint32 face_color0, Uint32 text_color0,
-	Uint32 face_color1, Uint32 text_color1,
-	int x, int y)
-{
-  SDL_Color sc;
-  ATButton* ab = (ATButton*)malloc(sizeof(ATButton)); Assert(ab);
-
-  /* Copy the colors */
-  ab->face_color[0] = face_color0;  
-  ab->text_color[0] = text_color0;
-  ab->face_color[1] = face_color1;  
-  ab->text_color[1] = text_color1;
-  /* Copy the text */
-  SDL_GetRGB(text_color0, screen->format, &sc.r, &sc.g, &sc.b);
-  ab->bitmap[0] = TTF_RenderText_Blended(font, text, sc);
-  Assert(ab->bitmap[0]);
-  SDL_GetRGB(text_color1, screen->format, &sc.r, &sc.g, &sc.b);
-  ab->bitmap[1]  = TTF_RenderText_Blended(font, text, sc);
-  Assert(ab->bitmap[1]);
-  /* Make the button bg */
-  ab->area.x = x; ab->area.y = y;
-  ab->area.w = ab->bitmap[0]->w + 10;
-  ab->area.h = ab->bitmap[0]->h + 10;
-  return ab;
-}
-
-/***************************************************************************
- *      show_button()
- * Displays the button, taking into account whether it's clicked or not.
- *********************************************************************PROTO*/
-void show_button(ATButton* ab, int state)
+/* reads n floats, 0 if the file ran out */
+static int
+ai_model_read(FILE *fin, float **v, int n)
 {
-    SDL_FillRect(screen, &ab->area, ab->text_color[state]);
-    SDL_UpdateSafe(screen, 1, &ab->area);
-    ab->area.x += 2; ab->area.y += 2;
-    ab->area.w -= 4; ab->area.h -= 4;
-    SDL_FillRect(screen, &ab->area, ab->face_color[state]);
-    SDL_UpdateSafe(screen, 1, &ab->area);
-    ab->area.x += 3; ab->area.y += 3;
-    ab->area.w -= 6; ab->area.h -= 6;
-    SDL_BlitSurface(ab->bitmap[state], NULL, screen, &ab->area);
-
-    ab->area.x -= 5;  ab->area.y -= 5;
-    ab->area.w += 10; ab->area.h += 10;
-    SDL_UpdateSafe(screen, 1, &ab->area);
+    Calloc(*v, float *, max(n, 1) * sizeof(float));
+    return fread(*v, sizeof(float), n, fin) == (size_t) n;
 }
 
 /***************************************************************************
- *      check_button()
- * Returns 1 if (x,y) is inside the button, else 0.
- * Also sets the is_clicked field in ab.
+ *      ai_load_model()
+ * Reads a model file (see AI_Model). Returns NULL if the file cannot be
+ * read or is not one.
  *********************************************************************PROTO*/
-char check_button(ATButton* ab, int x, int y)
+AI_Model *
+ai_load_model(const char *filespec)
 {
-  if ((ab->area.x <= x && x <= ab->area.x + ab->area.w) &&
-	  (ab->area.y <= y && y <= ab->area.y + ab->area.h)) {
-      return 1; 
-  } else return 0;
-}
-
-/*
- * $Log: button.c,v $
- * Revision 1.9  2000/11/06 01:22:40  wkiri
- * Updated menu system.
- *
- * Revision 1.8  2000/10/29 21:23:28  weimer
- * One last round of header-file changes to reflect my newest and greatest
- * knowledge of autoconf/automake. Now if you fail to have some bizarro
- * function, we try to go on anyway unless it is vastly needed.
- *
- * Revision 1.7  2000/10/21 01:14:42  weimer
- * massic autoconf/automake restructure ...
- *
- * Revision 1.6  2000/10/18 23:57:49  weimer
- * general fixup, color changes, display changes.
- * Notable: "Safe" Blits and Updates now perform "clipping". No more X errors,
- * we hope!
- *
- * Revision 1.5  2000/09/04 22:49:51  wkiri
- * gamemenu now uses the new nifty menus.  Also, added delete_menu.
- *
- * Revision 1.4  2000/09/04 19:48:02  weimer
- * interim menu for choosing among game styles, button changes (two states)
- *
- * Revision 1.3  2000/09/03 18:26:10  weimer
- * major header file and automatic prototype generation changes, restructuring
- *
- * Revision 1.2  2000/08/26 03:11:34  wkiri
- * Buttons now use borders.
- *
- * Revision 1.1  2000/08/26 02:45:28  wkiri
- * Beginnings of button class; also modified atris to query for 'new
- * game' vs. 'quit'.  (New Game doesn't work yet...)
- *
- */
-
-
-
-struct layout_struct {
-    /* the whole board layout */
-    SDL_Rect grid_border[2];
-    SDL_Rect grid[2];
-
-    SDL_Rect score[2];
-
-    SDL_Rect name[2];
-
-    struct adjust_struct {
-	SDL_Rect symbol[3];
-    } adjust[2];
-
-    SDL_Rect time;
-    SDL_Rect time_border;
-
-    SDL_Rect next_piece_border[2];
-    SDL_Rect next_piece[2];
-
-    SDL_Rect 	  pause;
-} layout;
-
-/* The background image, global so we can do updates */
-SDL_Surface *adjust_symbol[3] = { NULL, NULL, NULL };
-/* Rectangles that specify where my/their pieces can legally be */
-
-int Score[2];
+    FILE *fin = fopen(filespec, "rb");
+    char magic[8];
+    int head[2], F, ok;
+    AI_Model *m;
 
-/***************************************************************************
- *      poll_and_flame()
- * Poll for events and run the flaming background.
- *********************************************************************PROTO*/
-void
-poll_and_flame(SDL_Event *ev)
-{
-    while (!(SDL_PollEvent(ev))) {
-	atris_run_flame();
+    if (!fin) {
+	Debug("Cannot read AI model [%s]\n", filespec);
+	return NULL;
     }
-    return;
+    if (fread(magic, 1, 8, fin) != 8 || memcmp(magic, AI_MODEL_MAGIC, 8) ||
+	    fread(head, sizeof(int), 2, fin) != 2 ||
+	    head[0] <= AI_MODEL_EXTRA || head[0] > AI_MODEL_MAX_FEATURES ||
+	    head[1] < 0 || head[1] > AI_MODEL_MAX_HIDDEN) {
+	Debug("[%s] is not an AI model.\n", filespec);
+	fclose(fin);
+	return NULL;
+    }
+    Calloc(m, AI_Model *, sizeof(AI_Model));
+    F = m->features = head[0];
+    m->hidden = head[1];
+    ok = ai_model_read(fin, &m->mean, F) && ai_model_read(fin, &m->scale, F);
+    if (m->hidden == 0)
+	ok = ok && ai_model_read(fin, &m->w1, F);
+    else 
+	ok = ok && ai_model_read(fin, &m->w1, m->hidden * F) &&
+	    ai_model_read(fin, &m->b1, m->hidden) &&
+	    ai_model_read(fin, &m->w2, m->hidden);
+    ok = ok && fread(&m->b2, sizeof(float), 1, fin) == 1;
+    fclose(fin);
+    if (!ok) {
+	Debug("AI model [%s] is cut short.\n", filespec);
+	ai_free_model(m);
+	return NULL;
+    }
+    Debug("AI model [%s] loaded (%d features, %d hidden).\n", filespec,
+	    m->features, m->hidden);
+    return m;
 }
 
 /***************************************************************************
- *      clear_screen_to_flame()
- * Clears the screen so that only the flame layer is visible.
+ *      ai_set_model()
+ * The learned evaluator goes by m from now on (NULL for the built-in
+ * one). Call it before any AI starts thinking; the old model is not
+ * freed.
  *********************************************************************PROTO*/
 void
-clear_screen_to_flame(void)
+ai_set_model(AI_Model *m)
 {
-    SDL_Rect all;
-
-    all.x = all.y = 0;
-    all.w = screen->w;
-    all.h = screen->h;
-
-    SDL_FillRect(widget_layer, &all, int_black);
-    SDL_FillRect(screen, &all, int_black);
-    SDL_BlitSafe(flame_layer, NULL, screen, NULL);
-    SDL_UpdateSafe(screen, 1, &all);
+    ai_model = m;
 }
 
 /***************************************************************************
- *      setup_colors()
- * Sets up our favorite colors.
+ *      ai_batch_learned()
+ * The learned evaluator (see AI_Model) for every board in the batch,
+ * MASK_LANES at a time. Placements that did not fit get AI_BATCH_INVALID.
  *********************************************************************PROTO*/
 void
-setup_colors(SDL_Surface *screen)
+ai_batch_learned(AI_Batch *b, double *scores)
 {
-    int i = 0;
+    int W = b->w, H = b->h, F = W + AI_MODEL_EXTRA;
+    const AI_Model *m = ai_model;
+    AI_Model builtin;
+    float mean[AI_MODEL_MAX_FEATURES], scale[AI_MODEL_MAX_FEATURES];
+    float wt[AI_MODEL_MAX_FEATURES];
+    int i, j, k, x, y;
 
-    color_white.r = color_white.g = color_white.b = 0xFF;
-    color_white.unused = 0;
+    if (m == NULL || m->features != F) {
+	ai_model_builtin(&builtin, W, mean, scale, wt);
+	m = &builtin;
+    }
 
-    color_black.r = color_black.g = color_black.b = color_black.unused = 0;
+    ai_counters.evals += b->n;
+    for (i=0; i<b->n; i+=MASK_LANES) {
+	Lane_Int height[32], holes = { 0 }, same = { 0 }, garbage = { 0 };
+	Lane_Int bump = { 0 }, tallest = { 0 }, wells = { 0 }, lines;
+	Lane_Int edge = (Lane_Int) { 0 } + H;
+	Lane_Mask seen = { 0 };
+	Lane_Float f[AI_MODEL_MAX_FEATURES], out;
 
-    color_red.r = 0xFF; color_red.g = color_red.b = color_red.unused = 0;
+	/* 
+	 * A column is as tall as the number of rows at or below its top
+	 * block, so the heights fall out of a running "seen" mask.
+	 */
+	memset(height, 0, sizeof(height));
+	for (y=0; y<H; y++) {
+	    Lane_Mask occ = batch_lanes(b, b->occupied, y, i);
+	    seen |= occ;
+	    holes += lane_popcount(seen & ~occ);
+	    garbage += lane_popcount(batch_lanes(b, b->garbage, y, i));
+	    same += lane_popcount(batch_lanes(b, b->same_left, y, i));
+	    for (x=0; x<W; x++)
+		height[x] += (Lane_Int) ((seen >> x) & 1);
+	}
+	for (x=0; x<W; x++) {
+	    Lane_Int left = x > 0 ? height[x-1] : edge;
+	    Lane_Int right = x < W-1 ? height[x+1] : edge;
+	    Lane_Int zero = { 0 };
+
+	    tallest = lane_max(tallest, height[x]);
+	    wells += lane_max(lane_min(left, right) - height[x], zero);
+	    if (x < W-1)
+		bump += lane_max(height[x] - right, right - height[x]);
+	    f[x] = lane_float(height[x]);
+	}
+	memcpy(&lines, &b->lines[i], sizeof(lines));
+	f[W] = lane_float(holes);
+	f[W+1] = lane_float(bump);
+	f[W+2] = lane_float(tallest);
+	f[W+3] = lane_float(wells);
+	f[W+4] = lane_float(same);
+	f[W+5] = lane_float(garbage);
+	f[W+6] = lane_float(lane_max(lines, (Lane_Int) { 0 }));
+
+	for (k=0; k<F; k++)
+	    f[k] = (f[k] - m->mean[k]) * m->scale[k];
+
+	out = (Lane_Float) { 0 } + m->b2;
+	if (m->hidden == 0) 
+	    for (k=0; k<F; k++)
+		out += m->w1[k] * f[k];
+	else for (j=0; j<m->hidden; j++) {
+	    const float *row = &m->w1[j * F];
+	    Lane_Float a = (Lane_Float) { 0 } + m->b1[j];
+
+	    for (k=0; k<F; k++)
+		a += row[k] * f[k];
+	    /* rectify: keep the lanes that are above zero */
+	    a = (Lane_Float) ((Lane_Int) a & (a > 0));
+	    out += m->w2[j] * a;
+	}
 
-    color_blue.b = 0xFF; color_blue.r = color_blue.g = color_blue.unused = 0;
+	for (j=0; j<MASK_LANES && i+j<b->n; j++)
+	    scores[i+j] = (b->lines[i+j] == -1) ? AI_BATCH_INVALID : out[j];
+    }
+}
 
-    color_purple.b = 128; color_purple.r = 128; color_purple.g = 64;
-	color_purple.unused = 0;
+/*******************************************************************
+ *   cogitate()
+ * Kiri's AI 'thinking' function.  Again, called once 'every so'
+ * by event_loop().  
+ *******************************************************************/
+static void 
+alizCogitate(void *state, Grid* g, play_piece* pp, play_piece* np, 
+	int col, int row, int rot)
+{
+  Aliz_State *as = (Aliz_State *)state;
+  double eval, evalLeft = -1, evalRight = -1;
+  int nLines;
 
-    int_black = SDL_MapRGB(screen->format, 0, 0, 0);
+  Assert(as);
+    
+  if (as->foundBest) return;
+  
+  memcpy(as->kg.contents, g->contents, (g->w * g->h * sizeof(as->kg.contents[0])));
+  memcpy(as->kg.fall, g->fall, (g->w * g->h * sizeof(*as->kg.fall)));
 
-    /* find the darkest black that is different from "all black" */
-    do {
-	i++;
-	int_solid_black = SDL_MapRGB(screen->format, i, i, i);
-    } while (int_black == int_solid_black && i < 255);
-    /* couldn't find one?! */
-    if (i == 255) {
-	Debug("*** Warning: transparency is compromised by RGB format.\n");
-	int_solid_black = SDL_MapRGB(screen->format, 1, 1, 1);
-    } else if (i != 1)
-	Debug("*** Note: First non-black color found at magnitude %d.\n",i);
+  if (as->bestEval == -1) {
+    /* It's our first think! */
+    as->checkColumn = col; /* check this column first */
+    as->checkRotation = 0; /* check no rotation (it's easy!) */
+    as->checkSides = 0; /* middle */
+  }
+  else {
+    /* Try the next thing */
+    as->checkRotation = (as->checkRotation+1)%4;
+    if (as->checkRotation == 0) {
+      /* Try a new column */
+      /* Go all the way left first */
+      if (as->checkColumn == col || as->checkColumn < col) {
+	as->checkColumn--;
+	if (!valid_position(pp, as->checkColumn, row,
+			    as->checkRotation, &as->kg)) {
+	  as->checkColumn = col + 1;
+	  if (!valid_position(pp, as->checkColumn, row,
+			      as->checkRotation, &as->kg)) {
+	    /* skip this one */
+	    return;
+	  }
+	}
+      }
+      else {
+	/* Now go all the way to the right */
+	as->checkColumn++;
+	if (!valid_position(pp, as->checkColumn, row,
+			    as->checkRotation, &as->kg)) {
+	  /* skip this one */
+	  return;
+	}
+      }
+    } else if (!valid_position(pp, as->checkColumn, row,
+			       as->checkRotation, &as->kg)) {
+      /* as->checkRotation != 0 */
+      if (as->checkColumn >= g->w && as->checkRotation == 3) {
+	/* final one */
+	as->foundBest = TRUE;
+#ifdef DEBUG
+	printf("Aliz: Found best! (last checked %d, %d)\n",
+	       as->checkColumn, as->checkRotation);
+#endif
+	return;
+      }
+      /* Trying a specific rotation; skip this one */
+      else return;
+    }
+  }
+#ifdef DEBUG
+  printf("Aliz: trying (col %d, rot %d) ", as->checkColumn, as->checkRotation);
+#endif
 
-    int_white = SDL_MapRGB(screen->format, 255, 255, 255);
-    int_grey  = SDL_MapRGB(screen->format, 128, 128, 128);
-    int_blue  = SDL_MapRGB(screen->format, 0, 0, 255);
-    int_med_blue = SDL_MapRGB(screen->format, 0, 0, 0);
-    int_dark_blue  = SDL_MapRGB(screen->format, 0, 0, 128);
-    int_purple  = SDL_MapRGB(screen->format, 128, 64, 128);
-    int_dark_purple  = SDL_MapRGB(screen->format, 64, 32, 64);
+  /* Check for impending doom */
+  if (GRID_CONTENT(*g, col, row+1)) {
+#ifdef DEBUG
+    printf("Aliz: panic! about to crash, ");
+#endif
+   
+    /* something right below us, so move the direction with more space */
+    if (col > g->w - col) {
+      /* go left, leave rotation as is */
+      as->goalColumn = col/2;
+      /* wessy commentary: you might want to set goalRotation to the
+       * current rotation so that your next move (the panic flight) will
+       * be a motion, not a rotation) ...
+       */
+      as->goalRotation = as->checkRotation;
+#ifdef DEBUG
+      printf("moving left.\n");
+#endif
+    }
+    else {
+      /* go right, leave rotation as is */
+      as->goalColumn = col + (g->w - col)/2;
+      as->goalRotation = as->checkRotation;
+#ifdef DEBUG
+      printf("moving right.\n");
+#endif
+    }
+#ifdef DEBUG
+    printf(" NEW goal: col %d, rot %d\n", as->goalColumn, as->goalRotation);
+#endif
+    return;
+  }
+
+  /************** Test the current choice ****************/
+  ai_counters.candidates++;
+  nLines = drop_piece_on_grid(&as->kg, pp, as->checkColumn, row, 
+			      as->checkRotation);
+  if (nLines != -1) {	/* invalid place to drop something */
+    eval = evalBoard(&as->kg, nLines, row);
+#ifdef DEBUG
+    printf(": eval = %.3f", eval);
+#endif
+    if (as->bestEval == -1 || eval < as->bestEval) {
+      as->bestEval = eval;
+      as->goalColumn = as->checkColumn;
+      as->goalRotation = as->checkRotation;
+#ifdef DEBUG
+      printf(" **");
+#endif
+      
+      /* See if we should try to slide left */
+      if (as->checkColumn > 0 && !GRID_CONTENT(*g, as->checkColumn-1, row)) {
+	int y;
+	for (y=row; y>=0; y--)
+	  /* worth trying if there's something above it */
+	  if (GRID_CONTENT(*g, as->checkColumn-1, y)) break;
+	if (y >= 0 && valid_position(pp, as->checkColumn-1, row,
+				     as->checkRotation, &as->kg)) {
+	  printf("Aliz: Trying to slip left.\n");
+	  /* get a fresh copy */
+	  memcpy(as->kg.contents, g->contents, (g->w * g->h * sizeof(as->kg.contents[0])));
+	  memcpy(as->kg.fall, g->fall, (g->w * g->h * sizeof(*as->kg.fall)));
+	  paste_on_board(pp, as->checkColumn-1, row,
+			 as->checkRotation, &as->kg);
+	  /* nLines is the same */
+	  evalLeft = evalBoard(&as->kg, nLines, row);
+	}
+      }
+
+      /* See if we should try to slide left */
+      if (as->checkColumn < g->w-1 && !GRID_CONTENT(*g, as->checkColumn+1, row)) {
+	int y;
+	for (y=row; y>=0; y--)
+	  /* worth trying if there's something above it */
+	  if (GRID_CONTENT(*g, as->checkColumn+1, y)) break;
+	if (y >= 0 && valid_position(pp, as->checkColumn+1, row,
+				     as->checkRotation, &as->kg)) {
+	  printf("Aliz: Trying to slip right.\n");
+	  /* get a fresh copy */
+	  memcpy(as->kg.contents, g->contents, (g->w * g->h * sizeof(as->kg.contents[0])));
+	  memcpy(as->kg.fall, g->fall, (g->w * g->h * sizeof(*as->kg.fall)));
+	  paste_on_board(pp, as->checkColumn+1, row,
+			 as->checkRotation, &as->kg);
+	  /* nLines is the same */
+	  evalRight = evalBoard(&as->kg, nLines, row);
+	}
+      }
+
+      if (evalLeft >= 0 && evalLeft < as->bestEval && evalLeft <= evalRight) {
+	as->goalColumn = as->checkColumn;
+	as->goalSides = -1;
+	printf(": eval = %.3f left **", eval);
+      } else if (evalRight >= 0 && evalRight < as->bestEval && evalRight < evalLeft) {
+	as->goalColumn = as->checkColumn;
+	as->goalSides = 1;
+	printf(": eval = %.3f right **", eval);
+      }
+      else {
+#ifdef DEBUG
+	printf(": eval = %.3f", eval);
+#endif
+	if (as->bestEval == -1 || eval < as->bestEval) {
+	  as->bestEval = eval;
+	  as->goalColumn = as->checkColumn;
+	  as->goalRotation = as->checkRotation;
+	  as->goalSides = as->checkSides;
+	}
+      }
+    }
+#ifdef DEBUG
+    printf("\n");
+#endif
+  }
+    
 }
 
-/***************************************************************************
- *      draw_string()
- * Draws the given string at the given location using the default font.
- *********************************************************************PROTO*/
-#define	DRAW_CENTER	(1<<0)
-#define	DRAW_ABOVE	(1<<1)
-#define DRAW_LEFT	(1<<2)
-#define DRAW_UPDATE	(1<<3)
-#define DRAW_CLEAR	(1<<4)
-#define DRAW_HUGE	(1<<5)
-#define DRAW_LARGE	(1<<6)
-#define DRAW_GRID_0	(1<<7)
-int
-draw_string(char *text, SDL_Color sc, int x, int y, int flags)
+/*******************************************************************
+ *   alizReset()
+ * Clear all of Kiri's globals.
+ *********************************************************************/
+static void *
+alizReset(void *state, Grid *g)
 {
-    SDL_Surface * text_surface;
-    SDL_Rect r;
+    Aliz_State *as;
 
-    if (flags & DRAW_GRID_0) {
-	r.x = layout.grid[0].x + layout.grid[0].w / 2;
-	r.y = layout.grid[0].y + layout.grid[0].h / 2;
-    } else {
-	r.x = x;
-	r.y = y;
-    }
+    if (state == NULL) {
+	/* first time we have been called (this game) */
+	Calloc(as, Aliz_State *,sizeof(Aliz_State));
+    } else
+	as = (Aliz_State *)state;
+    Assert(as);
 
-    if (flags & DRAW_HUGE) {
-	text_surface = TTF_RenderText_Blended(hfont, text, sc); Assert(text_surface);
-    } else if (flags & DRAW_LARGE) {
-	text_surface = TTF_RenderText_Blended(lfont, text, sc); Assert(text_surface);
-    } else {
-	text_surface = TTF_RenderText_Blended(font, text, sc); Assert(text_surface);
-    }
+#ifdef DEBUG
+    printf("Aliz: Clearing state.\n");
+#endif
+    as->bestEval = -1;
+    as->foundBest = FALSE;
+    if (as->kg.contents == NULL) as->kg = generate_board(g->w, g->h, 0);
+    return as;
+}
+
+/*******************************************************************
+ *   alizRelease()
+ * Kiri's AI 'release' function.
+ *******************************************************************/
+static void
+alizRelease(void *state)
+{
+  Aliz_State *as = (Aliz_State *)state;
+
+  if (as->kg.contents) free_board(&as->kg);
+  free(as);
+}
+
+/*******************************************************************
+ *   alizEvaluate()
+ * Kiri's AI 'evaluate' function: evalBoard() for a whole batch.
+ *******************************************************************/
+static void
+alizEvaluate(void *state, AI_Batch *b, double *scores)
+{
+  ai_batch_eval(b, scores);
+}
+
+/*******************************************************************
+ *   alizTarget()
+ * Kiri's AI 'target' function: where the piece should end up once
+ * we have found the best spot, slips included. A slip drops the piece
+ * in the goal column and then slides it one column over at the
+ * bottom, tucking it under whatever hangs over that column.
+ *******************************************************************/
+static int
+alizTarget(void *state, Grid* g, play_piece* pp, int row, AI_Placement *goal)
+{
+  Aliz_State *as = (Aliz_State *)state;
+  int land = row;
+  Assert(as);
+
+  goal->col = as->goalColumn;
+  goal->rot = as->goalRotation;
+  goal->row = -1;
+  if (!as->foundBest) return 0;
+  if (as->goalSides == 0 || 
+      !valid_position(pp, goal->col, row, goal->rot, g)) return 1;
+
+  while (valid_position(pp, goal->col, land+1, goal->rot, g)) land++;
+  if (valid_position(pp, goal->col + as->goalSides, land, goal->rot, g)) {
+    goal->col += as->goalSides;
+    while (valid_position(pp, goal->col, land+1, goal->rot, g)) land++;
+    goal->row = land;
+  }
+  return 1;
+}
+
+/*******************************************************************
+ *   alizMove()
+ * Kiri's AI 'move' function.  Possible retvals:
+ * 	MOVE_NONE	Do nothing, fall normally.
+ * 	MOVE_LEFT	[Try to] Move one column to the left.
+ * 	MOVE_RIGHT	[Try to] Move one column to the right.
+ * 	MOVE_ROTATE	[Try to] Rotate the piece.
+ * 	MOVE_DOWN	Fall down really quickly.
+ *********************************************************************/
+static Command 
+alizMove(void *state, Grid* g, play_piece* pp, play_piece* np, int col, int row, int rot)
+{
+    Aliz_State *as = (Aliz_State *)state;
+    Assert(as);
+  if (rot == as->goalRotation) {
+    if (col == as->goalColumn) {
+      if (as->foundBest) {
+	if (GRID_CONTENT(*g, col, row+1)) {
+	  if (as->goalSides == -1) return MOVE_LEFT;
+	  else if (as->goalSides == 1) return MOVE_RIGHT;
+	}
+	return MOVE_DOWN;
+      }
+      else return MOVE_NONE;
+    } else if (col < as->goalColumn) return MOVE_RIGHT;
+    else return MOVE_LEFT;
+  } else return MOVE_ROTATE;
+
+  
+}
+
+/***************************************************************************
+ * The Gambler: Double-Think's two-piece search, with the boards it likes
+ * best played out a few more pieces into the future. Those extra pieces
+ * are drawn from the same distribution generate_piece() deals from
+ * (specials included), and each candidate's rollouts are averaged. All
+ * of the dropping happens on the simulation pool, so think() only starts
+ * batches and checks on them.
+ ***************************************************************************/
+#define MONTE_KEEP	4	/* candidates that get rollouts */
+#define MONTE_DEPTH	2	/* random pieces per rollout */
+#define MONTE_LOST	(1<<24)	/* weight of a rollout that topped out */
+
+typedef enum {
+    MONTE_IDLE,		/* nothing started yet */
+    MONTE_PLACING,	/* two-piece search running */
+    MONTE_ROLLING,	/* rollouts running */
+} Monte_Stage;
+
+typedef struct monte_struct {
+    int know_what_to_do;
+    int desired_col;
+    int desired_rot;
+
+    Monte_Stage stage;
+    Sim_Batch batch;
+    volatile int cancel;	/* reset() arrived mid-batch */
+
+    /* what we are thinking about, copied for the pool */
+    Grid g;
+    play_piece pp;
+    play_piece np;
+    int row;
+    piece_style *ps;
+    color_style *cs;
+    int rollouts;
+    Uint32 seed;	/* common to every candidate of one choice */
+
+    /* one per placement of pp */
+    int nplace;
+    int *weight;	/* after pp and the best np, or -1 if pp won't fit */
+    Grid *after;	/* the board that weight is for */
+    int *order;
+    int kept;
+
+    int *outcome;	/* kept * rollouts */
+} Monte_State;
+
+/***************************************************************************
+ *      monte_greedy()
+ * Drops pp wherever it leaves "from" lightest, leaving that board in "to".
+ * Returns its weight or -1 if pp does not fit anywhere. All of the
+ * placements are weighed in one batch.
+ ***************************************************************************/
+static int
+monte_greedy(Grid *from, Grid *to, play_piece *pp, int row)
+{
+    static __thread AI_Batch *b = NULL;
+    static __thread int *w = NULL;
+    int i, n, best = -1;
+
+    if (b == NULL || b->w != from->w || b->h != from->h) {
+	b = ai_batch_new(from, 4 * (from->w - WES_MIN_COL));
+	Realloc(w, int *, b->max * sizeof(int));
+    }
+    n = ai_batch_all(b, from, pp, row);
+    ai_batch_weigh(b, w);
+    for (i=0; i<n; i++) 
+	if (w[i] != AI_BATCH_INVALID && (best == -1 || w[i] < w[best]))
+	    best = i;
+    if (best == -1)
+	return -1;
+    sim_copy_grid(to, from);
+    drop_piece_on_grid(to, pp, b->place[best].col, row, b->place[best].rot);
+    return w[best];
+}
+
+/***************************************************************************
+ *      monte_place_job()
+ * Pool job: placement i of pp, followed by the best placement of np.
+ ***************************************************************************/
+static void
+monte_place_job(void *arg, int i)
+{
+    Monte_State *ms = (Monte_State *)arg;
+    int ncols = ms->g.w - WES_MIN_COL;
+    Grid *a = sim_scratch(0, ms->g.w, ms->g.h);
+    int w;
+
+    ms->weight[i] = -1;
+    if (ms->cancel) 
+	return;
+    ai_counters.candidates++;
+    sim_copy_grid(a, &ms->g);
+    if (drop_piece_on_grid(a, &ms->pp, WES_MIN_COL + i % ncols, ms->row,
+		i / ncols) == -1)
+	return;
+    sim_copy_grid(&ms->after[i], a);
+    if ((w = weight_board(a)) <= 0) {
+	ms->weight[i] = 0;	/* you'll win! */
+	return;
+    }
+    w = monte_greedy(a, &ms->after[i], &ms->np, ms->row);
+    ms->weight[i] = (w == -1) ? MONTE_LOST : 1 + w;
+}
+
+/***************************************************************************
+ *      monte_roll_job()
+ * Pool job: one rollout from one of the kept candidates.
+ ***************************************************************************/
+static void
+monte_roll_job(void *arg, int j)
+{
+    Monte_State *ms = (Monte_State *)arg;
+    int c = ms->order[j / ms->rollouts];
+    Uint32 seed = ms->seed + 7919 * (j % ms->rollouts);
+    Grid *cur = sim_scratch(2, ms->g.w, ms->g.h);
+    Grid *next = sim_scratch(3, ms->g.w, ms->g.h);
+    int d, w = ms->weight[c];
+
+    if (ms->cancel) 
+	return;
+    sim_copy_grid(cur, &ms->after[c]);
+    for (d=0; d<MONTE_DEPTH && w > 0 && w < MONTE_LOST; d++) {
+	play_piece pp = generate_piece_r(ms->ps, ms->cs, &seed);
+	Grid *t;
+
+	w = monte_greedy(cur, next, &pp, 0);
+	if (w == -1)
+	    w = MONTE_LOST;
+	t = cur; cur = next; next = t;
+    }
+    ms->outcome[j] = w;
+}
+
+/***************************************************************************
+ *      weight_evaluate()
+ * AI_Player evaluate() for the AIs that go by weight_board().
+ ***************************************************************************/
+static void
+weight_evaluate(void *state, AI_Batch *b, double *scores)
+{
+    int w[b->max];
+    int i;
+
+    ai_batch_weigh(b, w);
+    for (i=0; i<b->n; i++)
+	scores[i] = w[i];
+}
+
+/***************************************************************************
+ *      monte_ai_reset()
+ ***************************************************************************/
+static void *
+monte_ai_reset(void *state, Grid *g)
+{
+    Monte_State *retval;
+    int i;
+
+    if (state == NULL) {
+	Calloc(retval, Monte_State *, sizeof(Monte_State));
+	retval->g = generate_board(g->w, g->h, 0);
+	retval->nplace = 4 * (g->w - WES_MIN_COL);
+	Calloc(retval->weight, int *, retval->nplace * sizeof(int));
+	Calloc(retval->order, int *, retval->nplace * sizeof(int));
+	Calloc(retval->after, Grid *, retval->nplace * sizeof(Grid));
+	for (i=0; i<retval->nplace; i++) 
+	    retval->after[i] = generate_board(g->w, g->h, 0);
+    } else
+	retval = state;
+    Assert(retval);
+
+    /* the pool may still be working on the last piece */
+    if (retval->stage != MONTE_IDLE) {
+	retval->cancel = 1;
+	sim_batch_wait(&retval->batch);
+	retval->cancel = 0;
+    }
+    retval->stage = MONTE_IDLE;
+    retval->know_what_to_do = 0;
+    retval->desired_col = g->w / 2;
+    retval->desired_rot = 0;
+    return retval;
+}
+
+/***************************************************************************
+ *      monte_ai_release()
+ ***************************************************************************/
+static void
+monte_ai_release(void *state)
+{
+    Monte_State *ms = (Monte_State *) state;
+    int i;
+
+    if (ms->stage != MONTE_IDLE) {
+	ms->cancel = 1;
+	sim_batch_wait(&ms->batch);
+    }
+    free_board(&ms->g);
+    for (i=0; i<ms->nplace; i++) 
+	free_board(&ms->after[i]);
+    Free(ms->after); Free(ms->weight); Free(ms->order); Free(ms->outcome);
+    free(ms);
+}
+
+/***************************************************************************
+ *      monte_ai_think()
+ ***************************************************************************/
+static void
+monte_ai_think(void *data, Grid *g, play_piece *pp, play_piece *np, 
+	int col, int row, int rot)
+{
+    Monte_State *ms = (Monte_State *)data;
+    int i, j;
+
+    Assert(ms);
+    if (ms->know_what_to_do)
+	return;
+
+    switch (ms->stage) {
+	case MONTE_IDLE:
+	    sim_copy_grid(&ms->g, g);
+	    ms->pp = *pp;
+	    ms->np = *np;
+	    ms->row = row;
+	    ms->rollouts = Options.ai_rollouts > 0 ? Options.ai_rollouts : 1;
+	    if (!sim_get_styles(&ms->ps, &ms->cs))
+		ms->rollouts = 0;	/* no idea what is coming */
+	    /* the same position always gets the same rollouts */
+	    ms->seed = 1;
+	    for (i=0; i<g->w * g->h; i++) 
+		ms->seed = ms->seed * 69069 + g->contents[i];
+	    for (i=1; i<=pp->base->num_color; i++) 
+		ms->seed = ms->seed * 69069 + pp->colormap[i];
+	    for (i=1; i<=np->base->num_color; i++) 
+		ms->seed = ms->seed * 69069 + np->colormap[i];
+	    ms->seed |= 1;
+	    ms->stage = MONTE_PLACING;
+	    sim_batch_start(&ms->batch, monte_place_job, ms, ms->nplace);
+	    return;
+
+	case MONTE_PLACING:
+	    if (!sim_batch_done(&ms->batch))
+		return;
+	    ms->kept = 0;
+	    for (i=0; i<ms->nplace; i++) {
+		if (ms->weight[i] == -1) 
+		    continue;
+		for (j=ms->kept; j>0 && ms->weight[ms->order[j-1]] > ms->weight[i]; j--)
+		    ms->order[j] = ms->order[j-1];
+		ms->order[j] = i;
+		ms->kept++;
+	    }
+	    if (ms->kept == 0) {
+		ms->know_what_to_do = 1;	/* nothing fits: good luck */
+		return;
+	    }
+	    ms->desired_col = WES_MIN_COL + ms->order[0] % (g->w - WES_MIN_COL);
+	    ms->desired_rot = ms->order[0] / (g->w - WES_MIN_COL);
+	    if (ms->weight[ms->order[0]] == 0 || ms->rollouts == 0) {
+		ms->know_what_to_do = 1;
+		return;
+	    }
+	    ms->kept = min(ms->kept, MONTE_KEEP);
+	    Realloc(ms->outcome, int *, ms->kept * ms->rollouts * sizeof(int));
+	    ms->stage = MONTE_ROLLING;
+	    sim_batch_start(&ms->batch, monte_roll_job, ms, 
+		    ms->kept * ms->rollouts);
+	    return;
+
+	case MONTE_ROLLING: {
+	    double best = 0;
+	    if (!sim_batch_done(&ms->batch))
+		return;
+	    for (i=0; i<ms->kept; i++) {
+		double sum = 0;
+		for (j=0; j<ms->rollouts; j++)
+		    sum += ms->outcome[i * ms->rollouts + j];
+		if (i == 0 || sum < best) {
+		    best = sum;
+		    ms->desired_col = WES_MIN_COL + 
+			ms->order[i] % (g->w - WES_MIN_COL);
+		    ms->desired_rot = ms->order[i] / (g->w - WES_MIN_COL);
+		}
+	    }
+	    ms->know_what_to_do = 1;
+	    return;
+	}
+    }
+}
+
+/***************************************************************************
+ *      monte_ai_move()
+ ***************************************************************************/
+static Command
+monte_ai_move(void *state, Grid *g, play_piece *pp, play_piece *np, 
+	int col, int row, int rot)
+{
+    Monte_State *ms = (Monte_State *) state;
+
+    if (rot != ms->desired_rot)
+	return MOVE_ROTATE;
+    else if (col > ms->desired_col) 
+	return MOVE_LEFT;
+    else if (col < ms->desired_col) 
+	return MOVE_RIGHT;
+    else if (ms->know_what_to_do) {
+	return MOVE_DOWN;
+    } else 
+	return MOVE_NONE;
+}
+
+/***************************************************************************
+ * Input planning. The planner works in the event loop's own units: the
+ * piece sits on a column and falls a pixel at a time, so y is measured
+ * in pixels from the top of the board and a row is blockWidth pixels
+ * tall. Moves are tried exactly the way event_loop() tries them,
+ * including the rotation kicks and the half-block slide for left and
+ * right.
+ ***************************************************************************/
+
+/* the row a pixel falls in, rounded like screen_to_grid_coords() */
+static int
+plan_row(int y, int bw)
+{
+    if (y < 0) y -= bw - 1;
+    return y / bw;
+}
+
+/* valid_screen_position() in board pixels */
+static int
+plan_valid(play_piece *pp, Grid *g, int bw, int col, int y, int rot)
+{
+    int row = plan_row(y, bw), row2 = plan_row(y + bw - 1, bw);
+
+    if (!valid_position(pp, col, row, rot, g))
+	return 0;
+    return (row == row2) || valid_position(pp, col, row2, rot, g);
+}
+
+/* where a valid piece comes to rest if nobody touches it */
+static int
+plan_land(play_piece *pp, Grid *g, int bw, int col, int y, int rot)
+{
+    int row = plan_row(y, bw);
+
+    while (valid_position(pp, col, row+1, rot, g))
+	row++;
+    return max(row * bw, y);
+}
+
+/* does this move work from (col,y,rot), and where does it leave us? */
+static int
+plan_move(play_piece *pp, Grid *g, int bw, Command m, int *col, int *y,
+	int *rot)
+{
+    int i, r = (*rot + 1) % 4;
+
+    switch (m) {
+	case MOVE_NONE:
+	    return 1;
+	case MOVE_ROTATE:
+	    if (plan_valid(pp, g, bw, *col, *y, r)) {
+		*rot = r; return 1;
+	    } else if (plan_valid(pp, g, bw, *col - 1, *y, r)) {
+		*rot = r; (*col)--; return 1;
+	    } else if (plan_valid(pp, g, bw, *col + 1, *y, r)) {
+		*rot = r; (*col)++; return 1;
+	    } else if (plan_valid(pp, g, bw, *col, *y + bw, r)) {
+		*rot = r; *y += bw; return 1;
+	    } else if (Options.upward_rotation &&
+		    plan_valid(pp, g, bw, *col, *y - bw, r)) {
+		*rot = r; *y -= bw; return 1;
+	    }
+	    return 0;
+	case MOVE_LEFT: 
+	case MOVE_RIGHT: {
+	    int to = *col + (m == MOVE_LEFT ? -1 : 1);
+	    for (i=0; i<10; i++) 
+		if (plan_valid(pp, g, bw, to, *y + i, *rot)) {
+		    *col = to; *y += i; return 1;
+		}
+	    return 0;
+	}
+	default:
+	    return 0;
+    }
+}
+
+/***************************************************************************
+ *      ai_plan()
+ * Finds the shortest sequence of inputs that brings pp from (col,y,rot)
+ * to rest at goal, given that it falls "fall" pixels between one input
+ * and the next. y is in pixels from the top of the board and bw is the
+ * height of a row. Tucks under overhangs and kicks off walls come out of
+ * the search on their own. Returns the number of inputs (also left in
+ * plan->n, which is capped at AI_PLAN_MAX) or -1 if goal cannot be
+ * reached.
+ *********************************************************************PROTO*/
+int
+ai_plan(Grid *g, play_piece *pp, int bw, int col, int y, int rot,
+	AI_Placement *goal, int fall, AI_Plan *plan)
+{
+    static __thread int *from = NULL, *queue = NULL;
+    static __thread int room = 0;
+    static const Command moves[4] = 
+	{ MOVE_ROTATE, MOVE_LEFT, MOVE_RIGHT, MOVE_NONE };
+    int ncols = g->w - WES_MIN_COL;
+    int ybase = min(y, 0) - 4 * bw;	/* the kicks can lift us this far */
+    int ny = g->h * bw - ybase + 1;
+    int states = ncols * 4 * ny;
+    int goal_y = -1;
+    int head = 0, tail = 0, found = -1, i, k, n;
+
+#define PLAN_INDEX(c,yy,r)	((((c) - WES_MIN_COL) * 4 + (r)) * ny + (yy) - ybase)
+
+    plan->n = 0;
+    if (col < WES_MIN_COL || col >= g->w || 
+	    !plan_valid(pp, g, bw, col, y, rot))
+	return -1;
+    if (goal->row >= 0) 
+	goal_y = goal->row * bw;
+    else if (plan_valid(pp, g, bw, goal->col, y, goal->rot))
+	goal_y = plan_land(pp, g, bw, goal->col, y, goal->rot);
+
+    if (states > room) {
+	Realloc(from, int *, states * sizeof(int));
+	Realloc(queue, int *, states * sizeof(int));
+	room = states;
+    }
+    /* from[s] is 1 + (the state we came from) * 4 + (the move), or 0 */
+    memset(from, 0, states * sizeof(int));
+
+    i = PLAN_INDEX(col, y, rot);
+    from[i] = -1;	/* the start */
+    queue[tail++] = i;
+
+    while (head < tail) {
+	int s = queue[head++];
+	int c = s / (4 * ny) + WES_MIN_COL;
+	int r = (s / ny) % 4;
+	int yy = s % ny + ybase;
+	int land = plan_land(pp, g, bw, c, yy, r);
+	int m;
+
+	if (c == goal->col && r == goal->rot && 
+		(goal_y < 0 || land == goal_y)) {
+	    found = s;
+	    break;
+	}
+	for (m=0; m<4; m++) {
+	    int c2 = c, y2 = yy, r2 = r, t;
+	    if (!plan_move(pp, g, bw, moves[m], &c2, &y2, &r2))
+		continue;
+	    if (c2 < WES_MIN_COL || c2 >= g->w || y2 < ybase)
+		continue;
+	    /* gravity until the next input */
+	    y2 = min(y2 + fall, plan_land(pp, g, bw, c2, y2, r2));
+	    t = PLAN_INDEX(c2, y2, r2);
+	    if (from[t]) 
+		continue;
+	    from[t] = 1 + s * 4 + m;
+	    queue[tail++] = t;
+	}
+    }
+    if (found < 0) 
+	return -1;
+
+    /* count the moves back to the start, then fill them in backwards */
+    n = 0;
+    for (i = found; from[i] != -1; i = (from[i] - 1) / 4) 
+	n++;
+    k = n;
+    for (i = found; from[i] != -1; i = (from[i] - 1) / 4) 
+	if (--k < AI_PLAN_MAX)
+	    plan->move[k] = moves[(from[i] - 1) % 4];
+    /* and then drop it, unless it is already sitting there */
+    if (found % ny + ybase != plan_land(pp, g, bw, goal->col, 
+		found % ny + ybase, goal->rot)) {
+	if (n < AI_PLAN_MAX) 
+	    plan->move[n] = MOVE_DOWN;
+	n++;
+    }
+    plan->n = min(n, AI_PLAN_MAX);
+#undef PLAN_INDEX
+    return n;
+}
+
+/***************************************************************************
+ *      ai_new_piece()
+ * Gets the AI ready for piece pp. played says where the last piece went,
+ * or is NULL if there was no last piece (a new game, say): an AI with a
+ * cont() hook may then carry its search over instead of starting again.
+ * Returns the new state.
+ *********************************************************************PROTO*/
+void *
+ai_new_piece(AI_Player *ai, void *state, Grid *g, play_piece *pp,
+	AI_Placement *played)
+{
+    ai_counters.decisions++;
+    if (ai->cont && state && played)
+	return ai->cont(state, g, pp, played);
+    return ai->reset(state, g);
+}
+
+/***************************************************************************
+ *      ai_counters_sum()
+ * Adds c to *into.
+ *********************************************************************PROTO*/
+void
+ai_counters_sum(AI_Counters *into, const AI_Counters *c)
+{
+    AI_Counters zero;
+
+    memset(&zero, 0, sizeof(zero));
+    counters_add(into, c, &zero);
+}
+
+/***************************************************************************
+ *      ai_counters_print()
+ * One line of a table of where the AIs spent their time, most of it per
+ * piece; name NULL prints the heading instead.
+ *********************************************************************PROTO*/
+void
+ai_counters_print(FILE *f, const char *name, const AI_Counters *c)
+{
+    double pieces = c && c->decisions ? c->decisions : 1.0;
+
+    if (name == NULL) {
+	fprintf(f, "%-16s %9s %9s %9s %9s %9s %9s %9s %9s\n", "AI",
+		"Cand/pc", "Drops/pc", "Grav/drop", "Evals/pc", "Thinks/pc",
+		"Settled%", "Overruns", "Ticks/pc");
+	return;
+    }
+    fprintf(f, "%-16.16s %9.1f %9.1f %9.3f %9.1f %9.1f %8.1f%% %9lu %9.1f\n",
+	    name, c->candidates / pieces, c->drops / pieces,
+	    c->drops ? (double) c->gravity / c->drops : 0.0,
+	    c->evals / pieces, c->thinks / pieces,
+	    c->thinks ? 100.0 * c->settled / c->thinks : 0.0,
+	    c->overruns, c->think_ticks / pieces);
+}
+
+/***************************************************************************
+ *      ai_think()
+ * Calls ai->think() and keeps the books on it: a call that tried no
+ * placements and scored no boards counts as "settled" (the AI had made
+ * up its mind, or was waiting on the pool), one that ran past
+ * AI_THINK_SLICE as an overrun. If c is not NULL the work done in the
+ * call is added to it as well. Returns 0 if the call was settled, so the
+ * caller need not offer the AI more time just yet.
+ *********************************************************************PROTO*/
+int
+ai_think(AI_Player *ai, AI_Counters *c, void *state, Grid *g, 
+	play_piece *cp, play_piece *np, int col, int row, int rot)
+{
+    AI_Counters mark = ai_counters;
+    Uint32 start = sim_peek_ticks(), took;
+    int busy = 0;
+
+    ai->think(state, g, cp, np, col, row, rot);
+
+    took = sim_peek_ticks() - start;
+    ai_counters.thinks++;
+    ai_counters.think_ticks += took;
+    if (took > AI_THINK_SLICE)
+	ai_counters.overruns++;
+    if (ai_counters.candidates == mark.candidates &&
+	    ai_counters.evals == mark.evals &&
+	    ai_counters.drops == mark.drops)
+	ai_counters.settled++;
+    else
+	busy = 1;
+    if (c)
+	ai_counters_add(c, &mark);
+    return busy;
+}
+
+/***************************************************************************
+ *      ai_spawn()
+ * Where a new piece comes onto the board: the middle column, as high as
+ * it fits and in the first rotation that does, the way the event loop
+ * places it. y is in pixels from the top of the board. Returns 0 if the
+ * piece does not fit anywhere (the game is lost).
+ *********************************************************************PROTO*/
+int
+ai_spawn(Grid *g, play_piece *pp, int bw, int *col, int *y, int *rot)
+{
+    int Y, R;
+
+    *col = g->w / 2;
+    for (Y = 0; Y >= -2; Y--)
+	for (R = 0; R <= 3; R++) 
+	    if (plan_valid(pp, g, bw, *col, Y * bw, R)) {
+		*y = Y * bw;
+		*rot = R;
+		return 1;
+	    }
+    return 0;
+}
+
+/***************************************************************************
+ *      ai_step()
+ * Carries out one input the way the event loop would and then lets the
+ * piece fall "fall" pixels. Returns 1 once the piece is resting on
+ * something.
+ *********************************************************************PROTO*/
+int
+ai_step(Grid *g, play_piece *pp, int bw, Command m, int fall,
+	int *col, int *y, int *rot)
+{
+    int land;
+
+    if (m == MOVE_DOWN) 
+	fall = g->h * bw;
+    else 
+	plan_move(pp, g, bw, m, col, y, rot);
+    land = plan_land(pp, g, bw, *col, *y, *rot);
+    *y = min(*y + fall, land);
+    return *y == land;
+}
+
+/***************************************************************************
+ *      wes_ai_target()
+ ***************************************************************************/
+static int
+wes_ai_target(void *state, Grid *g, play_piece *pp, int row, 
+	AI_Placement *goal)
+{
+    Wessy_State *ws = (Wessy_State *) state;
+
+    goal->col = ws->desired_column;
+    goal->rot = ws->desired_rot;
+    goal->row = -1;
+    return ws->know_what_to_do;
+}
+
+/***************************************************************************
+ *      double_ai_target()
+ ***************************************************************************/
+static int
+double_ai_target(void *state, Grid *g, play_piece *pp, int row, 
+	AI_Placement *goal)
+{
+    Double_State *ds = (Double_State *) state;
+
+    goal->col = ds->desired_col;
+    goal->rot = ds->desired_rot;
+    goal->row = -1;
+    return ds->know_what_to_do;
+}
+
+/***************************************************************************
+ *      monte_ai_target()
+ ***************************************************************************/
+static int
+monte_ai_target(void *state, Grid *g, play_piece *pp, int row, 
+	AI_Placement *goal)
+{
+    Monte_State *ms = (Monte_State *) state;
+
+    goal->col = ms->desired_col;
+    goal->rot = ms->desired_rot;
+    goal->row = -1;
+    return ms->know_what_to_do;
+}
+
+/*
+ * Scholar goes by the learned evaluator, two pieces deep and leaving
+ * nothing out: every placement of the next piece after every placement
+ * of the current one. Each placement of the current piece (alpha) gets
+ * one batch of next-piece placements (beta), so think() does a batch
+ * at a time.
+ */
+typedef struct scholar_struct {
+    int know_what_to_do;
+    int desired_col;
+    int desired_rot;
+
+    int n;		/* alpha placements, or -1 before we try them */
+    int expanding;	/* the next one to look under */
+    int best;		/* alpha placement we like, or -1 */
+    double best_score;
+    AI_Batch *alpha;
+    AI_Batch *beta;
+    double *alpha_score;
+    double *beta_score;
+    Grid t;		/* the board under alpha placement "expanding" */
+} Scholar_State;
+
+/* how much worse an alpha placement the next piece cannot follow is */
+#define SCHOLAR_STUCK	1e6
+
+/***************************************************************************
+ *      scholar_ai_reset()
+ ***************************************************************************/
+static void *
+scholar_ai_reset(void *state, Grid *g)
+{
+    Scholar_State *ss = (Scholar_State *) state;
+
+    if (ss == NULL) {
+	int n = 4 * (g->w - WES_MIN_COL);
+	Calloc(ss, Scholar_State *, sizeof(Scholar_State));
+	ss->alpha = ai_batch_new(g, n);
+	ss->beta = ai_batch_new(g, n);
+	Calloc(ss->alpha_score, double *, ss->alpha->max * sizeof(double));
+	Calloc(ss->beta_score, double *, ss->beta->max * sizeof(double));
+	ss->t = generate_board(g->w, g->h, 0);
+    }
+    ss->know_what_to_do = 0;
+    ss->desired_col = g->w / 2;
+    ss->desired_rot = 0;
+    ss->n = -1;
+    return ss;
+}
+
+/***************************************************************************
+ *      scholar_ai_release()
+ ***************************************************************************/
+static void
+scholar_ai_release(void *state)
+{
+    Scholar_State *ss = (Scholar_State *) state;
+
+    ai_batch_free(ss->alpha);
+    ai_batch_free(ss->beta);
+    Free(ss->alpha_score); Free(ss->beta_score);
+    free_board(&ss->t);
+    free(ss);
+}
+
+/***************************************************************************
+ *      scholar_ai_think()
+ * The alpha placement whose best beta follow-up scores lowest wins; one
+ * with no follow-up at all only wins if nothing else fits.
+ ***************************************************************************/
+static void
+scholar_ai_think(void *data, Grid *g, play_piece *pp, play_piece *np, 
+	int col, int row, int rot)
+{
+    Scholar_State *ss = (Scholar_State *) data;
+    Uint32 incoming_time = sim_ticks();
+
+    Assert(ss);
+    if (ss->know_what_to_do)
+	return;
+
+    if (ss->n < 0) {
+	ss->n = ai_batch_all(ss->alpha, g, pp, row);
+	ai_batch_learned(ss->alpha, ss->alpha_score);
+	ss->expanding = 0;
+	ss->best = -1;
+	ss->best_score = 0.0;
+    }
+
+    do {
+	int a, i, nb;
+	double score;
+
+	if (ss->expanding == ss->n) {
+	    if (ss->best >= 0) {
+		ss->desired_col = ss->alpha->place[ss->best].col;
+		ss->desired_rot = ss->alpha->place[ss->best].rot;
+	    } else {
+		ss->desired_col = col;
+		ss->desired_rot = rot;
+	    }
+	    ss->know_what_to_do = 1;
+	    return;
+	}
+	a = ss->expanding++;
+	if (ss->alpha->lines[a] == -1)
+	    continue;
+
+	score = ss->alpha_score[a] + SCHOLAR_STUCK;
+	if (np) {
+	    AI_Placement *p = &ss->alpha->place[a];
+
+	    sim_copy_grid(&ss->t, g);
+	    drop_piece_on_grid(&ss->t, pp, p->col, p->row, p->rot);
+	    /* the next piece comes in at the top */
+	    nb = ai_batch_all(ss->beta, &ss->t, np, 0);
+	    ai_batch_learned(ss->beta, ss->beta_score);
+	    for (i=0; i<nb; i++)
+		if (ss->beta->lines[i] != -1 && ss->beta_score[i] < score)
+		    score = ss->beta_score[i];
+	} else
+	    score = ss->alpha_score[a];
+
+	if (ss->best < 0 || score < ss->best_score) {
+	    ss->best = a;
+	    ss->best_score = score;
+	}
+    } while (sim_ticks() == incoming_time);
+}
+
+/***************************************************************************
+ *      scholar_ai_move()
+ ***************************************************************************/
+static Command
+scholar_ai_move(void *state, Grid *g, play_piece *pp, play_piece *np, 
+	int col, int row, int rot)
+{
+    Scholar_State *ss = (Scholar_State *) state;
+
+    if (rot != ss->desired_rot)
+	return MOVE_ROTATE;
+    else if (col > ss->desired_col) 
+	return MOVE_LEFT;
+    else if (col < ss->desired_col) 
+	return MOVE_RIGHT;
+    else if (ss->know_what_to_do) 
+	return MOVE_DOWN;
+    else 
+	return MOVE_NONE;
+}
+
+/***************************************************************************
+ *      scholar_ai_target()
+ ***************************************************************************/
+static int
+scholar_ai_target(void *state, Grid *g, play_piece *pp, int row, 
+	AI_Placement *goal)
+{
+    Scholar_State *ss = (Scholar_State *) state;
+
+    goal->col = ss->desired_col;
+    goal->rot = ss->desired_rot;
+    goal->row = -1;
+    return ss->know_what_to_do;
+}
+
+/***************************************************************************
+ *      scholar_evaluate()
+ ***************************************************************************/
+static void
+scholar_evaluate(void *state, AI_Batch *b, double *scores)
+{
+    ai_batch_learned(b, scores);
+}
+
+/*************************************************************************
+ *   AI_Players_Setup()
+ * This function creates a structure describing all of the available AI
+ * players.
+ *******************************************************************PROTO*/
+AI_Players *
+AI_Players_Setup(void)
+{
+    int i;
+    AI_Players *retval;
+
+    Calloc(retval, AI_Players *, sizeof(AI_Players));
+
+    retval->n = 6;	/* change this to add another */
+    Calloc(retval->player, AI_Player *, sizeof(AI_Player) * retval->n);
+    i = 0;
+
+    retval->player[i].name 	= "Simple Robot";
+    retval->player[i].msg	= "An introductory opponent.";
+    retval->player[i].move 	= wes_ai_move;
+    retval->player[i].think 	= beginner_ai_think;
+    retval->player[i].reset	= wes_ai_reset;
+    retval->player[i].evaluate	= weight_evaluate;
+    retval->player[i].target	= wes_ai_target;
+    retval->player[i].release	= wes_ai_release;
+    i++;
+
+    retval->player[i].name 	= "Lightning";
+    retval->player[i].msg	= "Warp-speed heuristics.";
+    retval->player[i].move 	= wes_ai_move;
+    retval->player[i].think 	= wes_ai_think;
+    retval->player[i].reset	= wes_ai_reset;
+    retval->player[i].evaluate	= weight_evaluate;
+    retval->player[i].target	= wes_ai_target;
+    retval->player[i].release	= wes_ai_release;
+    i++;
+
+    retval->player[i].name	= "Aliz";
+    retval->player[i].msg	= "Kiri's codified wit and wisdom.";
+    retval->player[i].move 	= alizMove;
+    retval->player[i].think 	= alizCogitate;
+    retval->player[i].reset	= alizReset;
+    retval->player[i].evaluate	= alizEvaluate;
+    retval->player[i].target	= alizTarget;
+    retval->player[i].release	= alizRelease;
+    i++;
+
+    retval->player[i].name	= "Double-Think";
+    retval->player[i].msg	= "Brilliant but slow.";
+    retval->player[i].move 	= double_ai_move;
+    retval->player[i].think 	= double_ai_think;
+    retval->player[i].reset	= double_ai_reset;
+    retval->player[i].evaluate	= weight_evaluate;
+    retval->player[i].target	= double_ai_target;
+    retval->player[i].release	= double_ai_release;
+    retval->player[i].cont	= double_ai_cont;
+    i++;
+
+    retval->player[i].name	= "Gambler";
+    retval->player[i].msg	= "Plays the odds on every piece.";
+    retval->player[i].move 	= monte_ai_move;
+    retval->player[i].think 	= monte_ai_think;
+    retval->player[i].reset	= monte_ai_reset;
+    retval->player[i].evaluate	= weight_evaluate;
+    retval->player[i].target	= monte_ai_target;
+    retval->player[i].release	= monte_ai_release;
+    i++;
+
+    retval->player[i].name	= "Scholar";
+    retval->player[i].msg	= "Learned it all from a book.";
+    retval->player[i].move 	= scholar_ai_move;
+    retval->player[i].think 	= scholar_ai_think;
+    retval->player[i].reset	= scholar_ai_reset;
+    retval->player[i].evaluate	= scholar_evaluate;
+    retval->player[i].target	= scholar_ai_target;
+    retval->player[i].release	= scholar_ai_release;
+    i++;
+
+    plugin_load_all(retval);
+    
+    Debug("AI Players Initialized (%d AIs).\n",retval->n);
+
+    return retval;
+}
+
+/***************************************************************************
+ *      pick_key_repeat()
+ * Ask the player to select a keyboard repeat rate. 
+ *********************************************************************PROTO*/
+int
+pick_key_repeat(SDL_Surface * screen) 
+{
+    char *factor;
+    int retval;
+
+    clear_screen_to_flame();
+    draw_string("(1 = Slow Repeat, 16 = Default, 32 = Fastest)",
+	    color_purple, screen->w/2,
+	    screen->h/2, DRAW_UPDATE | DRAW_CENTER | DRAW_ABOVE);
+    draw_string("Keyboard repeat delay factor:", color_purple,
+	    screen->w/2, screen->h/2, DRAW_UPDATE | DRAW_LEFT);
+    factor = input_string(screen, screen->w/2, screen->h/2, 0);
+    retval = 0;
+    sscanf(factor,"%d",&retval);
+    free(factor);
+    if (retval < 1) retval = 1;
+    if (retval > 32) retval = 32;
+    clear_screen_to_flame();
+    return retval;
+}
+
+/***************************************************************************
+ *      pick_ai_factor()
+ * Asks the player to choose an AI delay factor.
+ *********************************************************************PROTO*/
+int
+pick_ai_factor(SDL_Surface * screen) 
+{
+    char *factor;
+    int retval;
+
+    clear_screen_to_flame();
+    draw_string("(1 = Impossible, 100 = Easy, 0 = Set Automatically)",
+	    color_purple, screen->w/2,
+	    screen->h/2, DRAW_UPDATE | DRAW_CENTER | DRAW_ABOVE);
+    draw_string("Pick an AI delay factor:", color_purple,
+	    screen->w/2, screen->h/2, DRAW_UPDATE | DRAW_LEFT);
+    factor = input_string(screen, screen->w/2, screen->h/2, 0);
+    retval = 0;
+    sscanf(factor,"%d",&retval);
+    free(factor);
+    if (retval < 0) retval = 0;
+    if (retval > 100) retval = 100;
+    return retval;
+}
+
+
+/***************************************************************************
+ *      pick_an_ai()
+ * Asks the player to choose an AI.
+ *
+ * Returns -1 on "cancel". 
+ *********************************************************************PROTO*/
+int 
+pick_an_ai(SDL_Surface *screen, char *msg, AI_Players *AI)
+{
+    WalkRadioGroup *wrg;
+    int i, text_h;
+    int retval;
+    SDL_Event event;
+
+    wrg = create_single_wrg( AI->n + 1 );
+    for (i=0; i<AI->n ; i++) {
+	char buf[1024];
+	sprintf(buf,"\"%s\" : %s", AI->player[i].name, AI->player[i].msg);
+	wrg->wr[0].label[i] = strdup(buf);
+    }
+
+    wrg->wr[0].label[AI->n] = "-- Cancel --";
+
+    wrg->wr[0].defaultchoice = retval = 0;
+
+    if (wrg->wr[0].defaultchoice > AI->n) 
+	PANIC("not enough choices!");
+    
+    setup_radio(&wrg->wr[0]);
+
+    wrg->wr[0].x = (screen->w - wrg->wr[0].area.w) / 2;
+    wrg->wr[0].y = (screen->h - wrg->wr[0].area.h) / 2;
+
+    clear_screen_to_flame();
+
+    text_h = draw_string(msg, color_ai_menu, ( screen->w ) / 2,
+	    wrg->wr[0].y - 30, DRAW_UPDATE | DRAW_CENTER);
+
+    draw_string("Choose a Computer Player", color_ai_menu, (screen->w ) /
+	    2, (wrg->wr[0].y - 30) - text_h, DRAW_UPDATE | DRAW_CENTER);
+
+    draw_radio(&wrg->wr[0], 1);
+
+    while (1) {
+	int retval;
+	poll_and_flame(&event);
+
+	retval = handle_radio_event(wrg,&event);
+	if (retval == -1)
+	    continue;
+	if (retval == AI->n)
+	    return -1;
+	return retval;
+    }
+}
+
+
+/*
+ * $Log: ai.c,v $
+ * Revision 1.27  2001/01/05 21:12:31  weimer
+ * advance to atris 1.0.5, add support for ".atrisrc" and changing the
+ * keyboard repeat rate
+ *
+ * Revision 1.26  2000/11/06 04:06:44  weimer
+ * option menu
+ *
+ * Revision 1.25  2000/11/06 01:22:40  wkiri
+ * Updated menu system.
+ *
+ * Revision 1.24  2000/11/06 00:24:01  weimer
+ * add WalkRadioGroup modifications (inactive field for Kiri) and some support
+ * for special pieces
+ *
+ * Revision 1.23  2000/11/02 03:06:20  weimer
+ * better interface for walk-radio menus: we are now ready for Kiri to change
+ * them to add run-time options ...
+ *
+ * Revision 1.22  2000/11/01 04:39:41  weimer
+ * clear the little scoring spot correctly, updates for making a no-sound
+ * distribution
+ *
+ * Revision 1.21  2000/11/01 03:53:06  weimer
+ * modifications for version 1.0.1: you can pick your starting level, you can
+ * pick the AI difficulty factor, the game is better about placing new pieces
+ * when there is garbage, when things fall out of your control they now fall
+ * at a uniform rate ...
+ *
+ * Revision 1.20  2000/10/29 21:23:28  weimer
+ * One last round of header-file changes to reflect my newest and greatest
+ * knowledge of autoconf/automake. Now if you fail to have some bizarro
+ * function, we try to go on anyway unless it is vastly needed.
+ *
+ * Revision 1.19  2000/10/29 19:04:32  weimer
+ * minor highscore handling changes: new filename, use the draw_string() and
+ * draw_bordered_rect() and input_string() interfaces, handle the widget layer
+ * and the flame layer, etc. Also fix a minor bug where you would be prevented
+ * from settling if you pressed a key even if it didn't really move you. :-)
+ *
+ * Revision 1.18  2000/10/29 17:23:13  weimer
+ * incorporate "xflame" flaming background for added spiffiness ...
+ *
+ * Revision 1.17  2000/10/28 21:30:34  wkiri
+ * Kiri AI rules!
+ *
+ * Revision 1.16  2000/10/21 01:14:42  weimer
+ * massic autoconf/automake restructure ...
+ *
+ * Revision 1.15  2000/10/20 01:32:09  weimer
+ * Minor play issue problems -- time is now truly a hard limit!
+ *
+ * Revision 1.14  2000/10/18 23:57:49  weimer
+ * general fixup, color changes, display changes.
+ * Notable: "Safe" Blits and Updates now perform "clipping". No more X errors,
+ * we hope!
+ *
+ * Revision 1.13  2000/10/18 02:04:02  weimer
+ * playability changes ...
+ *
+ * Revision 1.12  2000/10/14 16:17:41  weimer
+ * level adjustment changes, added some new AIs, etc.
+ *
+ * Revision 1.11  2000/10/14 03:36:22  weimer
+ * wessy AI changes: resource management
+ *
+ * Revision 1.10  2000/10/14 02:56:37  wkiri
+ * Kiri AI gets another leg up.
+ *
+ * Revision 1.9  2000/10/14 01:56:35  weimer
+ * remove dates from identity files
+ *
+ * Revision 1.8  2000/10/14 01:56:10  wkiri
+ * Kiri AI comes of age!
+ *
+ * Revision 1.7  2000/10/14 01:24:34  weimer
+ * fixed error with not advancing levels when fighting AI
+ *
+ * Revision 1.6  2000/10/13 22:34:26  weimer
+ * minor wessy AI changes
+ *
+ * Revision 1.5  2000/10/13 21:16:43  wkiri
+ * Aliz AI evolves!
+ *
+ * Revision 1.4  2000/10/13 16:37:39  weimer
+ * Changed the AI so that it now passes state around via void pointers, rather
+ * than using global variables. This allows the same AI to play itself. Also
+ * changed the "AI vs. AI" display so that you can keep track of total wins
+ * and losses.
+ *
+ * Revision 1.3  2000/10/13 15:41:53  weimer
+ * revamped AI support, now you can pick your AI and have AI duels (such fun!)
+ * the mighty Aliz AI still crashes a bit, though ... :-)
+ *
+ * Revision 1.2  2000/10/13 03:02:05  wkiri
+ * Added Aliz (Kiri AI) to ai.c.
+ * Note event.c currently calls Aliz, not Wessy AI.
+ *
+ * Revision 1.1  2000/10/12 19:19:43  weimer
+ * Sigh!
+ *
+ */
+
+/***************************************************************************
+ *      button()
+ * Create a new button and return it.
+ *********************************************************************PROTO*/
+ATButton* button(char* text, Uint32 face_color0, Uint32 text_color0,
+	Uint32 face_color1, Uint32 text_color1,
+	int x, int y)
+{
+  SDL_Color sc;
+  ATButton* ab = (ATButton*)malloc(sizeof(ATButton)); Assert(ab);
+
+  /* Copy the colors */
+  ab->face_color[0] = face_color0;  
+  ab->text_color[0] = text_color0;
+  ab->face_color[1] = face_color1;  
+  ab->text_color[1] = text_color1;
+  /* Copy the text */
+  SDL_GetRGB(text_color0, screen->format, &sc.r, &sc.g, &sc.b);
+  ab->bitmap[0] = TTF_RenderText_Blended(font, text, sc);
+  Assert(ab->bitmap[0]);
+  SDL_GetRGB(text_color1, screen->format, &sc.r, &sc.g, &sc.b);
+  ab->bitmap[1]  = TTF_RenderText_Blended(font, text, sc);
+  Assert(ab->bitmap[1]);
+  /* Make the button bg */
+  ab->area.x = x; ab->area.y = y;
+  ab->area.w = ab->bitmap[0]->w + 10;
+  ab->area.h = ab->bitmap[0]->h + 10;
+  return ab;
+}
+
+/***************************************************************************
+ *      show_button()
+ * Displays the button, taking into account whether it's clicked or not.
+ *********************************************************************PROTO*/
+void show_button(ATButton* ab, int state)
+{
+    SDL_FillRect(screen, &ab->area, ab->text_color[state]);
+    SDL_UpdateSafe(screen, 1, &ab->area);
+    ab->area.x += 2; ab->area.y += 2;
+    ab->area.w -= 4; ab->area.h -= 4;
+    SDL_FillRect(screen, &ab->area, ab->face_color[state]);
+    SDL_UpdateSafe(screen, 1, &ab->area);
+    ab->area.x += 3; ab->area.y += 3;
+    ab->area.w -= 6; ab->area.h -= 6;
+    SDL_BlitSurface(ab->bitmap[state], NULL, screen, &ab->area);
+
+    ab->area.x -= 5;  ab->area.y -= 5;
+    ab->area.w += 10; ab->area.h += 10;
+    SDL_UpdateSafe(screen, 1, &ab->area);
+}
+
+/***************************************************************************
+ *      check_button()
+ * Returns 1 if (x,y) is inside the button, else 0.
+ * Also sets the is_clicked field in ab.
+ *********************************************************************PROTO*/
+char check_button(ATButton* ab, int x, int y)
+{
+  if ((ab->area.x <= x && x <= ab->area.x + ab->area.w) &&
+	  (ab->area.y <= y && y <= ab->area.y + ab->area.h)) {
+      return 1; 
+  } else return 0;
+}
+
+/*
+ * $Log: button.c,v $
+ * Revision 1.9  2000/11/06 01:22:40  wkiri
+ * Updated menu system.
+ *
+ * Revision 1.8  2000/10/29 21:23:28  weimer
+ * One last round of header-file changes to reflect my newest and greatest
+ * knowledge of autoconf/automake. Now if you fail to have some bizarro
+ * function, we try to go on anyway unless it is vastly needed.
+ *
+ * Revision 1.7  2000/10/21 01:14:42  weimer
+ * massic autoconf/automake restructure ...
+ *
+ * Revision 1.6  2000/10/18 23:57:49  weimer
+ * general fixup, color changes, display changes.
+ * Notable: "Safe" Blits and Updates now perform "clipping". No more X errors,
+ * we hope!
+ *
+ * Revision 1.5  2000/09/04 22:49:51  wkiri
+ * gamemenu now uses the new nifty menus.  Also, added delete_menu.
+ *
+ * Revision 1.4  2000/09/04 19:48:02  weimer
+ * interim menu for choosing among game styles, button changes (two states)
+ *
+ * Revision 1.3  2000/09/03 18:26:10  weimer
+ * major header file and automatic prototype generation changes, restructuring
+ *
+ * Revision 1.2  2000/08/26 03:11:34  wkiri
+ * Buttons now use borders.
+ *
+ * Revision 1.1  2000/08/26 02:45:28  wkiri
+ * Beginnings of button class; also modified atris to query for 'new
+ * game' vs. 'quit'.  (New Game doesn't work yet...)
+ *
+ */
+
+
+
+/* The background image, global so we can do updates */
+SDL_Surface *adjust_symbol[3] = { NULL, NULL, NULL };
+/* Rectangles that specify where my/their pieces can legally be */
+
+/***************************************************************************
+ *      poll_and_flame()
+ * Waits for an event and runs the flaming background meanwhile, sleeping
+ * between its frames.
+ *********************************************************************PROTO*/
+void
+poll_and_flame(SDL_Event *ev)
+{
+    while (!(SDL_PollEvent(ev))) {
+	atris_run_flame();
+	idle_wait(atris_flame_wait(), 0);
+    }
+    return;
+}
+
+/***************************************************************************
+ *      clear_screen_to_flame()
+ * Clears the screen so that only the flame layer is visible.
+ *********************************************************************PROTO*/
+void
+clear_screen_to_flame(void)
+{
+    SDL_Rect all;
+
+    all.x = all.y = 0;
+    all.w = screen->w;
+    all.h = screen->h;
+
+    SDL_FillRect(widget_layer, &all, int_black);
+    SDL_FillRect(screen, &all, int_black);
+    SDL_BlitSafe(flame_layer, NULL, screen, NULL);
+    SDL_UpdateSafe(screen, 1, &all);
+}
+
+/***************************************************************************
+ *      setup_colors()
+ * Sets up our favorite colors.
+ *********************************************************************PROTO*/
+void
+setup_colors(SDL_Surface *screen)
+{
+    int i = 0;
+
+    color_white.r = color_white.g = color_white.b = 0xFF;
+    color_white.unused = 0;
+
+    color_black.r = color_black.g = color_black.b = color_black.unused = 0;
+
+    color_red.r = 0xFF; color_red.g = color_red.b = color_red.unused = 0;
+
+    color_blue.b = 0xFF; color_blue.r = color_blue.g = color_blue.unused = 0;
+
+    color_purple.b = 128; color_purple.r = 128; color_purple.g = 64;
+	color_purple.unused = 0;
+
+    int_black = SDL_MapRGB(screen->format, 0, 0, 0);
+
+    /* find the darkest black that is different from "all black" */
+    do {
+	i++;
+	int_solid_black = SDL_MapRGB(screen->format, i, i, i);
+    } while (int_black == int_solid_black && i < 255);
+    /* couldn't find one?! */
+    if (i == 255) {
+	Debug("*** Warning: transparency is compromised by RGB format.\n");
+	int_solid_black = SDL_MapRGB(screen->format, 1, 1, 1);
+    } else if (i != 1)
+	Debug("*** Note: First non-black color found at magnitude %d.\n",i);
+
+    int_white = SDL_MapRGB(screen->format, 255, 255, 255);
+    int_grey  = SDL_MapRGB(screen->format, 128, 128, 128);
+    int_blue  = SDL_MapRGB(screen->format, 0, 0, 255);
+    int_med_blue = SDL_MapRGB(screen->format, 0, 0, 0);
+    int_dark_blue  = SDL_MapRGB(screen->format, 0, 0, 128);
+    int_purple  = SDL_MapRGB(screen->format, 128, 64, 128);
+    int_dark_purple  = SDL_MapRGB(screen->format, 64, 32, 64);
+}
+
+/***************************************************************************
+ *      draw_string()
+ * Draws the given string at the given location using the default font.
+ *********************************************************************PROTO*/
+#define	DRAW_CENTER	(1<<0)
+#define	DRAW_ABOVE	(1<<1)
+#define DRAW_LEFT	(1<<2)
+#define DRAW_UPDATE	(1<<3)
+#define DRAW_CLEAR	(1<<4)
+#define DRAW_HUGE	(1<<5)
+#define DRAW_LARGE	(1<<6)
+#define DRAW_SMALL	(1<<8)
+int
+draw_string(char *text, SDL_Color sc, int x, int y, int flags)
+{
+    SDL_Surface * text_surface;
+    SDL_Rect r;
+
+    r.x = x;
+    r.y = y;
+
+    if (flags & DRAW_HUGE) {
+	text_surface = TTF_RenderText_Blended(hfont, text, sc); Assert(text_surface);
+    } else if (flags & DRAW_LARGE) {
+	text_surface = TTF_RenderText_Blended(lfont, text, sc); Assert(text_surface);
+    } else if (flags & DRAW_SMALL) {
+	text_surface = TTF_RenderText_Blended(sfont, text, sc); Assert(text_surface);
+    } else {
+	text_surface = TTF_RenderText_Blended(font, text, sc); Assert(text_surface);
+    }
+
+    r.w = text_surface->w;
+    r.h = text_surface->h;
+
+    if (flags & DRAW_CENTER)
+	r.x -= (r.w / 2);
+    if (flags & DRAW_LEFT)
+	r.x -= text_surface->w;
+    if (flags & DRAW_ABOVE)
+	r.y -= (r.h);
+    if (flags & DRAW_CLEAR) {
+	SDL_FillRect(widget_layer, &r, int_black);
+	SDL_FillRect(screen, &r, int_black);
+    }
+
+    SDL_BlitSafe(text_surface, NULL, widget_layer, &r);
+    SDL_BlitSafe(flame_layer, &r, screen, &r);
+    SDL_BlitSafe(widget_layer, &r, screen, &r);
+    if (flags & DRAW_UPDATE)
+	SDL_UpdateSafe(screen, 1, &r);
+
+    SDL_FreeSurface(text_surface);
+    return r.h;
+}
+
+/***************************************************************************
+ *      give_notice()
+ * Draws a little "press any key to continue"-type notice between levels.
+ * "msg" is any message you would like to display.
+ * Returns 1 if the user presses 'q', 0 if the users presses 'c'.
+ *********************************************************************PROTO*/
+int
+give_notice(Session *s, char *msg, int quit_possible)
+{
+    SDL_Event event;
+
+    while (SDL_PollEvent(&event)) {
+	/* pull out all leading 'Q's */
+    }
+
+    if (msg && msg[0]) 	/* throw that 'ol user text up there */
+	draw_string(msg, color_blue, 
+		s->layout.grid[0].x + (s->layout.grid[0].w / 2), s->layout.grid[0].y
+		+ 64, DRAW_CENTER | DRAW_UPDATE);
+
+    if (quit_possible) 
+	draw_string("Press 'Q' to Quit", color_red,
+		s->layout.grid[0].x + (s->layout.grid[0].w / 2), s->layout.grid[0].y + 128, 
+		DRAW_CENTER | DRAW_UPDATE);
+
+    draw_string("Press 'G' to Go On", color_red,
+	    s->layout.grid[0].x + (s->layout.grid[0].w / 2), s->layout.grid[0].y +
+	    128 + 30, DRAW_CENTER | DRAW_UPDATE);
+    while (1) {
+	poll_and_flame(&event);
+	if (event.type == SDL_KEYDOWN &&
+		event.key.keysym.sym == 'q') 
+	    return 1;
+	if (event.type == SDL_KEYDOWN &&
+		event.key.keysym.sym == 'g')
+	    return 0;
+    } 
+}
+
+/***************************************************************************
+ *      load_adjust_symbol()
+ * Loads the level adjustment images.
+ ***************************************************************************/
+static void
+load_adjust_symbols()
+{
+    SDL_Surface *bitmap = SDL_LoadBMP("graphics/Level-Up.bmp");
+    if (!bitmap) PANIC("Could not load [graphics/Level-Up.bmp]");
+    if (bitmap->format->palette != NULL ) {
+	SDL_SetColors(screen, bitmap->format->palette->colors, 0,
+		bitmap->format->palette->ncolors);
+    }
+    adjust_symbol[0] = SDL_DisplayFormat(bitmap);
+    if (!adjust_symbol[0]) 
+	PANIC("Can not convert [graphics/Level-Up.bmp] to hardware format");
+    SDL_SetColorKey(adjust_symbol[0], SDL_SRCCOLORKEY,
+	    SDL_MapRGB(screen->format, 0, 0, 0));
+    SDL_FreeSurface(bitmap);
+
+    bitmap = SDL_LoadBMP("graphics/Level-Medium.bmp");
+    if (!bitmap) PANIC("Could not load [graphics/Level-Medium.bmp]");
+    if (bitmap->format->palette != NULL ) {
+	SDL_SetColors(screen, bitmap->format->palette->colors, 0,
+		bitmap->format->palette->ncolors);
+    }
+    adjust_symbol[1] = SDL_DisplayFormat(bitmap);
+    if (!adjust_symbol[1]) 
+	PANIC("Can not convert [graphics/Level-Medium.bmp] to hardware format");
+    SDL_SetColorKey(adjust_symbol[1], SDL_SRCCOLORKEY,
+	    SDL_MapRGB(screen->format, 0, 0, 0));
+    SDL_FreeSurface(bitmap);
+
+    bitmap = SDL_LoadBMP("graphics/Level-Down.bmp");
+    if (!bitmap) PANIC("Could not load [graphics/Level-Down.bmp]");
+    if (bitmap->format->palette != NULL ) {
+	SDL_SetColors(screen, bitmap->format->palette->colors, 0,
+		bitmap->format->palette->ncolors);
+    }
+    adjust_symbol[2] = SDL_DisplayFormat(bitmap);
+    if (!adjust_symbol[2]) 
+	PANIC("Can not convert [graphics/Level-Down.bmp] to hardware format");
+    SDL_SetColorKey(adjust_symbol[2], SDL_SRCCOLORKEY,
+	    SDL_MapRGB(screen->format, 0, 0, 0));
+    SDL_FreeSurface(bitmap);
+
+    Assert(adjust_symbol[0]->h == adjust_symbol[1]->h);
+    Assert(adjust_symbol[1]->h == adjust_symbol[2]->h);
+}
+
+/***************************************************************************
+ *      draw_bordered_rect()
+ * Draws a bordered rectangle. Sets "border" based on "orig". 
+ *********************************************************************PROTO*/
+void
+draw_bordered_rect(SDL_Rect *orig, SDL_Rect *border, int thick)
+{
+    Assert(thick > 0 && thick < 8);
+
+    border->x = orig->x - thick;
+    border->y = orig->y - thick;
+    border->w = orig->w + thick * 2;
+    border->h = orig->h + thick * 2;
+
+    SDL_FillRect(widget_layer, border, int_border_color);
+    SDL_FillRect(widget_layer, orig, int_solid_black);
+
+    /* unchanged: SDL_BlitSafe(flame_layer, NULL, screen, &r); */
+    SDL_BlitSafe(widget_layer, border, screen, border);
+    SDL_UpdateSafe(screen, 1, border);
+
+    return;
+}
+
+/***************************************************************************
+ *      draw_pre_bordered_rect()
+ * Draws a bordered rectangle. 
+ *********************************************************************PROTO*/
+void
+draw_pre_bordered_rect(SDL_Rect *border, int thick)
+{
+    SDL_Rect orig;
+    Assert(thick > 0 && thick < 8);
+
+    orig.x = border->x + thick;
+    orig.y = border->y + thick;
+    orig.w = border->w - thick * 2;
+    orig.h = border->h - thick * 2;
+
+    SDL_FillRect(widget_layer, border, int_border_color);
+    SDL_FillRect(widget_layer, &orig, int_solid_black);
+
+    /* unchanged: SDL_BlitSafe(flame_layer, NULL, screen, &r); */
+    SDL_BlitSafe(widget_layer, border, screen, border);
+    SDL_UpdateSafe(screen, 1, border);
+    return;
+}
+
+/***************************************************************************
+ *      setup_layers()
+ * Set up the widget and flame layers.
+ *********************************************************************PROTO*/
+void
+setup_layers(SDL_Surface * screen)
+{
+    SDL_Rect all;
+    flame_layer = SDL_CreateRGBSurface
+	(SDL_HWSURFACE|SDL_SRCCOLORKEY,
+	 screen->w, screen->h, 8, 0, 0, 0, 0);
+    widget_layer = SDL_CreateRGBSurface
+	(SDL_HWSURFACE|SDL_SRCCOLORKEY,
+	 screen->w, screen->h, screen->format->BitsPerPixel, 
+	 screen->format->Rmask, screen->format->Gmask, 
+	 screen->format->Bmask, screen->format->Amask);
+    if (SDL_SetColorKey(widget_layer, SDL_SRCCOLORKEY, 
+		SDL_MapRGB(widget_layer->format, 0, 0, 0)))
+	PANIC("SDL_SetColorKey failed on the widget layer.");
+
+    if (int_black != SDL_MapRGB(widget_layer->format, 0, 0, 0)) {
+	Debug("*** Warning: screen and widget layer have different RGB format.\n");
+    }
+    if (int_black != SDL_MapRGB(flame_layer->format, 0, 0, 0)) {
+	Debug("*** Warning: screen and flame layer have different RGB format.\n");
+    }
+
+    all.x = all.y = 0;
+    all.w = screen->w;
+    all.h = screen->h;
+
+    SDL_FillRect(widget_layer, &all, int_black);
+    SDL_FillRect(flame_layer, &all, int_solid_black);
+}
+
+/***************************************************************************
+ *      free_for_all_room()
+ * How many boards of w by h blocks draw_free_for_all() can lay out on the
+ * screen. Anything that starts a free-for-all asks this first: a board
+ * that does not fit could not be shown.
+ *********************************************************************PROTO*/
+int
+free_for_all_room(SDL_Surface *screen, int blockWidth, int w, int h)
+{
+    int text_h = TTF_FontLineSkip(font);
+    int cols = max(1, screen->w / (w * blockWidth + 8));
+    int rows = max(1, screen->h / (h * blockWidth + 2 * text_h + 8));
+
+    return rows * cols;
+}
+
+/***************************************************************************
+ *      draw_free_for_all()
+ * The board layout for a match between more than two (AI_VS_AI, or you
+ * against several AIs in SINGLE_VS_AI): the boards side by side, each with
+ * its level and score above it and its name below, in as many rows as the
+ * screen has room for. The caller has made sure there is room for all of
+ * them. There is no clock and no next piece.
+ ***************************************************************************/
+static void
+draw_free_for_all(Session *s, SDL_Surface *screen, int blockWidth, Grid g[],
+	int level[], char *name[])
+{
+    char buf[1024];
+    int i, w = g[0].w * blockWidth, h = g[0].h * blockWidth;
+    int text_h = TTF_FontLineSkip(font);
+    int cols = max(1, screen->w / (w + 8));
+    int rows = max(1, screen->h / (h + 2 * text_h + 8));
+    int across, left, top;
+
+    Assert(s->boards <= free_for_all_room(screen, blockWidth, g[0].w, g[0].h));
+    s->layout.boards = s->boards;
+    across = min(s->boards, cols);
+    rows = (s->boards + cols - 1) / cols;
+    left = (screen->w - across * (w + 8)) / 2 + 4;
+    top = (screen->h - rows * (h + 2 * text_h + 8)) / 2 + text_h + 4;
+
+    for (i=0; i<s->boards; i++) {
+	Assert(g[i].w == g[0].w && g[i].h == g[0].h);
+	s->layout.grid[i].x = left + (i % cols) * (w + 8);
+	s->layout.grid[i].y = top + (i / cols) * (h + 2 * text_h + 8);
+	s->layout.grid[i].w = w;
+	s->layout.grid[i].h = h;
+	draw_bordered_rect(&s->layout.grid[i], &s->layout.grid_border[i], 2);
+	g[i].board = s->layout.grid[i];
+
+	draw_string(name[i], color_blue,
+		s->layout.grid_border[i].x + s->layout.grid_border[i].w/2,
+		s->layout.grid_border[i].y + s->layout.grid_border[i].h,
+		DRAW_CENTER);
+
+	sprintf(buf,"Level %d:",level[i]);
+	draw_string(buf, color_blue, s->layout.grid_border[i].x,
+		s->layout.grid_border[i].y, DRAW_ABOVE | DRAW_CLEAR);
+	s->layout.score[i].x = s->layout.grid_border[i].x + s->layout.grid_border[i].w;
+	s->layout.score[i].y = s->layout.grid_border[i].y;
+    }
+
+    s->layout.pause.w = 10 * blockWidth;
+    s->layout.pause.h = 2 * text_h;
+    s->layout.pause.x = (screen->w - s->layout.pause.w) / 2;
+    s->layout.pause.y = (screen->h - s->layout.pause.h) / 2;
+}
+
+/***************************************************************************
+ *      draw_background()
+ * Draws the Alizarin Tetris background. Not yet complete, but it's getting
+ * better. :-)
+ *********************************************************************PROTO*/
+void
+draw_background(Session *s, SDL_Surface *screen, int blockWidth, Grid g[],
+	int level[], int my_adj[], int their_adj[], char *name[])
+{
+    char buf[1024];
+    int i;
+#define IS_DOUBLE(x) ((x==NETWORK)||(x==SINGLE_VS_AI)||(x==TWO_PLAYERS)||(x==AI_VS_AI))
+
+    if (IS_DOUBLE(s->gametype)) {
+	Assert(g[0].w == g[1].w);
+	Assert(g[0].h == g[1].h);
+    }
+
+    /*
+     * clear away the old stuff
+     */
+    memset(&s->layout, 0, sizeof(s->layout));
+    s->layout.clock_seconds = -111;	/* nothing drawn on this one yet */
+    
+    if (!adjust_symbol[0]) { /* only load these guys the first time */
+	load_adjust_symbols();
+    }
+    if (s->boards > 2) {
+	draw_free_for_all(s, screen, blockWidth, g, level, name);
+	goto blit;
+    }
+    s->layout.boards = 1 + IS_DOUBLE(s->gametype);
+    /*
+     * 	THE BOARD
+     */
+    if (IS_DOUBLE(s->gametype)) {
+	s->layout.grid[0].x = ((screen->w / 2) - ((g[0].w*blockWidth))) - 5 * blockWidth - 2;
+	s->layout.grid[0].y = ((screen->h - (g[0].h*blockWidth)) / 2);
+	s->layout.grid[0].w = (g[0].w*blockWidth);
+	s->layout.grid[0].h = (g[0].h*blockWidth);
+
+	s->layout.grid[1].y = ((screen->h - (g[0].h*blockWidth)) / 2);
+	s->layout.grid[1].w = (g[0].w*blockWidth);
+	s->layout.grid[1].h = (g[0].h*blockWidth);
+	s->layout.grid[1].x = ((screen->w / 2) - 4) + 5 * blockWidth + 6;
+
+	/* Draw the opponent's board */
+	draw_bordered_rect(&s->layout.grid[1], &s->layout.grid_border[1], 2);
+	g[1].board = s->layout.grid[1];
+    }  else {
+	s->layout.grid[0].x = (screen->w - (g[0].w*blockWidth))/2 ;
+	s->layout.grid[0].y = (screen->h - (g[0].h*blockWidth))/2 ;
+	s->layout.grid[0].w = (g[0].w*blockWidth) ;
+	s->layout.grid[0].h = (g[0].h*blockWidth) ;
+	/* Don't need a Board[1] */
+    }
+    /* draw the leftmost board */
+    draw_bordered_rect(&s->layout.grid[0], &s->layout.grid_border[0], 2);
+    g[0].board = s->layout.grid[0];
+
+    /*
+     * 	SCORING, Names
+     */
+    for (i=0; i< 1+IS_DOUBLE(s->gametype); i++) {
+	s->layout.name[i].x = s->layout.grid[i].x;
+	s->layout.name[i].y = s->layout.grid[i].y + s->layout.grid[i].h + 2;
+	s->layout.name[i].w = s->layout.grid[i].w;
+	s->layout.name[i].h = screen->h - s->layout.name[i].y;
+
+	if (s->gametype == DEMO) {
+	    char buf[1024];
+	    SDL_FillRect(widget_layer, &s->layout.name[i], int_black);
+	    SDL_FillRect(screen, &s->layout.name[i], int_black);
+	    sprintf(buf,"Demo (%s)",name[i]);
+	    draw_string(buf, color_blue, s->layout.grid_border[i].x +
+		    s->layout.grid_border[i].w/2, s->layout.grid_border[i].y +
+		    s->layout.grid_border[i].h, DRAW_CENTER | DRAW_CLEAR | DRAW_UPDATE);
+	} else {
+	    draw_string(name[i], color_blue,
+		    s->layout.grid_border[i].x + s->layout.grid_border[i].w/2,
+		    s->layout.grid_border[i].y + s->layout.grid_border[i].h,
+		    DRAW_CENTER);
+	}
+	/* Set up the coordinates for future score writing */
+	s->layout.score[i].x = s->layout.grid_border[i].x;
+	s->layout.score[i].w = s->layout.grid_border[i].w;
+	s->layout.score[i].y = 0;
+	s->layout.score[i].h = s->layout.grid_border[i].y;
+	SDL_FillRect(widget_layer, &s->layout.score[i], int_black);
+	SDL_FillRect(screen, &s->layout.score[i], int_black);
+
+	sprintf(buf,"Level %d, Score:",level[i]);
+	draw_string(buf, color_blue, s->layout.grid_border[i].x,
+		s->layout.grid_border[i].y, DRAW_ABOVE | DRAW_CLEAR);
+
+	s->layout.score[i].x = s->layout.grid_border[i].x + s->layout.grid_border[i].w;
+	s->layout.score[i].y = s->layout.grid_border[i].y;
+    }
+
+    /*
+     * 	TIME LEFT
+     */
+
+#define TIME_WIDTH 	(16*5)
+#define TIME_HEIGHT 	28
+
+    if (s->gametype == DEMO) {
+	/* do nothing */
+    } else if (IS_DOUBLE(s->gametype)) {
+	draw_string("Time Left", color_blue, 
+		screen->w/2, s->layout.score[0].y, DRAW_CENTER | DRAW_ABOVE);
+	s->layout.time.x = (screen->w - TIME_WIDTH)/2;
+	s->layout.time.y = s->layout.score[0].y;
+	s->layout.time.w = TIME_WIDTH;
+	s->layout.time.h = TIME_HEIGHT;
+	draw_bordered_rect(&s->layout.time, &s->layout.time_border, 2);
+    } else { /* single */
+	int text_h = draw_string("Time Left", color_blue,
+		screen->w/10, screen->h/5, 0);
+	s->layout.time.x = screen->w / 10;
+	s->layout.time.y = screen->h / 5 + text_h;
+	s->layout.time.w = TIME_WIDTH;
+	s->layout.time.h = TIME_HEIGHT;
+
+	draw_bordered_rect(&s->layout.time, &s->layout.time_border, 2);
+    }
+
+    /*
+     *	LEVEL ADJUSTMENT
+     */
+    if (s->gametype == DEMO) {
+
+    } else if (s->gametype == AI_VS_AI) {
+	for (i=0;i<3;i++) {
+	    char buf[80];
+
+	    s->layout.adjust[0].symbol[i].x = (screen->w - adjust_symbol[i]->w)/2;
+	    s->layout.adjust[0].symbol[i].w = adjust_symbol[i]->w;
+	    s->layout.adjust[0].symbol[i].h = adjust_symbol[i]->h;
+	    s->layout.adjust[0].symbol[i].y = 
+		s->layout.time_border.y+s->layout.time_border.h + i * adjust_symbol[i]->h;
+
+	    SDL_BlitSafe(adjust_symbol[i], NULL, widget_layer, 
+		    &s->layout.adjust[0].symbol[i]);
+
+	    /* draw the textual tallies */
+	    sprintf(buf,"%d",my_adj[i]);
+	    draw_string(buf, color_red,
+		    s->layout.adjust[0].symbol[i].x - 10, 
+		    s->layout.adjust[0].symbol[i].y, DRAW_LEFT | DRAW_CLEAR);
+	    sprintf(buf,"%d",their_adj[i]);
+	    draw_string(buf, color_red,
+		    s->layout.adjust[0].symbol[i].x + s->layout.adjust[0].symbol[i].w + 10, 
+		    s->layout.adjust[0].symbol[i].y, DRAW_CLEAR);
+	}
+    } else if (IS_DOUBLE(s->gametype)) {
+	for (i=0;i<3;i++) {
+	    s->layout.adjust[0].symbol[i].w = adjust_symbol[i]->w;
+	    s->layout.adjust[0].symbol[i].h = adjust_symbol[i]->h;
+	    s->layout.adjust[0].symbol[i].x = (screen->w - 3*adjust_symbol[i]->w)/2;
+	    s->layout.adjust[0].symbol[i].y = 
+		s->layout.time_border.y+s->layout.time_border.h + i * adjust_symbol[i]->h;
+	    SDL_FillRect(widget_layer, &s->layout.adjust[0].symbol[i], int_black);
+	    SDL_FillRect(screen, &s->layout.adjust[0].symbol[i], int_black);
+	    if (my_adj[i] != -1) 
+		SDL_BlitSafe(adjust_symbol[my_adj[i]], NULL, widget_layer, 
+			&s->layout.adjust[0].symbol[i]);
+	    s->layout.adjust[1].symbol[i].w = adjust_symbol[i]->w;
+	    s->layout.adjust[1].symbol[i].h = adjust_symbol[i]->h;
+	    s->layout.adjust[1].symbol[i].x = (screen->w)/2 + adjust_symbol[i]->w/2;
+	    s->layout.adjust[1].symbol[i].y = 
+		s->layout.time_border.y+s->layout.time_border.h + i * adjust_symbol[i]->h;
+	    SDL_FillRect(widget_layer, &s->layout.adjust[1].symbol[i], int_black);
+	    SDL_FillRect(screen, &s->layout.adjust[1].symbol[i], int_black);
+	    if (their_adj[i] != -1) 
+		SDL_BlitSafe(adjust_symbol[their_adj[i]], NULL, widget_layer, 
+			&s->layout.adjust[1].symbol[i]);
+	}
+    } else { /* single player */
+	for (i=0;i<3;i++) {
+	    s->layout.adjust[0].symbol[i].w = adjust_symbol[i]->w;
+	    s->layout.adjust[0].symbol[i].h = adjust_symbol[i]->h;
+	    s->layout.adjust[0].symbol[i].x = 
+		s->layout.grid_border[0].x + s->layout.grid_border[0].w +
+		2 * adjust_symbol[i]->w;
+	    s->layout.adjust[0].symbol[i].y = 
+		s->layout.time_border.y +s->layout.time_border.h+ i * adjust_symbol[i]->h;
+	    SDL_FillRect(widget_layer, &s->layout.adjust[0].symbol[i], int_black);
+	    SDL_FillRect(screen, &s->layout.adjust[0].symbol[i], int_black);
+	    if (my_adj[i] != -1) 
+		SDL_BlitSafe(adjust_symbol[my_adj[i]], NULL, widget_layer, 
+			&s->layout.adjust[0].symbol[i]);
+	}
+    }
+
+    /*
+     * NEXT PIECE
+     */
+    if (s->gametype == DEMO) {
+	/* do nothing */
+    } else if (IS_DOUBLE(s->gametype)) {
+	int text_h = draw_string("Next Piece", color_blue,
+		screen->w / 2, 
+		s->layout.adjust[0].symbol[2].y +
+		s->layout.adjust[0].symbol[2].h, DRAW_CENTER);
+
+	s->layout.next_piece[0].w = 5 * blockWidth;
+	s->layout.next_piece[0].h = 5 * blockWidth;
+	s->layout.next_piece[0].x = (screen->w / 2) - (5 * blockWidth);
+	s->layout.next_piece[0].y = s->layout.adjust[0].symbol[2].y +
+	    s->layout.adjust[0].symbol[2].h + text_h;
+	draw_bordered_rect(&s->layout.next_piece[0], &s->layout.next_piece_border[0], 2);
+
+	s->layout.next_piece[1].w = s->layout.next_piece[0].w;
+	s->layout.next_piece[1].h = s->layout.next_piece[0].h;
+	s->layout.next_piece[1].y = s->layout.next_piece[0].y;
+	s->layout.next_piece[1].x = (screen->w / 2);
+	draw_bordered_rect(&s->layout.next_piece[1], &s->layout.next_piece_border[1], 2);
+    } else {
+	int text_h = draw_string("Next Piece", color_blue,
+		screen->w/10, 2*screen->h/5, 0);
+
+	s->layout.next_piece[0].w = 5 * blockWidth;
+	s->layout.next_piece[0].h = 5 * blockWidth;
+	s->layout.next_piece[0].x = screen->w/10;
+	s->layout.next_piece[0].y = (2*screen->h/5) + text_h;
+
+	/* Draw the box for the next piece to fit in */
+	draw_bordered_rect(&s->layout.next_piece[0], &s->layout.next_piece_border[0], 2);
+    }
+
+    /*
+     *	PAUSE BOX
+     */
+    if (s->gametype == DEMO) {
+
+    } else if (IS_DOUBLE(s->gametype)) {
+	s->layout.pause.x = s->layout.next_piece_border[0].x;
+	s->layout.pause.y = s->layout.next_piece_border[0].h + s->layout.next_piece_border[0].y + 2 + 
+	    s->layout.next_piece_border[0].h / 3;
+	s->layout.pause.w = s->layout.next_piece_border[0].w + s->layout.next_piece[1].w;
+	s->layout.pause.h = s->layout.next_piece_border[0].h / 3;
+    } else {
+	s->layout.pause.x = s->layout.next_piece_border[0].x;
+	s->layout.pause.y = s->layout.next_piece_border[0].h + s->layout.next_piece_border[0].y + 2 +
+	    s->layout.next_piece_border[0].h / 3;
+	s->layout.pause.w = s->layout.next_piece_border[0].w;
+	s->layout.pause.h = s->layout.next_piece_border[0].h / 3;
+    }
+
+    /* Blit onto the screen surface */
+blit:
+    {
+	SDL_Rect dest;
+	dest.x = 0; dest.y = 0; dest.w = screen->w; dest.h = screen->h;
+
+	SDL_BlitSafe(flame_layer, NULL, screen, NULL);
+	SDL_BlitSafe(widget_layer, NULL, screen, NULL);
+	SDL_UpdateSafe(screen, 1, &dest);
+    }
+    return;
+}
+
+/***************************************************************************
+ *      draw_pause()
+ * Draw or clear the pause indicator.
+ *********************************************************************PROTO*/
+void
+draw_pause(Session *s, int on)
+{
+    int i;
+    if (on) {
+	draw_pre_bordered_rect(&s->layout.pause, 2);
+	draw_string("* Paused *", color_blue, 
+		s->layout.pause.x + s->layout.pause.w / 2, s->layout.pause.y,
+		DRAW_CENTER | DRAW_UPDATE);
+	for (i=0; i<s->layout.boards; i++) {
+	    /* save this stuff so that the flame doesn't go over it .. */
+	    if (s->layout.grid[i].w) {
+		SDL_BlitSafe(screen, &s->layout.grid[i], widget_layer,
+			&s->layout.grid[i]);
+		SDL_BlitSafe(screen, &s->layout.next_piece[i], widget_layer,
+			&s->layout.next_piece[i]);
+	    }
+	}
+    } else {
+	SDL_FillRect(widget_layer, &s->layout.pause, int_black);
+	SDL_FillRect(screen, &s->layout.pause, int_black);
+	SDL_BlitSafe(flame_layer, &s->layout.pause, screen, &s->layout.pause);
+	/* no need to paste over it with the widget layer: we know it to
+	 * be all transparent */
+	SDL_UpdateSafe(screen, 1, &s->layout.pause);
+
+	for (i=0; i<s->layout.boards; i++) 
+	    if (s->layout.grid[i].w) {
+		SDL_BlitSafe(widget_layer, &s->layout.grid[i], screen,
+			&s->layout.grid[i]);
+		SDL_FillRect(widget_layer, &s->layout.grid[i], int_solid_black);
+
+		SDL_BlitSafe(widget_layer, &s->layout.next_piece[i], screen,
+			&s->layout.next_piece[i]);
+		SDL_FillRect(widget_layer, &s->layout.next_piece[i], int_solid_black);
+	    }
+    }
+}
+
+/***************************************************************************
+ *      draw_clock()
+ * Draws a five-digit (-x:yy) clock in the center of the screen.
+ *********************************************************************PROTO*/
+void
+draw_clock(Session *s, int seconds)
+{
+    static SDL_Surface * digit[12];
+    char buf[16];
+    static int w = -1, h= -1; /* max digit width/height */
+    int i, c;
+
+    if (seconds == s->layout.clock_seconds || s->gametype == DEMO ||
+	    !s->layout.time.w) return;
+
+    if (w == -1) {
+	/* setup code */
+
+	for (i=0;i<10;i++) {
+	    sprintf(buf,"%d",i);
+	    digit[i] = TTF_RenderText_Blended(font,buf,color_blue);
+	}
+	sprintf(buf,":"); digit[10] = TTF_RenderText_Blended(font,buf,color_red);
+	sprintf(buf,"-"); digit[11] = TTF_RenderText_Blended(font,buf,color_red);
+
+	for (i=0;i<12;i++) {
+	    Assert(digit[i]);
+	    /* the colorkey and display format are already done */
+	    /* find the largest dimensions */
+	    if (digit[i]->w > w) w = digit[i]->w;
+	    if (digit[i]->h > h) h = digit[i]->h;
+	}
+    }
+
+    s->layout.clock_seconds = seconds;
+
+    sprintf(buf,"%d:%02d",seconds / 60, seconds % 60);
+
+    c = s->layout.time.x;
+    s->layout.time.w = w * 5;
+    s->layout.time.h = h;
+
+    SDL_FillRect(widget_layer, &s->layout.time, int_solid_black); 
+
+    if (strlen(buf) > 5)
+	sprintf(buf,"----");
+
+    if (strlen(buf) < 5)
+	s->layout.time.x += ((5 - strlen(buf)) * w) / 2;
+
+
+    for (i=0;buf[i];i++) {
+	SDL_Surface * to_blit;
+
+	if (buf[i] >= '0' && buf[i] <= '9')
+	    to_blit = digit[buf[i] - '0'];
+	else if (buf[i] == ':')
+	    to_blit = digit[10];
+	else if (buf[i] == '-')
+	    to_blit = digit[11];
+	else PANIC("unknown character in clock string [%s]",buf);
+
+	/* center the letter horizontally */
+	if (w > to_blit->w) s->layout.time.x += (w - to_blit->w) / 2;
+	s->layout.time.w = to_blit->w;
+	s->layout.time.h = to_blit->h;
+	/*
+	Debug("[%d+%d, %d+%d]\n",
+		clockPos.x,clockPos.w,clockPos.y,clockPos.h);
+		*/
+	SDL_BlitSafe(to_blit, NULL, widget_layer, &s->layout.time);
+	if (w > to_blit->w) s->layout.time.x -= (w - to_blit->w) / 2;
+	s->layout.time.x += w;
+    }
+
+    s->layout.time.x = c;
+    /*    clockPos.x = (screen->w - (w * 5)) / 2;*/
+    s->layout.time.w = w * 5;
+    s->layout.time.h = h;
+    SDL_BlitSafe(flame_layer, &s->layout.time, screen, &s->layout.time);
+    SDL_BlitSafe(widget_layer, &s->layout.time, screen, &s->layout.time);
+    SDL_UpdateSafe(screen, 1, &s->layout.time);
+
+    return;
+}
+
+/***************************************************************************
+ *      draw_score_as()
+ * Draws "score" as player i's score, whatever the session says now.
+ *********************************************************************PROTO*/
+void
+draw_score_as(Session *s, int i, int score)
+{
+    char buf[256];
+
+    sprintf(buf, "%d", score);
+    draw_string(buf, color_red, 
+	    s->layout.score[i].x, s->layout.score[i].y, DRAW_LEFT | DRAW_CLEAR |
+	    DRAW_ABOVE | DRAW_UPDATE);
+}
+
+/***************************************************************************
+ *      draw_score()
+ *********************************************************************PROTO*/
+void
+draw_score(Session *s, SDL_Surface *screen, int i)
+{
+    draw_score_as(s, i, s->score[i]);
+}
+
+/***************************************************************************
+ *      draw_ai_overlay()
+ * The AI debugging overlay: lines of small text under player P's name,
+ * replacing whatever was there before.
+ *********************************************************************PROTO*/
+void
+draw_ai_overlay(Session *s, int P, char *line[], int n)
+{
+    SDL_Rect r;
+    int i, h = TTF_FontLineSkip(sfont);
+
+    if (!s->layout.grid_border[P].w)
+	return;
+    r.x = s->layout.grid_border[P].x;
+    r.w = s->layout.grid_border[P].w;
+    r.y = s->layout.grid_border[P].y + s->layout.grid_border[P].h + 
+	TTF_FontLineSkip(font);
+    if (r.y >= screen->h)
+	return;
+    r.h = min(n * h, screen->h - r.y);
+
+    SDL_FillRect(widget_layer, &r, int_black);
+    SDL_FillRect(screen, &r, int_black);
+    SDL_BlitSafe(flame_layer, &r, screen, &r);
+    for (i=0; i<n && (i+1) * h <= r.h; i++)
+	draw_string(line[i], color_purple, r.x + r.w / 2, r.y + i * h,
+		DRAW_CENTER | DRAW_SMALL);
+    SDL_UpdateSafe(screen, 1, &r);
+}
+
+/***************************************************************************
+ *      draw_next_piece()
+ * Draws the next piece on the screen.
+ *
+ * Needs the color style because draw_play_piece() needs it to paste the
+ * bitmaps. 
+ *********************************************************************PROTO*/
+void
+draw_next_piece(Session *s, SDL_Surface *screen, piece_style *ps,
+	color_style *cs, play_piece *cp, play_piece *np, int P)
+{
+    if (s->gametype != DEMO && s->layout.next_piece[P].w) {
+	/* fake-o centering */
+	int cp_right = 5 - cp->base->dim;
+	int cp_down = 5 - cp->base->dim;
+	int np_right = 5 - np->base->dim;
+	int np_down = 5 - np->base->dim;
+
+	draw_play_piece(screen, cs,
+		cp, 
+		s->layout.next_piece[P].x + cp_right * cs->w / 2,
+		s->layout.next_piece[P].y + cp_down * cs->w / 2, 0,
+		np, 
+		s->layout.next_piece[P].x + np_right * cs->w / 2,
+		s->layout.next_piece[P].y + np_down * cs->w / 2, 0);
+    }
+    return;
+}
+
+/*
+ * $Log: display.c,v $
+ * Revision 1.25  2000/11/01 04:39:41  weimer
+ * clear the little scoring spot correctly, updates for making a no-sound
+ * distribution
+ *
+ * Revision 1.24  2000/11/01 03:53:06  weimer
+ * modifications for version 1.0.1: you can pick your starting level, you can
+ * pick the AI difficulty factor, the game is better about placing new pieces
+ * when there is garbage, when things fall out of your control they now fall
+ * at a uniform rate ...
+ *
+ * Revision 1.23  2000/10/30 16:25:25  weimer
+ * display the network player score during network games. Also give the
+ * non-server a little message when waiting for the server to go on.
+ *
+ * Revision 1.22  2000/10/29 22:55:01  weimer
+ * networking consistency checks (you must have the same number of doodads):
+ * special hotkey 'f' in main menu toggles full screen mode
+ * added depth specification on the command line
+ * automatically search for the darkest non-black color ...
+ *
+ * Revision 1.21  2000/10/29 21:28:58  weimer
+ * fixed a few failures to clear the screen if we didn't have a flaming
+ * backdrop
+ *
+ * Revision 1.20  2000/10/29 21:23:28  weimer
+ * One last round of header-file changes to reflect my newest and greatest
+ * knowledge of autoconf/automake. Now if you fail to have some bizarro
+ * function, we try to go on anyway unless it is vastly needed.
+ *
+ * Revision 1.19  2000/10/29 19:04:32  weimer
+ * minor highscore handling changes: new filename, use the draw_string() and
+ * draw_bordered_rect() and input_string() interfaces, handle the widget layer
+ * and the flame layer, etc. Also fix a minor bug where you would be prevented
+ * from settling if you pressed a key even if it didn't really move you. :-)
+ *
+ * Revision 1.18  2000/10/29 17:23:13  weimer
+ * incorporate "xflame" flaming background for added spiffiness ...
+ *
+ * Revision 1.17  2000/10/28 13:39:14  weimer
+ * added a pausing feature ...
+ *
+ * Revision 1.16  2000/10/21 01:14:42  weimer
+ * massic autoconf/automake restructure ...
+ *
+ * Revision 1.15  2000/10/18 23:57:49  weimer
+ * general fixup, color changes, display changes.
+ * Notable: "Safe" Blits and Updates now perform "clipping". No more X errors,
+ * we hope!
+ *
+ * Revision 1.14  2000/10/18 02:04:02  weimer
+ * playability changes ...
+ *
+ * Revision 1.13  2000/10/14 02:52:44  weimer
+ * fixed a memory corruption problem in display (a use after a free)
+ *
+ * Revision 1.12  2000/10/13 16:37:39  weimer
+ * Changed the AI so that it now passes state around via void pointers, rather
+ * than using global variables. This allows the same AI to play itself. Also
+ * changed the "AI vs. AI" display so that you can keep track of total wins
+ * and losses.
+ *
+ * Revision 1.11  2000/10/13 15:41:53  weimer
+ * revamped AI support, now you can pick your AI and have AI duels (such fun!)
+ * the mighty Aliz AI still crashes a bit, though ... :-)
+ *
+ * Revision 1.10  2000/10/12 22:21:25  weimer
+ * display changes, more multi-local-play threading (e.g., myScore ->
+ * Score[0]), that sort of thing ...
+ *
+ * Revision 1.9  2000/10/12 19:17:08  weimer
+ * Further support for AI players and multiple game types.
+ *
+ * Revision 1.8  2000/10/12 00:49:08  weimer
+ * added "AI" support and walking radio menus for initial game configuration
+ *
+ * Revision 1.7  2000/09/09 17:05:35  wkiri
+ * Hideous log changes (Wes: how dare you include a comment character!)
+ *
+ * Revision 1.6  2000/09/09 16:58:27  weimer
+ * Sweeping Change of Ultimate Mastery. Main loop restructuring to clean up
+ * main(), isolate the behavior of the three game types. Move graphic files
+ * into graphics/-, style files into styles/-, remove some unused files,
+ * add game flow support (breaks between games, remembering your level within
+ * this game), multiplayer support for the event loop, some global variable
+ * cleanup. All that and a bag of chips!
+ *
+ * Revision 1.5  2000/09/05 20:22:12  weimer
+ * native video mode selection, timing investigation
+ *
+ * Revision 1.4  2000/09/03 21:06:31  wkiri
+ * Now handles three different game types (and does different things).
+ * Major changes in display.c to handle this.
+ *
+ * Revision 1.3  2000/09/03 18:40:23  wkiri
+ * Cleaned up atris.c some more (high_score_check()).
+ * Added variable for game type (defaults to MARATHON).
+ *
+ */
+
+
+/* 
+ * Everything in event_loop() that happens at a set time is one of these
+ * timers in the session's "timers", one set of them per board: each pass
+ * handles what is due on the board whose next timer comes first, and the
+ * loop sleeps until the next one. Boards with nothing due are not looked
+ * at. Times are in game ticks, which stand still while the game is paused;
+ * see event_ticks().
+ */
+#define EVENT_FALL	0	/* the piece falls a step */
+#define EVENT_TETRIS	1	/* the next step of clearing lines */
+#define EVENT_AI_THINK	2
+#define EVENT_AI_MOVE	3	/* the AI gets to press a key */
+#define EVENT_BLANK	4	/* the distraction comes down another row */
+#define EVENT_TIMERS	5
+#define EVENT_TIMER(P,which)	((P) * EVENT_TIMERS + (which))
+
+/* 
+ * Falls and tetris animation steps run on a fixed timestep: a pass that
+ * comes late makes up every step it missed, up to this many, so that
+ * how far things move depends on the time and not on the loop.
+ */
+#define EVENT_CATCH_UP	8
+
+/* the turbo clock moves on this much when nothing at all is due */
+#define EVENT_INPUT_POLL	2
+
+/* ... and the real one is slept on at most this long, for the clock */
+#define EVENT_IDLE	100
+
+/* do we draw board P ourselves? not if the render thread does, nor if
+ * draw_background() gave it no place on the screen */
+#define EVENT_DRAWS(s,P)	(!(s)->rendering && (P) < (s)->layout.boards)
+
+/* can anybody see board P as it is? not if it is blanked, off the screen
+ * or only drawn now and then in turbo */
+#define EVENT_WATCHED(s,P)	((s)->state[P].draw && \
+	(P) < (s)->layout.boards && !(s)->turbo.on)
+
+/*
+ * When lines clear, whatever was above them slides down a row in
+ * RENDER_SLIDE ticks, however it is drawn: the render thread works out how
+ * far along it is from the time, and when we draw it ourselves we do so
+ * every TETRIS_SLIDE_STEP. Nobody watching, it all comes down at once.
+ */
+#define TETRIS_SLIDE_STEP	4
+
+/* where F12 writes the event loop's histograms: see event_dump() */
+#define EVENT_LATENCY_FILE	"Atris.Latency"
+
+static const char *phase_name[PHASES] = {
+    "input", "fall", "tetris", "think", "move", "draw", "network", "sleep",
+    "pass", "fall-late"
+};
+
+/***************************************************************************
+ *      event_ticks()
+ * The game clock: SDL_GetTicks(), less the time spent paused. In turbo
+ * it only moves when the loop moves it.
+ ***************************************************************************/
+static Uint32
+event_ticks(Session *s)
+{
+    return s->turbo.on ? s->turbo.clock : SDL_GetTicks() - s->paused_ticks;
+}
+
+/***************************************************************************
+ *      event_piece()
+ * generate_piece() on the session's own random numbers, which it leaves
+ * where generate_piece() would have left ZEROTO()'s.
+ ***************************************************************************/
+static play_piece
+event_piece(Session *s, piece_style *ps, color_style *cs, unsigned int seq)
+{
+    s->random = seq;
+    return generate_piece_r(ps, cs, &s->random);
+}
+
+/***************************************************************************
+ *      input_gather()
+ * Takes everything SDL has waiting (as much as fits) and stamps it.
+ * Returns how much input is waiting now.
+ ***************************************************************************/
+static int
+input_gather(Session *s)
+{
+    while (s->input.n < INPUT_QUEUE) {
+	int i = (s->input.first + s->input.n) % INPUT_QUEUE, got;
+	render_lock();
+	got = SDL_PollEvent(&s->input.event[i]);
+	render_unlock();
+	if (!got)
+	    break;
+	s->input.at[i] = SDL_GetTicks();
+	s->input.n++;
+    }
+    return s->input.n;
+}
+
+/***************************************************************************
+ *      input_next()
+ * The oldest input waiting, in *e, noting how long it waited. Returns 0
+ * if there is none.
+ ***************************************************************************/
+static int
+input_next(Session *s, SDL_Event *e)
+{
+    static const Uint32 bound[INPUT_LAG_BUCKETS - 1] = { 1, 2, 5, 10 };
+    Uint32 lag;
+    int b;
+
+    if (s->input.n == 0 && !input_gather(s))
+	return 0;
+    *e = s->input.event[s->input.first];
+    lag = SDL_GetTicks() - s->input.at[s->input.first];
+    s->input.first = (s->input.first + 1) % INPUT_QUEUE;
+    s->input.n--;
+
+    s->input_lag.events++;
+    s->input_lag.total += lag;
+    if (lag > s->input_lag.worst)
+	s->input_lag.worst = lag;
+    for (b=0; b<INPUT_LAG_BUCKETS - 1 && lag >= bound[b]; b++)
+	;
+    s->input_lag.bucket[b]++;
+    return 1;
+}
+
+/***************************************************************************
+ *      paste_on_board()
+ * Places the given piece on the board. Uses row-column (== grid)
+ * coordinates. 
+ *********************************************************************PROTO*/
+void
+paste_on_board(play_piece *pp, int col, int row, int rot, Grid *g)
+{
+    int i,j,c;
+
+    for (j=0;j<pp->base->dim;j++)
+	for (i=0;i<pp->base->dim;i++) 
+	    if ((c=BITMAP(*pp->base,rot,i,j))) {
+		int t_x = i + col; /* was + (screen_x / cs->w); */
+		int t_y = j + row; /* was + (screen_y / cs->h); */
+		if ((t_x<0 || t_y<0 || t_x>=g->w || t_y>=g->h)) {
+		    Debug("Serious consistency failure: dropping pieces.\n");
+		    continue;
+		}
+		GRID_SET(*g,t_x,t_y,pp->colormap[c]);
+		FALL_SET(*g,t_x,t_y,NOT_FALLING);
+		if (t_x > 0) GRID_CHANGED(*g,t_x-1,t_y) = 1;
+		if (t_y > 0) GRID_CHANGED(*g,t_x,t_y-1) = 1;
+		if (t_x < g->w-1) GRID_CHANGED(*g,t_x+1,t_y) = 1;
+		if (t_y < g->h-1) GRID_CHANGED(*g,t_x,t_y+1) = 1;
+	}
+    return;
+}
+
+/***************************************************************************
+ *      screen_to_exact_grid_coords()
+ * Converts screen coordinates to exact grid coordinates. Will abort the
+ * program if you pass in unaligned coordinates!
+ ***************************************************************************/
+static void
+screen_to_exact_grid_coords(Grid *g, int blockWidth, 
+	int screen_x, int screen_y, int *row, int *col)
+{
+    screen_x -= g->board.x;
+    screen_y -= g->board.y;
+
+    Assert(screen_x % blockWidth == 0);
+    Assert(screen_y % blockWidth == 0);
+
+    *row = screen_y / blockWidth;
+    *col = screen_x / blockWidth;
+
+    return;
+}
+
+/***************************************************************************
+ *      screen_to_grid_coords()
+ * Converts screen coordinates to grid coordinates. Rounds "down". 
+ ***************************************************************************/
+void
+screen_to_grid_coords(Grid *g, int blockWidth, 
+	int screen_x, int screen_y, int *row, int *col)
+{
+    screen_x -= g->board.x;
+    screen_y -= g->board.y;
+    /* round up to negative #s */
+    if (screen_x < 0) screen_x -= blockWidth - 1;
+    if (screen_y < 0) screen_y -= blockWidth - 1;
+
+    *row = screen_y / blockWidth;
+    *col = screen_x / blockWidth;
+
+    return;
+}
+
+/***************************************************************************
+ *      valid_position()
+ * Determines if the given position is valid. Uses row-column (== grid)
+ * coordinates. Returns 0 if the piece would fall out of bounds or if
+ * some solid part of the piece would fall over something already on the
+ * the grid. Returns 1 otherwise (it is then safe to call
+ * paste_on_board()). 
+ *********************************************************************PROTO*/
+int
+valid_position(play_piece *pp, int col, int row, int rot, Grid *g)
+{
+    int i,j;
+
+    /* 
+     * We don't want this check because you can have col=-2 or whatnot if
+     * your piece doesn't start on its leftmost border.
+     *
+     * if (col < 0 || col >= g->w || row < 0 || row >= g->h)
+     *	return 0;
+     */
+
+    for (j=0;j<pp->base->dim;j++)
+	for (i=0;i<pp->base->dim;i++) 
+	    if (BITMAP(*pp->base,rot,i,j)) {
+		int t_x = i + col; /* was + (screen_x / cs->w); */
+		int t_y = j + row; /* was + (screen_y / cs->h); */
+		if (t_x < 0 || t_y < 0 || t_x >= g->w || t_y >= g->h)
+		    return 0;
+		if (GRID_CONTENT(*g,t_x,t_y)) return 0;
+	}
+    return 1;
+}
+
+/***************************************************************************
+ *      valid_screen_position()
+ * Determines if the given position is valid. Uses screen coordinates.
+ * Handles pieces that are not perfectly row-aligned. Pieces must still
+ * be perfectly column aligned. 
+ *
+ * Returns 0 if the piece would fall out of bounds or if some solid part of
+ * the piece would fall over something already on the the grid. Returns 1
+ * otherwise (it is then safe to call paste_on_board()). 
+ *********************************************************************PROTO*/
+int
+valid_screen_position(play_piece *pp, int blockWidth, Grid *g,
+	int rot, int screen_x, int screen_y)
+{
+    int row, row2, col;
+
+    screen_to_grid_coords(g, blockWidth, screen_x, screen_y, &row, &col);
+
+    if (!valid_position(pp, col, row, rot, g))
+	return 0;
+
+    /* a piece between two rows covers the lower one too */
+    screen_to_grid_coords(g, blockWidth, screen_x, screen_y + blockWidth - 1,
+	    &row2, &col);
+
+    if (row == row2) return 1;	/* no need to recheck, you were aligned */
+    else return valid_position(pp, col, row2, rot, g);
+}
+
+/***************************************************************************
+ *      tetris_event()
+ * Do some work associated with a collision, the step "count" of it that
+ * is due at game tick "at": 1 checks for lines, 2 runs gravity and 3
+ * slides what falls down a row (see TETRIS_SLIDE_STEP). Needs the color style
+ * to draw the grid.
+ *************************************************************************/
+int tetris_event(Session *s, int *delay, int count, SDL_Surface * screen, 
+	piece_style *ps, color_style *cs, sound_style *ss, Grid g[], int
+	level, int fall_event_interval, int sock, int draw,
+	int *blank, int *garbage, int P, Uint32 at)
+{
+    if (count == 1) { /* determine if anything happened, sounds */
+	int i;
+
+	s->state[P].check_result = check_tetris(g);
+	s->state[P].num_lines_cleared += s->state[P].check_result;
+
+	if (s->state[P].check_result >= 3)
+	    play_sound(ss,SOUND_CLEAR4,256);
+	else for (i=0;i<s->state[P].check_result;i++)
+	    play_sound(ss,SOUND_CLEAR1,256+6144*i);
+
+	*delay = 1;
+	return 2;
+
+    } else if (count == 2) {	/* run gravity */
+	int x,y;
+
+	if (sock) { 
+	    char msg = 'c'; /* WRW: send update */
+	    send(sock,&msg,1,0);
+	    send(sock,g[0].contents,sizeof(*g[0].contents)
+		    * g[0].h * g[0].w,0); 
+		    
+	}
+	draw_grid(screen,cs,&g[0],draw);
+
+	/*
+	 * recalculate falling, run gravity
+	 */
+	memcpy(g->temp,g->fall,g->w*g->h*sizeof(*(g->temp)));
+	for (y=g->h-1;y>=0;y--) 
+	    for (x=g->w-1;x>=0;x--) 
+		FALL_SET(*g,x,y,UNKNOWN);
+	run_gravity(&g[0]);
+	memset(g->changed,0,g->h*g->w*sizeof(*(g->changed)));
+	for (y=g->h-1;y>=0;y--) 
+	    for (x=g->w-1;x>=0;x--) 
+		if (TEMP_CONTENT(*g,x,y)!=FALL_CONTENT(*g,x,y)){
+		    GRID_CHANGED(*g,x,y) = 1;
+		    if (x > 0) GRID_CHANGED(*g,x-1,y) = 1;
+		    if (y > 0) GRID_CHANGED(*g,x,y-1) = 1;
+		    if (x < g->w-1) GRID_CHANGED(*g,x+1,y) = 1;
+		    if (y < g->h-1) GRID_CHANGED(*g,x,y+1) = 1;
+		}
+	/* 
+	 * check: did FALL_CONTENT change? 
+	 */
+	draw_grid(screen,cs,&g[0],draw);
+
+	if (determine_falling(&g[0]) && !EVENT_WATCHED(s,P)) {
+	    /* nobody would see it come down: bring it all down now */
+	    int thud = 0;
+
+	    do {
+		fall_down(g);
+		thud |= run_gravity(g);
+	    } while (determine_falling(&g[0]));
+	    draw_grid(screen,cs,g,draw);
+	    if (thud)
+		play_sound(ss,SOUND_THUD,0);
+	    *delay = 0;
+	    return check_tetris(g) ? 1 : 2;
+	} else if (determine_falling(&g[0])) {
+	    s->state[P].slide_at = at + 1;
+	    *delay = 1;
+	    return 3;
+	} else {
+	    s->score[P] += s->state[P].num_lines_cleared *
+		s->state[P].num_lines_cleared * level;
+	    if (sock) {
+		char msg = 's'; /* WRW: send update */
+		send(sock,&msg,1,0);
+		send(sock,(char *)&s->score[P],sizeof(s->score[P]),0);
+		if (s->state[P].num_lines_cleared >= 5) {
+		    char msg = 'g'; /* WRW: send garbage! */
+		    send(sock,&msg,1,0);
+		    s->state[P].num_lines_cleared -= 4; /* might possibly also blank! */
+		}
+		if (s->state[P].num_lines_cleared >= 3) {
+		    int i;
+		    for (i=3;i<=s->state[P].num_lines_cleared;i++) {
+			char msg = 'b'; /* WRW: send blanking! */
+			send(sock,&msg,1,0);
+		    }
+		}
+	    } else {
+		if (s->state[P].num_lines_cleared >= 5) {
+		    *garbage = 1;
+		    s->state[P].num_lines_cleared -= 4;
+		}
+		if (s->state[P].num_lines_cleared >= 3) {
+		    *blank = (s->state[P].num_lines_cleared - 2);
+		}
+	    }
+	    if (EVENT_DRAWS(s,P))
+		draw_score(s, screen,P);
+	    s->state[P].num_lines_cleared = 0;
+	    return 0;
+	}
+    } else if (count == 3) {
+	Sint32 age = at - s->state[P].slide_at;
+
+	if (age < RENDER_SLIDE && EVENT_WATCHED(s,P)) {
+	    if (draw) {
+		draw_falling(screen, cs->w, &g[0],
+			max(1, age * cs->h / RENDER_SLIDE));
+		*delay = min(TETRIS_SLIDE_STEP, RENDER_SLIDE - age);
+	    } else	/* the render thread does the in-betweens */
+		*delay = RENDER_SLIDE - age;
+	    return 3;
+	}
+	/* down the whole row: it lands */
+	fall_down(g);
+	draw_grid(screen,cs,g,draw);
+	if (run_gravity(g))
+	    play_sound(ss,SOUND_THUD,0);
+	/*
+	*delay = max(fall_event_interval / 5,4);
+	*/
+	*delay = EVENT_WATCHED(s,P) ? 4 : 0; 
+	if (determine_falling(&g[0])) {
+	    s->state[P].slide_at = at + *delay;
+	    return 3;
+	}
+	if (check_tetris(g))
+	    return 1;
+	else /* cannot be 0: we must redraw without falling */
+	    return 2;
+    }
+    return 0;	/* not done yet */
+}
+
+/***************************************************************************
+ *      do_blank()
+ * Blank the visual screen of the given (local) player. 
+ ***************************************************************************/
+static void
+do_blank(Session *s, SDL_Surface *screen, sound_style *ss[], Grid g[], int P)
+{
+    play_sound(ss[P],SOUND_GARBAGE1,1);
+    if (s->state[P].draw) {
+	s->state[P].next_draw = event_ticks(s) + 1000;
+	s->state[P].draw_timeout = 1000;
+	if (EVENT_DRAWS(s,P)) {
+	    SDL_FillRect(screen, &g[P].board, 
+		    SDL_MapRGB(screen->format,32,32,32));
+	    SDL_UpdateSafe(screen, 1, &g[P].board);
+	}
+    }  else {
+	s->state[P].next_draw += 1000;
+	s->state[P].draw_timeout += 1000;
+    }
+    { int i,j;
+	for (j=0;j<g[0].h;j++)
+	    for (i=0;i<g[0].w;i++)
+		GRID_CHANGED(s->distract[P],i,j) = 0;
+    }
+    s->state[P].draw = 0;
+    timer_set(&s->timers, EVENT_TIMER(P, EVENT_BLANK), event_ticks(s));
+}
+
+/***************************************************************************
+ *      event_target()
+ * Whom player P's garbage and blanks go to: the next of the n boards
+ * after the one that got them last that is still in the match, or -1 if
+ * there is nobody left. With two players it is always the other one.
+ ***************************************************************************/
+static int
+event_target(Session *s, int P, int n, int adjust[])
+{
+    int i, Q = s->state[P].target;
+
+    for (i=0; i<n; i++) {
+	Q = (Q + 1) % n;
+	if (Q != P && adjust[Q] == -1)
+	    return s->state[P].target = Q;
+    }
+    return -1;
+}
+
+/***************************************************************************
+ *      event_standing()
+ * How many of the n boards are still in the match.
+ ***************************************************************************/
+static int
+event_standing(int n, int adjust[])
+{
+    int Q, standing = 0;
+
+    for (Q=0; Q<n; Q++)
+	if (adjust[Q] == -1)
+	    standing++;
+    return standing;
+}
+
+/***************************************************************************
+ *      event_retire()
+ * Takes board P out of play: it is knocked out (or waiting on the network
+ * opponent) and nothing more happens to it but the end of a distraction.
+ ***************************************************************************/
+static void
+event_retire(Session *s, int P)
+{
+    int i;
+
+    s->state[P].falling = 0;
+    s->state[P].fall_speed = 0;
+    s->state[P].tetris_handling = 0;
+    s->state[P].accept_input = 0;
+    s->state[P].limbo = 1;
+    for (i=0; i<EVENT_TIMERS; i++)
+	if (i != EVENT_BLANK)
+	    timer_cancel(&s->timers, EVENT_TIMER(P, i));
+}
+
+/***************************************************************************
+ *      event_clock_sound()
+ * Starts or stops the last-thirty-seconds ticking for the n local boards.
+ ***************************************************************************/
+static void
+event_clock_sound(sound_style *ss[], int n, int on)
+{
+    int Q;
+
+    for (Q=0; Q<n; Q++)
+	if (on)
+	    play_sound_unless_already_playing(ss[Q],SOUND_CLOCK,0);
+	else
+	    stop_playing_sound(ss[Q],SOUND_CLOCK);
+}
+
+/***************************************************************************
+ *      event_show_piece()
+ * Draws player P's piece where it has moved to, if it has moved.
+ ***************************************************************************/
+static void
+event_show_piece(Session *s, SDL_Surface *screen, color_style *cs, int P)
+{
+    Player_State *st = &s->state[P];
+    Player_Pos *pos = &s->pos[P];
+
+    if (!st->falling || !st->draw || !EVENT_DRAWS(s,P))
+	return;
+    if (pos->old_x != pos->x || pos->old_y != pos->y || pos->old_rot != pos->rot) {
+	draw_play_piece(screen, cs, &st->cp, pos->old_x, pos->old_y, pos->old_rot,
+		&st->cp, pos->x, pos->y, pos->rot);
+	pos->old_x = pos->x; pos->old_y = pos->y; pos->old_rot = pos->rot;
+    }
+}
+
+/***************************************************************************
+ *      bomb_fun()
+ * Function for the bomb special piece.
+ ***************************************************************************/
+static void
+bomb_fun(int x, int y, Grid *g, int color) 
+{
+    if ((x<0 || y<0 || x>=g->w || y>=g->h)) 
+	return;
+    GRID_SET(*g,x,y,REMOVE_ME);
+}
+
+/***************************************************************************
+ *      colorkill_fun()
+ * Function for the repainting special piece.
+ ***************************************************************************/
+static void
+colorkill_recurse(int x, int y, Grid *g, int target_color)
+{
+    if ((x<0 || y<0 || x>=g->w || y>=g->h)) 
+	return;
+    GRID_CHANGED(*g,x,y) = 1;
+    if (GRID_CONTENT(*g,x,y) != target_color) return;
+    GRID_SET(*g,x,y,REMOVE_ME);
+    colorkill_recurse(x - 1, y, g, target_color);
+    colorkill_recurse(x + 1, y, g, target_color);
+    colorkill_recurse(x, y - 1, g, target_color);
+    colorkill_recurse(x, y + 1, g, target_color);
+}
+
+static void
+colorkill_fun(int x, int y, Grid *g, int color)
+{
+    int c;
+    if ((x<0 || y<0 || x>=g->w || y>=g->h)) 
+	return;
+    GRID_CHANGED(*g,x,y) = 1;
+    c = GRID_CONTENT(*g,x,y);
+    if (c <= 1 || c == REMOVE_ME) return;
+    GRID_SET(*g,x,y,REMOVE_ME);
+    colorkill_recurse(x - 1, y, g, c);
+    colorkill_recurse(x + 1, y, g, c);
+    colorkill_recurse(x, y - 1, g, c);
+    colorkill_recurse(x, y + 1, g, c);
+}
+
+/***************************************************************************
+ *      repaint_fun()
+ * Function for the repainting special piece: paints in "color".
+ ***************************************************************************/
+static void
+repaint_fun(int x, int y, Grid *g, int color) 
+{
+    int c;
+    if ((x<0 || y<0 || x>=g->w || y>=g->h)) 
+	return;
+    GRID_CHANGED(*g,x,y) = 1;
+    c = GRID_CONTENT(*g,x,y);
+    if (c <= 1 || c == color) return;
+    GRID_SET(*g,x,y,color);
+    repaint_fun(x - 1, y, g, color);
+    repaint_fun(x + 1, y, g, color);
+    repaint_fun(x, y - 1, g, color);
+    repaint_fun(x, y + 1, g, color);
+}
+
+/***************************************************************************
+ * 	push_down()
+ * Teleport all of the pieces just below this special piece as far down as
+ * they can go in their column. 
+ ***************************************************************************/
+static void
+push_down(play_piece *pp, int col, int row, int rot, Grid *g,
+	void (*fun)(int, int, Grid *, int))
+{
+    int i,j,c;
+    int place_y, look_y;
+
+    for (j=0;j<pp->base->dim;j++)
+	for (i=0;i<pp->base->dim;i++) 
+	    if ((c=BITMAP(*pp->base,rot,i,j))) {
+		int t_x = i + col;
+		int t_y = j + row;
+		if ((t_x<0 || t_y<0 || t_x>=g->w || t_y>=g->h)) {
+		    continue;
+		}
+		GRID_SET(*g,t_x,t_y,REMOVE_ME);
+		look_y = t_y + 1;
+		if (look_y >= g->h) continue;
+		if (!GRID_CONTENT(*g,t_x,look_y)) continue;
+		/* OK, try to move look_y down as far as possible */
+		for (place_y = g->h-1; 
+			place_y > look_y &&
+			GRID_CONTENT(*g,t_x,place_y) != 0;
+			place_y --)
+		    ;
+		if (place_y == look_y) continue;
+		/* otherwise, valid swap! */
+		if (place_y < 0 || place_y >= g->h) 
+		    continue;
+		if (look_y < 0 || look_y >= g->h) 
+		    continue;
+		GRID_SET(*g,t_x,place_y, GRID_CONTENT(*g,t_x,look_y));
+		GRID_SET(*g,t_x,look_y, REMOVE_ME);
+	    }
+}
+
+/***************************************************************************
+ *      find_on_board()
+ * Finds where on the board a piece would go: used by special piece
+ * handling routines. "color" is passed on to fun.
+ ***************************************************************************/
+static void
+find_on_board(play_piece *pp, int col, int row, int rot, Grid *g,
+	void (*fun)(int, int, Grid *, int), int color)
+{
+    int i,j,c;
+
+    for (j=0;j<pp->base->dim;j++)
+	for (i=0;i<pp->base->dim;i++) 
+	    if ((c=BITMAP(*pp->base,rot,i,j))) {
+		int t_x = i + col;
+		int t_y = j + row; 
+		if ((t_x<0 || t_y<0 || t_x>=g->w || t_y>=g->h)) {
+		    continue;
+		}
+		GRID_SET(*g,t_x,t_y,REMOVE_ME);
+	    }
+
+    for (j=0;j<pp->base->dim;j++)
+	for (i=0;i<pp->base->dim;i++) 
+	    if ((c=BITMAP(*pp->base,rot,i,j))) {
+		int t_x = i + col; 
+		int t_y = j + row;
+		if ((t_x<0 || t_y<0 || t_x>=g->w || t_y>=g->h)) {
+		    continue;
+		}
+		fun(t_x - 1, t_y, g, color);
+		fun(t_x + 1, t_y, g, color);
+		fun(t_x, t_y - 1, g, color);
+		fun(t_x, t_y + 1, g, color);
+	}
+    return;
+}
+
+/***************************************************************************
+ *      most_common_color()
+ * Finds the most common (non-zero, non-garbage) color on the board. If
+ * none, returns the garbage color. 
+ ***************************************************************************/
+static int
+most_common_color(Grid *g)
+{
+    int count[256];
+    int x,y,c;
+    int max, max_count;
+
+    memset(count,0, sizeof(count));
+    for (x=0;x<g->w;x++)
+	for (y=0;y<g->h;y++) {
+	    c = GRID_CONTENT(*g,x,y);
+	    if (c > 1) 
+		count[c]++;
+	}
+    max = 1;
+    max_count = 0;
+    for (x=2;x<256;x++) 
+	if (count[x] > max_count) {
+	    max = x;
+	    max_count = count[x];
+	}
+    return max;
+}
+
+/***************************************************************************
+ *      handle_special()
+ * Change the state of the grid based on the magical special piece ...
+ * pp has just landed at (col, row) in rotation rot on g; ss, if not
+ * NULL, makes the noise.
+ *********************************************************************PROTO*/
+void
+handle_special(play_piece *pp, int row, int col, int rot, Grid *g,
+	sound_style *ss)
+{
+    switch (pp->special) {
+	case No_Special: break;
+	case Special_Bomb: 
+			 find_on_board(pp, col, row, rot, g, bomb_fun, 0);
+			 if (ss) 
+			     play_sound(ss,SOUND_CLEAR1,256);
+			 break;
+	case Special_Repaint: 
+			 find_on_board(pp, col, row, rot, g, repaint_fun,
+				 most_common_color(g));
+			 if (ss) 
+			     play_sound(ss,SOUND_GARBAGE1,256);
+			 break;
+	case Special_Pushdown: 
+			 push_down(pp, col, row, rot, g, repaint_fun);
+			 if (ss) 
+			     play_sound(ss,SOUND_THUD,256*2);
+			 break;
+	case Special_Colorkill: 
+			 find_on_board(pp, col, row, rot, g, colorkill_fun, 0);
+			 if (ss) 
+			     play_sound(ss,SOUND_CLEAR1,256);
+			 break;
+
+    }
+}
+
+/***************************************************************************
+ *      do_pause()
+ * Change the pause status of the local player. Every deadline is in game
+ * ticks, so unpausing just takes the pause off the game clock.
+ ***************************************************************************/
+static void
+do_pause(Session *s, int paused, Uint32 *pause_begin_time)
+{
+    render_lock();
+    render_pause(paused);
+    draw_pause(s, paused);
+    render_unlock();
+    if (!paused) 
+	s->paused_ticks += SDL_GetTicks() - *pause_begin_time;
+    else 
+	*pause_begin_time = SDL_GetTicks();
+}
+
+/***************************************************************************
+ *      place_this_piece()
+ * Given that the player's current piece structure is already chosen, try
+ * to place it near the top of the board. this may involve shifting it up 
+ * a bit or rotating it or something. 
+ *
+ * Returns 0 on success. 
+ ***************************************************************************/
+static int
+place_this_piece(Session *s, int P, int blockWidth, Grid g[])
+{
+    int Y, R;
+    /* we'll try Y adjustments from -2 to 0 and rotations from 0 to 3 */
+
+    s->pos[P].x = s->pos[P].old_x = g[P].board.x + g[P].board.w / 2;
+    s->state[P].fall_dy = 0;
+    for (Y = 0; Y >= -2 ; Y --) {
+	for (R = 0; R <= 3; R++) {
+	    s->pos[P].y = s->pos[P].old_y = g[P].board.y + (blockWidth * Y);
+	    s->pos[P].old_rot = s->pos[P].rot = R;
+	    if (valid_screen_position(&s->state[P].cp, blockWidth,
+			&g[P], s->pos[P].rot, s->pos[P].x, s->pos[P].y)) {
+		return 0;
+	    }
+	}
+    }
+    return 1;	/* no valid position! */
+}
+
+/***************************************************************************
+ *      do_move()
+ * Carries out whatever move player Q has waiting in s->pos[Q].move.
+ ***************************************************************************/
+static void
+do_move(Session *s, int Q, int blockWidth, Grid g[])
+{
+    int i;
+
+    if (s->pos[Q].move != MOVE_NONE)
+	s->state[Q].fall_dy = 0;	/* show it where it is now */
+    switch (s->pos[Q].move) {
+	case MOVE_ROTATE: 
+	    s->state[Q].ready_for_rotate = 0;
+	    if (valid_screen_position(&s->state[Q].cp,blockWidth,&g[Q],(s->pos[Q].rot+1)%4,s->pos[Q].x,s->pos[Q].y)) {
+		s->pos[Q].rot = (s->pos[Q].rot+1)%4; 
+		s->state[Q].collide_time = 0;
+	    } else if (valid_screen_position(&s->state[Q].cp,blockWidth,&g[Q],(s->pos[Q].rot+1)%4,
+			s->pos[Q].x-blockWidth,s->pos[Q].y)) {
+		s->pos[Q].rot = (s->pos[Q].rot+1)%4; 
+		s->pos[Q].x -= blockWidth;
+		s->state[Q].collide_time = 0;
+	    } else if (valid_screen_position(&s->state[Q].cp,blockWidth,&g[Q],(s->pos[Q].rot+1)%4,
+			s->pos[Q].x+blockWidth,s->pos[Q].y)) {
+		s->pos[Q].rot = (s->pos[Q].rot+1)%4; 
+		s->pos[Q].x += blockWidth;
+		s->state[Q].collide_time = 0;
+	    } else if (valid_screen_position(&s->state[Q].cp,blockWidth,&g[Q],(s->pos[Q].rot+1)%4,
+			s->pos[Q].x,s->pos[Q].y+blockWidth)) {
+		s->pos[Q].rot = (s->pos[Q].rot+1)%4; 
+		s->pos[Q].y += blockWidth;
+		s->state[Q].collide_time = 0;
+	    } else if (Options.upward_rotation &&
+		    valid_screen_position(&s->state[Q].cp,blockWidth,
+			&g[Q],(s->pos[Q].rot+1)%4, s->pos[Q].x,
+			s->pos[Q].y-blockWidth)) {
+		s->pos[Q].rot = (s->pos[Q].rot+1)%4; 
+		s->pos[Q].y -= blockWidth;
+		s->state[Q].collide_time = 0;
+	    }
+	    s->pos[Q].move = MOVE_NONE;
+	    break;
+	case MOVE_LEFT:
+	    for (i=0;i<10;i++) 
+		if (valid_screen_position(&s->state[Q].cp,blockWidth,
+			    &g[Q],s->pos[Q].rot,
+			    s->pos[Q].x-blockWidth,
+			    s->pos[Q].y+i)) {
+		    s->pos[Q].x -= blockWidth;
+		    s->pos[Q].y += i;
+		    s->state[Q].collide_time = 0;
+		    break;
+		}
+	    s->pos[Q].move = MOVE_NONE;
+	    break;
+	case MOVE_RIGHT:
+	    for (i=0;i<10;i++)
+		if (valid_screen_position(&s->state[Q].cp,blockWidth,&g[Q],s->pos[Q].rot,
+			    s->pos[Q].x+blockWidth,s->pos[Q].y+i)){
+		    s->pos[Q].x += blockWidth;
+		    s->pos[Q].y += i;
+		    s->state[Q].collide_time = 0;
+		    break;
+		}
+	    s->pos[Q].move = MOVE_NONE;
+	    break;
+	case MOVE_DOWN:
+	    if (valid_screen_position(&s->state[Q].cp,blockWidth,&g[Q],s->pos[Q].rot,
+			s->pos[Q].x, s->pos[Q].y+blockWidth))
+		s->pos[Q].y+=blockWidth;
+	    s->state[Q].fall_speed = 20;
+	    s->state[Q].ready_for_fast = 0;
+	    s->pos[Q].move = MOVE_NONE;
+	    break;
+	default: 
+	    break;
+    }
+}
+
+/***************************************************************************
+ *      ai_overlay()
+ * Puts what player P's AI has been up to under its name (--ai-overlay):
+ * how much work each piece took, how often it had nothing left to do and
+ * how much of the time to spare the AIs have been using.
+ ***************************************************************************/
+static void
+ai_overlay(Session *s, int P, AI_Counters *c)
+{
+    char buf[3][80];
+    char *line[3] = { buf[0], buf[1], buf[2] };
+    double pieces = c->decisions ? c->decisions : 1;
+
+    sprintf(buf[0], "%.0f drops %.0f evals / piece",
+	    c->drops / pieces, c->evals / pieces);
+    sprintf(buf[1], "%lu%% settled  %lu overruns",
+	    c->thinks ? 100 * c->settled / c->thinks : 0, c->overruns);
+    sprintf(buf[2], "%.0f%% of slack used  %lu late",
+	    s->sched.slack > 0 ? 100.0 * s->sched.used / s->sched.slack : 0.0, 
+	    s->sched.late);
+    draw_ai_overlay(s, P, line, 3);
+}
+
+/***************************************************************************
+ *      event_phase()
+ * The event loop goes on to the given phase (see session.h): what it was
+ * doing until now is added to what that took this pass.
+ ***************************************************************************/
+static void
+event_phase(Session *s, int phase)
+{
+    Phase_Stats *p = &s->phases;
+    double now = sim_now();
+
+    if (p->on >= 0)
+	p->spent[p->on] += now - p->since;
+    if (p->spent[phase] < 0)
+	p->spent[phase] = 0;
+    p->on = phase;
+    p->since = now;
+}
+
+/***************************************************************************
+ *      event_pass()
+ * A pass through the event loop is over: into the histograms with what
+ * it took, unless "keep" says it was not a real one (the time since the
+ * last game, say).
+ ***************************************************************************/
+static void
+event_pass(Session *s, int keep)
+{
+    Phase_Stats *p = &s->phases;
+    double now = sim_now();
+    int i;
+
+    if (p->on >= 0 && keep) {
+	p->spent[p->on] += now - p->since;
+	for (i=0; i<PHASE_PASS; i++)
+	    if (p->spent[i] >= 0)
+		latency_add(&p->hist[i], (Uint32) (p->spent[i] * 1000000.0));
+	latency_add(&p->hist[PHASE_PASS], (Uint32) ((now - p->pass) * 1000000.0));
+    }
+    for (i=0; i<PHASE_PASS; i++)
+	p->spent[i] = -1;
+    p->on = -1;
+    p->pass = now;
+}
+
+/***************************************************************************
+ *      event_dump()
+ * Writes every histogram in session s to EVENT_LATENCY_FILE, for whoever
+ * wants to know where the frame time went: see latency_write().
+ ***************************************************************************/
+static void
+event_dump(Session *s)
+{
+    FILE *fout = fopen(EVENT_LATENCY_FILE, "wt");
+    int i;
+
+    if (!fout) {
+	Debug("fopen(%s): cannot write the latencies.\n", EVENT_LATENCY_FILE);
+	return;
+    }
+    fprintf(fout, "# Alizarin Tetris event loop, in microseconds\n"
+	    "# phase\tat most\tcount\tfraction\n");
+    for (i=0; i<PHASES; i++)
+	latency_write(fout, phase_name[i], &s->phases.hist[i]);
+    fclose(fout);
+    Debug("Latencies written to [%s].\n", EVENT_LATENCY_FILE);
+}
+
+/***************************************************************************
+ *      event_report()
+ * Says how the slack was spent, how long input waited before it was
+ * acted on and how long each phase of the event loop took, over every game
+ * in session s; called on the way out.
+ *********************************************************************PROTO*/
+void
+event_report(Session *s)
+{
+    unsigned long *b = s->input_lag.bucket;
+    int i;
+
+    if (s->sched.windows)
+	Debug("Slack: %.1f s in %lu gaps, %.0f%% to the AIs; %lu deadlines "
+		"missed by %.2f ms on average, %.2f ms at worst.\n",
+		s->sched.slack, s->sched.windows,
+		100.0 * s->sched.used / s->sched.slack, s->sched.late,
+		s->sched.late ? 1000.0 * s->sched.overrun / s->sched.late : 0.0,
+		1000.0 * s->sched.worst);
+    if (s->input_lag.events)
+	Debug("Input: %lu events waited %.2f ms on average, %u ms at worst "
+		"(<1 ms %lu, <2 %lu, <5 %lu, <10 %lu, more %lu).\n",
+		s->input_lag.events, s->input_lag.total / s->input_lag.events,
+		(unsigned) s->input_lag.worst, b[0], b[1], b[2], b[3], b[4]);
+    for (i=0; i<PHASES; i++) {
+	Latency *h = &s->phases.hist[i];
+
+	if (h->n)
+	    Debug("%-9s %8lu, %6.0f us on average, 50%% %lu, 99%% %lu, "
+		    "99.9%% %lu, worst %lu.\n", phase_name[i], h->n,
+		    h->total / h->n, (unsigned long) latency_at(h, 0.5),
+		    (unsigned long) latency_at(h, 0.99),
+		    (unsigned long) latency_at(h, 0.999),
+		    (unsigned long) h->worst);
+    }
+}
+
+/***************************************************************************
+ *      sched_slack()
+ * Nothing has to happen before game tick "least", the next timer due.
+ * The AIs get that time, a think() at a time and in turn, as long as
+ * each one's recent cost still fits before the deadline and nobody has
+ * pressed a key. Once they are settled we sleep till then, unless a key
+ * or something from sock comes first: see idle_wait().
+ ***************************************************************************/
+static void
+sched_slack(Session *s, Uint32 least, piece_style *ps, color_style *cs[],
+	Grid g[], AI_Player *AI[], int blockWidth, int NUM_PLAYER, int sock)
+{
+    Uint32 tv_now = event_ticks(s);
+    double now = sim_now(), deadline, before;
+    int Q, busy = 1;
+
+    if ((Sint32) (least - tv_now) <= 0)
+	return;
+    deadline = now + (least - tv_now) / 1000.0;
+    s->sched.windows++;
+    s->sched.slack += deadline - now;
+
+    while (busy && !input_gather(s)) {
+	busy = 0;
+	for (Q=0; Q<NUM_PLAYER; Q++) {
+	    int row, col;
+
+	    if (!s->state[Q].ai || !s->state[Q].draw || s->state[Q].book ||
+		    s->state[Q].limbo || now + s->state[Q].think_cost > deadline)
+		continue;
+	    screen_to_grid_coords(&g[Q], blockWidth, s->pos[Q].x, s->pos[Q].y,
+		    &row, &col);
+	    sim_set_styles(ps, cs[Q]);
+	    before = now;
+	    event_phase(s, PHASE_THINK);
+	    busy |= ai_think(AI[Q], &s->state[Q].ai_counters, s->state[Q].ai_state,
+		    &g[Q], &s->state[Q].cp, &s->state[Q].np, col, row, s->pos[Q].rot);
+	    event_phase(s, PHASE_SLEEP);
+	    now = sim_now();
+	    s->state[Q].think_cost += (now - before - s->state[Q].think_cost) / 8;
+	    s->sched.used += now - before;
+	    if (now > deadline) {
+		s->sched.late++;
+		s->sched.overrun += now - deadline;
+		if (now - deadline > s->sched.worst)
+		    s->sched.worst = now - deadline;
+		return;
+	    }
+	}
+    }
+
+    tv_now = event_ticks(s);
+    if ((Sint32) (least - tv_now) > 0 && !input_gather(s))
+	idle_wait(least - tv_now, sock);
+}
+
+/***************************************************************************
+ *      turbo_draw()
+ * Draws the boards over from scratch, for turbo without a render thread.
+ ***************************************************************************/
+static void
+turbo_draw(Session *s, SDL_Surface *screen, color_style *cs[], Grid g[], 
+	int NUM_PLAYER, int seconds)
+{
+    int Q, i, j;
+
+    for (Q=0; Q<NUM_PLAYER && Q<s->layout.boards; Q++) {
+	Grid *b = s->state[Q].draw ? &g[Q] : &s->distract[Q];
+
+	SDL_FillRect(screen, &g[Q].board, s->state[Q].draw ? int_solid_black :
+		SDL_MapRGB(screen->format,32,32,32));
+	for (i=0; i<b->w; i++)
+	    for (j=0; j<b->h; j++)
+		GRID_CHANGED(*b,i,j) = 1;
+	draw_grid(screen, cs[Q], b, 1);
+	if (s->state[Q].draw && s->state[Q].falling)
+	    draw_play_piece(screen, cs[Q], &s->state[Q].cp, s->pos[Q].x, s->pos[Q].y,
+		    s->pos[Q].rot, &s->state[Q].cp, s->pos[Q].x, s->pos[Q].y, s->pos[Q].rot);
+	SDL_UpdateSafe(screen, 1, &g[Q].board);
+	draw_score(s, screen, Q);
+    }
+    draw_clock(s, seconds);
+}
+
+/***************************************************************************
+ *      event_frame()
+ * Copies what the boards look like now into the render thread's next
+ * frame and hands it over. Boards past NUM_PLAYER are the network
+ * opponent's, of which we only ever see the squares. In turbo this only
+ * happens every Options.turbo passes, and draws the next pieces too.
+ ***************************************************************************/
+static void
+event_frame(Session *s, SDL_Surface *screen, piece_style *ps,
+	color_style *cs[], Grid g[], int NUM_PLAYER, int sock, Uint32 tv_now, int seconds)
+{
+    Render_Frame *f = render_frame();
+    int Q, i, nboard = min(NUM_PLAYER + (sock != 0), s->layout.boards);
+
+    if (s->turbo.on) {
+	if (s->turbo.passes++ % Options.turbo)
+	    return;
+	s->turbo.drawn++;
+	render_lock();
+	for (Q=0; Q<NUM_PLAYER; Q++)
+	    draw_next_piece(s, screen, ps, cs[Q], &s->state[Q].cp, &s->state[Q].np, Q);
+	render_unlock();
+	if (f == NULL)
+	    turbo_draw(s, screen, cs, g, NUM_PLAYER, seconds);
+    }
+    if (f == NULL)
+	return;
+    f->seconds = seconds;
+    f->at = SDL_GetTicks();
+    for (Q=0; Q<nboard; Q++) {
+	Render_Board *b = &f->b[Q];
+	int n = g[Q].w * g[Q].h;
+
+	for (i=0; i<n; i++)
+	    b->contents[i] = g[Q].contents[i] == REMOVE_ME ? 0 :
+		g[Q].contents[i];
+	memcpy(b->fall, g[Q].fall, n);
+	b->score = s->score[Q];
+	b->blank = -1;
+	b->slide_age = -1;
+	b->piece = 0;
+	if (Q >= NUM_PLAYER)
+	    continue;
+	if (!s->state[Q].draw) {
+	    /* the distraction comes down a row at a time */
+	    int delta = s->state[Q].next_draw - tv_now;
+	    b->blank = g[Q].h - (g[Q].h * delta) / s->state[Q].draw_timeout;
+	    b->blank = max(1, min(b->blank, g[Q].h));
+	    continue;
+	}
+	/* sliding down a row: see tetris_event() */
+	if (s->state[Q].tetris_handling == 3)
+	    b->slide_age = tv_now - s->state[Q].slide_at;
+	if (s->state[Q].falling) {
+	    b->piece = 1;
+	    b->cp = s->state[Q].cp;
+	    b->x = s->pos[Q].x;
+	    b->y = s->pos[Q].y;
+	    b->rot = s->pos[Q].rot;
+	    b->fall_dy = s->turbo.on ? 0 : s->state[Q].fall_dy;
+	    b->fall_age = tv_now - s->state[Q].fell_at;
+	    b->fall_interval = s->state[Q].fall_event_interval;
+	}
+    }
+    render_publish();
+}
+
+/***************************************************************************
+ *      event_play()
+ * The main event-processing dispatch loop: see event_loop().
+ ***************************************************************************/
+#define		NO_PLAYER	0
+#define		HUMAN_PLAYER	1
+#define		AI_PLAYER	2
+#define		NETWORK_PLAYER	3
+static int
+event_play(Session *s, SDL_Surface *screen, piece_style *ps,
+	color_style *cs[], sound_style *ss[], Grid g[], int level[], int sock,
+	int *seconds_remaining, int time_is_hard_limit,
+	int adjust[], int (*handle)(const SDL_Event *), 
+	int seed, int who[], AI_Player *AI[])
+{
+    SDL_Event event;
+    Uint32 tv_now, tv_start, next; 
+    int NUM_PLAYER = 0;
+    int NUM_KEYBOARD = 0;
+    int keyboard[2];	/* the boards the wasd and the arrow keys move */
+    int last_seconds = -1;
+    int minimum_fall_event_interval = 100;
+    int paused = 0;
+    Uint32 pause_begin_time = 0;
+
+    /* measured in milliseconds, 25 frames per second:
+     * 1 frame = 40 milliseconds
+     */
+    int blockWidth = cs[0]->w;
+    int i,j,P, Q;
+
+    SDL_EnableKeyRepeat(SDL_DEFAULT_REPEAT_DELAY/Options.key_repeat_delay,
+	    SDL_DEFAULT_REPEAT_INTERVAL/2);
+
+    if (s->gametype != DEMO)
+	stop_all_playing(); 
+
+    memset(s->pos, 0, sizeof(s->pos));
+    memset(s->state, 0, sizeof(s->state));
+
+    /* the local boards come first, the network opponent's (if any) last */
+    Assert(s->boards >= 1 && s->boards <= MAX_PLAYERS);
+    keyboard[0] = keyboard[1] = 0;
+    for (P=0; P<s->boards; P++)
+	switch (who[P]) {
+	    case HUMAN_PLAYER: Assert(!handle); Assert(NUM_KEYBOARD < 2);
+			       Assert(NUM_PLAYER == P);
+			       keyboard[NUM_KEYBOARD++] = P;
+			       NUM_PLAYER++; break;
+	    case AI_PLAYER: Assert(NUM_PLAYER == P);
+			    s->state[P].ai = 1; NUM_PLAYER++; break;
+	    case NETWORK_PLAYER: Assert(sock && P == 1 && s->boards == 2); break;
+	    default: PANIC("Board %d has nobody to play it!", P);
+	}
+    Assert(NUM_PLAYER >= 1);
+    if (NUM_KEYBOARD == 1)	/* both sets of keys move the one player */
+	keyboard[1] = keyboard[0];
+
+    if (s->timers.max == 0)
+	timer_init(&s->timers, MAX_PLAYERS * EVENT_TIMERS);
+    for (i=0; i<s->timers.max; i++)
+	timer_cancel(&s->timers, i);
+    s->paused_ticks = 0;
+    s->input.first = s->input.n = 0;	/* keys meant for the last game */
+
+    tv_start = tv_now = event_ticks(s);
+    tv_start += *seconds_remaining * 1000; 
+
+    for (P=0; P<NUM_PLAYER; P++) {
+	s->state[P].falling = 1;
+	s->state[P].fall_speed = 1;
+	s->state[P].tetris_handling = 0;
+	s->state[P].accept_input = 1;
+	s->state[P].limbo = 0;
+	s->state[P].draw = 1;
+	s->state[P].other_in_limbo = 0;
+	s->state[P].next_draw = 0;
+	s->state[P].limbo_sent = 0;
+	s->state[P].target = P;
+	s->state[P].cp = event_piece(s, ps, cs[P], seed);
+	s->state[P].np = event_piece(s, ps, cs[P], seed+1);
+	s->state[P].seed = seed+2;
+	s->state[P].ready_for_fast = 1;
+	s->state[P].ready_for_rotate = 1;
+
+	render_lock();
+	draw_next_piece(s, screen, ps, cs[P], &s->state[P].cp, &s->state[P].np, P);
+	render_unlock();
+
+	adjust[P] = -1;
+
+	if (SPEED_LEVEL(level[P]) <= 7)
+	    s->state[P].fall_event_interval = 45 - SPEED_LEVEL(level[P]) * 5;
+	else 
+	    s->state[P].fall_event_interval = 16 - SPEED_LEVEL(level[P]);
+	if (s->state[P].fall_event_interval < 1)
+	    s->state[P].fall_event_interval = 1;
+
+	if (s->state[P].fall_event_interval < minimum_fall_event_interval)
+	    minimum_fall_event_interval = s->state[P].fall_event_interval;
+
+	timer_set(&s->timers, EVENT_TIMER(P, EVENT_FALL), 
+		tv_now + s->state[P].fall_event_interval);
+
+	if (place_this_piece(s, P, blockWidth, g)) {
+	    /* failed to place piece initially ... */
+	    s->pos[P].x = s->pos[P].old_x = g[P].board.x + g[P].board.w / 2;
+	    s->pos[P].y = s->pos[P].old_y = g[P].board.y ;
+	    s->pos[P].rot = s->pos[P].old_rot = 0;
+	}
+
+	if (s->state[P].ai) {
+	    AI_Counters mark;
+	    timer_set(&s->timers, EVENT_TIMER(P, EVENT_AI_THINK), tv_now);
+	    timer_set(&s->timers, EVENT_TIMER(P, EVENT_AI_MOVE), tv_now);
+	    if (s->gametype == DEMO || s->gametype == AI_VS_AI ||
+		    AI[P]->delay_factor == 0) {
+		s->state[P].ai_interval = s->state[P].fall_event_interval;
+		if (s->state[P].ai_interval > 15)
+		    s->state[P].ai_interval = 15;
+	    } else {
+		if (AI[P]->delay_factor < 1)
+		    AI[P]->delay_factor = 1;
+		if (AI[P]->delay_factor > 100)
+		    AI[P]->delay_factor = 100;
+		s->state[P].ai_interval = AI[P]->delay_factor;
+	    }
+	    ai_counters_mark(&mark);
+	    s->state[P].ai_state = AI[P]->reset(s->state[P].ai_state, &g[P]);
+	    ai_counters_add(&s->state[P].ai_counters, &mark);
+	    sim_set_styles(ps, cs[P]);
+	    s->state[P].book = book_lookup(&g[P], 0, &s->state[P].cp,
+		    &s->state[P].np, &s->state[P].book_goal);
+	}
+    }
+
+
+    /* generate the fake-out grids: shown when an opponent does something
+     * good! (the last game's go first) */
+    for (P=0; P<NUM_PLAYER; P++) {
+	free_board(&s->distract[P]);
+	s->distract[P] = generate_board_r(g[P].w,g[P].h,g[P].h-2,
+		&s->random);
+	s->distract[P].board = g[P].board;
+	if (P == 0)	/* the colors start over from the seed */
+	    s->random = seed;
+	for (i=0;i<g[P].w;i++)
+	    for (j=0;j<g[P].h;j++) {
+		GRID_SET(s->distract[P],i,j,
+			FastRandom_r(&s->random, cs[P]->num_color));
+	    }
+    }
+
+    if (sock) { 
+	char msg = 'c'; /* WRW: send update */
+	send(sock,&msg,1,0);
+	send(sock,g[0].contents,sizeof(*g[0].contents)
+		* g[0].h * g[0].w,0); 
+		
+    }
+
+    if (!s->rendering) {
+	draw_clock(s, 0);
+
+	for (P=0; P<NUM_PLAYER && EVENT_DRAWS(s,P); P++) {
+	    draw_grid(screen,cs[P],&g[P],1);
+	    draw_score(s, screen, P);
+	}
+	if (sock)
+	    draw_score(s, screen, 1);
+    }
+
+    /* 
+     * Major State-Machine Event Loop
+     */
+
+    P = 0;
+    event_pass(s, 0);
+
+    while (1) { 
+
+	event_pass(s, 1);
+	tv_now = event_ticks(s);
+
+	/* this pass is for the board with the soonest thing due, if
+	 * anything is due yet */
+	if ((i = timer_next(&s->timers, &next)) >= 0 &&
+		(Sint32) (next - tv_now) <= 0)
+	    P = i / EVENT_TIMERS;
+
+	/* update the on-screen clock */
+	event_phase(s, PHASE_DRAW);
+	if (tv_start >= tv_now)
+	    * seconds_remaining = (tv_start - tv_now) / 1000;
+	else
+	    * seconds_remaining = - ((tv_now - tv_start) / 1000);
+
+	if (*seconds_remaining != last_seconds && !paused) {
+	    last_seconds = *seconds_remaining;
+	    if (!s->rendering)
+		draw_clock(s, *seconds_remaining);
+	    if (Options.ai_overlay) {
+		render_lock();
+		for (Q=0; Q<NUM_PLAYER; Q++)
+		    if (s->state[Q].ai) 
+			ai_overlay(s, Q, &s->state[Q].ai_counters);
+		render_unlock();
+	    }
+	    if (last_seconds <= 30 && last_seconds >= 0)
+		event_clock_sound(ss, NUM_PLAYER, 1);
+	}
+
+	/* check for time-out */
+	if (*seconds_remaining < 0 && time_is_hard_limit && !paused) { 
+	    for (Q=0; Q<NUM_PLAYER; Q++) {
+		play_sound(ss[Q],SOUND_LEVELDOWN,0);
+		adjust[Q] = ADJUST_DOWN;
+	    }
+	    event_clock_sound(ss, NUM_PLAYER, 0);
+	    return 0;
+	} 
+
+	/* 
+	 * 	User Interface Events: everything that has come in, in order,
+	 * 	each key acted on before the next one is looked at
+	 */
+
+	event_phase(s, PHASE_INPUT);
+	input_gather(s);
+	while (input_next(s, &event)) {
+
+	    /* special menu handling! */
+	    if (handle) {
+		int quit;
+		render_lock();
+		quit = handle(&event);
+		render_unlock();
+		if (quit)
+		    return -1;
+	    } else switch (event.type) {
+		case SDL_KEYUP:
+		    /* "down" will not affect you again until you release
+		     * the down key and press it again */
+		    if (event.key.keysym.sym == SDLK_DOWN)
+			s->state[keyboard[1]].ready_for_fast = 1;
+		    else if (event.key.keysym.sym == SDLK_UP)
+			s->state[keyboard[1]].ready_for_rotate = 1;
+		    else if (event.key.keysym.sym == SDLK_w)
+			s->state[keyboard[0]].ready_for_rotate = 1;
+		    else if (event.key.keysym.sym == SDLK_s)
+			s->state[keyboard[0]].ready_for_fast = 1;
+		    else if (event.key.keysym.sym == SDLK_1) {
+			P = 0;
+			goto you_win;
+		    }
+		    else if (event.key.keysym.sym == SDLK_2) {
+			P = 0;
+			goto you_lose;
+		    }
+		    else if (event.key.keysym.sym == SDLK_3) {
+			P = 1;
+			goto you_win;
+		    }
+		    else if (event.key.keysym.sym == SDLK_4) {
+			P = 1;
+			goto you_lose;
+		    } else if (event.key.keysym.sym == SDLK_p && s->gametype != DEMO) {
+			/* Pause it! */
+			paused = !paused;
+			if (sock) { 
+			    char msg = 'p'; /* WRW: send pause update */
+			    send(sock,&msg,1,0);
+			}
+			do_pause(s, paused, &pause_begin_time);
+		    }
+
+		    break;
+
+		case SDL_KEYDOWN:
+		    {
+			int ks = event.key.keysym.sym;
+			Q = -1;
+
+			/* the arrows are the second keyboard player's */
+			if (ks == SDLK_UP || ks == SDLK_DOWN ||
+				ks == SDLK_RIGHT || ks == SDLK_LEFT) {
+			    Q = keyboard[1];
+			} else if (ks == SDLK_w || ks == SDLK_s ||
+				ks == SDLK_a || ks == SDLK_d) {
+			    Q = keyboard[0];
+			} else if (ks == SDLK_q) {
+			    if (sock == 0) {
+				for (Q=0; Q<NUM_PLAYER; Q++)
+				    adjust[Q] = -1;
+				event_clock_sound(ss, NUM_PLAYER, 0);
+				return -1;
+			    } else {
+				/*
+				Debug("Entering Limbo: adjust down.\n");
+				*/
+				event_retire(s, 0);
+				adjust[0] = ADJUST_DOWN;
+			    }
+			} else if (ks == SDLK_F12) {
+			    event_dump(s);
+			    break;
+			} else if ((ks == SDLK_RETURN) && 
+                            ((event.key.keysym.mod & KMOD_LCTRL) ||
+                             (event.key.keysym.mod & KMOD_RCTRL))) {
+                          render_lock();
+                          SDL_WM_ToggleFullScreen(screen);
+                          render_unlock();
+                          break; 
+                        } else break;
+			if (NUM_KEYBOARD < 1) break;
+			/* humans cannot modify AI moves! */
+
+			Assert(Q >= 0 && Q < NUM_PLAYER && !s->state[Q].ai);
+
+			if (event.key.keysym.sym != SDLK_DOWN &&
+				event.key.keysym.sym != SDLK_s)
+			    s->state[Q].fall_speed = 1;
+			if (!s->state[Q].accept_input) {
+			    break;
+			}
+		    /* only if we are accepting input */
+			switch (event.key.keysym.sym) {
+			    case SDLK_UP: case SDLK_w: 
+				if (s->state[Q].ready_for_rotate)
+				    s->pos[Q].move = MOVE_ROTATE;
+				break;
+			    case SDLK_DOWN: case SDLK_s: 
+				if (s->state[Q].ready_for_fast)
+				    s->pos[Q].move = MOVE_DOWN;
+				break;
+			    case SDLK_LEFT: case SDLK_a: 
+				s->pos[Q].move = MOVE_LEFT; break;
+			    case SDLK_RIGHT: case SDLK_d: 
+				s->pos[Q].move = MOVE_RIGHT; break;
+			    default: 
+				PANIC("unknown keypress");
+			}
+		    }
+		    break;
+		case SDL_QUIT:
+		    Debug("Window-manager exit request.\n");
+		    for (Q=0; Q<NUM_PLAYER; Q++)
+			adjust[Q] = -1;
+		    event_clock_sound(ss, NUM_PLAYER, 0);
+		    return -1;
+		case SDL_SYSWMEVENT:
+		    break;
+	    } /* end: switch (event.type) */
+	    for (i=0; i<NUM_KEYBOARD; i++)
+		do_move(s, keyboard[i], blockWidth, g);
+	} 
+	for (i=0; i<NUM_KEYBOARD; i++)
+	    if (!paused)
+		event_show_piece(s, screen, cs[keyboard[i]], keyboard[i]);
+
+	/*
+	 * 	Visual Events
+	 */
+	event_phase(s, PHASE_DRAW);
+	if (s->state[P].draw)
+	    timer_cancel(&s->timers, EVENT_TIMER(P, EVENT_BLANK));
+	else if (!timer_due(&s->timers, EVENT_TIMER(P, EVENT_BLANK), tv_now) ||
+		paused)
+	    ;	/* nothing to do yet */
+	else if (tv_now > s->state[P].next_draw) {
+	    int i,j;
+	    s->state[P].draw = 1;
+	    timer_cancel(&s->timers, EVENT_TIMER(P, EVENT_BLANK));
+	    for (i=0;i<g[P].w;i++)
+		for (j=0;j<g[P].h;j++) {
+		    GRID_CHANGED(g[P],i,j) = 1;
+		    if (GRID_CONTENT(g[P],i,j) == 0)
+			GRID_SET(g[P],i,j,REMOVE_ME);
+		}
+	    draw_grid(screen,cs[P],&g[P],EVENT_DRAWS(s,P));
+	} else {
+	    /* unless we draw it, the rows come down by themselves (or
+	     * unseen): we need only come back when it is over */
+	    Uint32 next = s->state[P].next_draw + 1;
+
+	    if (EVENT_DRAWS(s,P)) {
+		int delta = s->state[P].next_draw - tv_now;
+		int amt = g[P].h - ((g[P].h * delta) / s->state[P].draw_timeout);
+		int i,j;
+		j = amt - 1;
+		if (j < 0) j = 0;
+		for (i=0;i<g[P].w;i++)
+		    GRID_CHANGED(s->distract[P],i,j) = 1;
+		draw_grid(screen,cs[P],&s->distract[P],1);
+		if (next - tv_now > s->state[P].draw_timeout / g[P].h)
+		    next = tv_now + max(1, s->state[P].draw_timeout / g[P].h);
+	    }
+	    timer_set(&s->timers, EVENT_TIMER(P, EVENT_BLANK), next);
+	}
+
+	/* 
+	 *	Falling Events
+	 */
+
+	if (!s->state[P].falling)
+	    timer_cancel(&s->timers, EVENT_TIMER(P, EVENT_FALL));
+	else if (timer_due(&s->timers, EVENT_TIMER(P, EVENT_FALL), tv_now) &&
+		!paused) {
+	    int try, steps = 0;
+	    int we_fell = 0;
+	    Uint32 next = timer_when(&s->timers, EVENT_TIMER(P, EVENT_FALL));
+
+	    event_phase(s, PHASE_FALL);
+	    if (!s->turbo.on)	/* where it is never late */
+		latency_add(&s->phases.hist[PHASE_LATE], (tv_now - next) * 1000);
+#if DEBUG
+	    if (tv_now > next) 
+		Debug("Fall: %d %d\n", tv_now, tv_now - next);
+#endif
+
+	    /* ok, we had a falling event: one step for every one due */
+	    s->state[P].fall_dy = 0;
+	    do {
+		we_fell = 0;
+		for (try = s->state[P].fall_speed; try > 0; try--)
+		    if (valid_screen_position(&s->state[P].cp,blockWidth,&g[P],s->pos[P].rot,s->pos[P].x,s->pos[P].y+try)) {
+			s->pos[P].y += try;
+			s->state[P].fall_dy += try;
+			s->state[P].fall_speed = try;
+			try = 0;
+			we_fell = 1;
+		    }
+		s->state[P].fell_at = next;
+		next += s->state[P].fall_event_interval;
+	    } while (we_fell && (Sint32) (next - tv_now) <= 0 &&
+		    ++steps < EVENT_CATCH_UP);
+	    if ((Sint32) (next - tv_now) <= 0)	/* too far behind: let it go */
+		next = tv_now + s->state[P].fall_event_interval;
+	    timer_set(&s->timers, EVENT_TIMER(P, EVENT_FALL), next);
+
+	    if (!we_fell) {
+		if (!s->state[P].collide_time) {
+		    s->state[P].collide_time = tv_now + 
+			(Options.long_settle_delay ? 400 : 200);
+		    continue; /* don't fall */
+		}
+		if (tv_now < s->state[P].collide_time)
+		    continue; /* don't fall */
+		/* do fall! */
+	    } else continue;
+	    /* collided! */
+
+	    s->state[P].collide_time = 0;
+
+	    play_sound(ss[P],SOUND_THUD,0);
+
+	    /* this would only come into play if you were halfway
+	     * between levels and suddenly someone added garbage */
+	    while (!valid_screen_position(&s->state[P].cp,blockWidth,&g[P],s->pos[P].rot,s->pos[P].x,s->pos[P].y) && s->pos[P].y > 0) 
+		s->pos[P].y--;
+
+	    if (s->state[P].draw && EVENT_DRAWS(s,P)) 
+		draw_play_piece(screen, cs[P], &s->state[P].cp, s->pos[P].old_x, s->pos[P].old_y, s->pos[P].old_rot,
+			&s->state[P].cp, s->pos[P].x, s->pos[P].y, s->pos[P].rot);
+
+	    screen_to_exact_grid_coords(&g[P], blockWidth, s->pos[P].x, s->pos[P].y,
+		    &s->state[P].last_drop.row, &s->state[P].last_drop.col);
+	    s->state[P].last_drop.rot = s->pos[P].rot;
+	    if (s->state[P].cp.special != No_Special) {
+		/* handle special powers! */
+		handle_special(&s->state[P].cp, s->state[P].last_drop.row,
+			s->state[P].last_drop.col, s->pos[P].rot, &g[P], ss[P]);
+	    } else { 
+		/* paste the piece on the board */
+		paste_on_board(&s->state[P].cp, s->state[P].last_drop.col,
+			s->state[P].last_drop.row, s->pos[P].rot, &g[P]);
+	    }
+	    s->state[P].pieces++;
+
+	    if (sock) { 
+		char msg = 'c'; /* WRW: send update */
+		send(sock,&msg,1,0);
+		send(sock,g[P].contents,sizeof(*g[P].contents)
+			* g[P].h * g[P].w,0); 
+	    }
+	    draw_grid(screen,cs[P],&g[P],s->state[P].draw && EVENT_DRAWS(s,P));
+
+	    /* state change */
+	    s->state[P].falling = 0;
+	    s->state[P].fall_speed = 0;
+	    s->state[P].tetris_handling = 1;
+	    s->state[P].accept_input = 0;
+	    timer_set(&s->timers, EVENT_TIMER(P, EVENT_TETRIS), tv_now);
+	}
+	/* 
+	 *	Tetris Clear Events
+	 */
+	if (s->state[P].tetris_handling == 0)
+	    timer_cancel(&s->timers, EVENT_TIMER(P, EVENT_TETRIS));
+	else if (timer_due(&s->timers, EVENT_TIMER(P, EVENT_TETRIS), tv_now) &&
+		!paused) {
+	    int steps = 0;
+	    Uint32 next = timer_when(&s->timers, EVENT_TIMER(P, EVENT_TETRIS));
+
+	    event_phase(s, PHASE_TETRIS);
+#if DEBUG 
+	    Debug("Tetr: %d %d (%d)\n", tv_now, tv_now - next,
+		    s->state[P].tetris_handling);
+#endif
+
+	    /* every step that is due, as for falls */
+	    do {
+		int blank = 0, garbage = 0;
+
+		s->state[P].tetris_handling = tetris_event(s, 
+			&s->state[P].tetris_event_interval, 
+			s->state[P].tetris_handling, screen, ps, cs[P], ss[P],
+			&g[P], level[P], minimum_fall_event_interval, sock,
+			s->state[P].draw && EVENT_DRAWS(s,P),
+			&blank, &garbage, P, next);
+
+		if (NUM_PLAYER >= 2 && (blank || garbage) &&
+			(Q = event_target(s, P, NUM_PLAYER, adjust)) >= 0) {
+		    if (blank)
+			do_blank(s, screen, ss, g, Q);
+		    if (garbage) {
+			add_garbage_r(&g[Q], &s->random);
+			play_sound(ss[Q],SOUND_GARBAGE1,1);
+			draw_grid(screen,cs[Q],&g[Q],
+				s->state[Q].draw && EVENT_DRAWS(s,Q));
+		    }
+		}
+		next += s->state[P].tetris_event_interval;
+	    } while (s->state[P].tetris_handling && (Sint32) (next - tv_now) <= 0
+		    && ++steps < EVENT_CATCH_UP);
+
+	    tv_now = event_ticks(s);
+	    if ((Sint32) (next - tv_now) < 0)	/* too far behind */
+		next = tv_now;
+	    if (s->state[P].tetris_handling)
+		timer_set(&s->timers, EVENT_TIMER(P, EVENT_TETRIS), next);
+	    else
+		timer_cancel(&s->timers, EVENT_TIMER(P, EVENT_TETRIS));
+
+	    if (s->state[P].tetris_handling == 0) { /* state change */
+		/* Time for your next piece ...
+		 * Yujia points out that we should try a little harder to
+		 * fit your piece on the board. 
+		 */
+		s->state[P].cp = s->state[P].np;
+		s->state[P].np = event_piece(s, ps, cs[P], s->state[P].seed++);
+		if (!s->turbo.on) {
+		    render_lock();
+		    draw_next_piece(s, screen, ps, cs[P], 
+			    &s->state[P].cp, &s->state[P].np, P);
+		    render_unlock();
+		}
+
+		if (place_this_piece(s, P, blockWidth, g)) {
+		    /* failed to place piece */
+you_lose: 
+		    play_sound(ss[P],SOUND_LEVELDOWN,0);
+		    adjust[P] = ADJUST_DOWN;
+		    if (sock == 0 && event_standing(NUM_PLAYER, adjust) > 1) {
+			/* knocked out: the rest play on without us */
+			event_retire(s, P);
+			continue;
+		    }
+		    if (sock == 0) {
+			/* the last one standing has won */
+			for (Q=0; Q<NUM_PLAYER; Q++)
+			    if (adjust[Q] == -1)
+				adjust[Q] = ADJUST_SAME;
+			event_clock_sound(ss, NUM_PLAYER, 0);
+			return 0;
+		    }
+		    /*
+		    Debug("Entering Limbo: adjust down.\n");
+		    */
+		    event_retire(s, P);
+		} else {
+		    int x,y,count = 0;
+		    if (s->state[P].ai) {
+			AI_Counters mark;
+			ai_counters_mark(&mark);
+			s->state[P].ai_state = ai_new_piece(AI[P],
+				s->state[P].ai_state, &g[P], &s->state[P].cp,
+				&s->state[P].last_drop);
+			ai_counters_add(&s->state[P].ai_counters, &mark);
+			sim_set_styles(ps, cs[P]);
+			s->state[P].book = book_lookup(&g[P],
+				s->state[P].pieces, &s->state[P].cp,
+				&s->state[P].np, &s->state[P].book_goal);
+		    }
+		    for (y=0;y<g->h;y++)
+			for (x=0;x<g->w;x++)
+			    if (GRID_CONTENT(g[P],x,y) == 1)
+				count++;
+		    if (count == 0) {
+you_win: 
+			play_sound(ss[P],SOUND_LEVELUP,256);
+			for (Q=0; Q<NUM_PLAYER && !sock; Q++)
+			    if (Q != P && adjust[Q] == -1)
+				adjust[Q] = *seconds_remaining <= 0 ?
+				    ADJUST_DOWN : ADJUST_SAME;
+			adjust[P] = *seconds_remaining <= 0 ?
+			    ADJUST_SAME : ADJUST_UP;
+			if (sock == 0) {
+			    event_clock_sound(ss, NUM_PLAYER, 0);
+			    return 0;
+			}
+			/*
+			Debug("Entering Limbo: you win, adjust ?/?.\n");
+			*/
+			event_retire(s, P);
+		    } else {
+			/* keep playing */
+			s->state[P].falling = 1;
+			s->state[P].fall_speed = 1;
+			s->state[P].tetris_handling = 0;
+			s->state[P].accept_input = 1;
+			timer_set(&s->timers, EVENT_TIMER(P, EVENT_FALL),
+				event_ticks(s) + s->state[P].fall_event_interval);
+			if (s->state[P].ai)
+			    timer_set(&s->timers, EVENT_TIMER(P, EVENT_AI_MOVE),
+				    tv_now);
+		    }
+		}
+	    } 
+	} /* end: handle tetris events */
+
+	/* 
+	 *	AI Events
+	 */
+	if (s->state[P].ai && !paused &&
+		timer_due(&s->timers, EVENT_TIMER(P, EVENT_AI_THINK), tv_now)) {
+	    int row, col;
+	    Uint32 next = timer_when(&s->timers, EVENT_TIMER(P, EVENT_AI_THINK));
+#ifdef AI_THINK_TIME
+	    Uint32 tv_before = event_ticks(s);
+#endif
+
+	    event_phase(s, PHASE_THINK);
+	    screen_to_grid_coords(&g[P], blockWidth, s->pos[P].x, s->pos[P].y, &row, &col);
+
+	    /* simulate blanked screens */
+	    if (s->state[P].draw && !s->state[P].book) {
+		sim_set_styles(ps, cs[P]);
+		ai_think(AI[P], &s->state[P].ai_counters, s->state[P].ai_state,
+			&g[P], &s->state[P].cp, &s->state[P].np, col, row, s->pos[P].rot);
+	    }
+
+#ifdef AI_THINK_TIME
+	    tv_now = event_ticks(s);
+	    if (tv_now > tv_before + 1)
+		Debug("AI[%s] took too long in think() [%d ticks].\n",
+			AI[P]->name, tv_now - tv_before);
+#endif
+
+	    do {  /* just in case we're *way* behind */
+		next += s->state[P].ai_interval;
+	    } while ((Sint32) (next - tv_now) < 0); 
+	    timer_set(&s->timers, EVENT_TIMER(P, EVENT_AI_THINK), next);
+	}
+	if (!s->state[P].ai || !s->state[P].accept_input)
+	    timer_cancel(&s->timers, EVENT_TIMER(P, EVENT_AI_MOVE));
+	else if (timer_due(&s->timers, EVENT_TIMER(P, EVENT_AI_MOVE), tv_now) &&
+		!paused) {
+	    Uint32 next = timer_when(&s->timers, EVENT_TIMER(P, EVENT_AI_MOVE));
+	    int row, col, n = 0;
+	    AI_Placement goal;
+	    AI_Plan plan;
+	    AI_Counters mark;
+	    /* pixels we fall between two of these */
+	    int fall = (s->state[P].ai_interval * 5 + 
+		    s->state[P].fall_event_interval - 1) /
+		s->state[P].fall_event_interval * s->state[P].fall_speed;
+#ifdef AI_THINK_TIME
+	    Uint32 tv_before = event_ticks(s);
+#endif
 
-    r.w = text_surface->w;
-    r.h = text_surface->h;
+	    event_phase(s, PHASE_MOVE);
+	    screen_to_grid_coords(&g[P], blockWidth, s->pos[P].x, s->pos[P].y, &row, &col);
+	    ai_counters_mark(&mark);
+	    if (s->state[P].book) {
+		n = ai_plan(&g[P], &s->state[P].cp, blockWidth, col,
+			s->pos[P].y - g[P].board.y, s->pos[P].rot, 
+			&s->state[P].book_goal, fall, &plan);
+		if (n < 0)	/* the AI will have to think after all */
+		    s->state[P].book = 0;
+	    }
+	    if (s->state[P].book)
+		s->pos[P].move = n > 0 ? plan.move[0] : MOVE_DOWN;
+	    else if (AI[P]->target && AI[P]->target(s->state[P].ai_state, &g[P],
+			&s->state[P].cp, row, &goal) && 
+		    ai_plan(&g[P], &s->state[P].cp, blockWidth, col,
+			s->pos[P].y - g[P].board.y, s->pos[P].rot, &goal, fall,
+			&plan) > 0)
+		s->pos[P].move = plan.move[0];
+	    else 
+		s->pos[P].move =
+		    AI[P]->move(s->state[P].ai_state, &g[P], &s->state[P].cp, &s->state[P].np, 
+			    col, row, s->pos[P].rot);
+	    ai_counters_add(&s->state[P].ai_counters, &mark);
+#ifdef AI_THINK_TIME
+	    tv_now = event_ticks(s);
+	    if (tv_now > tv_before + 1)
+		Debug("AI[%s] took too long in move() [%d ticks].\n",
+			AI[P]->name, tv_now - tv_before);
+#endif
 
-    if (flags & DRAW_CENTER)
-	r.x -= (r.w / 2);
-    if (flags & DRAW_LEFT)
-	r.x -= text_surface->w;
-    if (flags & DRAW_ABOVE)
-	r.y -= (r.h);
-    if (flags & DRAW_CLEAR) {
-	SDL_FillRect(widget_layer, &r, int_black);
-	SDL_FillRect(screen, &r, int_black);
-    }
+	    do {  /* just in case we're *way* behind */
+		next += s->state[P].ai_interval * 5;
+	    } while ((Sint32) (next - tv_now) < 0); 
+	    timer_set(&s->timers, EVENT_TIMER(P, EVENT_AI_MOVE), next);
+	}
 
-    SDL_BlitSafe(text_surface, NULL, widget_layer, &r);
-    SDL_BlitSafe(flame_layer, &r, screen, &r);
-    SDL_BlitSafe(widget_layer, &r, screen, &r);
-    if (flags & DRAW_UPDATE)
-	SDL_UpdateSafe(screen, 1, &r);
 
-    SDL_FreeSurface(text_surface);
-    return r.h;
-}
+	/* 
+	 *	Handle Movement (the AI's)
+	 */
+	event_phase(s, PHASE_DRAW);
+	do_move(s, P, blockWidth, g);
+	if (!paused)
+	    event_show_piece(s, screen, cs[P], P);
 
-/***************************************************************************
- *      give_notice()
- * Draws a little "press any key to continue"-type notice between levels.
- * "s" is any message you would like to display.
- * Returns 1 if the user presses 'q', 0 if the users presses 'c'.
- *********************************************************************PROTO*/
-int
-give_notice(char *s, int quit_possible)
-{
-    SDL_Event event;
+	/* network connection */
+	if (sock) {
+	    fd_set read_fds;
+	    struct timeval timeout = { 0, 0 };
+	    int retval;
 
-    while (SDL_PollEvent(&event)) {
-	/* pull out all leading 'Q's */
-    }
+	    event_phase(s, PHASE_NET);
+	    Assert(P == 0);
 
-    if (s && s[0]) 	/* throw that 'ol user text up there */
-	draw_string(s, color_blue, 
-		layout.grid[0].x + (layout.grid[0].w / 2), layout.grid[0].y
-		+ 64, DRAW_CENTER | DRAW_UPDATE);
+	    do { 
+		FD_ZERO(&read_fds);
+		FD_SET(sock,&read_fds);
+#if HAVE_SELECT || HAVE_WINSOCK_H
+		retval = select(sock+1, &read_fds, NULL, NULL, &timeout);
+#else
+#warning	"Since you do not have select(), networking play will fail."
+		retval = 0;
+#endif
+		if (retval > 0) {
+		    char msg;
+		    if (recv(sock,&msg,1,0) != 1) {
+			Debug("WARNING: Other player has left?\n");
+			close(sock);
+			sock = 0;
+			retval = 0;
+		    } else {
+			switch (msg) {
+			    case 'b': 
+				do_blank(s, screen, ss, g, P);
+			    break;
+			    case 'p':
+				paused = !paused;
+				do_pause(s, paused, &pause_begin_time);
+			    break; 
 
-    if (quit_possible) 
-	draw_string("Press 'Q' to Quit", color_red,
-		layout.grid[0].x + (layout.grid[0].w / 2), layout.grid[0].y + 128, 
-		DRAW_CENTER | DRAW_UPDATE);
+			    case ADJUST_DOWN: /* other play in limbo */
+			    case ADJUST_SAME:
+			    case ADJUST_UP:
+				s->state[P].other_in_limbo = 1;
+				adjust[!P] = msg;
+				break;
 
-    draw_string("Press 'G' to Go On", color_red,
-	    layout.grid[0].x + (layout.grid[0].w / 2), layout.grid[0].y +
-	    128 + 30, DRAW_CENTER | DRAW_UPDATE);
-    while (1) {
-	poll_and_flame(&event);
-	if (event.type == SDL_KEYDOWN &&
-		event.key.keysym.sym == 'q') 
-	    return 1;
-	if (event.type == SDL_KEYDOWN &&
-		event.key.keysym.sym == 'g')
-	    return 0;
+			    case 'g': 
+				add_garbage_r(&g[P], &s->random);
+				play_sound(ss[P],SOUND_GARBAGE1,1);
+				draw_grid(screen,cs[P],&g[P],
+					s->state[P].draw && EVENT_DRAWS(s,P));
+				      break;
+			    case 's':
+				  recv(sock,(char *)&s->score[1], sizeof(s->score[1]),0);
+				  if (!s->rendering)
+				      draw_score(s, screen, 1);
+				  break;
+			    case 'c':  { int i,j;
+				      memcpy(g[!P].temp,g[!P].contents,
+					      sizeof(*g[0].temp) *
+					      g[!P].w * g[!P].h);
+				      recv(sock,g[!P].contents,
+					      sizeof(*g[!P].contents) *
+					      g[!P].w * g[!P].h,0);
+				      for (i=0;i<g[!P].w;i++)
+					  for (j=0;j<g[!P].h;j++)
+					      if (GRID_CONTENT(g[!P],i,j) != TEMP_CONTENT(g[1],i,j)){
+						  GRID_CHANGED(g[!P],i,j)=1;
+						  if (i > 0) GRID_CHANGED(g[!P],i-1,j) = 1;
+						  if (j > 0) GRID_CHANGED(g[!P],i,j-1) = 1;
+						  if (i < g[!P].w-1) GRID_CHANGED(g[!P],i+1,j) = 1;
+						  if (i < g[!P].h-1) GRID_CHANGED(g[!P],i,j+1) = 1;
+						  if (GRID_CONTENT(g[!P],i,j) == 0) GRID_SET(g[!P],i,j,REMOVE_ME);
+						  }
+				      draw_grid(screen,cs[!P],&g[!P],EVENT_DRAWS(s,!P));
+				       }
+				      break;
+			    default: break;
+			}
+		    }
+		}
+	    } while (retval > 0 && 
+		    !(s->state[P].limbo && s->state[P].other_in_limbo));
+
+	    /* limbo handling */
+	    if (s->state[P].limbo && s->state[P].other_in_limbo) {
+		Assert(adjust[0] != -1 && adjust[1] != -1);
+		event_clock_sound(ss, NUM_PLAYER, 0);
+		return 0;
+	    } else if (s->state[P].limbo && !s->state[P].other_in_limbo &&
+		    !s->state[P].limbo_sent) {
+		char msg = adjust[P]; /* WRW: send update */
+		s->state[P].limbo_sent = 1;
+		send(sock,&msg,1,0);
+	    } else if (!s->state[P].limbo && s->state[P].other_in_limbo) {
+		char msg; /* WRW: send update */
+		/* hmm, other guy is done ... */
+		if (adjust[!P] == ADJUST_UP || adjust[!P] == ADJUST_SAME) {
+		    if (*seconds_remaining > 0) 
+			adjust[P] = ADJUST_SAME;
+		    else
+			adjust[P] = ADJUST_DOWN;
+		} else if (adjust[!P] == ADJUST_DOWN) {
+		    adjust[P] = ADJUST_SAME;
+		}
+		/*
+		Debug("Entering Limbo: adjust same/down.\n");
+		*/
+		event_retire(s, P);
+		s->state[P].limbo_sent = 1;
+		msg = adjust[P];
+		send(sock,&msg,1,0);
+		event_clock_sound(ss, NUM_PLAYER, 0);
+		return 0;
+	    }
+	}
+	event_phase(s, PHASE_DRAW);
+	if (paused) {
+	    render_lock();
+	    atris_run_flame();
+	    render_unlock();
+	} else
+	    event_frame(s, screen, ps, cs, g, NUM_PLAYER, sock, tv_now,
+		    *seconds_remaining);
+
+	event_phase(s, PHASE_SLEEP);
+	if (s->turbo.on) {
+	    Uint32 next;
+
+	    /* no waiting: it is simply time for the next thing due */
+	    if (paused)
+		idle_wait(atris_flame_wait(), sock);
+	    else if (timer_next(&s->timers, &next) < 0)
+		s->turbo.clock += EVENT_INPUT_POLL;
+	    else if ((Sint32) (next - s->turbo.clock) > 0)
+		s->turbo.clock = next;
+	} else {
+	    Uint32 next;
+
+	    /* paused or with nothing due, we still come back for the flame
+	     * and the clock */
+	    if (paused)
+		next = event_ticks(s) + atris_flame_wait();
+	    else if (timer_next(&s->timers, &next) < 0)
+		next = event_ticks(s) + EVENT_IDLE;
+	    if (!input_gather(s))
+		sched_slack(s, next, ps, cs, g, AI, blockWidth, NUM_PLAYER,
+			sock);
+	}
     } 
 }
 
 /***************************************************************************
- *      load_adjust_symbol()
- * Loads the level adjustment images.
- ***************************************************************************/
-static void
-load_adjust_symbols()
-{
-    SDL_Surface *bitmap = SDL_LoadBMP("graphics/Level-Up.bmp");
-    if (!bitmap) PANIC("Could not load [graphics/Level-Up.bmp]");
-    if (bitmap->format->palette != NULL ) {
-	SDL_SetColors(screen, bitmap->format->palette->colors, 0,
-		bitmap->format->palette->ncolors);
+ *      event_loop()
+ * The main event-processing dispatch loop: plays one game of session s,
+ * which keeps its score, on boards g[0] to g[s->boards-1]. who[] says who
+ * plays each one (HUMAN_PLAYER, AI_PLAYER or NETWORK_PLAYER): at most two
+ * humans, and a network opponent only ever as the second of two boards.
+ * The boards are drawn on the render thread while it runs, if there is
+ * one. AI_VS_AI and DEMO games run in turbo if Options.turbo says so, and
+ * say how fast they went. F12 writes out where the loop's time has gone
+ * so far (see event_phase()).
+ *
+ * Returns 0 on a successful game completion, -1 on a [single-user] quit.
+ *********************************************************************PROTO*/
+int
+event_loop(Session *s, SDL_Surface *screen, piece_style *ps,
+	color_style *cs[], sound_style *ss[], Grid g[], int level[], int sock,
+	int *seconds_remaining, int time_is_hard_limit,
+	int adjust[], int (*handle)(const SDL_Event *), 
+	int seed, int who[], AI_Player *AI[])
+{
+    int retval, seconds = *seconds_remaining;
+    double start = sim_now();
+    int Q;
+
+    memset(&s->turbo, 0, sizeof(s->turbo));
+    s->turbo.on = Options.turbo > 0 && (s->gametype == AI_VS_AI ||
+	    s->gametype == DEMO);
+    for (Q=0; Q<s->boards; Q++)
+	if (who[Q] != AI_PLAYER)
+	    s->turbo.on = 0;
+    if (s->turbo.on) {
+	sound_mute(1);
+	sim_virtual_clock(1);	/* the AIs do not notice either */
+    }
+    s->rendering = render_start(s, g, cs, min(s->boards, s->layout.boards))
+	|| s->turbo.on;
+    retval = event_play(s, screen, ps, cs, ss, g, level, sock,
+	    seconds_remaining, time_is_hard_limit, adjust, handle, seed, who, AI);
+    render_stop();
+    s->rendering = 0;
+    if (s->turbo.on) {
+	double took = sim_now() - start;
+	double played = seconds - *seconds_remaining;
+	char buf[8 * MAX_PLAYERS] = "";
+
+	for (Q=0; Q<s->boards; Q++)
+	    sprintf(buf + strlen(buf), "%s%d", Q ? "/" : "", adjust[Q]);
+	Debug("Turbo: %.0f s of play in %.2f s (%.0fx), %lu steps, "
+		"%lu drawn; adjustments %s.\n", played, took,
+		took > 0 ? played / took : 0.0, s->turbo.passes, s->turbo.drawn,
+		buf);
+	sim_virtual_clock(0);
+	sound_mute(0);
+	s->turbo.on = 0;
     }
-    adjust_symbol[0] = SDL_DisplayFormat(bitmap);
-    if (!adjust_symbol[0]) 
-	PANIC("Can not convert [graphics/Level-Up.bmp] to hardware format");
-    SDL_SetColorKey(adjust_symbol[0], SDL_SRCCOLORKEY,
-	    SDL_MapRGB(screen->format, 0, 0, 0));
-    SDL_FreeSurface(bitmap);
+    return retval;
+}
 
-    bitmap = SDL_LoadBMP("graphics/Level-Medium.bmp");
-    if (!bitmap) PANIC("Could not load [graphics/Level-Medium.bmp]");
-    if (bitmap->format->palette != NULL ) {
-	SDL_SetColors(screen, bitmap->format->palette->colors, 0,
-		bitmap->format->palette->ncolors);
-    }
-    adjust_symbol[1] = SDL_DisplayFormat(bitmap);
-    if (!adjust_symbol[1]) 
-	PANIC("Can not convert [graphics/Level-Medium.bmp] to hardware format");
-    SDL_SetColorKey(adjust_symbol[1], SDL_SRCCOLORKEY,
-	    SDL_MapRGB(screen->format, 0, 0, 0));
-    SDL_FreeSurface(bitmap);
+/*
+ * $Log: event.c,v $
+ * Revision 1.61  2001/01/05 21:12:32  weimer
+ * advance to atris 1.0.5, add support for ".atrisrc" and changing the
+ * keyboard repeat rate
+ *
+ * Revision 1.60  2000/11/10 18:16:48  weimer
+ * changes for Atris 1.0.4 - three new special options
+ *
+ * Revision 1.59  2000/11/06 04:39:56  weimer
+ * networking consistency check for power pieces
+ *
+ * Revision 1.58  2000/11/06 04:06:44  weimer
+ * option menu
+ *
+ * Revision 1.57  2000/11/06 01:25:54  weimer
+ * add in the other special piece
+ *
+ * Revision 1.56  2000/11/06 00:51:55  weimer
+ * fixed the paint thing so that it actually paints
+ *
+ * Revision 1.55  2000/11/06 00:24:01  weimer
+ * add WalkRadioGroup modifications (inactive field for Kiri) and some support
+ * for special pieces
+ *
+ * Revision 1.54  2000/11/03 04:25:58  weimer
+ * add some optimizations to run_gravity to make it just a bit faster (down
+ * to 0.01 ms/call from 0.02), sleep a bit more in event-loop: generally
+ * trying to make us more CPU friendly ...
+ *
+ * Revision 1.53  2000/11/02 03:06:20  weimer
+ * better interface for walk-radio menus: we are now ready for Kiri to change
+ * them to add run-time options ...
+ *
+ * Revision 1.52  2000/11/01 17:55:33  weimer
+ * remove ambiguous references to "you win" in debugging output
+ *
+ * Revision 1.51  2000/11/01 04:39:41  weimer
+ * clear the little scoring spot correctly, updates for making a no-sound
+ * distribution
+ *
+ * Revision 1.50  2000/11/01 03:53:06  weimer
+ * modifications for version 1.0.1: you can pick your starting level, you can
+ * pick the AI difficulty factor, the game is better about placing new pieces
+ * when there is garbage, when things fall out of your control they now fall
+ * at a uniform rate ...
+ *
+ * Revision 1.49  2000/10/30 16:57:24  weimer
+ * minor doc fixups
+ *
+ * Revision 1.48  2000/10/30 16:25:25  weimer
+ * display the network player score during network games. Also give the
+ * non-server a little message when waiting for the server to go on.
+ *
+ * Revision 1.47  2000/10/29 22:55:01  weimer
+ * networking consistency checks (you must have the same number of doodads):
+ * special hotkey 'f' in main menu toggles full screen mode
+ * added depth specification on the command line
+ * automatically search for the darkest non-black color ...
+ *
+ * Revision 1.46  2000/10/29 21:23:28  weimer
+ * One last round of header-file changes to reflect my newest and greatest
+ * knowledge of autoconf/automake. Now if you fail to have some bizarro
+ * function, we try to go on anyway unless it is vastly needed.
+ *
+ * Revision 1.45  2000/10/29 19:04:32  weimer
+ * minor highscore handling changes: new filename, use the draw_string() and
+ * draw_bordered_rect() and input_string() interfaces, handle the widget layer
+ * and the flame layer, etc. Also fix a minor bug where you would be prevented
+ * from settling if you pressed a key even if it didn't really move you. :-)
+ *
+ * Revision 1.44  2000/10/29 17:23:13  weimer
+ * incorporate "xflame" flaming background for added spiffiness ...
+ *
+ * Revision 1.43  2000/10/29 00:17:39  weimer
+ * added support for a system independent random number generator
+ *
+ * Revision 1.42  2000/10/28 13:39:14  weimer
+ * added a pausing feature ...
+ *
+ * Revision 1.41  2000/10/27 00:07:36  weimer
+ * some sound fixes ...
+ *
+ * Revision 1.40  2000/10/26 22:23:07  weimer
+ * double the effective number of levels
+ *
+ * Revision 1.39  2000/10/22 22:05:51  weimer
+ * Added a few new sounds ...
+ *
+ * Revision 1.38  2000/10/21 01:14:42  weimer
+ * massic autoconf/automake restructure ...
+ *
+ * Revision 1.37  2000/10/20 01:32:09  weimer
+ * Minor play issue problems -- time is now truly a hard limit!
+ *
+ * Revision 1.36  2000/10/19 22:30:55  weimer
+ * make pieces fall a bit faster
+ *
+ * Revision 1.35  2000/10/19 22:06:51  weimer
+ * minor changes ...
+ *
+ * Revision 1.34  2000/10/19 00:20:27  weimer
+ * sound directory changes, added a ticking clock ...
+ *
+ * Revision 1.33  2000/10/18 23:57:49  weimer
+ * general fixup, color changes, display changes.
+ * Notable: "Safe" Blits and Updates now perform "clipping". No more X errors,
+ * we hope!
+ *
+ * Revision 1.32  2000/10/18 03:29:56  weimer
+ * fixed problem with "machine-gun" sounds caused by "run_gravity()" returning
+ * 1 too often
+ *
+ * Revision 1.31  2000/10/18 02:04:02  weimer
+ * playability changes ...
+ *
+ * Revision 1.30  2000/10/14 16:17:41  weimer
+ * level adjustment changes, added some new AIs, etc.
+ *
+ * Revision 1.29  2000/10/14 01:42:53  weimer
+ * better scoring of thumbs-up, thumbs-down
+ *
+ * Revision 1.28  2000/10/14 01:24:34  weimer
+ * fixed error with not advancing levels when fighting AI
+ *
+ * Revision 1.27  2000/10/14 00:58:32  weimer
+ * fixed an unsigned arithmetic problem that was sleeping too often!
+ *
+ * Revision 1.26  2000/10/14 00:56:41  weimer
+ * whoops, minor boolean typo!
+ *
+ * Revision 1.25  2000/10/14 00:42:27  weimer
+ * fixed minor error where you couldn't move all the way to the left ...
+ *
+ * Revision 1.24  2000/10/13 22:34:26  weimer
+ * minor wessy AI changes
+ *
+ * Revision 1.23  2000/10/13 18:23:28  weimer
+ * fixed a race condition in tetris_event()
+ *
+ * Revision 1.22  2000/10/13 17:55:36  weimer
+ * Added another color "Style" ...
+ *
+ * Revision 1.21  2000/10/13 16:37:39  weimer
+ * Changed the AI so that it now passes state around via void pointers, rather
+ * than using global variables. This allows the same AI to play itself. Also
+ * changed the "AI vs. AI" display so that you can keep track of total wins
+ * and losses.
+ *
+ * Revision 1.20  2000/10/13 15:41:53  weimer
+ * revamped AI support, now you can pick your AI and have AI duels (such fun!)
+ * the mighty Aliz AI still crashes a bit, though ... :-)
+ *
+ * Revision 1.19  2000/10/13 03:02:05  wkiri
+ * Added Aliz (Kiri AI) to ai.c.
+ * Note event.c currently calls Aliz, not Wessy AI.
+ *
+ * Revision 1.18  2000/10/12 22:21:25  weimer
+ * display changes, more multi-local-play threading (e.g., myScore ->
+ * Score[0]), that sort of thing ...
+ *
+ * Revision 1.17  2000/10/12 19:17:08  weimer
+ * Further support for AI players and multiple game types.
+ *
+ * Revision 1.16  2000/10/12 00:49:08  weimer
+ * added "AI" support and walking radio menus for initial game configuration
+ *
+ * Revision 1.15  2000/09/09 17:05:35  wkiri
+ * Hideous log changes (Wes: how dare you include a comment character!)
+ *
+ * Revision 1.14  2000/09/09 16:58:27  weimer
+ * Sweeping Change of Ultimate Mastery. Main loop restructuring to clean up
+ * main(), isolate the behavior of the three game types. Move graphic files
+ * into graphics/-, style files into styles/-, remove some unused files,
+ * add game flow support (breaks between games, remembering your level within
+ * this game), multiplayer support for the event loop, some global variable
+ * cleanup. All that and a bag of chips!
+ *
+ * Revision 1.13  2000/09/05 22:10:46  weimer
+ * fixed initial garbage generation strangeness
+ *
+ * Revision 1.12  2000/09/05 21:47:41  weimer
+ * major timing revamping: it actually seems to work now!
+ *
+ * Revision 1.11  2000/09/05 20:22:12  weimer
+ * native video mode selection, timing investigation
+ *
+ * Revision 1.10  2000/09/04 15:20:21  weimer
+ * faster blitting algorithms for drawing the grid and drawing falling pieces
+ * (when you eliminate a line)
+ *
+ * Revision 1.9  2000/09/04 14:18:09  weimer
+ * flushed out the pattern color so that it has the same number of colors as
+ * the default
+ *
+ * Revision 1.8  2000/09/03 20:58:22  weimer
+ * yada
+ *
+ * Revision 1.7  2000/09/03 20:57:02  weimer
+ * changes the time variable to be passed by reference in the event loop
+ *
+ * Revision 1.6  2000/09/03 20:34:42  weimer
+ * only draw their score in multiplayer game
+ *
+ * Revision 1.5  2000/09/03 20:27:38  weimer
+ * the event loop actually works!
+ *
+ * Revision 1.4  2000/09/03 19:59:56  weimer
+ * wessy event-loop changes
+ *
+ * Revision 1.3  2000/09/03 18:44:36  wkiri
+ * Cleaned up atris.c (see high_score_check()).
+ * Added game type (defaults to MARATHON).
+ *
+ */
 
-    bitmap = SDL_LoadBMP("graphics/Level-Down.bmp");
-    if (!bitmap) PANIC("Could not load [graphics/Level-Down.bmp]");
-    if (bitmap->format->palette != NULL ) {
-	SDL_SetColors(screen, bitmap->format->palette->colors, 0,
-		bitmap->format->palette->ncolors);
-    }
-    adjust_symbol[2] = SDL_DisplayFormat(bitmap);
-    if (!adjust_symbol[2]) 
-	PANIC("Can not convert [graphics/Level-Down.bmp] to hardware format");
-    SDL_SetColorKey(adjust_symbol[2], SDL_SRCCOLORKEY,
-	    SDL_MapRGB(screen->format, 0, 0, 0));
-    SDL_FreeSurface(bitmap);
 
-    Assert(adjust_symbol[0]->h == adjust_symbol[1]->h);
-    Assert(adjust_symbol[1]->h == adjust_symbol[2]->h);
-}
+static Uint32 randomSeed;
 
-/***************************************************************************
- *      draw_bordered_rect()
- * Draws a bordered rectangle. Sets "border" based on "orig". 
- *********************************************************************PROTO*/
-void
-draw_bordered_rect(SDL_Rect *orig, SDL_Rect *border, int thick)
+void SeedRandom(Uint32 Seed)
 {
-    Assert(thick > 0 && thick < 8);
-
-    border->x = orig->x - thick;
-    border->y = orig->y - thick;
-    border->w = orig->w + thick * 2;
-    border->h = orig->h + thick * 2;
-
-    SDL_FillRect(widget_layer, border, int_border_color);
-    SDL_FillRect(widget_layer, orig, int_solid_black);
-
-    /* unchanged: SDL_BlitSafe(flame_layer, NULL, screen, &r); */
-    SDL_BlitSafe(widget_layer, border, screen, border);
-    SDL_UpdateSafe(screen, 1, border);
-
-    return;
+	if ( ! Seed ) {
+		srand(time(NULL));
+		Seed = (((rand()%0xFFFF)<<16)|(rand()%0xFFFF));
+	}
+	randomSeed = Seed;
 }
 
-/***************************************************************************
- *      draw_pre_bordered_rect()
- * Draws a bordered rectangle. 
- *********************************************************************PROTO*/
-void
-draw_pre_bordered_rect(SDL_Rect *border, int thick)
+Uint32 GetRandSeed(void)
 {
-    SDL_Rect orig;
-    Assert(thick > 0 && thick < 8);
-
-    orig.x = border->x + thick;
-    orig.y = border->y + thick;
-    orig.w = border->w - thick * 2;
-    orig.h = border->h - thick * 2;
-
-    SDL_FillRect(widget_layer, border, int_border_color);
-    SDL_FillRect(widget_layer, &orig, int_solid_black);
-
-    /* unchanged: SDL_BlitSafe(flame_layer, NULL, screen, &r); */
-    SDL_BlitSafe(widget_layer, border, screen, border);
-    SDL_UpdateSafe(screen, 1, border);
-    return;
+	return(randomSeed);
 }
 
-/***************************************************************************
- *      setup_layers()
- * Set up the widget and flame layers.
- *********************************************************************PROTO*/
-void
-setup_layers(SDL_Surface * screen)
+/* This magic is wholly the result of Andrew Welch, not me. :-) */
+/* -- The same generator, but on a seed of your own (for threads) */
+Uint16 FastRandom_r(Uint32 *seed, Uint16 range)
 {
-    SDL_Rect all;
-    flame_layer = SDL_CreateRGBSurface
-	(SDL_HWSURFACE|SDL_SRCCOLORKEY,
-	 screen->w, screen->h, 8, 0, 0, 0, 0);
-    widget_layer = SDL_CreateRGBSurface
-	(SDL_HWSURFACE|SDL_SRCCOLORKEY,
-	 screen->w, screen->h, screen->format->BitsPerPixel, 
-	 screen->format->Rmask, screen->format->Gmask, 
-	 screen->format->Bmask, screen->format->Amask);
-    if (SDL_SetColorKey(widget_layer, SDL_SRCCOLORKEY, 
-		SDL_MapRGB(widget_layer->format, 0, 0, 0)))
-	PANIC("SDL_SetColorKey failed on the widget layer.");
+	Uint16 result;
+	register Uint32 calc;
+	register Uint32 regD0;
+	register Uint32 regD1;
+	register Uint32 regD2;
 
-    if (int_black != SDL_MapRGB(widget_layer->format, 0, 0, 0)) {
-	Debug("*** Warning: screen and widget layer have different RGB format.\n");
-    }
-    if (int_black != SDL_MapRGB(flame_layer->format, 0, 0, 0)) {
-	Debug("*** Warning: screen and flame layer have different RGB format.\n");
-    }
+	calc = *seed;
+	regD0 = 0x41A7;
+	regD2 = regD0;
+	
+	regD0 *= calc & 0x0000FFFF;
+	regD1 = regD0;
+	
+	regD1 = regD1 >> 16;
+	
+	regD2 *= calc >> 16;
+	regD2 += regD1;
+	regD1 = regD2;
+	regD1 += regD1;
+	
+	regD1 = regD1 >> 16;
+	
+	regD0 &= 0x0000FFFF;
+	regD0 -= 0x7FFFFFFF;
+	
+	regD2 &= 0x00007FFF;
+	regD2 = (regD2 << 16) + (regD2 >> 16);
+	
+	regD2 += regD1;
+	regD0 += regD2;
+	
+	/* An unsigned value < 0 is always 0 */
+	/*************************************
+	 Not compiled:
+	if (regD0 < 0)
+		regD0 += 0x7FFFFFFF;
+	 *************************************/
+	
+	*seed = regD0;
+	if ((regD0 & 0x0000FFFF) == 0x8000)
+		regD0 &= 0xFFFF0000;
 
-    all.x = all.y = 0;
-    all.w = screen->w;
-    all.h = screen->h;
+/* -- Now that we have our pseudo random number, pin it to the range we want */
 
-    SDL_FillRect(widget_layer, &all, int_black);
-    SDL_FillRect(flame_layer, &all, int_solid_black);
+	regD1 = range;
+	regD1 *= (regD0 & 0x0000FFFF);
+	regD1 = (regD1 >> 16);
+	
+	result = regD1;
+	
+	return result;
 }
 
-/***************************************************************************
- *      draw_background()
- * Draws the Alizarin Tetris background. Not yet complete, but it's getting
- * better. :-)
- *********************************************************************PROTO*/
-void
-draw_background(SDL_Surface *screen, int blockWidth, Grid g[],
-	int level[], int my_adj[], int their_adj[], char *name[])
+Uint16 FastRandom(Uint16 range)
 {
-    char buf[1024];
-    int i;
-#define IS_DOUBLE(x) ((x==NETWORK)||(x==SINGLE_VS_AI)||(x==TWO_PLAYERS)||(x==AI_VS_AI))
-
-    if (IS_DOUBLE(gametype)) {
-	Assert(g[0].w == g[1].w);
-	Assert(g[0].h == g[1].h);
-    }
-
-    /*
-     * clear away the old stuff
-     */
-    memset(&layout, 0, sizeof(layout));
-    
-    if (!adjust_symbol[0]) { /* only load these guys the first time */
-	load_adjust_symbols();
-    }
-    /*
-     * 	THE BOARD
-     */
-    if (IS_DOUBLE(gametype)) {
-	layout.grid[0].x = ((screen->w / 2) - ((g[0].w*blockWidth))) - 5 * blockWidth - 2;
-	layout.grid[0].y = ((screen->h - (g[0].h*blockWidth)) / 2);
-	layout.grid[0].w = (g[0].w*blockWidth);
-	layout.grid[0].h = (g[0].h*blockWidth);
+	return FastRandom_r(&randomSeed, range);
+}
 
-	layout.grid[1].y = ((screen->h - (g[0].h*blockWidth)) / 2);
-	layout.grid[1].w = (g[0].w*blockWidth);
-	layout.grid[1].h = (g[0].h*blockWidth);
-	layout.grid[1].x = ((screen->w / 2) - 4) + 5 * blockWidth + 6;
+typedef enum {
+    ColorStyleMenu = 0,
+    SoundStyleMenu = 1,
+    PieceStyleMenu = 2,
+    GameMenu	   = 3,
+    OptionsMenu	   = 4,
+    MainMenu       = 5,
+} MainMenuChoice;
 
-	/* Draw the opponent's board */
-	draw_bordered_rect(&layout.grid[1], &layout.grid_border[1], 2);
-	g[1].board = layout.grid[1];
-    }  else {
-	layout.grid[0].x = (screen->w - (g[0].w*blockWidth))/2 ;
-	layout.grid[0].y = (screen->h - (g[0].h*blockWidth))/2 ;
-	layout.grid[0].w = (g[0].w*blockWidth) ;
-	layout.grid[0].h = (g[0].h*blockWidth) ;
-	/* Don't need a Board[1] */
-    }
-    /* draw the leftmost board */
-    draw_bordered_rect(&layout.grid[0], &layout.grid_border[0], 2);
-    g[0].board = layout.grid[0];
+typedef enum {
+    Opt_ToggleFullScreen,
+    Opt_ToggleFlame,
+    Opt_ToggleSpecial,
+    Opt_FasterLevels,
+    Opt_LongSettleDelay,
+    Opt_UpwardRotation,
+    Opt_KeyRepeat,
+    Opt_Turbo,
+} OptionMenuChoice;
 
-    /*
-     * 	SCORING, Names
-     */
-    for (i=0; i< 1+IS_DOUBLE(gametype); i++) {
-	layout.name[i].x = layout.grid[i].x;
-	layout.name[i].y = layout.grid[i].y + layout.grid[i].h + 2;
-	layout.name[i].w = layout.grid[i].w;
-	layout.name[i].h = screen->h - layout.name[i].y;
+#define MAX_MENU_CHOICE	6
 
-	if (gametype == DEMO) {
-	    char buf[1024];
-	    SDL_FillRect(widget_layer, &layout.name[i], int_black);
-	    SDL_FillRect(screen, &layout.name[i], int_black);
-	    sprintf(buf,"Demo (%s)",name[i]);
-	    draw_string(buf, color_blue, layout.grid_border[i].x +
-		    layout.grid_border[i].w/2, layout.grid_border[i].y +
-		    layout.grid_border[i].h, DRAW_CENTER | DRAW_CLEAR | DRAW_UPDATE);
-	} else {
-	    draw_string(name[i], color_blue,
-		    layout.grid_border[i].x + layout.grid_border[i].w/2,
-		    layout.grid_border[i].y + layout.grid_border[i].h,
-		    DRAW_CENTER);
-	}
-	/* Set up the coordinates for future score writing */
-	layout.score[i].x = layout.grid_border[i].x;
-	layout.score[i].w = layout.grid_border[i].w;
-	layout.score[i].y = 0;
-	layout.score[i].h = layout.grid_border[i].y;
-	SDL_FillRect(widget_layer, &layout.score[i], int_black);
-	SDL_FillRect(screen, &layout.score[i], int_black);
+static int start_playing = 0;
+static sound_styles *_ss;
+static color_styles *_cs;
+static piece_styles *_ps;
+static WalkRadioGroup *wrg = NULL;
 
-	sprintf(buf,"Level %d, Score:",level[i]);
-	draw_string(buf, color_blue, layout.grid_border[i].x,
-		layout.grid_border[i].y, DRAW_ABOVE | DRAW_CLEAR);
+static GT _local_gametype;
 
-	layout.score[i].x = layout.grid_border[i].x + layout.grid_border[i].w;
-	layout.score[i].y = layout.grid_border[i].y;
-    }
+/***************************************************************************/
+/* Update the given choice on the main menu */
+static void updateMenu(int whichSubMenu, int choice)
+{
+  wrg->wr[MainMenu].label[whichSubMenu] = wrg->wr[whichSubMenu].label[choice];
+  clear_radio(&wrg->wr[MainMenu]);
+  setup_radio(&wrg->wr[MainMenu]);
+  wrg->wr[MainMenu].x = (screen->w/3 - wrg->wr[MainMenu].area.w)/2;
+  wrg->wr[MainMenu].y = (screen->h - wrg->wr[MainMenu].area.h)/2;
+}
 
-    /*
-     * 	TIME LEFT
-     */
+char key_repeat_label[] = "Key Repeat: 16 " ;
 
-#define TIME_WIDTH 	(16*5)
-#define TIME_HEIGHT 	28
+static void OptionsMenu_setup()
+{
+    wrg->wr[OptionsMenu].label[Opt_ToggleFullScreen] = "Toggle Full Screen";
+    if (Options.flame_wanted)
+	wrg->wr[OptionsMenu].label[Opt_ToggleFlame] = "Background Flame: On";
+    else
+	wrg->wr[OptionsMenu].label[Opt_ToggleFlame] = "Background Flame: Off";
+    if (Options.special_wanted)
+	wrg->wr[OptionsMenu].label[Opt_ToggleSpecial] = "Power Pieces: On";
+    else
+	wrg->wr[OptionsMenu].label[Opt_ToggleSpecial] = "Power Pieces: Off";
+    if (Options.faster_levels)
+	wrg->wr[OptionsMenu].label[Opt_FasterLevels] = "Double Difficulty: On";
+    else
+	wrg->wr[OptionsMenu].label[Opt_FasterLevels] = "Double Difficulty: Off";
+    if (Options.long_settle_delay)
+	wrg->wr[OptionsMenu].label[Opt_LongSettleDelay] = "Long Settle Delay: On";
+    else
+	wrg->wr[OptionsMenu].label[Opt_LongSettleDelay] = "Long Settle Delay: Off";
+    if (Options.upward_rotation)
+	wrg->wr[OptionsMenu].label[Opt_UpwardRotation] = "Upward Rotation: On";
+    else
+	wrg->wr[OptionsMenu].label[Opt_UpwardRotation] = "Upward Rotation: Off";
 
-    if (gametype == DEMO) {
-	/* do nothing */
-    } else if (IS_DOUBLE(gametype)) {
-	draw_string("Time Left", color_blue, 
-		screen->w/2, layout.score[0].y, DRAW_CENTER | DRAW_ABOVE);
-	layout.time.x = (screen->w - TIME_WIDTH)/2;
-	layout.time.y = layout.score[0].y;
-	layout.time.w = TIME_WIDTH;
-	layout.time.h = TIME_HEIGHT;
-	draw_bordered_rect(&layout.time, &layout.time_border, 2);
-    } else { /* single */
-	int text_h = draw_string("Time Left", color_blue,
-		screen->w/10, screen->h/5, 0);
-	layout.time.x = screen->w / 10;
-	layout.time.y = screen->h / 5 + text_h;
-	layout.time.w = TIME_WIDTH;
-	layout.time.h = TIME_HEIGHT;
+    sprintf(key_repeat_label,"Key Repeat: %.2d", Options.key_repeat_delay);
+    wrg->wr[OptionsMenu].label[Opt_KeyRepeat] = key_repeat_label;
+    if (Options.turbo)
+	wrg->wr[OptionsMenu].label[Opt_Turbo] = "AI Turbo: On";
+    else
+	wrg->wr[OptionsMenu].label[Opt_Turbo] = "AI Turbo: Off";
+}
 
-	draw_bordered_rect(&layout.time, &layout.time_border, 2);
+static int OptionsMenu_action(WalkRadio *wr)
+{
+    switch (wr->defaultchoice) {
+	case Opt_ToggleFullScreen:
+	    SDL_WM_ToggleFullScreen(screen);
+	    break;
+	case Opt_ToggleFlame: Options.flame_wanted = ! Options.flame_wanted; break;
+	case Opt_ToggleSpecial: Options.special_wanted = ! Options.special_wanted; break;
+	case Opt_FasterLevels: Options.faster_levels = ! Options.faster_levels; break;
+	case Opt_LongSettleDelay: Options.long_settle_delay = ! Options.long_settle_delay; break;
+	case Opt_UpwardRotation: Options.upward_rotation = ! Options.upward_rotation; break;
+	case Opt_KeyRepeat: Options.key_repeat_delay = pick_key_repeat(screen); break;
+	case Opt_Turbo: Options.turbo = Options.turbo ? 0 : TURBO_EVERY; break;
+	default: 
+	    break;
     }
+    OptionsMenu_setup();
+    clear_radio(&wrg->wr[OptionsMenu]);
+    setup_radio(&wrg->wr[OptionsMenu]);
+    return 0;
+}
 
-    /*
-     *	LEVEL ADJUSTMENT
-     */
-    if (gametype == DEMO) {
-
-    } else if (gametype == AI_VS_AI) {
-	for (i=0;i<3;i++) {
-	    char buf[80];
-
-	    layout.adjust[0].symbol[i].x = (screen->w - adjust_symbol[i]->w)/2;
-	    layout.adjust[0].symbol[i].w = adjust_symbol[i]->w;
-	    layout.adjust[0].symbol[i].h = adjust_symbol[i]->h;
-	    layout.adjust[0].symbol[i].y = 
-		layout.time_border.y+layout.time_border.h + i * adjust_symbol[i]->h;
-
-	    SDL_BlitSafe(adjust_symbol[i], NULL, widget_layer, 
-		    &layout.adjust[0].symbol[i]);
-
-	    /* draw the textual tallies */
-	    sprintf(buf,"%d",my_adj[i]);
-	    draw_string(buf, color_red,
-		    layout.adjust[0].symbol[i].x - 10, 
-		    layout.adjust[0].symbol[i].y, DRAW_LEFT | DRAW_CLEAR);
-	    sprintf(buf,"%d",their_adj[i]);
-	    draw_string(buf, color_red,
-		    layout.adjust[0].symbol[i].x + layout.adjust[0].symbol[i].w + 10, 
-		    layout.adjust[0].symbol[i].y, DRAW_CLEAR);
-	}
-    } else if (IS_DOUBLE(gametype)) {
-	for (i=0;i<3;i++) {
-	    layout.adjust[0].symbol[i].w = adjust_symbol[i]->w;
-	    layout.adjust[0].symbol[i].h = adjust_symbol[i]->h;
-	    layout.adjust[0].symbol[i].x = (screen->w - 3*adjust_symbol[i]->w)/2;
-	    layout.adjust[0].symbol[i].y = 
-		layout.time_border.y+layout.time_border.h + i * adjust_symbol[i]->h;
-	    SDL_FillRect(widget_layer, &layout.adjust[0].symbol[i], int_black);
-	    SDL_FillRect(screen, &layout.adjust[0].symbol[i], int_black);
-	    if (my_adj[i] != -1) 
-		SDL_BlitSafe(adjust_symbol[my_adj[i]], NULL, widget_layer, 
-			&layout.adjust[0].symbol[i]);
-	    layout.adjust[1].symbol[i].w = adjust_symbol[i]->w;
-	    layout.adjust[1].symbol[i].h = adjust_symbol[i]->h;
-	    layout.adjust[1].symbol[i].x = (screen->w)/2 + adjust_symbol[i]->w/2;
-	    layout.adjust[1].symbol[i].y = 
-		layout.time_border.y+layout.time_border.h + i * adjust_symbol[i]->h;
-	    SDL_FillRect(widget_layer, &layout.adjust[1].symbol[i], int_black);
-	    SDL_FillRect(screen, &layout.adjust[1].symbol[i], int_black);
-	    if (their_adj[i] != -1) 
-		SDL_BlitSafe(adjust_symbol[their_adj[i]], NULL, widget_layer, 
-			&layout.adjust[1].symbol[i]);
-	}
-    } else { /* single player */
-	for (i=0;i<3;i++) {
-	    layout.adjust[0].symbol[i].w = adjust_symbol[i]->w;
-	    layout.adjust[0].symbol[i].h = adjust_symbol[i]->h;
-	    layout.adjust[0].symbol[i].x = 
-		layout.grid_border[0].x + layout.grid_border[0].w +
-		2 * adjust_symbol[i]->w;
-	    layout.adjust[0].symbol[i].y = 
-		layout.time_border.y +layout.time_border.h+ i * adjust_symbol[i]->h;
-	    SDL_FillRect(widget_layer, &layout.adjust[0].symbol[i], int_black);
-	    SDL_FillRect(screen, &layout.adjust[0].symbol[i], int_black);
-	    if (my_adj[i] != -1) 
-		SDL_BlitSafe(adjust_symbol[my_adj[i]], NULL, widget_layer, 
-			&layout.adjust[0].symbol[i]);
-	}
-    }
+static int ColorStyleMenu_action(WalkRadio *wr)
+{
+    _cs->choice = wr->defaultchoice;
+    /* Update this choice on the main menu */
+    updateMenu((int)ColorStyleMenu, wr->defaultchoice);
+    return 1;
+}
+static int SoundStyleMenu_action(WalkRadio *wr) 
+{
+    _ss->choice = wr->defaultchoice;
+    play_all_sounds(_ss->style[_ss->choice]);
+    /* Update this choice on the main menu */
+    updateMenu((int)SoundStyleMenu, wr->defaultchoice);
+    return 1;	
+}
+static int PieceStyleMenu_action(WalkRadio *wr)
+{
+    _ps->choice = wr->defaultchoice;
+    /* Update this choice on the main menu */
+    updateMenu((int)PieceStyleMenu, wr->defaultchoice);
+    return 1;
+}
+static int GameMenu_action(WalkRadio *wr)
+{
+    _local_gametype = wr->defaultchoice;
+    /*    start_playing = 1;*/
+    /* Update this choice on the main menu */
+    updateMenu((int)GameMenu, wr->defaultchoice);
+    return 1;
+}
 
-    /*
-     * NEXT PIECE
-     */
-    if (gametype == DEMO) {
-	/* do nothing */
-    } else if (IS_DOUBLE(gametype)) {
-	int text_h = draw_string("Next Piece", color_blue,
-		screen->w / 2, 
-		layout.adjust[0].symbol[2].y +
-		layout.adjust[0].symbol[2].h, DRAW_CENTER);
-
-	layout.next_piece[0].w = 5 * blockWidth;
-	layout.next_piece[0].h = 5 * blockWidth;
-	layout.next_piece[0].x = (screen->w / 2) - (5 * blockWidth);
-	layout.next_piece[0].y = layout.adjust[0].symbol[2].y +
-	    layout.adjust[0].symbol[2].h + text_h;
-	draw_bordered_rect(&layout.next_piece[0], &layout.next_piece_border[0], 2);
-
-	layout.next_piece[1].w = layout.next_piece[0].w;
-	layout.next_piece[1].h = layout.next_piece[0].h;
-	layout.next_piece[1].y = layout.next_piece[0].y;
-	layout.next_piece[1].x = (screen->w / 2);
-	draw_bordered_rect(&layout.next_piece[1], &layout.next_piece_border[1], 2);
-    } else {
-	int text_h = draw_string("Next Piece", color_blue,
-		screen->w/10, 2*screen->h/5, 0);
+static int MainMenu_action(WalkRadio *wr)
+{
+  int i;
+  /* If they selected a submenu, activate it */
+  switch (wr->defaultchoice) {
+      case ColorStyleMenu:
+      case SoundStyleMenu:
+      case PieceStyleMenu:
+      case GameMenu:
+      case OptionsMenu: 
+	  /* Make sure everything is inactive (not including the main menu) */ 
+	  for (i=0; i<MAX_MENU_CHOICE-1; i++)
+	      if (wrg->wr[i].inactive == FALSE) {
+		  wrg->wr[i].inactive = TRUE;
+		  clear_radio(&wrg->wr[i]);
+	      }
+	  /* now activate the proper submenu */
+	  wrg->wr[wr->defaultchoice].inactive = FALSE;
+	  wrg->cur = wr->defaultchoice;
+	  break;
+      case 5: /* they chose go! */
+	  start_playing = 1;
+	  gametype = _local_gametype;
+	  break;
+      case 6: /* they chose quit */
+	  start_playing = 1;
+	  gametype = QUIT;
+	  break;
+      default:
+	  Debug("Invalid menu choice %d.\n", wr->defaultchoice);
+  }
+  return 1;
+}
 
-	layout.next_piece[0].w = 5 * blockWidth;
-	layout.next_piece[0].h = 5 * blockWidth;
-	layout.next_piece[0].x = screen->w/10;
-	layout.next_piece[0].y = (2*screen->h/5) + text_h;
+/***************************************************************************
+ *      menu_handler()
+ * Play the MENU-style game. 
+ ***************************************************************************/
+static int
+menu_handler(const SDL_Event *event) 
+{
+    int retval;
+    if (event->type == SDL_KEYDOWN) {
+	switch (event->key.keysym.sym) {
+	    case SDLK_q: 
+		start_playing = 1;
+		_local_gametype = gametype = QUIT;
+		return 1;
 
-	/* Draw the box for the next piece to fit in */
-	draw_bordered_rect(&layout.next_piece[0], &layout.next_piece_border[0], 2);
-    }
+	    case SDLK_RETURN:
+                if ((event->key.keysym.mod & KMOD_LCTRL) ||
+                    (event->key.keysym.mod & KMOD_RCTRL)) {
+                  SDL_WM_ToggleFullScreen(screen);
+                  return 1;
+                }
 
-    /*
-     *	PAUSE BOX
-     */
-    if (gametype == DEMO) {
-
-    } else if (IS_DOUBLE(gametype)) {
-	layout.pause.x = layout.next_piece_border[0].x;
-	layout.pause.y = layout.next_piece_border[0].h + layout.next_piece_border[0].y + 2 + 
-	    layout.next_piece_border[0].h / 3;
-	layout.pause.w = layout.next_piece_border[0].w + layout.next_piece[1].w;
-	layout.pause.h = layout.next_piece_border[0].h / 3;
-    } else {
-	layout.pause.x = layout.next_piece_border[0].x;
-	layout.pause.y = layout.next_piece_border[0].h + layout.next_piece_border[0].y + 2 +
-	    layout.next_piece_border[0].h / 3;
-	layout.pause.w = layout.next_piece_border[0].w;
-	layout.pause.h = layout.next_piece_border[0].h / 3;
+	    default:
+		break;
+	}
     }
+    retval = handle_radio_event(wrg, event);
 
-    /* Blit onto the screen surface */
-    {
-	SDL_Rect dest;
-	dest.x = 0; dest.y = 0; dest.w = screen->w; dest.h = screen->h;
-
-	SDL_BlitSafe(flame_layer, NULL, screen, NULL);
-	SDL_BlitSafe(widget_layer, NULL, screen, NULL);
-	SDL_UpdateSafe(screen, 1, &dest);
-    }
-    return;
+    if (retval != -1)
+	return 1;
+    return 0;
 }
 
 /***************************************************************************
- *      draw_pause()
- * Draw or clear the pause indicator.
- *********************************************************************PROTO*/
-void
-draw_pause(int on)
+ *      play_MENU()
+ * Play the MENU-style game. 
+ ***************************************************************************/
+static int
+play_MENU(color_styles cs, piece_styles ps, sound_styles ss,
+    Grid g[], int my_level, AI_Player *aip)
 {
-    int i;
-    if (on) {
-	draw_pre_bordered_rect(&layout.pause, 2);
-	draw_string("* Paused *", color_blue, 
-		layout.pause.x + layout.pause.w / 2, layout.pause.y,
-		DRAW_CENTER | DRAW_UPDATE);
-	for (i=0; i<2; i++) {
-	    /* save this stuff so that the flame doesn't go over it .. */
-	    if (layout.grid[i].w) {
-		SDL_BlitSafe(screen, &layout.grid[i], widget_layer,
-			&layout.grid[i]);
-		SDL_BlitSafe(screen, &layout.next_piece[i], widget_layer,
-			&layout.next_piece[i]);
-	    }
-	}
-    } else {
-	SDL_FillRect(widget_layer, &layout.pause, int_black);
-	SDL_FillRect(screen, &layout.pause, int_black);
-	SDL_BlitSafe(flame_layer, &layout.pause, screen, &layout.pause);
-	/* no need to paste over it with the widget layer: we know it to
-	 * be all transparent */
-	SDL_UpdateSafe(screen, 1, &layout.pause);
+    int curtimeleft;
+    int match;
+    int level[2];			/* level array: me + dummy slot */
+    int adjustment[2] = {-1, -1};	/* result of playing a match */
+    int my_adj[3];			/* my three winnings so far */
+    int result;
+    color_style *event_cs[2];	/* pass these to event_loop */
+    sound_style *event_ss[2];
+    AI_Player *event_ai[2];
+    int who[1] = { AI_PLAYER };
+    Session s;
+
+    level[0] = my_level;	/* starting level */
+    session_init(&s, DEMO);
+    SeedRandom(0);
+
+    while (1) {	
+	/* until they give up by pressing 'q'! */
+	/* 5 total minutes for three matches */
+	curtimeleft = 300;
+	my_adj[0] = 0; my_adj[1] = 1; my_adj[2] = 2;
+
+	for (match=0; match<3 && curtimeleft > 0; match++) {
+	    /* generate the board */
+	    /* draw the background */
+	    g[0] = generate_board(10,20,level[0]);
+	    draw_background(&s, screen, cs.style[0]->w, g, level, my_adj, NULL,
+		    &(aip->name));
+		{
+		    int i;
+		    for (i=0; i<MAX_MENU_CHOICE; i++) 
+			draw_radio(&wrg->wr[i], i == wrg->cur);
+		}
+	    /* get the result, but don't update level yet */
 
-	for (i=0; i<2; i++) 
-	    if (layout.grid[i].w) {
-		SDL_BlitSafe(widget_layer, &layout.grid[i], screen,
-			&layout.grid[i]);
-		SDL_FillRect(widget_layer, &layout.grid[i], int_solid_black);
+	    event_cs[0] = event_cs[1] = cs.style[cs.choice];
+	    event_ss[0] = event_ss[1] = ss.style[ss.choice];
+	    event_ai[0] = aip;
+	    event_ai[1] = NULL;
 
-		SDL_BlitSafe(widget_layer, &layout.next_piece[i], screen,
-			&layout.next_piece[i]);
-		SDL_FillRect(widget_layer, &layout.next_piece[i], int_solid_black);
+	    result = event_loop(&s, screen, ps.style[ps.choice], 
+		    event_cs, event_ss, g,
+		    level, 0, &curtimeleft, 1, adjustment,
+		    menu_handler, time(NULL), who, event_ai);
+	    if (result < 0) { 	/* explicit quit */
+		session_free(&s);
+		return -1;
 	    }
+	    /* reset board */
+	    my_adj[match] = adjustment[0];
+	}
     }
 }
 
+
 /***************************************************************************
- *      draw_clock()
- * Draws a five-digit (-x:yy) clock in the center of the screen.
+ *      choose_gametype()
+ * User selects the desired game type, which is returned. Uses walking
+ * radio menus.
  *********************************************************************PROTO*/
-void
-draw_clock(int seconds)
-{
-    static int old_seconds = -111;	/* last time we drew */
-    static SDL_Surface * digit[12];
-    char buf[16];
-    static int w = -1, h= -1; /* max digit width/height */
-    int i, c;
-
-    if (seconds == old_seconds || gametype == DEMO) return;
-
-    if (old_seconds == -111) {
-	/* setup code */
+int choose_gametype(piece_styles *ps, color_styles *cs,
+	sound_styles *ss, AI_Players *ai)
+{ /* walk-radio menu */
+    int i;
 
-	for (i=0;i<10;i++) {
-	    sprintf(buf,"%d",i);
-	    digit[i] = TTF_RenderText_Blended(font,buf,color_blue);
-	}
-	sprintf(buf,":"); digit[10] = TTF_RenderText_Blended(font,buf,color_red);
-	sprintf(buf,"-"); digit[11] = TTF_RenderText_Blended(font,buf,color_red);
+    _local_gametype = gametype;
 
-	for (i=0;i<12;i++) {
-	    Assert(digit[i]);
-	    /* the colorkey and display format are already done */
-	    /* find the largest dimensions */
-	    if (digit[i]->w > w) w = digit[i]->w;
-	    if (digit[i]->h > h) h = digit[i]->h;
-	}
-    }
+    if (!wrg) {
+	Calloc(wrg , WalkRadioGroup * , sizeof(*wrg));
+	wrg->n = MAX_MENU_CHOICE;
+	Calloc(wrg->wr, WalkRadio *, wrg->n * sizeof(*wrg->wr));
+	wrg->cur = MainMenu;
 
-    old_seconds = seconds;
+	wrg->wr[PieceStyleMenu].n = ps->num_style;
+	Malloc(wrg->wr[PieceStyleMenu].label, char**, sizeof(char*)*ps->num_style);
+	for (i=0; i<ps->num_style; i++)
+	    wrg->wr[PieceStyleMenu].label[i] = ps->style[i]->name;
+	wrg->wr[PieceStyleMenu].defaultchoice = ps->choice;
+	wrg->wr[PieceStyleMenu].action = PieceStyleMenu_action;
 
-    sprintf(buf,"%d:%02d",seconds / 60, seconds % 60);
+	wrg->wr[ColorStyleMenu].n = cs->num_style;
+	Malloc(wrg->wr[ColorStyleMenu].label, char**, sizeof(char*)*cs->num_style);
+	for (i=0; i<cs->num_style; i++)
+	    wrg->wr[ColorStyleMenu].label[i] = cs->style[i]->name;
+	wrg->wr[ColorStyleMenu].defaultchoice = cs->choice;
+	wrg->wr[ColorStyleMenu].action = ColorStyleMenu_action;
 
-    c = layout.time.x;
-    layout.time.w = w * 5;
-    layout.time.h = h;
+	wrg->wr[SoundStyleMenu].n = ss->num_style;
+	Malloc(wrg->wr[SoundStyleMenu].label, char**, sizeof(char*)*ss->num_style);
+	for (i=0; i<ss->num_style; i++)
+	    wrg->wr[SoundStyleMenu].label[i] = ss->style[i]->name;
+	wrg->wr[SoundStyleMenu].defaultchoice = ss->choice;
+	wrg->wr[SoundStyleMenu].action = SoundStyleMenu_action;
 
-    SDL_FillRect(widget_layer, &layout.time, int_solid_black); 
+	_ss = ss;
+	_cs = cs;
+	_ps = ps;
 
-    if (strlen(buf) > 5)
-	sprintf(buf,"----");
+	wrg->wr[GameMenu].n = 6;
+	Malloc(wrg->wr[GameMenu].label, char**, sizeof(char*)*wrg->wr[GameMenu].n);
+	wrg->wr[GameMenu].label[0] = "Solo Normal Game";
+	wrg->wr[GameMenu].label[1] = "Solo Scoring Marathon";
+	wrg->wr[GameMenu].label[2] = "Solo vs. Computer";
+	wrg->wr[GameMenu].label[3] = "2 Players @ 1 Keyboard";
+	wrg->wr[GameMenu].label[4] = "2 Players, Use Network";
+	wrg->wr[GameMenu].label[5] = "Computer vs. Computer";
+	wrg->wr[GameMenu].defaultchoice = 0;
+	wrg->wr[GameMenu].action = GameMenu_action;
 
-    if (strlen(buf) < 5)
-	layout.time.x += ((5 - strlen(buf)) * w) / 2;
+	wrg->wr[OptionsMenu].n = 8;
+	Malloc(wrg->wr[OptionsMenu].label, char**, sizeof(char*)*wrg->wr[OptionsMenu].n);
+	OptionsMenu_setup();
+	wrg->wr[OptionsMenu].defaultchoice = 0;
+	wrg->wr[OptionsMenu].action = OptionsMenu_action;
 
+	/* Make the main menu */
+	wrg->wr[MainMenu].n = 7;
+	Malloc(wrg->wr[MainMenu].label, char**, sizeof(char*)*wrg->wr[MainMenu].n);
+	/* Main menu displays the current value for each choice */
+	wrg->wr[MainMenu].label[0] = wrg->wr[ColorStyleMenu].label[wrg->wr[ColorStyleMenu].defaultchoice];
+	wrg->wr[MainMenu].label[1] = wrg->wr[SoundStyleMenu].label[wrg->wr[SoundStyleMenu].defaultchoice];
+	wrg->wr[MainMenu].label[2] = wrg->wr[PieceStyleMenu].label[wrg->wr[PieceStyleMenu].defaultchoice];
+	wrg->wr[MainMenu].label[3] = wrg->wr[GameMenu].label[(int)_local_gametype];
+	wrg->wr[MainMenu].label[4] = "Special Options";
+	wrg->wr[MainMenu].label[5] = "Play!";
+	wrg->wr[MainMenu].label[6] = "Quit";
+	wrg->wr[MainMenu].defaultchoice = 5;
+	wrg->wr[MainMenu].action = MainMenu_action;
 
-    for (i=0;buf[i];i++) {
-	SDL_Surface * to_blit;
+	for (i=0; i<MAX_MENU_CHOICE; i++) {
+	    setup_radio(&wrg->wr[i]);
+	}
 
-	if (buf[i] >= '0' && buf[i] <= '9')
-	    to_blit = digit[buf[i] - '0'];
-	else if (buf[i] == ':')
-	    to_blit = digit[10];
-	else if (buf[i] == '-')
-	    to_blit = digit[11];
-	else PANIC("unknown character in clock string [%s]",buf);
+	wrg->wr[ColorStyleMenu].x = 2*(screen->w/3) +
+	    (screen->w/3 - wrg->wr[ColorStyleMenu].area.w)/2;
+	wrg->wr[ColorStyleMenu].y =
+	    (screen->h - wrg->wr[ColorStyleMenu].area.h)/2;
+	wrg->wr[ColorStyleMenu].inactive = TRUE;
 
-	/* center the letter horizontally */
-	if (w > to_blit->w) layout.time.x += (w - to_blit->w) / 2;
-	layout.time.w = to_blit->w;
-	layout.time.h = to_blit->h;
-	/*
-	Debug("[%d+%d, %d+%d]\n",
-		clockPos.x,clockPos.w,clockPos.y,clockPos.h);
-		*/
-	SDL_BlitSafe(to_blit, NULL, widget_layer, &layout.time);
-	if (w > to_blit->w) layout.time.x -= (w - to_blit->w) / 2;
-	layout.time.x += w;
-    }
+	wrg->wr[SoundStyleMenu].x = 2*(screen->w/3) +
+	    (screen->w/3 - wrg->wr[SoundStyleMenu].area.w)/2;
+	wrg->wr[SoundStyleMenu].y =
+	    (screen->h - wrg->wr[SoundStyleMenu].area.h)/2;
+	wrg->wr[SoundStyleMenu].inactive = TRUE;
 
-    layout.time.x = c;
-    /*    clockPos.x = (screen->w - (w * 5)) / 2;*/
-    layout.time.w = w * 5;
-    layout.time.h = h;
-    SDL_BlitSafe(flame_layer, &layout.time, screen, &layout.time);
-    SDL_BlitSafe(widget_layer, &layout.time, screen, &layout.time);
-    SDL_UpdateSafe(screen, 1, &layout.time);
+	wrg->wr[OptionsMenu].x = 2*(screen->w/3) +
+	    (screen->w/3 - wrg->wr[OptionsMenu].area.w)/2;
+	wrg->wr[OptionsMenu].y =
+	    (screen->h - wrg->wr[OptionsMenu].area.h)/2;
+	wrg->wr[OptionsMenu].inactive = TRUE;
 
-    return;
-}
+	wrg->wr[PieceStyleMenu].x = 2*(screen->w/3) +
+	    (screen->w/3 - wrg->wr[PieceStyleMenu].area.w)/2;
+	wrg->wr[PieceStyleMenu].y =
+	    (screen->h - wrg->wr[PieceStyleMenu].area.h)/2;
+	wrg->wr[PieceStyleMenu].inactive = TRUE;
 
-/***************************************************************************
- *      draw_score()
- *********************************************************************PROTO*/
-void
-draw_score(SDL_Surface *screen, int i)
-{
-    char buf[256];
+	wrg->wr[GameMenu].x = 2*(screen->w/3) +
+	    (screen->w/3 - wrg->wr[GameMenu].area.w)/2;
+	wrg->wr[GameMenu].y =
+	    (screen->h - wrg->wr[GameMenu].area.h)/2;
+	wrg->wr[GameMenu].inactive = TRUE;
 
-    sprintf(buf, "%d", Score[i]);
-    draw_string(buf, color_red, 
-	    layout.score[i].x, layout.score[i].y, DRAW_LEFT | DRAW_CLEAR |
-	    DRAW_ABOVE | DRAW_UPDATE);
-}
+	wrg->wr[MainMenu].x = (screen->w/3 - wrg->wr[MainMenu].area.w)/2;
+	wrg->wr[MainMenu].y = (screen->h - wrg->wr[MainMenu].area.h)/2;
+	wrg->wr[MainMenu].inactive = FALSE;
+    }
 
-/***************************************************************************
- *      draw_next_piece()
- * Draws the next piece on the screen.
- *
- * Needs the color style because draw_play_piece() needs it to paste the
- * bitmaps. 
- *********************************************************************PROTO*/
-void
-draw_next_piece(SDL_Surface *screen, piece_style *ps, color_style *cs,
-	play_piece *cp, play_piece *np, int P)
-{
-    if (gametype != DEMO) {
-	/* fake-o centering */
-	int cp_right = 5 - cp->base->dim;
-	int cp_down = 5 - cp->base->dim;
-	int np_right = 5 - np->base->dim;
-	int np_down = 5 - np->base->dim;
+    clear_screen_to_flame();
+    SDL_EnableKeyRepeat(SDL_DEFAULT_REPEAT_DELAY*10,
+	    SDL_DEFAULT_REPEAT_INTERVAL*10);
 
-	draw_play_piece(screen, cs,
-		cp, 
-		layout.next_piece[P].x + cp_right * cs->w / 2,
-		layout.next_piece[P].y + cp_down * cs->w / 2, 0,
-		np, 
-		layout.next_piece[P].x + np_right * cs->w / 2,
-		layout.next_piece[P].y + np_down * cs->w / 2, 0);
+    start_playing = 0;
+    while (1) {
+	Grid g[2];
+	gametype = DEMO;
+	play_MENU(*cs, *ps, *ss, g, Options.faster_levels ? 5 : 10, 
+		&ai->player[ZEROTO(ai->n)]);
+	if (start_playing) {
+	    return 0;
+	}
     }
-    return;
 }
 
 /*
- * $Log: display.c,v $
- * Revision 1.25  2000/11/01 04:39:41  weimer
- * clear the little scoring spot correctly, updates for making a no-sound
- * distribution
+ * $Log: gamemenu.c,v $
+ * Revision 1.30  2001/01/06 00:25:23  weimer
+ * changes so that we remember things ...
  *
- * Revision 1.24  2000/11/01 03:53:06  weimer
+ * Revision 1.29  2001/01/05 21:38:01  weimer
+ * more key changes
+ *
+ * Revision 1.28  2001/01/05 21:12:32  weimer
+ * advance to atris 1.0.5, add support for ".atrisrc" and changing the
+ * keyboard repeat rate
+ *
+ * Revision 1.27  2000/11/10 18:16:48  weimer
+ * changes for Atris 1.0.4 - three new special options
+ *
+ * Revision 1.26  2000/11/06 04:16:10  weimer
+ * "power pieces" plus images
+ *
+ * Revision 1.25  2000/11/06 04:06:44  weimer
+ * option menu
+ *
+ * Revision 1.24  2000/11/06 01:24:43  wkiri
+ * Removed 'quit' from the game type menu.
+ *
+ * Revision 1.23  2000/11/06 01:22:40  wkiri
+ * Updated menu system.
+ *
+ * Revision 1.22  2000/11/02 03:06:20  weimer
+ * better interface for walk-radio menus: we are now ready for Kiri to change
+ * them to add run-time options ...
+ *
+ * Revision 1.21  2000/11/01 03:53:06  weimer
  * modifications for version 1.0.1: you can pick your starting level, you can
  * pick the AI difficulty factor, the game is better about placing new pieces
  * when there is garbage, when things fall out of your control they now fall
  * at a uniform rate ...
  *
- * Revision 1.23  2000/10/30 16:25:25  weimer
- * display the network player score during network games. Also give the
- * non-server a little message when waiting for the server to go on.
- *
- * Revision 1.22  2000/10/29 22:55:01  weimer
+ * Revision 1.20  2000/10/29 22:55:01  weimer
  * networking consistency checks (you must have the same number of doodads):
  * special hotkey 'f' in main menu toggles full screen mode
  * added depth specification on the command line
  * automatically search for the darkest non-black color ...
  *
- * Revision 1.21  2000/10/29 21:28:58  weimer
- * fixed a few failures to clear the screen if we didn't have a flaming
- * backdrop
- *
- * Revision 1.20  2000/10/29 21:23:28  weimer
+ * Revision 1.19  2000/10/29 21:23:28  weimer
  * One last round of header-file changes to reflect my newest and greatest
  * knowledge of autoconf/automake. Now if you fail to have some bizarro
  * function, we try to go on anyway unless it is vastly needed.
  *
- * Revision 1.19  2000/10/29 19:04:32  weimer
- * minor highscore handling changes: new filename, use the draw_string() and
- * draw_bordered_rect() and input_string() interfaces, handle the widget layer
- * and the flame layer, etc. Also fix a minor bug where you would be prevented
- * from settling if you pressed a key even if it didn't really move you. :-)
- *
  * Revision 1.18  2000/10/29 17:23:13  weimer
  * incorporate "xflame" flaming background for added spiffiness ...
  *
- * Revision 1.17  2000/10/28 13:39:14  weimer
- * added a pausing feature ...
+ * Revision 1.17  2000/10/29 00:17:39  weimer
+ * added support for a system independent random number generator
  *
- * Revision 1.16  2000/10/21 01:14:42  weimer
+ * Revision 1.16  2000/10/28 21:52:56  weimer
+ * you can now press 'Q' to quit from the main menu!
+ *
+ * Revision 1.15  2000/10/28 16:40:17  weimer
+ * Further changes: we can now build .tar.gz files and RPMs!
+ *
+ * Revision 1.14  2000/10/22 22:05:51  weimer
+ * Added a few new sounds ...
+ *
+ * Revision 1.13  2000/10/21 01:14:42  weimer
  * massic autoconf/automake restructure ...
  *
- * Revision 1.15  2000/10/18 23:57:49  weimer
+ * Revision 1.12  2000/10/18 23:57:49  weimer
  * general fixup, color changes, display changes.
  * Notable: "Safe" Blits and Updates now perform "clipping". No more X errors,
  * we hope!
  *
- * Revision 1.14  2000/10/18 02:04:02  weimer
+ * Revision 1.11  2000/10/18 02:04:02  weimer
  * playability changes ...
  *
- * Revision 1.13  2000/10/14 02:52:44  weimer
- * fixed a memory corruption problem in display (a use after a free)
- *
- * Revision 1.12  2000/10/13 16:37:39  weimer
- * Changed the AI so that it now passes state around via void pointers, rather
- * than using global variables. This allows the same AI to play itself. Also
- * changed the "AI vs. AI" display so that you can keep track of total wins
- * and losses.
- *
- * Revision 1.11  2000/10/13 15:41:53  weimer
+ * Revision 1.10  2000/10/13 15:41:53  weimer
  * revamped AI support, now you can pick your AI and have AI duels (such fun!)
  * the mighty Aliz AI still crashes a bit, though ... :-)
  *
- * Revision 1.10  2000/10/12 22:21:25  weimer
+ * Revision 1.9  2000/10/12 22:21:25  weimer
  * display changes, more multi-local-play threading (e.g., myScore ->
  * Score[0]), that sort of thing ...
  *
- * Revision 1.9  2000/10/12 19:17:08  weimer
+ * Revision 1.8  2000/10/12 19:17:08  weimer
  * Further support for AI players and multiple game types.
  *
- * Revision 1.8  2000/10/12 00:49:08  weimer
+ * Revision 1.7  2000/10/12 01:38:07  weimer
+ * added initial support for persistent player identities
+ *
+ * Revision 1.6  2000/10/12 00:49:08  weimer
  * added "AI" support and walking radio menus for initial game configuration
  *
- * Revision 1.7  2000/09/09 17:05:35  wkiri
+ * Revision 1.5  2000/09/09 17:05:35  wkiri
  * Hideous log changes (Wes: how dare you include a comment character!)
- *
- * Revision 1.6  2000/09/09 16:58:27  weimer
- * Sweeping Change of Ultimate Mastery. Main loop restructuring to clean up
- * main(), isolate the behavior of the three game types. Move graphic files
- * into graphics/-, style files into styles/-, remove some unused files,
- * add game flow support (breaks between games, remembering your level within
- * this game), multiplayer support for the event loop, some global variable
- * cleanup. All that and a bag of chips!
- *
- * Revision 1.5  2000/09/05 20:22:12  weimer
- * native video mode selection, timing investigation
- *
- * Revision 1.4  2000/09/03 21:06:31  wkiri
- * Now handles three different game types (and does different things).
- * Major changes in display.c to handle this.
- *
- * Revision 1.3  2000/09/03 18:40:23  wkiri
- * Cleaned up atris.c some more (high_score_check()).
- * Added variable for game type (defaults to MARATHON).
- *
- */
-
-
-extern int Score[];
-
-struct state_struct {
-    int 	ai;
-    int 	falling;
-    int 	fall_speed; 
-    int 	accept_input;
-    int 	tetris_handling;
-    int 	limbo;
-    int 	other_in_limbo;
-    int 	limbo_sent;
-    int 	draw;
-    Uint32	collide_time;	/* time when your piece merges with the rest */
-    Uint32 	next_draw;
-    Uint32 	draw_timeout;
-    Uint32 	tv_next_fall;
-    int 	fall_event_interval;
-    Uint32 	tv_next_tetris;
-    int 	tetris_event_interval;
-    Uint32 	tv_next_ai_think;
-    Uint32 	tv_next_ai_move;
-    int		ai_interval;
-    int 	ready_for_fast;
-    int 	ready_for_rotate;
-    int		seed;
-    play_piece	cp, np;		
-    void *	ai_state;
-    /* these two are used by tetris_event() */
-    int		check_result;
-    int		num_lines_cleared;
-} State[2];
-
-/* one position structure per player */
-struct pos_struct {
-    int x;
-    int y;
-    int rot;
-    int old_x;
-    int old_y;
-    int old_rot;
-    Command move;
-} pos[2];
-
-Grid distract_grid[2];
-
-/***************************************************************************
- *      paste_on_board()
- * Places the given piece on the board. Uses row-column (== grid)
- * coordinates. 
- *********************************************************************PROTO*/
-void
-paste_on_board(play_piece *pp, int col, int row, int rot, Grid *g)
-{
-    int i,j,c;
-
-    for (j=0;j<pp->base->dim;j++)
-	for (i=0;i<pp->base->dim;i++) 
-	    if ((c=BITMAP(*pp->base,rot,i,j))) {
-		int t_x = i + col; /* was + (screen_x / cs->w); */
-		int t_y = j + row; /* was + (screen_y / cs->h); */
-		if ((t_x<0 || t_y<0 || t_x>=g->w || t_y>=g->h)) {
-		    Debug("Serious consistency failure: dropping pieces.\n");
-		    continue;
-		}
-		GRID_SET(*g,t_x,t_y,pp->colormap[c]);
-		FALL_SET(*g,t_x,t_y,NOT_FALLING);
-		if (t_x > 0) GRID_CHANGED(*g,t_x-1,t_y) = 1;
-		if (t_y > 0) GRID_CHANGED(*g,t_x,t_y-1) = 1;
-		if (t_x < g->w-1) GRID_CHANGED(*g,t_x+1,t_y) = 1;
-		if (t_y < g->h-1) GRID_CHANGED(*g,t_x,t_y+1) = 1;
-	}
-    return;
-}
-
-/***************************************************************************
- *      screen_to_exact_grid_coords()
- * Converts screen coordinates to exact grid coordinates. Will abort the
- * program if you pass in unaligned coordinates!
- ***************************************************************************/
-static void
-screen_to_exact_grid_coords(Grid *g, int blockWidth, 
-	int screen_x, int screen_y, int *row, int *col)
-{
-    screen_x -= g->board.x;
-    screen_y -= g->board.y;
-
-    Assert(screen_x % blockWidth == 0);
-    Assert(screen_y % blockWidth == 0);
-
-    *row = screen_y / blockWidth;
-    *col = screen_x / blockWidth;
-
-    return;
-}
-
-/***************************************************************************
- *      screen_to_grid_coords()
- * Converts screen coordinates to grid coordinates. Rounds "down". 
- ***************************************************************************/
-void
-screen_to_grid_coords(Grid *g, int blockWidth, 
-	int screen_x, int screen_y, int *row, int *col)
-{
-    screen_x -= g->board.x;
-    screen_y -= g->board.y;
-    if (screen_x < 0) screen_x -= 19;	/* round up to negative #s */
-    if (screen_y < 0) screen_y -= 19;	/* round up to negative #s */
-
-    *row = screen_y / blockWidth;
-    *col = screen_x / blockWidth;
-
-    return;
-}
-
-/***************************************************************************
- *      valid_position()
- * Determines if the given position is valid. Uses row-column (== grid)
- * coordinates. Returns 0 if the piece would fall out of bounds or if
- * some solid part of the piece would fall over something already on the
- * the grid. Returns 1 otherwise (it is then safe to call
- * paste_on_board()). 
- *********************************************************************PROTO*/
-int
-valid_position(play_piece *pp, int col, int row, int rot, Grid *g)
-{
-    int i,j;
-
-    /* 
-     * We don't want this check because you can have col=-2 or whatnot if
-     * your piece doesn't start on its leftmost border.
-     *
-     * if (col < 0 || col >= g->w || row < 0 || row >= g->h)
-     *	return 0;
-     */
-
-    for (j=0;j<pp->base->dim;j++)
-	for (i=0;i<pp->base->dim;i++) 
-	    if (BITMAP(*pp->base,rot,i,j)) {
-		int t_x = i + col; /* was + (screen_x / cs->w); */
-		int t_y = j + row; /* was + (screen_y / cs->h); */
-		if (t_x < 0 || t_y < 0 || t_x >= g->w || t_y >= g->h)
-		    return 0;
-		if (GRID_CONTENT(*g,t_x,t_y)) return 0;
-	}
-    return 1;
-}
+ *
+ * Revision 1.4  2000/09/09 16:58:27  weimer
+ * Sweeping Change of Ultimate Mastery. Main loop restructuring to clean up
+ * main(), isolate the behavior of the three game types. Move graphic files
+ * into graphics/-, style files into styles/-, remove some unused files,
+ * add game flow support (breaks between games, remembering your level within
+ * this game), multiplayer support for the event loop, some global variable
+ * cleanup. All that and a bag of chips!
+ *
+ * Revision 1.3  2000/09/04 22:49:51  wkiri
+ * gamemenu now uses the new nifty menus.  Also, added delete_menu.
+ *
+ * Revision 1.2  2000/09/04 19:48:02  weimer
+ * interim menu for choosing among game styles, button changes (two states)
+ *
+ * Revision 1.1  2000/09/03 19:41:30  wkiri
+ * Now allows you to choose the game type (though it doesn't do anything yet).
+ *
+ */
 
 /***************************************************************************
- *      valid_screen_position()
- * Determines if the given position is valid. Uses screen coordinates.
- * Handles pieces that are not perfectly row-aligned. Pieces must still
- * be perfectly column aligned. 
- *
- * Returns 0 if the piece would fall out of bounds or if some solid part of
- * the piece would fall over something already on the the grid. Returns 1
- * otherwise (it is then safe to call paste_on_board()). 
+ *      cleanup_grid()
+ * Removes all of the REMOVE_ME's in a grid. Normally one uses draw_grid
+ * for this purpose, but you might have a personal testing grid or
+ * something that you're not displaying.
  *********************************************************************PROTO*/
-int
-valid_screen_position(play_piece *pp, int blockWidth, Grid *g,
-	int rot, int screen_x, int screen_y)
+void
+cleanup_grid(Grid *g)
 {
-    int row, row2, col;
-
-    screen_to_grid_coords(g, blockWidth, screen_x, screen_y, &row, &col);
-
-    if (!valid_position(pp, col, row, rot, g))
-	return 0;
-
-    screen_to_grid_coords(g, blockWidth, screen_x, screen_y+19, &row2, &col);
-
-    if (row == row2) return 1;	/* no need to recheck, you were aligned */
-    else return valid_position(pp, col, row2, rot, g);
+    int x,y;
+    for (y=g->h-1;y>=0;y--) 
+	for (x=g->w-1;x>=0;x--) 
+	    if (GRID_CONTENT(*g,x,y) == REMOVE_ME)
+		GRID_SET(*g,x,y,0);
 }
 
 /***************************************************************************
- *      tetris_event()
- * Do some work associated with a collision. Needs the color style to draw
- * the grid.
- *************************************************************************/
-int tetris_event(int *delay, int count, SDL_Surface * screen, 
-	piece_style *ps, color_style *cs, sound_style *ss, Grid g[], int
-	level, int fall_event_interval, int sock, int draw,
-	int *blank, int *garbage, int P)
+ *      grid_masks()
+ * Summarizes the given grid as per-column bitmasks (see Grid_Masks). One
+ * pass over the squares, after which evaluators need never look at them
+ * again.
+ *********************************************************************PROTO*/
+void
+grid_masks(Grid *g, Grid_Masks *m)
 {
-    if (count == 1) { /* determine if anything happened, sounds */
-	int i;
-
-	State[P].check_result = check_tetris(g);
-	State[P].num_lines_cleared += State[P].check_result;
-
-	if (State[P].check_result >= 3)
-	    play_sound(ss,SOUND_CLEAR4,256);
-	else for (i=0;i<State[P].check_result;i++)
-	    play_sound(ss,SOUND_CLEAR1,256+6144*i);
-
-	*delay = 1;
-	return 2;
-
-    } else if (count == 2) {	/* run gravity */
-	int x,y;
-
-	if (sock) { 
-	    char msg = 'c'; /* WRW: send update */
-	    send(sock,&msg,1,0);
-	    send(sock,g[0].contents,sizeof(*g[0].contents)
-		    * g[0].h * g[0].w,0); 
-		    
-	}
-	draw_grid(screen,cs,&g[0],draw);
+    int x,y;
 
-	/*
-	 * recalculate falling, run gravity
-	 */
-	memcpy(g->temp,g->fall,g->w*g->h*sizeof(*(g->temp)));
-	for (y=g->h-1;y>=0;y--) 
-	    for (x=g->w-1;x>=0;x--) 
-		FALL_SET(*g,x,y,UNKNOWN);
-	run_gravity(&g[0]);
-	memset(g->changed,0,g->h*g->w*sizeof(*(g->changed)));
-	for (y=g->h-1;y>=0;y--) 
-	    for (x=g->w-1;x>=0;x--) 
-		if (TEMP_CONTENT(*g,x,y)!=FALL_CONTENT(*g,x,y)){
-		    GRID_CHANGED(*g,x,y) = 1;
-		    if (x > 0) GRID_CHANGED(*g,x-1,y) = 1;
-		    if (y > 0) GRID_CHANGED(*g,x,y-1) = 1;
-		    if (x < g->w-1) GRID_CHANGED(*g,x+1,y) = 1;
-		    if (y < g->h-1) GRID_CHANGED(*g,x,y+1) = 1;
-		}
-	/* 
-	 * check: did FALL_CONTENT change? 
-	 */
-	draw_grid(screen,cs,&g[0],draw);
+    Assert(g->w <= GRID_MASK_MAX_W && g->h <= GRID_MASK_MAX_H);
+    m->w = g->w;
+    m->h = g->h;
+    memset(m->occupied, 0, sizeof(m->occupied));
+    memset(m->garbage, 0, sizeof(m->garbage));
+    memset(m->same_left, 0, sizeof(m->same_left));
 
-	if (determine_falling(&g[0])) {
-	    *delay = 1;
-	    return 3;
-	} else {
-	    Score[P] += State[P].num_lines_cleared *
-		State[P].num_lines_cleared * level;
-	    if (sock) {
-		char msg = 's'; /* WRW: send update */
-		send(sock,&msg,1,0);
-		send(sock,(char *)&Score[P],sizeof(Score[P]),0);
-		if (State[P].num_lines_cleared >= 5) {
-		    char msg = 'g'; /* WRW: send garbage! */
-		    send(sock,&msg,1,0);
-		    State[P].num_lines_cleared -= 4; /* might possibly also blank! */
-		}
-		if (State[P].num_lines_cleared >= 3) {
-		    int i;
-		    for (i=3;i<=State[P].num_lines_cleared;i++) {
-			char msg = 'b'; /* WRW: send blanking! */
-			send(sock,&msg,1,0);
-		    }
-		}
-	    } else {
-		if (State[P].num_lines_cleared >= 5) {
-		    *garbage = 1;
-		    State[P].num_lines_cleared -= 4;
-		}
-		if (State[P].num_lines_cleared >= 3) {
-		    *blank = (State[P].num_lines_cleared - 2);
-		}
-	    }
-	    draw_score(screen,P);
-	    State[P].num_lines_cleared = 0;
-	    return 0;
+    for (y=0; y<g->h; y++) {
+	unsigned char *row = &GRID_CONTENT(*g,0,y);
+	Uint32 bit = 1U << y;
+	for (x=0; x<g->w; x++) {
+	    if (!row[x]) continue;
+	    m->occupied[x] |= bit;
+	    if (row[x] == 1)
+		m->garbage[x] |= bit;
+	    if (x > 0 && row[x-1] == row[x])
+		m->same_left[x] |= bit;
 	}
-    } else if (count >= 3 && count <= 22) {
-	if (draw) 
-	    draw_falling(screen, cs->w , &g[0], count - 2);
-
-	/*
-	*delay = max(fall_event_interval / 5,4);
-	*/
-	*delay = 4;
-	return count + 1;
-    } else if (count == 23) {
-	fall_down(g);
-	draw_grid(screen,cs,g,draw);
-	if (run_gravity(g))
-	    play_sound(ss,SOUND_THUD,0);
-	/*
-	*delay = max(fall_event_interval / 5,4);
-	*/
-	*delay = 4; 
-	if (determine_falling(&g[0])) 
-	    return 3;
-	if (check_tetris(g))
-	    return 1;
-	else /* cannot be 0: we must redraw without falling */
-	    return 2;
-    }
-    return 0;	/* not done yet */
-}
-
-/***************************************************************************
- *      do_blank()
- * Blank the visual screen of the given (local) player. 
- ***************************************************************************/
-static void
-do_blank(SDL_Surface *screen, sound_style *ss[2], Grid g[], int P)
-{
-    play_sound(ss[P],SOUND_GARBAGE1,1);
-    if (State[P].draw) {
-	State[P].next_draw = SDL_GetTicks() + 1000;
-	State[P].draw_timeout = 1000;
-	SDL_FillRect(screen, &g[P].board, 
-		SDL_MapRGB(screen->format,32,32,32));
-	SDL_UpdateSafe(screen, 1, &g[P].board);
-    }  else {
-	State[P].next_draw += 1000;
-	State[P].draw_timeout += 1000;
     }
-    { int i,j;
-	for (j=0;j<g[0].h;j++)
-	    for (i=0;i<g[0].w;i++)
-		GRID_CHANGED(distract_grid[P],i,j) = 0;
-    }
-    State[P].draw = 0;
-}
-
-/***************************************************************************
- *      bomb_fun()
- * Function for the bomb special piece.
- ***************************************************************************/
-static void
-bomb_fun(int x, int y, Grid *g) 
-{
-    if ((x<0 || y<0 || x>=g->w || y>=g->h)) 
-	return;
-    GRID_SET(*g,x,y,REMOVE_ME);
 }
 
-static int most_common = 1;
-
 /***************************************************************************
- *      colorkill_fun()
- * Function for the repainting special piece.
- ***************************************************************************/
-static void
-colorkill_recurse(int x, int y, Grid *g, int target_color)
+ *      generate_board_r()
+ * Creates a new board at the given level, drawing the garbage from *seed
+ * instead of the shared generator.
+ *********************************************************************PROTO*/
+Grid
+generate_board_r(int w, int h, int level, Uint32 *seed)
 {
-    if ((x<0 || y<0 || x>=g->w || y>=g->h)) 
-	return;
-    GRID_CHANGED(*g,x,y) = 1;
-    if (GRID_CONTENT(*g,x,y) != target_color) return;
-    GRID_SET(*g,x,y,REMOVE_ME);
-    colorkill_recurse(x - 1, y, g, target_color);
-    colorkill_recurse(x + 1, y, g, target_color);
-    colorkill_recurse(x, y - 1, g, target_color);
-    colorkill_recurse(x, y + 1, g, target_color);
-}
+    int i,j,r;
 
-static void
-colorkill_fun(int x, int y, Grid *g)
-{
-    int c;
-    if ((x<0 || y<0 || x>=g->w || y>=g->h)) 
-	return;
-    GRID_CHANGED(*g,x,y) = 1;
-    c = GRID_CONTENT(*g,x,y);
-    if (c <= 1 || c == REMOVE_ME) return;
-    GRID_SET(*g,x,y,REMOVE_ME);
-    colorkill_recurse(x - 1, y, g, c);
-    colorkill_recurse(x + 1, y, g, c);
-    colorkill_recurse(x, y - 1, g, c);
-    colorkill_recurse(x, y + 1, g, c);
-}
+    Grid retval;
 
-/***************************************************************************
- *      repaint_fun()
- * Function for the repainting special piece.
- ***************************************************************************/
-static void
-repaint_fun(int x, int y, Grid *g) 
-{
-    int c;
-    if ((x<0 || y<0 || x>=g->w || y>=g->h)) 
-	return;
-    GRID_CHANGED(*g,x,y) = 1;
-    c = GRID_CONTENT(*g,x,y);
-    if (c <= 1 || c == most_common) return;
-    GRID_SET(*g,x,y,most_common);
-    repaint_fun(x - 1, y, g);
-    repaint_fun(x + 1, y, g);
-    repaint_fun(x, y - 1, g);
-    repaint_fun(x, y + 1, g);
-}
+    retval.w = w;
+    retval.h = h;
 
-/***************************************************************************
- * 	push_down()
- * Teleport all of the pieces just below this special piece as far down as
- * they can go in their column. 
- ***************************************************************************/
-static void
-push_down(play_piece *pp, int col, int row, int rot, Grid *g,
-	void (*fun)(int, int, Grid *))
-{
-    int i,j,c;
-    int place_y, look_y;
+    Calloc(retval.contents,unsigned char *,(w*h*sizeof(*retval.contents)));
+    Calloc(retval.fall,unsigned char *,(w*h*sizeof(*retval.fall)));
+    Calloc(retval.changed,unsigned char *,(w*h*sizeof(*retval.changed)));
+    Calloc(retval.temp,unsigned char *,(w*h*sizeof(*retval.temp)));
 
-    for (j=0;j<pp->base->dim;j++)
-	for (i=0;i<pp->base->dim;i++) 
-	    if ((c=BITMAP(*pp->base,rot,i,j))) {
-		int t_x = i + col;
-		int t_y = j + row;
-		if ((t_x<0 || t_y<0 || t_x>=g->w || t_y>=g->h)) {
-		    continue;
-		}
-		GRID_SET(*g,t_x,t_y,REMOVE_ME);
-		look_y = t_y + 1;
-		if (look_y >= g->h) continue;
-		if (!GRID_CONTENT(*g,t_x,look_y)) continue;
-		/* OK, try to move look_y down as far as possible */
-		for (place_y = g->h-1; 
-			place_y > look_y &&
-			GRID_CONTENT(*g,t_x,place_y) != 0;
-			place_y --)
-		    ;
-		if (place_y == look_y) continue;
-		/* otherwise, valid swap! */
-		if (place_y < 0 || place_y >= g->h) 
-		    continue;
-		if (look_y < 0 || look_y >= g->h) 
-		    continue;
-		GRID_SET(*g,t_x,place_y, GRID_CONTENT(*g,t_x,look_y));
-		GRID_SET(*g,t_x,look_y, REMOVE_ME);
+    if (level) {
+	int start_garbage;
+	level = GARBAGE_LEVEL(level);
+	start_garbage = (h-level) - 2;
+
+	if (start_garbage < 2) start_garbage = 2;
+	else if (start_garbage >= h) start_garbage = h - 1;
+
+	for (j=start_garbage;j<h;j++)
+	    for (r=0;r<w/2;r++) {
+		do {
+		    i = FastRandom_r(seed, w);
+		} while (GRID_CONTENT(retval,i,j) == 1);
+		GRID_SET(retval,i,j,1);
 	    }
+    }
+    return retval;
 }
 
 /***************************************************************************
- *      find_on_board()
- * Finds where on the board a piece would go: used by special piece
- * handling routines. 
- ***************************************************************************/
-static void
-find_on_board(play_piece *pp, int col, int row, int rot, Grid *g,
-	void (*fun)(int, int, Grid *))
+ *      generate_board()
+ * Creates a new board at the given level.
+ *********************************************************************PROTO*/
+Grid
+generate_board(int w, int h, int level)
 {
-    int i,j,c;
-
-    for (j=0;j<pp->base->dim;j++)
-	for (i=0;i<pp->base->dim;i++) 
-	    if ((c=BITMAP(*pp->base,rot,i,j))) {
-		int t_x = i + col;
-		int t_y = j + row; 
-		if ((t_x<0 || t_y<0 || t_x>=g->w || t_y>=g->h)) {
-		    continue;
-		}
-		GRID_SET(*g,t_x,t_y,REMOVE_ME);
-	    }
+    Grid retval;
+    Uint32 seed = GetRandSeed();
 
-    for (j=0;j<pp->base->dim;j++)
-	for (i=0;i<pp->base->dim;i++) 
-	    if ((c=BITMAP(*pp->base,rot,i,j))) {
-		int t_x = i + col; 
-		int t_y = j + row;
-		if ((t_x<0 || t_y<0 || t_x>=g->w || t_y>=g->h)) {
-		    continue;
-		}
-		fun(t_x - 1, t_y, g);
-		fun(t_x + 1, t_y, g);
-		fun(t_x, t_y - 1, g);
-		fun(t_x, t_y + 1, g);
-	}
-    return;
+    retval = generate_board_r(w, h, level, &seed);
+    SeedRandom(seed);
+    return retval;
 }
 
 /***************************************************************************
- *      most_common_color()
- * Finds the most common (non-zero, non-garbage) color on the board. If
- * none, returns the garbage color. 
- ***************************************************************************/
-static void
-most_common_color(Grid *g)
+ *      free_board()
+ * Gives back what generate_board() took.
+ *********************************************************************PROTO*/
+void
+free_board(Grid *g)
 {
-    int count[256];
-    int x,y,c;
-    int max, max_count;
+    Free(g->contents);
+    Free(g->fall);
+    Free(g->changed);
+    Free(g->temp);
+}
 
-    memset(count,0, sizeof(count));
-    for (x=0;x<g->w;x++)
-	for (y=0;y<g->h;y++) {
-	    c = GRID_CONTENT(*g,x,y);
-	    if (c > 1) 
-		count[c]++;
+/***************************************************************************
+ *      add_garbage_r()
+ * Adds garbage to the given board, drawing it from *seed. Pushes all of
+ * the lines up, adds the garbage to the bottom.
+ *********************************************************************PROTO*/
+void
+add_garbage_r(Grid *g, Uint32 *seed)
+{
+    int i,j;
+    for (j=0;j<g->h-1;j++)
+	for (i=0;i<g->w;i++) {
+	    GRID_SET(*g,i,j, GRID_CONTENT(*g,i,j+1));
+	    FALL_SET(*g,i,j, NOT_FALLING);
+	    if (GRID_CONTENT(*g,i,j) == 0)
+		GRID_SET(*g,i,j,REMOVE_ME);
+	    GRID_CHANGED(*g,i,j) = 1;
 	}
-    max = 1;
-    max_count = 0;
-    for (x=2;x<256;x++) 
-	if (count[x] > max_count) {
-	    max = x;
-	    max_count = count[x];
+
+    j = g->h - 1;
+    for (i=0; i<g->w; i++) {
+	    if (FastRandom_r(seed, 100) < 50) {
+		GRID_SET(*g,i,j,1);
+		if (GRID_CONTENT(*g,i,j-1) &&
+			GRID_CONTENT(*g,i,j-1) != REMOVE_ME)
+		    GRID_SET(*g,i,j-1,1);
+	    } else {
+		GRID_SET(*g,i,j,REMOVE_ME);
+	    }
+	    FALL_SET(*g,i,j, NOT_FALLING);
+	    GRID_CHANGED(*g,i,j) = 1;
+    }
+
+    for (j=0;j<g->h;j++)
+	for (i=0;i<g->w;i++) {
+	    Assert(GRID_CHANGED(*g,i,j));
+	    Assert(FALL_CONTENT(*g,i,j) == NOT_FALLING);
 	}
-    most_common = max;
+
     return;
 }
 
 /***************************************************************************
- *      handle_special()
- * Change the state of the grid based on the magical special piece ...
- * Look in pos[P] for the current position.
+ *      add_garbage()
+ * Adds garbage to the given board. Pushes all of the lines up, adds the
+ * garbage to the bottom.
  *********************************************************************PROTO*/
 void
-handle_special(play_piece *pp, int row, int col, int rot, Grid *g,
-	sound_style *ss)
+add_garbage(Grid *g)
 {
-    switch (pp->special) {
-	case No_Special: break;
-	case Special_Bomb: 
-			 find_on_board(pp, col, row, rot, g, bomb_fun);
-			 if (ss) 
-			     play_sound(ss,SOUND_CLEAR1,256);
-			 break;
-	case Special_Repaint: 
-			 most_common_color(g);
-			 find_on_board(pp, col, row, rot, g, repaint_fun);
-			 if (ss) 
-			     play_sound(ss,SOUND_GARBAGE1,256);
-			 break;
-	case Special_Pushdown: 
-			 push_down(pp, col, row, rot, g, repaint_fun);
-			 if (ss) 
-			     play_sound(ss,SOUND_THUD,256*2);
-			 break;
-	case Special_Colorkill: 
-			 find_on_board(pp, col, row, rot, g, colorkill_fun);
-			 if (ss) 
-			     play_sound(ss,SOUND_CLEAR1,256);
-			 break;
+    Uint32 seed = GetRandSeed();
 
-    }
+    add_garbage_r(g, &seed);
+    SeedRandom(seed);
 }
 
 /***************************************************************************
- *      do_pause()
- * Change the pause status of the local player.
- ***************************************************************************/
-static void
-do_pause(int paused, Uint32 tv_now, int *pause_begin_time, int *tv_start)
+ *      draw_grid_block()
+ * Draws the block at (i,j) on the main grid, with its lighting and
+ * shadows, dy pixels below where it belongs.
+ *********************************************************************PROTO*/
+void
+draw_grid_block(SDL_Surface *screen, color_style *cs, Grid *g, int i, int j,
+	int dy)
 {
-    int i;
-    draw_pause(paused);
-    if (!paused) {
-	/* fixup times */
-	*tv_start += (tv_now - *pause_begin_time);
-	for (i=0; i<2; i++) {
-	    State[i].collide_time += (tv_now - *pause_begin_time);
-	    State[i].next_draw += (tv_now - *pause_begin_time);
-	    State[i].tv_next_fall += (tv_now - *pause_begin_time);
-	    State[i].tv_next_tetris += (tv_now - *pause_begin_time);
-	    State[i].tv_next_ai_think += (tv_now - *pause_begin_time);
-	    State[i].tv_next_ai_move += (tv_now - *pause_begin_time);
-	}
-    } else {
-	*pause_begin_time = tv_now;
+    SDL_Rect r,s;
+    int c = GRID_CONTENT(*g,i,j);
+    int fall = FALL_CONTENT(*g,i,j);
+    int that_precolor, that_fall;
+
+    s.x = g->board.x + (i * cs->w);
+    s.y = g->board.y + (j * cs->h) + dy;
+    s.w = cs->w;
+    s.h = cs->h;
+
+    SDL_BlitSafe(cs->color[c], NULL, screen, &s);
+
+    /* light up */
+    that_precolor = (j == 0) ? 0 : GRID_CONTENT(*g,i,j-1);
+    that_fall = (j == 0) ? -1 : FALL_CONTENT(*g,i,j-1);
+    if (that_precolor != c || that_fall != fall) {
+	r.x = s.x;
+	r.y = s.y;
+	r.h = edge[HORIZ_LIGHT]->h;
+	r.w = edge[HORIZ_LIGHT]->w;
+	SDL_BlitSafe(edge[HORIZ_LIGHT],NULL, screen, &r);
+    }
+
+    /* light left */
+    that_precolor = (i == 0) ? 0 : GRID_CONTENT(*g,i-1,j);
+    that_fall = (i == 0) ? -1 : FALL_CONTENT(*g,i-1,j);
+    if (that_precolor != c || that_fall != fall) {
+	r.x = s.x;
+	r.y = s.y;
+	r.h = edge[VERT_LIGHT]->h;
+	r.w = edge[VERT_LIGHT]->w;
+	SDL_BlitSafe(edge[VERT_LIGHT],NULL, screen,&r);
+    }
+
+    /* shadow down */
+    that_precolor = (j == g->h-1) ? 0 : GRID_CONTENT(*g,i,j+1);
+    that_fall = (j == g->h-1) ? -1 : FALL_CONTENT(*g,i,j+1);
+    if (that_precolor != c || that_fall != fall) {
+	r.x = s.x;
+	r.y = s.y + cs->h - edge[HORIZ_DARK]->h;
+	r.h = edge[HORIZ_DARK]->h;
+	r.w = edge[HORIZ_DARK]->w;
+	SDL_BlitSafe(edge[HORIZ_DARK],NULL, screen,&r);
+    }
+
+    /* shadow right */
+    that_precolor = (i == g->w-1) ? 0 : GRID_CONTENT(*g,i+1,j);
+    that_fall = (i == g->w-1) ? -1 : FALL_CONTENT(*g,i+1,j);
+    if (that_precolor != c || that_fall != fall) {
+	r.x = s.x + cs->w - edge[VERT_DARK]->w;
+	r.y = s.y;
+	r.h = edge[VERT_DARK]->h;
+	r.w = edge[VERT_DARK]->w;
+	SDL_BlitSafe(edge[VERT_DARK],NULL, screen,&r);
     }
 }
 
 /***************************************************************************
- *      place_this_piece()
- * Given that the player's current piece structure is already chosen, try
- * to place it near the top of the board. this may involve shifting it up 
- * a bit or rotating it or something. 
+ *      draw_grid()
+ * Draws the main grid board. This involves drawing all of the pieces (and
+ * garbage) currently pasted on to it. This is the function that actually
+ * clears out grid pieces marked with "REMOVE_ME". The main bit of work
+ * here is calculating the shadows (see draw_grid_block()). 
  *
- * Returns 0 on success. 
- ***************************************************************************/
-static int
-place_this_piece(int P, int blockWidth, Grid g[])
+ * Uses the color style to actually draw the right picture on the screen.
+ *********************************************************************PROTO*/
+void
+draw_grid(SDL_Surface *screen, color_style *cs, Grid *g, int draw)
 {
-    int Y, R;
-    /* we'll try Y adjustments from -2 to 0 and rotations from 0 to 3 */
+    SDL_Rect s;
+    int i,j;
+    int mini=20, minj=20, maxi=-1, maxj=-1;
+    for (j=g->h-1;j>=0;j--) {
+	for (i=g->w-1;i>=0;i--) {
+	    int c = GRID_CONTENT(*g,i,j);
+	    if (draw && c && c != REMOVE_ME && GRID_CHANGED(*g,i,j)) {
+		if (i < mini) mini = i; if (j < minj) minj = j;
+		if (i > maxi) maxi = i; if (j > maxj) maxj = j;
+		
 
-    pos[P].x = pos[P].old_x = g[P].board.x + g[P].board.w / 2;
-    for (Y = 0; Y >= -2 ; Y --) {
-	for (R = 0; R <= 3; R++) {
-	    pos[P].y = pos[P].old_y = g[P].board.y + (blockWidth * Y);
-	    pos[P].old_rot = pos[P].rot = R;
-	    if (valid_screen_position(&State[P].cp, blockWidth,
-			&g[P], pos[P].rot, pos[P].x, pos[P].y)) {
-		return 0;
+		draw_grid_block(screen, cs, g, i, j, 0);
+		/* SDL_UpdateSafe(screen, 1, &s); */
+		GRID_CHANGED(*g,i,j) = 0;
+	    } else if (c == REMOVE_ME) {
+		if (i < mini) mini = i; if (j < minj) minj = j;
+		if (i > maxi) maxi = i; if (j > maxj) maxj = j;
+		if (draw) { 
+		    s.x = g->board.x + (i * cs->w);
+		    s.y = g->board.y + (j * cs->h);
+		    s.w = cs->w;
+		    s.h = cs->h;
+		    SDL_FillRect(screen, &s, int_solid_black);
+		    GRID_SET(*g,i,j,0);
+		    GRID_CHANGED(*g,i,j) = 0;
+		} else {
+		    GRID_SET(*g,i,j,0);
+		}
 	    }
 	}
     }
-    return 1;	/* no valid position! */
+    s.x = g->board.x + mini * cs->w;
+    s.y = g->board.y + minj * cs->h;
+    s.w = (maxi - mini + 1) * cs->w;
+    s.h = (maxj - minj + 1) * cs->h;
+    if (draw && maxi >  -1) SDL_UpdateSafe(screen,1,&s);
+    return;
 }
 
 /***************************************************************************
- *      event_loop()
- * The main event-processing dispatch loop. 
- *
- * Returns 0 on a successful game completion, -1 on a [single-user] quit.
+ *      draw_falling()
+ * Draws the falling pieces on the main grid. Offset should range from 1 to
+ * the size of the color tiles -- the falling pieces are drawn that far
+ * down out of their "real" places. This gives a smooth animation effect.
  *********************************************************************PROTO*/
-#define		NO_PLAYER	0
-#define		HUMAN_PLAYER	1
-#define		AI_PLAYER	2
-#define		NETWORK_PLAYER	3
-int
-event_loop(SDL_Surface *screen, piece_style *ps, color_style *cs[2], 
-	sound_style *ss[2], Grid g[], int level[2], int sock,
-	int *seconds_remaining, int time_is_hard_limit,
-	int adjust[], int (*handle)(const SDL_Event *), 
-	int seed, int p1, int p2, AI_Player *AI[2])
+void
+draw_falling(SDL_Surface *screen, int blockWidth, Grid *g, int offset)
 {
-    SDL_Event event;
-    Uint32 tv_now, tv_start; 
-    int NUM_PLAYER = 0;
-    int NUM_KEYBOARD = 0;
-    int last_seconds = -1;
-    int minimum_fall_event_interval = 100;
-    int paused = 0;
-    Uint32 pause_begin_time = 0;
-
-    /* measured in milliseconds, 25 frames per second:
-     * 1 frame = 40 milliseconds
-     */
-    int blockWidth = cs[0]->w;
-    int i,j,P, Q;
-
-    SDL_EnableKeyRepeat(SDL_DEFAULT_REPEAT_DELAY/Options.key_repeat_delay,
-	    SDL_DEFAULT_REPEAT_INTERVAL/2);
-
-    if (gametype != DEMO)
-	stop_all_playing(); 
-
-    memset(pos, 0, sizeof(pos[0]) * 2);
-    memset(State, 0, sizeof(State[0]) * 2);
+    SDL_Rect s;
+    SDL_Rect r;  
+    int i,j;
+    int mini=100000, minj=100000, maxi=-1, maxj=-1;
 
-    switch (p1) {
-	case NO_PLAYER: Assert(!handle); break;
-	case HUMAN_PLAYER: Assert(!handle); NUM_PLAYER++; NUM_KEYBOARD++; break;
-	case AI_PLAYER: State[0].ai = 1; NUM_PLAYER++; break;
-	case NETWORK_PLAYER: PANIC("Cannot have player 1 over the network!");
-    }
-    switch (p2) {
-	case NO_PLAYER: break;
-	case HUMAN_PLAYER: Assert(!handle); NUM_PLAYER++; NUM_KEYBOARD++; break;
-	case AI_PLAYER: State[1].ai = 1; NUM_PLAYER++; break;
-	case NETWORK_PLAYER: Assert(sock); break;
-    }
-    Assert(NUM_PLAYER >= 1 && NUM_PLAYER <= 2);
+    int cj;	/* cluster right, cluster bottom */
 
-    tv_start = tv_now = SDL_GetTicks();
-    tv_start += *seconds_remaining * 1000; 
+    memset(g->temp, 0, sizeof(*g->temp)*g->w*g->h);
 
-    for (P=0; P<NUM_PLAYER; P++) {
-	State[P].falling = 1;
-	State[P].fall_speed = 1;
-	State[P].tetris_handling = 0;
-	State[P].accept_input = 1;
-	State[P].limbo = 0;
-	State[P].draw = 1;
-	State[P].other_in_limbo = 0;
-	State[P].next_draw = 0;
-	State[P].limbo_sent = 0;
-	State[P].cp = generate_piece(ps, cs[P], seed);
-	State[P].np = generate_piece(ps, cs[P], seed+1);
-	State[P].seed = seed+2;
-	State[P].ready_for_fast = 1;
-	State[P].ready_for_rotate = 1;
-
-	draw_next_piece(screen, ps, cs[P], &State[P].cp, &State[P].np, P);
+    for (j=0;j<g->h;j++) {
+	for (i=0;i<g->w;i++) {
+	    int c = GRID_CONTENT(*g,i,j);
+	    if (c && FALL_CONTENT(*g,i,j) == FALLING &&
+		    TEMP_CONTENT(*g,i,j) == 0) {
 
-	adjust[P] = -1;
+		for (cj = j; GRID_CONTENT(*g,i,cj) &&
+			FALL_CONTENT(*g,i,cj) &&
+			TEMP_CONTENT(*g,i,cj) == 0 &&
+			cj < g->h; cj++)
+		    TEMP_CONTENT(*g,i,cj) = 1;
 
-	if (SPEED_LEVEL(level[P]) <= 7)
-	    State[P].fall_event_interval = 45 - SPEED_LEVEL(level[P]) * 5;
-	else 
-	    State[P].fall_event_interval = 16 - SPEED_LEVEL(level[P]);
-	if (State[P].fall_event_interval < 1)
-	    State[P].fall_event_interval = 1;
+		/* source == up */
+		s.x = g->board.x + (i * blockWidth);
+		s.y = g->board.y + (j * blockWidth) + offset - 1;
+		s.w = blockWidth;
+		s.h = blockWidth * (cj - j + 1); 
 
-	if (State[P].fall_event_interval < minimum_fall_event_interval)
-	    minimum_fall_event_interval = State[P].fall_event_interval;
+		/* dest == down */
+		r.x = g->board.x + (i * blockWidth);
+		r.y = g->board.y + (j * blockWidth) + offset;
+		r.w = blockWidth;
+		r.h = blockWidth * (cj - j + 1); 
 
-	State[P].tv_next_fall = tv_now + State[P].fall_event_interval;
+		/* just blit the screen down a notch */
+		SDL_BlitSafe(screen, &s, screen, &r);
 
-	if (place_this_piece(P, blockWidth, g)) {
-	    /* failed to place piece initially ... */
-	    pos[P].x = pos[P].old_x = g[P].board.x + g[P].board.w / 2;
-	    pos[P].y = pos[P].old_y = g[P].board.y ;
-	    pos[P].rot = pos[P].old_rot = 0;
-	}
+		if (s.x < mini) mini = s.x; 
+		if (s.y < minj) minj = s.y;
+		if (s.x+s.w > maxi) maxi = s.x+s.w; 
+		if (s.y+s.h > maxj) maxj = s.y+s.h;
 
-	if (State[P].ai) {
-	    State[P].tv_next_ai_think = tv_now;
-	    State[P].tv_next_ai_move = tv_now;
-	    if (gametype == DEMO || gametype == AI_VS_AI ||
-		    AI[P]->delay_factor == 0) {
-		State[P].ai_interval = State[P].fall_event_interval;
-		if (State[P].ai_interval > 15)
-		    State[P].ai_interval = 15;
-	    } else {
-		if (AI[P]->delay_factor < 1)
-		    AI[P]->delay_factor = 1;
-		if (AI[P]->delay_factor > 100)
-		    AI[P]->delay_factor = 100;
-		State[P].ai_interval = AI[P]->delay_factor;
+		/* clear! */
+		if (j == 0 || FALL_CONTENT(*g,i,j-1) == NOT_FALLING ||
+			GRID_CONTENT(*g,i,j-1) == 0) {
+		    s.h = 1;
+		    SDL_BlitSafe(widget_layer, &s, screen, &s);
+		    /*  SDL_UpdateSafe(screen, 1, &s); */
+		}
 	    }
-	    State[P].ai_state = AI[P]->reset(State[P].ai_state, &g[P]);
 	}
     }
 
+    s.x = mini;
+    s.y = minj;
+    s.w = maxi - mini + 1;
+    s.h = maxj - minj + 1;
+    if (maxi >  -1) SDL_UpdateSafe(screen,1,&s);
+    return;
+}
 
-    /* generate the fake-out grid: shown when the opponent does something
-     * good! */
-    distract_grid[0] = generate_board(g[0].w,g[0].h,g[0].h-2);
-    distract_grid[0].board = g[0].board;
-
-    SeedRandom(seed);
-    for (i=0;i<g[0].w;i++)
-	for (j=0;j<g[0].h;j++) {
-	    GRID_SET(distract_grid[0],i,j,ZEROTO(cs[0]->num_color));
-	}
-    if (NUM_PLAYER == 2) {
-	distract_grid[1] = generate_board(g[1].w,g[1].h,g[1].h-2);
-	distract_grid[1].board = g[1].board;
-	for (i=0;i<g[1].w;i++)
-	    for (j=0;j<g[1].h;j++) {
-		GRID_SET(distract_grid[1],i,j,ZEROTO(cs[1]->num_color));
+/***************************************************************************
+ *      fall_down()
+ * Move all of the fallen pieces down a notch.
+ *********************************************************************PROTO*/
+void
+fall_down(Grid *g)
+{
+    int x,y;
+    for (y=g->h-1;y>=1;y--) {
+	for (x=0;x<g->w;x++) {
+	    if (FALL_CONTENT(*g,x,y-1) == FALLING &&
+		     GRID_CONTENT(*g,x,y-1)) {
+		Assert(GRID_CONTENT(*g,x,y) == 0 || 
+		       GRID_CONTENT(*g,x,y) == REMOVE_ME);
+		GRID_SET(*g,x,y, GRID_CONTENT(*g,x,y-1));
+		GRID_SET(*g,x,y-1,REMOVE_ME);
+		FALL_SET(*g,x,y, FALLING);
+		/* FALL_SET(*g,x,y-1,UNKNOWN); */
 	    }
+	}
     }
+    return;
+}
 
-    if (sock) { 
-	char msg = 'c'; /* WRW: send update */
-	send(sock,&msg,1,0);
-	send(sock,g[0].contents,sizeof(*g[0].contents)
-		* g[0].h * g[0].w,0); 
-		
+/***************************************************************************
+ *      determine_falling()
+ * Determines if anything can fall.
+ *********************************************************************PROTO*/
+int
+determine_falling(Grid *g)
+{
+    int x,y;
+#ifdef DEBUG
+    {
+	int retval=0;
+    for (y=0;y<g->h;y++) {
+	for (x=0;x<g->w;x++) {
+	    if (GRID_CONTENT(*g,x,y) && FALL_CONTENT(*g,x,y) == FALLING) {
+		printf("X");
+		retval= 1;
+	    } else printf(".");
+	}
+	printf("\n");
     }
-
-    draw_clock(0);
-
-    draw_grid(screen,cs[0],&g[0],1);
-    draw_score(screen, 0);
-    if (NUM_PLAYER == 2) {
-	draw_grid(screen,cs[1],&g[1],1);
-	draw_score(screen,1);
+    printf("--\n");
+    return retval;
     }
-    if (sock)
-	draw_score(screen, 1);
-
-    /* 
-     * Major State-Machine Event Loop
-     */
-
-    P = 0;
-
-    while (1) { 
+#else
+    for (y=0;y<g->h;y++) 
+	for (x=0;x<g->w;x++) 
+	    if (GRID_CONTENT(*g,x,y) && FALL_CONTENT(*g,x,y) == FALLING) 
+		return 1;
+    return 0;
+#endif
+}
 
-	if (NUM_PLAYER == 2)
-	    P = !P;
+/***************************************************************************
+ *      run_gravity()
+ * Applies gravity: pieces with no support change to "FALLING". After this,
+ * "determine_falling" can be used to determine if anything should be
+ * falling.
+ *
+ * Returns 1 if any pieces that were FALLING settled down.
+ *
+ * This is the Mark II iterative version. Heavy-sigh!
+ *********************************************************************PROTO*/
+int
+run_gravity(Grid *g)
+{
+    int falling_pieces_settled;
+    int x,y,c,f, X,Y, YY;
+    int S; 
+    int lowest_y = 0;
+    int garbage_on_row[21] ;	/* FIXME! */
+    /*   6.68      5.20     0.38    16769     0.02     0.02  run_gravity */
 
-	tv_now = SDL_GetTicks();
+    char UP_QUEUE[2000], UP_POS=0;
 
-	/* update the on-screen clock */
-	if (tv_start >= tv_now)
-	    * seconds_remaining = (tv_start - tv_now) / 1000;
-	else
-	    * seconds_remaining = - ((tv_now - tv_start) / 1000);
+#define UP_X(P) UP_QUEUE[(P)*3]
+#define UP_Y(P) UP_QUEUE[(P)*3 + 1]
+#define UP_S(P) UP_QUEUE[(P)*3 + 2]
 
-	if (*seconds_remaining != last_seconds && !paused) {
-	    last_seconds = *seconds_remaining;
-	    draw_clock(*seconds_remaining);
-	    if (last_seconds <= 30 && last_seconds >= 0) {
-		play_sound_unless_already_playing(ss[0],SOUND_CLOCK,0);
-		if (NUM_PLAYER == 2) 
-		    play_sound_unless_already_playing(ss[1],SOUND_CLOCK,0);
-	    }
+    falling_pieces_settled = 0;
+    for (y=0; y<g->h; y++) {
+	garbage_on_row[y] = 0;
+	for (x=0;x<g->w;x++) {
+	    int c = GRID_CONTENT(*g,x,y);
+	    if (!lowest_y && c)
+		lowest_y = y;
+	    if (c == 1)
+		garbage_on_row[y] = 1;
+	    if (FALL_CONTENT(*g,x,y) == NOT_FALLING)
+		FALL_SET(*g,x,y,UNKNOWN);
 	}
+    }
+    garbage_on_row[20] = 1;
 
-	/* check for time-out */
-	if (*seconds_remaining < 0 && time_is_hard_limit && !paused) { 
-	    play_sound(ss[0],SOUND_LEVELDOWN,0);
-	    adjust[0] = ADJUST_DOWN;
-	    if (NUM_PLAYER == 2) {
-		play_sound(ss[1],SOUND_LEVELDOWN,0);
-		adjust[1] = ADJUST_DOWN;
+    for (y=g->h-1;y>=lowest_y;y--)
+	for (x=0;x<g->w;x++) {
+	    c = GRID_CONTENT(*g,x,y);
+	    if (!c) continue;
+	    else if (c != 1 && y < g->h-1) continue;
+	    else if (c == 1 && !garbage_on_row[y+1]) {
+		/* if we do not set this, garbage from above us will appear
+		 * to be supported and it will reach down and support us!
+		 * scary! */
+		garbage_on_row[y] = 0;
+		continue;
+	    }
+	    f = FALL_CONTENT(*g,x,y);
+	    if (f == NOT_FALLING) continue;
+	    else if (f == FALLING) {
+		falling_pieces_settled = 1;
 	    }
-	    stop_playing_sound(ss[0],SOUND_CLOCK);
-	    if (NUM_PLAYER == 2) stop_playing_sound(ss[1],SOUND_CLOCK);
-	    return 0;
-	} 
 
-	/*
-	 * 	Visual Events
-	 */
-	if (!State[P].draw && tv_now > State[P].next_draw && !paused) {
-	    int i,j;
-	    State[P].draw = 1;
-	    for (i=0;i<g[P].w;i++)
-		for (j=0;j<g[P].h;j++) {
-		    GRID_CHANGED(g[P],i,j) = 1;
-		    if (GRID_CONTENT(g[P],i,j) == 0)
-			GRID_SET(g[P],i,j,REMOVE_ME);
+	    /* now, run up as far as we can ... */
+	    if (y >= 1) {
+		Y = y;
+		while (Y >= 0 && (c = GRID_CONTENT(*g,x,Y)) && 
+			FALL_CONTENT(*g,x,Y) != NOT_FALLING) {
+		    /* mark stable */
+		    f = FALL_CONTENT(*g,x,Y);
+		    if (f == FALLING) {
+			falling_pieces_settled = 1;
+		    }
+		    FALL_SET(*g,x,Y,NOT_FALLING);
+		    /* promise to get to our same-color buddies later */
+		    if (x >= 1 && GRID_CONTENT(*g,x-1,Y) == c &&
+			    FALL_CONTENT(*g,x-1,Y) != NOT_FALLING) {
+			UP_X(UP_POS) = x-1 ; UP_Y(UP_POS) = Y; 
+			UP_S(UP_POS) = (f == FALLING || c == 1); UP_POS++;
+		    }
+		    if (x < g->w-1 && GRID_CONTENT(*g,x+1,Y) == c &&
+			    FALL_CONTENT(*g,x+1,Y) != NOT_FALLING) {
+			UP_X(UP_POS) = x+1 ; UP_Y(UP_POS) = Y; 
+			UP_S(UP_POS) = (f == FALLING || c == 1); UP_POS++;
+		    }
+		    if (Y < g->h-1 && GRID_CONTENT(*g,x,Y+1) == c &&
+			    FALL_CONTENT(*g,x,Y+1) != NOT_FALLING) {
+			UP_X(UP_POS) = x ; UP_Y(UP_POS) = Y+1; 
+			UP_S(UP_POS) = (f == FALLING || c == 1); UP_POS++;
+		    }
+		    Y--;
 		}
-	    draw_grid(screen,cs[P],&g[P],1);
-	} else if (!State[P].draw) {
-	    int delta = State[P].next_draw - tv_now;
-	    int amt = g[P].h - ((g[P].h * delta) / State[P].draw_timeout);
-	    int i,j;
-	    j = amt - 1;
-	    if (j < 0) j = 0;
-	    for (i=0;i<g[P].w;i++)
-		GRID_CHANGED(distract_grid[P],i,j) = 1;
-	    draw_grid(screen,cs[P],&distract_grid[P],1);
-	}
-
-	/* 
-	 *	Falling Events
-	 */
-
-	if (State[P].falling && tv_now >= State[P].tv_next_fall && !paused) {
-	    int try;
-	    int we_fell = 0;
-
-#if DEBUG
-	    if (tv_now > State[P].tv_next_fall) 
-		Debug("Fall: %d %d\n", tv_now, tv_now - State[P].tv_next_fall);
-#endif
+	    } else {
+		/* Debug("2 (%2d,%2d)\n",x,y); */
+		FALL_SET(*g,x,y,NOT_FALLING);
+	    }
+	    
+	    /* now burn down the queue */
+	    while (UP_POS > 0) {
+		UP_POS--;
+		X = UP_X(UP_POS);
+		Y = UP_Y(UP_POS);
+		S = UP_S(UP_POS);
+		c = GRID_CONTENT(*g,X,Y);
+		Assert(c);
+		f = FALL_CONTENT(*g,X,Y);
+		if (f == NOT_FALLING) continue;
+		else if (f == FALLING && !S) continue;
 
-	    /* ok, we had a falling event */
-	    do {
-		State[P].tv_next_fall += State[P].fall_event_interval;
-	    } while (State[P].tv_next_fall <= tv_now); 
-
-	    for (try = State[P].fall_speed; try > 0; try--)
-		if (valid_screen_position(&State[P].cp,blockWidth,&g[P],pos[P].rot,pos[P].x,pos[P].y+try)) {
-		    pos[P].y += try;
-		    State[P].fall_speed = try;
-		    try = 0;
-		    we_fell = 1;
-		}
-	    if (!we_fell) {
-		if (!State[P].collide_time) {
-		    State[P].collide_time = tv_now + 
-			(Options.long_settle_delay ? 400 : 200);
-		    continue; /* don't fall */
+		if (Y >= 1) {
+		    YY = Y;
+		    while (YY >= 0 && (c = GRID_CONTENT(*g,X,YY)) && 
+			    FALL_CONTENT(*g,X,YY) != NOT_FALLING) {
+			/* mark stable */
+			f = FALL_CONTENT(*g,X,YY);
+			if (f == FALLING) falling_pieces_settled = 1;
+			FALL_SET(*g,X,YY,NOT_FALLING);
+			/* promise to get to our same-color buddies later */
+			if (X >= 1 && GRID_CONTENT(*g,X-1,YY) == c &&
+				FALL_CONTENT(*g,X-1,YY) != NOT_FALLING) {
+			    UP_X(UP_POS) = X-1 ; UP_Y(UP_POS) = YY; 
+			    UP_S(UP_POS) = (f == FALLING || c == 1); UP_POS++;
+			}
+			if (X < g->w-1 && GRID_CONTENT(*g,X+1,YY) == c &&
+				FALL_CONTENT(*g,X+1,YY) != NOT_FALLING) {
+			    UP_X(UP_POS) = X+1 ; UP_Y(UP_POS) = YY; 
+			    UP_S(UP_POS) = (f == FALLING || c == 1); UP_POS++;
+			}
+			if (YY < g->h-1 && GRID_CONTENT(*g,X,YY+1) == c &&
+				FALL_CONTENT(*g,X,YY+1) != NOT_FALLING) {
+			    UP_X(UP_POS) = X ; UP_Y(UP_POS) = YY+1; 
+			    UP_S(UP_POS) = (f == FALLING || c == 1); UP_POS++;
+			}
+			YY--;
+		    }
+		} else {
+		    FALL_SET(*g,X,Y,NOT_FALLING);
 		}
-		if (tv_now < State[P].collide_time)
-		    continue; /* don't fall */
-		/* do fall! */
-	    } else continue;
-	    /* collided! */
+	    }
+	}
+	    
+    for (y=g->h-1;y>=0;y--) 
+	for (x=0;x<g->w;x++) 
+	    if (FALL_CONTENT(*g,x,y) == UNKNOWN)
+		FALL_CONTENT(*g,x,y) = FALLING;
 
-	    State[P].collide_time = 0;
+    return falling_pieces_settled;
+}
 
-	    play_sound(ss[P],SOUND_THUD,0);
 
-	    /* this would only come into play if you were halfway
-	     * between levels and suddenly someone added garbage */
-	    while (!valid_screen_position(&State[P].cp,blockWidth,&g[P],pos[P].rot,pos[P].x,pos[P].y) && pos[P].y > 0) 
-		pos[P].y--;
+/***************************************************************************
+ *      check_tetris()
+ * Checks to see if any rows have been completely filled. Returns the
+ * number of such rows. Such rows are cleared.
+ *********************************************************************PROTO*/
+int
+check_tetris(Grid *g)
+{
+    int tetris_count = 0;
+    int x,y;
+    for (y=g->h-1;y>=0;y--)  {
+	int c = 0;
+	for (x=0;x<g->w;x++) 
+	    if (GRID_CONTENT(*g,x,y))
+		c++;
+	if (c == g->w) {
+	    tetris_count++;
+	    for (x=0;x<g->w;x++)
+		GRID_SET(*g,x,y,REMOVE_ME);
+	}
+    }
+    return tetris_count;
+}
 
-	    if (State[P].draw) 
-		draw_play_piece(screen, cs[P], &State[P].cp, pos[P].old_x, pos[P].old_y, pos[P].old_rot,
-			&State[P].cp, pos[P].x, pos[P].y, pos[P].rot);
+/*
+ * $Log: grid.c,v $
+ * Revision 1.24  2000/11/10 18:16:48  weimer
+ * changes for Atris 1.0.4 - three new special options
+ *
+ * Revision 1.23  2000/11/06 04:06:44  weimer
+ * option menu
+ *
+ * Revision 1.22  2000/11/03 04:25:58  weimer
+ * add some optimizations to run_gravity to make it just a bit faster (down
+ * to 0.01 ms/call from 0.02), sleep a bit more in event-loop: generally
+ * trying to make us more CPU friendly ...
+ *
+ * Revision 1.21  2000/11/03 03:41:35  weimer
+ * made the light and dark "edges" of pieces global, rather than part of a
+ * specific color style. also fixed a bug where we were updating too much
+ * when drawing falling pieces (bad min() code on my part)
+ *
+ * Revision 1.20  2000/10/29 21:23:28  weimer
+ * One last round of header-file changes to reflect my newest and greatest
+ * knowledge of autoconf/automake. Now if you fail to have some bizarro
+ * function, we try to go on anyway unless it is vastly needed.
+ *
+ * Revision 1.19  2000/10/29 17:23:13  weimer
+ * incorporate "xflame" flaming background for added spiffiness ...
+ *
+ * Revision 1.18  2000/10/26 22:23:07  weimer
+ * double the effective number of levels
+ *
+ * Revision 1.17  2000/10/21 01:14:42  weimer
+ * massic autoconf/automake restructure ...
+ *
+ * Revision 1.16  2000/10/18 23:57:49  weimer
+ * general fixup, color changes, display changes.
+ * Notable: "Safe" Blits and Updates now perform "clipping". No more X errors,
+ * we hope!
+ *
+ * Revision 1.15  2000/10/18 03:29:56  weimer
+ * fixed problem with "machine-gun" sounds caused by "run_gravity()" returning
+ * 1 too often
+ *
+ * Revision 1.14  2000/10/14 02:52:44  weimer
+ * fixed a memory corruption problem in display (a use after a free)
+ *
+ * Revision 1.13  2000/10/14 00:31:53  weimer
+ * non-recursive run-gravity ...
+ *
+ * Revision 1.12  2000/10/13 15:41:53  weimer
+ * revamped AI support, now you can pick your AI and have AI duels (such fun!)
+ * the mighty Aliz AI still crashes a bit, though ... :-)
+ *
+ * Revision 1.11  2000/10/12 22:21:25  weimer
+ * display changes, more multi-local-play threading (e.g., myScore ->
+ * Score[0]), that sort of thing ...
+ *
+ * Revision 1.10  2000/10/12 19:17:08  weimer
+ * Further support for AI players and multiple game types.
+ *
+ * Revision 1.9  2000/10/12 00:49:08  weimer
+ * added "AI" support and walking radio menus for initial game configuration
+ *
+ * Revision 1.8  2000/09/09 17:05:35  wkiri
+ * Hideous log changes (Wes: how dare you include a comment character!)
+ *
+ * Revision 1.7  2000/09/09 16:58:27  weimer
+ * Sweeping Change of Ultimate Mastery. Main loop restructuring to clean up
+ * main(), isolate the behavior of the three game types. Move graphic files
+ * into graphics/-, style files into styles/-, remove some unused files,
+ * add game flow support (breaks between games, remembering your level within
+ * this game), multiplayer support for the event loop, some global variable
+ * cleanup. All that and a bag of chips!
+ *
+ * Revision 1.6  2000/09/05 22:10:46  weimer
+ * fixed initial garbage generation strangeness
+ *
+ * Revision 1.5  2000/09/05 20:22:12  weimer
+ * native video mode selection, timing investigation
+ *
+ * Revision 1.4  2000/09/04 21:02:18  weimer
+ * Added some addition piece layout code, garbage now falls unless the row
+ * below it features some non-falling garbage
+ *
+ * Revision 1.3  2000/09/04 15:20:21  weimer
+ * faster blitting algorithms for drawing the grid and drawing falling pieces
+ * (when you eliminate a line)
+ *
+ * Revision 1.2  2000/09/03 18:26:10  weimer
+ * major header file and automatic prototype generation changes, restructuring
+ *
+ * Revision 1.1  2000/09/03 17:56:36  wkiri
+ * Reorganization of files (display.[ch], event.c are new).
+ *
+ * Revision 1.9  2000/08/26 02:28:55  weimer
+ * now you can see the other player!
+ *
+ * Revision 1.8  2000/08/26 01:36:25  weimer
+ * fixed a long-running update bug: the grid changed field was being reset to
+ * 0 when falling states or content were set to the same thing, even if they
+ * had actually previously changed ...
+ *
+ * Revision 1.7  2000/08/26 01:03:11  weimer
+ * remove keyboard repeat when you enter high scores
+ *
+ * Revision 1.6  2000/08/24 02:32:18  weimer
+ * gameplay changes (key repeats) and speed modifications (falling pieces,
+ * redraws, etc.)
+ *
+ * Revision 1.5  2000/08/22 15:13:53  weimer
+ * added a garbage-generation routine
+ *
+ * Revision 1.4  2000/08/21 00:04:56  weimer
+ * minor text placement changes, falling speed, etc.
+ *
+ * Revision 1.3  2000/08/15 00:59:41  weimer
+ * a few more sound things
+ *
+ * Revision 1.2  2000/08/13 19:27:20  weimer
+ * added file changelogs
+ *
+ */
 
-	    if (State[P].cp.special != No_Special) {
-		/* handle special powers! */
-		int row, col;
-		screen_to_exact_grid_coords(&g[P], blockWidth, 
-			pos[P].x, pos[P].y, &row, &col);
-		handle_special(&State[P].cp, row, col, pos[P].rot, &g[P], ss[P]);
-	    } else { 
-		/* paste the piece on the board */
-		int row, col;
-		screen_to_exact_grid_coords(&g[P], blockWidth, 
-			pos[P].x, pos[P].y, &row, &col);
-		paste_on_board(&State[P].cp, col, row, pos[P].rot, &g[P]);
-	    }
+static char  loaded = FALSE;
+static int   high_scores[NUM_HIGH_SCORES];
+static char* high_names[NUM_HIGH_SCORES];
+static char* high_dates[NUM_HIGH_SCORES];
 
-	    if (sock) { 
-		char msg = 'c'; /* WRW: send update */
-		send(sock,&msg,1,0);
-		send(sock,g[P].contents,sizeof(*g[P].contents)
-			* g[P].h * g[P].w,0); 
-	    }
-	    draw_grid(screen,cs[P],&g[P],State[P].draw);
+static SDL_Rect hs, hs_border;	/* where are the high scores? */
+static int score_height;	/* how high is each score? */
 
-	    /* state change */
-	    State[P].falling = 0;
-	    State[P].fall_speed = 0;
-	    State[P].tetris_handling = 1;
-	    State[P].accept_input = 0;
-	    State[P].tv_next_tetris = tv_now;
-	}
-	/* 
-	 *	Tetris Clear Events
-	 */
-	if (State[P].tetris_handling != 0 && tv_now >= State[P].tv_next_tetris && !paused) {
-	    int blank = 0, garbage = 0;
+#define FIRST_SCORE_Y	(hs.y + 60)
 
-#if DEBUG 
-	    if (tv_now >= State[P].tv_next_tetris) 
-		Debug("Tetr: %d %d (%d)\n", tv_now, tv_now -
-			State[P].tv_next_tetris, State[P].tetris_handling);
-#endif
+/***************************************************************************
+ *      prep_hs_bg()
+ * Prepare the high score background. 
+ ***************************************************************************/
+static void 
+prep_hs_bg()
+{
+    hs.x = screen->w/20; hs.y = screen->h/20;
+    hs.w = 9*screen->w/10; hs.h = 18*screen->h/20;
 
-	    State[P].tetris_handling = tetris_event(
-		    &State[P].tetris_event_interval, 
-		    State[P].tetris_handling, screen, ps, cs[P], ss[P], &g[P], 
-		    level[P], minimum_fall_event_interval, sock, State[P].draw,
-		    &blank, &garbage, P);
-
-	    if (NUM_PLAYER == 2) {
-		if (blank)
-		    do_blank(screen, ss, g, !P);
-		if (garbage) {
-		    add_garbage(&g[!P]);
-		    play_sound(ss[!P],SOUND_GARBAGE1,1);
-		    draw_grid(screen,cs[!P],&g[!P],State[!P].draw);
-		}
-	    }
+    draw_bordered_rect(&hs, &hs_border, 2);
+}
 
-	    tv_now = SDL_GetTicks();
-	    do {  /* just in case we're *way* behind */
-		State[P].tv_next_tetris += State[P].tetris_event_interval;
-	    } while (State[P].tv_next_tetris < tv_now); 
+/***************************************************************************
+ *      save_high_scores()
+ * Save the high scores out to the disk. 
+ ***************************************************************************/
+static void 
+save_high_scores()
+{
+    FILE *fout;
+    int i;
 
-	    if (State[P].tetris_handling == 0) { /* state change */
-		/* Time for your next piece ...
-		 * Yujia points out that we should try a little harder to
-		 * fit your piece on the board. 
-		 */
-		State[P].cp = State[P].np;
-		State[P].np = generate_piece(ps, cs[P], State[P].seed++);
-		draw_next_piece(screen, ps, cs[P], 
-			&State[P].cp, &State[P].np, P);
+    if (!loaded) 
+	return;
 
-		if (place_this_piece(P, blockWidth, g)) {
-		    /* failed to place piece */
-you_lose: 
-		    play_sound(ss[P],SOUND_LEVELDOWN,0);
-		    adjust[P] = ADJUST_DOWN;
-		    if (NUM_PLAYER == 2 && !sock)
-			adjust[!P] = ADJUST_SAME;
-		    if (sock == 0) {
-			stop_playing_sound(ss[0],SOUND_CLOCK);
-			if (NUM_PLAYER == 2) stop_playing_sound(ss[1],SOUND_CLOCK);
-			return 0;
-		    }
-		    /*
-		    Debug("Entering Limbo: adjust down.\n");
-		    */
-		    State[P].falling = 0;
-		    State[P].fall_speed = 0;
-		    State[P].tetris_handling = 0;
-		    State[P].accept_input = 0;
-		    State[P].limbo = 1;
-		} else {
-		    int x,y,count = 0;
-		    if (State[P].ai) 
-			State[P].ai_state =
-			    AI[P]->reset(State[P].ai_state, &g[P]);
-		    for (y=0;y<g->h;y++)
-			for (x=0;x<g->w;x++)
-			    if (GRID_CONTENT(g[P],x,y) == 1)
-				count++;
-		    if (count == 0) {
-you_win: 
-			play_sound(ss[P],SOUND_LEVELUP,256);
-			if (*seconds_remaining <= 0) { 
-			    adjust[P] = ADJUST_SAME;
-			    if (NUM_PLAYER == 2 && !sock)
-				adjust[!P] = ADJUST_DOWN;
-			} else {
-			    adjust[P] = ADJUST_UP;
-			    if (NUM_PLAYER == 2 && !sock)
-				adjust[!P] = ADJUST_SAME;
-			}
-			if (sock == 0) {
-			    stop_playing_sound(ss[0],SOUND_CLOCK);
-			    if (NUM_PLAYER == 2) stop_playing_sound(ss[1],SOUND_CLOCK);
-			    return 0;
-			}
-			/*
-			Debug("Entering Limbo: you win, adjust ?/?.\n");
-			*/
-			State[P].falling = 0;
-			State[P].fall_speed = 0;
-			State[P].tetris_handling = 0;
-			State[P].accept_input = 0;
-			State[P].limbo = 1;
-		    } else {
-			/* keep playing */
-			State[P].falling = 1;
-			State[P].fall_speed = 1;
-			State[P].tetris_handling = 0;
-			State[P].accept_input = 1;
-			State[P].tv_next_fall = SDL_GetTicks() + 
-			    State[P].fall_event_interval;
-		    }
-		}
-	    } 
-	} /* end: handle tetris events */
+    fout = fopen("Atris.Scores","wt");
+    if (!fout) {
+	Debug("Unable to write High Score file [Atris.Scores]: %s\n", strerror(errno));
+	return;
+    }
 
-	/* 
-	 *	AI Events
-	 */
-	if (State[P].ai && tv_now >= State[P].tv_next_ai_think && !paused) {
-	    int row, col;
-#ifdef AI_THINK_TIME
-	    Uint32 tv_before = SDL_GetTicks();
-#endif
+    fprintf(fout,"# Alizarin Tetris High Score File\n");
+    for (i=0; i<NUM_HIGH_SCORES; i++)
+	fprintf(fout,"%04d|%s|%s\n",high_scores[i], high_dates[i], high_names[i]);
+    fclose(fout);
+}
 
-	    screen_to_grid_coords(&g[P], blockWidth, pos[P].x, pos[P].y, &row, &col);
 
-	    /* simulate blanked screens */
-	    if (State[P].draw) 
-		AI[P]->think(State[P].ai_state, &g[P], &State[P].cp, &State[P].np, col, row, pos[P].rot);
+/***************************************************************************
+ *      load_high_scores()
+ * Load the high scores from disk (and allocate space).
+ ***************************************************************************/
+static void 
+load_high_scores()
+{
+    FILE* fin;
+    int i = 0;
+    char buf[2048];
 
-#ifdef AI_THINK_TIME
-	    tv_now = SDL_GetTicks();
-	    if (tv_now > tv_before + 1)
-		Debug("AI[%s] took too long in think() [%d ticks].\n",
-			AI[P]->name, tv_now - tv_before);
-#endif
+    if (!loaded) {
+	/* make up a dummy high score template first */
 
-	    do {  /* just in case we're *way* behind */
-		State[P].tv_next_ai_think += 
-		    State[P].ai_interval;
-	    } while (State[P].tv_next_ai_think < tv_now); 
+	for (i=0; i<NUM_HIGH_SCORES; i++) {
+	    high_names[i] = strdup("No one yet..."); Assert(high_names[i]);
+	    high_dates[i] = strdup("Never"); Assert(high_dates[i]);
+	    high_scores[i] = 0;
 	}
-	if (State[P].ai && State[P].accept_input &&
-		tv_now >= State[P].tv_next_ai_move && !paused) {
-	    int row, col;
-#ifdef AI_THINK_TIME
-	    Uint32 tv_before = SDL_GetTicks();
-#endif
+	loaded = TRUE;
+    }
 
-	    screen_to_grid_coords(&g[P], blockWidth, pos[P].x, pos[P].y, &row, &col);
-	    pos[P].move =
-		AI[P]->move(State[P].ai_state, &g[P], &State[P].cp, &State[P].np, 
-			col, row, pos[P].rot);
-#ifdef AI_THINK_TIME
-	    tv_now = SDL_GetTicks();
-	    if (tv_now > tv_before + 1)
-		Debug("AI[%s] took too long in move() [%d ticks].\n",
-			AI[P]->name, tv_now - tv_before);
-#endif
+    fin = fopen("Atris.Scores", "r");
+    if (fin) {
 
-	    do {  /* just in case we're *way* behind */
-		State[P].tv_next_ai_move += 
-		    State[P].ai_interval * 5;
-	    } while (State[P].tv_next_ai_move < tv_now); 
+	for (i=0; !feof(fin) && i < NUM_HIGH_SCORES; i++) {
+	    char *p, *q;
+	    /* read in a line of text, but skip comments and blanks */
+	    do {
+		fgets(buf, sizeof(buf), fin);
+	    } while (!feof(fin) && (buf[0] == '\n' || buf[0] == '#'));
+	    /* are we done with this file? */
+	    if (feof(fin)) break;
+	    /* strip the newline */
+	    if (strchr(buf,'\n'))
+		*(strchr(buf,'\n')) = 0;
+	    /* format: "score|date|name" */
+
+	    sscanf(buf,"%d",&high_scores[i]);
+	    p = strchr(buf,'|');
+	    if (!p) break;
+	    p++;
+	    q = strchr(p, '|');
+	    if (!q) break;
+	    Free(high_dates[i]); Free(high_names[i]);
+	    *q = 0;
+	    high_dates[i] = strdup(p); Assert(high_dates[i]);
+	    q++;
+	    high_names[i] = strdup(q); Assert(high_names[i]);
 	}
+	fclose(fin);
+    }
+}
 
-	/* 
-	 * 	User Interface Events 
-	 */
+/***************************************************************************
+ *      show_high_scores()
+ * Display the current high score list.
+ ***************************************************************************/
+static void 
+show_high_scores()
+{
+  char buf[256];
+  int i, base;
+  int delta;
+    
+  if (!loaded) load_high_scores();
+  prep_hs_bg();
 
-	if (SDL_PollEvent(&event)) {
+  draw_string("Alizarin Tetris High Scores", color_purple, screen->w/2,
+	  hs.y, DRAW_LARGE | DRAW_UPDATE | DRAW_CENTER );
 
-	    /* special menu handling! */
-	    if (handle) {
-		if (handle(&event)) {
-		    return -1;
-		}
-	    } else switch (event.type) {
-		case SDL_KEYUP:
-		    /* "down" will not affect you again until you release
-		     * the down key and press it again */
-		    if (event.key.keysym.sym == SDLK_DOWN) {
-			State[1].ready_for_fast = 1;
-			if (NUM_KEYBOARD == 1)
-			    State[0].ready_for_fast = 1;
-		    }
-		    else if (event.key.keysym.sym == SDLK_UP) {
-			State[1].ready_for_rotate = 1;
-			if (NUM_KEYBOARD == 1)
-			    State[0].ready_for_rotate = 1;
-		    }
-		    else if (event.key.keysym.sym == SDLK_w)
-			State[0].ready_for_rotate = 1;
-		    else if (event.key.keysym.sym == SDLK_s)
-			State[0].ready_for_fast = 1;
-		    else if (event.key.keysym.sym == SDLK_1) {
-			P = 0;
-			goto you_win;
-		    }
-		    else if (event.key.keysym.sym == SDLK_2) {
-			P = 0;
-			goto you_lose;
-		    }
-		    else if (event.key.keysym.sym == SDLK_3) {
-			P = 1;
-			goto you_win;
-		    }
-		    else if (event.key.keysym.sym == SDLK_4) {
-			P = 1;
-			goto you_lose;
-		    } else if (event.key.keysym.sym == SDLK_p && gametype != DEMO) {
-			/* Pause it! */
-			tv_now = SDL_GetTicks();
-			paused = !paused;
-			if (sock) { 
-			    char msg = 'p'; /* WRW: send pause update */
-			    send(sock,&msg,1,0);
-			}
-			do_pause(paused, tv_now, &pause_begin_time, &tv_start);
-		    }
+  base = FIRST_SCORE_Y;
 
-		    break;
+  for (i=0; i<NUM_HIGH_SCORES; i++)
+    {
+      sprintf(buf, "%-2d)", i+1);
+      delta = draw_string(buf, color_blue, 3*screen->w/40, base, DRAW_UPDATE );
 
-		case SDL_KEYDOWN:
-		    {
-			int ks = event.key.keysym.sym;
-			Q = -1;
+      score_height = delta + 3;
 
-			/* keys for P=0 */
-			if (ks == SDLK_UP || ks == SDLK_DOWN ||
-				ks == SDLK_RIGHT || ks == SDLK_LEFT) {
-			    Q = 1;
-			} else if (ks == SDLK_w || ks == SDLK_s ||
-				ks == SDLK_a || ks == SDLK_d) {
-			    Q = 0;
-			} else if (ks == SDLK_q) {
-			    if (sock == 0) {
-				adjust[0] = -1;
-				if (NUM_PLAYER == 2)
-				    adjust[1] = -1;
-				stop_playing_sound(ss[0],SOUND_CLOCK);
-				if (NUM_PLAYER == 2) stop_playing_sound(ss[1],SOUND_CLOCK);
-				return -1;
-			    } else {
-				/*
-				Debug("Entering Limbo: adjust down.\n");
-				*/
-				State[0].falling = 0;
-				State[0].fall_speed = 0;
-				State[0].tetris_handling = 0;
-				State[0].accept_input = 0;
-				State[0].limbo = 1;
-				adjust[0] = ADJUST_DOWN;
-			    }
-			} else if ((ks == SDLK_RETURN) && 
-                            ((event.key.keysym.mod & KMOD_LCTRL) ||
-                             (event.key.keysym.mod & KMOD_RCTRL))) {
-                          SDL_WM_ToggleFullScreen(screen);
-                          break; 
-                        } else break;
-			if (NUM_KEYBOARD == 1) Q = 0;
-			else if (NUM_KEYBOARD < 1) break;
-			/* humans cannot modify AI moves! */
+      sprintf(buf, "%-20s", high_names[i]);
+      draw_string(buf, color_red, 3*screen->w/20, base, DRAW_UPDATE );
 
-			Assert(Q == 0 || Q == 1);
+      sprintf(buf, "%.4d", high_scores[i]);
+      draw_string(buf, color_blue, 11*screen->w/20, base, DRAW_UPDATE );
 
-			if (event.key.keysym.sym != SDLK_DOWN &&
-				event.key.keysym.sym != SDLK_s)
-			    State[Q].fall_speed = 1;
-			if (!State[Q].accept_input) {
-			    break;
-			}
-		    /* only if we are accepting input */
-			switch (event.key.keysym.sym) {
-			    case SDLK_UP: case SDLK_w: 
-				if (State[Q].ready_for_rotate)
-				    pos[Q].move = MOVE_ROTATE;
-				break;
-			    case SDLK_DOWN: case SDLK_s: 
-				if (State[Q].ready_for_fast)
-				    pos[Q].move = MOVE_DOWN;
-				break;
-			    case SDLK_LEFT: case SDLK_a: 
-				pos[Q].move = MOVE_LEFT; break;
-			    case SDLK_RIGHT: case SDLK_d: 
-				pos[Q].move = MOVE_RIGHT; break;
-			    default: 
-				PANIC("unknown keypress");
-			}
-		    }
-		    break;
-		case SDL_QUIT:
-		    Debug("Window-manager exit request.\n");
-		    adjust[0] = -1;
-		    if (NUM_PLAYER == 2)
-			adjust[1] = -1;
-		    stop_playing_sound(ss[0],SOUND_CLOCK);
-		    if (NUM_PLAYER == 2) stop_playing_sound(ss[1],SOUND_CLOCK);
-		    return -1;
-		case SDL_SYSWMEVENT:
-		    break;
-	    } /* end: switch (event.type) */
-	} 
+      sprintf(buf, "%s", high_dates[i]);
+      draw_string(buf, color_red, 7*screen->w/10, base, DRAW_UPDATE );
 
-	/* 
-	 *	Handle Movement 
-	 */
-	for (Q=0;Q<NUM_PLAYER;Q++) {
-	    switch (pos[Q].move) {
-		case MOVE_ROTATE: 
-		    State[Q].ready_for_rotate = 0;
-		    if (valid_screen_position(&State[Q].cp,blockWidth,&g[Q],(pos[Q].rot+1)%4,pos[Q].x,pos[Q].y)) {
-			pos[Q].rot = (pos[Q].rot+1)%4; 
-			State[Q].collide_time = 0;
-		    } else if (valid_screen_position(&State[Q].cp,blockWidth,&g[Q],(pos[Q].rot+1)%4,
-				pos[Q].x-blockWidth,pos[Q].y)) {
-			pos[Q].rot = (pos[Q].rot+1)%4; 
-			pos[Q].x -= blockWidth;
-			State[Q].collide_time = 0;
-		    } else if (valid_screen_position(&State[Q].cp,blockWidth,&g[Q],(pos[Q].rot+1)%4,
-				pos[Q].x+blockWidth,pos[Q].y)) {
-			pos[Q].rot = (pos[Q].rot+1)%4; 
-			pos[Q].x += blockWidth;
-			State[Q].collide_time = 0;
-		    } else if (valid_screen_position(&State[Q].cp,blockWidth,&g[Q],(pos[Q].rot+1)%4,
-				pos[Q].x,pos[Q].y+blockWidth)) {
-			pos[Q].rot = (pos[Q].rot+1)%4; 
-			pos[Q].y += blockWidth;
-			State[Q].collide_time = 0;
-		    } else if (Options.upward_rotation &&
-			    valid_screen_position(&State[Q].cp,blockWidth,
-				&g[Q],(pos[Q].rot+1)%4, pos[Q].x,
-				pos[Q].y-blockWidth)) {
-			pos[Q].rot = (pos[Q].rot+1)%4; 
-			pos[Q].y -= blockWidth;
-			State[Q].collide_time = 0;
-		    }
-		    pos[Q].move = MOVE_NONE;
-		    break;
-		case MOVE_LEFT:
-		    for (i=0;i<10;i++) 
-			if (valid_screen_position(&State[Q].cp,blockWidth,
-				    &g[Q],pos[Q].rot,
-				    pos[Q].x-blockWidth,
-				    pos[Q].y+i)) {
-			    pos[Q].x -= blockWidth;
-			    pos[Q].y += i;
-			    State[Q].collide_time = 0;
-			    break;
-			}
-		    pos[Q].move = MOVE_NONE;
-		    break;
-		case MOVE_RIGHT:
-		    for (i=0;i<10;i++)
-			if (valid_screen_position(&State[Q].cp,blockWidth,&g[Q],pos[Q].rot,
-				    pos[Q].x+blockWidth,pos[Q].y+i)){
-			    pos[Q].x += blockWidth;
-			    pos[Q].y += i;
-			    State[Q].collide_time = 0;
-			    break;
-			}
-		    pos[Q].move = MOVE_NONE;
-		    break;
-		case MOVE_DOWN:
-		    if (valid_screen_position(&State[Q].cp,blockWidth,&g[Q],pos[Q].rot,
-				pos[Q].x, pos[Q].y+blockWidth))
-			pos[Q].y+=blockWidth;
-		    State[Q].fall_speed = 20;
-		    State[Q].ready_for_fast = 0;
-		    pos[Q].move = MOVE_NONE;
-		    break;
-		default: 
-		    break;
+      base += score_height;
+    }
+}
+
+/***************************************************************************
+ *      is_high_score()
+ * Checks whether score qualifies as a high score.
+ * Returns 1 if so, 0 if not.
+ ***************************************************************************/
+static int 
+is_high_score(int score)
+{
+  if (!loaded) load_high_scores();
+  return (score >= high_scores[NUM_HIGH_SCORES-1]);
+}
+
+/***************************************************************************
+ *      update_high_scores()
+ * Modifies the high score list, adding in the current score and
+ * querying for a name.
+ ***************************************************************************/
+static void 
+update_high_scores(int score)
+{
+  unsigned int i, j;
+  char buf[256];
+#if HAVE_STRFTIME
+  const struct tm* tm;
+  time_t t;
+#endif
+  
+  if (!is_high_score(score)) return;
+  if (!loaded) load_high_scores();
+
+  for (i=0; i<NUM_HIGH_SCORES; i++)
+    {
+      if (score >= high_scores[i])
+	{
+	  prep_hs_bg();
+	  /* move everything down */
+
+	  Free(high_names[NUM_HIGH_SCORES-1]);
+	  Free(high_dates[NUM_HIGH_SCORES-1]);
+
+	  for (j=NUM_HIGH_SCORES-1; j>i; j--)
+	    {
+	      high_scores[j] = high_scores[j-1];
+	      high_names[j] = high_names[j-1];
+	      high_dates[j] = high_dates[j-1];
 	    }
-	} /* endof: for each player, check move */
+	  /* Get the date */
+#if HAVE_STRFTIME
+	  t = time(NULL); tm = localtime(&t);
+	  strftime(buf, sizeof(buf), "%b %d %H:%M", tm);
+	  high_dates[i] = strdup(buf);
+#else
+#warning  "Since you do not have strftime(), you will not have accurate times in the high score list."
+	  high_dates[i] = "Unknown Time";
+#endif
 
+	  high_scores[i] = score;
+	  /* Display the high scores */
+	  high_names[i] = " ";
+	  show_high_scores();
+	  /* get the new name */
 
-	if (State[P].falling && !paused) { 
-	    if (State[P].draw) 
-		if (pos[P].old_x != pos[P].x || pos[P].old_y != pos[P].y || pos[P].old_rot != pos[P].rot) {
-		    draw_play_piece(screen, cs[P], &State[P].cp, pos[P].old_x, pos[P].old_y, pos[P].old_rot,
-			    &State[P].cp, pos[P].x, pos[P].y, pos[P].rot);
-		    pos[P].old_x = pos[P].x; pos[P].old_y = pos[P].y; pos[P].old_rot = pos[P].rot;
-		}
-	}
+	  draw_string("Enter your name!", color_purple, screen->w / 2, hs.y
+		  + hs.h - 10, DRAW_CENTER | DRAW_ABOVE | DRAW_UPDATE);
 
-	/* network connection */
-	if (sock) {
-	    fd_set read_fds;
-	    struct timeval timeout = { 0, 0 };
-	    int retval;
+	  high_names[i] = input_string(screen, 3*screen->w/20,
+		  FIRST_SCORE_Y + score_height * i, 1);
+	  break;
+	}
+    }
+  save_high_scores();
+}
 
-	    Assert(P == 0);
+/***************************************************************************
+ *      high_score_check()
+ * Checks for a high score; if so, updates the list. Displays list.
+ *********************************************************************PROTO*/
+void high_score_check(int level, int new_score)
+{
+  SDL_Event event;
 
-	    do { 
-		FD_ZERO(&read_fds);
-		FD_SET(sock,&read_fds);
-#if HAVE_SELECT || HAVE_WINSOCK_H
-		retval = select(sock+1, &read_fds, NULL, NULL, &timeout);
-#else
-#warning	"Since you do not have select(), networking play will fail."
-		retval = 0;
-#endif
-		if (retval > 0) {
-		    char msg;
-		    if (recv(sock,&msg,1,0) != 1) {
-			Debug("WARNING: Other player has left?\n");
-			close(sock);
-			sock = 0;
-			retval = 0;
-		    } else {
-			switch (msg) {
-			    case 'b': 
-				do_blank(screen, ss, g, P);
-			    break;
-			    case 'p':
-				paused = !paused;
-				tv_now = SDL_GetTicks();
-				do_pause(paused, tv_now, &pause_begin_time, &tv_start);
-			    break; 
+  clear_screen_to_flame();
 
-			    case ADJUST_DOWN: /* other play in limbo */
-			    case ADJUST_SAME:
-			    case ADJUST_UP:
-				State[P].other_in_limbo = 1;
-				adjust[!P] = msg;
-				break;
+  if (level < 0) {
+      return;
+  }
 
-			    case 'g': 
-				add_garbage(&g[P]);
-				play_sound(ss[P],SOUND_GARBAGE1,1);
-				draw_grid(screen,cs[P],&g[P],State[P].draw);
-				      break;
-			    case 's':
-				  recv(sock,(char *)&Score[1], sizeof(Score[1]),0);
-				  draw_score(screen, 1);
-				  break;
-			    case 'c':  { int i,j;
-				      memcpy(g[!P].temp,g[!P].contents,
-					      sizeof(*g[0].temp) *
-					      g[!P].w * g[!P].h);
-				      recv(sock,g[!P].contents,
-					      sizeof(*g[!P].contents) *
-					      g[!P].w * g[!P].h,0);
-				      for (i=0;i<g[!P].w;i++)
-					  for (j=0;j<g[!P].h;j++)
-					      if (GRID_CONTENT(g[!P],i,j) != TEMP_CONTENT(g[1],i,j)){
-						  GRID_CHANGED(g[!P],i,j)=1;
-						  if (i > 0) GRID_CHANGED(g[!P],i-1,j) = 1;
-						  if (j > 0) GRID_CHANGED(g[!P],i,j-1) = 1;
-						  if (i < g[!P].w-1) GRID_CHANGED(g[!P],i+1,j) = 1;
-						  if (i < g[!P].h-1) GRID_CHANGED(g[!P],i,j+1) = 1;
-						  if (GRID_CONTENT(g[!P],i,j) == 0) GRID_SET(g[!P],i,j,REMOVE_ME);
-						  }
-				      draw_grid(screen,cs[!P],&g[!P],1);
-				       }
-				      break;
-			    default: break;
-			}
-		    }
-		}
-	    } while (retval > 0 && 
-		    !(State[P].limbo && State[P].other_in_limbo));
+  /* Clear the queue */
+  while (SDL_PollEvent(&event)) { 
+      poll_and_flame(&event);
+  }
+  
+  /* Check for a new high score.  If so, update the list. */
+  if (is_high_score(new_score)) {
+      update_high_scores(new_score);
+      show_high_scores();
+  } else { 
+      char buf[BUFSIZE];
 
-	    /* limbo handling */
-	    if (State[P].limbo && State[P].other_in_limbo) {
-		Assert(adjust[0] != -1 && adjust[1] != -1);
-		stop_playing_sound(ss[0],SOUND_CLOCK);
-		if (NUM_PLAYER == 2) stop_playing_sound(ss[1],SOUND_CLOCK);
-		return 0;
-	    } else if (State[P].limbo && !State[P].other_in_limbo &&
-		    !State[P].limbo_sent) {
-		char msg = adjust[P]; /* WRW: send update */
-		State[P].limbo_sent = 1;
-		send(sock,&msg,1,0);
-	    } else if (!State[P].limbo && State[P].other_in_limbo) {
-		char msg; /* WRW: send update */
-		/* hmm, other guy is done ... */
-		if (adjust[!P] == ADJUST_UP || adjust[!P] == ADJUST_SAME) {
-		    if (*seconds_remaining > 0) 
-			adjust[P] = ADJUST_SAME;
-		    else
-			adjust[P] = ADJUST_DOWN;
-		} else if (adjust[!P] == ADJUST_DOWN) {
-		    adjust[P] = ADJUST_SAME;
-		}
-		/*
-		Debug("Entering Limbo: adjust same/down.\n");
-		*/
-		State[P].falling = 0;
-		State[P].fall_speed = 0;
-		State[P].tetris_handling = 0;
-		State[P].accept_input = 0;
-		State[P].limbo = 1;
-		State[P].limbo_sent = 1;
-		msg = adjust[P];
-		send(sock,&msg,1,0);
-		stop_playing_sound(ss[0],SOUND_CLOCK);
-		if (NUM_PLAYER == 2) stop_playing_sound(ss[1],SOUND_CLOCK);
-		return 0;
-	    }
-	}
-	if (paused) {
-	    atris_run_flame();
-	}
+      show_high_scores();
+      sprintf(buf,"Your score: %d", new_score);
 
-	tv_now = SDL_GetTicks();
-	{
-	    Uint32 least = State[0].tv_next_fall;
-
-	    if (State[0].tetris_handling && State[0].tv_next_tetris < least)
-		least = State[0].tv_next_tetris;
-	    if (State[0].ai && State[0].tv_next_ai_think < least)
-		least = State[0].tv_next_ai_think;
-	    if (State[0].ai && State[0].tv_next_ai_move < least)
-		least = State[0].tv_next_ai_move;
-	    if (NUM_PLAYER == 2) {
-		if (State[1].tv_next_fall < least)
-		    least = State[1].tv_next_tetris;
-		if (State[1].tetris_handling && State[1].tv_next_tetris < least)
-		    least = State[1].tv_next_tetris;
-		if (State[1].ai && State[1].tv_next_ai_think < least)
-		    least = State[1].tv_next_ai_think;
-		if (State[1].ai && State[1].tv_next_ai_move < least)
-		    least = State[1].tv_next_ai_move;
-	    }
+      draw_string(buf, color_purple, screen->w / 2, hs.y
+	      + hs.h - 10, DRAW_CENTER | DRAW_ABOVE | DRAW_UPDATE);
 
-	    if (least >= tv_now + 4 && !SDL_PollEvent(NULL)) {
-		/* hey, we could sleep for two ... */
-		if (State[0].ai || State[1].ai) {
-		    SDL_Delay(1);
-		    if (State[0].ai && State[0].draw) {
-			int row, col;
-			screen_to_grid_coords(&g[0], blockWidth, pos[0].x, pos[0].y, &row, &col);
-			AI[0]->think(State[0].ai_state, &g[0], &State[0].cp, &State[0].np, col, row, pos[0].rot);
-		    } else SDL_Delay(1);
-		    if (State[1].ai && State[1].draw) {
-			int row, col;
-			screen_to_grid_coords(&g[1], blockWidth, pos[1].x, pos[1].y, &row, &col);
-			AI[1]->think(State[1].ai_state, &g[1], &State[1].cp, &State[1].np, col, row, pos[1].rot);
-		    } else SDL_Delay(1);
-		} else SDL_Delay(2);
-	    } else if (least > tv_now && !SDL_PollEvent(NULL))
-		SDL_Delay(least - tv_now);
-	}
-    } 
+    }
+  /* wait for any key */
+  do {
+      poll_and_flame(&event);
+  } while (event.type != SDL_KEYDOWN);
 }
 
 /*
- * $Log: event.c,v $
- * Revision 1.61  2001/01/05 21:12:32  weimer
- * advance to atris 1.0.5, add support for ".atrisrc" and changing the
- * keyboard repeat rate
- *
- * Revision 1.60  2000/11/10 18:16:48  weimer
- * changes for Atris 1.0.4 - three new special options
- *
- * Revision 1.59  2000/11/06 04:39:56  weimer
- * networking consistency check for power pieces
- *
- * Revision 1.58  2000/11/06 04:06:44  weimer
- * option menu
- *
- * Revision 1.57  2000/11/06 01:25:54  weimer
- * add in the other special piece
- *
- * Revision 1.56  2000/11/06 00:51:55  weimer
- * fixed the paint thing so that it actually paints
- *
- * Revision 1.55  2000/11/06 00:24:01  weimer
- * add WalkRadioGroup modifications (inactive field for Kiri) and some support
- * for special pieces
- *
- * Revision 1.54  2000/11/03 04:25:58  weimer
- * add some optimizations to run_gravity to make it just a bit faster (down
- * to 0.01 ms/call from 0.02), sleep a bit more in event-loop: generally
- * trying to make us more CPU friendly ...
- *
- * Revision 1.53  2000/11/02 03:06:20  weimer
- * better interface for walk-radio menus: we are now ready for Kiri to change
- * them to add run-time options ...
- *
- * Revision 1.52  2000/11/01 17:55:33  weimer
- * remove ambiguous references to "you win" in debugging output
- *
- * Revision 1.51  2000/11/01 04:39:41  weimer
- * clear the little scoring spot correctly, updates for making a no-sound
- * distribution
- *
- * Revision 1.50  2000/11/01 03:53:06  weimer
- * modifications for version 1.0.1: you can pick your starting level, you can
- * pick the AI difficulty factor, the game is better about placing new pieces
- * when there is garbage, when things fall out of your control they now fall
- * at a uniform rate ...
- *
- * Revision 1.49  2000/10/30 16:57:24  weimer
- * minor doc fixups
- *
- * Revision 1.48  2000/10/30 16:25:25  weimer
- * display the network player score during network games. Also give the
- * non-server a little message when waiting for the server to go on.
- *
- * Revision 1.47  2000/10/29 22:55:01  weimer
- * networking consistency checks (you must have the same number of doodads):
- * special hotkey 'f' in main menu toggles full screen mode
- * added depth specification on the command line
- * automatically search for the darkest non-black color ...
+ * $Log: highscore.c,v $
+ * Revision 1.31  2000/11/06 01:22:40  wkiri
+ * Updated menu system.
  *
- * Revision 1.46  2000/10/29 21:23:28  weimer
+ * Revision 1.30  2000/10/29 21:23:28  weimer
  * One last round of header-file changes to reflect my newest and greatest
  * knowledge of autoconf/automake. Now if you fail to have some bizarro
  * function, we try to go on anyway unless it is vastly needed.
  *
- * Revision 1.45  2000/10/29 19:04:32  weimer
+ * Revision 1.29  2000/10/29 19:04:33  weimer
  * minor highscore handling changes: new filename, use the draw_string() and
  * draw_bordered_rect() and input_string() interfaces, handle the widget layer
  * and the flame layer, etc. Also fix a minor bug where you would be prevented
  * from settling if you pressed a key even if it didn't really move you. :-)
  *
- * Revision 1.44  2000/10/29 17:23:13  weimer
- * incorporate "xflame" flaming background for added spiffiness ...
- *
- * Revision 1.43  2000/10/29 00:17:39  weimer
- * added support for a system independent random number generator
- *
- * Revision 1.42  2000/10/28 13:39:14  weimer
- * added a pausing feature ...
- *
- * Revision 1.41  2000/10/27 00:07:36  weimer
- * some sound fixes ...
- *
- * Revision 1.40  2000/10/26 22:23:07  weimer
- * double the effective number of levels
- *
- * Revision 1.39  2000/10/22 22:05:51  weimer
- * Added a few new sounds ...
- *
- * Revision 1.38  2000/10/21 01:14:42  weimer
+ * Revision 1.28  2000/10/21 01:14:43  weimer
  * massic autoconf/automake restructure ...
  *
- * Revision 1.37  2000/10/20 01:32:09  weimer
- * Minor play issue problems -- time is now truly a hard limit!
- *
- * Revision 1.36  2000/10/19 22:30:55  weimer
- * make pieces fall a bit faster
- *
- * Revision 1.35  2000/10/19 22:06:51  weimer
- * minor changes ...
- *
- * Revision 1.34  2000/10/19 00:20:27  weimer
- * sound directory changes, added a ticking clock ...
- *
- * Revision 1.33  2000/10/18 23:57:49  weimer
+ * Revision 1.27  2000/10/18 23:57:49  weimer
  * general fixup, color changes, display changes.
  * Notable: "Safe" Blits and Updates now perform "clipping". No more X errors,
  * we hope!
  *
- * Revision 1.32  2000/10/18 03:29:56  weimer
- * fixed problem with "machine-gun" sounds caused by "run_gravity()" returning
- * 1 too often
- *
- * Revision 1.31  2000/10/18 02:04:02  weimer
- * playability changes ...
- *
- * Revision 1.30  2000/10/14 16:17:41  weimer
- * level adjustment changes, added some new AIs, etc.
- *
- * Revision 1.29  2000/10/14 01:42:53  weimer
- * better scoring of thumbs-up, thumbs-down
- *
- * Revision 1.28  2000/10/14 01:24:34  weimer
- * fixed error with not advancing levels when fighting AI
+ * Revision 1.26  2000/09/09 17:05:35  wkiri
+ * Hideous log changes (Wes: how dare you include a comment character!)
  *
- * Revision 1.27  2000/10/14 00:58:32  weimer
- * fixed an unsigned arithmetic problem that was sleeping too often!
+ * Revision 1.25  2000/09/09 16:58:27  weimer
+ * Sweeping Change of Ultimate Mastery. Main loop restructuring to clean up
+ * main(), isolate the behavior of the three game types. Move graphic files
+ * into graphics/-, style files into styles/-, remove some unused files,
+ * add game flow support (breaks between games, remembering your level within
+ * this game), multiplayer support for the event loop, some global variable
+ * cleanup. All that and a bag of chips!
  *
- * Revision 1.26  2000/10/14 00:56:41  weimer
- * whoops, minor boolean typo!
+ * Revision 1.24  2000/09/04 19:48:02  weimer
+ * interim menu for choosing among game styles, button changes (two states)
  *
- * Revision 1.25  2000/10/14 00:42:27  weimer
- * fixed minor error where you couldn't move all the way to the left ...
+ * Revision 1.23  2000/09/03 19:41:30  wkiri
+ * Now allows you to choose the game type (though it doesn't do anything yet).
  *
- * Revision 1.24  2000/10/13 22:34:26  weimer
- * minor wessy AI changes
+ * Revision 1.22  2000/09/03 18:44:36  wkiri
+ * Cleaned up atris.c (see high_score_check()).
+ * Added game type (defaults to MARATHON).
  *
- * Revision 1.23  2000/10/13 18:23:28  weimer
- * fixed a race condition in tetris_event()
+ * Revision 1.21  2000/09/03 18:26:10  weimer
+ * major header file and automatic prototype generation changes, restructuring
  *
- * Revision 1.22  2000/10/13 17:55:36  weimer
- * Added another color "Style" ...
+ * Revision 1.20  2000/09/03 17:56:36  wkiri
+ * Reorganization of files (display.[ch], event.c are new).
  *
- * Revision 1.21  2000/10/13 16:37:39  weimer
- * Changed the AI so that it now passes state around via void pointers, rather
- * than using global variables. This allows the same AI to play itself. Also
- * changed the "AI vs. AI" display so that you can keep track of total wins
- * and losses.
+ * Revision 1.19  2000/08/26 03:11:34  wkiri
+ * Buttons now use borders.
  *
- * Revision 1.20  2000/10/13 15:41:53  weimer
- * revamped AI support, now you can pick your AI and have AI duels (such fun!)
- * the mighty Aliz AI still crashes a bit, though ... :-)
+ * Revision 1.18  2000/08/26 02:45:28  wkiri
+ * Beginnings of button class; also modified atris to query for 'new
+ * game' vs. 'quit'.  (New Game doesn't work yet...)
  *
- * Revision 1.19  2000/10/13 03:02:05  wkiri
- * Added Aliz (Kiri AI) to ai.c.
- * Note event.c currently calls Aliz, not Wessy AI.
+ * Revision 1.17  2000/08/26 00:54:00  wkiri
+ * Now high-scoring user enters name at the proper place.
+ * Also, score is shown even if user doesn't make the high score list.
  *
- * Revision 1.18  2000/10/12 22:21:25  weimer
- * display changes, more multi-local-play threading (e.g., myScore ->
- * Score[0]), that sort of thing ...
+ * Revision 1.16  2000/08/20 23:45:58  wkiri
+ * High scores reports the hour:minute rather than the year.
  *
- * Revision 1.17  2000/10/12 19:17:08  weimer
- * Further support for AI players and multiple game types.
+ * Revision 1.15  2000/08/20 23:39:00  wkiri
+ * Different color for the scores in the score display; positions adjusted.
  *
- * Revision 1.16  2000/10/12 00:49:08  weimer
- * added "AI" support and walking radio menus for initial game configuration
+ * Revision 1.14  2000/08/20 19:00:29  weimer
+ * text output changes (moved from _Solid to _Blended)
  *
- * Revision 1.15  2000/09/09 17:05:35  wkiri
- * Hideous log changes (Wes: how dare you include a comment character!)
+ * Revision 1.13  2000/08/20 17:16:25  wkiri
+ * Can quit using 'q' and this will skip the high score list.
+ * Adjusted the high score display positions to fit in the window.
  *
- * Revision 1.14  2000/09/09 16:58:27  weimer
- * Sweeping Change of Ultimate Mastery. Main loop restructuring to clean up
- * main(), isolate the behavior of the three game types. Move graphic files
- * into graphics/-, style files into styles/-, remove some unused files,
- * add game flow support (breaks between games, remembering your level within
- * this game), multiplayer support for the event loop, some global variable
- * cleanup. All that and a bag of chips!
+ * Revision 1.12  2000/08/20 16:49:52  wkiri
+ * Now supports dates as well.
  *
- * Revision 1.13  2000/09/05 22:10:46  weimer
- * fixed initial garbage generation strangeness
+ * Revision 1.11  2000/08/20 16:20:46  wkiri
+ * Now displays the new score correctly.
  *
- * Revision 1.12  2000/09/05 21:47:41  weimer
- * major timing revamping: it actually seems to work now!
+ * Revision 1.10  2000/08/20 16:16:04  wkiri
+ * Better display of high scores.
  *
- * Revision 1.11  2000/09/05 20:22:12  weimer
- * native video mode selection, timing investigation
+ * Revision 1.9  2000/08/15 01:58:11  wkiri
+ * Not allowed to backspace before the beginning of the array! :)
+ * Handles this gracefully (i.e. ignores any such keypresses)
+ * and clears the display correctly even when fewer letters are present
+ * than were present previously (when BS is pressed).
  *
- * Revision 1.10  2000/09/04 15:20:21  weimer
- * faster blitting algorithms for drawing the grid and drawing falling pieces
- * (when you eliminate a line)
+ * Revision 1.8  2000/08/15 01:30:33  wkiri
+ * Handles shift keys (i.e. empty messages) properly.
  *
- * Revision 1.9  2000/09/04 14:18:09  weimer
- * flushed out the pattern color so that it has the same number of colors as
- * the default
+ * Revision 1.7  2000/08/15 01:22:59  wkiri
+ * High scores can handle punctuation, backspace, and spaces in names.
+ * Also, display is nicer (got rid of the weird boxes).
  *
- * Revision 1.8  2000/09/03 20:58:22  weimer
- * yada
+ * Revision 1.6  2000/08/15 00:52:33  wkiri
+ * Ooops! Now properly checks for new high scores.
  *
- * Revision 1.7  2000/09/03 20:57:02  weimer
- * changes the time variable to be passed by reference in the event loop
+ * Revision 1.5  2000/08/15 00:50:49  wkiri
+ * Now displays your high score name as you type it in.
+ * No support for backspace, though.
  *
- * Revision 1.6  2000/09/03 20:34:42  weimer
- * only draw their score in multiplayer game
+ * Revision 1.4  2000/08/15 00:37:01  wkiri
+ * Wes found nasty memory bug!  Wes is my hero!
+ * Also, changes to high scores to get input from the window.
  *
- * Revision 1.5  2000/09/03 20:27:38  weimer
- * the event loop actually works!
+ * Revision 1.3  2000/08/15 00:22:15  wkiri
+ * Now handles non-regular-ascii input to high scores.
  *
- * Revision 1.4  2000/09/03 19:59:56  weimer
- * wessy event-loop changes
+ * Revision 1.2  2000/08/14 23:37:06  wkiri
+ * Removed debugging output from high score module.
  *
- * Revision 1.3  2000/09/03 18:44:36  wkiri
- * Cleaned up atris.c (see high_score_check()).
- * Added game type (defaults to MARATHON).
+ * Revision 1.1  2000/08/14 01:07:17  wkiri
+ * High score files.
  *
  */
 
+/***************************************************************************
+ *      input_string()
+ * Read input from the user ... on the widget layer. 
+ *********************************************************************PROTO*/
+char *
+input_string(SDL_Surface *screen, int x, int y, int opaque)
+{
+    int pos;
+    char c;
+    char retval[1024];
+    SDL_Surface *text, *ctext;
+    SDL_Color tc, cc;
+    SDL_Rect rect;
+    SDL_Event event;
+    Uint32 text_color = int_input_color0;
+    Uint32 cursor_color = int_input_color1;
+    Uint32 our_black = opaque ? int_solid_black : int_black;
 
-static Uint32 randomSeed;
+    memset(retval, 0, sizeof(retval));
+    retval[0] = ' ';
+    pos = 1;
 
-void SeedRandom(Uint32 Seed)
-{
-	if ( ! Seed ) {
-		srand(time(NULL));
-		Seed = (((rand()%0xFFFF)<<16)|(rand()%0xFFFF));
-	}
-	randomSeed = Seed;
-}
+    SDL_GetRGB(text_color, screen->format, &tc.r, &tc.g, &tc.b);
+    SDL_GetRGB(cursor_color, screen->format, &cc.r, &cc.g, &cc.b);
 
-Uint32 GetRandSeed(void)
-{
-	return(randomSeed);
-}
+    ctext = TTF_RenderText_Blended(font, "_", cc); Assert(ctext);
 
-/* This magic is wholly the result of Andrew Welch, not me. :-) */
-Uint16 FastRandom(Uint16 range)
-{
-	Uint16 result;
-	register Uint32 calc;
-	register Uint32 regD0;
-	register Uint32 regD1;
-	register Uint32 regD2;
+    while (1) {
+	int changed = 0;	/* did they change the text string? */
+	int blink = 1;		/* toggle the blinking the cursor */
+	Uint32  flip_when = SDL_GetTicks();
+	/* display the current string */
 
-	calc = randomSeed;
-	regD0 = 0x41A7;
-	regD2 = regD0;
-	
-	regD0 *= calc & 0x0000FFFF;
-	regD1 = regD0;
-	
-	regD1 = regD1 >> 16;
-	
-	regD2 *= calc >> 16;
-	regD2 += regD1;
-	regD1 = regD2;
-	regD1 += regD1;
-	
-	regD1 = regD1 >> 16;
-	
-	regD0 &= 0x0000FFFF;
-	regD0 -= 0x7FFFFFFF;
-	
-	regD2 &= 0x00007FFF;
-	regD2 = (regD2 << 16) + (regD2 >> 16);
-	
-	regD2 += regD1;
-	regD0 += regD2;
-	
-	/* An unsigned value < 0 is always 0 */
-	/*************************************
-	 Not compiled:
-	if (regD0 < 0)
-		regD0 += 0x7FFFFFFF;
-	 *************************************/
-	
-	randomSeed = regD0;
-	if ((regD0 & 0x0000FFFF) == 0x8000)
-		regD0 &= 0xFFFF0000;
+	text = TTF_RenderText_Blended(font, retval, tc); Assert(text);
+
+	rect.x = x;
+	rect.y = y;
+	rect.w = text->w;
+	rect.h = text->h;
+
+	SDL_BlitSurface(text, NULL, widget_layer, &rect);
+	/* OK to ignore the intervening flame layer */
+	SDL_BlitSurface(text, NULL, screen, &rect);
+	SDL_UpdateSafe(screen, 1, &rect);
+
+	rect.x += rect.w;
+	rect.w = ctext->w;
+	rect.h = ctext->h;
+
+	changed = 0;
+	while (!changed) { 
+	    if (SDL_GetTicks() > flip_when) {
+		if (blink) {
+		    SDL_BlitSurface(ctext, NULL, screen, &rect);
+		    SDL_BlitSurface(ctext, NULL, widget_layer, &rect);
+		} else {
+		    SDL_FillRect(widget_layer, &rect, our_black);
+		    SDL_FillRect(screen, &rect, our_black);
+		    SDL_BlitSurface(flame_layer, &rect, screen, &rect);
+		    SDL_BlitSurface(widget_layer, &rect, screen, &rect);
+		}
+		SDL_UpdateSafe(screen, 1, &rect);
+		flip_when = SDL_GetTicks() + 400;
+		blink = !blink;
+	    }
+	    if (SDL_PollEvent(&event)) {
+		if (event.type == SDL_KEYDOWN) {
+		    changed = 1;
+		    switch (event.key.keysym.sym) {
+			case SDLK_RETURN:
+			    return strdup(retval + 1);
+
+			case SDLK_BACKSPACE:
+			    if (pos > 1) pos--;
+			    retval[pos] = 0;
+
+			    rect.x = x;
+			    rect.w = text->w + ctext->w;
+			    SDL_FillRect(widget_layer, &rect, our_black);
+			    SDL_FillRect(screen, &rect, our_black);
+			    SDL_BlitSurface(flame_layer, &rect, screen, &rect);
+			    SDL_BlitSurface(widget_layer, &rect, screen, &rect);
+			    SDL_UpdateSafe(screen, 1, &rect);
+			    break;
 
-/* -- Now that we have our pseudo random number, pin it to the range we want */
+			default:
+			    c = event.key.keysym.unicode;
+			    if (c == 0) break;
 
-	regD1 = range;
-	regD1 *= (regD0 & 0x0000FFFF);
-	regD1 = (regD1 >> 16);
-	
-	result = regD1;
-	
-	return result;
-}
+			    SDL_FillRect(widget_layer, &rect, our_black);
+			    SDL_FillRect(screen, &rect, our_black);
+			    SDL_BlitSurface(flame_layer, &rect, screen, &rect);
+			    SDL_BlitSurface(widget_layer, &rect, screen, &rect);
+			    SDL_UpdateSafe(screen, 1, &rect);
 
-typedef enum {
-    ColorStyleMenu = 0,
-    SoundStyleMenu = 1,
-    PieceStyleMenu = 2,
-    GameMenu	   = 3,
-    OptionsMenu	   = 4,
-    MainMenu       = 5,
-} MainMenuChoice;
+			    if (isalpha(c) || isdigit(c) || isspace(c) || ispunct(c))
+				retval[pos++] = c;
+			    break;
+		    }
+		}
+	    } else {
+		Sint32 blink_wait = flip_when - SDL_GetTicks();
 
-typedef enum {
-    Opt_ToggleFullScreen,
-    Opt_ToggleFlame,
-    Opt_ToggleSpecial,
-    Opt_FasterLevels,
-    Opt_LongSettleDelay,
-    Opt_UpwardRotation,
-    Opt_KeyRepeat,
-} OptionMenuChoice;
+		atris_run_flame();
+		idle_wait(min(atris_flame_wait(), max(blink_wait, 0)), 0);
+	    }
+	}
+	SDL_FreeSurface(text);
+    }
+}
 
-#define MAX_MENU_CHOICE	6
+/***************************************************************************
+ *      load_identity_file()
+ * Parse an identity file.
+ *********************************************************************PROTO*/
+identity *
+load_identity_file()
+{
+    identity *retval;
+    char buf[2048];
 
-static int start_playing = 0;
-static sound_styles *_ss;
-static color_styles *_cs;
-static piece_styles *_ps;
-static WalkRadioGroup *wrg = NULL;
+    FILE *fin = fopen(ID_FILENAME, "rt");
+    int count = 0;
+    int i;
 
-static GT _local_gametype;
+    if (!fin) {
+	Debug("fopen(%s)\n", ID_FILENAME);
+	Debug("Cannot open Identity File.\n");
 
-/***************************************************************************/
-/* Update the given choice on the main menu */
-static void updateMenu(int whichSubMenu, int choice)
-{
-  wrg->wr[MainMenu].label[whichSubMenu] = wrg->wr[whichSubMenu].label[choice];
-  clear_radio(&wrg->wr[MainMenu]);
-  setup_radio(&wrg->wr[MainMenu]);
-  wrg->wr[MainMenu].x = (screen->w/3 - wrg->wr[MainMenu].area.w)/2;
-  wrg->wr[MainMenu].y = (screen->h - wrg->wr[MainMenu].area.h)/2;
-}
+	Calloc(retval,identity *,sizeof(identity));
+	return retval;
+    }
+    Calloc(retval,identity *,sizeof(identity));
 
-char key_repeat_label[] = "Key Repeat: 16 " ;
+    while (!(feof(fin))) {
+	do {
+	    fgets(buf,sizeof(buf),fin);
+	} while (!feof(fin) &&
+		(buf[0] == '\n' || buf[0] == '#'));
+	if (feof(fin)) break;
+	if (strchr(buf,'\n'))
+	    *(strchr(buf,'\n')) = 0;
+	count++;
+    }
+    rewind(fin);
 
-static void OptionsMenu_setup()
-{
-    wrg->wr[OptionsMenu].label[Opt_ToggleFullScreen] = "Toggle Full Screen";
-    if (Options.flame_wanted)
-	wrg->wr[OptionsMenu].label[Opt_ToggleFlame] = "Background Flame: On";
-    else
-	wrg->wr[OptionsMenu].label[Opt_ToggleFlame] = "Background Flame: Off";
-    if (Options.special_wanted)
-	wrg->wr[OptionsMenu].label[Opt_ToggleSpecial] = "Power Pieces: On";
-    else
-	wrg->wr[OptionsMenu].label[Opt_ToggleSpecial] = "Power Pieces: Off";
-    if (Options.faster_levels)
-	wrg->wr[OptionsMenu].label[Opt_FasterLevels] = "Double Difficulty: On";
-    else
-	wrg->wr[OptionsMenu].label[Opt_FasterLevels] = "Double Difficulty: Off";
-    if (Options.long_settle_delay)
-	wrg->wr[OptionsMenu].label[Opt_LongSettleDelay] = "Long Settle Delay: On";
-    else
-	wrg->wr[OptionsMenu].label[Opt_LongSettleDelay] = "Long Settle Delay: Off";
-    if (Options.upward_rotation)
-	wrg->wr[OptionsMenu].label[Opt_UpwardRotation] = "Upward Rotation: On";
-    else
-	wrg->wr[OptionsMenu].label[Opt_UpwardRotation] = "Upward Rotation: Off";
+    retval->n = count;
 
-    sprintf(key_repeat_label,"Key Repeat: %.2d", Options.key_repeat_delay);
-    wrg->wr[OptionsMenu].label[Opt_KeyRepeat] = key_repeat_label;
-}
+    if (!count) {
+	/* do nothing */
+    } else {
+	Calloc(retval->p,person *,sizeof(person)*count);
+	i = 0;
+	while (!(feof(fin))) {
+	    char *p;
+	    do {
+		fgets(buf,sizeof(buf),fin);
+	    } while (!feof(fin) &&
+		    (buf[0] == '\n' || buf[0] == '#'));
+	    if (feof(fin)) break;
+	    if (strchr(buf,'\n'))
+		*(strchr(buf,'\n')) = 0;
 
-static int OptionsMenu_action(WalkRadio *wr)
-{
-    switch (wr->defaultchoice) {
-	case Opt_ToggleFullScreen:
-	    SDL_WM_ToggleFullScreen(screen);
-	    break;
-	case Opt_ToggleFlame: Options.flame_wanted = ! Options.flame_wanted; break;
-	case Opt_ToggleSpecial: Options.special_wanted = ! Options.special_wanted; break;
-	case Opt_FasterLevels: Options.faster_levels = ! Options.faster_levels; break;
-	case Opt_LongSettleDelay: Options.long_settle_delay = ! Options.long_settle_delay; break;
-	case Opt_UpwardRotation: Options.upward_rotation = ! Options.upward_rotation; break;
-	case Opt_KeyRepeat: Options.key_repeat_delay = pick_key_repeat(screen); break;
-	default: 
-	    break;
+	    sscanf(buf,"%d",&retval->p[i].level);
+	    p = strchr(buf,' ');
+	    if (!p) {
+		retval->p[i].name = "-garbled-";
+	    } else {
+		retval->p[i].name = strdup( p + 1 );
+	    }
+	    i++;
+	}
     }
-    OptionsMenu_setup();
-    clear_radio(&wrg->wr[OptionsMenu]);
-    setup_radio(&wrg->wr[OptionsMenu]);
-    return 0;
-}
+    fclose(fin);
 
-static int ColorStyleMenu_action(WalkRadio *wr)
-{
-    _cs->choice = wr->defaultchoice;
-    /* Update this choice on the main menu */
-    updateMenu((int)ColorStyleMenu, wr->defaultchoice);
-    return 1;
-}
-static int SoundStyleMenu_action(WalkRadio *wr) 
-{
-    _ss->choice = wr->defaultchoice;
-    play_all_sounds(_ss->style[_ss->choice]);
-    /* Update this choice on the main menu */
-    updateMenu((int)SoundStyleMenu, wr->defaultchoice);
-    return 1;	
-}
-static int PieceStyleMenu_action(WalkRadio *wr)
-{
-    _ps->choice = wr->defaultchoice;
-    /* Update this choice on the main menu */
-    updateMenu((int)PieceStyleMenu, wr->defaultchoice);
-    return 1;
-}
-static int GameMenu_action(WalkRadio *wr)
-{
-    _local_gametype = wr->defaultchoice;
-    /*    start_playing = 1;*/
-    /* Update this choice on the main menu */
-    updateMenu((int)GameMenu, wr->defaultchoice);
-    return 1;
+    Debug("Identity File [%s] loaded (%d players).\n",ID_FILENAME, count);
+
+    return retval;
 }
 
-static int MainMenu_action(WalkRadio *wr)
+/***************************************************************************
+ *      save_identity_file()
+ * Saves the information to an identity file.
+ *********************************************************************PROTO*/
+void 
+save_identity_file(identity *id, char *new_name, int new_level)
 {
-  int i;
-  /* If they selected a submenu, activate it */
-  switch (wr->defaultchoice) {
-      case ColorStyleMenu:
-      case SoundStyleMenu:
-      case PieceStyleMenu:
-      case GameMenu:
-      case OptionsMenu: 
-	  /* Make sure everything is inactive (not including the main menu) */ 
-	  for (i=0; i<MAX_MENU_CHOICE-1; i++)
-	      if (wrg->wr[i].inactive == FALSE) {
-		  wrg->wr[i].inactive = TRUE;
-		  clear_radio(&wrg->wr[i]);
-	      }
-	  /* now activate the proper submenu */
-	  wrg->wr[wr->defaultchoice].inactive = FALSE;
-	  wrg->cur = wr->defaultchoice;
-	  break;
-      case 5: /* they chose go! */
-	  start_playing = 1;
-	  gametype = _local_gametype;
-	  break;
-      case 6: /* they chose quit */
-	  start_playing = 1;
-	  gametype = QUIT;
-	  break;
-      default:
-	  Debug("Invalid menu choice %d.\n", wr->defaultchoice);
-  }
-  return 1;
+    FILE *fin = fopen(ID_FILENAME,"wt");
+    int i;
+    if (!fin) {
+	Debug("fopen(%s): cannot write Identity File.\n",ID_FILENAME);
+	return;
+    }
+    fprintf(fin,"# Alizarin Tetris Identity File\n"
+	        "#\n"
+		"# Format:\n"
+		"#[level] [name] (no space before level, one space after)\n"
+		);
+    for (i=0; i<id->n ;i++) {
+	fprintf(fin,"%d %s\n",id->p[i].level, id->p[i].name);
+    }
+    if (new_name)  {
+	fprintf(fin,"%d %s\n",new_level, new_name);
+    }
+
+#ifdef DEBUG
+    Debug("Identity File [%s] saved (%d players).\n",ID_FILENAME, id->n +
+	    (new_name != NULL));
+#endif
+    fclose(fin);
+    return;
 }
 
 /***************************************************************************
- *      menu_handler()
- * Play the MENU-style game. 
+ *      network_choice_action()
+ * What to do when they click on the network choice button ...
  ***************************************************************************/
 static int
-menu_handler(const SDL_Event *event) 
+network_choice_action(WalkRadio *wr) 
 {
-    int retval;
-    if (event->type == SDL_KEYDOWN) {
-	switch (event->key.keysym.sym) {
-	    case SDLK_q: 
-		start_playing = 1;
-		_local_gametype = gametype = QUIT;
-		return 1;
-
-	    case SDLK_RETURN:
-                if ((event->key.keysym.mod & KMOD_LCTRL) ||
-                    (event->key.keysym.mod & KMOD_RCTRL)) {
-                  SDL_WM_ToggleFullScreen(screen);
-                  return 1;
-                }
-
-	    default:
-		break;
-	}
-    }
-    retval = handle_radio_event(wrg, event);
-
-    if (retval != -1)
-	return 1;
-    return 0;
+    if (wr->defaultchoice == 0) {
+	/* I am client */
+	clear_screen_to_flame();
+	draw_string("Who is the Server?", color_network_menu, screen->w/2,
+		screen->h/2, DRAW_LEFT | DRAW_UPDATE);
+	wr->data = input_string(screen, screen->w/2, screen->h/2, 0);
+    } else if (wr->data) {
+	Free(wr->data);
+    } else
+	wr->data = NULL;
+    return 1;
 }
 
 /***************************************************************************
- *      play_MENU()
- * Play the MENU-style game. 
- ***************************************************************************/
-static int
-play_MENU(color_styles cs, piece_styles ps, sound_styles ss,
-    Grid g[], int my_level, AI_Player *aip)
+ *      network_choice()
+ * Do you want to be the client or the server? Returns the hostname.
+ *********************************************************************PROTO*/
+char *
+network_choice(SDL_Surface *screen)
 {
-    int curtimeleft;
-    int match;
-    int level[2];			/* level array: me + dummy slot */
-    int adjustment[2] = {-1, -1};	/* result of playing a match */
-    int my_adj[3];			/* my three winnings so far */
-    int result;
-    color_style *event_cs[2];	/* pass these to event_loop */
-    sound_style *event_ss[2];
-    AI_Player *event_ai[2];
-    extern int Score[];
+    static WalkRadioGroup *wrg = NULL;
+    SDL_Event event;
 
-    level[0] = my_level;	/* starting level */
-    Score[0] = Score[1] = 0;
-    SeedRandom(0);
+    if (!wrg) {
+	wrg = create_single_wrg( 2 ) ; 
+	wrg->wr[0].label[0] = "I am the Client. I will specify a server.";
+	wrg->wr[0].label[1] = "I will be the Server.";
 
-    while (1) {	
-	/* until they give up by pressing 'q'! */
-	/* 5 total minutes for three matches */
-	curtimeleft = 300;
-	my_adj[0] = 0; my_adj[1] = 1; my_adj[2] = 2;
+	setup_radio(&wrg->wr[0]);
+	wrg->wr[0].x = (screen->w - wrg->wr[0].area.w) / 2;
+	wrg->wr[0].y = (screen->h - wrg->wr[0].area.h) / 2;
+	wrg->wr[0].action = network_choice_action;
+    }
 
-	for (match=0; match<3 && curtimeleft > 0; match++) {
-	    /* generate the board */
-	    /* draw the background */
-	    g[0] = generate_board(10,20,level[0]);
-	    draw_background(screen, cs.style[0]->w, g, level, my_adj, NULL,
-		    &(aip->name));
-		{
-		    int i;
-		    for (i=0; i<MAX_MENU_CHOICE; i++) 
-			draw_radio(&wrg->wr[i], i == wrg->cur);
-		}
-	    /* get the result, but don't update level yet */
+    clear_screen_to_flame();
 
-	    event_cs[0] = event_cs[1] = cs.style[cs.choice];
-	    event_ss[0] = event_ss[1] = ss.style[ss.choice];
-	    event_ai[0] = aip;
-	    event_ai[1] = NULL;
+    draw_string("Who is the Server?", color_network_menu, 
+	    screen->w/2, wrg->wr[0].y, DRAW_CENTER | DRAW_UPDATE | DRAW_ABOVE);
 
-	    result = event_loop(screen, ps.style[ps.choice], 
-		    event_cs, event_ss, g,
-		    level, 0, &curtimeleft, 1, adjustment,
-		    menu_handler, time(NULL), AI_PLAYER, NO_PLAYER, event_ai);
-	    if (result < 0) { 	/* explicit quit */
-		return -1;
-	    }
-	    /* reset board */
-	    my_adj[match] = adjustment[0];
-	}
+    draw_radio(&wrg->wr[0], 1);
+
+    while (1) {
+	int retval;
+	poll_and_flame(&event);
+	retval = handle_radio_event(wrg, &event);
+	if (retval != -1)
+	    return wrg->wr[0].data;
     }
 }
 
-
 /***************************************************************************
- *      choose_gametype()
- * User selects the desired game type, which is returned. Uses walking
- * radio menus.
- *********************************************************************PROTO*/
-int choose_gametype(piece_styles *ps, color_styles *cs,
-	sound_styles *ss, AI_Players *ai)
-{ /* walk-radio menu */
-    int i;
-
-    _local_gametype = gametype;
-
-    if (!wrg) {
-	Calloc(wrg , WalkRadioGroup * , sizeof(*wrg));
-	wrg->n = MAX_MENU_CHOICE;
-	Calloc(wrg->wr, WalkRadio *, wrg->n * sizeof(*wrg->wr));
-	wrg->cur = MainMenu;
-
-	wrg->wr[PieceStyleMenu].n = ps->num_style;
-	Malloc(wrg->wr[PieceStyleMenu].label, char**, sizeof(char*)*ps->num_style);
-	for (i=0; i<ps->num_style; i++)
-	    wrg->wr[PieceStyleMenu].label[i] = ps->style[i]->name;
-	wrg->wr[PieceStyleMenu].defaultchoice = ps->choice;
-	wrg->wr[PieceStyleMenu].action = PieceStyleMenu_action;
-
-	wrg->wr[ColorStyleMenu].n = cs->num_style;
-	Malloc(wrg->wr[ColorStyleMenu].label, char**, sizeof(char*)*cs->num_style);
-	for (i=0; i<cs->num_style; i++)
-	    wrg->wr[ColorStyleMenu].label[i] = cs->style[i]->name;
-	wrg->wr[ColorStyleMenu].defaultchoice = cs->choice;
-	wrg->wr[ColorStyleMenu].action = ColorStyleMenu_action;
+ *	new_player()
+ * Add another player ... Displays a little dialog so that the new player
+ * can enter a new name and a new level. 
+ **************************************************************************/
+static
+void new_player(SDL_Surface * screen, identity **id)
+{
+    char *new_name, *new_level;
+    int level;
+    clear_screen_to_flame();
 
-	wrg->wr[SoundStyleMenu].n = ss->num_style;
-	Malloc(wrg->wr[SoundStyleMenu].label, char**, sizeof(char*)*ss->num_style);
-	for (i=0; i<ss->num_style; i++)
-	    wrg->wr[SoundStyleMenu].label[i] = ss->style[i]->name;
-	wrg->wr[SoundStyleMenu].defaultchoice = ss->choice;
-	wrg->wr[SoundStyleMenu].action = SoundStyleMenu_action;
+    draw_string("Enter your name:", color_who_are_you, screen->w / 2,
+	    screen->h / 2, DRAW_CLEAR | DRAW_LEFT);
 
-	_ss = ss;
-	_cs = cs;
-	_ps = ps;
+    new_name = input_string(screen, screen->w/2, screen->h/2, 0);
 
-	wrg->wr[GameMenu].n = 6;
-	Malloc(wrg->wr[GameMenu].label, char**, sizeof(char*)*wrg->wr[GameMenu].n);
-	wrg->wr[GameMenu].label[0] = "Solo Normal Game";
-	wrg->wr[GameMenu].label[1] = "Solo Scoring Marathon";
-	wrg->wr[GameMenu].label[2] = "Solo vs. Computer";
-	wrg->wr[GameMenu].label[3] = "2 Players @ 1 Keyboard";
-	wrg->wr[GameMenu].label[4] = "2 Players, Use Network";
-	wrg->wr[GameMenu].label[5] = "Computer vs. Computer";
-	wrg->wr[GameMenu].defaultchoice = 0;
-	wrg->wr[GameMenu].action = GameMenu_action;
+    if (strlen(new_name)) {
+	clear_screen_to_flame();
+	draw_string("Welcome ", color_purple, screen->w/2,
+		screen->h/2, DRAW_CLEAR | DRAW_LEFT | DRAW_LARGE | DRAW_ABOVE);
+	draw_string(new_name, color_purple, screen->w/2,
+		screen->h/2, DRAW_CLEAR | DRAW_LARGE | DRAW_ABOVE);
+	draw_string("Starting level (2-10):", color_who_are_you, screen->w
+		/ 2, screen->h / 2, DRAW_CLEAR | DRAW_LEFT);
+	new_level = input_string(screen, screen->w/2, screen->h/2, 0);
+	level = 0;
+	sscanf(new_level,"%d",&level);
+	if (level < 2) level = 2;
+	if (level > 10) level = 10;
 
-	wrg->wr[OptionsMenu].n = 7;
-	Malloc(wrg->wr[OptionsMenu].label, char**, sizeof(char*)*wrg->wr[OptionsMenu].n);
-	OptionsMenu_setup();
-	wrg->wr[OptionsMenu].defaultchoice = 0;
-	wrg->wr[OptionsMenu].action = OptionsMenu_action;
+	save_identity_file(*id, new_name, level);
 
-	/* Make the main menu */
-	wrg->wr[MainMenu].n = 7;
-	Malloc(wrg->wr[MainMenu].label, char**, sizeof(char*)*wrg->wr[MainMenu].n);
-	/* Main menu displays the current value for each choice */
-	wrg->wr[MainMenu].label[0] = wrg->wr[ColorStyleMenu].label[wrg->wr[ColorStyleMenu].defaultchoice];
-	wrg->wr[MainMenu].label[1] = wrg->wr[SoundStyleMenu].label[wrg->wr[SoundStyleMenu].defaultchoice];
-	wrg->wr[MainMenu].label[2] = wrg->wr[PieceStyleMenu].label[wrg->wr[PieceStyleMenu].defaultchoice];
-	wrg->wr[MainMenu].label[3] = wrg->wr[GameMenu].label[(int)_local_gametype];
-	wrg->wr[MainMenu].label[4] = "Special Options";
-	wrg->wr[MainMenu].label[5] = "Play!";
-	wrg->wr[MainMenu].label[6] = "Quit";
-	wrg->wr[MainMenu].defaultchoice = 5;
-	wrg->wr[MainMenu].action = MainMenu_action;
+	(*id) = load_identity_file();
 
-	for (i=0; i<MAX_MENU_CHOICE; i++) {
-	    setup_radio(&wrg->wr[i]);
-	}
+	free(new_level);
+    }
+    free(new_name);
+}
 
-	wrg->wr[ColorStyleMenu].x = 2*(screen->w/3) +
-	    (screen->w/3 - wrg->wr[ColorStyleMenu].area.w)/2;
-	wrg->wr[ColorStyleMenu].y =
-	    (screen->h - wrg->wr[ColorStyleMenu].area.h)/2;
-	wrg->wr[ColorStyleMenu].inactive = TRUE;
 
-	wrg->wr[SoundStyleMenu].x = 2*(screen->w/3) +
-	    (screen->w/3 - wrg->wr[SoundStyleMenu].area.w)/2;
-	wrg->wr[SoundStyleMenu].y =
-	    (screen->h - wrg->wr[SoundStyleMenu].area.h)/2;
-	wrg->wr[SoundStyleMenu].inactive = TRUE;
+/***************************************************************************
+ *      who_are_you()
+ * Asks the player to choose an identity ...
+ * Returns -1 on "cancel". 
+ *********************************************************************PROTO*/
+int 
+who_are_you(SDL_Surface *screen, identity **id, int taken, int p)
+{
+    WalkRadioGroup *wrg = NULL;
+    int i;
+    int retval;
+    SDL_Event event;
+    char buf[1024];
 
-	wrg->wr[OptionsMenu].x = 2*(screen->w/3) +
-	    (screen->w/3 - wrg->wr[OptionsMenu].area.w)/2;
-	wrg->wr[OptionsMenu].y =
-	    (screen->h - wrg->wr[OptionsMenu].area.h)/2;
-	wrg->wr[OptionsMenu].inactive = TRUE;
+restart: 	/* sigh! */
+    wrg = create_single_wrg((*id)->n + 2);
+    for (i=0; i<(*id)->n; i++) {
+	if (i == taken)
+	    sprintf(buf,"%s (already taken!)",(*id)->p[i].name);
+	else
+	    sprintf(buf,"%s (Level %d)",(*id)->p[i].name, (*id)->p[i].level);
+	wrg->wr[0].label[i] = strdup(buf);
+    }
+    wrg->wr[0].label[(*id)->n] = "-- New Player --";
+    wrg->wr[0].label[(*id)->n+1] = "-- Cancel --";
 
-	wrg->wr[PieceStyleMenu].x = 2*(screen->w/3) +
-	    (screen->w/3 - wrg->wr[PieceStyleMenu].area.w)/2;
-	wrg->wr[PieceStyleMenu].y =
-	    (screen->h - wrg->wr[PieceStyleMenu].area.h)/2;
-	wrg->wr[PieceStyleMenu].inactive = TRUE;
+    setup_radio(&wrg->wr[0]);
+    wrg->wr[0].x = (screen->w - wrg->wr[0].area.w) / 2;
+    wrg->wr[0].y = (screen->h - wrg->wr[0].area.h) / 2;
+    wrg->wr[0].action = NULL /* return default choice */;
 
-	wrg->wr[GameMenu].x = 2*(screen->w/3) +
-	    (screen->w/3 - wrg->wr[GameMenu].area.w)/2;
-	wrg->wr[GameMenu].y =
-	    (screen->h - wrg->wr[GameMenu].area.h)/2;
-	wrg->wr[GameMenu].inactive = TRUE;
+    clear_screen_to_flame();
 
-	wrg->wr[MainMenu].x = (screen->w/3 - wrg->wr[MainMenu].area.w)/2;
-	wrg->wr[MainMenu].y = (screen->h - wrg->wr[MainMenu].area.h)/2;
-	wrg->wr[MainMenu].inactive = FALSE;
+    if (p == 1)  {
+	draw_string("Left = A  Rotate = W  Right = D  Drop = S", color_keys_explain,
+		screen->w / 2, 0, DRAW_CENTER | DRAW_UPDATE);
+	draw_string("Player 1: Who Are You?", color_who_are_you,
+		screen->w / 2, wrg->wr[0].y - 30, DRAW_CENTER | DRAW_UPDATE);
+    } else {
+	draw_string("Use the Arrow keys. Rotate = Up  Drop = Down", color_keys_explain,
+		screen->w / 2, 0, DRAW_CENTER | DRAW_UPDATE);
+	draw_string("Player 2: Who Are You?", color_who_are_you,
+		screen->w / 2, wrg->wr[0].y - 30, DRAW_CENTER | DRAW_UPDATE);
     }
 
-    clear_screen_to_flame();
-    SDL_EnableKeyRepeat(SDL_DEFAULT_REPEAT_DELAY*10,
-	    SDL_DEFAULT_REPEAT_INTERVAL*10);
+    draw_radio(&wrg->wr[0], 1);
 
-    start_playing = 0;
     while (1) {
-	Grid g[2];
-	gametype = DEMO;
-	play_MENU(*cs, *ps, *ss, g, Options.faster_levels ? 5 : 10, 
-		&ai->player[ZEROTO(ai->n)]);
-	if (start_playing) {
-	    return 0;
+	poll_and_flame(&event);
+
+	retval = handle_radio_event(wrg, &event);
+	if (retval == -1 || retval == taken)
+	    continue;
+	if (retval == (*id)->n) {
+	    new_player(screen, id);
+	    goto restart;
 	}
+	if (retval == (*id)->n+1)
+	    return -1;
+	return retval;
     }
+    return 0;
 }
 
 /*
- * $Log: gamemenu.c,v $
- * Revision 1.30  2001/01/06 00:25:23  weimer
- * changes so that we remember things ...
- *
- * Revision 1.29  2001/01/05 21:38:01  weimer
- * more key changes
- *
- * Revision 1.28  2001/01/05 21:12:32  weimer
- * advance to atris 1.0.5, add support for ".atrisrc" and changing the
- * keyboard repeat rate
- *
- * Revision 1.27  2000/11/10 18:16:48  weimer
- * changes for Atris 1.0.4 - three new special options
- *
- * Revision 1.26  2000/11/06 04:16:10  weimer
- * "power pieces" plus images
- *
- * Revision 1.25  2000/11/06 04:06:44  weimer
- * option menu
- *
- * Revision 1.24  2000/11/06 01:24:43  wkiri
- * Removed 'quit' from the game type menu.
- *
- * Revision 1.23  2000/11/06 01:22:40  wkiri
- * Updated menu system.
+ * $Log: identity.c,v $
+ * Revision 1.16  2000/11/06 04:44:15  weimer
+ * fixed that who-is-the-server thing
  *
- * Revision 1.22  2000/11/02 03:06:20  weimer
+ * Revision 1.15  2000/11/02 03:06:20  weimer
  * better interface for walk-radio menus: we are now ready for Kiri to change
  * them to add run-time options ...
  *
- * Revision 1.21  2000/11/01 03:53:06  weimer
+ * Revision 1.14  2000/11/01 03:53:06  weimer
  * modifications for version 1.0.1: you can pick your starting level, you can
  * pick the AI difficulty factor, the game is better about placing new pieces
  * when there is garbage, when things fall out of your control they now fall
  * at a uniform rate ...
  *
- * Revision 1.20  2000/10/29 22:55:01  weimer
- * networking consistency checks (you must have the same number of doodads):
- * special hotkey 'f' in main menu toggles full screen mode
- * added depth specification on the command line
- * automatically search for the darkest non-black color ...
+ * Revision 1.13  2000/10/29 21:28:58  weimer
+ * fixed a few failures to clear the screen if we didn't have a flaming
+ * backdrop
  *
- * Revision 1.19  2000/10/29 21:23:28  weimer
+ * Revision 1.12  2000/10/29 21:23:28  weimer
  * One last round of header-file changes to reflect my newest and greatest
  * knowledge of autoconf/automake. Now if you fail to have some bizarro
  * function, we try to go on anyway unless it is vastly needed.
  *
- * Revision 1.18  2000/10/29 17:23:13  weimer
- * incorporate "xflame" flaming background for added spiffiness ...
+ * Revision 1.11  2000/10/29 19:04:33  weimer
+ * minor highscore handling changes: new filename, use the draw_string() and
+ * draw_bordered_rect() and input_string() interfaces, handle the widget layer
+ * and the flame layer, etc. Also fix a minor bug where you would be prevented
+ * from settling if you pressed a key even if it didn't really move you. :-)
  *
- * Revision 1.17  2000/10/29 00:17:39  weimer
- * added support for a system independent random number generator
+ * Revision 1.10  2000/10/29 17:23:13  weimer
+ * incorporate "xflame" flaming background for added spiffiness ...
  *
- * Revision 1.16  2000/10/28 21:52:56  weimer
- * you can now press 'Q' to quit from the main menu!
+ * Revision 1.9  2000/10/28 22:33:18  weimer
+ * add a blinking cursor to the input string widget
  *
- * Revision 1.15  2000/10/28 16:40:17  weimer
+ * Revision 1.8  2000/10/28 16:40:17  weimer
  * Further changes: we can now build .tar.gz files and RPMs!
  *
- * Revision 1.14  2000/10/22 22:05:51  weimer
- * Added a few new sounds ...
- *
- * Revision 1.13  2000/10/21 01:14:42  weimer
+ * Revision 1.7  2000/10/21 01:14:43  weimer
  * massic autoconf/automake restructure ...
  *
- * Revision 1.12  2000/10/18 23:57:49  weimer
+ * Revision 1.6  2000/10/18 23:57:49  weimer
  * general fixup, color changes, display changes.
  * Notable: "Safe" Blits and Updates now perform "clipping". No more X errors,
  * we hope!
  *
- * Revision 1.11  2000/10/18 02:04:02  weimer
+ * Revision 1.5  2000/10/18 02:04:02  weimer
  * playability changes ...
  *
- * Revision 1.10  2000/10/13 15:41:53  weimer
+ * Revision 1.4  2000/10/14 01:56:35  weimer
+ * remove dates from identity files
+ *
+ * Revision 1.3  2000/10/13 15:41:53  weimer
  * revamped AI support, now you can pick your AI and have AI duels (such fun!)
  * the mighty Aliz AI still crashes a bit, though ... :-)
  *
- * Revision 1.9  2000/10/12 22:21:25  weimer
- * display changes, more multi-local-play threading (e.g., myScore ->
- * Score[0]), that sort of thing ...
- *
- * Revision 1.8  2000/10/12 19:17:08  weimer
- * Further support for AI players and multiple game types.
+ * Revision 1.2  2000/10/13 02:26:54  weimer
+ * rudimentary identity functions, including adding new players
  *
- * Revision 1.7  2000/10/12 01:38:07  weimer
+ * Revision 1.1  2000/10/12 01:38:07  weimer
  * added initial support for persistent player identities
  *
- * Revision 1.6  2000/10/12 00:49:08  weimer
- * added "AI" support and walking radio menus for initial game configuration
- *
- * Revision 1.5  2000/09/09 17:05:35  wkiri
- * Hideous log changes (Wes: how dare you include a comment character!)
- *
- * Revision 1.4  2000/09/09 16:58:27  weimer
- * Sweeping Change of Ultimate Mastery. Main loop restructuring to clean up
- * main(), isolate the behavior of the three game types. Move graphic files
- * into graphics/-, style files into styles/-, remove some unused files,
- * add game flow support (breaks between games, remembering your level within
- * this game), multiplayer support for the event loop, some global variable
- * cleanup. All that and a bag of chips!
- *
- * Revision 1.3  2000/09/04 22:49:51  wkiri
- * gamemenu now uses the new nifty menus.  Also, added delete_menu.
- *
- * Revision 1.2  2000/09/04 19:48:02  weimer
- * interim menu for choosing among game styles, button changes (two states)
- *
- * Revision 1.1  2000/09/03 19:41:30  wkiri
- * Now allows you to choose the game type (though it doesn't do anything yet).
- *
  */
 
 /***************************************************************************
- *      cleanup_grid()
- * Removes all of the REMOVE_ME's in a grid. Normally one uses draw_grid
- * for this purpose, but you might have a personal testing grid or
- * something that you're not displaying.
- *********************************************************************PROTO*/
-void
-cleanup_grid(Grid *g)
-{
-    int x,y;
-    for (y=g->h-1;y>=0;y--) 
-	for (x=g->w-1;x>=0;x--) 
-	    if (GRID_CONTENT(*g,x,y) == REMOVE_ME)
-		GRID_SET(*g,x,y,0);
-}
-
-/***************************************************************************
- *      generate_board()
- * Creates a new board at the given level.
+ *      menu()
+ * Create a new menu and return it.
  *********************************************************************PROTO*/
-Grid
-generate_board(int w, int h, int level)
+ATMenu* menu(int nButtons, char** strings, int defaultchoice,
+	     Uint32 face_color0, Uint32 text_color0,
+	     Uint32 face_color1, Uint32 text_color1, int x, int y)
 {
-    int i,j,r;
-
-    Grid retval;
-
-    retval.w = w;
-    retval.h = h;
-
-    Calloc(retval.contents,unsigned char *,(w*h*sizeof(*retval.contents)));
-    Calloc(retval.fall,unsigned char *,(w*h*sizeof(*retval.fall)));
-    Calloc(retval.changed,unsigned char *,(w*h*sizeof(*retval.changed)));
-    Calloc(retval.temp,unsigned char *,(w*h*sizeof(*retval.temp)));
-
-    if (level) {
-	int start_garbage;
-	level = GARBAGE_LEVEL(level);
-	start_garbage = (h-level) - 2;
+  int i, yp;
+  ATMenu* am = (ATMenu*)malloc(sizeof(ATMenu)); assert(am);
 
-	if (start_garbage < 2) start_garbage = 2;
-	else if (start_garbage >= h) start_garbage = h - 1;
+  /* Create the buttons */
+  am->buttons = (ATButton**)malloc(nButtons*sizeof(ATButton*)); 
+  assert(am->buttons);
+  am->clicked = (char*)malloc(nButtons*sizeof(char)); assert(am->clicked);
+  am->nButtons = nButtons;
+  am->x = x; am->y = y;
+  am->defaultchoice = defaultchoice;
 
-	for (j=start_garbage;j<h;j++)
-	    for (r=0;r<w/2;r++) {
-		do {
-		    i = ZEROTO(w);
-		} while (GRID_CONTENT(retval,i,j) == 1);
-		GRID_SET(retval,i,j,1);
-	    }
-    }
-    return retval;
-}
+  yp = y;
 
-/***************************************************************************
- *      add_garbage()
- * Adds garbage to the given board. Pushes all of the lines up, adds the
- * garbage to the bottom.
- *********************************************************************PROTO*/
-void
-add_garbage(Grid *g)
-{
-    int i,j;
-    for (j=0;j<g->h-1;j++)
-	for (i=0;i<g->w;i++) {
-	    GRID_SET(*g,i,j, GRID_CONTENT(*g,i,j+1));
-	    FALL_SET(*g,i,j, NOT_FALLING);
-	    if (GRID_CONTENT(*g,i,j) == 0)
-		GRID_SET(*g,i,j,REMOVE_ME);
-	    GRID_CHANGED(*g,i,j) = 1;
-	}
+  Assert(nButtons >= 0);
 
-    j = g->h - 1;
-    for (i=0; i<g->w; i++) {
-	    if (ZEROTO(100) < 50) {
-		GRID_SET(*g,i,j,1);
-		if (GRID_CONTENT(*g,i,j-1) &&
-			GRID_CONTENT(*g,i,j-1) != REMOVE_ME)
-		    GRID_SET(*g,i,j-1,1);
-	    } else {
-		GRID_SET(*g,i,j,REMOVE_ME);
-	    }
-	    FALL_SET(*g,i,j, NOT_FALLING);
-	    GRID_CHANGED(*g,i,j) = 1;
+  for (i=0; i<nButtons; i++)
+    {
+      /* Line them up x-wise */
+      am->buttons[i] = button(strings[i], face_color0, text_color0,
+			      face_color1, text_color1, x, yp);
+      yp += am->buttons[i]->area.h; /* add a separating space? */
+      am->clicked[i] = FALSE;
     }
 
-    for (j=0;j<g->h;j++)
-	for (i=0;i<g->w;i++) {
-	    Assert(GRID_CHANGED(*g,i,j));
-	    Assert(FALL_CONTENT(*g,i,j) == NOT_FALLING);
-	}
+  am->w = am->buttons[0]->area.w;
+  am->h = (am->buttons[nButtons-1]->area.y - am->buttons[0]->area.y)
+    + am->buttons[nButtons-1]->area.h;
+  /* Set the default one */
+  if (defaultchoice >= 0) am->clicked[defaultchoice] = TRUE;
 
-    return;
+  return am;
 }
 
 /***************************************************************************
- *      draw_grid()
- * Draws the main grid board. This involves drawing all of the pieces (and
- * garbage) currently pasted on to it. This is the function that actually
- * clears out grid pieces marked with "REMOVE_ME". The main bit of work
- * here is calculating the shadows. 
- *
- * Uses the color style to actually draw the right picture on the screen.
+ *      show_menu()
+ * Displays the menu.
  *********************************************************************PROTO*/
-void
-draw_grid(SDL_Surface *screen, color_style *cs, Grid *g, int draw)
+void show_menu(ATMenu* am)
 {
-    SDL_Rect r,s;
-    int i,j;
-    int mini=20, minj=20, maxi=-1, maxj=-1;
-    for (j=g->h-1;j>=0;j--) {
-	for (i=g->w-1;i>=0;i--) {
-	    int c = GRID_CONTENT(*g,i,j);
-	    if (draw && c && c != REMOVE_ME && GRID_CHANGED(*g,i,j)) {
-		if (i < mini) mini = i; if (j < minj) minj = j;
-		if (i > maxi) maxi = i; if (j > maxj) maxj = j;
-		
-
-		s.x = g->board.x + (i * cs->w);
-		s.y = g->board.y + (j * cs->h);
-		s.w = cs->w;
-		s.h = cs->h;
-
-		SDL_BlitSafe(cs->color[c], NULL, screen, &s);
+  int i;
+  for (i=0; i<am->nButtons; i++)
+    show_button(am->buttons[i], am->clicked[i]);
+}
 
+/***************************************************************************
+ *      check_menu()
+ * Returns the index of the button that was clicked (-1 if none).
+ *********************************************************************PROTO*/
+int check_menu(ATMenu* am, int x, int y)
+{
+  int i, j;
+  for (i=0; i<am->nButtons; i++)
+    if (check_button(am->buttons[i], x, y)) 
+      {
+	/* invert its clicked state */
+	if (am->clicked[i])
+	  {
+	    am->clicked[i] = FALSE;
+	    /* reset the default */
+	    am->clicked[am->defaultchoice] = TRUE;
+	    show_button(am->buttons[am->defaultchoice],
+			am->clicked[am->defaultchoice]);
+	  }
+	else
+	  {
+	    /* blank all others */
+	    for (j=0; j<am->nButtons; j++)
+	      if (i!=j && am->clicked[j])
 		{
-		    int fall = FALL_CONTENT(*g,i,j);
-
-		    int that_precolor = (j == 0) ? 0 : 
-			GRID_CONTENT(*g,i,j-1);
-		    int that_fall = (j == 0) ? -1 :
-			FALL_CONTENT(*g,i,j-1);
-		    /* light up */
-		    if (that_precolor != c || that_fall != fall) {
-			r.x = g->board.x + i * cs->w;
-			r.y = g->board.y + j * cs->h;
-			r.h = edge[HORIZ_LIGHT]->h;
-			r.w = edge[HORIZ_LIGHT]->w;
-			SDL_BlitSafe(edge[HORIZ_LIGHT],NULL,
-				    screen, &r);
-		    }
-
-		    /* light left */
-		    that_precolor = (i == 0) ? 0 :
-			GRID_CONTENT(*g,i-1,j);
-		    that_fall = (i == 0) ? -1 :
-			FALL_CONTENT(*g,i-1,j);
-		    if (that_precolor != c || that_fall != fall) {
-			r.x = g->board.x + i * cs->w;
-			r.y = g->board.y + j * cs->h;
-			r.h = edge[VERT_LIGHT]->h;
-			r.w = edge[VERT_LIGHT]->w;
-			SDL_BlitSafe(edge[VERT_LIGHT],NULL,
-				    screen,&r);
-		    }
-		    
-		    /* shadow down */
-		    that_precolor = (j == g->h-1) ? 0 :
-			GRID_CONTENT(*g,i,j+1);
-		    that_fall = (j == g->h-1) ? -1 :
-			FALL_CONTENT(*g,i,j+1);
-		    if (that_precolor != c || that_fall != fall) {
-			r.x = g->board.x + i * cs->w;
-			r.y = (g->board.y + (j+1) * cs->h) 
-			    - edge[HORIZ_DARK]->h;
-			r.h = edge[HORIZ_DARK]->h;
-			r.w = edge[HORIZ_DARK]->w;
-			SDL_BlitSafe(edge[HORIZ_DARK],NULL,
-				    screen,&r);
-		    }
-
-		    /* shadow right */
-		    that_precolor = (i == g->w-1) ? 0 :
-			GRID_CONTENT(*g,i+1,j);
-		    that_fall = (i == g->w-1) ? -1 :
-			FALL_CONTENT(*g,i+1,j);
-		    if (that_precolor != c || that_fall != fall) {
-			r.x = (g->board.x + (i+1) * cs->w) 
-			    - edge[VERT_DARK]->w;
-			r.y = (g->board.y + (j) * cs->h);
-			r.h = edge[VERT_DARK]->h;
-			r.w = edge[VERT_DARK]->w;
-			SDL_BlitSafe(edge[VERT_DARK],NULL,
-				    screen,&r);
-		    }
-		} /* endof: hikari to kage */
-		/* SDL_UpdateSafe(screen, 1, &s); */
-		GRID_CHANGED(*g,i,j) = 0;
-	    } else if (c == REMOVE_ME) {
-		if (i < mini) mini = i; if (j < minj) minj = j;
-		if (i > maxi) maxi = i; if (j > maxj) maxj = j;
-		if (draw) { 
-		    s.x = g->board.x + (i * cs->w);
-		    s.y = g->board.y + (j * cs->h);
-		    s.w = cs->w;
-		    s.h = cs->h;
-		    SDL_FillRect(screen, &s, int_solid_black);
-		    GRID_SET(*g,i,j,0);
-		    GRID_CHANGED(*g,i,j) = 0;
-		} else {
-		    GRID_SET(*g,i,j,0);
+		  am->clicked[j] = FALSE;
+		  show_button(am->buttons[j], am->clicked[j]);
 		}
-	    }
-	}
-    }
-    s.x = g->board.x + mini * cs->w;
-    s.y = g->board.y + minj * cs->h;
-    s.w = (maxi - mini + 1) * cs->w;
-    s.h = (maxj - minj + 1) * cs->h;
-    if (draw && maxi >  -1) SDL_UpdateSafe(screen,1,&s);
-    return;
+	    am->clicked[i] = TRUE;
+	  }
+	/* redraw it */
+	show_button(am->buttons[i], am->clicked[i]);
+	Debug("Button %d was clicked.\n", i);
+	return i;
+      }
+  return -1;
 }
 
 /***************************************************************************
- *      draw_falling()
- * Draws the falling pieces on the main grid. Offset should range from 1 to
- * the size of the color tiles -- the falling pieces are drawn that far
- * down out of their "real" places. This gives a smooth animation effect.
+ *      delete_menu()
+ * Deletes the menu and all of its buttons.
  *********************************************************************PROTO*/
-void
-draw_falling(SDL_Surface *screen, int blockWidth, Grid *g, int offset)
+void delete_menu(ATMenu* am)
 {
-    SDL_Rect s;
-    SDL_Rect r;  
-    int i,j;
-    int mini=100000, minj=100000, maxi=-1, maxj=-1;
-
-    int cj;	/* cluster right, cluster bottom */
+  int i;
+  for (i=0; i<am->nButtons; i++)
+    Free(am->buttons[i]);
+  Free(am);
+}
 
-    memset(g->temp, 0, sizeof(*g->temp)*g->w*g->h);
+#define BORDER_X	8
+#define BORDER_Y	8
+#define BUTTON_X_SPACE	4
+#define RADIO_HEIGHT	12
 
-    for (j=0;j<g->h;j++) {
-	for (i=0;i<g->w;i++) {
-	    int c = GRID_CONTENT(*g,i,j);
-	    if (c && FALL_CONTENT(*g,i,j) == FALLING &&
-		    TEMP_CONTENT(*g,i,j) == 0) {
+/***************************************************************************
+ *      setup_radio()
+ * Prepared a WalkRadio button for display.
+ *********************************************************************PROTO*/
+void
+setup_radio(WalkRadio *wr)
+{
+    int i;
+    int our_height;
 
-		for (cj = j; GRID_CONTENT(*g,i,cj) &&
-			FALL_CONTENT(*g,i,cj) &&
-			TEMP_CONTENT(*g,i,cj) == 0 &&
-			cj < g->h; cj++)
-		    TEMP_CONTENT(*g,i,cj) = 1;
+    wr->face_color[0] = int_button_face0;
+    wr->face_color[1] = int_button_face1;
+    wr->text_color[0] = int_button_text0;
+    wr->text_color[1] = int_button_text1;
+    wr->border_color[0] = int_button_border0;
+    wr->border_color[1] = int_button_border1;
 
-		/* source == up */
-		s.x = g->board.x + (i * blockWidth);
-		s.y = g->board.y + (j * blockWidth) + offset - 1;
-		s.w = blockWidth;
-		s.h = blockWidth * (cj - j + 1); 
+    wr->bitmap0 = malloc(sizeof(SDL_Surface *) * wr->n); Assert(wr->bitmap0);
+    wr->bitmap1 = malloc(sizeof(SDL_Surface *) * wr->n); Assert(wr->bitmap1);
+    wr->w = 0;
+    wr->h = 0;
 
-		/* dest == down */
-		r.x = g->board.x + (i * blockWidth);
-		r.y = g->board.y + (j * blockWidth) + offset;
-		r.w = blockWidth;
-		r.h = blockWidth * (cj - j + 1); 
+    for (i=0; i<wr->n; i++) {
+	SDL_Color sc;
 
-		/* just blit the screen down a notch */
-		SDL_BlitSafe(screen, &s, screen, &r);
+	SDL_GetRGB(wr->text_color[0], screen->format, &sc.r, &sc.g, &sc.b);
+	wr->bitmap0[i] = TTF_RenderText_Blended(sfont, wr->label[i], sc);
+	Assert(wr->bitmap0[i]);
 
-		if (s.x < mini) mini = s.x; 
-		if (s.y < minj) minj = s.y;
-		if (s.x+s.w > maxi) maxi = s.x+s.w; 
-		if (s.y+s.h > maxj) maxj = s.y+s.h;
+	SDL_GetRGB(wr->text_color[1], screen->format, &sc.r, &sc.g, &sc.b);
+	wr->bitmap1[i] = TTF_RenderText_Blended(sfont, wr->label[i], sc);
+	Assert(wr->bitmap1[i]);
 
-		/* clear! */
-		if (j == 0 || FALL_CONTENT(*g,i,j-1) == NOT_FALLING ||
-			GRID_CONTENT(*g,i,j-1) == 0) {
-		    s.h = 1;
-		    SDL_BlitSafe(widget_layer, &s, screen, &s);
-		    /*  SDL_UpdateSafe(screen, 1, &s); */
-		}
-	    }
-	}
+	if (wr->bitmap0[i]->w + BUTTON_X_SPACE > wr->w) 
+	    wr->w = wr->bitmap0[i]->w + BUTTON_X_SPACE;
+	if (wr->bitmap0[i]->h > wr->h) wr->h = wr->bitmap0[i]->h;
     }
+    wr->w += 5 ;
+    wr->h += 10 ;
+    wr->area.w = wr->w + BORDER_X;
 
-    s.x = mini;
-    s.y = minj;
-    s.w = maxi - mini + 1;
-    s.h = maxj - minj + 1;
-    if (maxi >  -1) SDL_UpdateSafe(screen,1,&s);
+    our_height = RADIO_HEIGHT;
+    if (wr->n < our_height) our_height = wr->n;
+
+    wr->area.h = wr->h * our_height + BORDER_Y;
     return;
 }
 
 /***************************************************************************
- *      fall_down()
- * Move all of the fallen pieces down a notch.
+ *      check_radio()
+ * Determines if we have clicked in a radio button.
  *********************************************************************PROTO*/
-void
-fall_down(Grid *g)
+int
+check_radio(WalkRadio *wr, int x, int y)
 {
-    int x,y;
-    for (y=g->h-1;y>=1;y--) {
-	for (x=0;x<g->w;x++) {
-	    if (FALL_CONTENT(*g,x,y-1) == FALLING &&
-		     GRID_CONTENT(*g,x,y-1)) {
-		Assert(GRID_CONTENT(*g,x,y) == 0 || 
-		       GRID_CONTENT(*g,x,y) == REMOVE_ME);
-		GRID_SET(*g,x,y, GRID_CONTENT(*g,x,y-1));
-		GRID_SET(*g,x,y-1,REMOVE_ME);
-		FALL_SET(*g,x,y, FALLING);
-		/* FALL_SET(*g,x,y-1,UNKNOWN); */
+    if (wr->inactive) return 0;
+
+    if (    x  >= wr->area.x &&
+	    x  <= wr->area.x + wr->area.w &&
+	    y  >= wr->area.y &&
+	    y  <= wr->area.y + wr->area.h   ) {
+	int start, stop;
+	int c;
+
+	if (wr->n < RADIO_HEIGHT) {	/* draw them all */
+	    start = 0;
+	    stop = wr->n;
+	} else {		/* at least four */
+	    start = wr->defaultchoice - (RADIO_HEIGHT/2);
+	    if (start < 0) start = 0;
+	    stop = start + RADIO_HEIGHT;
+	    if (stop > wr->n) {	/* we're at the bottom */
+		start -= (stop - wr->n);
+		stop = wr->n;
 	    }
 	}
+	c = (y - wr->area.y) / wr->h;
+	c += start;
+	if (c < 0) c = 0;
+	if (c >= wr->n) c = wr->n - 1;
+	wr->defaultchoice = c;
+	return 1;
     }
-    return;
+    return 0;
 }
 
 /***************************************************************************
- *      determine_falling()
- * Determines if anything can fall.
+ *      clear_radio()
+ * Clears away a WalkRadio button. Works even if I am inactive. 
  *********************************************************************PROTO*/
-int
-determine_falling(Grid *g)
+void
+clear_radio(WalkRadio *wr)
 {
-    int x,y;
-#ifdef DEBUG
-    {
-	int retval=0;
-    for (y=0;y<g->h;y++) {
-	for (x=0;x<g->w;x++) {
-	    if (GRID_CONTENT(*g,x,y) && FALL_CONTENT(*g,x,y) == FALLING) {
-		printf("X");
-		retval= 1;
-	    } else printf(".");
-	}
-	printf("\n");
-    }
-    printf("--\n");
-    return retval;
-    }
-#else
-    for (y=0;y<g->h;y++) 
-	for (x=0;x<g->w;x++) 
-	    if (GRID_CONTENT(*g,x,y) && FALL_CONTENT(*g,x,y) == FALLING) 
-		return 1;
-    return 0;
-#endif
+    SDL_FillRect(widget_layer, &wr->area, int_black);
+    SDL_FillRect(screen, &wr->area, int_black);
+    SDL_BlitSurface(flame_layer, &wr->area, screen, &wr->area);
+    SDL_BlitSurface(widget_layer, &wr->area, screen, &wr->area);
+    SDL_UpdateSafe(screen, 1, &wr->area);
+    return; 
 }
 
 /***************************************************************************
- *      run_gravity()
- * Applies gravity: pieces with no support change to "FALLING". After this,
- * "determine_falling" can be used to determine if anything should be
- * falling.
- *
- * Returns 1 if any pieces that were FALLING settled down.
+ *      draw_radio()
+ * Draws a WalkRadio button.
  *
- * This is the Mark II iterative version. Heavy-sigh!
+ * Only draws me if I am not inactive. 
  *********************************************************************PROTO*/
-int
-run_gravity(Grid *g)
+void
+draw_radio(WalkRadio *wr, int state)
 {
-    int falling_pieces_settled;
-    int x,y,c,f, X,Y, YY;
-    int S; 
-    int lowest_y = 0;
-    int garbage_on_row[21] ;	/* FIXME! */
-    /*   6.68      5.20     0.38    16769     0.02     0.02  run_gravity */
+    int start, stop, i;
+    SDL_Rect draw;
+    
+    if (wr->inactive) return;
 
-    char UP_QUEUE[2000], UP_POS=0;
+    wr->area.x = wr->x;
+    wr->area.y = wr->y;
 
-#define UP_X(P) UP_QUEUE[(P)*3]
-#define UP_Y(P) UP_QUEUE[(P)*3 + 1]
-#define UP_S(P) UP_QUEUE[(P)*3 + 2]
+    SDL_FillRect(widget_layer, &wr->area, wr->border_color[state]);
 
-    falling_pieces_settled = 0;
-    for (y=0; y<g->h; y++) {
-	garbage_on_row[y] = 0;
-	for (x=0;x<g->w;x++) {
-	    int c = GRID_CONTENT(*g,x,y);
-	    if (!lowest_y && c)
-		lowest_y = y;
-	    if (c == 1)
-		garbage_on_row[y] = 1;
-	    if (FALL_CONTENT(*g,x,y) == NOT_FALLING)
-		FALL_SET(*g,x,y,UNKNOWN);
+    if (wr->n < RADIO_HEIGHT) {	/* draw them all */
+	start = 0;
+	stop = wr->n;
+    } else {		/* at least four */
+	start = wr->defaultchoice - (RADIO_HEIGHT/2);
+	if (start < 0) start = 0;
+	stop = start + RADIO_HEIGHT;
+	if (stop > wr->n) {	/* we're at the bottom */
+	    start -= (stop - wr->n);
+	    stop = wr->n;
 	}
     }
-    garbage_on_row[20] = 1;
 
-    for (y=g->h-1;y>=lowest_y;y--)
-	for (x=0;x<g->w;x++) {
-	    c = GRID_CONTENT(*g,x,y);
-	    if (!c) continue;
-	    else if (c != 1 && y < g->h-1) continue;
-	    else if (c == 1 && !garbage_on_row[y+1]) {
-		/* if we do not set this, garbage from above us will appear
-		 * to be supported and it will reach down and support us!
-		 * scary! */
-		garbage_on_row[y] = 0;
-		continue;
-	    }
-	    f = FALL_CONTENT(*g,x,y);
-	    if (f == NOT_FALLING) continue;
-	    else if (f == FALLING) {
-		falling_pieces_settled = 1;
-	    }
+    draw.x = wr->x + BORDER_X/2;
+    draw.y = wr->y + BORDER_Y/2;
+    draw.w = wr->w; 
+    draw.h = wr->h;
+    
+    for (i=start; i<stop; i++) {
+	int on = (wr->defaultchoice == i);
+	SDL_Rect text;
 
-	    /* now, run up as far as we can ... */
-	    if (y >= 1) {
-		Y = y;
-		while ((c = GRID_CONTENT(*g,x,Y)) && 
-			FALL_CONTENT(*g,x,Y) != NOT_FALLING) {
-		    /* mark stable */
-		    f = FALL_CONTENT(*g,x,Y);
-		    if (f == FALLING) {
-			falling_pieces_settled = 1;
-		    }
-		    FALL_SET(*g,x,Y,NOT_FALLING);
-		    /* promise to get to our same-color buddies later */
-		    if (x >= 1 && GRID_CONTENT(*g,x-1,Y) == c &&
-			    FALL_CONTENT(*g,x-1,Y) != NOT_FALLING) {
-			UP_X(UP_POS) = x-1 ; UP_Y(UP_POS) = Y; 
-			UP_S(UP_POS) = (f == FALLING || c == 1); UP_POS++;
-		    }
-		    if (x < g->w-1 && GRID_CONTENT(*g,x+1,Y) == c &&
-			    FALL_CONTENT(*g,x+1,Y) != NOT_FALLING) {
-			UP_X(UP_POS) = x+1 ; UP_Y(UP_POS) = Y; 
-			UP_S(UP_POS) = (f == FALLING || c == 1); UP_POS++;
-		    }
-		    if (Y < g->h-1 && GRID_CONTENT(*g,x,Y+1) == c &&
-			    FALL_CONTENT(*g,x,Y+1) != NOT_FALLING) {
-			UP_X(UP_POS) = x ; UP_Y(UP_POS) = Y+1; 
-			UP_S(UP_POS) = (f == FALLING || c == 1); UP_POS++;
-		    }
-		    Y--;
-		}
-	    } else {
-		/* Debug("2 (%2d,%2d)\n",x,y); */
-		FALL_SET(*g,x,y,NOT_FALLING);
-	    }
-	    
-	    /* now burn down the queue */
-	    while (UP_POS > 0) {
-		UP_POS--;
-		X = UP_X(UP_POS);
-		Y = UP_Y(UP_POS);
-		S = UP_S(UP_POS);
-		c = GRID_CONTENT(*g,X,Y);
-		Assert(c);
-		f = FALL_CONTENT(*g,X,Y);
-		if (f == NOT_FALLING) continue;
-		else if (f == FALLING && !S) continue;
+	SDL_FillRect(widget_layer, &draw, wr->text_color[on]);
+	draw.x += 2; draw.y += 2; draw.w -= 4; draw.h -= 4;
+	if (state || on) 
+	    SDL_FillRect(widget_layer, &draw, wr->face_color[on]);
+	else 
+	    SDL_FillRect(widget_layer, &draw, wr->border_color[on]);
+	draw.x += 3; draw.y += 3; draw.w -= 6; draw.h -= 6;
 
-		if (Y >= 1) {
-		    YY = Y;
-		    while ((c = GRID_CONTENT(*g,X,YY)) && 
-			    FALL_CONTENT(*g,X,YY) != NOT_FALLING) {
-			/* mark stable */
-			f = FALL_CONTENT(*g,X,YY);
-			if (f == FALLING) falling_pieces_settled = 1;
-			FALL_SET(*g,X,YY,NOT_FALLING);
-			/* promise to get to our same-color buddies later */
-			if (X >= 1 && GRID_CONTENT(*g,X-1,YY) == c &&
-				FALL_CONTENT(*g,X-1,YY) != NOT_FALLING) {
-			    UP_X(UP_POS) = X-1 ; UP_Y(UP_POS) = YY; 
-			    UP_S(UP_POS) = (f == FALLING || c == 1); UP_POS++;
-			}
-			if (X < g->w-1 && GRID_CONTENT(*g,X+1,YY) == c &&
-				FALL_CONTENT(*g,X+1,YY) != NOT_FALLING) {
-			    UP_X(UP_POS) = X+1 ; UP_Y(UP_POS) = YY; 
-			    UP_S(UP_POS) = (f == FALLING || c == 1); UP_POS++;
-			}
-			if (YY < g->h-1 && GRID_CONTENT(*g,X,YY+1) == c &&
-				FALL_CONTENT(*g,X,YY+1) != NOT_FALLING) {
-			    UP_X(UP_POS) = X ; UP_Y(UP_POS) = YY+1; 
-			    UP_S(UP_POS) = (f == FALLING || c == 1); UP_POS++;
-			}
-			YY--;
-		    }
-		} else {
-		    FALL_SET(*g,X,Y,NOT_FALLING);
+	text.x = draw.x; text.y = draw.y;
+	text.w = wr->bitmap0[i]->w;
+	text.h = wr->bitmap0[i]->h;
+	text.x += (draw.w - text.w) / 2;
+
+	if (on) {
+	    SDL_BlitSafe(wr->bitmap1[i], NULL, widget_layer, &text);
+	} else {
+	    SDL_BlitSafe(wr->bitmap0[i], NULL, widget_layer, &text);
+	}
+	draw.x -= 5; draw.y -= 5; draw.w += 10; draw.h += 10;
+
+	draw.y += draw.h; /* move down! */
+    }
+
+    SDL_BlitSurface(flame_layer, &wr->area, screen, &wr->area);
+    SDL_BlitSurface(widget_layer, &wr->area, screen, &wr->area);
+    SDL_UpdateSafe(screen, 1, &wr->area);
+}
+
+/***************************************************************************
+ *      create_single_wrg()
+ * Creates a walk-radio-group with a single walk-radio button with N
+ * choices. 
+ *********************************************************************PROTO*/
+WalkRadioGroup *
+create_single_wrg(int n)
+{
+    WalkRadioGroup *wrg;
+
+    Calloc(wrg, WalkRadioGroup *, 1 * sizeof(*wrg));
+    wrg->n = 1;
+    Calloc(wrg->wr, WalkRadio *, wrg->n * sizeof(*wrg->wr));
+    wrg->wr[0].n = n;
+    Calloc(wrg->wr[0].label, char **, wrg->wr[0].n * sizeof(*wrg->wr[0].label));
+    return wrg;
+}
+
+/***************************************************************************
+ *      handle_radio_event()
+ * Tries to handle the given event with respect to the given set of
+ * WalkRadio's. Returns non-zero if an action said that we are done.
+ *********************************************************************PROTO*/
+int
+handle_radio_event(WalkRadioGroup *wrg, const SDL_Event *ev)
+{
+    int i, ret;
+    if (ev->type == SDL_MOUSEBUTTONDOWN) {
+	for (i=0; i<wrg->n; i++) {
+	    if (check_radio(&wrg->wr[i], ev->button.x, ev->button.y)) {
+		if (i != wrg->cur) {
+		    draw_radio(&wrg->wr[wrg->cur], 0);
 		}
+		draw_radio(&wrg->wr[i], 1);
+		if (wrg->wr[i].action) {
+		    ret = wrg->wr[i].action(&wrg->wr[i]);
+		    return ret;
+		} else
+		    return wrg->wr[i].defaultchoice;
 	    }
 	}
-	    
-    for (y=g->h-1;y>=0;y--) 
-	for (x=0;x<g->w;x++) 
-	    if (FALL_CONTENT(*g,x,y) == UNKNOWN)
-		FALL_CONTENT(*g,x,y) = FALLING;
+    } else if (ev->type == SDL_KEYDOWN) {
+	switch (ev->key.keysym.sym) {
+	    case SDLK_RETURN:
+		if (wrg->wr[wrg->cur].action) {
+		    ret = wrg->wr[wrg->cur].action(&wrg->wr[wrg->cur]);
+		    return ret;
+		} else
+		    return wrg->wr[wrg->cur].defaultchoice;
+		return 1;
 
-    return falling_pieces_settled;
-}
+	    case SDLK_UP:
+		wrg->wr[wrg->cur].defaultchoice --;
+		if (wrg->wr[wrg->cur].defaultchoice < 0)
+		    wrg->wr[wrg->cur].defaultchoice = wrg->wr[wrg->cur].n - 1;
+		draw_radio(&wrg->wr[wrg->cur], 1);
+		return -1;
+		break;
+
+	    case SDLK_DOWN:
+		wrg->wr[wrg->cur].defaultchoice ++;
+		if (wrg->wr[wrg->cur].defaultchoice >= wrg->wr[wrg->cur].n)
+		    wrg->wr[wrg->cur].defaultchoice = 0;
+		draw_radio(&wrg->wr[wrg->cur], 1);
+		return -1;
 
+	    case SDLK_LEFT:
+		draw_radio(&wrg->wr[wrg->cur], 0);
+		do { 
+		    wrg->cur--;
+		    if (wrg->cur < 0) 
+			wrg->cur = wrg->n - 1;
+		} while (wrg->wr[wrg->cur].inactive);
+		draw_radio(&wrg->wr[wrg->cur], 1);
+		return -1;
 
-/***************************************************************************
- *      check_tetris()
- * Checks to see if any rows have been completely filled. Returns the
- * number of such rows. Such rows are cleared.
- *********************************************************************PROTO*/
-int
-check_tetris(Grid *g)
-{
-    int tetris_count = 0;
-    int x,y;
-    for (y=g->h-1;y>=0;y--)  {
-	int c = 0;
-	for (x=0;x<g->w;x++) 
-	    if (GRID_CONTENT(*g,x,y))
-		c++;
-	if (c == g->w) {
-	    tetris_count++;
-	    for (x=0;x<g->w;x++)
-		GRID_SET(*g,x,y,REMOVE_ME);
+	    case SDLK_RIGHT: 
+		draw_radio(&wrg->wr[wrg->cur], 0);
+		do { 
+		    wrg->cur++;
+		    if (wrg->cur >= wrg->n) 
+			wrg->cur = 0;
+		} while (wrg->wr[wrg->cur].inactive);
+		draw_radio(&wrg->wr[wrg->cur], 1);
+		return -1;
+
+	    default:
+		return -1;
 	}
     }
-    return tetris_count;
+    return -1;
 }
 
 /*
- * $Log: grid.c,v $
- * Revision 1.24  2000/11/10 18:16:48  weimer
- * changes for Atris 1.0.4 - three new special options
- *
- * Revision 1.23  2000/11/06 04:06:44  weimer
- * option menu
+ * $Log: menu.c,v $
+ * Revision 1.17  2000/11/06 01:22:40  wkiri
+ * Updated menu system.
  *
- * Revision 1.22  2000/11/03 04:25:58  weimer
- * add some optimizations to run_gravity to make it just a bit faster (down
- * to 0.01 ms/call from 0.02), sleep a bit more in event-loop: generally
- * trying to make us more CPU friendly ...
+ * Revision 1.16  2000/11/06 00:24:01  weimer
+ * add WalkRadioGroup modifications (inactive field for Kiri) and some support
+ * for special pieces
  *
- * Revision 1.21  2000/11/03 03:41:35  weimer
- * made the light and dark "edges" of pieces global, rather than part of a
- * specific color style. also fixed a bug where we were updating too much
- * when drawing falling pieces (bad min() code on my part)
+ * Revision 1.15  2000/11/02 03:06:20  weimer
+ * better interface for walk-radio menus: we are now ready for Kiri to change
+ * them to add run-time options ...
  *
- * Revision 1.20  2000/10/29 21:23:28  weimer
+ * Revision 1.14  2000/10/29 21:23:28  weimer
  * One last round of header-file changes to reflect my newest and greatest
  * knowledge of autoconf/automake. Now if you fail to have some bizarro
  * function, we try to go on anyway unless it is vastly needed.
  *
- * Revision 1.19  2000/10/29 17:23:13  weimer
+ * Revision 1.13  2000/10/29 17:23:13  weimer
  * incorporate "xflame" flaming background for added spiffiness ...
  *
- * Revision 1.18  2000/10/26 22:23:07  weimer
- * double the effective number of levels
+ * Revision 1.12  2000/10/21 01:22:44  weimer
+ * prevent segfault from out-of-range values
  *
- * Revision 1.17  2000/10/21 01:14:42  weimer
+ * Revision 1.11  2000/10/21 01:14:43  weimer
  * massic autoconf/automake restructure ...
  *
- * Revision 1.16  2000/10/18 23:57:49  weimer
+ * Revision 1.10  2000/10/19 22:06:51  weimer
+ * minor changes ...
+ *
+ * Revision 1.9  2000/10/18 23:57:49  weimer
  * general fixup, color changes, display changes.
  * Notable: "Safe" Blits and Updates now perform "clipping". No more X errors,
  * we hope!
  *
- * Revision 1.15  2000/10/18 03:29:56  weimer
- * fixed problem with "machine-gun" sounds caused by "run_gravity()" returning
- * 1 too often
- *
- * Revision 1.14  2000/10/14 02:52:44  weimer
- * fixed a memory corruption problem in display (a use after a free)
- *
- * Revision 1.13  2000/10/14 00:31:53  weimer
- * non-recursive run-gravity ...
- *
- * Revision 1.12  2000/10/13 15:41:53  weimer
- * revamped AI support, now you can pick your AI and have AI duels (such fun!)
- * the mighty Aliz AI still crashes a bit, though ... :-)
+ * Revision 1.8  2000/10/13 02:26:54  weimer
+ * rudimentary identity functions, including adding new players
  *
- * Revision 1.11  2000/10/12 22:21:25  weimer
+ * Revision 1.7  2000/10/12 22:21:25  weimer
  * display changes, more multi-local-play threading (e.g., myScore ->
  * Score[0]), that sort of thing ...
  *
- * Revision 1.10  2000/10/12 19:17:08  weimer
+ * Revision 1.6  2000/10/12 19:17:08  weimer
  * Further support for AI players and multiple game types.
  *
- * Revision 1.9  2000/10/12 00:49:08  weimer
+ * Revision 1.5  2000/10/12 00:49:08  weimer
  * added "AI" support and walking radio menus for initial game configuration
  *
- * Revision 1.8  2000/09/09 17:05:35  wkiri
+ * Revision 1.4  2000/09/09 17:05:35  wkiri
  * Hideous log changes (Wes: how dare you include a comment character!)
  *
- * Revision 1.7  2000/09/09 16:58:27  weimer
+ * Revision 1.3  2000/09/09 16:58:27  weimer
  * Sweeping Change of Ultimate Mastery. Main loop restructuring to clean up
  * main(), isolate the behavior of the three game types. Move graphic files
  * into graphics/-, style files into styles/-, remove some unused files,
@@ -5765,2177 +10143,3904 @@ check_tetris(Grid *g)
  * this game), multiplayer support for the event loop, some global variable
  * cleanup. All that and a bag of chips!
  *
- * Revision 1.6  2000/09/05 22:10:46  weimer
- * fixed initial garbage generation strangeness
- *
- * Revision 1.5  2000/09/05 20:22:12  weimer
- * native video mode selection, timing investigation
- *
- * Revision 1.4  2000/09/04 21:02:18  weimer
- * Added some addition piece layout code, garbage now falls unless the row
- * below it features some non-falling garbage
- *
- * Revision 1.3  2000/09/04 15:20:21  weimer
- * faster blitting algorithms for drawing the grid and drawing falling pieces
- * (when you eliminate a line)
- *
- * Revision 1.2  2000/09/03 18:26:10  weimer
- * major header file and automatic prototype generation changes, restructuring
- *
- * Revision 1.1  2000/09/03 17:56:36  wkiri
- * Reorganization of files (display.[ch], event.c are new).
- *
- * Revision 1.9  2000/08/26 02:28:55  weimer
- * now you can see the other player!
- *
- * Revision 1.8  2000/08/26 01:36:25  weimer
- * fixed a long-running update bug: the grid changed field was being reset to
- * 0 when falling states or content were set to the same thing, even if they
- * had actually previously changed ...
- *
- * Revision 1.7  2000/08/26 01:03:11  weimer
- * remove keyboard repeat when you enter high scores
- *
- * Revision 1.6  2000/08/24 02:32:18  weimer
- * gameplay changes (key repeats) and speed modifications (falling pieces,
- * redraws, etc.)
- *
- * Revision 1.5  2000/08/22 15:13:53  weimer
- * added a garbage-generation routine
- *
- * Revision 1.4  2000/08/21 00:04:56  weimer
- * minor text placement changes, falling speed, etc.
- *
- * Revision 1.3  2000/08/15 00:59:41  weimer
- * a few more sound things
+ * Revision 1.2  2000/09/04 22:49:51  wkiri
+ * gamemenu now uses the new nifty menus.  Also, added delete_menu.
  *
- * Revision 1.2  2000/08/13 19:27:20  weimer
- * added file changelogs
+ * Revision 1.1  2000/09/04 19:54:26  wkiri
+ * Added menus (menu.[ch]).
+ */
+
+/***************************************************************************
+ *	Server_AwaitConnection() 
+ * Sets up the server side listening socket and awaits connections from the
+ * outside world. Returns a socket.
+ *********************************************************************PROTO*/
+int
+Server_AwaitConnection(int port)
+{
+  static struct sockaddr_in addr;
+  static struct hostent *host;
+  static int sockListen=0;  
+  static int addrLen;
+  int val1;
+  struct linger val2;
+  int sock;
+
+  if (sockListen == 0) {
+    memset(&addr,0,sizeof(addr));
+    addr.sin_family=AF_INET;
+    addr.sin_addr.s_addr=htonl(INADDR_ANY);
+    addr.sin_port=htons(port);
+    sockListen=socket(AF_INET,SOCK_STREAM,0);
+
+    error_msg = 0;
+
+    if (sockListen < 0) {
+	Debug("unable to create socket: %s\n",error_msg = strerror(errno));
+	return -1;
+    } 
+
+    val1=1;
+
+#ifdef HAVE_SYS_SOCKET_H
+    if (fcntl(sockListen, F_SETFL, O_NONBLOCK)) {
+	Debug("unable to make socket non-blocking: %s\n", error_msg = strerror(errno));
+	return -1;
+    }
+#endif
+
+    if (setsockopt(sockListen,SOL_SOCKET,SO_REUSEADDR,
+		   (void *)&val1, sizeof(val1))) {
+      Debug("WARNING: setsockopt(...,SO_REUSEADDR) failed. You may have to wait a\n"
+	      "\tfew minutes before you can try to be the server again.\n");
+    }
+    if (bind(sockListen, (struct sockaddr *)&addr, sizeof(addr))) {
+	Debug("unable to bind socket (for listening): %s\n", error_msg = strerror(errno));
+	return -1;
+    }
+    if (listen(sockListen,16)) {
+	Debug("unable to listen on socket: %s\n", error_msg = strerror(errno));
+	return -1;
+    } 
+
+    addrLen=sizeof(addr);
+
+    Debug("accepting connections on port %d, socketfd %d\n",port,sockListen); 
+  }
+#if HAVE_SELECT || HAVE_WINSOCK_H
+  /* it is possible to select() on a socket for the purpose of doing an
+   * accept by putting it in the read group */
+  {
+      fd_set read_fds;
+      struct timeval timeout = {0, 0};
+      int retval;
+
+      FD_ZERO(&read_fds);
+      FD_SET(sockListen, &read_fds);
+
+      retval = select(sockListen+1, &read_fds, NULL, NULL, &timeout);
+      
+      if (retval <= 0) {
+	  /* no one is there */
+	  return -1;
+      }
+  }
+#endif
+  sock=accept(sockListen, (struct sockaddr *)&addr,&addrLen);
+  if (sock < 0) {
+      if (
+#ifdef HAVE_SYS_SOCKET_H
+	      errno == EWOULDBLOCK || 
+#endif
+	      errno == EAGAIN)
+	  return -1;
+      else {
+	  Debug("unable to accept on listening socket: %s\n", error_msg = strerror(errno));
+	  return -1;
+      }
+  }
+
+  val2.l_onoff=0; val2.l_linger=0;
+  if (setsockopt(sock,SOL_SOCKET,SO_LINGER,(void *)&val2,sizeof(val2)))
+      Debug("WARNING: setsockopt(...,SO_LINGER) failed. You may have to wait a few\n"
+	      "\tminutes before you can try to be the server again.\n");
+
+  host=gethostbyaddr((void *)&addr.sin_addr,sizeof(struct in_addr),AF_INET);
+  if (!host) 
+      Debug("connection from some unresolvable IP address, socketfd %d.\n", sock);
+  else
+      Debug("connection from %s, socketfd %d.\n",host->h_name,sock); 
+  return sock;
+}
+
+/***************************************************************************
+ *	Client_Connect() 
+ * Set up client side networking and connect to the server. Returns a socket
+ * pointing to the server.
  *
- */
+ * On error, -1 is returned.
+ *********************************************************************PROTO*/
+int
+Client_Connect(char *hoststr, int lport)
+{
+    struct sockaddr_in addr;
+    struct hostent *host;
+    int mySock;
+    short port = lport;
+    int retval; 
 
-static char  loaded = FALSE;
-static int   high_scores[NUM_HIGH_SCORES];
-static char* high_names[NUM_HIGH_SCORES];
-static char* high_dates[NUM_HIGH_SCORES];
+    error_msg = NULL;
 
-static SDL_Rect hs, hs_border;	/* where are the high scores? */
-static int score_height;	/* how high is each score? */
+    host=gethostbyname(hoststr);
+    if (!host) {
+	Debug("unable to resolve [%s]: unknown hostname\n",hoststr);
+	error_msg = "unknown hostname";
+	return -1;
+    }
 
-#define FIRST_SCORE_Y	(hs.y + 60)
+    Debug("connecting to %s:%d ...\n",host->h_name,port);   
+
+    memset(&addr, 0, sizeof(addr)); 
+    addr.sin_family = AF_INET; /*host->h_addrtype;*/
+    memcpy(&addr.sin_addr, host->h_addr, host->h_length);
+    addr.sin_port=htons(port);
+    mySock = socket(AF_INET, SOCK_STREAM, 0);
+    if (mySock < 0) {
+	Debug("unable to create socket: %s\n",error_msg = strerror(errno));
+	return -1;
+    }
+
+    retval = connect(mySock, (struct sockaddr *) &addr, sizeof(addr));
+
+    if (retval < 0) {
+	Debug("unable to connect: %s\n",error_msg = strerror(errno));
+	close(mySock);
+	return -1;
+    }
+
+    Debug("connected to %s:%d, socketfd %d.\n",host->h_name,port,mySock);
+    return mySock;
+}
 
 /***************************************************************************
- *      prep_hs_bg()
- * Prepare the high score background. 
- ***************************************************************************/
-static void 
-prep_hs_bg()
+ *	Network_Init() 
+ * Call before you try to use any networking functions. Returns 0 on
+ * success.
+ *********************************************************************PROTO*/
+int
+Network_Init(void)
 {
-    hs.x = screen->w/20; hs.y = screen->h/20;
-    hs.w = 9*screen->w/10; hs.h = 18*screen->h/20;
+#if HAVE_WINSOCK_H
+    WORD version_wanted = MAKEWORD(1,1);
+    WSADATA wsaData;
 
-    draw_bordered_rect(&hs, &hs_border, 2);
+    if ( WSAStartup(version_wanted, &wsaData) != 0 ) {
+	Debug("WARNING: Couldn't initialize Winsock 1.1\n");
+	return 1;
+    }
+    Debug("Winsock 1.1 networking available.\n");
+    return 0;
+#endif
+    /* always works on Unix ... */
+    return 0;
 }
 
 /***************************************************************************
- *      save_high_scores()
- * Save the high scores out to the disk. 
+ *	Network_Quit() 
+ * Call when you are done networking. 
+ *********************************************************************PROTO*/
+void
+Network_Quit(void)
+{
+#if HAVE_WINSOCK_H
+    /* Clean up windows networking */
+    if ( WSACleanup() == SOCKET_ERROR ) {
+	if ( WSAGetLastError() == WSAEINPROGRESS ) {
+	    WSACancelBlockingCall();
+	    WSACleanup();
+	}
+    }
+#endif
+    return;
+}
+
+
+/***************************************************************************
+ *      load_piece_style()
+ * Load a piece style from the given file.
  ***************************************************************************/
-static void 
-save_high_scores()
+static piece_style *
+load_piece_style(const char *filename)
 {
-    FILE *fout;
+    piece_style *retval;
+    char buf[2048];
+    FILE *fin = fopen(filename,"rt");
     int i;
 
-    if (!loaded) 
-	return;
+    if (!fin) {
+	Debug("fopen(%s)\n",filename);
+	return NULL;
+    }
+    Calloc(retval,piece_style *,sizeof(piece_style));
 
-    fout = fopen("Atris.Scores","wt");
-    if (!fout) {
-	Debug("Unable to write High Score file [Atris.Scores]: %s\n", strerror(errno));
-	return;
+    fgets(buf,sizeof(buf),fin);
+    if (feof(fin)) {
+	Debug("unexpected EOF after name in [%s]\n",filename);
+	free(retval);
+	return NULL;
     }
 
-    fprintf(fout,"# Alizarin Tetris High Score File\n");
-    for (i=0; i<NUM_HIGH_SCORES; i++)
-	fprintf(fout,"%04d|%s|%s\n",high_scores[i], high_dates[i], high_names[i]);
-    fclose(fout);
-}
+    if (strchr(buf,'\n'))
+	*(strchr(buf,'\n')) = 0;
+    retval->name = strdup(buf);
+
+    if (fscanf(fin,"%d",&retval->num_piece) != 1) {
+	Debug("malformed piece count in [%s]\n",filename);
+	free(retval->name);
+	free(retval);
+	return NULL;
+    }
+
+    Calloc(retval->shape,piece *,(retval->num_piece)*sizeof(piece));
+
+    for (i=0;i<retval->num_piece;i++) {
+	int x,y,rot,counter;
+	do {
+	    fgets(buf,sizeof(buf),fin);
+	    if (feof(fin))
+		PANIC("unexpected EOF in [%s], before piece %d",filename,i+1);
+	} while (buf[0] == '\n');
+	retval->shape[i].dim = strlen(buf) - 1;
+	if (retval->shape[i].dim <= 0) 
+	    PANIC("piece %d malformed height/width in [%s]", i,filename);
+#ifdef DEBUG
+	Debug("... loading piece %d (%d by %d)\n",i,
+		retval->shape[i].dim, retval->shape[i].dim);
+#endif
+	for (rot=0;rot<4;rot++) {
+	    Malloc(retval->shape[i].bitmap[rot], unsigned char *,
+		    retval->shape[i].dim * retval->shape[i].dim);
+	}
+	counter = 1;
+	for (y=0;y<retval->shape[i].dim;y++) {
+	    for (x=0;x<retval->shape[i].dim;x++) {
+		BITMAP(retval->shape[i],0,x,y) = 
+		    (buf[x] != '.') ? counter++ : 0;
+	    }
+	    if (y != retval->shape[i].dim - 1) do {
+		fgets(buf,sizeof(buf),fin);
+		if (feof(fin))
+		    PANIC("unexpected EOF in [%s]",filename);
+	    } while (buf[0] == '\n');
+	}
+	retval->shape[i].num_color = counter-1;
+
+	for (rot=1;rot<4;rot++) {
+	    for (y=0;y<retval->shape[i].dim;y++) 
+		for (x=0;x<retval->shape[i].dim;x++) {
+		    BITMAP(retval->shape[i],rot,x,y) =
+			BITMAP(retval->shape[i],rot-1,
+				(retval->shape[i].dim - 1) - y,
+				x);
+		}
+	} /* end: for rot = 0..4 */
+
+#ifdef DEBUG
+	for (y=0;y<retval->shape[i].dim;y++) {
+	    for (rot=0;rot<4;rot++) {
+		for (x=0;x<retval->shape[i].dim;x++) {
+		    printf("%d", BITMAP(retval->shape[i],rot,x,y));
+		}
+		printf("\t");
+	    }
+	    printf("\n");
+	}
+#endif
+    }
 
 
+    Debug("Piece Style [%s] loaded (%d pieces).\n",retval->name,
+	    retval->num_piece);
+    return retval;
+}
+
 /***************************************************************************
- *      load_high_scores()
- * Load the high scores from disk (and allocate space).
+ *	piece_Select()
+ * Returns 1 if the file pointed to ends with ".Piece" 
+ * Used by scandir() to grab all the *.Piece files from a directory. 
  ***************************************************************************/
-static void 
-load_high_scores()
+static int
+piece_Select(const struct dirent *d)
+{
+    if (strstr(d->d_name,".Piece") && 
+	    (signed)strlen(d->d_name) == 
+	    (strstr(d->d_name,".Piece") - d->d_name + 6))
+	return 1;
+    else 
+	return 0; 
+}
+
+/***************************************************************************
+ *      load_piece_styles()
+ * Load all ".Style" files in the directory.
+ *********************************************************************PROTO*/
+piece_styles
+load_piece_styles(void)
 {
-    FILE* fin;
+    piece_styles retval;
     int i = 0;
-    char buf[2048];
+    DIR *my_dir;
+    char filespec[2048];
 
-    if (!loaded) {
-	/* make up a dummy high score template first */
+    memset(&retval, 0, sizeof(retval));
 
-	for (i=0; i<NUM_HIGH_SCORES; i++) {
-	    high_names[i] = strdup("No one yet..."); Assert(high_names[i]);
-	    high_dates[i] = strdup("Never"); Assert(high_dates[i]);
-	    high_scores[i] = 0;
-	}
-	loaded = TRUE;
+    my_dir = opendir("styles");
+    if (my_dir) {
+	while (1) { 
+	    struct dirent *this_file = readdir(my_dir);
+	    if (!this_file) break;
+	    if (piece_Select(this_file))
+		i++;
+	} 
+	closedir(my_dir);
+    } else {
+	PANIC("Cannot read directory [styles/]");
     }
-
-    fin = fopen("Atris.Scores", "r");
-    if (fin) {
-
-	for (i=0; !feof(fin) && i < NUM_HIGH_SCORES; i++) {
-	    char *p, *q;
-	    /* read in a line of text, but skip comments and blanks */
-	    do {
-		fgets(buf, sizeof(buf), fin);
-	    } while (!feof(fin) && (buf[0] == '\n' || buf[0] == '#'));
-	    /* are we done with this file? */
-	    if (feof(fin)) break;
-	    /* strip the newline */
-	    if (strchr(buf,'\n'))
-		*(strchr(buf,'\n')) = 0;
-	    /* format: "score|date|name" */
-
-	    sscanf(buf,"%d",&high_scores[i]);
-	    p = strchr(buf,'|');
-	    if (!p) break;
-	    p++;
-	    q = strchr(p, '|');
-	    if (!q) break;
-	    Free(high_dates[i]); Free(high_names[i]);
-	    *q = 0;
-	    high_dates[i] = strdup(p); Assert(high_dates[i]);
-	    q++;
-	    high_names[i] = strdup(q); Assert(high_names[i]);
+    my_dir = opendir("styles");
+    if (my_dir) {
+	if (i > 0) { 
+	    int j;
+	    Calloc(retval.style,piece_style **,sizeof(*(retval.style))*i);
+	    retval.num_style = i;
+	    j = 0;
+	    while (j<i) {
+		struct dirent *this_file = readdir(my_dir);
+		if (!piece_Select(this_file)) continue;
+		sprintf(filespec,"styles/%s",this_file->d_name);
+		retval.style[j] = load_piece_style(filespec);
+		if (strstr(retval.style[j]->name,"Default"))
+		    retval.choice = j;
+		j++;
+	    }
+	    closedir(my_dir);
+	    return retval;
+	} else {
+	    PANIC("No piece styles [styles/*.Piece] found.\n");
 	}
-	fclose(fin);
+    } else { 
+	PANIC("Cannot read directory [styles/]");
     }
+    return retval;
 }
 
 /***************************************************************************
- *      show_high_scores()
- * Display the current high score list.
+ *      load_color_style()
+ * Load a color style from the given file.
  ***************************************************************************/
-static void 
-show_high_scores()
+static color_style *
+load_color_style(SDL_Surface * screen, const char *filename)
 {
-  char buf[256];
-  int i, base;
-  int delta;
-    
-  if (!loaded) load_high_scores();
-  prep_hs_bg();
+    color_style *retval;
+    char buf[2048];
+    FILE *fin = fopen(filename,"rt");
+    int i;
 
-  draw_string("Alizarin Tetris High Scores", color_purple, screen->w/2,
-	  hs.y, DRAW_LARGE | DRAW_UPDATE | DRAW_CENTER );
+    if (!fin) {
+	Debug("fopen(%s)\n",filename);
+	return NULL;
+    }
+    Calloc(retval,color_style *,sizeof(*retval));
 
-  base = FIRST_SCORE_Y;
+    fgets(buf,sizeof(buf),fin);
+    if (feof(fin)) {
+	Debug("unexpected EOF after name in [%s]\n",filename);
+	free(retval);
+	return NULL;
+    }
+    if (strchr(buf,'\n'))
+	*(strchr(buf,'\n')) = 0;
+    retval->name = strdup(buf);
 
-  for (i=0; i<NUM_HIGH_SCORES; i++)
-    {
-      sprintf(buf, "%-2d)", i+1);
-      delta = draw_string(buf, color_blue, 3*screen->w/40, base, DRAW_UPDATE );
+    if (fscanf(fin,"%d\n",&retval->num_color) != 1) {
+	Debug("malformed color count in [%s]\n",filename);
+	free(retval->name);
+	free(retval);
+	return NULL;
+    }
 
-      score_height = delta + 3;
+    Malloc(retval->color, SDL_Surface **,
+	    (retval->num_color+1)*sizeof(retval->color[0]));
 
-      sprintf(buf, "%-20s", high_names[i]);
-      draw_string(buf, color_red, 3*screen->w/20, base, DRAW_UPDATE );
+    for (i=1;i<=retval->num_color;i++) {
+	SDL_Surface *imagebmp;
 
-      sprintf(buf, "%.4d", high_scores[i]);
-      draw_string(buf, color_blue, 11*screen->w/20, base, DRAW_UPDATE );
+	do {
+	    buf[0] = 0;
+	    fgets(buf,sizeof(buf),fin);
+	} while (!feof(fin) && (buf[0] == '\n' || buf[0] == '#'));
 
-      sprintf(buf, "%s", high_dates[i]);
-      draw_string(buf, color_red, 7*screen->w/10, base, DRAW_UPDATE );
+	if (feof(fin)) PANIC("unexpected EOF in color style [%s]",retval->name);
+	if (strchr(buf,'\n'))
+	    *(strchr(buf,'\n')) = 0;
+
+	if (!screen) {	/* headless: we only need to know how many */
+	    retval->color[i] = NULL;
+	    retval->w = retval->h = 20;
+	    continue;
+	}
+	imagebmp = SDL_LoadBMP(buf);
+	if (!imagebmp) 
+	    PANIC("cannot load [%s] in color style [%s]",buf,retval->name);
+	/* set the video colormap */
+	if ( imagebmp->format->palette != NULL ) {
+	    SDL_SetColors(screen,
+		    imagebmp->format->palette->colors, 0,
+		    imagebmp->format->palette->ncolors);
+	}
+	/* Convert the image to the video format (maps colors) */
+	retval->color[i] = SDL_DisplayFormat(imagebmp);
+	SDL_FreeSurface(imagebmp);
+	if ( !retval->color[i] ) 
+	    PANIC("could not convert [%s] in color style [%s]", 
+		buf, retval->name);
+	if (i == 1) {
+	    retval->h = retval->color[i]->h;
+	    retval->w = retval->color[i]->w;
+	} else {
+	    if (retval->h != retval->color[i]->h ||
+		    retval->w != retval->color[i]->w)
+		PANIC("[%s] has the wrong size in color style [%s]",
+			buf, retval->name);
+	}
 
-      base += score_height;
     }
+    retval->color[0] = retval->color[1];
+
+    Debug("Color Style [%s] loaded (%d colors).\n",retval->name,
+	    retval->num_color);
+
+    return retval;
 }
 
 /***************************************************************************
- *      is_high_score()
- * Checks whether score qualifies as a high score.
- * Returns 1 if so, 0 if not.
+ *	color_Select()
+ * Returns 1 if the file pointed to ends with ".Color" 
+ * Used by scandir() to grab all the *.Color files from a directory. 
  ***************************************************************************/
-static int 
-is_high_score(int score)
+static int
+color_Select(const struct dirent *d)
 {
-  if (!loaded) load_high_scores();
-  return (score >= high_scores[NUM_HIGH_SCORES-1]);
+    if (strstr(d->d_name,".Color") && 
+	    (signed)strlen(d->d_name) == 
+	    (strstr(d->d_name,".Color") - d->d_name + 6))
+	return 1;
+    else 
+	return 0; 
 }
 
 /***************************************************************************
- *      update_high_scores()
- * Modifies the high score list, adding in the current score and
- * querying for a name.
+ *	load_specials()
+ * Loads the pictures for the special pieces.
  ***************************************************************************/
-static void 
-update_high_scores(int score)
+static void
+load_special(void)
 {
-  unsigned int i, j;
-  char buf[256];
-#if HAVE_STRFTIME
-  const struct tm* tm;
-  time_t t;
-#endif
-  
-  if (!is_high_score(score)) return;
-  if (!loaded) load_high_scores();
-
-  for (i=0; i<NUM_HIGH_SCORES; i++)
-    {
-      if (score >= high_scores[i])
-	{
-	  prep_hs_bg();
-	  /* move everything down */
-
-	  Free(high_names[NUM_HIGH_SCORES-1]);
-	  Free(high_dates[NUM_HIGH_SCORES-1]);
-
-	  for (j=NUM_HIGH_SCORES-1; j>i; j--)
-	    {
-	      high_scores[j] = high_scores[j-1];
-	      high_names[j] = high_names[j-1];
-	      high_dates[j] = high_dates[j-1];
-	    }
-	  /* Get the date */
-#if HAVE_STRFTIME
-	  t = time(NULL); tm = localtime(&t);
-	  strftime(buf, sizeof(buf), "%b %d %H:%M", tm);
-	  high_dates[i] = strdup(buf);
-#else
-#warning  "Since you do not have strftime(), you will not have accurate times in the high score list."
-	  high_dates[i] = "Unknown Time";
-#endif
-
-	  high_scores[i] = score;
-	  /* Display the high scores */
-	  high_names[i] = " ";
-	  show_high_scores();
-	  /* get the new name */
+    int i;
+#define NUM_SPECIAL 6
+    char *filename[NUM_SPECIAL] = {
+	"graphics/Special-Bomb.bmp",		/* special_bomb */
+	"graphics/Special-Drip.bmp",		/* special_repaint */
+	"graphics/Special-DownArrow.bmp",	/* special_pushdown */
+	"graphics/Special-Skull.bmp",		/* special_colorkill */
+	"graphics/Special-X.bmp",
+	"graphics/Special-YinYang.bmp" };
 
-	  draw_string("Enter your name!", color_purple, screen->w / 2, hs.y
-		  + hs.h - 10, DRAW_CENTER | DRAW_ABOVE | DRAW_UPDATE);
+    special_style.name = "Special Pieces";
+    special_style.num_color = NUM_SPECIAL;
+    Malloc(special_style.color, SDL_Surface **, NUM_SPECIAL * sizeof(SDL_Surface *));
+    special_style.w = 20;
+    special_style.h = 20;
 
-	  high_names[i] = input_string(screen, 3*screen->w/20,
-		  FIRST_SCORE_Y + score_height * i, 1);
-	  break;
+    for (i=0; i<NUM_SPECIAL; i++) {
+	SDL_Surface *imagebmp;
+	/* grab the lighting */
+	imagebmp = SDL_LoadBMP(filename[i]);
+	if (!imagebmp) 
+	    PANIC("cannot load [%s], a required special piece",filename[i]);
+	if ( imagebmp->format->palette != NULL ) {
+	    SDL_SetColors(screen,
+		    imagebmp->format->palette->colors, 0,
+		    imagebmp->format->palette->ncolors);
 	}
+	/* Convert the image to the video format (maps colors) */
+	special_style.color[i] = SDL_DisplayFormat(imagebmp);
+	SDL_FreeSurface(imagebmp);
+	if ( !special_style.color[i] ) 
+	    PANIC("could not convert [%s], a required special piece",filename[i]);
     }
-  save_high_scores();
+    return;
 }
 
 /***************************************************************************
- *      high_score_check()
- * Checks for a high score; if so, updates the list. Displays list.
- *********************************************************************PROTO*/
-void high_score_check(int level, int new_score)
+ *	load_edges()
+ * Loads the pictures for the edges.
+ ***************************************************************************/
+static void
+load_edges(void)
 {
-  SDL_Event event;
-
-  clear_screen_to_flame();
+    int i;
+    char *filename[4] = {
+	"graphics/Horiz-Light.bmp",
+	"graphics/Vert-Light.bmp",
+	"graphics/Horiz-Dark.bmp",
+	"graphics/Vert-Dark.bmp" };
 
-  if (level < 0) {
-      return;
-  }
+    for (i=0;i<4;i++) {
+	SDL_Surface *imagebmp;
+	/* grab the lighting */
+	imagebmp = SDL_LoadBMP(filename[i]);
+	if (!imagebmp) 
+	    PANIC("cannot load [%s], a required edge",filename[i]);
+	/* set the video colormap */
+	if ( imagebmp->format->palette != NULL ) {
+	    SDL_SetColors(screen,
+		    imagebmp->format->palette->colors, 0,
+		    imagebmp->format->palette->ncolors);
+	}
+	/* Convert the image to the video format (maps colors) */
+	edge[i] = SDL_DisplayFormat(imagebmp);
+	SDL_FreeSurface(imagebmp);
+	if ( !edge[i] ) 
+	    PANIC("could not convert [%s], a required edge",filename[i]);
 
-  /* Clear the queue */
-  while (SDL_PollEvent(&event)) { 
-      poll_and_flame(&event);
-  }
-  
-  /* Check for a new high score.  If so, update the list. */
-  if (is_high_score(new_score)) {
-      update_high_scores(new_score);
-      show_high_scores();
-  } else { 
-      char buf[BUFSIZE];
+	SDL_SetAlpha(edge[i],SDL_SRCALPHA|SDL_RLEACCEL, 48 /*128+64*/);
+    }
+    return; 
+}
 
-      show_high_scores();
-      sprintf(buf,"Your score: %d", new_score);
 
-      draw_string(buf, color_purple, screen->w / 2, hs.y
-	      + hs.h - 10, DRAW_CENTER | DRAW_ABOVE | DRAW_UPDATE);
+/***************************************************************************
+ *      load_color_styles()
+ * Loads all available color styles. With a NULL screen (the headless
+ * tools) no pictures are loaded: the styles just know how many colors
+ * they have and that each is 20 pixels square.
+ *********************************************************************PROTO*/
+color_styles 
+load_color_styles(SDL_Surface * screen)
+{
+    color_styles retval;
+    int i = 0;
+    DIR *my_dir;
+    char filespec[2048];
 
+    if (screen) {
+	load_edges();
+	load_special();
     }
-  /* wait for any key */
-  do {
-      poll_and_flame(&event);
-  } while (event.type != SDL_KEYDOWN);
-}
 
-/*
- * $Log: highscore.c,v $
- * Revision 1.31  2000/11/06 01:22:40  wkiri
- * Updated menu system.
- *
- * Revision 1.30  2000/10/29 21:23:28  weimer
- * One last round of header-file changes to reflect my newest and greatest
- * knowledge of autoconf/automake. Now if you fail to have some bizarro
- * function, we try to go on anyway unless it is vastly needed.
- *
- * Revision 1.29  2000/10/29 19:04:33  weimer
- * minor highscore handling changes: new filename, use the draw_string() and
- * draw_bordered_rect() and input_string() interfaces, handle the widget layer
- * and the flame layer, etc. Also fix a minor bug where you would be prevented
- * from settling if you pressed a key even if it didn't really move you. :-)
- *
- * Revision 1.28  2000/10/21 01:14:43  weimer
- * massic autoconf/automake restructure ...
- *
- * Revision 1.27  2000/10/18 23:57:49  weimer
- * general fixup, color changes, display changes.
- * Notable: "Safe" Blits and Updates now perform "clipping". No more X errors,
- * we hope!
- *
- * Revision 1.26  2000/09/09 17:05:35  wkiri
- * Hideous log changes (Wes: how dare you include a comment character!)
- *
- * Revision 1.25  2000/09/09 16:58:27  weimer
- * Sweeping Change of Ultimate Mastery. Main loop restructuring to clean up
- * main(), isolate the behavior of the three game types. Move graphic files
- * into graphics/-, style files into styles/-, remove some unused files,
- * add game flow support (breaks between games, remembering your level within
- * this game), multiplayer support for the event loop, some global variable
- * cleanup. All that and a bag of chips!
- *
- * Revision 1.24  2000/09/04 19:48:02  weimer
- * interim menu for choosing among game styles, button changes (two states)
- *
- * Revision 1.23  2000/09/03 19:41:30  wkiri
- * Now allows you to choose the game type (though it doesn't do anything yet).
- *
- * Revision 1.22  2000/09/03 18:44:36  wkiri
- * Cleaned up atris.c (see high_score_check()).
- * Added game type (defaults to MARATHON).
- *
- * Revision 1.21  2000/09/03 18:26:10  weimer
- * major header file and automatic prototype generation changes, restructuring
- *
- * Revision 1.20  2000/09/03 17:56:36  wkiri
- * Reorganization of files (display.[ch], event.c are new).
- *
- * Revision 1.19  2000/08/26 03:11:34  wkiri
- * Buttons now use borders.
- *
- * Revision 1.18  2000/08/26 02:45:28  wkiri
- * Beginnings of button class; also modified atris to query for 'new
- * game' vs. 'quit'.  (New Game doesn't work yet...)
- *
- * Revision 1.17  2000/08/26 00:54:00  wkiri
- * Now high-scoring user enters name at the proper place.
- * Also, score is shown even if user doesn't make the high score list.
- *
- * Revision 1.16  2000/08/20 23:45:58  wkiri
- * High scores reports the hour:minute rather than the year.
- *
- * Revision 1.15  2000/08/20 23:39:00  wkiri
- * Different color for the scores in the score display; positions adjusted.
- *
- * Revision 1.14  2000/08/20 19:00:29  weimer
- * text output changes (moved from _Solid to _Blended)
- *
- * Revision 1.13  2000/08/20 17:16:25  wkiri
- * Can quit using 'q' and this will skip the high score list.
- * Adjusted the high score display positions to fit in the window.
- *
- * Revision 1.12  2000/08/20 16:49:52  wkiri
- * Now supports dates as well.
- *
- * Revision 1.11  2000/08/20 16:20:46  wkiri
- * Now displays the new score correctly.
- *
- * Revision 1.10  2000/08/20 16:16:04  wkiri
- * Better display of high scores.
- *
- * Revision 1.9  2000/08/15 01:58:11  wkiri
- * Not allowed to backspace before the beginning of the array! :)
- * Handles this gracefully (i.e. ignores any such keypresses)
- * and clears the display correctly even when fewer letters are present
- * than were present previously (when BS is pressed).
- *
- * Revision 1.8  2000/08/15 01:30:33  wkiri
- * Handles shift keys (i.e. empty messages) properly.
- *
- * Revision 1.7  2000/08/15 01:22:59  wkiri
- * High scores can handle punctuation, backspace, and spaces in names.
- * Also, display is nicer (got rid of the weird boxes).
- *
- * Revision 1.6  2000/08/15 00:52:33  wkiri
- * Ooops! Now properly checks for new high scores.
- *
- * Revision 1.5  2000/08/15 00:50:49  wkiri
- * Now displays your high score name as you type it in.
- * No support for backspace, though.
- *
- * Revision 1.4  2000/08/15 00:37:01  wkiri
- * Wes found nasty memory bug!  Wes is my hero!
- * Also, changes to high scores to get input from the window.
- *
- * Revision 1.3  2000/08/15 00:22:15  wkiri
- * Now handles non-regular-ascii input to high scores.
- *
- * Revision 1.2  2000/08/14 23:37:06  wkiri
- * Removed debugging output from high score module.
- *
- * Revision 1.1  2000/08/14 01:07:17  wkiri
- * High score files.
- *
- */
+    memset(&retval, 0, sizeof(retval));
+
+    my_dir = opendir("styles");
+    if (my_dir) {
+	while (1) { 
+	    struct dirent *this_file = readdir(my_dir);
+	    if (!this_file) break;
+	    if (color_Select(this_file))
+		i++;
+	} 
+	closedir(my_dir);
+    } else {
+	PANIC("Cannot read directory [styles/]");
+    }
+    my_dir = opendir("styles");
+    if (my_dir) {
+	if (i > 0) { 
+	    int j;
+	    Calloc(retval.style,color_style **,sizeof(*(retval.style))*i);
+	    retval.num_style = i;
+	    j = 0;
+	    while (j<i) {
+		struct dirent *this_file = readdir(my_dir);
+		if (!color_Select(this_file)) continue;
+		sprintf(filespec,"styles/%s",this_file->d_name);
+		retval.style[j] = load_color_style(screen, filespec);
+		if (strstr(retval.style[j]->name,"Default"))
+		    retval.choice = j;
+		j++;
+	    }
+	    closedir(my_dir);
+	    return retval;
+	} else {
+	    PANIC("No piece styles [styles/*.Color] found.\n");
+	}
+    } else { 
+	PANIC("Cannot read directory [styles/]");
+    }
+    return retval;
+}
 
 /***************************************************************************
- *      input_string()
- * Read input from the user ... on the widget layer. 
+ *      generate_piece()
+ * Chooses the next piece in sequence. This involves assigning colors to
+ * all of the tiles that make up the shape of the piece.
+ *
+ * Uses the color style because it needs to know the number of colors.
  *********************************************************************PROTO*/
-char *
-input_string(SDL_Surface *screen, int x, int y, int opaque)
+play_piece
+generate_piece(piece_style *ps, color_style *cs, unsigned int seq)
 {
-    int pos;
-    char c;
-    char retval[1024];
-    SDL_Surface *text, *ctext;
-    SDL_Color tc, cc;
-    SDL_Rect rect;
-    SDL_Event event;
-    Uint32 text_color = int_input_color0;
-    Uint32 cursor_color = int_input_color1;
-    Uint32 our_black = opaque ? int_solid_black : int_black;
+    play_piece retval;
+    Uint32 seed;
 
-    memset(retval, 0, sizeof(retval));
-    retval[0] = ' ';
-    pos = 1;
+    SeedRandom(seq);
+    seed = GetRandSeed();
+    retval = generate_piece_r(ps, cs, &seed);
+    SeedRandom(seed);	/* leave ZEROTO() where it always was */
+    return retval;
+}
 
-    SDL_GetRGB(text_color, screen->format, &tc.r, &tc.g, &tc.b);
-    SDL_GetRGB(cursor_color, screen->format, &cc.r, &cc.g, &cc.b);
+/***************************************************************************
+ *      generate_piece_r()
+ * generate_piece() on a random seed of your own: *seed is used and
+ * advanced instead of the global one, so threads can draw pieces from the
+ * same distribution the game does.
+ *********************************************************************PROTO*/
+play_piece
+generate_piece_r(piece_style *ps, color_style *cs, Uint32 *seed)
+{
+    unsigned int p,q,r,c;
+    play_piece retval;
 
-    ctext = TTF_RenderText_Blended(font, "_", cc); Assert(ctext);
+    memset(&retval, 0, sizeof(retval));	/* unused colors compare equal */
+    p = FastRandom_r(seed, ps->num_piece);
+    q = 2 + FastRandom_r(seed, cs->num_color - 1);
+    r = 2 + FastRandom_r(seed, cs->num_color - 1);
+    retval.base = &(ps->shape[p]);
 
-    while (1) {
-	int changed = 0;	/* did they change the text string? */
-	int blink = 1;		/* toggle the blinking the cursor */
-	Uint32  flip_when = SDL_GetTicks();
-	/* display the current string */
+    retval.special = No_Special;
+    if (Options.special_wanted && FastRandom_r(seed, 10000) < 2000) {
+	switch (FastRandom_r(seed, 4)) {
+	    case 0: retval.special = Special_Bomb; /* bomb */
+		    break;
+	    case 1: retval.special = Special_Repaint; /* repaint */
+		    break; 
+	    case 2: retval.special = Special_Pushdown; /* repaint */
+		    break;
+	    case 3: retval.special = Special_Colorkill; /* trace and kill color */
+		    break;
+	}
+    }
+    if (retval.special != No_Special) {
+	for (c=1;c<=(unsigned)ps->shape[p].num_color;c++) {
+	    retval.colormap[c] = (unsigned char) retval.special;
+	}
+    } else for (c=1;c<=(unsigned)ps->shape[p].num_color;c++) {
+	if (FastRandom_r(seed, 100) < 25) 
+	    retval.colormap[c] = q; 
+	else
+	    retval.colormap[c] = r; 
+	Assert(retval.colormap[c] > 1);
+    }
+    return retval;
+}
 
-	text = TTF_RenderText_Blended(font, retval, tc); Assert(text);
+#define PRECOLOR_AT(pp,rot,i,j) BITMAP(*pp->base,rot,i,j)
 
-	rect.x = x;
-	rect.y = y;
-	rect.w = text->w;
-	rect.h = text->h;
+/***************************************************************************
+ *      draw_play_piece()
+ * Draws a play piece on the screen.
+ *
+ * Needs the color style because it actually has to paste the color
+ * bitmaps.
+ *********************************************************************PROTO*/
+void
+draw_play_piece(SDL_Surface *screen, color_style *cs, 
+	play_piece *o_pp, int o_x, int o_y, int o_rot,	/* old */
+	play_piece *pp,int x, int y, int rot)		/* new */
+{
+    SDL_Rect dstrect;
+    int i,j;
+    int w,h;
 
-	SDL_BlitSurface(text, NULL, widget_layer, &rect);
-	/* OK to ignore the intervening flame layer */
-	SDL_BlitSurface(text, NULL, screen, &rect);
-	SDL_UpdateSafe(screen, 1, &rect);
+    if (pp->special != No_Special)
+	cs = &special_style;
 
-	rect.x += rect.w;
-	rect.w = ctext->w;
-	rect.h = ctext->h;
+    w = cs->w;
+    h = cs->h;
 
-	changed = 0;
-	while (!changed) { 
-	    if (SDL_GetTicks() > flip_when) {
-		if (blink) {
-		    SDL_BlitSurface(ctext, NULL, screen, &rect);
-		    SDL_BlitSurface(ctext, NULL, widget_layer, &rect);
-		} else {
-		    SDL_FillRect(widget_layer, &rect, our_black);
-		    SDL_FillRect(screen, &rect, our_black);
-		    SDL_BlitSurface(flame_layer, &rect, screen, &rect);
-		    SDL_BlitSurface(widget_layer, &rect, screen, &rect);
-		}
-		SDL_UpdateSafe(screen, 1, &rect);
-		flip_when = SDL_GetTicks() + 400;
-		blink = !blink;
+    for (j=0;j<o_pp->base->dim;j++)
+	for (i=0;i<o_pp->base->dim;i++) {
+	    int what;
+	    /* clear old */
+	    if ((what = PRECOLOR_AT(o_pp,o_rot,i,j))) {
+		dstrect.x = o_x + i * w;
+		dstrect.y = o_y + j * h;
+		dstrect.w = w;
+		dstrect.h = h;
+		SDL_BlitSafe(widget_layer,&dstrect,screen,&dstrect);
 	    }
-	    if (SDL_PollEvent(&event)) {
-		if (event.type == SDL_KEYDOWN) {
-		    changed = 1;
-		    switch (event.key.keysym.sym) {
-			case SDLK_RETURN:
-			    return strdup(retval + 1);
-
-			case SDLK_BACKSPACE:
-			    if (pos > 1) pos--;
-			    retval[pos] = 0;
-
-			    rect.x = x;
-			    rect.w = text->w + ctext->w;
-			    SDL_FillRect(widget_layer, &rect, our_black);
-			    SDL_FillRect(screen, &rect, our_black);
-			    SDL_BlitSurface(flame_layer, &rect, screen, &rect);
-			    SDL_BlitSurface(widget_layer, &rect, screen, &rect);
-			    SDL_UpdateSafe(screen, 1, &rect);
-			    break;
+	}
+    for (j=0;j<pp->base->dim;j++)
+	for (i=0;i<pp->base->dim;i++) {
+	    int this_precolor;
+	    /* draw new */
+	    if ((this_precolor = PRECOLOR_AT(pp,rot,i,j))) {
+		int this_color = pp->colormap[this_precolor];
+		dstrect.x = x + i * w;
+		dstrect.y = y + j * h;
+		dstrect.w = w;
+		dstrect.h = h;
+		SDL_BlitSafe(cs->color[this_color], NULL,screen,&dstrect) ;
+		if (pp->special == No_Special)
+		{
+		    int that_precolor = (j == 0) ? 0 : 
+			PRECOLOR_AT(pp,rot,i,j-1);
 
-			default:
-			    c = event.key.keysym.unicode;
-			    if (c == 0) break;
+		    /* light up */
+		    if (that_precolor == 0 ||
+			    pp->colormap[that_precolor] != this_color) {
+			dstrect.x = x + i * w;
+			dstrect.y = y + j * h;
+			dstrect.h = edge[HORIZ_LIGHT]->h;
+			dstrect.w = edge[HORIZ_LIGHT]->w;
+			SDL_BlitSafe(edge[HORIZ_LIGHT],NULL,
+				    screen,&dstrect) ;
+		    }
 
-			    SDL_FillRect(widget_layer, &rect, our_black);
-			    SDL_FillRect(screen, &rect, our_black);
-			    SDL_BlitSurface(flame_layer, &rect, screen, &rect);
-			    SDL_BlitSurface(widget_layer, &rect, screen, &rect);
-			    SDL_UpdateSafe(screen, 1, &rect);
+		    /* light left */
+		    that_precolor = (i == 0) ? 0 :
+			PRECOLOR_AT(pp,rot,i-1,j);
+		    if (that_precolor == 0 ||
+			    pp->colormap[that_precolor] != this_color) {
+			dstrect.x = x + i * w;
+			dstrect.y = y + j * h;
+			dstrect.h = edge[VERT_LIGHT]->h;
+			dstrect.w = edge[VERT_LIGHT]->w;
+			SDL_BlitSafe(edge[VERT_LIGHT],NULL,
+				    screen,&dstrect) ;
+		    }
+		    
+		    /* shadow down */
+		    that_precolor = (j == pp->base->dim-1) ? 0 :
+			PRECOLOR_AT(pp,rot,i,j+1);
+		    if (that_precolor == 0 ||
+			    pp->colormap[that_precolor] != this_color) {
+			dstrect.x = x + i * w;
+			dstrect.y = (y + (j+1) * h) - edge[HORIZ_DARK]->h;
+			dstrect.h = edge[HORIZ_DARK]->h;
+			dstrect.w = edge[HORIZ_DARK]->w;
+			SDL_BlitSafe(edge[HORIZ_DARK],NULL,
+				    screen,&dstrect);
+		    }
 
-			    if (isalpha(c) || isdigit(c) || isspace(c) || ispunct(c))
-				retval[pos++] = c;
-			    break;
+		    /* shadow right */
+		    that_precolor = (i == pp->base->dim-1) ? 0 :
+			PRECOLOR_AT(pp,rot,i+1,j);
+		    if (that_precolor == 0 ||
+			    pp->colormap[that_precolor] != this_color) {
+			dstrect.x = (x + (i+1) * w) - edge[VERT_DARK]->w;
+			dstrect.y = (y + (j) * h);
+			dstrect.h = edge[VERT_DARK]->h;
+			dstrect.w = edge[VERT_DARK]->w;
+			SDL_BlitSafe(edge[VERT_DARK],NULL, screen,&dstrect);
 		    }
 		}
-	    } else atris_run_flame();
+	    }
 	}
-	SDL_FreeSurface(text);
-    }
-}
+    /* now update the entire relevant area */
+    dstrect.x = min(o_x, x);
+    dstrect.x = max( dstrect.x, 0 );
 
-/***************************************************************************
- *      load_identity_file()
- * Parse an identity file.
- *********************************************************************PROTO*/
-identity *
-load_identity_file()
-{
-    identity *retval;
-    char buf[2048];
+    dstrect.w = max(o_x + (o_pp->base->dim * cs->w), 
+	    x + (pp->base->dim * cs->w)) - dstrect.x;
+    dstrect.w = min( dstrect.w , screen->w - dstrect.x );
 
-    FILE *fin = fopen(ID_FILENAME, "rt");
-    int count = 0;
-    int i;
+    dstrect.y = min(o_y, y);
+    dstrect.y = max( dstrect.y, 0 );
+    dstrect.h = max(o_y + (o_pp->base->dim * cs->h),
+	    y + (pp->base->dim * cs->h)) - dstrect.y;
+    dstrect.h = min( dstrect.h , screen->h - dstrect.y );
 
-    if (!fin) {
-	Debug("fopen(%s)\n", ID_FILENAME);
-	Debug("Cannot open Identity File.\n");
+    SDL_UpdateSafe(screen,1,&dstrect);
 
-	Calloc(retval,identity *,sizeof(identity));
-	return retval;
-    }
-    Calloc(retval,identity *,sizeof(identity));
+    return;
+}
 
-    while (!(feof(fin))) {
-	do {
-	    fgets(buf,sizeof(buf),fin);
-	} while (!feof(fin) &&
-		(buf[0] == '\n' || buf[0] == '#'));
-	if (feof(fin)) break;
-	if (strchr(buf,'\n'))
-	    *(strchr(buf,'\n')) = 0;
-	count++;
-    }
-    rewind(fin);
 
-    retval->n = count;
+/*
+ * $Log: piece.c,v $
+ * Revision 1.29  2000/11/06 04:16:10  weimer
+ * "power pieces" plus images
+ *
+ * Revision 1.28  2000/11/06 04:06:44  weimer
+ * option menu
+ *
+ * Revision 1.27  2000/11/06 01:25:54  weimer
+ * add in the other special piece
+ *
+ * Revision 1.26  2000/11/06 00:24:01  weimer
+ * add WalkRadioGroup modifications (inactive field for Kiri) and some support
+ * for special pieces
+ *
+ * Revision 1.25  2000/11/03 04:25:58  weimer
+ * add some optimizations to run_gravity to make it just a bit faster (down
+ * to 0.01 ms/call from 0.02), sleep a bit more in event-loop: generally
+ * trying to make us more CPU friendly ...
+ *
+ * Revision 1.24  2000/11/03 03:41:35  weimer
+ * made the light and dark "edges" of pieces global, rather than part of a
+ * specific color style. also fixed a bug where we were updating too much
+ * when drawing falling pieces (bad min() code on my part)
+ *
+ * Revision 1.23  2000/10/29 21:23:28  weimer
+ * One last round of header-file changes to reflect my newest and greatest
+ * knowledge of autoconf/automake. Now if you fail to have some bizarro
+ * function, we try to go on anyway unless it is vastly needed.
+ *
+ * Revision 1.22  2000/10/29 17:23:13  weimer
+ * incorporate "xflame" flaming background for added spiffiness ...
+ *
+ * Revision 1.21  2000/10/29 00:17:39  weimer
+ * added support for a system independent random number generator
+ *
+ * Revision 1.20  2000/10/29 00:06:27  weimer
+ * networking fixes, change "styles/" to "styles" so that it works on Windows
+ *
+ * Revision 1.19  2000/10/21 01:14:43  weimer
+ * massic autoconf/automake restructure ...
+ *
+ * Revision 1.18  2000/10/19 22:06:51  weimer
+ * minor changes ...
+ *
+ * Revision 1.17  2000/10/18 23:57:49  weimer
+ * general fixup, color changes, display changes.
+ * Notable: "Safe" Blits and Updates now perform "clipping". No more X errors,
+ * we hope!
+ *
+ * Revision 1.16  2000/10/13 18:23:28  weimer
+ * fixed a race condition in tetris_event()
+ *
+ * Revision 1.15  2000/10/13 17:55:36  weimer
+ * Added another color "Style" ...
+ *
+ * Revision 1.14  2000/10/13 15:41:53  weimer
+ * revamped AI support, now you can pick your AI and have AI duels (such fun!)
+ * the mighty Aliz AI still crashes a bit, though ... :-)
+ *
+ * Revision 1.13  2000/10/12 19:17:08  weimer
+ * Further support for AI players and multiple game types.
+ *
+ * Revision 1.12  2000/10/12 00:49:08  weimer
+ * added "AI" support and walking radio menus for initial game configuration
+ *
+ * Revision 1.11  2000/09/09 17:05:35  wkiri
+ * Hideous log changes (Wes: how dare you include a comment character!)
+ *
+ * Revision 1.10  2000/09/09 16:58:27  weimer
+ * Sweeping Change of Ultimate Mastery. Main loop restructuring to clean up
+ * main(), isolate the behavior of the three game types. Move graphic files
+ * into graphics/-, style files into styles/-, remove some unused files,
+ * add game flow support (breaks between games, remembering your level within
+ * this game), multiplayer support for the event loop, some global variable
+ * cleanup. All that and a bag of chips!
+ *
+ * Revision 1.9  2000/09/04 21:02:18  weimer
+ * Added some addition piece layout code, garbage now falls unless the row
+ * below it features some non-falling garbage
+ *
+ * Revision 1.8  2000/09/04 19:48:02  weimer
+ * interim menu for choosing among game styles, button changes (two states)
+ *
+ * Revision 1.7  2000/09/04 14:08:30  weimer
+ * Added another color scheme and color/piece scheme scanning code.
+ *
+ * Revision 1.6  2000/09/03 21:06:31  wkiri
+ * Now handles three different game types (and does different things).
+ * Major changes in display.c to handle this.
+ *
+ * Revision 1.5  2000/09/03 18:26:11  weimer
+ * major header file and automatic prototype generation changes, restructuring
+ *
+ * Revision 1.4  2000/08/20 16:14:10  weimer
+ * changed the piece generation so that pieces and colors cluster together
+ *
+ * Revision 1.3  2000/08/15 00:48:28  weimer
+ * Massive sound rewrite, fixed a few memory problems. We now have
+ * sound_styles that work like piece_styles and color_styles.
+ *
+ * Revision 1.2  2000/08/13 19:27:20  weimer
+ * added file changelogs
+ *
+ */
 
-    if (!count) {
-	/* do nothing */
-    } else {
-	Calloc(retval->p,person *,sizeof(person)*count);
-	i = 0;
-	while (!(feof(fin))) {
-	    char *p;
-	    do {
-		fgets(buf,sizeof(buf),fin);
-	    } while (!feof(fin) &&
-		    (buf[0] == '\n' || buf[0] == '#'));
-	    if (feof(fin)) break;
-	    if (strchr(buf,'\n'))
-		*(strchr(buf,'\n')) = 0;
+static SDL_mutex *sim_lock = NULL;
+static SDL_cond *sim_work;	/* signalled when a batch is queued */
+static SDL_cond *sim_finished;	/* signalled when a batch completes */
+static Sim_Batch *sim_queue = NULL;
+static int sim_workers = 0;
 
-	    sscanf(buf,"%d",&retval->p[i].level);
-	    p = strchr(buf,' ');
-	    if (!p) {
-		retval->p[i].name = "-garbled-";
-	    } else {
-		retval->p[i].name = strdup( p + 1 );
-	    }
-	    i++;
-	}
-    }
-    fclose(fin);
+/* what the game is currently dealing from, per thread */
+static __thread piece_style *sim_ps = NULL;
+static __thread color_style *sim_cs = NULL;
 
-    Debug("Identity File [%s] loaded (%d players).\n",ID_FILENAME, count);
+static __thread Grid sim_scratch_grid[SIM_SCRATCH];
 
-    return retval;
-}
+/* pool threads and headless games run the batches they start themselves */
+static __thread int sim_inline = 0;
+
+/* the headless clock: see sim_ticks() */
+static __thread int sim_virtual = 0;
+static __thread Uint32 sim_clock = 0;
+static __thread int sim_reads = 0;
 
 /***************************************************************************
- *      save_identity_file()
- * Saves the information to an identity file.
+ *      sim_num_cpus()
+ * How many processors can we keep busy?
  *********************************************************************PROTO*/
-void 
-save_identity_file(identity *id, char *new_name, int new_level)
+int
+sim_num_cpus(void)
 {
-    FILE *fin = fopen(ID_FILENAME,"wt");
-    int i;
-    if (!fin) {
-	Debug("fopen(%s): cannot write Identity File.\n",ID_FILENAME);
-	return;
-    }
-    fprintf(fin,"# Alizarin Tetris Identity File\n"
-	        "#\n"
-		"# Format:\n"
-		"#[level] [name] (no space before level, one space after)\n"
-		);
-    for (i=0; i<id->n ;i++) {
-	fprintf(fin,"%d %s\n",id->p[i].level, id->p[i].name);
-    }
-    if (new_name)  {
-	fprintf(fin,"%d %s\n",new_level, new_name);
-    }
-
-#ifdef DEBUG
-    Debug("Identity File [%s] saved (%d players).\n",ID_FILENAME, id->n +
-	    (new_name != NULL));
+#ifdef _SC_NPROCESSORS_ONLN
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > 0)
+	return (int) n;
 #endif
-    fclose(fin);
-    return;
+    return 1;
 }
 
 /***************************************************************************
- *      network_choice_action()
- * What to do when they click on the network choice button ...
+ *      sim_worker()
+ * Runs jobs off the queue forever.
  ***************************************************************************/
 static int
-network_choice_action(WalkRadio *wr) 
-{
-    if (wr->defaultchoice == 0) {
-	/* I am client */
-	clear_screen_to_flame();
-	draw_string("Who is the Server?", color_network_menu, screen->w/2,
-		screen->h/2, DRAW_LEFT | DRAW_UPDATE);
-	wr->data = input_string(screen, screen->w/2, screen->h/2, 0);
-    } else if (wr->data) {
-	Free(wr->data);
-    } else
-	wr->data = NULL;
-    return 1;
-}
-
-/***************************************************************************
- *      network_choice()
- * Do you want to be the client or the server? Returns the hostname.
- *********************************************************************PROTO*/
-char *
-network_choice(SDL_Surface *screen)
+sim_worker(void *unused)
 {
-    static WalkRadioGroup *wrg = NULL;
-    SDL_Event event;
-
-    if (!wrg) {
-	wrg = create_single_wrg( 2 ) ; 
-	wrg->wr[0].label[0] = "I am the Client. I will specify a server.";
-	wrg->wr[0].label[1] = "I will be the Server.";
-
-	setup_radio(&wrg->wr[0]);
-	wrg->wr[0].x = (screen->w - wrg->wr[0].area.w) / 2;
-	wrg->wr[0].y = (screen->h - wrg->wr[0].area.h) / 2;
-	wrg->wr[0].action = network_choice_action;
-    }
-
-    clear_screen_to_flame();
+    sim_inline = 1;
+    SDL_mutexP(sim_lock);
+    for (;;) {
+	Sim_Batch *b;
+	int i;
 
-    draw_string("Who is the Server?", color_network_menu, 
-	    screen->w/2, wrg->wr[0].y, DRAW_CENTER | DRAW_UPDATE | DRAW_ABOVE);
+	while (sim_queue == NULL)
+	    SDL_CondWait(sim_work, sim_lock);
+	b = sim_queue;
+	i = b->next++;
+	if (b->next == b->n)
+	    sim_queue = b->link;
+	SDL_mutexV(sim_lock);
 
-    draw_radio(&wrg->wr[0], 1);
+	b->job(b->arg, i);
 
-    while (1) {
-	int retval;
-	poll_and_flame(&event);
-	retval = handle_radio_event(wrg, &event);
-	if (retval != -1)
-	    return wrg->wr[0].data;
+	SDL_mutexP(sim_lock);
+	if (++b->done == b->n)
+	    SDL_CondBroadcast(sim_finished);
     }
+    return 0;
 }
 
 /***************************************************************************
- *	new_player()
- * Add another player ... Displays a little dialog so that the new player
- * can enter a new name and a new level. 
- **************************************************************************/
-static
-void new_player(SDL_Surface * screen, identity **id)
+ *      sim_start()
+ * Starts the worker pool if it is not running yet. Options.ai_threads
+ * says how big it should be; 0 means one thread per processor.
+ *********************************************************************PROTO*/
+void
+sim_start(void)
 {
-    char *new_name, *new_level;
-    int level;
-    clear_screen_to_flame();
+    int i;
 
-    draw_string("Enter your name:", color_who_are_you, screen->w / 2,
-	    screen->h / 2, DRAW_CLEAR | DRAW_LEFT);
+    if (sim_lock)
+	return;
+    sim_lock = SDL_CreateMutex();
+    sim_work = SDL_CreateCond();
+    sim_finished = SDL_CreateCond();
+    if (!sim_lock || !sim_work || !sim_finished)
+	PANIC("Cannot create the simulation locks: %s", SDL_GetError());
 
-    new_name = input_string(screen, screen->w/2, screen->h/2, 0);
+    sim_workers = Options.ai_threads > 0 ? Options.ai_threads : sim_num_cpus();
+    for (i=0; i<sim_workers; i++)
+	if (!SDL_CreateThread(sim_worker, NULL))
+	    PANIC("Cannot create simulation thread %d: %s", i, SDL_GetError());
+    Debug("Simulation pool started (%d threads).\n", sim_workers);
+}
 
-    if (strlen(new_name)) {
-	clear_screen_to_flame();
-	draw_string("Welcome ", color_purple, screen->w/2,
-		screen->h/2, DRAW_CLEAR | DRAW_LEFT | DRAW_LARGE | DRAW_ABOVE);
-	draw_string(new_name, color_purple, screen->w/2,
-		screen->h/2, DRAW_CLEAR | DRAW_LARGE | DRAW_ABOVE);
-	draw_string("Starting level (2-10):", color_who_are_you, screen->w
-		/ 2, screen->h / 2, DRAW_CLEAR | DRAW_LEFT);
-	new_level = input_string(screen, screen->w/2, screen->h/2, 0);
-	level = 0;
-	sscanf(new_level,"%d",&level);
-	if (level < 2) level = 2;
-	if (level > 10) level = 10;
+/***************************************************************************
+ *      sim_batch_start()
+ * Queues n jobs and returns at once: poll sim_batch_done() or block in
+ * sim_batch_wait(). The batch must stay put until it is done.
+ *
+ * A job that starts a batch of its own (an AI playing inside a headless
+ * game, say) gets it run right there: every other thread may well be
+ * waiting on a job just like it. So does a headless game, which wants
+ * the answer now and the same answer every time.
+ *********************************************************************PROTO*/
+void
+sim_batch_start(Sim_Batch *b, void (*job)(void *arg, int i), void *arg, int n)
+{
+    Sim_Batch **tail;
 
-	save_identity_file(*id, new_name, level);
+    b->job = job;
+    b->arg = arg;
+    b->n = n;
+    b->next = 0;
+    b->done = 0;
+    b->link = NULL;
+    if (n <= 0) 
+	return;
+    if (sim_inline) {
+	for (b->next = 0; b->next < n; b->next++) 
+	    job(arg, b->next);
+	b->done = n;
+	return;
+    }
 
-	(*id) = load_identity_file();
+    sim_start();
 
-	free(new_level);
-    }
-    free(new_name);
+    SDL_mutexP(sim_lock);
+    for (tail = &sim_queue; *tail; tail = &(*tail)->link)
+	;
+    *tail = b;
+    SDL_CondBroadcast(sim_work);
+    SDL_mutexV(sim_lock);
 }
 
-
 /***************************************************************************
- *      who_are_you()
- * Asks the player to choose an identity ...
- * Returns -1 on "cancel". 
+ *      sim_batch_done()
+ * Returns 1 if every job in the batch has finished.
  *********************************************************************PROTO*/
-int 
-who_are_you(SDL_Surface *screen, identity **id, int taken, int p)
+int
+sim_batch_done(Sim_Batch *b)
 {
-    WalkRadioGroup *wrg = NULL;
-    int i;
     int retval;
-    SDL_Event event;
-    char buf[1024];
-
-restart: 	/* sigh! */
-    wrg = create_single_wrg((*id)->n + 2);
-    for (i=0; i<(*id)->n; i++) {
-	if (i == taken)
-	    sprintf(buf,"%s (already taken!)",(*id)->p[i].name);
-	else
-	    sprintf(buf,"%s (Level %d)",(*id)->p[i].name, (*id)->p[i].level);
-	wrg->wr[0].label[i] = strdup(buf);
-    }
-    wrg->wr[0].label[(*id)->n] = "-- New Player --";
-    wrg->wr[0].label[(*id)->n+1] = "-- Cancel --";
 
-    setup_radio(&wrg->wr[0]);
-    wrg->wr[0].x = (screen->w - wrg->wr[0].area.w) / 2;
-    wrg->wr[0].y = (screen->h - wrg->wr[0].area.h) / 2;
-    wrg->wr[0].action = NULL /* return default choice */;
+    if (b->n <= 0 || sim_inline)
+	return 1;
+    SDL_mutexP(sim_lock);
+    retval = (b->done == b->n);
+    SDL_mutexV(sim_lock);
+    return retval;
+}
 
-    clear_screen_to_flame();
+/***************************************************************************
+ *      sim_batch_wait()
+ * Blocks until every job in the batch has finished.
+ *********************************************************************PROTO*/
+void
+sim_batch_wait(Sim_Batch *b)
+{
+    if (b->n <= 0 || sim_inline)
+	return;
+    SDL_mutexP(sim_lock);
+    while (b->done != b->n)
+	SDL_CondWait(sim_finished, sim_lock);
+    SDL_mutexV(sim_lock);
+}
 
-    if (p == 1)  {
-	draw_string("Left = A  Rotate = W  Right = D  Drop = S", color_keys_explain,
-		screen->w / 2, 0, DRAW_CENTER | DRAW_UPDATE);
-	draw_string("Player 1: Who Are You?", color_who_are_you,
-		screen->w / 2, wrg->wr[0].y - 30, DRAW_CENTER | DRAW_UPDATE);
-    } else {
-	draw_string("Use the Arrow keys. Rotate = Up  Drop = Down", color_keys_explain,
-		screen->w / 2, 0, DRAW_CENTER | DRAW_UPDATE);
-	draw_string("Player 2: Who Are You?", color_who_are_you,
-		screen->w / 2, wrg->wr[0].y - 30, DRAW_CENTER | DRAW_UPDATE);
-    }
+/***************************************************************************
+ *      sim_run()
+ * Runs job(arg, i) for every i in [0,n) across the pool and waits for
+ * all of them.
+ *********************************************************************PROTO*/
+void
+sim_run(void (*job)(void *arg, int i), void *arg, int n)
+{
+    Sim_Batch b;
 
-    draw_radio(&wrg->wr[0], 1);
+    sim_batch_start(&b, job, arg, n);
+    sim_batch_wait(&b);
+}
 
-    while (1) {
-	poll_and_flame(&event);
+/***************************************************************************
+ *      sim_scratch()
+ * Returns scratch grid "which" (0 to SIM_SCRATCH-1) of the calling thread,
+ * sized w by h. Its contents are whatever the last caller left there.
+ *********************************************************************PROTO*/
+Grid *
+sim_scratch(int which, int w, int h)
+{
+    Grid *g;
 
-	retval = handle_radio_event(wrg, &event);
-	if (retval == -1 || retval == taken)
-	    continue;
-	if (retval == (*id)->n) {
-	    new_player(screen, id);
-	    goto restart;
-	}
-	if (retval == (*id)->n+1)
-	    return -1;
-	return retval;
+    Assert(which >= 0 && which < SIM_SCRATCH);
+    g = &sim_scratch_grid[which];
+    if (g->contents == NULL || g->w != w || g->h != h) {
+	if (g->contents) 
+	    free_board(g);
+	*g = generate_board(w, h, 0);
     }
-    return 0;
+    return g;
 }
 
-/*
- * $Log: identity.c,v $
- * Revision 1.16  2000/11/06 04:44:15  weimer
- * fixed that who-is-the-server thing
- *
- * Revision 1.15  2000/11/02 03:06:20  weimer
- * better interface for walk-radio menus: we are now ready for Kiri to change
- * them to add run-time options ...
- *
- * Revision 1.14  2000/11/01 03:53:06  weimer
- * modifications for version 1.0.1: you can pick your starting level, you can
- * pick the AI difficulty factor, the game is better about placing new pieces
- * when there is garbage, when things fall out of your control they now fall
- * at a uniform rate ...
- *
- * Revision 1.13  2000/10/29 21:28:58  weimer
- * fixed a few failures to clear the screen if we didn't have a flaming
- * backdrop
- *
- * Revision 1.12  2000/10/29 21:23:28  weimer
- * One last round of header-file changes to reflect my newest and greatest
- * knowledge of autoconf/automake. Now if you fail to have some bizarro
- * function, we try to go on anyway unless it is vastly needed.
- *
- * Revision 1.11  2000/10/29 19:04:33  weimer
- * minor highscore handling changes: new filename, use the draw_string() and
- * draw_bordered_rect() and input_string() interfaces, handle the widget layer
- * and the flame layer, etc. Also fix a minor bug where you would be prevented
- * from settling if you pressed a key even if it didn't really move you. :-)
- *
- * Revision 1.10  2000/10/29 17:23:13  weimer
- * incorporate "xflame" flaming background for added spiffiness ...
- *
- * Revision 1.9  2000/10/28 22:33:18  weimer
- * add a blinking cursor to the input string widget
- *
- * Revision 1.8  2000/10/28 16:40:17  weimer
- * Further changes: we can now build .tar.gz files and RPMs!
- *
- * Revision 1.7  2000/10/21 01:14:43  weimer
- * massic autoconf/automake restructure ...
- *
- * Revision 1.6  2000/10/18 23:57:49  weimer
- * general fixup, color changes, display changes.
- * Notable: "Safe" Blits and Updates now perform "clipping". No more X errors,
- * we hope!
- *
- * Revision 1.5  2000/10/18 02:04:02  weimer
- * playability changes ...
- *
- * Revision 1.4  2000/10/14 01:56:35  weimer
- * remove dates from identity files
- *
- * Revision 1.3  2000/10/13 15:41:53  weimer
- * revamped AI support, now you can pick your AI and have AI duels (such fun!)
- * the mighty Aliz AI still crashes a bit, though ... :-)
- *
- * Revision 1.2  2000/10/13 02:26:54  weimer
- * rudimentary identity functions, including adding new players
- *
- * Revision 1.1  2000/10/12 01:38:07  weimer
- * added initial support for persistent player identities
- *
- */
-
 /***************************************************************************
- *      menu()
- * Create a new menu and return it.
+ *      sim_copy_grid()
+ * Makes "to" look like "from" (contents and falling state).
  *********************************************************************PROTO*/
-ATMenu* menu(int nButtons, char** strings, int defaultchoice,
-	     Uint32 face_color0, Uint32 text_color0,
-	     Uint32 face_color1, Uint32 text_color1, int x, int y)
+void
+sim_copy_grid(Grid *to, Grid *from)
 {
-  int i, yp;
-  ATMenu* am = (ATMenu*)malloc(sizeof(ATMenu)); assert(am);
+    Assert(to->w == from->w && to->h == from->h);
+    memcpy(to->contents, from->contents, from->w * from->h * sizeof(from->contents[0]));
+    memcpy(to->fall, from->fall, from->w * from->h * sizeof(from->fall[0]));
+}
 
-  /* Create the buttons */
-  am->buttons = (ATButton**)malloc(nButtons*sizeof(ATButton*)); 
-  assert(am->buttons);
-  am->clicked = (char*)malloc(nButtons*sizeof(char)); assert(am->clicked);
-  am->nButtons = nButtons;
-  am->x = x; am->y = y;
-  am->defaultchoice = defaultchoice;
+/***************************************************************************
+ *      sim_set_styles()
+ * Tells the AIs on this thread which piece and color styles the pieces
+ * they are given come from, so that they can guess at the ones to come.
+ *********************************************************************PROTO*/
+void
+sim_set_styles(piece_style *ps, color_style *cs)
+{
+    sim_ps = ps;
+    sim_cs = cs;
+}
 
-  yp = y;
+/***************************************************************************
+ *      sim_get_styles()
+ * Returns 0 if nobody has called sim_set_styles() on this thread.
+ *********************************************************************PROTO*/
+int
+sim_get_styles(piece_style **ps, color_style **cs)
+{
+    *ps = sim_ps;
+    *cs = sim_cs;
+    return sim_ps != NULL && sim_cs != NULL;
+}
 
-  Assert(nButtons >= 0);
+/***************************************************************************
+ *      sim_virtual_clock()
+ * Switches the calling thread over to the headless clock (on != 0) or
+ * back to SDL_GetTicks(). 
+ *********************************************************************PROTO*/
+void
+sim_virtual_clock(int on)
+{
+    sim_virtual = on;
+    sim_clock = 0;
+    sim_reads = 0;
+}
 
-  for (i=0; i<nButtons; i++)
-    {
-      /* Line them up x-wise */
-      am->buttons[i] = button(strings[i], face_color0, text_color0,
-			      face_color1, text_color1, x, yp);
-      yp += am->buttons[i]->area.h; /* add a separating space? */
-      am->clicked[i] = FALSE;
+/***************************************************************************
+ *      sim_ticks()
+ * What the AIs use for a clock. In a game on the screen that is just
+ * SDL_GetTicks(); headless, a "millisecond" passes every SIM_TICK_READS
+ * times somebody looks at the clock, so an AI that thinks "until the
+ * clock ticks" does the same amount of work on every machine and a game
+ * played from a given seed always comes out the same way.
+ *********************************************************************PROTO*/
+Uint32
+sim_ticks(void)
+{
+    if (!sim_virtual)
+	return SDL_GetTicks();
+    if (++sim_reads >= SIM_TICK_READS) {
+	sim_reads = 0;
+	sim_clock++;
     }
+    return sim_clock;
+}
 
-  am->w = am->buttons[0]->area.w;
-  am->h = (am->buttons[nButtons-1]->area.y - am->buttons[0]->area.y)
-    + am->buttons[nButtons-1]->area.h;
-  /* Set the default one */
-  if (defaultchoice >= 0) am->clicked[defaultchoice] = TRUE;
+/***************************************************************************
+ *      sim_peek_ticks()
+ * What sim_ticks() would say, without counting as a look at the headless
+ * clock: for keeping books on the AIs without changing what they do.
+ *********************************************************************PROTO*/
+Uint32
+sim_peek_ticks(void)
+{
+    return sim_virtual ? sim_clock : SDL_GetTicks();
+}
 
-  return am;
+/***************************************************************************
+ *      sim_now()
+ * Wall-clock seconds, for measuring. Only differences mean anything.
+ *********************************************************************PROTO*/
+double
+sim_now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
 }
 
 /***************************************************************************
- *      show_menu()
- * Displays the menu.
+ *      sim_fall()
+ * How many pixels a piece falls between AI inputs in an AI_VS_AI game at
+ * the given level.
  *********************************************************************PROTO*/
-void show_menu(ATMenu* am)
+int
+sim_fall(int level)
 {
-  int i;
-  for (i=0; i<am->nButtons; i++)
-    show_button(am->buttons[i], am->clicked[i]);
+    int fei, ai_interval;
+
+    if (SPEED_LEVEL(level) <= 7)
+	fei = 45 - SPEED_LEVEL(level) * 5;
+    else 
+	fei = 16 - SPEED_LEVEL(level);
+    if (fei < 1) fei = 1;
+    ai_interval = min(fei, 15);
+    return (ai_interval * 5 + fei - 1) / fei;
 }
 
 /***************************************************************************
- *      check_menu()
- * Returns the index of the button that was clicked (-1 if none).
+ *      sim_decide()
+ * Has the AI decide where piece cp goes, the way it would in a headless
+ * game: ai_new_piece() (played is where the last piece went, or NULL),
+ * then the opening book (see book_lookup(): "pieces" have been placed on
+ * g so far), then think() until target()
+ * has an answer. Either only counts if ai_plan() can steer the piece
+ * there at "fall" pixels a step.
+ * AIs without target() steer with move() instead, one input per think().
+ * Returns 1 with the placement in *col, *row and *rot; 0 if the goal was
+ * out of reach, in which case the piece drops where it appeared; and -1
+ * if the piece does not fit on the board at all.
  *********************************************************************PROTO*/
-int check_menu(ATMenu* am, int x, int y)
+int
+sim_decide(AI_Player *ai, void **state, Grid *g, play_piece *cp,
+	play_piece *np, AI_Placement *played, int pieces, int bw, int fall,
+	int *col, int *row, int *rot)
 {
-  int i, j;
-  for (i=0; i<am->nButtons; i++)
-    if (check_button(am->buttons[i], x, y)) 
-      {
-	/* invert its clicked state */
-	if (am->clicked[i])
-	  {
-	    am->clicked[i] = FALSE;
-	    /* reset the default */
-	    am->clicked[am->defaultchoice] = TRUE;
-	    show_button(am->buttons[am->defaultchoice],
-			am->clicked[am->defaultchoice]);
-	  }
-	else
-	  {
-	    /* blank all others */
-	    for (j=0; j<am->nButtons; j++)
-	      if (i!=j && am->clicked[j])
-		{
-		  am->clicked[j] = FALSE;
-		  show_button(am->buttons[j], am->clicked[j]);
-		}
-	    am->clicked[i] = TRUE;
-	  }
-	/* redraw it */
-	show_button(am->buttons[i], am->clicked[i]);
-	Debug("Button %d was clicked.\n", i);
-	return i;
-      }
-  return -1;
+    int y, i, retval = 1;
+    AI_Placement goal;
+    AI_Plan plan;
+
+    if (!ai_spawn(g, cp, bw, col, &y, rot))
+	return -1;
+    *row = y / bw;
+
+    *state = ai_new_piece(ai, *state, g, cp, played);
+    /* the opening book, if it knows this one, saves the AI the trouble */
+    if (book_lookup(g, pieces, cp, np, &goal) &&
+	    ai_plan(g, cp, bw, *col, y, *rot, &goal, fall, &plan) >= 0) {
+	*col = goal.col;
+	*rot = goal.rot;
+	if (goal.row >= 0)
+	    *row = goal.row;
+	return 1;
+    }
+    if (ai->target) {
+	for (i=0; i<SIM_THINK_MAX; i++) {
+	    ai_think(ai, NULL, *state, g, cp, np, *col, *row, *rot);
+	    if (ai->target(*state, g, cp, *row, &goal))
+		break;
+	}
+	/* the piece only goes there if it could have been steered there */
+	if (ai_plan(g, cp, bw, *col, y, *rot, &goal, fall, &plan) >= 0) {
+	    *col = goal.col;
+	    *rot = goal.rot;
+	    if (goal.row >= 0)
+		*row = goal.row;
+	} else 
+	    retval = 0;
+    } else {
+	for (i=0; i<SIM_THINK_MAX; i++) {
+	    Command m;
+	    ai_think(ai, NULL, *state, g, cp, np, *col, y / bw, *rot);
+	    m = ai->move(*state, g, cp, np, *col, y / bw, *rot);
+	    if (ai_step(g, cp, bw, m, fall, col, &y, rot))
+		break;
+	}
+	*row = y / bw;
+    }
+    return retval;
 }
 
 /***************************************************************************
- *      delete_menu()
- * Deletes the menu and all of its buttons.
+ *      sim_turn()
+ * Player P gets a piece, decides where it goes and puts it there.
+ * Returns SIM_LOST if the piece did not fit, SIM_WON if that cleared the
+ * last of the garbage and 0 otherwise.
+ ***************************************************************************/
+#define SIM_LOST	1
+#define SIM_WON		2
+static int
+sim_turn(Sim_Game *sg, int P)
+{
+    Sim_Player *me = &sg->p[P];
+    Grid *g = &me->g;
+    int col, row, rot, lines, i, r;
+    Uint32 seed;
+    double start;
+    AI_Counters mark;
+
+    start = sim_now();
+    ai_set_thread_weights(me->weights);
+    ai_counters_mark(&mark);
+    r = sim_decide(me->ai, &me->state, g, &me->cp, &me->np,
+	    me->pieces ? &me->last : NULL, me->pieces, sg->cs->w, sg->fall,
+	    &col, &row, &rot);
+    ai_counters_add(&me->c, &mark);
+    if (r < 0)
+	return SIM_LOST;
+    me->think_time += sim_now() - start;
+    if (r == 0)
+	me->unreachable++;
+    me->decisions++;
+    if (sg->record)
+	sg->record(sg->record_arg, sg, P, col, row, rot, r);
+
+    lines = drop_piece_on_grid(g, &me->cp, col, row, rot);
+    if (lines < 0)
+	return SIM_LOST;
+
+    me->pieces++;
+    me->last.col = col;
+    me->last.row = row;
+    me->last.rot = rot;
+    me->lines += lines;
+    me->score += lines * lines * sg->level;
+    if (lines >= 5) {
+	Grid *them = &sg->p[!P].g;
+	add_garbage_r(them, &sg->garbage_seed);
+	cleanup_grid(them);
+	me->garbage_sent++;
+    }
+
+    for (i=0; i<g->w * g->h; i++)
+	if (g->contents[i] == 1)
+	    break;
+    if (i == g->w * g->h)
+	return SIM_WON;
+
+    me->cp = me->np;
+    seed = me->seq++;
+    me->np = generate_piece_r(sg->ps, sg->cs, &seed);
+    return 0;
+}
+
+/***************************************************************************
+ *      sim_play_game()
+ * Plays one AI_VS_AI game off-screen: both players start on the same
+ * board at sg->level and get the same pieces, and they take turns
+ * placing them. The AIs think on the headless clock for as long as they
+ * like, but the planner must be able to steer the piece to where they
+ * want it at the speed it would fall on the screen. Clearing five lines
+ * or more with one piece sends the other player garbage, as usual.
+ *
+ * The players' ai fields must be set and their state fields are handed
+ * to reset(): NULL gives every game a fresh start. A player whose weights
+ * are not NULL evaluates boards by them instead of the profile. States
+ * are released at the end if the AI knows how.
+ *
+ * Returns the winner (0 or 1), or -1 if nobody had won after
+ * sg->max_pieces pieces each.
  *********************************************************************PROTO*/
-void delete_menu(ATMenu* am)
-{
-  int i;
-  for (i=0; i<am->nButtons; i++)
-    Free(am->buttons[i]);
-  Free(am);
+int
+sim_play_game(Sim_Game *sg)
+{
+    int P, turn;
+    int was_inline = sim_inline;
+    Uint32 seed = sg->seed;
+
+    sim_virtual_clock(1);
+    sim_inline = 1;
+    sim_set_styles(sg->ps, sg->cs);
+
+    sg->fall = sim_fall(sg->level);
+
+    sg->p[0].g = generate_board_r(10, 20, sg->level, &seed);
+    sg->p[1].g = generate_board(10, 20, 0);
+    sim_copy_grid(&sg->p[1].g, &sg->p[0].g);
+    sg->garbage_seed = seed;
+
+    for (P=0; P<2; P++) {
+	Sim_Player *me = &sg->p[P];
+	me->seq = sg->seed;
+	seed = me->seq++;
+	me->cp = generate_piece_r(sg->ps, sg->cs, &seed);
+	seed = me->seq++;
+	me->np = generate_piece_r(sg->ps, sg->cs, &seed);
+	me->score = me->lines = me->pieces = me->decisions = 0;
+	me->garbage_sent = me->unreachable = 0;
+	me->think_time = 0.0;
+	memset(&me->c, 0, sizeof(me->c));
+    }
+
+    sg->winner = -1;
+    for (turn=0; turn < sg->max_pieces && sg->winner < 0; turn++) 
+	for (P=0; P<2; P++) {
+	    int r = sim_turn(sg, P);
+	    if (r == SIM_LOST) { sg->winner = !P; break; }
+	    if (r == SIM_WON) { sg->winner = P; break; }
+	}
+
+    for (P=0; P<2; P++) {
+	Sim_Player *me = &sg->p[P];
+	free_board(&me->g);
+	if (me->ai->release && me->state) {
+	    me->ai->release(me->state);
+	    me->state = NULL;
+	}
+    }
+    ai_set_thread_weights(NULL);
+    sim_virtual_clock(0);
+    sim_inline = was_inline;
+    return sg->winner;
 }
 
-#define BORDER_X	8
-#define BORDER_Y	8
-#define BUTTON_X_SPACE	4
-#define RADIO_HEIGHT	12
+/* everything the game jobs need to see */
+typedef struct tournament_run_struct {
+    Tournament *t;
+    AI_Players *ai;
+    piece_style *ps;
+    color_style *cs;
+    int *first;		/* pairing k is first[k] against second[k] */
+    int *second;
+    Sim_Game *game;	/* t->games per pairing */
+} Tournament_Run;
 
 /***************************************************************************
- *      setup_radio()
- * Prepared a WalkRadio button for display.
- *********************************************************************PROTO*/
-void
-setup_radio(WalkRadio *wr)
+ *      tournament_game_job()
+ * Plays game i of the tournament. The games of a pairing come in twos on
+ * the same seed, so each AI gets to move first on every deal.
+ ***************************************************************************/
+static void
+tournament_game_job(void *arg, int i)
 {
-    int i;
-    int our_height;
+    Tournament_Run *tr = (Tournament_Run *) arg;
+    Tournament *t = tr->t;
+    Sim_Game *sg = &tr->game[i];
+    int k = i / t->games, r = i % t->games;
+    int a = tr->first[k], b = tr->second[k];
 
-    wr->face_color[0] = int_button_face0;
-    wr->face_color[1] = int_button_face1;
-    wr->text_color[0] = int_button_text0;
-    wr->text_color[1] = int_button_text1;
-    wr->border_color[0] = int_button_border0;
-    wr->border_color[1] = int_button_border1;
+    if (r & 1) {
+	int swap = a; a = b; b = swap;
+    }
 
-    wr->bitmap0 = malloc(sizeof(SDL_Surface *) * wr->n); Assert(wr->bitmap0);
-    wr->bitmap1 = malloc(sizeof(SDL_Surface *) * wr->n); Assert(wr->bitmap1);
-    wr->w = 0;
-    wr->h = 0;
+    sg->level = t->level;
+    sg->seed = t->seed + r / 2;
+    sg->max_pieces = t->max_pieces;
+    sg->ps = tr->ps;
+    sg->cs = tr->cs;
+    sg->p[0].ai = &tr->ai->player[a];
+    sg->p[0].state = NULL;
+    sg->p[1].ai = &tr->ai->player[b];
+    sg->p[1].state = NULL;
 
-    for (i=0; i<wr->n; i++) {
-	SDL_Color sc;
+    sim_play_game(sg);
+}
 
-	SDL_GetRGB(wr->text_color[0], screen->format, &sc.r, &sc.g, &sc.b);
-	wr->bitmap0[i] = TTF_RenderText_Blended(sfont, wr->label[i], sc);
-	Assert(wr->bitmap0[i]);
+/***************************************************************************
+ *      tournament_elo()
+ * Fits Bradley-Terry strengths to the results (score[i*n+j] is what i
+ * scored against j, a draw being half a win, out of games[i*n+j]) and
+ * puts them on the Elo scale around TOURNAMENT_ELO_BASE. Everybody is
+ * given one extra draw against everybody else so that a perfect record
+ * does not come out infinite.
+ ***************************************************************************/
+static void
+tournament_elo(int n, double *score, double *games, Tournament_Record *rec)
+{
+    double *gamma, *next;
+    int i, j, iter;
 
-	SDL_GetRGB(wr->text_color[1], screen->format, &sc.r, &sc.g, &sc.b);
-	wr->bitmap1[i] = TTF_RenderText_Blended(sfont, wr->label[i], sc);
-	Assert(wr->bitmap1[i]);
+    Calloc(gamma, double *, n * sizeof(*gamma));
+    Calloc(next, double *, n * sizeof(*next));
+    for (i=0; i<n; i++)
+	gamma[i] = 1.0;
 
-	if (wr->bitmap0[i]->w + BUTTON_X_SPACE > wr->w) 
-	    wr->w = wr->bitmap0[i]->w + BUTTON_X_SPACE;
-	if (wr->bitmap0[i]->h > wr->h) wr->h = wr->bitmap0[i]->h;
+    for (iter=0; iter<1000; iter++) {
+	double change = 0.0, logsum = 0.0;
+
+	for (i=0; i<n; i++) {
+	    double w = 0.0, d = 0.0;
+	    for (j=0; j<n; j++) {
+		if (j == i) continue;
+		w += score[i*n+j] + 0.5;
+		d += (games[i*n+j] + 1.0) / (gamma[i] + gamma[j]);
+	    }
+	    next[i] = d > 0 ? w / d : 1.0;
+	    logsum += log(next[i]);
+	}
+	for (i=0; i<n; i++) {
+	    double g = next[i] / exp(logsum / n);
+	    change = max(change, fabs(g - gamma[i]) / gamma[i]);
+	    gamma[i] = g;
+	}
+	if (change < 1e-9)
+	    break;
     }
-    wr->w += 5 ;
-    wr->h += 10 ;
-    wr->area.w = wr->w + BORDER_X;
+    for (i=0; i<n; i++)
+	rec[i].elo = TOURNAMENT_ELO_BASE + 400.0 * log10(gamma[i]);
+    free(gamma);
+    free(next);
+}
 
-    our_height = RADIO_HEIGHT;
-    if (wr->n < our_height) our_height = wr->n;
+/***************************************************************************
+ *      tournament_play()
+ * Plays t->games games between every two AIs, spread over the worker
+ * pool, and prints how everybody did. Nothing is drawn and nothing is
+ * heard: the styles may have been loaded without a screen. Returns 0.
+ *********************************************************************PROTO*/
+int
+tournament_play(Tournament *t, AI_Players *ai, piece_style *ps,
+	color_style *cs)
+{
+    Tournament_Run tr;
+    Tournament_Record *rec;
+    double *score, *games;
+    double start, elapsed;
+    int n = ai->n, npair = n * (n-1) / 2, ngame, total_pieces = 0;
+    int i, j, k;
+
+    if (t->games < 1) t->games = 1;
+    if (t->max_pieces < 1) t->max_pieces = 1000;
+    ngame = npair * t->games;
+
+    tr.t = t;
+    tr.ai = ai;
+    tr.ps = ps;
+    tr.cs = cs;
+    Calloc(tr.first, int *, npair * sizeof(int));
+    Calloc(tr.second, int *, npair * sizeof(int));
+    Calloc(tr.game, Sim_Game *, ngame * sizeof(Sim_Game));
+    k = 0;
+    for (i=0; i<n; i++)
+	for (j=i+1; j<n; j++) {
+	    tr.first[k] = i;
+	    tr.second[k] = j;
+	    k++;
+	}
 
-    wr->area.h = wr->h * our_height + BORDER_Y;
-    return;
+    sim_start();
+    printf("Tournament: %d AIs, %d games per pairing, level %d, seed %u, "
+	    "%d threads\n", n, t->games, t->level, (unsigned) t->seed,
+	    Options.ai_threads > 0 ? Options.ai_threads : sim_num_cpus());
+    fflush(stdout);
+
+    start = sim_now();
+    sim_run(tournament_game_job, &tr, ngame);
+    elapsed = sim_now() - start;
+
+    /* add it all up */
+    Calloc(rec, Tournament_Record *, n * sizeof(*rec));
+    Calloc(score, double *, n * n * sizeof(*score));
+    Calloc(games, double *, n * n * sizeof(*games));
+    for (k=0; k<ngame; k++) {
+	Sim_Game *sg = &tr.game[k];
+	int who[2];
+	int P;
+
+	who[0] = sg->p[0].ai - ai->player;
+	who[1] = sg->p[1].ai - ai->player;
+	for (P=0; P<2; P++) {
+	    Tournament_Record *r = &rec[who[P]];
+	    Sim_Player *sp = &sg->p[P];
+	    r->games++;
+	    if (sg->winner < 0) r->drawn++;
+	    else if (sg->winner == P) r->won++;
+	    else r->lost++;
+	    r->pieces += sp->pieces;
+	    r->lines += sp->lines;
+	    r->decisions += sp->decisions;
+	    r->unreachable += sp->unreachable;
+	    r->think_time += sp->think_time;
+	    ai_counters_sum(&r->c, &sp->c);
+	    total_pieces += sp->pieces;
+
+	    games[who[P]*n + who[!P]] += 1.0;
+	    score[who[P]*n + who[!P]] +=
+		sg->winner < 0 ? 0.5 : (sg->winner == P ? 1.0 : 0.0);
+	}
+    }
+    tournament_elo(n, score, games, rec);
+
+    printf("\n%-16s %6s %6s %6s %6s %7s %7s %9s %11s %6s\n",
+	    "AI", "Games", "Won", "Lost", "Drawn", "Win%", "Elo",
+	    "Lines/pc", "Placed/sec", "Stuck");
+    for (i=0; i<n; i++) {
+	Tournament_Record *r = &rec[i];
+	printf("%-16.16s %6d %6d %6d %6d %6.1f%% %7.0f %9.3f %11.0f %6d\n",
+		ai->player[i].name, r->games, r->won, r->lost, r->drawn,
+		r->games ? 100.0 * (r->won + 0.5 * r->drawn) / r->games : 0.0,
+		r->elo,
+		r->pieces ? (double) r->lines / r->pieces : 0.0,
+		r->think_time > 0 ? r->decisions / r->think_time : 0.0,
+		r->unreachable);
+    }
+
+    printf("\nScore of row against column:\n%-16s", "");
+    for (j=0; j<n; j++)
+	printf(" %7.7s", ai->player[j].name);
+    printf("\n");
+    for (i=0; i<n; i++) {
+	printf("%-16.16s", ai->player[i].name);
+	for (j=0; j<n; j++)
+	    if (i == j || games[i*n+j] == 0)
+		printf(" %7s", "-");
+	    else
+		printf(" %6.1f%%", 100.0 * score[i*n+j] / games[i*n+j]);
+	printf("\n");
+    }
+    printf("\nWhere the time went:\n");
+    ai_counters_print(stdout, NULL, NULL);
+    for (i=0; i<n; i++)
+	ai_counters_print(stdout, ai->player[i].name, &rec[i].c);
+
+    printf("\n%d games, %d placements in %.2f seconds "
+	    "(%.1f games/sec, %.0f placements/sec)\n", ngame, total_pieces,
+	    elapsed, elapsed > 0 ? ngame / elapsed : 0.0,
+	    elapsed > 0 ? total_pieces / elapsed : 0.0);
+    fflush(stdout);
+
+    free(rec); free(score); free(games);
+    free(tr.first); free(tr.second); free(tr.game);
+    return 0;
 }
 
+/* everything the game jobs need to see */
+typedef struct tune_run_struct {
+    Tuner *t;
+    AI_Player *ai;
+    piece_style *ps;
+    color_style *cs;
+    Uint32 seed;	/* this generation's deals start here */
+    AI_Weights *cand;	/* lambda candidates */
+    Sim_Game *game;	/* t->games per candidate */
+} Tune_Run;
+
 /***************************************************************************
- *      check_radio()
- * Determines if we have clicked in a radio button.
+ *      tune_normal()
+ * A standard normal deviate (Box-Muller).
+ ***************************************************************************/
+static double
+tune_normal(Uint32 *seed)
+{
+    double u, v;
+
+    u = (FastRandom_r(seed, 65535) * 65536.0 + FastRandom_r(seed, 65535)
+	    + 1.0) / 4294967296.0;
+    v = (FastRandom_r(seed, 65535) * 65536.0 + FastRandom_r(seed, 65535))
+	/ 4294967296.0;
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+/***************************************************************************
+ *      tune_game_job()
+ * Game i of a generation: candidate i / t->games against the starting
+ * weights. The games of a candidate come in twos on the same deal, one
+ * from each side, and every candidate gets the same deals.
+ ***************************************************************************/
+static void
+tune_game_job(void *arg, int i)
+{
+    Tune_Run *tr = (Tune_Run *) arg;
+    Tuner *t = tr->t;
+    Sim_Game *sg = &tr->game[i];
+    int c = i / t->games, r = i % t->games;
+    int us = r & 1;
+
+    sg->level = t->level;
+    sg->seed = tr->seed + r / 2;
+    sg->max_pieces = t->max_pieces;
+    sg->ps = tr->ps;
+    sg->cs = tr->cs;
+    sg->p[0].ai = sg->p[1].ai = tr->ai;
+    sg->p[0].state = sg->p[1].state = NULL;
+    sg->p[us].weights = &tr->cand[c];
+    sg->p[!us].weights = NULL;
+
+    sim_play_game(sg);
+}
+
+/***************************************************************************
+ *      tune_play()
+ * Runs the tuner and writes the best weights found to t->out as a
+ * profile for --profile. The weights not being tuned stay as they are in
+ * the current profile. Returns 0, or 1 if there was nothing to tune.
  *********************************************************************PROTO*/
 int
-check_radio(WalkRadio *wr, int x, int y)
-{
-    if (wr->inactive) return 0;
+tune_play(Tuner *t, AI_Players *ais, piece_style *ps, color_style *cs)
+{
+    Tune_Run tr;
+    AI_Weights start_w, best_w;
+    double start_v[AI_WEIGHTS_N], scale[AI_WEIGHTS_N];
+    int dim[AI_WEIGHTS_N];
+    double *mean, *C, *pc, *ps_path, *z, *y, *yw, *fit, *wgt;
+    int *order;
+    int n = 0, lambda, mu, ngame, gen, i, j, k;
+    double mueff, c_sigma, d_sigma, c_c, c_1, c_mu, chi_n, sigma = 0.15;
+    double best_fit = -1.0;
+    Uint32 rng = t->seed;
+    char *who = (t->family == TUNE_ALIZ) ? TUNE_ALIZ_AI : TUNE_WES_AI;
+
+    tr.ai = NULL;
+    for (i=0; i<ais->n; i++)
+	if (!strcmp(ais->player[i].name, who))
+	    tr.ai = &ais->player[i];
+    if (!tr.ai) {
+	printf("Tuner: there is no [%s] to tune.\n", who);
+	return 1;
+    }
 
-    if (    x  >= wr->area.x &&
-	    x  <= wr->area.x + wr->area.w &&
-	    y  >= wr->area.y &&
-	    y  <= wr->area.y + wr->area.h   ) {
-	int start, stop;
-	int c;
+    /* the weights in play, measured in units of their starting values */
+    ai_get_profile(&start_w);
+    best_w = start_w;
+    ai_weights_get(&start_w, start_v);
+    for (i=0; i<AI_WEIGHTS_N; i++) {
+	int wes = (i < AI_BADNESS_W + 2);
+	if (wes == (t->family == TUNE_WES)) {
+	    scale[n] = start_v[i] != 0 ? fabs(start_v[i]) : 1.0;
+	    dim[n++] = i;
+	}
+    }
 
-	if (wr->n < RADIO_HEIGHT) {	/* draw them all */
-	    start = 0;
-	    stop = wr->n;
-	} else {		/* at least four */
-	    start = wr->defaultchoice - (RADIO_HEIGHT/2);
-	    if (start < 0) start = 0;
-	    stop = start + RADIO_HEIGHT;
-	    if (stop > wr->n) {	/* we're at the bottom */
-		start -= (stop - wr->n);
-		stop = wr->n;
+    /* the usual CMA-ES constants, with the separable learning rates */
+    lambda = 4 + (int) (3 * log(n));
+    mu = lambda / 2;
+    Calloc(wgt, double *, mu * sizeof(double));
+    for (i=0, mueff=0; i<mu; i++) {
+	wgt[i] = log(mu + 0.5) - log(i + 1.0);
+	mueff += wgt[i];
+    }
+    for (i=0; i<mu; i++)
+	wgt[i] /= mueff;
+    for (i=0, mueff=0; i<mu; i++)
+	mueff += wgt[i] * wgt[i];
+    mueff = 1.0 / mueff;
+    c_sigma = (mueff + 2) / (n + mueff + 5);
+    d_sigma = 1 + 2 * max(0.0, sqrt((mueff - 1) / (n + 1)) - 1) + c_sigma;
+    c_c = (4 + mueff / n) / (n + 4 + 2 * mueff / n);
+    c_1 = 2 / ((n + 1.3) * (n + 1.3) + mueff) * (n + 2) / 3.0;
+    c_mu = min(1 - c_1, 2 * (mueff - 2 + 1 / mueff) /
+	    ((n + 2) * (n + 2) + mueff) * (n + 2) / 3.0);
+    chi_n = sqrt(n) * (1 - 1.0 / (4 * n) + 1.0 / (21.0 * n * n));
+
+    Calloc(mean, double *, n * sizeof(double));
+    Calloc(C, double *, n * sizeof(double));
+    Calloc(pc, double *, n * sizeof(double));
+    Calloc(ps_path, double *, n * sizeof(double));
+    Calloc(z, double *, lambda * n * sizeof(double));
+    Calloc(y, double *, lambda * n * sizeof(double));
+    Calloc(yw, double *, n * sizeof(double));
+    Calloc(fit, double *, lambda * sizeof(double));
+    Calloc(order, int *, lambda * sizeof(int));
+    for (j=0; j<n; j++)
+	C[j] = 1.0;
+
+    if (t->games < 2) t->games = 2;
+    t->games &= ~1;
+    if (t->max_pieces < 1) t->max_pieces = 1000;
+    ngame = lambda * t->games;
+    tr.t = t;
+    tr.ps = ps;
+    tr.cs = cs;
+    Calloc(tr.cand, AI_Weights *, lambda * sizeof(AI_Weights));
+    Calloc(tr.game, Sim_Game *, ngame * sizeof(Sim_Game));
+
+    sim_start();
+    printf("Tuner: %d %s weights with %s, %d candidates x %d games per "
+	    "generation, level %d\n", n,
+	    t->family == TUNE_ALIZ ? "evalBoard()" : "weight_board()",
+	    who, lambda, t->games, t->level);
+    fflush(stdout);
+
+    for (gen=0; gen<t->generations; gen++) {
+	double ps_norm = 0, start, elapsed, sum_fit = 0;
+	int h_sigma;
+
+	/* sample lambda candidates around the mean */
+	for (k=0; k<lambda; k++) {
+	    double v[AI_WEIGHTS_N];
+	    memcpy(v, start_v, sizeof(v));
+	    for (j=0; j<n; j++) {
+		z[k*n+j] = tune_normal(&rng);
+		y[k*n+j] = sqrt(C[j]) * z[k*n+j];
+		v[dim[j]] = start_v[dim[j]] +
+		    scale[j] * (mean[j] + sigma * y[k*n+j]);
 	    }
+	    tr.cand[k] = start_w;
+	    ai_weights_set(&tr.cand[k], v);
 	}
-	c = (y - wr->area.y) / wr->h;
-	c += start;
-	if (c < 0) c = 0;
-	if (c >= wr->n) c = wr->n - 1;
-	wr->defaultchoice = c;
-	return 1;
+
+	/* play them all at once */
+	memset(tr.game, 0, ngame * sizeof(Sim_Game));
+	tr.seed = t->seed + gen * t->games;
+	start = sim_now();
+	sim_run(tune_game_job, &tr, ngame);
+	elapsed = sim_now() - start;
+
+	/*
+	 * Fitness is the score against the starting weights, a draw being
+	 * half a win, with lines per piece to break ties.
+	 */
+	for (k=0; k<lambda; k++) {
+	    double score = 0;
+	    int lines = 0, pieces = 0;
+	    for (i=k*t->games; i<(k+1)*t->games; i++) {
+		Sim_Game *sg = &tr.game[i];
+		int us = (i % t->games) & 1;
+		score += sg->winner < 0 ? 0.5 : (sg->winner == us);
+		lines += sg->p[us].lines;
+		pieces += sg->p[us].pieces;
+	    }
+	    fit[k] = score / t->games +
+		0.01 * (pieces ? (double) lines / pieces : 0);
+	    sum_fit += fit[k];
+	    for (j=k; j>0 && fit[order[j-1]] < fit[k]; j--)
+		order[j] = order[j-1];
+	    order[j] = k;
+	}
+	if (fit[order[0]] > best_fit) {
+	    char comment[256];
+	    best_fit = fit[order[0]];
+	    best_w = tr.cand[order[0]];
+	    sprintf(comment, "%s: fitness %.3f against the starting weights "
+		    "(generation %d, %d games at level %d)", who, best_fit,
+		    gen, t->games, t->level);
+	    ai_save_weights(t->out, &best_w, comment);
+	}
+
+	/* move the mean and adapt the step size and the variances */
+	for (j=0; j<n; j++) {
+	    double zw = 0;
+	    yw[j] = 0;
+	    for (i=0; i<mu; i++) {
+		yw[j] += wgt[i] * y[order[i]*n+j];
+		zw += wgt[i] * z[order[i]*n+j];
+	    }
+	    mean[j] += sigma * yw[j];
+	    ps_path[j] = (1 - c_sigma) * ps_path[j] +
+		sqrt(c_sigma * (2 - c_sigma) * mueff) * zw;
+	    ps_norm += ps_path[j] * ps_path[j];
+	}
+	ps_norm = sqrt(ps_norm);
+	h_sigma = ps_norm / sqrt(1 - pow(1 - c_sigma, 2 * (gen + 1)))
+	    < (1.4 + 2.0 / (n + 1)) * chi_n;
+	for (j=0; j<n; j++) {
+	    double rank_mu = 0;
+	    pc[j] = (1 - c_c) * pc[j] +
+		h_sigma * sqrt(c_c * (2 - c_c) * mueff) * yw[j];
+	    for (i=0; i<mu; i++) {
+		double d = y[order[i]*n+j];
+		rank_mu += wgt[i] * d * d;
+	    }
+	    C[j] = (1 - c_1 - c_mu) * C[j] +
+		c_1 * (pc[j] * pc[j] + (1 - h_sigma) * c_c * (2 - c_c) * C[j]) +
+		c_mu * rank_mu;
+	}
+	sigma *= exp((c_sigma / d_sigma) * (ps_norm / chi_n - 1));
+
+	printf("gen %3d  sigma %.3f  best %.3f  mean %.3f  so far %.3f  "
+		"(%.1f games/sec)\n", gen, sigma, fit[order[0]],
+		sum_fit / lambda, best_fit,
+		elapsed > 0 ? ngame / elapsed : 0.0);
+	fflush(stdout);
     }
+
+    printf("Best weights (fitness %.3f) are in [%s].\n", best_fit, t->out);
+    free(mean); free(C); free(pc); free(ps_path); free(z); free(y); free(yw);
+    free(fit); free(order); free(wgt); free(tr.cand); free(tr.game);
     return 0;
 }
 
+/* one position: a board and the two pieces the AI gets to see */
+typedef struct bench_position_struct {
+    Grid g;
+    int level;
+    play_piece cp;
+    play_piece np;
+    int pieces;		/* dropped on g to fill it */
+} Bench_Position;
+
+/* everything the job needs to see */
+typedef struct bench_run_struct {
+    Bench *b;
+    AI_Player *ai;
+    piece_style *ps;
+    color_style *cs;
+    Bench_Position *pos;
+    Bench_Result *r;
+} Bench_Run;
+
 /***************************************************************************
- *      clear_radio()
- * Clears away a WalkRadio button. Works even if I am inactive. 
- *********************************************************************PROTO*/
-void
-clear_radio(WalkRadio *wr)
+ *      bench_corpus()
+ * Makes up the positions: a board at levels 1 through 9 in turn with up
+ * to BENCH_MAX_FILL pieces dropped on it at random, stopping before the
+ * top rows fill up, and then two more pieces. Nothing here depends on the
+ * AIs, so the same seed gives the same positions in every build.
+ ***************************************************************************/
+static void
+bench_corpus(Bench *b, piece_style *ps, color_style *cs, Bench_Position *pos)
+{
+    Uint32 seed = b->seed;
+    int i, k, x, y;
+
+    for (i=0; i<b->positions; i++) {
+	Bench_Position *p = &pos[i];
+	int fill;
+
+	p->level = 1 + i % 9;
+	p->pieces = 0;
+	p->g = generate_board_r(10, 20, p->level, &seed);
+	fill = FastRandom_r(&seed, BENCH_MAX_FILL + 1);
+	for (k=0; k<fill; k++) {
+	    play_piece pp = generate_piece_r(ps, cs, &seed);
+	    int col = FastRandom_r(&seed, p->g.w + 4) - 4;
+	    int rot = FastRandom_r(&seed, 4);
+	    int high = 0;
+
+	    drop_piece_on_grid(&p->g, &pp, col, 0, rot);
+	    p->pieces++;
+	    for (y=0; y<6; y++)
+		for (x=0; x<p->g.w; x++)
+		    if (GRID_CONTENT(p->g,x,y))
+			high = 1;
+	    if (high)
+		break;
+	}
+	p->cp = generate_piece_r(ps, cs, &seed);
+	p->np = generate_piece_r(ps, cs, &seed);
+    }
+}
+
+/***************************************************************************
+ *      bench_compare()
+ * For sorting the latencies.
+ ***************************************************************************/
+static int
+bench_compare(const void *a, const void *b)
 {
-    SDL_FillRect(widget_layer, &wr->area, int_black);
-    SDL_FillRect(screen, &wr->area, int_black);
-    SDL_BlitSurface(flame_layer, &wr->area, screen, &wr->area);
-    SDL_BlitSurface(widget_layer, &wr->area, screen, &wr->area);
-    SDL_UpdateSafe(screen, 1, &wr->area);
-    return; 
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
 }
 
 /***************************************************************************
- *      draw_radio()
- * Draws a WalkRadio button.
- *
- * Only draws me if I am not inactive. 
- *********************************************************************PROTO*/
-void
-draw_radio(WalkRadio *wr, int state)
+ *      bench_percentile()
+ * Milliseconds per decision at the given fraction of the way through the
+ * sorted latencies.
+ ***************************************************************************/
+static double
+bench_percentile(Bench_Result *r, double p)
 {
-    int start, stop, i;
-    SDL_Rect draw;
-    
-    if (wr->inactive) return;
+    int i;
 
-    wr->area.x = wr->x;
-    wr->area.y = wr->y;
+    if (r->decisions == 0)
+	return 0.0;
+    i = (int) (p * (r->decisions - 1) + 0.5);
+    return 1000.0 * r->latency[i];
+}
 
-    SDL_FillRect(widget_layer, &wr->area, wr->border_color[state]);
+/***************************************************************************
+ *      bench_ai_job()
+ * Runs one AI over every position. The AI keeps its state from one
+ * position to the next, as it would from one piece to the next in a game,
+ * and the headless clock starts again at every position so that each
+ * decision is the same amount of work on every machine.
+ ***************************************************************************/
+static void
+bench_ai_job(void *arg, int unused)
+{
+    Bench_Run *br = (Bench_Run *) arg;
+    Bench_Result *r = br->r;
+    AI_Player *ai = br->ai;
+    void *state = NULL;
+    Grid g = generate_board(10, 20, 0);
+    int i;
 
-    if (wr->n < RADIO_HEIGHT) {	/* draw them all */
-	start = 0;
-	stop = wr->n;
-    } else {		/* at least four */
-	start = wr->defaultchoice - (RADIO_HEIGHT/2);
-	if (start < 0) start = 0;
-	stop = start + RADIO_HEIGHT;
-	if (stop > wr->n) {	/* we're at the bottom */
-	    start -= (stop - wr->n);
-	    stop = wr->n;
+    sim_set_styles(br->ps, br->cs);
+    ai_take_counters(&r->c);
+    r->placements = 2166136261U;
+    for (i=0; i<br->b->positions; i++) {
+	Bench_Position *p = &br->pos[i];
+	play_piece cp = p->cp, np = p->np;
+	int col = 0, row = 0, rot = 0, ok;
+	double start;
+
+	sim_copy_grid(&g, &p->g);
+	sim_virtual_clock(1);
+	start = sim_now();
+	ok = sim_decide(ai, &state, &g, &cp, &np, NULL, p->pieces, br->cs->w,
+		sim_fall(p->level), &col, &row, &rot);
+	r->latency[r->decisions] = sim_now() - start;
+
+	if (ok < 0) {
+	    r->stuck++;
+	    col = row = rot = -1;
+	} else {
+	    r->seconds += r->latency[r->decisions++];
+	    if (ok == 0)
+		r->unreachable++;
 	}
+	r->placements = (r->placements ^ (Uint32) (col & 0xff)) * 16777619U;
+	r->placements = (r->placements ^ (Uint32) (row & 0xff)) * 16777619U;
+	r->placements = (r->placements ^ (Uint32) (rot & 0xff)) * 16777619U;
     }
+    ai_take_counters(&r->c);
+    qsort(r->latency, r->decisions, sizeof(double), bench_compare);
 
-    draw.x = wr->x + BORDER_X/2;
-    draw.y = wr->y + BORDER_Y/2;
-    draw.w = wr->w; 
-    draw.h = wr->h;
-    
-    for (i=start; i<stop; i++) {
-	int on = (wr->defaultchoice == i);
-	SDL_Rect text;
+    if (ai->release && state)
+	ai->release(state);
+    free_board(&g);
+    sim_virtual_clock(0);
+}
 
-	SDL_FillRect(widget_layer, &draw, wr->text_color[on]);
-	draw.x += 2; draw.y += 2; draw.w -= 4; draw.h -= 4;
-	if (state || on) 
-	    SDL_FillRect(widget_layer, &draw, wr->face_color[on]);
-	else 
-	    SDL_FillRect(widget_layer, &draw, wr->border_color[on]);
-	draw.x += 3; draw.y += 3; draw.w -= 6; draw.h -= 6;
+/***************************************************************************
+ *      bench_write()
+ * Writes the results out as JSON.
+ ***************************************************************************/
+static void
+bench_write(FILE *f, Bench *b, AI_Players *ai, piece_style *ps,
+	Bench_Result *res)
+{
+    int i, k;
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"version\": \"%s\",\n", VERSION);
+    fprintf(f, "  \"seed\": %u,\n", (unsigned) b->seed);
+    fprintf(f, "  \"positions\": %d,\n", b->positions);
+    fprintf(f, "  \"piece_style\": \"%s\",\n", ps->name);
+    fprintf(f, "  \"tick_reads\": %d,\n", SIM_TICK_READS);
+    fprintf(f, "  \"ai\": [\n");
+    for (i=0; i<ai->n; i++) {
+	Bench_Result *r = &res[i];
+	double mean = r->decisions ? r->seconds / r->decisions : 0.0;
+
+	fprintf(f, "    {\n");
+	fprintf(f, "      \"name\": \"%s\",\n", ai->player[i].name);
+	fprintf(f, "      \"decisions\": %d,\n", r->decisions);
+	fprintf(f, "      \"unreachable\": %d,\n", r->unreachable);
+	fprintf(f, "      \"stuck\": %d,\n", r->stuck);
+	fprintf(f, "      \"seconds\": %.6f,\n", r->seconds);
+	fprintf(f, "      \"decisions_per_sec\": %.3f,\n",
+		r->seconds > 0 ? r->decisions / r->seconds : 0.0);
+	fprintf(f, "      \"candidates\": %lu,\n", r->c.candidates);
+	fprintf(f, "      \"drops\": %lu,\n", r->c.drops);
+	fprintf(f, "      \"drops_per_sec\": %.1f,\n",
+		r->seconds > 0 ? r->c.drops / r->seconds : 0.0);
+	fprintf(f, "      \"drops_per_decision\": %.1f,\n",
+		r->decisions ? (double) r->c.drops / r->decisions : 0.0);
+	fprintf(f, "      \"latency_ms\": { \"mean\": %.4f, \"p50\": %.4f, "
+		"\"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n",
+		1000.0 * mean, bench_percentile(r, 0.50),
+		bench_percentile(r, 0.90), bench_percentile(r, 0.99),
+		bench_percentile(r, 1.0));
+	fprintf(f, "      \"gravity\": %lu,\n", r->c.gravity);
+	fprintf(f, "      \"evals\": %lu,\n", r->c.evals);
+	fprintf(f, "      \"thinks\": %lu,\n", r->c.thinks);
+	fprintf(f, "      \"settled\": %lu,\n", r->c.settled);
+	fprintf(f, "      \"overruns\": %lu,\n", r->c.overruns);
+	fprintf(f, "      \"think_ticks\": %lu,\n", r->c.think_ticks);
+	fprintf(f, "      \"cascade\": [");
+	for (k=0; k<AI_CASCADE_MAX; k++)
+	    fprintf(f, "%s%lu", k ? ", " : "", r->c.cascade[k]);
+	fprintf(f, "],\n");
+	fprintf(f, "      \"placements\": \"%08x\"\n", (unsigned) r->placements);
+	fprintf(f, "    }%s\n", i < ai->n - 1 ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
 
-	text.x = draw.x; text.y = draw.y;
-	text.w = wr->bitmap0[i]->w;
-	text.h = wr->bitmap0[i]->h;
-	text.x += (draw.w - text.w) / 2;
+/***************************************************************************
+ *      bench_play()
+ * Runs every AI over b->positions positions, one AI at a time so that
+ * they do not get in each other's way, prints a summary and writes the
+ * details to b->out. Returns 0, or 1 if b->out cannot be written.
+ *********************************************************************PROTO*/
+int
+bench_play(Bench *b, AI_Players *ai, piece_style *ps, color_style *cs)
+{
+    Bench_Run br;
+    Bench_Result *res;
+    FILE *f;
+    int i, k;
+
+    if (b->positions < 1) b->positions = 1;
+    Calloc(br.pos, Bench_Position *, b->positions * sizeof(Bench_Position));
+    Calloc(res, Bench_Result *, ai->n * sizeof(Bench_Result));
+    bench_corpus(b, ps, cs, br.pos);
+    br.b = b;
+    br.ps = ps;
+    br.cs = cs;
+
+    sim_start();
+    printf("Benchmark: %d AIs, %d positions, seed %u\n", ai->n,
+	    b->positions, (unsigned) b->seed);
+    fflush(stdout);
+
+    for (i=0; i<ai->n; i++) {
+	Calloc(res[i].latency, double *, b->positions * sizeof(double));
+	br.ai = &ai->player[i];
+	br.r = &res[i];
+	sim_run(bench_ai_job, &br, 1);
+    }
+
+    printf("\n%-16s %9s %10s %11s %9s %9s %9s %9s  %s\n",
+	    "AI", "Decisions", "Dec/sec", "Drops/sec", "Drops/dec",
+	    "p50 ms", "p99 ms", "Max ms", "Cascades 0/1/2/3+");
+    for (i=0; i<ai->n; i++) {
+	Bench_Result *r = &res[i];
+	unsigned long deep = 0;
+	for (k=3; k<AI_CASCADE_MAX; k++)
+	    deep += r->c.cascade[k];
+	printf("%-16.16s %9d %10.1f %11.0f %9.1f %9.3f %9.3f %9.3f  "
+		"%lu/%lu/%lu/%lu\n", ai->player[i].name, r->decisions,
+		r->seconds > 0 ? r->decisions / r->seconds : 0.0,
+		r->seconds > 0 ? r->c.drops / r->seconds : 0.0,
+		r->decisions ? (double) r->c.drops / r->decisions : 0.0,
+		bench_percentile(r, 0.50), bench_percentile(r, 0.99),
+		bench_percentile(r, 1.0), r->c.cascade[0], r->c.cascade[1],
+		r->c.cascade[2], deep);
+    }
 
-	if (on) {
-	    SDL_BlitSafe(wr->bitmap1[i], NULL, widget_layer, &text);
-	} else {
-	    SDL_BlitSafe(wr->bitmap0[i], NULL, widget_layer, &text);
-	}
-	draw.x -= 5; draw.y -= 5; draw.w += 10; draw.h += 10;
+    printf("\n");
+    ai_counters_print(stdout, NULL, NULL);
+    for (i=0; i<ai->n; i++)
+	ai_counters_print(stdout, ai->player[i].name, &res[i].c);
+    fflush(stdout);
+
+    f = fopen(b->out, "w");
+    if (f) {
+	bench_write(f, b, ai, ps, res);
+	fclose(f);
+	printf("\nResults are in [%s].\n", b->out);
+    } else
+	Debug("Cannot write benchmark results to [%s].\n", b->out);
 
-	draw.y += draw.h; /* move down! */
-    }
+    for (i=0; i<b->positions; i++)
+	free_board(&br.pos[i].g);
+    for (i=0; i<ai->n; i++)
+	free(res[i].latency);
+    free(br.pos);
+    free(res);
+    return f == NULL;
+}
 
-    SDL_BlitSurface(flame_layer, &wr->area, screen, &wr->area);
-    SDL_BlitSurface(widget_layer, &wr->area, screen, &wr->area);
-    SDL_UpdateSafe(screen, 1, &wr->area);
+static char *plugin_dir = PLUGIN_DIR;
+static const AI_Plugin *plugin_slot[PLUGIN_MAX];
+static int plugin_n = 0;
+
+/* what a plugin AI_Player's state really is */
+typedef struct plugin_state_struct {
+    const AI_Plugin *p;
+    void *state;	/* the plugin's own */
+} Plugin_State;
+
+/***************************************************************************
+ * The host side: the game's own primitives, with the plugin's views made
+ * const. None of these write to a board the plugin was only shown.
+ ***************************************************************************/
+static void
+host_board_new(Grid *g, const Grid *like)
+{
+    *g = generate_board(like->w, like->h, 0);
+    sim_copy_grid(g, (Grid *) like);
+}
+
+static void
+host_board_copy(Grid *to, const Grid *from)
+{
+    sim_copy_grid(to, (Grid *) from);
 }
 
-/***************************************************************************
- *      create_single_wrg()
- * Creates a walk-radio-group with a single walk-radio button with N
- * choices. 
- *********************************************************************PROTO*/
-WalkRadioGroup *
-create_single_wrg(int n)
+static int
+host_valid(const Grid *g, const play_piece *pp, int col, int row, int rot)
 {
-    WalkRadioGroup *wrg;
+    return valid_position((play_piece *) pp, col, row, rot, (Grid *) g);
+}
 
-    Calloc(wrg, WalkRadioGroup *, 1 * sizeof(*wrg));
-    wrg->n = 1;
-    Calloc(wrg->wr, WalkRadio *, wrg->n * sizeof(*wrg->wr));
-    wrg->wr[0].n = n;
-    Calloc(wrg->wr[0].label, char **, wrg->wr[0].n * sizeof(*wrg->wr[0].label));
-    return wrg;
+static int
+host_drop(Grid *g, const play_piece *pp, int col, int row, int rot)
+{
+    return drop_piece_on_grid(g, (play_piece *) pp, col, row, rot);
 }
 
-/***************************************************************************
- *      handle_radio_event()
- * Tries to handle the given event with respect to the given set of
- * WalkRadio's. Returns non-zero if an action said that we are done.
- *********************************************************************PROTO*/
-int
-handle_radio_event(WalkRadioGroup *wrg, const SDL_Event *ev)
+static void
+host_masks(const Grid *g, Grid_Masks *m)
 {
-    int i, ret;
-    if (ev->type == SDL_MOUSEBUTTONDOWN) {
-	for (i=0; i<wrg->n; i++) {
-	    if (check_radio(&wrg->wr[i], ev->button.x, ev->button.y)) {
-		if (i != wrg->cur) {
-		    draw_radio(&wrg->wr[wrg->cur], 0);
-		}
-		draw_radio(&wrg->wr[i], 1);
-		if (wrg->wr[i].action) {
-		    ret = wrg->wr[i].action(&wrg->wr[i]);
-		    return ret;
-		} else
-		    return wrg->wr[i].defaultchoice;
-	    }
-	}
-    } else if (ev->type == SDL_KEYDOWN) {
-	switch (ev->key.keysym.sym) {
-	    case SDLK_RETURN:
-		if (wrg->wr[wrg->cur].action) {
-		    ret = wrg->wr[wrg->cur].action(&wrg->wr[wrg->cur]);
-		    return ret;
-		} else
-		    return wrg->wr[wrg->cur].defaultchoice;
-		return 1;
+    grid_masks((Grid *) g, m);
+}
 
-	    case SDLK_UP:
-		wrg->wr[wrg->cur].defaultchoice --;
-		if (wrg->wr[wrg->cur].defaultchoice < 0)
-		    wrg->wr[wrg->cur].defaultchoice = wrg->wr[wrg->cur].n - 1;
-		draw_radio(&wrg->wr[wrg->cur], 1);
-		return -1;
-		break;
+static AI_Batch *
+host_batch_new(const Grid *like, int max)
+{
+    return ai_batch_new((Grid *) like, max);
+}
 
-	    case SDLK_DOWN:
-		wrg->wr[wrg->cur].defaultchoice ++;
-		if (wrg->wr[wrg->cur].defaultchoice >= wrg->wr[wrg->cur].n)
-		    wrg->wr[wrg->cur].defaultchoice = 0;
-		draw_radio(&wrg->wr[wrg->cur], 1);
-		return -1;
+static void
+host_batch_drop(AI_Batch *b, const Grid *g, const play_piece *pp,
+	const AI_Placement *p, int n)
+{
+    ai_batch_drop(b, (Grid *) g, (play_piece *) pp, (AI_Placement *) p, n);
+}
 
-	    case SDLK_LEFT:
-		draw_radio(&wrg->wr[wrg->cur], 0);
-		do { 
-		    wrg->cur--;
-		    if (wrg->cur < 0) 
-			wrg->cur = wrg->n - 1;
-		} while (wrg->wr[wrg->cur].inactive);
-		draw_radio(&wrg->wr[wrg->cur], 1);
-		return -1;
+static int
+host_batch_all(AI_Batch *b, const Grid *g, const play_piece *pp, int row)
+{
+    return ai_batch_all(b, (Grid *) g, (play_piece *) pp, row);
+}
+
+static const AI_Host plugin_host = {
+    AI_PLUGIN_ABI,
+    AI_PLUGIN_LAYOUT,
+    host_board_new,
+    host_board_copy,
+    free_board,
+    host_valid,
+    host_drop,
+    host_masks,
+    host_batch_new,
+    ai_batch_free,
+    host_batch_drop,
+    host_batch_all,
+    ai_batch_weigh,
+    ai_batch_eval,
+    sim_ticks,
+};
 
-	    case SDLK_RIGHT: 
-		draw_radio(&wrg->wr[wrg->cur], 0);
-		do { 
-		    wrg->cur++;
-		    if (wrg->cur >= wrg->n) 
-			wrg->cur = 0;
-		} while (wrg->wr[wrg->cur].inactive);
-		draw_radio(&wrg->wr[wrg->cur], 1);
-		return -1;
+/***************************************************************************
+ * The player side: AI_Player's functions in terms of the plugin's.
+ ***************************************************************************/
+static void *
+plugin_reset(int slot, void *state, Grid *g)
+{
+    Plugin_State *ps = (Plugin_State *) state;
 
-	    default:
-		return -1;
-	}
+    if (ps == NULL) {
+	Calloc(ps, Plugin_State *, sizeof(Plugin_State));
+	ps->p = plugin_slot[slot];
     }
-    return -1;
+    ps->state = ps->p->reset(ps->state, g, &plugin_host);
+    return ps;
 }
 
-/*
- * $Log: menu.c,v $
- * Revision 1.17  2000/11/06 01:22:40  wkiri
- * Updated menu system.
- *
- * Revision 1.16  2000/11/06 00:24:01  weimer
- * add WalkRadioGroup modifications (inactive field for Kiri) and some support
- * for special pieces
- *
- * Revision 1.15  2000/11/02 03:06:20  weimer
- * better interface for walk-radio menus: we are now ready for Kiri to change
- * them to add run-time options ...
- *
- * Revision 1.14  2000/10/29 21:23:28  weimer
- * One last round of header-file changes to reflect my newest and greatest
- * knowledge of autoconf/automake. Now if you fail to have some bizarro
- * function, we try to go on anyway unless it is vastly needed.
- *
- * Revision 1.13  2000/10/29 17:23:13  weimer
- * incorporate "xflame" flaming background for added spiffiness ...
- *
- * Revision 1.12  2000/10/21 01:22:44  weimer
- * prevent segfault from out-of-range values
- *
- * Revision 1.11  2000/10/21 01:14:43  weimer
- * massic autoconf/automake restructure ...
- *
- * Revision 1.10  2000/10/19 22:06:51  weimer
- * minor changes ...
- *
- * Revision 1.9  2000/10/18 23:57:49  weimer
- * general fixup, color changes, display changes.
- * Notable: "Safe" Blits and Updates now perform "clipping". No more X errors,
- * we hope!
- *
- * Revision 1.8  2000/10/13 02:26:54  weimer
- * rudimentary identity functions, including adding new players
- *
- * Revision 1.7  2000/10/12 22:21:25  weimer
- * display changes, more multi-local-play threading (e.g., myScore ->
- * Score[0]), that sort of thing ...
- *
- * Revision 1.6  2000/10/12 19:17:08  weimer
- * Further support for AI players and multiple game types.
- *
- * Revision 1.5  2000/10/12 00:49:08  weimer
- * added "AI" support and walking radio menus for initial game configuration
- *
- * Revision 1.4  2000/09/09 17:05:35  wkiri
- * Hideous log changes (Wes: how dare you include a comment character!)
- *
- * Revision 1.3  2000/09/09 16:58:27  weimer
- * Sweeping Change of Ultimate Mastery. Main loop restructuring to clean up
- * main(), isolate the behavior of the three game types. Move graphic files
- * into graphics/-, style files into styles/-, remove some unused files,
- * add game flow support (breaks between games, remembering your level within
- * this game), multiplayer support for the event loop, some global variable
- * cleanup. All that and a bag of chips!
- *
- * Revision 1.2  2000/09/04 22:49:51  wkiri
- * gamemenu now uses the new nifty menus.  Also, added delete_menu.
- *
- * Revision 1.1  2000/09/04 19:54:26  wkiri
- * Added menus (menu.[ch]).
- */
-
-/***************************************************************************
- *	Server_AwaitConnection() 
- * Sets up the server side listening socket and awaits connections from the
- * outside world. Returns a socket.
- *********************************************************************PROTO*/
-int
-Server_AwaitConnection(int port)
+static void
+plugin_evaluate(int slot, void *state, AI_Batch *b, double *scores)
 {
-  static struct sockaddr_in addr;
-  static struct hostent *host;
-  static int sockListen=0;  
-  static int addrLen;
-  int val1;
-  struct linger val2;
-  int sock;
+    Plugin_State *ps = (Plugin_State *) state;
 
-  if (sockListen == 0) {
-    memset(&addr,0,sizeof(addr));
-    addr.sin_family=AF_INET;
-    addr.sin_addr.s_addr=htonl(INADDR_ANY);
-    addr.sin_port=htons(port);
-    sockListen=socket(AF_INET,SOCK_STREAM,0);
+    plugin_slot[slot]->evaluate(ps ? ps->state : NULL, b, scores);
+}
 
-    error_msg = 0;
+#define PLUGIN_SLOT(i) \
+static void * plugin_reset_##i(void *s, Grid *g) \
+{ return plugin_reset(i, s, g); } \
+static void plugin_evaluate_##i(void *s, AI_Batch *b, double *scores) \
+{ plugin_evaluate(i, s, b, scores); }
 
-    if (sockListen < 0) {
-	Debug("unable to create socket: %s\n",error_msg = strerror(errno));
-	return -1;
-    } 
+PLUGIN_SLOT(0)  PLUGIN_SLOT(1)  PLUGIN_SLOT(2)  PLUGIN_SLOT(3)
+PLUGIN_SLOT(4)  PLUGIN_SLOT(5)  PLUGIN_SLOT(6)  PLUGIN_SLOT(7)
+PLUGIN_SLOT(8)  PLUGIN_SLOT(9)  PLUGIN_SLOT(10) PLUGIN_SLOT(11)
+PLUGIN_SLOT(12) PLUGIN_SLOT(13) PLUGIN_SLOT(14) PLUGIN_SLOT(15)
 
-    val1=1;
+static void * (*plugin_resets[PLUGIN_MAX])(void *, Grid *) = {
+    plugin_reset_0,  plugin_reset_1,  plugin_reset_2,  plugin_reset_3,
+    plugin_reset_4,  plugin_reset_5,  plugin_reset_6,  plugin_reset_7,
+    plugin_reset_8,  plugin_reset_9,  plugin_reset_10, plugin_reset_11,
+    plugin_reset_12, plugin_reset_13, plugin_reset_14, plugin_reset_15,
+};
 
-#ifdef HAVE_SYS_SOCKET_H
-    if (fcntl(sockListen, F_SETFL, O_NONBLOCK)) {
-	Debug("unable to make socket non-blocking: %s\n", error_msg = strerror(errno));
-	return -1;
-    }
-#endif
+static void (*plugin_evaluates[PLUGIN_MAX])(void *, AI_Batch *, double *) = {
+    plugin_evaluate_0,  plugin_evaluate_1,  plugin_evaluate_2,
+    plugin_evaluate_3,  plugin_evaluate_4,  plugin_evaluate_5,
+    plugin_evaluate_6,  plugin_evaluate_7,  plugin_evaluate_8,
+    plugin_evaluate_9,  plugin_evaluate_10, plugin_evaluate_11,
+    plugin_evaluate_12, plugin_evaluate_13, plugin_evaluate_14,
+    plugin_evaluate_15,
+};
 
-    if (setsockopt(sockListen,SOL_SOCKET,SO_REUSEADDR,
-		   (void *)&val1, sizeof(val1))) {
-      Debug("WARNING: setsockopt(...,SO_REUSEADDR) failed. You may have to wait a\n"
-	      "\tfew minutes before you can try to be the server again.\n");
-    }
-    if (bind(sockListen, (struct sockaddr *)&addr, sizeof(addr))) {
-	Debug("unable to bind socket (for listening): %s\n", error_msg = strerror(errno));
-	return -1;
-    }
-    if (listen(sockListen,16)) {
-	Debug("unable to listen on socket: %s\n", error_msg = strerror(errno));
-	return -1;
-    } 
+static void
+plugin_think(void *state, Grid *g, play_piece *cp, play_piece *np,
+	int col, int row, int rot)
+{
+    Plugin_State *ps = (Plugin_State *) state;
+    AI_View v = { g, cp, np, col, row, rot };
 
-    addrLen=sizeof(addr);
+    ps->p->think(ps->state, &v);
+}
 
-    Debug("accepting connections on port %d, socketfd %d\n",port,sockListen); 
-  }
-#if HAVE_SELECT || HAVE_WINSOCK_H
-  /* it is possible to select() on a socket for the purpose of doing an
-   * accept by putting it in the read group */
-  {
-      fd_set read_fds;
-      struct timeval timeout = {0, 0};
-      int retval;
+static Command
+plugin_move(void *state, Grid *g, play_piece *cp, play_piece *np,
+	int col, int row, int rot)
+{
+    Plugin_State *ps = (Plugin_State *) state;
+    AI_View v = { g, cp, np, col, row, rot };
 
-      FD_ZERO(&read_fds);
-      FD_SET(sockListen, &read_fds);
+    if (ps->p->move == NULL)
+	return MOVE_NONE;
+    return ps->p->move(ps->state, &v);
+}
 
-      retval = select(sockListen+1, &read_fds, NULL, NULL, &timeout);
-      
-      if (retval <= 0) {
-	  /* no one is there */
-	  return -1;
-      }
-  }
-#endif
-  sock=accept(sockListen, (struct sockaddr *)&addr,&addrLen);
-  if (sock < 0) {
-      if (
-#ifdef HAVE_SYS_SOCKET_H
-	      errno == EWOULDBLOCK || 
-#endif
-	      errno == EAGAIN)
-	  return -1;
-      else {
-	  Debug("unable to accept on listening socket: %s\n", error_msg = strerror(errno));
-	  return -1;
-      }
-  }
+static int
+plugin_target(void *state, Grid *g, play_piece *cp, int row,
+	AI_Placement *goal)
+{
+    Plugin_State *ps = (Plugin_State *) state;
+    AI_View v = { g, cp, NULL, -1, row, -1 };
 
-  val2.l_onoff=0; val2.l_linger=0;
-  if (setsockopt(sock,SOL_SOCKET,SO_LINGER,(void *)&val2,sizeof(val2)))
-      Debug("WARNING: setsockopt(...,SO_LINGER) failed. You may have to wait a few\n"
-	      "\tminutes before you can try to be the server again.\n");
+    return ps->p->target(ps->state, &v, goal);
+}
 
-  host=gethostbyaddr((void *)&addr.sin_addr,sizeof(struct in_addr),AF_INET);
-  if (!host) 
-      Debug("connection from some unresolvable IP address, socketfd %d.\n", sock);
-  else
-      Debug("connection from %s, socketfd %d.\n",host->h_name,sock); 
-  return sock;
+static void
+plugin_release(void *state)
+{
+    Plugin_State *ps = (Plugin_State *) state;
+
+    if (ps->p->release && ps->state)
+	ps->p->release(ps->state);
+    free(ps);
 }
 
 /***************************************************************************
- *	Client_Connect() 
- * Set up client side networking and connect to the server. Returns a socket
- * pointing to the server.
- *
- * On error, -1 is returned.
+ *      plugin_set_dir()
+ * Look for plugins here instead of PLUGIN_DIR.
  *********************************************************************PROTO*/
-int
-Client_Connect(char *hoststr, int lport)
+void
+plugin_set_dir(char *dir)
 {
-    struct sockaddr_in addr;
-    struct hostent *host;
-    int mySock;
-    short port = lport;
-    int retval; 
+    plugin_dir = dir;
+}
 
-    error_msg = NULL;
+/***************************************************************************
+ *      plugin_add()
+ * Makes an AI_Player out of p. Returns 0 if p will not do.
+ ***************************************************************************/
+static int
+plugin_add(AI_Players *ais, const AI_Plugin *p, const char *file)
+{
+    AI_Player *ai;
 
-    host=gethostbyname(hoststr);
-    if (!host) {
-	Debug("unable to resolve [%s]: unknown hostname\n",hoststr);
-	error_msg = "unknown hostname";
-	return -1;
+    if (p->abi != AI_PLUGIN_ABI) {
+	Debug("Plugin [%s] wants interface %d, we have %d.\n", file, p->abi,
+		AI_PLUGIN_ABI);
+	return 0;
     }
-
-    Debug("connecting to %s:%d ...\n",host->h_name,port);   
-
-    memset(&addr, 0, sizeof(addr)); 
-    addr.sin_family = AF_INET; /*host->h_addrtype;*/
-    memcpy(&addr.sin_addr, host->h_addr, host->h_length);
-    addr.sin_port=htons(port);
-    mySock = socket(AF_INET, SOCK_STREAM, 0);
-    if (mySock < 0) {
-	Debug("unable to create socket: %s\n",error_msg = strerror(errno));
-	return -1;
+    if (memcmp(&p->layout, &plugin_host.layout, sizeof(AI_Layout))) {
+	Debug("Plugin [%s] was built against other versions of the game's "
+		"structures.\n", file);
+	return 0;
     }
-
-    retval = connect(mySock, (struct sockaddr *) &addr, sizeof(addr));
-
-    if (retval < 0) {
-	Debug("unable to connect: %s\n",error_msg = strerror(errno));
-	close(mySock);
-	return -1;
+    if (!p->name || !p->reset || !p->think || (!p->move && !p->target)) {
+	Debug("Plugin [%s] is missing something.\n", file);
+	return 0;
     }
-
-    Debug("connected to %s:%d, socketfd %d.\n",host->h_name,port,mySock);
-    return mySock;
+    if (plugin_n == PLUGIN_MAX) {
+	Debug("No room for plugin AI [%s] (%d at most).\n", p->name,
+		PLUGIN_MAX);
+	return 0;
+    }
+    plugin_slot[plugin_n] = p;
+
+    Realloc(ais->player, AI_Player *, (ais->n + 1) * sizeof(AI_Player));
+    ai = &ais->player[ais->n++];
+    memset(ai, 0, sizeof(*ai));
+    ai->name	= (char *) p->name;
+    ai->msg	= (char *) (p->msg ? p->msg : "A plugin.");
+    ai->move	= plugin_move;
+    ai->think	= plugin_think;
+    ai->reset	= plugin_resets[plugin_n];
+    ai->evaluate = p->evaluate ? plugin_evaluates[plugin_n] : NULL;
+    ai->target	= p->target ? plugin_target : NULL;
+    ai->release	= plugin_release;
+    plugin_n++;
+
+    Debug("Plugin AI [%s] loaded from [%s].\n", p->name, file);
+    return 1;
 }
 
 /***************************************************************************
- *	Network_Init() 
- * Call before you try to use any networking functions. Returns 0 on
- * success.
+ *      plugin_load_all()
+ * Adds an AI_Player for every plugin AI in the plugin directory. It is
+ * fine for there to be no such directory. Returns how many were added.
  *********************************************************************PROTO*/
 int
-Network_Init(void)
+plugin_load_all(AI_Players *ais)
 {
-#if HAVE_WINSOCK_H
-    WORD version_wanted = MAKEWORD(1,1);
-    WSADATA wsaData;
+    DIR *my_dir;
+    char filespec[2048];
+    int added = 0;
 
-    if ( WSAStartup(version_wanted, &wsaData) != 0 ) {
-	Debug("WARNING: Couldn't initialize Winsock 1.1\n");
-	return 1;
-    }
-    Debug("Winsock 1.1 networking available.\n");
-    return 0;
-#endif
-    /* always works on Unix ... */
-    return 0;
+    my_dir = opendir(plugin_dir);
+    if (!my_dir)
+	return 0;
+    while (1) {
+	struct dirent *this_file = readdir(my_dir);
+	int len, i;
+	void *handle;
+	AI_Plugin_Entry entry;
+	const AI_Plugin *p;
+
+	if (!this_file) break;
+	len = NAMLEN(this_file);
+	if (len < 4 || strcmp(this_file->d_name + len - 3, ".so"))
+	    continue;
+	sprintf(filespec, "%.1000s/%.1000s", plugin_dir, this_file->d_name);
+	handle = dlopen(filespec, RTLD_NOW | RTLD_LOCAL);
+	if (!handle) {
+	    Debug("Cannot load plugin [%s]: %s\n", filespec, dlerror());
+	    continue;
+	}
+	entry = (AI_Plugin_Entry) dlsym(handle, AI_PLUGIN_ENTRY);
+	if (!entry) {
+	    Debug("Plugin [%s] has no %s().\n", filespec, AI_PLUGIN_ENTRY);
+	    dlclose(handle);
+	    continue;
+	}
+	for (i=0; (p = entry(&plugin_host, i)) != NULL; i++)
+	    added += plugin_add(ais, p, filespec);
+	/* the AIs live as long as we do, so the handle stays open */
+    }
+    closedir(my_dir);
+    return added;
+}
+
+/* everything one worker writes */
+typedef struct selfplay_shard_struct {
+    FILE *rec;
+    FILE *idx;
+    Uint64 records;	/* in the file, from this run and earlier ones */
+    Selfplay_Record *game;	/* the game being played */
+    int n;
+    int room;
+    int games;		/* written this run */
+    int written;	/* records written this run */
+    int failed;		/* the files could not be used */
+    AI_Counters *c;	/* per AI */
+} Selfplay_Shard;
+
+/* everything the shard jobs need to see */
+typedef struct selfplay_run_struct {
+    Selfplay *s;
+    AI_Players *ai;
+    piece_style *ps;
+    color_style *cs;
+    int *pick;		/* the AIs that play */
+    int npick;
+    int nshard;
+    int first;		/* the number of this run's first game */
+    Selfplay_Shard *shard;
+} Selfplay_Run;
+
+/* stores a 4-bit value in nibble i of a */
+static void
+selfplay_nibble(Uint8 *a, int i, int v)
+{
+    if (v > 15) v = 15;
+    if (i & 1)
+	a[i/2] |= v << 4;
+    else
+	a[i/2] |= v;
 }
 
 /***************************************************************************
- *	Network_Quit() 
- * Call when you are done networking. 
- *********************************************************************PROTO*/
-void
-Network_Quit(void)
+ *      selfplay_pack_piece()
+ ***************************************************************************/
+static void
+selfplay_pack_piece(piece_style *ps, play_piece *pp, Selfplay_Piece *sp)
 {
-#if HAVE_WINSOCK_H
-    /* Clean up windows networking */
-    if ( WSACleanup() == SOCKET_ERROR ) {
-	if ( WSAGetLastError() == WSAEINPROGRESS ) {
-	    WSACancelBlockingCall();
-	    WSACleanup();
-	}
-    }
-#endif
-    return;
-}
+    int c;
 
+    memset(sp, 0, sizeof(*sp));
+    sp->shape = (Uint8) (pp->base - ps->shape);
+    for (c=1; c<=pp->base->num_color && c < 12; c++)
+	selfplay_nibble(sp->colors, c-1, pp->colormap[c]);
+}
 
 /***************************************************************************
- *      load_piece_style()
- * Load a piece style from the given file.
+ *      selfplay_record()
+ * The Sim_Game hook: keeps the decision until the game is over.
  ***************************************************************************/
-static piece_style *
-load_piece_style(const char *filename)
+static void
+selfplay_record(void *arg, Sim_Game *sg, int P, int col, int row, int rot,
+	int reached)
 {
-    piece_style *retval;
-    char buf[2048];
-    FILE *fin = fopen(filename,"rt");
+    Selfplay_Shard *sh = (Selfplay_Shard *) arg;
+    Sim_Player *me = &sg->p[P];
+    Selfplay_Record *r;
     int i;
 
-    if (!fin) {
-	Debug("fopen(%s)\n",filename);
-	return NULL;
-    }
-    Calloc(retval,piece_style *,sizeof(piece_style));
+    Assert(me->g.w == SELFPLAY_W && me->g.h == SELFPLAY_H);
+    if (sh->n == sh->room) {
+	sh->room = sh->room ? 2 * sh->room : 256;
+	Realloc(sh->game, Selfplay_Record *,
+		sh->room * sizeof(Selfplay_Record));
+    }
+    r = &sh->game[sh->n++];
+    memset(r, 0, sizeof(*r));
+    for (i=0; i<SELFPLAY_W * SELFPLAY_H; i++)
+	selfplay_nibble(r->board, i, me->g.contents[i]);
+    selfplay_pack_piece(sg->ps, &me->cp, &r->cp);
+    selfplay_pack_piece(sg->ps, &me->np, &r->np);
+    r->col = col;
+    r->row = row;
+    r->rot = rot;
+    r->flags = reached ? 0 : SELFPLAY_UNREACHED;
+    r->player = P;
+    r->ply = me->pieces;
+}
 
-    fgets(buf,sizeof(buf),fin);
-    if (feof(fin)) {
-	Debug("unexpected EOF after name in [%s]\n",filename);
-	free(retval);
+/***************************************************************************
+ *      selfplay_open()
+ * Opens one of a shard's files to append to, writing the header if it is
+ * new and checking it if it is not. A record cut short by a run that
+ * stopped halfway is dropped. *count, if count is not NULL, is how many
+ * records there are already. Returns NULL if the file cannot be used.
+ ***************************************************************************/
+static FILE *
+selfplay_open(const char *filespec, const char *magic, Uint32 size,
+	piece_style *ps, Uint64 *count)
+{
+    FILE *f = fopen(filespec, "r+b");
+    Selfplay_Header want, have;
+    Uint64 n;
+    long end;
+
+    memset(&want, 0, sizeof(want));
+    memcpy(want.magic, magic, 8);
+    want.record_size = size;
+    want.w = SELFPLAY_W;
+    want.h = SELFPLAY_H;
+    strncpy(want.piece_style, ps->name, sizeof(want.piece_style) - 1);
+
+    if (f == NULL) {
+	f = fopen(filespec, "w+b");
+	if (f == NULL) {
+	    Debug("Cannot write [%s]\n", filespec);
+	    return NULL;
+	}
+    }
+    fseek(f, 0, SEEK_END);
+    end = ftell(f);
+    if (end == 0) {
+	fwrite(&want, sizeof(want), 1, f);
+	if (count) *count = 0;
+	return f;
+    }
+    rewind(f);
+    if (fread(&have, sizeof(have), 1, f) != 1 ||
+	    memcmp(&have, &want, sizeof(want))) {
+	Debug("[%s] holds some other kind of records.\n", filespec);
+	fclose(f);
 	return NULL;
     }
+    n = (end - sizeof(have)) / size;
+    if (count) *count = n;
+    if ((end - sizeof(have)) % size) {
+	Debug("[%s] ends in the middle of a record, dropping it.\n",
+		filespec);
+	fflush(f);
+	if (ftruncate(fileno(f), sizeof(have) + n * size)) {
+	    fclose(f);
+	    return NULL;
+	}
+    }
+    fseek(f, 0, SEEK_END);
+    return f;
+}
 
-    if (strchr(buf,'\n'))
-	*(strchr(buf,'\n')) = 0;
-    retval->name = strdup(buf);
+/***************************************************************************
+ *      selfplay_recorded()
+ * Reads the index of every shard an earlier run left under s->out and
+ * returns the number the first game of this run should have for its seed
+ * to come after every seed already recorded there. *games is how many
+ * games they hold.
+ ***************************************************************************/
+static int
+selfplay_recorded(Selfplay *s, int *games)
+{
+    char filespec[2048];
+    Uint32 top = 0;
+    int i;
 
-    if (fscanf(fin,"%d",&retval->num_piece) != 1) {
-	Debug("malformed piece count in [%s]\n",filename);
-	free(retval->name);
-	free(retval);
-	return NULL;
+    *games = 0;
+    for (i=0; ; i++) {
+	Selfplay_Game e;
+	FILE *f;
+
+	sprintf(filespec, "%.2000s.%02d.idx", s->out, i);
+	if ((f = fopen(filespec, "rb")) == NULL)
+	    break;
+	if (!fseek(f, sizeof(Selfplay_Header), SEEK_SET))
+	    while (fread(&e, sizeof(e), 1, f) == 1) {
+		if (!*games || e.seed > top)
+		    top = e.seed;
+		(*games)++;
+	    }
+	fclose(f);
     }
+    if (!*games || top < s->seed)
+	return 0;
+    return top - s->seed + 1;
+}
 
-    Calloc(retval->shape,piece *,(retval->num_piece)*sizeof(piece));
+/***************************************************************************
+ *      selfplay_shard_job()
+ * Plays games i, i + nshard, i + 2*nshard ... of this run and writes them
+ * to shard i. Game k of the run is number sr->first + k: that says its
+ * seed, its level and who plays it.
+ ***************************************************************************/
+static void
+selfplay_shard_job(void *arg, int i)
+{
+    Selfplay_Run *sr = (Selfplay_Run *) arg;
+    Selfplay *s = sr->s;
+    Selfplay_Shard *sh = &sr->shard[i];
+    char filespec[2048];
+    int k;
+
+    sprintf(filespec, "%.2000s.%02d.rec", s->out, i);
+    sh->rec = selfplay_open(filespec, SELFPLAY_MAGIC,
+	    sizeof(Selfplay_Record), sr->ps, &sh->records);
+    sprintf(filespec, "%.2000s.%02d.idx", s->out, i);
+    sh->idx = selfplay_open(filespec, SELFPLAY_INDEX_MAGIC,
+	    sizeof(Selfplay_Game), sr->ps, NULL);
+    if (!sh->rec || !sh->idx) {
+	sh->failed = 1;
+	if (sh->rec) fclose(sh->rec);
+	if (sh->idx) fclose(sh->idx);
+	return;
+    }
 
-    for (i=0;i<retval->num_piece;i++) {
-	int x,y,rot,counter;
-	do {
-	    fgets(buf,sizeof(buf),fin);
-	    if (feof(fin))
-		PANIC("unexpected EOF in [%s], before piece %d",filename,i+1);
-	} while (buf[0] == '\n');
-	retval->shape[i].dim = strlen(buf) - 1;
-	if (retval->shape[i].dim <= 0) 
-	    PANIC("piece %d malformed height/width in [%s]", i,filename);
-#ifdef DEBUG
-	Debug("... loading piece %d (%d by %d)\n",i,
-		retval->shape[i].dim, retval->shape[i].dim);
-#endif
-	for (rot=0;rot<4;rot++) {
-	    Malloc(retval->shape[i].bitmap[rot], unsigned char *,
-		    retval->shape[i].dim * retval->shape[i].dim);
+    for (k=i; k<s->games; k+=sr->nshard) {
+	Sim_Game sg;
+	Selfplay_Game e;
+	int n = sr->first + k;
+	int a = sr->pick[n % sr->npick];
+	int b = sr->pick[(n / sr->npick) % sr->npick];
+	int j;
+
+	memset(&sg, 0, sizeof(sg));
+	sg.level = s->level ? s->level : 1 + n % 9;
+	sg.seed = s->seed + n;
+	sg.max_pieces = s->max_pieces;
+	sg.ps = sr->ps;
+	sg.cs = sr->cs;
+	sg.p[0].ai = &sr->ai->player[a];
+	sg.p[1].ai = &sr->ai->player[b];
+	sg.record = selfplay_record;
+	sg.record_arg = sh;
+	sh->n = 0;
+	sim_play_game(&sg);
+	ai_counters_sum(&sh->c[a], &sg.p[0].c);
+	ai_counters_sum(&sh->c[b], &sg.p[1].c);
+
+	for (j=0; j<sh->n; j++) {
+	    Selfplay_Record *r = &sh->game[j];
+	    r->outcome = sg.winner < 0 ? 0 : (r->player == sg.winner ? 1 : -1);
 	}
-	counter = 1;
-	for (y=0;y<retval->shape[i].dim;y++) {
-	    for (x=0;x<retval->shape[i].dim;x++) {
-		BITMAP(retval->shape[i],0,x,y) = 
-		    (buf[x] != '.') ? counter++ : 0;
-	    }
-	    if (y != retval->shape[i].dim - 1) do {
-		fgets(buf,sizeof(buf),fin);
-		if (feof(fin))
-		    PANIC("unexpected EOF in [%s]",filename);
-	    } while (buf[0] == '\n');
+	memset(&e, 0, sizeof(e));
+	e.first = sh->records;
+	e.records = sh->n;
+	e.seed = sg.seed;
+	e.level = sg.level;
+	e.winner = sg.winner;
+	strncpy(e.ai[0], sg.p[0].ai->name, SELFPLAY_NAME - 1);
+	strncpy(e.ai[1], sg.p[1].ai->name, SELFPLAY_NAME - 1);
+
+	if (fwrite(sh->game, sizeof(Selfplay_Record), sh->n, sh->rec) !=
+		(size_t) sh->n || fwrite(&e, sizeof(e), 1, sh->idx) != 1) {
+	    Debug("Shard %d: write failed, stopping.\n", i);
+	    sh->failed = 1;
+	    break;
 	}
-	retval->shape[i].num_color = counter-1;
+	sh->records += sh->n;
+	sh->written += sh->n;
+	sh->games++;
+    }
+    fclose(sh->rec);
+    fclose(sh->idx);
+    Free(sh->game);
+}
 
-	for (rot=1;rot<4;rot++) {
-	    for (y=0;y<retval->shape[i].dim;y++) 
-		for (x=0;x<retval->shape[i].dim;x++) {
-		    BITMAP(retval->shape[i],rot,x,y) =
-			BITMAP(retval->shape[i],rot-1,
-				(retval->shape[i].dim - 1) - y,
-				x);
-		}
-	} /* end: for rot = 0..4 */
+/***************************************************************************
+ *      selfplay_play()
+ * Plays s->games headless games, spread over s->shards workers, and
+ * appends every decision in them to the shard files. Every AI plays every
+ * AI, itself included, unless s->ai names just one. The games carry on
+ * from those already in the shard files, so no seed is played twice.
+ * Returns 0, or 1 if there was no such AI or nothing could be written.
+ *********************************************************************PROTO*/
+int
+selfplay_play(Selfplay *s, AI_Players *ai, piece_style *ps, color_style *cs)
+{
+    Selfplay_Run sr;
+    AI_Counters *c;
+    double start, elapsed;
+    int i, k, games = 0, records = 0, failed = 0, recorded;
+
+    if (s->max_pieces < 1) s->max_pieces = 1000;
+    sr.s = s;
+    sr.ai = ai;
+    sr.ps = ps;
+    sr.cs = cs;
+    Calloc(sr.pick, int *, ai->n * sizeof(int));
+    sr.npick = 0;
+    for (i=0; i<ai->n; i++)
+	if (!s->ai || !strcasecmp(s->ai, ai->player[i].name))
+	    sr.pick[sr.npick++] = i;
+    if (sr.npick == 0) {
+	Debug("There is no AI called [%s].\n", s->ai);
+	free(sr.pick);
+	return 1;
+    }
+
+    sim_start();
+    sr.nshard = s->shards > 0 ? s->shards : sim_num_cpus();
+    if (sr.nshard > s->games) sr.nshard = s->games;
+    Calloc(sr.shard, Selfplay_Shard *, sr.nshard * sizeof(Selfplay_Shard));
+    for (i=0; i<sr.nshard; i++)
+	Calloc(sr.shard[i].c, AI_Counters *, ai->n * sizeof(AI_Counters));
+
+    sr.first = selfplay_recorded(s, &recorded);
+
+    printf("Self-play: %d games, %d AIs, %d shards, seed %u\n", s->games,
+	    sr.npick, sr.nshard, (unsigned) (s->seed + sr.first));
+    if (recorded)
+	printf("  after the %d games already in [%.2000s.NN.idx]\n",
+		recorded, s->out);
+    fflush(stdout);
+    start = sim_now();
+    sim_run(selfplay_shard_job, &sr, sr.nshard);
+    elapsed = sim_now() - start;
+
+    for (i=0; i<sr.nshard; i++) {
+	Selfplay_Shard *sh = &sr.shard[i];
+	games += sh->games;
+	records += sh->written;
+	failed += sh->failed;
+	printf("  %.2000s.%02d.rec: %d games, %d records (%lu in all)\n",
+		s->out, i, sh->games, sh->written,
+		(unsigned long) sh->records);
+    }
+    printf("%d games, %d records in %.1f seconds (%.0f records/hour)\n",
+	    games, records, elapsed,
+	    elapsed > 0 ? records / elapsed * 3600.0 : 0.0);
+
+    Calloc(c, AI_Counters *, ai->n * sizeof(AI_Counters));
+    for (i=0; i<sr.nshard; i++) {
+	for (k=0; k<ai->n; k++)
+	    ai_counters_sum(&c[k], &sr.shard[i].c[k]);
+	free(sr.shard[i].c);
+    }
+    printf("\n");
+    ai_counters_print(stdout, NULL, NULL);
+    for (k=0; k<sr.npick; k++)
+	ai_counters_print(stdout, ai->player[sr.pick[k]].name,
+		&c[sr.pick[k]]);
+    fflush(stdout);
+
+    free(c);
+    free(sr.shard);
+    free(sr.pick);
+    return failed == sr.nshard;
+}
+
+/* the book in use, if any */
+static Book_Header *book_map = NULL;
+static size_t book_map_size = 0;
+static Book_Entry *book_table = NULL;
+
+/* everything the jobs need to see */
+typedef struct book_run_struct {
+    Book *b;
+    AI_Player *ai;
+    piece_style *ps;
+    color_style *cs;
+    int njob;
+    Book_Entry *found;	/* [positions * plies], key 0 where none */
+} Book_Run;
+
+/***************************************************************************
+ *      book_key()
+ * Where a position goes in the book; see book.h. Never 0.
+ ***************************************************************************/
+static Uint64
+book_key(Grid *g, play_piece *cp, play_piece *np, piece_style *ps)
+{
+    Uint64 key = 14695981039346656037ULL;
+    int x, y, top, depth;
+
+#define BOOK_HASH(v)	(key = (key ^ (Uint8) (v)) * 1099511628211ULL)
+    for (top=0; top<g->h; top++) {
+	for (x=0; x<g->w; x++)
+	    if (GRID_CONTENT(*g,x,top))
+		break;
+	if (x < g->w)
+	    break;
+    }
+    BOOK_HASH(g->w);
+    BOOK_HASH(g->h);
+    BOOK_HASH(top);
+    for (x=0; x<g->w; x++) {
+	for (depth=0, y=top; y<g->h && depth<BOOK_DEPTH; y++, depth++)
+	    if (GRID_CONTENT(*g,x,y))
+		break;
+	BOOK_HASH(depth);
+    }
+    BOOK_HASH(cp->base - ps->shape);
+    BOOK_HASH(np->base - ps->shape);
+#undef BOOK_HASH
+    return key ? key : 1;
+}
+
+/***************************************************************************
+ *      book_close()
+ * Stops using the book, if there is one.
+ ***************************************************************************/
+static void
+book_close(void)
+{
+    if (book_map)
+	munmap(book_map, book_map_size);
+    book_map = NULL;
+    book_table = NULL;
+    book_map_size = 0;
+}
+
+/***************************************************************************
+ *      book_load()
+ * Maps the book in filespec and starts using it. Returns 0 (and goes on
+ * without a book) if it cannot be read or is not one of ours.
+ *********************************************************************PROTO*/
+int
+book_load(const char *filespec)
+{
+    int fd = open(filespec, O_RDONLY);
+    struct stat st;
+    Book_Header *h;
+
+    book_close();
+    if (fd < 0) {
+	Debug("Cannot read opening book [%s]\n", filespec);
+	return 0;
+    }
+    if (fstat(fd, &st) || st.st_size < (off_t) sizeof(Book_Header)) {
+	Debug("[%s] is too short to be an opening book.\n", filespec);
+	close(fd);
+	return 0;
+    }
+    h = (Book_Header *) mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (h == MAP_FAILED) {
+	Debug("Cannot map opening book [%s]\n", filespec);
+	return 0;
+    }
+    if (memcmp(h->magic, BOOK_MAGIC, 8) ||
+	    h->entry_size != sizeof(Book_Entry) || h->depth != BOOK_DEPTH ||
+	    h->slots == 0 || (h->slots & (h->slots - 1)) ||
+	    st.st_size != (off_t) (sizeof(Book_Header) +
+		(size_t) h->slots * sizeof(Book_Entry))) {
+	Debug("[%s] is not an opening book this version can use.\n",
+		filespec);
+	munmap(h, st.st_size);
+	return 0;
+    }
+    book_map = h;
+    book_map_size = st.st_size;
+    book_table = (Book_Entry *) (h + 1);
+    Debug("Opening book [%s] loaded: %u positions from %.24s.\n", filespec,
+	    (unsigned) h->entries, h->ai);
+    return 1;
+}
+
+/***************************************************************************
+ *      book_lookup()
+ * If the book knows where cp goes on g (with np coming next), puts it in
+ * *goal and returns 1. The placement was right for a board with the same
+ * surface, which may not be this one all the way down, so the caller
+ * should make sure the piece can still be steered there. "pieces" is how
+ * many have been placed on g since it was made: the book only covers the
+ * first Book_Header.plies of those, and later boards only look like the
+ * ones in it near the top. Uses the piece style from sim_set_styles().
+ *********************************************************************PROTO*/
+int
+book_lookup(Grid *g, int pieces, play_piece *cp, play_piece *np,
+	AI_Placement *goal)
+{
+    piece_style *ps;
+    color_style *cs;
+    Uint64 key;
+    Uint32 i, mask;
+
+    if (book_map == NULL || pieces >= book_map->plies ||
+	    !sim_get_styles(&ps, &cs) || g->w != book_map->w || g->h != book_map->h ||
+	    strncmp(ps->name, book_map->piece_style,
+		sizeof(book_map->piece_style)))
+	return 0;
+    key = book_key(g, cp, np, ps);
+    mask = book_map->slots - 1;
+    for (i = (Uint32) key & mask; book_table[i].key; i = (i + 1) & mask)
+	if (book_table[i].key == key) {
+	    goal->col = book_table[i].col;
+	    goal->row = book_table[i].row;
+	    goal->rot = book_table[i].rot;
+	    return 1;
+	}
+    return 0;
+}
 
-#ifdef DEBUG
-	for (y=0;y<retval->shape[i].dim;y++) {
-	    for (rot=0;rot<4;rot++) {
-		for (x=0;x<retval->shape[i].dim;x++) {
-		    printf("%d", BITMAP(retval->shape[i],rot,x,y));
-		}
-		printf("\t");
+/***************************************************************************
+ *      book_job()
+ * Plays out boards i, i + njob, i + 2*njob ... and notes down every
+ * placement the AI could steer its piece to.
+ ***************************************************************************/
+static void
+book_job(void *arg, int i)
+{
+    Book_Run *br = (Book_Run *) arg;
+    Book *b = br->b;
+    void *state = NULL;
+    int k, ply, x;
+
+    sim_set_styles(br->ps, br->cs);
+    for (k=i; k<b->positions; k+=br->njob) {
+	Uint32 seed = b->seed + k;
+	int level = b->level ? b->level : 1 + k % BOOK_LEVELS;
+	Grid g = generate_board_r(10, 20, level, &seed);
+	play_piece cp = generate_piece_r(br->ps, br->cs, &seed);
+	AI_Placement last;
+
+	for (ply=0; ply<b->plies; ply++) {
+	    play_piece np = generate_piece_r(br->ps, br->cs, &seed);
+	    Book_Entry *e = &br->found[k * b->plies + ply];
+	    Uint64 key = book_key(&g, &cp, &np, br->ps);
+	    int col, row, rot, r;
+
+	    sim_virtual_clock(1);
+	    r = sim_decide(br->ai, &state, &g, &cp, &np, ply ? &last : NULL,
+		    ply, br->cs->w, sim_fall(level), &col, &row, &rot);
+	    if (r < 0)
+		break;
+	    if (r > 0) {
+		e->key = key;
+		e->col = col;
+		e->row = row;
+		e->rot = rot;
 	    }
-	    printf("\n");
+	    if (drop_piece_on_grid(&g, &cp, col, row, rot) < 0)
+		break;
+	    for (x=0; x<g.w * g.h; x++)
+		if (g.contents[x] == 1)
+		    break;
+	    if (x == g.w * g.h)
+		break;	/* that was the last of the garbage */
+	    last.col = col;
+	    last.row = row;
+	    last.rot = rot;
+	    cp = np;
 	}
-#endif
+	free_board(&g);
     }
+    if (br->ai->release && state)
+	br->ai->release(state);
+    sim_virtual_clock(0);
+}
 
+/***************************************************************************
+ *      book_make()
+ * Has b->ai play b->plies pieces on each of b->positions boards and
+ * writes every placement it chose to the book in b->out, the first one
+ * made wherever two boards had the same key. Returns 0, or 1 if there is
+ * no such AI or the book cannot be written.
+ *********************************************************************PROTO*/
+int
+book_make(Book *b, AI_Players *ai, piece_style *ps, color_style *cs)
+{
+    Book_Run br;
+    Book_Header h;
+    Book_Entry *table;
+    Uint32 slots, entries = 0, placed = 0, mask;
+    double start, elapsed;
+    FILE *f;
+    int i, n;
+
+    book_close();	/* the AI works everything out for itself */
+    if (b->plies < 1) b->plies = 1;
+    br.ai = NULL;
+    for (i=0; i<ai->n; i++)
+	if (!strcasecmp(b->ai, ai->player[i].name))
+	    br.ai = &ai->player[i];
+    if (br.ai == NULL) {
+	Debug("There is no AI called [%s].\n", b->ai);
+	return 1;
+    }
+    br.b = b;
+    br.ps = ps;
+    br.cs = cs;
+    n = b->positions * b->plies;
+    Calloc(br.found, Book_Entry *, n * sizeof(Book_Entry));
+
+    sim_start();
+    br.njob = 4 * sim_num_cpus();
+    if (br.njob > b->positions) br.njob = b->positions;
+    printf("Opening book: %s, %d boards, %d pieces each, seed %u\n",
+	    br.ai->name, b->positions, b->plies, (unsigned) b->seed);
+    fflush(stdout);
+    start = sim_now();
+    sim_run(book_job, &br, br.njob);
+    elapsed = sim_now() - start;
+
+    /* at most half full, so that a miss does not have far to look */
+    for (slots = 16; slots < 2 * (Uint32) n; slots *= 2)
+	;
+    mask = slots - 1;
+    Calloc(table, Book_Entry *, slots * sizeof(Book_Entry));
+    for (i=0; i<n; i++) {
+	Uint32 j;
+	if (br.found[i].key == 0)
+	    continue;
+	placed++;
+	for (j = (Uint32) br.found[i].key & mask; table[j].key &&
+		table[j].key != br.found[i].key; j = (j + 1) & mask)
+	    ;
+	if (table[j].key == 0) {
+	    table[j] = br.found[i];
+	    entries++;
+	}
+    }
 
-    Debug("Piece Style [%s] loaded (%d pieces).\n",retval->name,
-	    retval->num_piece);
-    return retval;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, BOOK_MAGIC, 8);
+    h.entry_size = sizeof(Book_Entry);
+    h.slots = slots;
+    h.entries = entries;
+    h.seed = b->seed;
+    h.w = 10;
+    h.h = 20;
+    h.depth = BOOK_DEPTH;
+    h.plies = b->plies;
+    strncpy(h.piece_style, ps->name, sizeof(h.piece_style) - 1);
+    strncpy(h.ai, br.ai->name, sizeof(h.ai) - 1);
+
+    f = fopen(b->out, "wb");
+    if (f && (fwrite(&h, sizeof(h), 1, f) != 1 ||
+		fwrite(table, sizeof(Book_Entry), slots, f) != slots)) {
+	fclose(f);
+	f = NULL;
+    }
+    if (f) {
+	fclose(f);
+	printf("%u positions from %u placements in %.1f seconds, "
+		"written to [%s]\n", (unsigned) entries, (unsigned) placed,
+		elapsed, b->out);
+    } else
+	Debug("Cannot write the opening book to [%s].\n", b->out);
+
+    free(table);
+    free(br.found);
+    return f == NULL;
 }
 
+/* is tick a before tick b? */
+#define TIMER_BEFORE(a,b)	((Sint32) ((a) - (b)) < 0)
+
 /***************************************************************************
- *	piece_Select()
- * Returns 1 if the file pointed to ends with ".Piece" 
- * Used by scandir() to grab all the *.Piece files from a directory. 
+ *      timer_place()
+ * Puts t at heap[i] and remembers that it is there.
  ***************************************************************************/
-static int
-piece_Select(const struct dirent *d)
+static void
+timer_place(Timer_Queue *q, int i, Timer t)
 {
-    if (strstr(d->d_name,".Piece") && 
-	    (signed)strlen(d->d_name) == 
-	    (strstr(d->d_name,".Piece") - d->d_name + 6))
-	return 1;
-    else 
-	return 0; 
+    q->heap[i] = t;
+    q->at[t.id] = i;
 }
 
 /***************************************************************************
- *      load_piece_styles()
- * Load all ".Style" files in the directory.
+ *      timer_up()
+ * Moves heap[i] towards the top until its parent is not due after it.
+ ***************************************************************************/
+static void
+timer_up(Timer_Queue *q, int i)
+{
+    Timer t = q->heap[i];
+
+    while (i > 0 && TIMER_BEFORE(t.when, q->heap[(i-1)/2].when)) {
+	timer_place(q, i, q->heap[(i-1)/2]);
+	i = (i-1)/2;
+    }
+    timer_place(q, i, t);
+}
+
+/***************************************************************************
+ *      timer_down()
+ * Moves heap[i] towards the bottom until neither child is due before it.
+ ***************************************************************************/
+static void
+timer_down(Timer_Queue *q, int i)
+{
+    Timer t = q->heap[i];
+    int c;
+
+    while ((c = 2*i + 1) < q->n) {
+	if (c+1 < q->n && TIMER_BEFORE(q->heap[c+1].when, q->heap[c].when))
+	    c++;
+	if (!TIMER_BEFORE(q->heap[c].when, t.when))
+	    break;
+	timer_place(q, i, q->heap[c]);
+	i = c;
+    }
+    timer_place(q, i, t);
+}
+
+/***************************************************************************
+ *      timer_init()
+ * Room for timers 0 to max-1, none of them armed.
  *********************************************************************PROTO*/
-piece_styles
-load_piece_styles(void)
+void
+timer_init(Timer_Queue *q, int max)
 {
-    piece_styles retval;
-    int i = 0;
-    DIR *my_dir;
-    char filespec[2048];
+    int i;
 
-    memset(&retval, 0, sizeof(retval));
+    q->n = 0;
+    q->max = max;
+    Calloc(q->heap, Timer *, max * sizeof(Timer));
+    Malloc(q->at, int *, max * sizeof(int));
+    for (i=0; i<max; i++)
+	q->at[i] = -1;
+}
 
-    my_dir = opendir("styles");
-    if (my_dir) {
-	while (1) { 
-	    struct dirent *this_file = readdir(my_dir);
-	    if (!this_file) break;
-	    if (piece_Select(this_file))
-		i++;
-	} 
-	closedir(my_dir);
+/***************************************************************************
+ *      timer_free()
+ * Gives back what timer_init() took.
+ *********************************************************************PROTO*/
+void
+timer_free(Timer_Queue *q)
+{
+    Free(q->heap);
+    Free(q->at);
+    q->n = q->max = 0;
+}
+
+/***************************************************************************
+ *      timer_set()
+ * Arms timer id for tick "when", or moves it there if it was armed.
+ *********************************************************************PROTO*/
+void
+timer_set(Timer_Queue *q, int id, Uint32 when)
+{
+    int i = q->at[id];
+    Timer t;
+
+    Assert(id >= 0 && id < q->max);
+    t.when = when;
+    t.id = id;
+    if (i < 0) {
+	i = q->n++;
+	timer_place(q, i, t);
+	timer_up(q, i);
+    } else if (TIMER_BEFORE(when, q->heap[i].when)) {
+	timer_place(q, i, t);
+	timer_up(q, i);
     } else {
-	PANIC("Cannot read directory [styles/]");
+	timer_place(q, i, t);
+	timer_down(q, i);
     }
-    my_dir = opendir("styles");
-    if (my_dir) {
-	if (i > 0) { 
-	    int j;
-	    Calloc(retval.style,piece_style **,sizeof(*(retval.style))*i);
-	    retval.num_style = i;
-	    j = 0;
-	    while (j<i) {
-		struct dirent *this_file = readdir(my_dir);
-		if (!piece_Select(this_file)) continue;
-		sprintf(filespec,"styles/%s",this_file->d_name);
-		retval.style[j] = load_piece_style(filespec);
-		if (strstr(retval.style[j]->name,"Default"))
-		    retval.choice = j;
-		j++;
-	    }
-	    closedir(my_dir);
-	    return retval;
-	} else {
-	    PANIC("No piece styles [styles/*.Piece] found.\n");
-	}
-    } else { 
-	PANIC("Cannot read directory [styles/]");
+}
+
+/***************************************************************************
+ *      timer_cancel()
+ * Disarms timer id, if it was armed.
+ *********************************************************************PROTO*/
+void
+timer_cancel(Timer_Queue *q, int id)
+{
+    int i = q->at[id];
+    Timer last;
+
+    if (i < 0)
+	return;
+    q->at[id] = -1;
+    if (i == --q->n)
+	return;
+    /* the last one takes its place and goes whichever way it must */
+    last = q->heap[q->n];
+    timer_place(q, i, last);
+    timer_up(q, i);
+    if (q->at[last.id] == i)
+	timer_down(q, i);
+}
+
+/***************************************************************************
+ *      timer_when()
+ * When timer id is due. Only means something if it is armed.
+ *********************************************************************PROTO*/
+Uint32
+timer_when(Timer_Queue *q, int id)
+{
+    return q->at[id] < 0 ? 0 : q->heap[q->at[id]].when;
+}
+
+/***************************************************************************
+ *      timer_due()
+ * Is timer id armed and due at tick "now"?
+ *********************************************************************PROTO*/
+int
+timer_due(Timer_Queue *q, int id, Uint32 now)
+{
+    return q->at[id] >= 0 && !TIMER_BEFORE(now, q->heap[q->at[id]].when);
+}
+
+/***************************************************************************
+ *      timer_next()
+ * Returns the id of the next timer due and puts its tick in *when, or
+ * returns -1 if none is armed.
+ *********************************************************************PROTO*/
+int
+timer_next(Timer_Queue *q, Uint32 *when)
+{
+    if (q->n == 0)
+	return -1;
+    *when = q->heap[0].when;
+    return q->heap[0].id;
+}
+
+#define RENDER_INDEX	3	/* which of the three frames */
+#define RENDER_FRESH	4	/* ... and it has not been taken yet */
+#define RENDER_WAITING()	(__sync_fetch_and_or(&render.middle, 0) & RENDER_FRESH)
+
+static struct render_struct {
+    SDL_Thread *thread;
+    SDL_mutex *lock;		/* around every SDL call during a game */
+    SDL_mutex *wake_lock;	/* only for sleeping on "wake" till the tick */
+    SDL_cond *wake;
+    int running;
+    volatile int quit;
+    int paused;			/* under "lock" */
+
+    int nboard;
+    Grid g[RENDER_MAX_BOARD];	/* the boards: where, and how big */
+    Session *session;		/* whose they are */
+    color_style *cs[RENDER_MAX_BOARD];
+
+    Render_Frame frame[3];
+    int back;			/* the event loop fills this one */
+    int front;			/* the render thread draws this one */
+    int middle;			/* the newest, | RENDER_FRESH */
+    Render_Frame drawn;		/* what the screen shows */
+    int drawn_valid;
+
+    unsigned long published;
+    unsigned long frames;	/* ... of those, drawn */
+    double draw_time;		/* seconds */
+} render;
+
+/***************************************************************************
+ *      render_alloc()
+ * Gives frame f room for every board's squares.
+ ***************************************************************************/
+static void
+render_alloc(Render_Frame *f)
+{
+    int Q;
+
+    memset(f, 0, sizeof(*f));
+    for (Q=0; Q<render.nboard; Q++) {
+	int n = render.g[Q].w * render.g[Q].h;
+	Calloc(f->b[Q].contents, unsigned char *, n);
+	Calloc(f->b[Q].fall, unsigned char *, n);
+	f->b[Q].blank = -1;
     }
-    return retval;
 }
 
 /***************************************************************************
- *      load_color_style()
- * Load a color style from the given file.
+ *      render_release()
  ***************************************************************************/
-static color_style *
-load_color_style(SDL_Surface * screen, const char *filename)
+static void
+render_release(Render_Frame *f)
 {
-    color_style *retval;
-    char buf[2048];
-    FILE *fin = fopen(filename,"rt");
-    int i;
+    int Q;
 
-    if (!fin) {
-	Debug("fopen(%s)\n",filename);
-	return NULL;
+    for (Q=0; Q<render.nboard; Q++) {
+	Free(f->b[Q].contents);
+	Free(f->b[Q].fall);
     }
-    Calloc(retval,color_style *,sizeof(*retval));
+}
 
-    fgets(buf,sizeof(buf),fin);
-    if (feof(fin)) {
-	Debug("unexpected EOF after name in [%s]\n",filename);
-	free(retval);
-	return NULL;
+/***************************************************************************
+ *      render_same()
+ * Would board Q look just the same in frame a as in frame b?
+ ***************************************************************************/
+static int
+render_same(int Q, Render_Board *a, Render_Board *b)
+{
+    int n = render.g[Q].w * render.g[Q].h;
+
+    if (a->blank != b->blank)
+	return 0;
+    if (a->blank >= 0)
+	return 1;	/* the distraction does not change */
+    if (a->fall_offset != b->fall_offset || a->piece != b->piece)
+	return 0;
+    if (a->piece && (a->x != b->x || a->draw_y != b->draw_y ||
+		a->rot != b->rot ||
+		memcmp(&a->cp, &b->cp, sizeof(a->cp))))
+	return 0;
+    return !memcmp(a->contents, b->contents, n) &&
+	!memcmp(a->fall, b->fall, n);
+}
+
+/***************************************************************************
+ *      render_board()
+ * Draws all of board Q as frame board b has it.
+ ***************************************************************************/
+static void
+render_board(int Q, Render_Board *b)
+{
+    Grid view = render.g[Q];
+    color_style *cs = render.cs[Q];
+    SDL_Rect all = view.board;
+    int i, j;
+
+    if (b->blank >= 0) {
+	Grid *d = &render.session->distract[Q];
+	SDL_FillRect(screen, &all, SDL_MapRGB(screen->format,32,32,32));
+	for (j=0; j<b->blank && j<d->h; j++)
+	    for (i=0; i<d->w; i++)
+		if (GRID_CONTENT(*d,i,j))
+		    draw_grid_block(screen, cs, d, i, j, 0);
+	SDL_UpdateSafe(screen, 1, &all);
+	return;
     }
-    if (strchr(buf,'\n'))
-	*(strchr(buf,'\n')) = 0;
-    retval->name = strdup(buf);
 
-    if (fscanf(fin,"%d\n",&retval->num_color) != 1) {
-	Debug("malformed color count in [%s]\n",filename);
-	free(retval->name);
-	free(retval);
-	return NULL;
+    view.contents = b->contents;
+    view.fall = b->fall;
+    SDL_FillRect(screen, &all, int_solid_black);
+    /* what stays put, then what is coming down on top of it */
+    for (j=0; j<view.h; j++)
+	for (i=0; i<view.w; i++)
+	    if (GRID_CONTENT(view,i,j) && !(b->fall_offset &&
+			FALL_CONTENT(view,i,j) == FALLING))
+		draw_grid_block(screen, cs, &view, i, j, 0);
+    if (b->fall_offset)
+	for (j=0; j<view.h; j++)
+	    for (i=0; i<view.w; i++)
+		if (GRID_CONTENT(view,i,j) &&
+			FALL_CONTENT(view,i,j) == FALLING)
+		    draw_grid_block(screen, cs, &view, i, j, b->fall_offset);
+    if (b->piece)
+	draw_play_piece(screen, cs, &b->cp, b->x, b->draw_y, b->rot,
+		&b->cp, b->x, b->draw_y, b->rot);
+    SDL_UpdateSafe(screen, 1, &all);
+}
+
+/***************************************************************************
+ *      render_place()
+ * Works out where in between its last fall and the next the piece on
+ * board Q is at tick now, never below where it really is, and how far
+ * down a row whatever is sliding after a clear has come.
+ ***************************************************************************/
+static void
+render_place(int Q, Render_Board *b, Uint32 at, Uint32 now)
+{
+    int age, h = render.cs[Q]->h;
+
+    b->fall_offset = 0;
+    if (b->slide_age >= 0) {
+	age = b->slide_age + (Sint32) (now - at);
+	b->fall_offset = max(1, min(h - 1, age * h / RENDER_SLIDE));
     }
 
-    Malloc(retval->color, SDL_Surface **,
-	    (retval->num_color+1)*sizeof(retval->color[0]));
+    b->draw_y = b->y;
+    if (!b->piece || b->fall_dy <= 0 || b->fall_interval <= 0)
+	return;
+    age = b->fall_age + (Sint32) (now - at);
+    if (age < 0) age = 0;
+    if (age < b->fall_interval)
+	b->draw_y = b->y - b->fall_dy + (b->fall_dy * age) / b->fall_interval;
+}
 
-    for (i=1;i<=retval->num_color;i++) {
-	SDL_Surface *imagebmp;
+/***************************************************************************
+ *      render_keep()
+ * Remembers frame f as what is on the screen now.
+ ***************************************************************************/
+static void
+render_keep(Render_Frame *f)
+{
+    int Q;
 
-	do {
-	    buf[0] = 0;
-	    fgets(buf,sizeof(buf),fin);
-	} while (!feof(fin) && (buf[0] == '\n' || buf[0] == '#'));
+    render.drawn.seconds = f->seconds;
+    for (Q=0; Q<render.nboard; Q++) {
+	Render_Board *d = &render.drawn.b[Q];
+	unsigned char *contents = d->contents, *fall = d->fall;
+	int n = render.g[Q].w * render.g[Q].h;
 
-	if (feof(fin)) PANIC("unexpected EOF in color style [%s]",retval->name);
-	if (strchr(buf,'\n'))
-	    *(strchr(buf,'\n')) = 0;
+	*d = f->b[Q];
+	d->contents = contents;
+	d->fall = fall;
+	memcpy(d->contents, f->b[Q].contents, n);
+	memcpy(d->fall, f->b[Q].fall, n);
+    }
+    render.drawn_valid = 1;
+}
 
-	imagebmp = SDL_LoadBMP(buf);
-	if (!imagebmp) 
-	    PANIC("cannot load [%s] in color style [%s]",buf,retval->name);
-	/* set the video colormap */
-	if ( imagebmp->format->palette != NULL ) {
-	    SDL_SetColors(screen,
-		    imagebmp->format->palette->colors, 0,
-		    imagebmp->format->palette->ncolors);
+/***************************************************************************
+ *      render_draw()
+ * Draws whatever is different in frame f from what is on the screen.
+ * Returns 1 if that was anything.
+ ***************************************************************************/
+static int
+render_draw(Render_Frame *f)
+{
+    double start = sim_now();
+    Uint32 now = SDL_GetTicks();
+    int Q, drew = !render.drawn_valid;
+
+    for (Q=0; Q<render.nboard; Q++) {
+	render_place(Q, &f->b[Q], f->at, now);
+	if (!render.drawn_valid ||
+		!render_same(Q, &f->b[Q], &render.drawn.b[Q])) {
+	    render_board(Q, &f->b[Q]);
+	    drew = 1;
 	}
-	/* Convert the image to the video format (maps colors) */
-	retval->color[i] = SDL_DisplayFormat(imagebmp);
-	SDL_FreeSurface(imagebmp);
-	if ( !retval->color[i] ) 
-	    PANIC("could not convert [%s] in color style [%s]", 
-		buf, retval->name);
-	if (i == 1) {
-	    retval->h = retval->color[i]->h;
-	    retval->w = retval->color[i]->w;
-	} else {
-	    if (retval->h != retval->color[i]->h ||
-		    retval->w != retval->color[i]->w)
-		PANIC("[%s] has the wrong size in color style [%s]",
-			buf, retval->name);
+	if (!render.drawn_valid || f->b[Q].score != render.drawn.b[Q].score) {
+	    draw_score_as(render.session, Q, f->b[Q].score);
+	    drew = 1;
 	}
-
     }
-    retval->color[0] = retval->color[1];
+    if (!render.drawn_valid || f->seconds != render.drawn.seconds) {
+	draw_clock(render.session, f->seconds);
+	drew = 1;
+    }
+    render_keep(f);
+    if (drew) {		/* the rest cost next to nothing */
+	render.frames++;
+	render.draw_time += sim_now() - start;
+    }
+    return drew;
+}
 
-    Debug("Color Style [%s] loaded (%d colors).\n",retval->name,
-	    retval->num_color);
+/***************************************************************************
+ *      render_swap()
+ * Puts "with" in the middle and returns what was there. Every frame
+ * written before is seen by whoever swaps it out.
+ ***************************************************************************/
+static int
+render_swap(int with)
+{
+    int old;
 
-    return retval;
+    do 
+	old = __sync_fetch_and_or(&render.middle, 0);
+    while (!__sync_bool_compare_and_swap(&render.middle, old, with));
+    return old;
 }
 
 /***************************************************************************
- *	color_Select()
- * Returns 1 if the file pointed to ends with ".Color" 
- * Used by scandir() to grab all the *.Color files from a directory. 
+ *      render_take()
+ * Swaps the render thread's frame for the newest one, if there is a new
+ * one. Returns 1 if there was.
  ***************************************************************************/
 static int
-color_Select(const struct dirent *d)
+render_take(void)
 {
-    if (strstr(d->d_name,".Color") && 
-	    (signed)strlen(d->d_name) == 
-	    (strstr(d->d_name,".Color") - d->d_name + 6))
-	return 1;
-    else 
-	return 0; 
+    int old;
+
+    if (!RENDER_WAITING())
+	return 0;
+    old = render_swap(render.front);
+    render.front = old & RENDER_INDEX;
+    return 1;
 }
 
 /***************************************************************************
- *	load_specials()
- * Loads the pictures for the special pieces.
+ *      render_thread()
+ * Every 1/RENDER_RATE of a second, draws the newest frame (or the last one
+ * again, with the piece further along), until render_stop().
  ***************************************************************************/
-static void
-load_special(void)
+static int
+render_thread(void *arg)
+{
+    Uint32 next = SDL_GetTicks();
+    int have = 0, quit;
+
+    for (;;) {
+	Sint32 wait;
+
+	SDL_mutexP(render.wake_lock);
+	while (!render.quit &&
+		(wait = (Sint32) (next - SDL_GetTicks())) > 0)
+	    SDL_CondWaitTimeout(render.wake, render.wake_lock, wait);
+	quit = render.quit;
+	SDL_mutexV(render.wake_lock);
+
+	if (render_take())
+	    have = 1;
+	if (have) {
+	    int drew = 0;
+
+	    SDL_mutexP(render.lock);
+	    if (!render.paused)
+		drew = render_draw(&render.frame[render.front]);
+	    SDL_mutexV(render.lock);
+	    if (drew)	/* it may have read input meant for the event loop */
+		idle_wake();
+	}
+	if (quit)
+	    return 0;
+	next += 1000 / RENDER_RATE;
+	if ((Sint32) (next - SDL_GetTicks()) < 0)
+	    next = SDL_GetTicks();	/* fell behind: do not try to catch up */
+    }
+}
+
+/***************************************************************************
+ *      render_start()
+ * Starts drawing session s's boards g[0] to g[nboard-1] (covered by its
+ * distractions when blanked) on the render thread, unless
+ * Options.render_thread says not to. Returns 1 if the caller must leave
+ * them to it.
+ *********************************************************************PROTO*/
+int
+render_start(Session *s, Grid g[], color_style *cs[], int nboard)
 {
     int i;
-#define NUM_SPECIAL 6
-    char *filename[NUM_SPECIAL] = {
-	"graphics/Special-Bomb.bmp",		/* special_bomb */
-	"graphics/Special-Drip.bmp",		/* special_repaint */
-	"graphics/Special-DownArrow.bmp",	/* special_pushdown */
-	"graphics/Special-Skull.bmp",		/* special_colorkill */
-	"graphics/Special-X.bmp",
-	"graphics/Special-YinYang.bmp" };
-
-    special_style.name = "Special Pieces";
-    special_style.num_color = NUM_SPECIAL;
-    Malloc(special_style.color, SDL_Surface **, NUM_SPECIAL * sizeof(SDL_Surface *));
-    special_style.w = 20;
-    special_style.h = 20;
 
-    for (i=0; i<NUM_SPECIAL; i++) {
-	SDL_Surface *imagebmp;
-	/* grab the lighting */
-	imagebmp = SDL_LoadBMP(filename[i]);
-	if (!imagebmp) 
-	    PANIC("cannot load [%s], a required special piece",filename[i]);
-	if ( imagebmp->format->palette != NULL ) {
-	    SDL_SetColors(screen,
-		    imagebmp->format->palette->colors, 0,
-		    imagebmp->format->palette->ncolors);
-	}
-	/* Convert the image to the video format (maps colors) */
-	special_style.color[i] = SDL_DisplayFormat(imagebmp);
-	SDL_FreeSurface(imagebmp);
-	if ( !special_style.color[i] ) 
-	    PANIC("could not convert [%s], a required special piece",filename[i]);
+    if (!Options.render_thread || render.running || nboard < 1)
+	return render.running;
+    Assert(nboard <= RENDER_MAX_BOARD);
+    if (!render.lock) {
+	render.lock = SDL_CreateMutex();
+	render.wake_lock = SDL_CreateMutex();
+	render.wake = SDL_CreateCond();
+	if (!render.lock || !render.wake_lock || !render.wake)
+	    PANIC("Cannot create the render locks: %s", SDL_GetError());
+    }
+    render.nboard = nboard;
+    for (i=0; i<nboard; i++) {
+	render.g[i] = g[i];
+	render.cs[i] = cs[i];
+    }
+    render.session = s;
+    for (i=0; i<3; i++)
+	render_alloc(&render.frame[i]);
+    render_alloc(&render.drawn);
+    render.drawn_valid = 0;
+    render.back = 0;
+    render.middle = 1;
+    render.front = 2;
+    render.quit = 0;
+    render.paused = 0;
+    render.published = render.frames = 0;
+    render.draw_time = 0;
+
+    render.thread = SDL_CreateThread(render_thread, NULL);
+    if (!render.thread) {
+	Debug("Cannot create the render thread (%s), drawing in line.\n",
+		SDL_GetError());
+	for (i=0; i<3; i++)
+	    render_release(&render.frame[i]);
+	render_release(&render.drawn);
+	return 0;
     }
-    return;
+    render.running = 1;
+    return 1;
 }
 
 /***************************************************************************
- *	load_edges()
- * Loads the pictures for the edges.
- ***************************************************************************/
-static void
-load_edges(void)
+ *      render_stop()
+ * Draws the last frame once more and stops the render thread.
+ *********************************************************************PROTO*/
+void
+render_stop(void)
 {
     int i;
-    char *filename[4] = {
-	"graphics/Horiz-Light.bmp",
-	"graphics/Vert-Light.bmp",
-	"graphics/Horiz-Dark.bmp",
-	"graphics/Vert-Dark.bmp" };
 
-    for (i=0;i<4;i++) {
-	SDL_Surface *imagebmp;
-	/* grab the lighting */
-	imagebmp = SDL_LoadBMP(filename[i]);
-	if (!imagebmp) 
-	    PANIC("cannot load [%s], a required edge",filename[i]);
-	/* set the video colormap */
-	if ( imagebmp->format->palette != NULL ) {
-	    SDL_SetColors(screen,
-		    imagebmp->format->palette->colors, 0,
-		    imagebmp->format->palette->ncolors);
-	}
-	/* Convert the image to the video format (maps colors) */
-	edge[i] = SDL_DisplayFormat(imagebmp);
-	SDL_FreeSurface(imagebmp);
-	if ( !edge[i] ) 
-	    PANIC("could not convert [%s], a required edge",filename[i]);
+    if (!render.running)
+	return;
+    SDL_mutexP(render.wake_lock);
+    render.quit = 1;
+    SDL_CondSignal(render.wake);
+    SDL_mutexV(render.wake_lock);
+    SDL_WaitThread(render.thread, NULL);
+    render.running = 0;
 
-	SDL_SetAlpha(edge[i],SDL_SRCALPHA|SDL_RLEACCEL, 48 /*128+64*/);
-    }
-    return; 
+    Debug("Render: %lu frames drawn of %lu, %.2f ms each.\n",
+	    render.frames, render.published, render.frames ?
+	    1000.0 * render.draw_time / render.frames : 0.0);
+    for (i=0; i<3; i++)
+	render_release(&render.frame[i]);
+    render_release(&render.drawn);
 }
 
+/***************************************************************************
+ *      render_frame()
+ * The frame for the event loop to fill in and render_publish(). NULL if
+ * the render thread is not running.
+ *********************************************************************PROTO*/
+Render_Frame *
+render_frame(void)
+{
+    return render.running ? &render.frame[render.back] : NULL;
+}
 
 /***************************************************************************
- *      load_color_styles()
- * Loads all available color styles.
+ *      render_publish()
+ * Hands the frame from render_frame() to the render thread. Never waits
+ * for it to be drawn: if the render thread does not get to it before the
+ * next one comes, it is simply never drawn.
  *********************************************************************PROTO*/
-color_styles 
-load_color_styles(SDL_Surface * screen)
+void
+render_publish(void)
 {
-    color_styles retval;
-    int i = 0;
-    DIR *my_dir;
-    char filespec[2048];
+    int old;
 
-    load_edges();
-    load_special();
+    if (!render.running)
+	return;
+    old = render_swap(render.back | RENDER_FRESH);
+    render.back = old & RENDER_INDEX;
+    render.published++;
+}
 
-    memset(&retval, 0, sizeof(retval));
+/***************************************************************************
+ *      render_lock()
+ * Keeps the render thread off the screen (and out of SDL) until
+ * render_unlock(). Does nothing if it is not running.
+ *********************************************************************PROTO*/
+void
+render_lock(void)
+{
+    if (render.running)
+	SDL_mutexP(render.lock);
+}
 
-    my_dir = opendir("styles");
-    if (my_dir) {
-	while (1) { 
-	    struct dirent *this_file = readdir(my_dir);
-	    if (!this_file) break;
-	    if (color_Select(this_file))
-		i++;
-	} 
-	closedir(my_dir);
-    } else {
-	PANIC("Cannot read directory [styles/]");
-    }
-    my_dir = opendir("styles");
-    if (my_dir) {
-	if (i > 0) { 
-	    int j;
-	    Calloc(retval.style,color_style **,sizeof(*(retval.style))*i);
-	    retval.num_style = i;
-	    j = 0;
-	    while (j<i) {
-		struct dirent *this_file = readdir(my_dir);
-		if (!color_Select(this_file)) continue;
-		sprintf(filespec,"styles/%s",this_file->d_name);
-		retval.style[j] = load_color_style(screen, filespec);
-		if (strstr(retval.style[j]->name,"Default"))
-		    retval.choice = j;
-		j++;
-	    }
-	    closedir(my_dir);
-	    return retval;
-	} else {
-	    PANIC("No piece styles [styles/*.Color] found.\n");
-	}
-    } else { 
-	PANIC("Cannot read directory [styles/]");
-    }
-    return retval;
+/***************************************************************************
+ *      render_unlock()
+ *********************************************************************PROTO*/
+void
+render_unlock(void)
+{
+    if (render.running)
+	SDL_mutexV(render.lock);
 }
 
 /***************************************************************************
- *      generate_piece()
- * Chooses the next piece in sequence. This involves assigning colors to
- * all of the tiles that make up the shape of the piece.
- *
- * Uses the color style because it needs to know the number of colors.
+ *      render_pause()
+ * While the game is paused the screen belongs to the flame and the render
+ * thread draws nothing. Call it between render_lock() and render_unlock().
  *********************************************************************PROTO*/
-play_piece
-generate_piece(piece_style *ps, color_style *cs, unsigned int seq)
+void
+render_pause(int on)
 {
-    unsigned int p,q,r,c;
-    play_piece retval;
+    render.paused = on;
+}
 
-    SeedRandom(seq);
+/***************************************************************************
+ *      session_init()
+ * A new match of the given game type: no score, nothing drawn yet. It has
+ * as many boards as that game type always has; a free-for-all (AI_VS_AI,
+ * or SINGLE_VS_AI against several AIs) sets "boards" to more before it
+ * draws the background.
+ *********************************************************************PROTO*/
+void
+session_init(Session *s, GT gametype)
+{
+    memset(s, 0, sizeof(*s));
+    s->gametype = gametype;
+    s->boards = (gametype == SINGLE || gametype == MARATHON ||
+	    gametype == DEMO) ? 1 : 2;
+    s->layout.clock_seconds = -111;
+}
 
-    p = ZEROTO(ps->num_piece);
-    q = 2 + ZEROTO(cs->num_color - 1);
-    r = 2 + ZEROTO(cs->num_color - 1);
-    retval.base = &(ps->shape[p]);
+/***************************************************************************
+ *      session_free()
+ * Says how the match's time was spent and gives back what it took.
+ *********************************************************************PROTO*/
+void
+session_free(Session *s)
+{
+    int i;
 
-    retval.special = No_Special;
-    if (Options.special_wanted && ZEROTO(10000) < 2000) {
-	switch (ZEROTO(4)) {
-	    case 0: retval.special = Special_Bomb; /* bomb */
-		    break;
-	    case 1: retval.special = Special_Repaint; /* repaint */
-		    break; 
-	    case 2: retval.special = Special_Pushdown; /* repaint */
-		    break;
-	    case 3: retval.special = Special_Colorkill; /* trace and kill color */
-		    break;
-	}
-    }
-    if (retval.special != No_Special) {
-	for (c=1;c<=(unsigned)ps->shape[p].num_color;c++) {
-	    retval.colormap[c] = (unsigned char) retval.special;
-	}
-    } else for (c=1;c<=(unsigned)ps->shape[p].num_color;c++) {
-	if (ZEROTO(100) < 25) 
-	    retval.colormap[c] = q; 
-	else
-	    retval.colormap[c] = r; 
-	Assert(retval.colormap[c] > 1);
+    event_report(s);
+    if (s->timers.max)
+	timer_free(&s->timers);
+    for (i=0; i<MAX_PLAYERS; i++)
+	free_board(&s->distract[i]);
+}
+
+/***************************************************************************
+ *      latency_index()
+ * The bucket value v is counted in.
+ ***************************************************************************/
+static int
+latency_index(Uint32 v)
+{
+    int top = LATENCY_SUB_BITS;
+
+    if (v < LATENCY_SUB)
+	return v;
+    while (v >> (top + 1))
+	top++;
+    /* the LATENCY_SUB_BITS bits under the top one say which bucket */
+    return LATENCY_SUB * (top - LATENCY_SUB_BITS + 1) +
+	(int) ((v >> (top - LATENCY_SUB_BITS)) - LATENCY_SUB);
+}
+
+/***************************************************************************
+ *      latency_top()
+ * The biggest value counted in bucket i.
+ ***************************************************************************/
+static Uint32
+latency_top(int i)
+{
+    int shift;
+
+    if (i < LATENCY_SUB)
+	return i;
+    shift = i / LATENCY_SUB - 1;
+    return (((Uint32) (LATENCY_SUB + i % LATENCY_SUB) + 1) << shift) - 1;
+}
+
+/***************************************************************************
+ *      latency_add()
+ * Counts one more thing that took "us" microseconds.
+ *********************************************************************PROTO*/
+void
+latency_add(Latency *h, Uint32 us)
+{
+    if (us > LATENCY_MAX)
+	us = LATENCY_MAX;
+    h->n++;
+    h->total += us;
+    if (us > h->worst)
+	h->worst = us;
+    h->bucket[latency_index(us)]++;
+}
+
+/***************************************************************************
+ *      latency_at()
+ * How long the given fraction (0.5 for the median) of everything counted
+ * took at most, to within a bucket.
+ *********************************************************************PROTO*/
+Uint32
+latency_at(const Latency *h, double fraction)
+{
+    unsigned long want = (unsigned long) (fraction * h->n + 0.5), seen = 0;
+    int i;
+
+    if (want < 1)
+	want = 1;
+    for (i=0; i<LATENCY_BUCKETS; i++)
+	if ((seen += h->bucket[i]) >= want)
+	    return min(latency_top(i), h->worst);
+    return h->worst;
+}
+
+/***************************************************************************
+ *      latency_write()
+ * Writes histogram h to fout, one line per bucket that has anything in it:
+ * its name, the bucket's top value, the count and the fraction of
+ * everything counted that is that long or less.
+ *********************************************************************PROTO*/
+void
+latency_write(FILE *fout, const char *name, const Latency *h)
+{
+    unsigned long seen = 0;
+    int i;
+
+    for (i=0; i<LATENCY_BUCKETS; i++) {
+	if (!h->bucket[i])
+	    continue;
+	seen += h->bucket[i];
+	fprintf(fout, "%s\t%lu\t%lu\t%.6f\n", name,
+		(unsigned long) min(latency_top(i), h->worst), h->bucket[i],
+		(double) seen / h->n);
     }
-    return retval;
 }
 
-#define PRECOLOR_AT(pp,rot,i,j) BITMAP(*pp->base,rot,i,j)
+#if HAVE_SELECT && !HAVE_WINSOCK_H
+#define IDLE_SELECT	1
+#endif
+
+static int idle_pipe[2] = { -1, -1 };	/* idle_wake() to idle_wait() */
+static int idle_x11 = -1;		/* the X server connection */
 
 /***************************************************************************
- *      draw_play_piece()
- * Draws a play piece on the screen.
- *
- * Needs the color style because it actually has to paste the color
- * bitmaps.
+ *      idle_setup()
+ * Finds out how we can hear about input without asking: call it once
+ * the video mode is set.
+ *********************************************************************PROTO*/
+void
+idle_setup(void)
+{
+#if IDLE_SELECT
+#ifdef SDL_VIDEO_DRIVER_X11
+    SDL_SysWMinfo info;
+
+    SDL_VERSION(&info.version);
+    if (SDL_GetWMInfo(&info) > 0 && info.subsystem == SDL_SYSWM_X11)
+	idle_x11 = ConnectionNumber(info.info.x11.display);
+#endif
+    if (idle_x11 < 0 || idle_pipe[0] >= 0)
+	return;
+    if (pipe(idle_pipe)) {
+	Debug("pipe(): %s, looking for input every %d ms instead.\n",
+		strerror(errno), IDLE_POLL);
+	idle_pipe[0] = idle_pipe[1] = -1;
+	idle_x11 = -1;
+	return;
+    }
+#if HAVE_FCNTL_H
+    fcntl(idle_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(idle_pipe[1], F_SETFL, O_NONBLOCK);
+#endif
+#endif
+}
+
+/***************************************************************************
+ *      idle_wake()
+ * Cuts short whatever idle_wait() is sleeping, on any thread.
  *********************************************************************PROTO*/
 void
-draw_play_piece(SDL_Surface *screen, color_style *cs, 
-	play_piece *o_pp, int o_x, int o_y, int o_rot,	/* old */
-	play_piece *pp,int x, int y, int rot)		/* new */
+idle_wake(void)
 {
-    SDL_Rect dstrect;
-    int i,j;
-    int w,h;
+    char c = 0;
 
-    if (pp->special != No_Special)
-	cs = &special_style;
+    if (idle_pipe[1] >= 0 && write(idle_pipe[1], &c, 1) < 0) {
+	/* full: it will wake up anyway */
+    }
+}
 
-    w = cs->w;
-    h = cs->h;
+/***************************************************************************
+ *      idle_key_held()
+ * Is a key down that SDL would repeat? It makes up its repeats only while
+ * we ask for events. The lock keys read as down for as long as the lock
+ * is on, and neither they nor the modifiers ever repeat.
+ ***************************************************************************/
+static int
+idle_key_held(void)
+{
+    int n, i;
+    Uint8 *key = SDL_GetKeyState(&n);
 
-    for (j=0;j<o_pp->base->dim;j++)
-	for (i=0;i<o_pp->base->dim;i++) {
-	    int what;
-	    /* clear old */
-	    if ((what = PRECOLOR_AT(o_pp,o_rot,i,j))) {
-		dstrect.x = o_x + i * w;
-		dstrect.y = o_y + j * h;
-		dstrect.w = w;
-		dstrect.h = h;
-		SDL_BlitSafe(widget_layer,&dstrect,screen,&dstrect);
-	    }
-	}
-    for (j=0;j<pp->base->dim;j++)
-	for (i=0;i<pp->base->dim;i++) {
-	    int this_precolor;
-	    /* draw new */
-	    if ((this_precolor = PRECOLOR_AT(pp,rot,i,j))) {
-		int this_color = pp->colormap[this_precolor];
-		dstrect.x = x + i * w;
-		dstrect.y = y + j * h;
-		dstrect.w = w;
-		dstrect.h = h;
-		SDL_BlitSafe(cs->color[this_color], NULL,screen,&dstrect) ;
-		if (pp->special == No_Special)
-		{
-		    int that_precolor = (j == 0) ? 0 : 
-			PRECOLOR_AT(pp,rot,i,j-1);
+    for (i=0; i<n; i++)
+	if (key[i] && (i < SDLK_NUMLOCK || i > SDLK_COMPOSE))
+	    return 1;
+    return 0;
+}
 
-		    /* light up */
-		    if (that_precolor == 0 ||
-			    pp->colormap[that_precolor] != this_color) {
-			dstrect.x = x + i * w;
-			dstrect.y = y + j * h;
-			dstrect.h = edge[HORIZ_LIGHT]->h;
-			dstrect.w = edge[HORIZ_LIGHT]->w;
-			SDL_BlitSafe(edge[HORIZ_LIGHT],NULL,
-				    screen,&dstrect) ;
-		    }
+/***************************************************************************
+ *      idle_wait()
+ * Sleeps for up to ms milliseconds, or until there is input, something
+ * to read on sock (if it is not 0) or an idle_wake(). Leaves the input
+ * where it was. Returns 1 if woken early, as far as it knows.
+ *********************************************************************PROTO*/
+int
+idle_wait(int ms, int sock)
+{
+    SDL_Event event;
+    int got;
 
-		    /* light left */
-		    that_precolor = (i == 0) ? 0 :
-			PRECOLOR_AT(pp,rot,i-1,j);
-		    if (that_precolor == 0 ||
-			    pp->colormap[that_precolor] != this_color) {
-			dstrect.x = x + i * w;
-			dstrect.y = y + j * h;
-			dstrect.h = edge[VERT_LIGHT]->h;
-			dstrect.w = edge[VERT_LIGHT]->w;
-			SDL_BlitSafe(edge[VERT_LIGHT],NULL,
-				    screen,&dstrect) ;
-		    }
-		    
-		    /* shadow down */
-		    that_precolor = (j == pp->base->dim-1) ? 0 :
-			PRECOLOR_AT(pp,rot,i,j+1);
-		    if (that_precolor == 0 ||
-			    pp->colormap[that_precolor] != this_color) {
-			dstrect.x = x + i * w;
-			dstrect.y = (y + (j+1) * h) - edge[HORIZ_DARK]->h;
-			dstrect.h = edge[HORIZ_DARK]->h;
-			dstrect.w = edge[HORIZ_DARK]->w;
-			SDL_BlitSafe(edge[HORIZ_DARK],NULL,
-				    screen,&dstrect);
-		    }
+    if (ms <= 0)
+	return 1;
+    render_lock();
+    SDL_PumpEvents();		/* SDL takes whatever has come */
+    got = SDL_PeepEvents(&event, 1, SDL_PEEKEVENT, SDL_ALLEVENTS) > 0;
+    if (!got && idle_key_held())
+	ms = min(ms, IDLE_POLL);
+    render_unlock();
+    if (got)
+	return 1;
 
-		    /* shadow right */
-		    that_precolor = (i == pp->base->dim-1) ? 0 :
-			PRECOLOR_AT(pp,rot,i+1,j);
-		    if (that_precolor == 0 ||
-			    pp->colormap[that_precolor] != this_color) {
-			dstrect.x = (x + (i+1) * w) - edge[VERT_DARK]->w;
-			dstrect.y = (y + (j) * h);
-			dstrect.h = edge[VERT_DARK]->h;
-			dstrect.w = edge[VERT_DARK]->w;
-			SDL_BlitSafe(edge[VERT_DARK],NULL, screen,&dstrect);
-		    }
-		}
-	    }
+#if IDLE_SELECT
+    if (idle_x11 >= 0) {
+	fd_set read_fds;
+	struct timeval timeout;
+	int top = max(idle_x11, idle_pipe[0]);
+	char buf[64];
+
+	FD_ZERO(&read_fds);
+	FD_SET(idle_x11, &read_fds);
+	FD_SET(idle_pipe[0], &read_fds);
+	if (sock > 0) {
+	    FD_SET(sock, &read_fds);
+	    top = max(top, sock);
 	}
-    /* now update the entire relevant area */
-    dstrect.x = min(o_x, x);
-    dstrect.x = max( dstrect.x, 0 );
-
-    dstrect.w = max(o_x + (o_pp->base->dim * cs->w), 
-	    x + (pp->base->dim * cs->w)) - dstrect.x;
-    dstrect.w = min( dstrect.w , screen->w - dstrect.x );
-
-    dstrect.y = min(o_y, y);
-    dstrect.y = max( dstrect.y, 0 );
-    dstrect.h = max(o_y + (o_pp->base->dim * cs->h),
-	    y + (pp->base->dim * cs->h)) - dstrect.y;
-    dstrect.h = min( dstrect.h , screen->h - dstrect.y );
-
-    SDL_UpdateSafe(screen,1,&dstrect);
-
-    return;
+	timeout.tv_sec = ms / 1000;
+	timeout.tv_usec = (ms % 1000) * 1000;
+	got = select(top + 1, &read_fds, NULL, NULL, &timeout);
+	if (got > 0 && FD_ISSET(idle_pipe[0], &read_fds))
+	    while (read(idle_pipe[0], buf, sizeof(buf)) > 0)
+		;
+	return got > 0;
+    }
+#endif
+    SDL_Delay(min(ms, IDLE_POLL));
+    return 0;
 }
 
 
-/*
- * $Log: piece.c,v $
- * Revision 1.29  2000/11/06 04:16:10  weimer
- * "power pieces" plus images
- *
- * Revision 1.28  2000/11/06 04:06:44  weimer
- * option menu
- *
- * Revision 1.27  2000/11/06 01:25:54  weimer
- * add in the other special piece
- *
- * Revision 1.26  2000/11/06 00:24:01  weimer
- * add WalkRadioGroup modifications (inactive field for Kiri) and some support
- * for special pieces
- *
- * Revision 1.25  2000/11/03 04:25:58  weimer
- * add some optimizations to run_gravity to make it just a bit faster (down
- * to 0.01 ms/call from 0.02), sleep a bit more in event-loop: generally
- * trying to make us more CPU friendly ...
- *
- * Revision 1.24  2000/11/03 03:41:35  weimer
- * made the light and dark "edges" of pieces global, rather than part of a
- * specific color style. also fixed a bug where we were updating too much
- * when drawing falling pieces (bad min() code on my part)
- *
- * Revision 1.23  2000/10/29 21:23:28  weimer
- * One last round of header-file changes to reflect my newest and greatest
- * knowledge of autoconf/automake. Now if you fail to have some bizarro
- * function, we try to go on anyway unless it is vastly needed.
- *
- * Revision 1.22  2000/10/29 17:23:13  weimer
- * incorporate "xflame" flaming background for added spiffiness ...
- *
- * Revision 1.21  2000/10/29 00:17:39  weimer
- * added support for a system independent random number generator
- *
- * Revision 1.20  2000/10/29 00:06:27  weimer
- * networking fixes, change "styles/" to "styles" so that it works on Windows
- *
- * Revision 1.19  2000/10/21 01:14:43  weimer
- * massic autoconf/automake restructure ...
- *
- * Revision 1.18  2000/10/19 22:06:51  weimer
- * minor changes ...
- *
- * Revision 1.17  2000/10/18 23:57:49  weimer
- * general fixup, color changes, display changes.
- * Notable: "Safe" Blits and Updates now perform "clipping". No more X errors,
- * we hope!
- *
- * Revision 1.16  2000/10/13 18:23:28  weimer
- * fixed a race condition in tetris_event()
- *
- * Revision 1.15  2000/10/13 17:55:36  weimer
- * Added another color "Style" ...
- *
- * Revision 1.14  2000/10/13 15:41:53  weimer
- * revamped AI support, now you can pick your AI and have AI duels (such fun!)
- * the mighty Aliz AI still crashes a bit, though ... :-)
- *
- * Revision 1.13  2000/10/12 19:17:08  weimer
- * Further support for AI players and multiple game types.
- *
- * Revision 1.12  2000/10/12 00:49:08  weimer
- * added "AI" support and walking radio menus for initial game configuration
- *
- * Revision 1.11  2000/09/09 17:05:35  wkiri
- * Hideous log changes (Wes: how dare you include a comment character!)
- *
- * Revision 1.10  2000/09/09 16:58:27  weimer
- * Sweeping Change of Ultimate Mastery. Main loop restructuring to clean up
- * main(), isolate the behavior of the three game types. Move graphic files
- * into graphics/-, style files into styles/-, remove some unused files,
- * add game flow support (breaks between games, remembering your level within
- * this game), multiplayer support for the event loop, some global variable
- * cleanup. All that and a bag of chips!
- *
- * Revision 1.9  2000/09/04 21:02:18  weimer
- * Added some addition piece layout code, garbage now falls unless the row
- * below it features some non-falling garbage
- *
- * Revision 1.8  2000/09/04 19:48:02  weimer
- * interim menu for choosing among game styles, button changes (two states)
- *
- * Revision 1.7  2000/09/04 14:08:30  weimer
- * Added another color scheme and color/piece scheme scanning code.
- *
- * Revision 1.6  2000/09/03 21:06:31  wkiri
- * Now handles three different game types (and does different things).
- * Major changes in display.c to handle this.
- *
- * Revision 1.5  2000/09/03 18:26:11  weimer
- * major header file and automatic prototype generation changes, restructuring
- *
- * Revision 1.4  2000/08/20 16:14:10  weimer
- * changed the piece generation so that pieces and colors cluster together
- *
- * Revision 1.3  2000/08/15 00:48:28  weimer
- * Massive sound rewrite, fixed a few memory problems. We now have
- * sound_styles that work like piece_styles and color_styles.
- *
- * Revision 1.2  2000/08/13 19:27:20  weimer
- * added file changelogs
- *
- */
-
 
 samples_to_be_played current;	/* what should we play now? */
+static int muted = 0;		/* see sound_mute() */
 
 char *sound_name[NUM_SOUND] = { /* english names */
     "thud", "clear1", "clear4", "levelup", "leveldown" , "garbage1", "clock"
@@ -7993,6 +14098,8 @@ play_sound_unless_already_playing(sound_style *ss, int which, int delay)
 {
     int i;
 
+    if (muted)
+	return;
     if (ss->WAV[which].audio_len == 0) {
 	if (strcmp(ss->name,"No Sound"))
 		Debug("No [%s] sound in Sound Style [%s]\n", 
@@ -8057,6 +14164,8 @@ play_sound(sound_style *ss, int which, int delay)
 {
     int i;
 
+    if (muted)
+	return;
     if (ss->WAV[which].audio_len == 0) {
 	if (strcmp(ss->name,"No Sound"))
 		Debug("No [%s] sound in Sound Style [%s]\n", 
@@ -8099,6 +14208,18 @@ stop_all_playing(void)
     return;
 }
 
+/***************************************************************************
+ *      sound_mute()
+ * While on, nothing new is played (turbo games would only make a din).
+ *********************************************************************PROTO*/
+void
+sound_mute(int on)
+{
+    muted = on;
+    if (on)
+	stop_all_playing();
+}
+
 /***************************************************************************
  *      play_all_sounds()
  * Schedule all of the sounds associated with a given style to be played.
@@ -8429,6 +14550,9 @@ nosound:
 #define DELT 0x08		/* Delta code is broken -- Rasterman? */
 #define BLOK 0x20
 #define LACE 0x40
+
+/* frames a second, at most: it used to be as many as the machine could */
+#define FLAME_RATE 30
 /*This structure contains all of the "Global" variables for my program so */
 /*that I just pass a pointer to my functions, not a million parameters */
 struct globaldata
@@ -8815,13 +14939,36 @@ XFDrawFlame(struct globaldata *g,int *f, int w, int ws, int h, int *ctab)
 static int *flame,flamesize,ws,flamewidth,flameheight,*flame2;
 static struct globaldata *g;
 static int w, h, f, *ctab;
+static Uint32 flame_next;	/* when the next frame is due */
+
+/***************************************************************************
+ *      atris_flame_wait()
+ * How many ms until atris_run_flame() has another frame to draw: how long
+ * whoever runs it can sleep.
+ *********************************************************************PROTO*/
+int
+atris_flame_wait(void)
+{
+    Sint32 wait = flame_next - SDL_GetTicks();
+
+    if (!Options.flame_wanted) return IDLE_FOREVER;
+    return wait > 0 ? wait : 0;
+}
 
 /***************************************************************************
+ *      atris_run_flame()
+ * Draws the next frame of the flame, if it is time for one.
  *********************************************************************PROTO*/
 void 
 atris_run_flame(void)
 {
+    Uint32 now = SDL_GetTicks();
+
     if (!Options.flame_wanted) return;
+    if ((Sint32) (now - flame_next) < 0) return;
+    flame_next += 1000 / FLAME_RATE;
+    if ((Sint32) (flame_next - now) <= 0)	/* behind: do not catch up */
+	flame_next = now + 1000 / FLAME_RATE;
 
     /* modify the bas of the flame */
     XFModifyFlameBase(flame,w>>1,ws,h>>1);
@@ -8934,7 +15081,7 @@ main(int argc, char *argv[])
     sound_styles ss;
     identity *id;
     AI_Players *ai;
-    Grid g[2];
+    Grid g[MAX_PLAYERS];
     int renderstyle = TTF_STYLE_NORMAL;
     int flags;
     Uint32 time_now;
@@ -8955,6 +15102,31 @@ main(int argc, char *argv[])
 #endif
     parse_options(argc, argv);
 
+    if (profile_file) {
+	AI_Weights w;
+	ai_get_profile(&w);
+	if (ai_load_weights(profile_file, &w))
+	    ai_set_profile(&w);
+    }
+    if (model_file) 
+	ai_set_model(ai_load_model(model_file));
+    if (book_file)
+	book_load(book_file);
+    tuner.out = cwd_path(tuner.out);
+    bench.out = cwd_path(bench.out);
+    selfplay.out = cwd_path(selfplay.out);
+    book.out = cwd_path(book.out);
+    if (tourney.games > 0)
+	return play_TOURNAMENT();
+    if (tuner.family != TUNE_NONE)
+	return play_TUNE();
+    if (bench.positions > 0)
+	return play_BENCH();
+    if (selfplay.games > 0)
+	return play_SELFPLAY();
+    if (book.positions > 0)
+	return play_BOOK();
+
     if (SDL_Init(SDL_INIT_VIDEO)) 
 	PANIC("SDL_Init failed!");
 
@@ -8978,6 +15150,7 @@ main(int argc, char *argv[])
 
     /* Set the window title */
     SDL_WM_SetCaption("Alizarin Tetris", (char*)NULL);
+    idle_setup();
 
     Network_Init();
 
@@ -8998,8 +15171,6 @@ main(int argc, char *argv[])
     if ( font == NULL ) PANIC("Couldn't open [graphics/DejaVuSans-BoldOblique.ttf].", ATRIS_LIBDIR); 
     TTF_SetFontStyle(font, renderstyle);
     TTF_SetFontStyle(sfont, renderstyle);
-    /* Initialize scores */
-    Score[0] = Score[1] = 0;
     /* enable unicode so we can easily see which key they pressed */
     SDL_EnableUNICODE(1);
 
@@ -9042,6 +15213,7 @@ main(int argc, char *argv[])
     clear_screen_to_flame();	/* lose the "welcome to" words */
 
     while (1) {
+	Session session;
 	int p1, p2;
 	int retval;
 
@@ -9052,7 +15224,7 @@ main(int argc, char *argv[])
 	else Options.named_game = (int)gametype;
 	/* play our game! */
 
-	Score[0] = Score[1] = 0;
+	session_init(&session, gametype);
 	SDL_EnableKeyRepeat(SDL_DEFAULT_REPEAT_DELAY*10,
 		SDL_DEFAULT_REPEAT_INTERVAL);
 
@@ -9062,19 +15234,19 @@ main(int argc, char *argv[])
 		p1 = who_are_you(screen, &id, -1, 1);
 		clear_screen_to_flame();
 		if (p1 < 0) break;
-		id->p[p1].level = play_SINGLE(cs,ps,ss,g,&id->p[p1]);
+		id->p[p1].level = play_SINGLE(&session, cs,ps,ss,g,&id->p[p1]);
 		clear_screen_to_flame();
 		break;
 	    case MARATHON:
 		p1 = who_are_you(screen, &id, -1, 1);
 		clear_screen_to_flame();
 		if (p1 < 0) break;
-		retval = play_MARATHON(cs,ps,ss,g,&id->p[p1]);
+		retval = play_MARATHON(&session, cs,ps,ss,g,&id->p[p1]);
 		clear_screen_to_flame();
 		/* it's high score time */
 		SDL_EnableKeyRepeat(SDL_DEFAULT_REPEAT_DELAY*10,
 			SDL_DEFAULT_REPEAT_INTERVAL);
-		high_score_check(retval, Score[0]);
+		high_score_check(retval, session.score[0]);
 		clear_screen_to_flame();
 		break;
 	    case SINGLE_VS_AI:
@@ -9085,8 +15257,19 @@ main(int argc, char *argv[])
 		if (p2 < 0) break;
 		ai->player[p2].delay_factor = pick_ai_factor(screen);
 		clear_screen_to_flame();
-		id->p[p1].level = play_SINGLE_VS_AI(cs,ps,ss,g,
-			&id->p[p1], &ai->player[p2]);
+		{
+		    /* the rest of the field: the AIs after Player 2's, at
+		     * the same speed */
+		    AI_Player *aip[MAX_PLAYERS];
+		    int i;
+
+		    for (i=1; i<Options.players; i++) {
+			aip[i] = &ai->player[(p2 + i - 1) % ai->n];
+			aip[i]->delay_factor = ai->player[p2].delay_factor;
+		    }
+		    id->p[p1].level = play_SINGLE_VS_AI(&session, cs,ps,ss,g,
+			    &id->p[p1], aip, Options.players);
+		}
 		clear_screen_to_flame();
 		break;
 	    case AI_VS_AI:
@@ -9096,8 +15279,15 @@ main(int argc, char *argv[])
 		p2 = pick_an_ai(screen, "As Player 2", ai);
 		clear_screen_to_flame();
 		if (p2 < 0) break;
-		play_AI_VS_AI(cs,ps,ss,g,
-			&ai->player[p1], &ai->player[p2]);
+		{
+		    /* the rest of the field: the AIs after Player 2's */
+		    AI_Player *aip[MAX_PLAYERS];
+		    int i;
+
+		    for (i=0; i<Options.players; i++)
+			aip[i] = &ai->player[(i ? p2 + i - 1 : p1) % ai->n];
+		    play_AI_VS_AI(&session, cs,ps,ss,g, aip, Options.players);
+		}
 		clear_screen_to_flame();
 		break;
 	    case TWO_PLAYERS:
@@ -9107,7 +15297,8 @@ main(int argc, char *argv[])
 		p2 = who_are_you(screen, &id, p1, 2);
 		clear_screen_to_flame();
 		if (p2 < 0) break;
-		play_TWO_PLAYERS(cs,ps,ss,g, &id->p[p1], &id->p[p2]);
+		play_TWO_PLAYERS(&session, cs,ps,ss,g,
+			&id->p[p1], &id->p[p2]);
 		clear_screen_to_flame();
 		break;
 	    case NETWORK: 
@@ -9116,13 +15307,16 @@ main(int argc, char *argv[])
 		if (p1 < 0) break;
 
 		id->p[p1].level = 
-		    play_NETWORK(cs,ps,ss,g,&id->p[p1],network_choice(screen));
+		    play_NETWORK(&session, cs,ps,ss,g,&id->p[p1],
+			    network_choice(screen));
 		clear_screen_to_flame();
 		break;
 	    default:
 		break;
 	}
 
+	session_free(&session);
+
 	/*
 	 * save those updates!
 	 */
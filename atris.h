@@ -69,6 +69,10 @@ typedef enum {
 } GT;
 GT gametype;
 
+/* everything that belongs to one match: see session.h */
+typedef struct session_struct Session;
+#define MAX_PLAYERS	8	/* boards in one match, at most */
+
 #ifndef min
 #define min(a,b)	((a)<(b)?(a):(b))
 #endif
@@ -95,6 +99,8 @@ void Panic(const char *func, const char *file, char *fmt, ...) __attribute__ ((n
 
 extern void SeedRandom(Uint32 Seed);
 extern Uint16 FastRandom(Uint16 range);
+extern Uint16 FastRandom_r(Uint32 *seed, Uint16 range);
+extern Uint32 GetRandSeed(void);
 
 
 /*
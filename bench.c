@@ -0,0 +1,295 @@
+/*
+ *                               Alizarin Tetris
+ * Timing the AI players on a fixed set of positions.
+ *
+ * Every AI is shown the same positions, made up from Bench.seed, and
+ * decides where the piece goes just as it would in a headless game. The
+ * results go to Bench.out in a form a script can compare between builds:
+ * the "placements" hash only changes if some AI changed its mind.
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+
+#include "config.h"
+
+#include "atris.h"
+#include "grid.h"
+#include "piece.h"
+#include "ai.h"
+#include "options.h"
+#include "sim.h"
+#include "bench.h"
+
+#include ".protos/ai.pro"
+
+/* one position: a board and the two pieces the AI gets to see */
+typedef struct bench_position_struct {
+    Grid g;
+    int level;
+    play_piece cp;
+    play_piece np;
+    int pieces;		/* dropped on g to fill it */
+} Bench_Position;
+
+/* everything the job needs to see */
+typedef struct bench_run_struct {
+    Bench *b;
+    AI_Player *ai;
+    piece_style *ps;
+    color_style *cs;
+    Bench_Position *pos;
+    Bench_Result *r;
+} Bench_Run;
+
+/***************************************************************************
+ *      bench_corpus()
+ * Makes up the positions: a board at levels 1 through 9 in turn with up
+ * to BENCH_MAX_FILL pieces dropped on it at random, stopping before the
+ * top rows fill up, and then two more pieces. Nothing here depends on the
+ * AIs, so the same seed gives the same positions in every build.
+ ***************************************************************************/
+static void
+bench_corpus(Bench *b, piece_style *ps, color_style *cs, Bench_Position *pos)
+{
+    Uint32 seed = b->seed;
+    int i, k, x, y;
+
+    for (i=0; i<b->positions; i++) {
+	Bench_Position *p = &pos[i];
+	int fill;
+
+	p->level = 1 + i % 9;
+	p->pieces = 0;
+	p->g = generate_board_r(10, 20, p->level, &seed);
+	fill = FastRandom_r(&seed, BENCH_MAX_FILL + 1);
+	for (k=0; k<fill; k++) {
+	    play_piece pp = generate_piece_r(ps, cs, &seed);
+	    int col = FastRandom_r(&seed, p->g.w + 4) - 4;
+	    int rot = FastRandom_r(&seed, 4);
+	    int high = 0;
+
+	    drop_piece_on_grid(&p->g, &pp, col, 0, rot);
+	    p->pieces++;
+	    for (y=0; y<6; y++)
+		for (x=0; x<p->g.w; x++)
+		    if (GRID_CONTENT(p->g,x,y))
+			high = 1;
+	    if (high)
+		break;
+	}
+	p->cp = generate_piece_r(ps, cs, &seed);
+	p->np = generate_piece_r(ps, cs, &seed);
+    }
+}
+
+/***************************************************************************
+ *      bench_compare()
+ * For sorting the latencies.
+ ***************************************************************************/
+static int
+bench_compare(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/***************************************************************************
+ *      bench_percentile()
+ * Milliseconds per decision at the given fraction of the way through the
+ * sorted latencies.
+ ***************************************************************************/
+static double
+bench_percentile(Bench_Result *r, double p)
+{
+    int i;
+
+    if (r->decisions == 0)
+	return 0.0;
+    i = (int) (p * (r->decisions - 1) + 0.5);
+    return 1000.0 * r->latency[i];
+}
+
+/***************************************************************************
+ *      bench_ai_job()
+ * Runs one AI over every position. The AI keeps its state from one
+ * position to the next, as it would from one piece to the next in a game,
+ * and the headless clock starts again at every position so that each
+ * decision is the same amount of work on every machine.
+ ***************************************************************************/
+static void
+bench_ai_job(void *arg, int unused)
+{
+    Bench_Run *br = (Bench_Run *) arg;
+    Bench_Result *r = br->r;
+    AI_Player *ai = br->ai;
+    void *state = NULL;
+    Grid g = generate_board(10, 20, 0);
+    int i;
+
+    sim_set_styles(br->ps, br->cs);
+    ai_take_counters(&r->c);
+    r->placements = 2166136261U;
+    for (i=0; i<br->b->positions; i++) {
+	Bench_Position *p = &br->pos[i];
+	play_piece cp = p->cp, np = p->np;
+	int col = 0, row = 0, rot = 0, ok;
+	double start;
+
+	sim_copy_grid(&g, &p->g);
+	sim_virtual_clock(1);
+	start = sim_now();
+	ok = sim_decide(ai, &state, &g, &cp, &np, NULL, p->pieces, br->cs->w,
+		sim_fall(p->level), &col, &row, &rot);
+	r->latency[r->decisions] = sim_now() - start;
+
+	if (ok < 0) {
+	    r->stuck++;
+	    col = row = rot = -1;
+	} else {
+	    r->seconds += r->latency[r->decisions++];
+	    if (ok == 0)
+		r->unreachable++;
+	}
+	r->placements = (r->placements ^ (Uint32) (col & 0xff)) * 16777619U;
+	r->placements = (r->placements ^ (Uint32) (row & 0xff)) * 16777619U;
+	r->placements = (r->placements ^ (Uint32) (rot & 0xff)) * 16777619U;
+    }
+    ai_take_counters(&r->c);
+    qsort(r->latency, r->decisions, sizeof(double), bench_compare);
+
+    if (ai->release && state)
+	ai->release(state);
+    free_board(&g);
+    sim_virtual_clock(0);
+}
+
+/***************************************************************************
+ *      bench_write()
+ * Writes the results out as JSON.
+ ***************************************************************************/
+static void
+bench_write(FILE *f, Bench *b, AI_Players *ai, piece_style *ps,
+	Bench_Result *res)
+{
+    int i, k;
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"version\": \"%s\",\n", VERSION);
+    fprintf(f, "  \"seed\": %u,\n", (unsigned) b->seed);
+    fprintf(f, "  \"positions\": %d,\n", b->positions);
+    fprintf(f, "  \"piece_style\": \"%s\",\n", ps->name);
+    fprintf(f, "  \"tick_reads\": %d,\n", SIM_TICK_READS);
+    fprintf(f, "  \"ai\": [\n");
+    for (i=0; i<ai->n; i++) {
+	Bench_Result *r = &res[i];
+	double mean = r->decisions ? r->seconds / r->decisions : 0.0;
+
+	fprintf(f, "    {\n");
+	fprintf(f, "      \"name\": \"%s\",\n", ai->player[i].name);
+	fprintf(f, "      \"decisions\": %d,\n", r->decisions);
+	fprintf(f, "      \"unreachable\": %d,\n", r->unreachable);
+	fprintf(f, "      \"stuck\": %d,\n", r->stuck);
+	fprintf(f, "      \"seconds\": %.6f,\n", r->seconds);
+	fprintf(f, "      \"decisions_per_sec\": %.3f,\n",
+		r->seconds > 0 ? r->decisions / r->seconds : 0.0);
+	fprintf(f, "      \"candidates\": %lu,\n", r->c.candidates);
+	fprintf(f, "      \"drops\": %lu,\n", r->c.drops);
+	fprintf(f, "      \"drops_per_sec\": %.1f,\n",
+		r->seconds > 0 ? r->c.drops / r->seconds : 0.0);
+	fprintf(f, "      \"drops_per_decision\": %.1f,\n",
+		r->decisions ? (double) r->c.drops / r->decisions : 0.0);
+	fprintf(f, "      \"latency_ms\": { \"mean\": %.4f, \"p50\": %.4f, "
+		"\"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f },\n",
+		1000.0 * mean, bench_percentile(r, 0.50),
+		bench_percentile(r, 0.90), bench_percentile(r, 0.99),
+		bench_percentile(r, 1.0));
+	fprintf(f, "      \"gravity\": %lu,\n", r->c.gravity);
+	fprintf(f, "      \"evals\": %lu,\n", r->c.evals);
+	fprintf(f, "      \"thinks\": %lu,\n", r->c.thinks);
+	fprintf(f, "      \"settled\": %lu,\n", r->c.settled);
+	fprintf(f, "      \"overruns\": %lu,\n", r->c.overruns);
+	fprintf(f, "      \"think_ticks\": %lu,\n", r->c.think_ticks);
+	fprintf(f, "      \"cascade\": [");
+	for (k=0; k<AI_CASCADE_MAX; k++)
+	    fprintf(f, "%s%lu", k ? ", " : "", r->c.cascade[k]);
+	fprintf(f, "],\n");
+	fprintf(f, "      \"placements\": \"%08x\"\n", (unsigned) r->placements);
+	fprintf(f, "    }%s\n", i < ai->n - 1 ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+}
+
+/***************************************************************************
+ *      bench_play()
+ * Runs every AI over b->positions positions, one AI at a time so that
+ * they do not get in each other's way, prints a summary and writes the
+ * details to b->out. Returns 0, or 1 if b->out cannot be written.
+ *********************************************************************PROTO*/
+int
+bench_play(Bench *b, AI_Players *ai, piece_style *ps, color_style *cs)
+{
+    Bench_Run br;
+    Bench_Result *res;
+    FILE *f;
+    int i, k;
+
+    if (b->positions < 1) b->positions = 1;
+    Calloc(br.pos, Bench_Position *, b->positions * sizeof(Bench_Position));
+    Calloc(res, Bench_Result *, ai->n * sizeof(Bench_Result));
+    bench_corpus(b, ps, cs, br.pos);
+    br.b = b;
+    br.ps = ps;
+    br.cs = cs;
+
+    sim_start();
+    printf("Benchmark: %d AIs, %d positions, seed %u\n", ai->n,
+	    b->positions, (unsigned) b->seed);
+    fflush(stdout);
+
+    for (i=0; i<ai->n; i++) {
+	Calloc(res[i].latency, double *, b->positions * sizeof(double));
+	br.ai = &ai->player[i];
+	br.r = &res[i];
+	sim_run(bench_ai_job, &br, 1);
+    }
+
+    printf("\n%-16s %9s %10s %11s %9s %9s %9s %9s  %s\n",
+	    "AI", "Decisions", "Dec/sec", "Drops/sec", "Drops/dec",
+	    "p50 ms", "p99 ms", "Max ms", "Cascades 0/1/2/3+");
+    for (i=0; i<ai->n; i++) {
+	Bench_Result *r = &res[i];
+	unsigned long deep = 0;
+	for (k=3; k<AI_CASCADE_MAX; k++)
+	    deep += r->c.cascade[k];
+	printf("%-16.16s %9d %10.1f %11.0f %9.1f %9.3f %9.3f %9.3f  "
+		"%lu/%lu/%lu/%lu\n", ai->player[i].name, r->decisions,
+		r->seconds > 0 ? r->decisions / r->seconds : 0.0,
+		r->seconds > 0 ? r->c.drops / r->seconds : 0.0,
+		r->decisions ? (double) r->c.drops / r->decisions : 0.0,
+		bench_percentile(r, 0.50), bench_percentile(r, 0.99),
+		bench_percentile(r, 1.0), r->c.cascade[0], r->c.cascade[1],
+		r->c.cascade[2], deep);
+    }
+
+    printf("\n");
+    ai_counters_print(stdout, NULL, NULL);
+    for (i=0; i<ai->n; i++)
+	ai_counters_print(stdout, ai->player[i].name, &res[i].c);
+    fflush(stdout);
+
+    f = fopen(b->out, "w");
+    if (f) {
+	bench_write(f, b, ai, ps, res);
+	fclose(f);
+	printf("\nResults are in [%s].\n", b->out);
+    } else
+	Debug("Cannot write benchmark results to [%s].\n", b->out);
+
+    for (i=0; i<b->positions; i++)
+	free_board(&br.pos[i].g);
+    for (i=0; i<ai->n; i++)
+	free(res[i].latency);
+    free(br.pos);
+    free(res);
+    return f == NULL;
+}
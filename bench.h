@@ -0,0 +1,36 @@
+/*
+ *                               Alizarin Tetris
+ * Timing the AI players on a fixed set of positions.
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+#pragma once
+#ifndef __BENCH_H
+#define __BENCH_H
+#include "ai.h"
+#include "sim.h"
+
+/* what the command line asked for */
+typedef struct bench_struct {
+    int positions;	/* 0 = no benchmark */
+    Uint32 seed;	/* the positions all come from this */
+    char *out;		/* where the results go */
+} Bench;
+
+/* the most pieces dropped at random to make up a position */
+#define BENCH_MAX_FILL	24
+
+/* how one AI did on every position */
+typedef struct bench_result_struct {
+    int decisions;
+    int unreachable;	/* goals the piece could not be steered to */
+    int stuck;		/* positions where the piece did not fit */
+    double seconds;	/* spent deciding, all told */
+    double *latency;	/* seconds per decision, sorted */
+    Uint32 placements;	/* a hash of every col, row and rot chosen */
+    AI_Counters c;
+} Bench_Result;
+
+#include ".protos/bench.pro"
+
+#endif
@@ -0,0 +1,327 @@
+/*
+ *                               Alizarin Tetris
+ * An opening book: placements worked out ahead of time for the boards
+ * games start on.
+ *
+ * book_make() has one AI play the first few pieces on a great many
+ * boards made up the way the game makes them, off-screen and on the
+ * worker pool, and keeps where it put each one. book_load() maps the
+ * result, and from then on sim_decide() and the event loop ask
+ * book_lookup() before they let an AI think about a piece.
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+
+#include "config.h"
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "atris.h"
+#include "grid.h"
+#include "piece.h"
+#include "ai.h"
+#include "options.h"
+#include "sim.h"
+#include "book.h"
+
+#include ".protos/ai.pro"
+
+/* the book in use, if any */
+static Book_Header *book_map = NULL;
+static size_t book_map_size = 0;
+static Book_Entry *book_table = NULL;
+
+/* everything the jobs need to see */
+typedef struct book_run_struct {
+    Book *b;
+    AI_Player *ai;
+    piece_style *ps;
+    color_style *cs;
+    int njob;
+    Book_Entry *found;	/* [positions * plies], key 0 where none */
+} Book_Run;
+
+/***************************************************************************
+ *      book_key()
+ * Where a position goes in the book; see book.h. Never 0.
+ ***************************************************************************/
+static Uint64
+book_key(Grid *g, play_piece *cp, play_piece *np, piece_style *ps)
+{
+    Uint64 key = 14695981039346656037ULL;
+    int x, y, top, depth;
+
+#define BOOK_HASH(v)	(key = (key ^ (Uint8) (v)) * 1099511628211ULL)
+    for (top=0; top<g->h; top++) {
+	for (x=0; x<g->w; x++)
+	    if (GRID_CONTENT(*g,x,top))
+		break;
+	if (x < g->w)
+	    break;
+    }
+    BOOK_HASH(g->w);
+    BOOK_HASH(g->h);
+    BOOK_HASH(top);
+    for (x=0; x<g->w; x++) {
+	for (depth=0, y=top; y<g->h && depth<BOOK_DEPTH; y++, depth++)
+	    if (GRID_CONTENT(*g,x,y))
+		break;
+	BOOK_HASH(depth);
+    }
+    BOOK_HASH(cp->base - ps->shape);
+    BOOK_HASH(np->base - ps->shape);
+#undef BOOK_HASH
+    return key ? key : 1;
+}
+
+/***************************************************************************
+ *      book_close()
+ * Stops using the book, if there is one.
+ ***************************************************************************/
+static void
+book_close(void)
+{
+    if (book_map)
+	munmap(book_map, book_map_size);
+    book_map = NULL;
+    book_table = NULL;
+    book_map_size = 0;
+}
+
+/***************************************************************************
+ *      book_load()
+ * Maps the book in filespec and starts using it. Returns 0 (and goes on
+ * without a book) if it cannot be read or is not one of ours.
+ *********************************************************************PROTO*/
+int
+book_load(const char *filespec)
+{
+    int fd = open(filespec, O_RDONLY);
+    struct stat st;
+    Book_Header *h;
+
+    book_close();
+    if (fd < 0) {
+	Debug("Cannot read opening book [%s]\n", filespec);
+	return 0;
+    }
+    if (fstat(fd, &st) || st.st_size < (off_t) sizeof(Book_Header)) {
+	Debug("[%s] is too short to be an opening book.\n", filespec);
+	close(fd);
+	return 0;
+    }
+    h = (Book_Header *) mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (h == MAP_FAILED) {
+	Debug("Cannot map opening book [%s]\n", filespec);
+	return 0;
+    }
+    if (memcmp(h->magic, BOOK_MAGIC, 8) ||
+	    h->entry_size != sizeof(Book_Entry) || h->depth != BOOK_DEPTH ||
+	    h->slots == 0 || (h->slots & (h->slots - 1)) ||
+	    st.st_size != (off_t) (sizeof(Book_Header) +
+		(size_t) h->slots * sizeof(Book_Entry))) {
+	Debug("[%s] is not an opening book this version can use.\n",
+		filespec);
+	munmap(h, st.st_size);
+	return 0;
+    }
+    book_map = h;
+    book_map_size = st.st_size;
+    book_table = (Book_Entry *) (h + 1);
+    Debug("Opening book [%s] loaded: %u positions from %.24s.\n", filespec,
+	    (unsigned) h->entries, h->ai);
+    return 1;
+}
+
+/***************************************************************************
+ *      book_lookup()
+ * If the book knows where cp goes on g (with np coming next), puts it in
+ * *goal and returns 1. The placement was right for a board with the same
+ * surface, which may not be this one all the way down, so the caller
+ * should make sure the piece can still be steered there. "pieces" is how
+ * many have been placed on g since it was made: the book only covers the
+ * first Book_Header.plies of those, and later boards only look like the
+ * ones in it near the top. Uses the piece style from sim_set_styles().
+ *********************************************************************PROTO*/
+int
+book_lookup(Grid *g, int pieces, play_piece *cp, play_piece *np,
+	AI_Placement *goal)
+{
+    piece_style *ps;
+    color_style *cs;
+    Uint64 key;
+    Uint32 i, mask;
+
+    if (book_map == NULL || pieces >= book_map->plies ||
+	    !sim_get_styles(&ps, &cs) || g->w != book_map->w || g->h != book_map->h ||
+	    strncmp(ps->name, book_map->piece_style,
+		sizeof(book_map->piece_style)))
+	return 0;
+    key = book_key(g, cp, np, ps);
+    mask = book_map->slots - 1;
+    for (i = (Uint32) key & mask; book_table[i].key; i = (i + 1) & mask)
+	if (book_table[i].key == key) {
+	    goal->col = book_table[i].col;
+	    goal->row = book_table[i].row;
+	    goal->rot = book_table[i].rot;
+	    return 1;
+	}
+    return 0;
+}
+
+/***************************************************************************
+ *      book_job()
+ * Plays out boards i, i + njob, i + 2*njob ... and notes down every
+ * placement the AI could steer its piece to.
+ ***************************************************************************/
+static void
+book_job(void *arg, int i)
+{
+    Book_Run *br = (Book_Run *) arg;
+    Book *b = br->b;
+    void *state = NULL;
+    int k, ply, x;
+
+    sim_set_styles(br->ps, br->cs);
+    for (k=i; k<b->positions; k+=br->njob) {
+	Uint32 seed = b->seed + k;
+	int level = b->level ? b->level : 1 + k % BOOK_LEVELS;
+	Grid g = generate_board_r(10, 20, level, &seed);
+	play_piece cp = generate_piece_r(br->ps, br->cs, &seed);
+	AI_Placement last;
+
+	for (ply=0; ply<b->plies; ply++) {
+	    play_piece np = generate_piece_r(br->ps, br->cs, &seed);
+	    Book_Entry *e = &br->found[k * b->plies + ply];
+	    Uint64 key = book_key(&g, &cp, &np, br->ps);
+	    int col, row, rot, r;
+
+	    sim_virtual_clock(1);
+	    r = sim_decide(br->ai, &state, &g, &cp, &np, ply ? &last : NULL,
+		    ply, br->cs->w, sim_fall(level), &col, &row, &rot);
+	    if (r < 0)
+		break;
+	    if (r > 0) {
+		e->key = key;
+		e->col = col;
+		e->row = row;
+		e->rot = rot;
+	    }
+	    if (drop_piece_on_grid(&g, &cp, col, row, rot) < 0)
+		break;
+	    for (x=0; x<g.w * g.h; x++)
+		if (g.contents[x] == 1)
+		    break;
+	    if (x == g.w * g.h)
+		break;	/* that was the last of the garbage */
+	    last.col = col;
+	    last.row = row;
+	    last.rot = rot;
+	    cp = np;
+	}
+	free_board(&g);
+    }
+    if (br->ai->release && state)
+	br->ai->release(state);
+    sim_virtual_clock(0);
+}
+
+/***************************************************************************
+ *      book_make()
+ * Has b->ai play b->plies pieces on each of b->positions boards and
+ * writes every placement it chose to the book in b->out, the first one
+ * made wherever two boards had the same key. Returns 0, or 1 if there is
+ * no such AI or the book cannot be written.
+ *********************************************************************PROTO*/
+int
+book_make(Book *b, AI_Players *ai, piece_style *ps, color_style *cs)
+{
+    Book_Run br;
+    Book_Header h;
+    Book_Entry *table;
+    Uint32 slots, entries = 0, placed = 0, mask;
+    double start, elapsed;
+    FILE *f;
+    int i, n;
+
+    book_close();	/* the AI works everything out for itself */
+    if (b->plies < 1) b->plies = 1;
+    br.ai = NULL;
+    for (i=0; i<ai->n; i++)
+	if (!strcasecmp(b->ai, ai->player[i].name))
+	    br.ai = &ai->player[i];
+    if (br.ai == NULL) {
+	Debug("There is no AI called [%s].\n", b->ai);
+	return 1;
+    }
+    br.b = b;
+    br.ps = ps;
+    br.cs = cs;
+    n = b->positions * b->plies;
+    Calloc(br.found, Book_Entry *, n * sizeof(Book_Entry));
+
+    sim_start();
+    br.njob = 4 * sim_num_cpus();
+    if (br.njob > b->positions) br.njob = b->positions;
+    printf("Opening book: %s, %d boards, %d pieces each, seed %u\n",
+	    br.ai->name, b->positions, b->plies, (unsigned) b->seed);
+    fflush(stdout);
+    start = sim_now();
+    sim_run(book_job, &br, br.njob);
+    elapsed = sim_now() - start;
+
+    /* at most half full, so that a miss does not have far to look */
+    for (slots = 16; slots < 2 * (Uint32) n; slots *= 2)
+	;
+    mask = slots - 1;
+    Calloc(table, Book_Entry *, slots * sizeof(Book_Entry));
+    for (i=0; i<n; i++) {
+	Uint32 j;
+	if (br.found[i].key == 0)
+	    continue;
+	placed++;
+	for (j = (Uint32) br.found[i].key & mask; table[j].key &&
+		table[j].key != br.found[i].key; j = (j + 1) & mask)
+	    ;
+	if (table[j].key == 0) {
+	    table[j] = br.found[i];
+	    entries++;
+	}
+    }
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, BOOK_MAGIC, 8);
+    h.entry_size = sizeof(Book_Entry);
+    h.slots = slots;
+    h.entries = entries;
+    h.seed = b->seed;
+    h.w = 10;
+    h.h = 20;
+    h.depth = BOOK_DEPTH;
+    h.plies = b->plies;
+    strncpy(h.piece_style, ps->name, sizeof(h.piece_style) - 1);
+    strncpy(h.ai, br.ai->name, sizeof(h.ai) - 1);
+
+    f = fopen(b->out, "wb");
+    if (f && (fwrite(&h, sizeof(h), 1, f) != 1 ||
+		fwrite(table, sizeof(Book_Entry), slots, f) != slots)) {
+	fclose(f);
+	f = NULL;
+    }
+    if (f) {
+	fclose(f);
+	printf("%u positions from %u placements in %.1f seconds, "
+		"written to [%s]\n", (unsigned) entries, (unsigned) placed,
+		elapsed, b->out);
+    } else
+	Debug("Cannot write the opening book to [%s].\n", b->out);
+
+    free(table);
+    free(br.found);
+    return f == NULL;
+}
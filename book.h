@@ -0,0 +1,69 @@
+/*
+ *                               Alizarin Tetris
+ * An opening book: placements worked out ahead of time for the boards
+ * games start on.
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+#pragma once
+#ifndef __BOOK_H
+#define __BOOK_H
+#include "ai.h"
+#include "sim.h"
+
+/* what the command line asked for */
+typedef struct book_struct {
+    int positions;	/* boards to make up; 0 = no book to make */
+    int level;		/* 0 = levels 1 through BOOK_LEVELS in turn */
+    Uint32 seed;	/* board k comes from seed + k */
+    int plies;		/* pieces played out on each board */
+    char *ai;		/* whose placements go in the book */
+    char *out;		/* where it goes */
+} Book;
+
+/*
+ * Positions are looked up by the shape of the board's surface rather than
+ * by every cell in it: the row the highest block is on and, for every
+ * column, how far below that row its first block is, counting no further
+ * than BOOK_DEPTH. Garbage further down changes little about where the
+ * first few pieces should go, and boards made with different random
+ * seeds turn out to have the same surface often enough to be worth
+ * keeping. The falling piece and the next one are part of the key (their
+ * shapes, not their colors).
+ *
+ * A book file is, in the machine's own byte order, a Book_Header and then
+ * "slots" Book_Entry, an open-addressed hash table: entry key & (slots -
+ * 1) is where a key goes, or the first free one after it; key 0 is a free
+ * slot. The whole file is mapped and used in place.
+ */
+#define BOOK_MAGIC	"ATRISBK1"
+#define BOOK_DEPTH	2
+#define BOOK_LEVELS	17	/* AI_VS_AI plays levels 2 to 17 */
+#define BOOK_NAME	24
+
+typedef struct book_header_struct {
+    char magic[8];
+    Uint32 entry_size;
+    Uint32 slots;	/* a power of two */
+    Uint32 entries;	/* slots in use */
+    Uint32 seed;
+    Uint16 w;
+    Uint16 h;
+    Uint16 depth;	/* BOOK_DEPTH when it was made */
+    Uint16 plies;
+    char piece_style[48];
+    char ai[BOOK_NAME];	/* who worked the placements out */
+    char reserved[24];
+} Book_Header;
+
+typedef struct book_entry_struct {
+    Uint64 key;
+    Sint8 col;		/* as in AI_Placement */
+    Sint8 row;
+    Uint8 rot;
+    Uint8 reserved[5];
+} Book_Entry;
+
+#include ".protos/book.pro"
+
+#endif
@@ -11,46 +11,28 @@
 #include "display.h"
 #include "grid.h"
 #include "piece.h"
+#include "ai.h"
+#include "timer.h"
+#include "session.h"
+#include "idle.h"
 
 #include ".protos/xflame.pro"
 
-struct layout_struct {
-    /* the whole board layout */
-    SDL_Rect grid_border[2];
-    SDL_Rect grid[2];
-
-    SDL_Rect score[2];
-
-    SDL_Rect name[2];
-
-    struct adjust_struct {
-	SDL_Rect symbol[3];
-    } adjust[2];
-
-    SDL_Rect time;
-    SDL_Rect time_border;
-
-    SDL_Rect next_piece_border[2];
-    SDL_Rect next_piece[2];
-
-    SDL_Rect 	  pause;
-} layout;
-
 /* The background image, global so we can do updates */
 SDL_Surface *adjust_symbol[3] = { NULL, NULL, NULL };
 /* Rectangles that specify where my/their pieces can legally be */
 
-int Score[2];
-
 /***************************************************************************
  *      poll_and_flame()
- * Poll for events and run the flaming background.
+ * Waits for an event and runs the flaming background meanwhile, sleeping
+ * between its frames.
  *********************************************************************PROTO*/
 void
 poll_and_flame(SDL_Event *ev)
 {
     while (!(SDL_PollEvent(ev))) {
 	atris_run_flame();
+	idle_wait(atris_flame_wait(), 0);
     }
     return;
 }
@@ -129,25 +111,22 @@ setup_colors(SDL_Surface *screen)
 #define DRAW_CLEAR	(1<<4)
 #define DRAW_HUGE	(1<<5)
 #define DRAW_LARGE	(1<<6)
-#define DRAW_GRID_0	(1<<7)
+#define DRAW_SMALL	(1<<8)
 int
 draw_string(char *text, SDL_Color sc, int x, int y, int flags)
 {
     SDL_Surface * text_surface;
     SDL_Rect r;
 
-    if (flags & DRAW_GRID_0) {
-	r.x = layout.grid[0].x + layout.grid[0].w / 2;
-	r.y = layout.grid[0].y + layout.grid[0].h / 2;
-    } else {
-	r.x = x;
-	r.y = y;
-    }
+    r.x = x;
+    r.y = y;
 
     if (flags & DRAW_HUGE) {
 	text_surface = TTF_RenderText_Blended(hfont, text, sc); Assert(text_surface);
     } else if (flags & DRAW_LARGE) {
 	text_surface = TTF_RenderText_Blended(lfont, text, sc); Assert(text_surface);
+    } else if (flags & DRAW_SMALL) {
+	text_surface = TTF_RenderText_Blended(sfont, text, sc); Assert(text_surface);
     } else {
 	text_surface = TTF_RenderText_Blended(font, text, sc); Assert(text_surface);
     }
@@ -179,11 +158,11 @@ draw_string(char *text, SDL_Color sc, int x, int y, int flags)
 /***************************************************************************
  *      give_notice()
  * Draws a little "press any key to continue"-type notice between levels.
- * "s" is any message you would like to display.
+ * "msg" is any message you would like to display.
  * Returns 1 if the user presses 'q', 0 if the users presses 'c'.
  *********************************************************************PROTO*/
 int
-give_notice(char *s, int quit_possible)
+give_notice(Session *s, char *msg, int quit_possible)
 {
     SDL_Event event;
 
@@ -191,18 +170,18 @@ give_notice(char *s, int quit_possible)
 	/* pull out all leading 'Q's */
     }
 
-    if (s && s[0]) 	/* throw that 'ol user text up there */
-	draw_string(s, color_blue, 
-		layout.grid[0].x + (layout.grid[0].w / 2), layout.grid[0].y
+    if (msg && msg[0]) 	/* throw that 'ol user text up there */
+	draw_string(msg, color_blue, 
+		s->layout.grid[0].x + (s->layout.grid[0].w / 2), s->layout.grid[0].y
 		+ 64, DRAW_CENTER | DRAW_UPDATE);
 
     if (quit_possible) 
 	draw_string("Press 'Q' to Quit", color_red,
-		layout.grid[0].x + (layout.grid[0].w / 2), layout.grid[0].y + 128, 
+		s->layout.grid[0].x + (s->layout.grid[0].w / 2), s->layout.grid[0].y + 128, 
 		DRAW_CENTER | DRAW_UPDATE);
 
     draw_string("Press 'G' to Go On", color_red,
-	    layout.grid[0].x + (layout.grid[0].w / 2), layout.grid[0].y +
+	    s->layout.grid[0].x + (s->layout.grid[0].w / 2), s->layout.grid[0].y +
 	    128 + 30, DRAW_CENTER | DRAW_UPDATE);
     while (1) {
 	poll_and_flame(&event);
@@ -348,20 +327,89 @@ setup_layers(SDL_Surface * screen)
     SDL_FillRect(flame_layer, &all, int_solid_black);
 }
 
+/***************************************************************************
+ *      free_for_all_room()
+ * How many boards of w by h blocks draw_free_for_all() can lay out on the
+ * screen. Anything that starts a free-for-all asks this first: a board
+ * that does not fit could not be shown.
+ *********************************************************************PROTO*/
+int
+free_for_all_room(SDL_Surface *screen, int blockWidth, int w, int h)
+{
+    int text_h = TTF_FontLineSkip(font);
+    int cols = max(1, screen->w / (w * blockWidth + 8));
+    int rows = max(1, screen->h / (h * blockWidth + 2 * text_h + 8));
+
+    return rows * cols;
+}
+
+/***************************************************************************
+ *      draw_free_for_all()
+ * The board layout for a match between more than two (AI_VS_AI, or you
+ * against several AIs in SINGLE_VS_AI): the boards side by side, each with
+ * its level and score above it and its name below, in as many rows as the
+ * screen has room for. The caller has made sure there is room for all of
+ * them. There is no clock and no next piece.
+ ***************************************************************************/
+static void
+draw_free_for_all(Session *s, SDL_Surface *screen, int blockWidth, Grid g[],
+	int level[], char *name[])
+{
+    char buf[1024];
+    int i, w = g[0].w * blockWidth, h = g[0].h * blockWidth;
+    int text_h = TTF_FontLineSkip(font);
+    int cols = max(1, screen->w / (w + 8));
+    int rows = max(1, screen->h / (h + 2 * text_h + 8));
+    int across, left, top;
+
+    Assert(s->boards <= free_for_all_room(screen, blockWidth, g[0].w, g[0].h));
+    s->layout.boards = s->boards;
+    across = min(s->boards, cols);
+    rows = (s->boards + cols - 1) / cols;
+    left = (screen->w - across * (w + 8)) / 2 + 4;
+    top = (screen->h - rows * (h + 2 * text_h + 8)) / 2 + text_h + 4;
+
+    for (i=0; i<s->boards; i++) {
+	Assert(g[i].w == g[0].w && g[i].h == g[0].h);
+	s->layout.grid[i].x = left + (i % cols) * (w + 8);
+	s->layout.grid[i].y = top + (i / cols) * (h + 2 * text_h + 8);
+	s->layout.grid[i].w = w;
+	s->layout.grid[i].h = h;
+	draw_bordered_rect(&s->layout.grid[i], &s->layout.grid_border[i], 2);
+	g[i].board = s->layout.grid[i];
+
+	draw_string(name[i], color_blue,
+		s->layout.grid_border[i].x + s->layout.grid_border[i].w/2,
+		s->layout.grid_border[i].y + s->layout.grid_border[i].h,
+		DRAW_CENTER);
+
+	sprintf(buf,"Level %d:",level[i]);
+	draw_string(buf, color_blue, s->layout.grid_border[i].x,
+		s->layout.grid_border[i].y, DRAW_ABOVE | DRAW_CLEAR);
+	s->layout.score[i].x = s->layout.grid_border[i].x + s->layout.grid_border[i].w;
+	s->layout.score[i].y = s->layout.grid_border[i].y;
+    }
+
+    s->layout.pause.w = 10 * blockWidth;
+    s->layout.pause.h = 2 * text_h;
+    s->layout.pause.x = (screen->w - s->layout.pause.w) / 2;
+    s->layout.pause.y = (screen->h - s->layout.pause.h) / 2;
+}
+
 /***************************************************************************
  *      draw_background()
  * Draws the Alizarin Tetris background. Not yet complete, but it's getting
  * better. :-)
  *********************************************************************PROTO*/
 void
-draw_background(SDL_Surface *screen, int blockWidth, Grid g[],
+draw_background(Session *s, SDL_Surface *screen, int blockWidth, Grid g[],
 	int level[], int my_adj[], int their_adj[], char *name[])
 {
     char buf[1024];
     int i;
 #define IS_DOUBLE(x) ((x==NETWORK)||(x==SINGLE_VS_AI)||(x==TWO_PLAYERS)||(x==AI_VS_AI))
 
-    if (IS_DOUBLE(gametype)) {
+    if (IS_DOUBLE(s->gametype)) {
 	Assert(g[0].w == g[1].w);
 	Assert(g[0].h == g[1].h);
     }
@@ -369,76 +417,82 @@ draw_background(SDL_Surface *screen, int blockWidth, Grid g[],
     /*
      * clear away the old stuff
      */
-    memset(&layout, 0, sizeof(layout));
+    memset(&s->layout, 0, sizeof(s->layout));
+    s->layout.clock_seconds = -111;	/* nothing drawn on this one yet */
     
     if (!adjust_symbol[0]) { /* only load these guys the first time */
 	load_adjust_symbols();
     }
+    if (s->boards > 2) {
+	draw_free_for_all(s, screen, blockWidth, g, level, name);
+	goto blit;
+    }
+    s->layout.boards = 1 + IS_DOUBLE(s->gametype);
     /*
      * 	THE BOARD
      */
-    if (IS_DOUBLE(gametype)) {
-	layout.grid[0].x = ((screen->w / 2) - ((g[0].w*blockWidth))) - 5 * blockWidth - 2;
-	layout.grid[0].y = ((screen->h - (g[0].h*blockWidth)) / 2);
-	layout.grid[0].w = (g[0].w*blockWidth);
-	layout.grid[0].h = (g[0].h*blockWidth);
+    if (IS_DOUBLE(s->gametype)) {
+	s->layout.grid[0].x = ((screen->w / 2) - ((g[0].w*blockWidth))) - 5 * blockWidth - 2;
+	s->layout.grid[0].y = ((screen->h - (g[0].h*blockWidth)) / 2);
+	s->layout.grid[0].w = (g[0].w*blockWidth);
+	s->layout.grid[0].h = (g[0].h*blockWidth);
 
-	layout.grid[1].y = ((screen->h - (g[0].h*blockWidth)) / 2);
-	layout.grid[1].w = (g[0].w*blockWidth);
-	layout.grid[1].h = (g[0].h*blockWidth);
-	layout.grid[1].x = ((screen->w / 2) - 4) + 5 * blockWidth + 6;
+	s->layout.grid[1].y = ((screen->h - (g[0].h*blockWidth)) / 2);
+	s->layout.grid[1].w = (g[0].w*blockWidth);
+	s->layout.grid[1].h = (g[0].h*blockWidth);
+	s->layout.grid[1].x = ((screen->w / 2) - 4) + 5 * blockWidth + 6;
 
 	/* Draw the opponent's board */
-	draw_bordered_rect(&layout.grid[1], &layout.grid_border[1], 2);
-	g[1].board = layout.grid[1];
+	draw_bordered_rect(&s->layout.grid[1], &s->layout.grid_border[1], 2);
+	g[1].board = s->layout.grid[1];
     }  else {
-	layout.grid[0].x = (screen->w - (g[0].w*blockWidth))/2 ;
-	layout.grid[0].y = (screen->h - (g[0].h*blockWidth))/2 ;
-	layout.grid[0].w = (g[0].w*blockWidth) ;
-	layout.grid[0].h = (g[0].h*blockWidth) ;
+	s->layout.grid[0].x = (screen->w - (g[0].w*blockWidth))/2 ;
+	s->layout.grid[0].y = (screen->h - (g[0].h*blockWidth))/2 ;
+	s->layout.grid[0].w = (g[0].w*blockWidth) ;
+	s->layout.grid[0].h = (g[0].h*blockWidth) ;
 	/* Don't need a Board[1] */
     }
     /* draw the leftmost board */
-    draw_bordered_rect(&layout.grid[0], &layout.grid_border[0], 2);
-    g[0].board = layout.grid[0];
+    draw_bordered_rect(&s->layout.grid[0], &s->layout.grid_border[0], 2);
+    g[0].board = s->layout.grid[0];
 
     /*
      * 	SCORING, Names
      */
-    for (i=0; i< 1+IS_DOUBLE(gametype); i++) {
-	layout.name[i].x = layout.grid[i].x;
-	layout.name[i].y = layout.grid[i].y + layout.grid[i].h + 2;
-	layout.name[i].w = layout.grid[i].w;
-	layout.name[i].h = screen->h - layout.name[i].y;
+    for (i=0; i< 1+IS_DOUBLE(s->gametype); i++) {
+	s->layout.name[i].x = s->layout.grid[i].x;
+	s->layout.name[i].y = s->layout.grid[i].y + s->layout.grid[i].h + 2;
+	s->layout.name[i].w = s->layout.grid[i].w;
+	s->layout.name[i].h = screen->h - s->layout.name[i].y;
 
-	if (gametype == DEMO) {
+	if (s->gametype == DEMO) {
 	    char buf[1024];
-	    SDL_FillRect(widget_layer, &layout.name[i], int_black);
-	    SDL_FillRect(screen, &layout.name[i], int_black);
+	    SDL_FillRect(widget_layer, &s->layout.name[i], int_black);
+	    SDL_FillRect(screen, &s->layout.name[i], int_black);
 	    sprintf(buf,"Demo (%s)",name[i]);
-	    draw_string(buf, color_blue, layout.grid_border[i].x +
-		    layout.grid_border[i].w/2, layout.grid_border[i].y +
-		    layout.grid_border[i].h, DRAW_CENTER | DRAW_CLEAR | DRAW_UPDATE);
+	    draw_string(buf, color_blue, s->layout.grid_border[i].x +
+		    s->layout.grid_border[i].w/2, s->layout.grid_border[i].y +
+		    s->layout.grid_border[i].h, DRAW_CENTER | DRAW_CLEAR | DRAW_UPDATE);
 	} else {
 	    draw_string(name[i], color_blue,
-		    layout.grid_border[i].x + layout.grid_border[i].w/2,
-		    layout.grid_border[i].y + layout.grid_border[i].h,
+		    s->layout.grid_border[i].x + s->layout.grid_border[i].w/2,
+		    s->layout.grid_border[i].y + s->layout.grid_border[i].h,
 		    DRAW_CENTER);
 	}
 	/* Set up the coordinates for future score writing */
-	layout.score[i].x = layout.grid_border[i].x;
-	layout.score[i].w = layout.grid_border[i].w;
-	layout.score[i].y = 0;
-	layout.score[i].h = layout.grid_border[i].y;
-	SDL_FillRect(widget_layer, &layout.score[i], int_black);
-	SDL_FillRect(screen, &layout.score[i], int_black);
+	s->layout.score[i].x = s->layout.grid_border[i].x;
+	s->layout.score[i].w = s->layout.grid_border[i].w;
+	s->layout.score[i].y = 0;
+	s->layout.score[i].h = s->layout.grid_border[i].y;
+	SDL_FillRect(widget_layer, &s->layout.score[i], int_black);
+	SDL_FillRect(screen, &s->layout.score[i], int_black);
 
 	sprintf(buf,"Level %d, Score:",level[i]);
-	draw_string(buf, color_blue, layout.grid_border[i].x,
-		layout.grid_border[i].y, DRAW_ABOVE | DRAW_CLEAR);
+	draw_string(buf, color_blue, s->layout.grid_border[i].x,
+		s->layout.grid_border[i].y, DRAW_ABOVE | DRAW_CLEAR);
 
-	layout.score[i].x = layout.grid_border[i].x + layout.grid_border[i].w;
-	layout.score[i].y = layout.grid_border[i].y;
+	s->layout.score[i].x = s->layout.grid_border[i].x + s->layout.grid_border[i].w;
+	s->layout.score[i].y = s->layout.grid_border[i].y;
     }
 
     /*
@@ -448,151 +502,152 @@ draw_background(SDL_Surface *screen, int blockWidth, Grid g[],
 #define TIME_WIDTH 	(16*5)
 #define TIME_HEIGHT 	28
 
-    if (gametype == DEMO) {
+    if (s->gametype == DEMO) {
 	/* do nothing */
-    } else if (IS_DOUBLE(gametype)) {
+    } else if (IS_DOUBLE(s->gametype)) {
 	draw_string("Time Left", color_blue, 
-		screen->w/2, layout.score[0].y, DRAW_CENTER | DRAW_ABOVE);
-	layout.time.x = (screen->w - TIME_WIDTH)/2;
-	layout.time.y = layout.score[0].y;
-	layout.time.w = TIME_WIDTH;
-	layout.time.h = TIME_HEIGHT;
-	draw_bordered_rect(&layout.time, &layout.time_border, 2);
+		screen->w/2, s->layout.score[0].y, DRAW_CENTER | DRAW_ABOVE);
+	s->layout.time.x = (screen->w - TIME_WIDTH)/2;
+	s->layout.time.y = s->layout.score[0].y;
+	s->layout.time.w = TIME_WIDTH;
+	s->layout.time.h = TIME_HEIGHT;
+	draw_bordered_rect(&s->layout.time, &s->layout.time_border, 2);
     } else { /* single */
 	int text_h = draw_string("Time Left", color_blue,
 		screen->w/10, screen->h/5, 0);
-	layout.time.x = screen->w / 10;
-	layout.time.y = screen->h / 5 + text_h;
-	layout.time.w = TIME_WIDTH;
-	layout.time.h = TIME_HEIGHT;
+	s->layout.time.x = screen->w / 10;
+	s->layout.time.y = screen->h / 5 + text_h;
+	s->layout.time.w = TIME_WIDTH;
+	s->layout.time.h = TIME_HEIGHT;
 
-	draw_bordered_rect(&layout.time, &layout.time_border, 2);
+	draw_bordered_rect(&s->layout.time, &s->layout.time_border, 2);
     }
 
     /*
      *	LEVEL ADJUSTMENT
      */
-    if (gametype == DEMO) {
+    if (s->gametype == DEMO) {
 
-    } else if (gametype == AI_VS_AI) {
+    } else if (s->gametype == AI_VS_AI) {
 	for (i=0;i<3;i++) {
 	    char buf[80];
 
-	    layout.adjust[0].symbol[i].x = (screen->w - adjust_symbol[i]->w)/2;
-	    layout.adjust[0].symbol[i].w = adjust_symbol[i]->w;
-	    layout.adjust[0].symbol[i].h = adjust_symbol[i]->h;
-	    layout.adjust[0].symbol[i].y = 
-		layout.time_border.y+layout.time_border.h + i * adjust_symbol[i]->h;
+	    s->layout.adjust[0].symbol[i].x = (screen->w - adjust_symbol[i]->w)/2;
+	    s->layout.adjust[0].symbol[i].w = adjust_symbol[i]->w;
+	    s->layout.adjust[0].symbol[i].h = adjust_symbol[i]->h;
+	    s->layout.adjust[0].symbol[i].y = 
+		s->layout.time_border.y+s->layout.time_border.h + i * adjust_symbol[i]->h;
 
 	    SDL_BlitSafe(adjust_symbol[i], NULL, widget_layer, 
-		    &layout.adjust[0].symbol[i]);
+		    &s->layout.adjust[0].symbol[i]);
 
 	    /* draw the textual tallies */
 	    sprintf(buf,"%d",my_adj[i]);
 	    draw_string(buf, color_red,
-		    layout.adjust[0].symbol[i].x - 10, 
-		    layout.adjust[0].symbol[i].y, DRAW_LEFT | DRAW_CLEAR);
+		    s->layout.adjust[0].symbol[i].x - 10, 
+		    s->layout.adjust[0].symbol[i].y, DRAW_LEFT | DRAW_CLEAR);
 	    sprintf(buf,"%d",their_adj[i]);
 	    draw_string(buf, color_red,
-		    layout.adjust[0].symbol[i].x + layout.adjust[0].symbol[i].w + 10, 
-		    layout.adjust[0].symbol[i].y, DRAW_CLEAR);
+		    s->layout.adjust[0].symbol[i].x + s->layout.adjust[0].symbol[i].w + 10, 
+		    s->layout.adjust[0].symbol[i].y, DRAW_CLEAR);
 	}
-    } else if (IS_DOUBLE(gametype)) {
+    } else if (IS_DOUBLE(s->gametype)) {
 	for (i=0;i<3;i++) {
-	    layout.adjust[0].symbol[i].w = adjust_symbol[i]->w;
-	    layout.adjust[0].symbol[i].h = adjust_symbol[i]->h;
-	    layout.adjust[0].symbol[i].x = (screen->w - 3*adjust_symbol[i]->w)/2;
-	    layout.adjust[0].symbol[i].y = 
-		layout.time_border.y+layout.time_border.h + i * adjust_symbol[i]->h;
-	    SDL_FillRect(widget_layer, &layout.adjust[0].symbol[i], int_black);
-	    SDL_FillRect(screen, &layout.adjust[0].symbol[i], int_black);
+	    s->layout.adjust[0].symbol[i].w = adjust_symbol[i]->w;
+	    s->layout.adjust[0].symbol[i].h = adjust_symbol[i]->h;
+	    s->layout.adjust[0].symbol[i].x = (screen->w - 3*adjust_symbol[i]->w)/2;
+	    s->layout.adjust[0].symbol[i].y = 
+		s->layout.time_border.y+s->layout.time_border.h + i * adjust_symbol[i]->h;
+	    SDL_FillRect(widget_layer, &s->layout.adjust[0].symbol[i], int_black);
+	    SDL_FillRect(screen, &s->layout.adjust[0].symbol[i], int_black);
 	    if (my_adj[i] != -1) 
 		SDL_BlitSafe(adjust_symbol[my_adj[i]], NULL, widget_layer, 
-			&layout.adjust[0].symbol[i]);
-	    layout.adjust[1].symbol[i].w = adjust_symbol[i]->w;
-	    layout.adjust[1].symbol[i].h = adjust_symbol[i]->h;
-	    layout.adjust[1].symbol[i].x = (screen->w)/2 + adjust_symbol[i]->w/2;
-	    layout.adjust[1].symbol[i].y = 
-		layout.time_border.y+layout.time_border.h + i * adjust_symbol[i]->h;
-	    SDL_FillRect(widget_layer, &layout.adjust[1].symbol[i], int_black);
-	    SDL_FillRect(screen, &layout.adjust[1].symbol[i], int_black);
+			&s->layout.adjust[0].symbol[i]);
+	    s->layout.adjust[1].symbol[i].w = adjust_symbol[i]->w;
+	    s->layout.adjust[1].symbol[i].h = adjust_symbol[i]->h;
+	    s->layout.adjust[1].symbol[i].x = (screen->w)/2 + adjust_symbol[i]->w/2;
+	    s->layout.adjust[1].symbol[i].y = 
+		s->layout.time_border.y+s->layout.time_border.h + i * adjust_symbol[i]->h;
+	    SDL_FillRect(widget_layer, &s->layout.adjust[1].symbol[i], int_black);
+	    SDL_FillRect(screen, &s->layout.adjust[1].symbol[i], int_black);
 	    if (their_adj[i] != -1) 
 		SDL_BlitSafe(adjust_symbol[their_adj[i]], NULL, widget_layer, 
-			&layout.adjust[1].symbol[i]);
+			&s->layout.adjust[1].symbol[i]);
 	}
     } else { /* single player */
 	for (i=0;i<3;i++) {
-	    layout.adjust[0].symbol[i].w = adjust_symbol[i]->w;
-	    layout.adjust[0].symbol[i].h = adjust_symbol[i]->h;
-	    layout.adjust[0].symbol[i].x = 
-		layout.grid_border[0].x + layout.grid_border[0].w +
+	    s->layout.adjust[0].symbol[i].w = adjust_symbol[i]->w;
+	    s->layout.adjust[0].symbol[i].h = adjust_symbol[i]->h;
+	    s->layout.adjust[0].symbol[i].x = 
+		s->layout.grid_border[0].x + s->layout.grid_border[0].w +
 		2 * adjust_symbol[i]->w;
-	    layout.adjust[0].symbol[i].y = 
-		layout.time_border.y +layout.time_border.h+ i * adjust_symbol[i]->h;
-	    SDL_FillRect(widget_layer, &layout.adjust[0].symbol[i], int_black);
-	    SDL_FillRect(screen, &layout.adjust[0].symbol[i], int_black);
+	    s->layout.adjust[0].symbol[i].y = 
+		s->layout.time_border.y +s->layout.time_border.h+ i * adjust_symbol[i]->h;
+	    SDL_FillRect(widget_layer, &s->layout.adjust[0].symbol[i], int_black);
+	    SDL_FillRect(screen, &s->layout.adjust[0].symbol[i], int_black);
 	    if (my_adj[i] != -1) 
 		SDL_BlitSafe(adjust_symbol[my_adj[i]], NULL, widget_layer, 
-			&layout.adjust[0].symbol[i]);
+			&s->layout.adjust[0].symbol[i]);
 	}
     }
 
     /*
      * NEXT PIECE
      */
-    if (gametype == DEMO) {
+    if (s->gametype == DEMO) {
 	/* do nothing */
-    } else if (IS_DOUBLE(gametype)) {
+    } else if (IS_DOUBLE(s->gametype)) {
 	int text_h = draw_string("Next Piece", color_blue,
 		screen->w / 2, 
-		layout.adjust[0].symbol[2].y +
-		layout.adjust[0].symbol[2].h, DRAW_CENTER);
-
-	layout.next_piece[0].w = 5 * blockWidth;
-	layout.next_piece[0].h = 5 * blockWidth;
-	layout.next_piece[0].x = (screen->w / 2) - (5 * blockWidth);
-	layout.next_piece[0].y = layout.adjust[0].symbol[2].y +
-	    layout.adjust[0].symbol[2].h + text_h;
-	draw_bordered_rect(&layout.next_piece[0], &layout.next_piece_border[0], 2);
-
-	layout.next_piece[1].w = layout.next_piece[0].w;
-	layout.next_piece[1].h = layout.next_piece[0].h;
-	layout.next_piece[1].y = layout.next_piece[0].y;
-	layout.next_piece[1].x = (screen->w / 2);
-	draw_bordered_rect(&layout.next_piece[1], &layout.next_piece_border[1], 2);
+		s->layout.adjust[0].symbol[2].y +
+		s->layout.adjust[0].symbol[2].h, DRAW_CENTER);
+
+	s->layout.next_piece[0].w = 5 * blockWidth;
+	s->layout.next_piece[0].h = 5 * blockWidth;
+	s->layout.next_piece[0].x = (screen->w / 2) - (5 * blockWidth);
+	s->layout.next_piece[0].y = s->layout.adjust[0].symbol[2].y +
+	    s->layout.adjust[0].symbol[2].h + text_h;
+	draw_bordered_rect(&s->layout.next_piece[0], &s->layout.next_piece_border[0], 2);
+
+	s->layout.next_piece[1].w = s->layout.next_piece[0].w;
+	s->layout.next_piece[1].h = s->layout.next_piece[0].h;
+	s->layout.next_piece[1].y = s->layout.next_piece[0].y;
+	s->layout.next_piece[1].x = (screen->w / 2);
+	draw_bordered_rect(&s->layout.next_piece[1], &s->layout.next_piece_border[1], 2);
     } else {
 	int text_h = draw_string("Next Piece", color_blue,
 		screen->w/10, 2*screen->h/5, 0);
 
-	layout.next_piece[0].w = 5 * blockWidth;
-	layout.next_piece[0].h = 5 * blockWidth;
-	layout.next_piece[0].x = screen->w/10;
-	layout.next_piece[0].y = (2*screen->h/5) + text_h;
+	s->layout.next_piece[0].w = 5 * blockWidth;
+	s->layout.next_piece[0].h = 5 * blockWidth;
+	s->layout.next_piece[0].x = screen->w/10;
+	s->layout.next_piece[0].y = (2*screen->h/5) + text_h;
 
 	/* Draw the box for the next piece to fit in */
-	draw_bordered_rect(&layout.next_piece[0], &layout.next_piece_border[0], 2);
+	draw_bordered_rect(&s->layout.next_piece[0], &s->layout.next_piece_border[0], 2);
     }
 
     /*
      *	PAUSE BOX
      */
-    if (gametype == DEMO) {
-
-    } else if (IS_DOUBLE(gametype)) {
-	layout.pause.x = layout.next_piece_border[0].x;
-	layout.pause.y = layout.next_piece_border[0].h + layout.next_piece_border[0].y + 2 + 
-	    layout.next_piece_border[0].h / 3;
-	layout.pause.w = layout.next_piece_border[0].w + layout.next_piece[1].w;
-	layout.pause.h = layout.next_piece_border[0].h / 3;
+    if (s->gametype == DEMO) {
+
+    } else if (IS_DOUBLE(s->gametype)) {
+	s->layout.pause.x = s->layout.next_piece_border[0].x;
+	s->layout.pause.y = s->layout.next_piece_border[0].h + s->layout.next_piece_border[0].y + 2 + 
+	    s->layout.next_piece_border[0].h / 3;
+	s->layout.pause.w = s->layout.next_piece_border[0].w + s->layout.next_piece[1].w;
+	s->layout.pause.h = s->layout.next_piece_border[0].h / 3;
     } else {
-	layout.pause.x = layout.next_piece_border[0].x;
-	layout.pause.y = layout.next_piece_border[0].h + layout.next_piece_border[0].y + 2 +
-	    layout.next_piece_border[0].h / 3;
-	layout.pause.w = layout.next_piece_border[0].w;
-	layout.pause.h = layout.next_piece_border[0].h / 3;
+	s->layout.pause.x = s->layout.next_piece_border[0].x;
+	s->layout.pause.y = s->layout.next_piece_border[0].h + s->layout.next_piece_border[0].y + 2 +
+	    s->layout.next_piece_border[0].h / 3;
+	s->layout.pause.w = s->layout.next_piece_border[0].w;
+	s->layout.pause.h = s->layout.next_piece_border[0].h / 3;
     }
 
     /* Blit onto the screen surface */
+blit:
     {
 	SDL_Rect dest;
 	dest.x = 0; dest.y = 0; dest.w = screen->w; dest.h = screen->h;
@@ -609,40 +664,40 @@ draw_background(SDL_Surface *screen, int blockWidth, Grid g[],
  * Draw or clear the pause indicator.
  *********************************************************************PROTO*/
 void
-draw_pause(int on)
+draw_pause(Session *s, int on)
 {
     int i;
     if (on) {
-	draw_pre_bordered_rect(&layout.pause, 2);
+	draw_pre_bordered_rect(&s->layout.pause, 2);
 	draw_string("* Paused *", color_blue, 
-		layout.pause.x + layout.pause.w / 2, layout.pause.y,
+		s->layout.pause.x + s->layout.pause.w / 2, s->layout.pause.y,
 		DRAW_CENTER | DRAW_UPDATE);
-	for (i=0; i<2; i++) {
+	for (i=0; i<s->layout.boards; i++) {
 	    /* save this stuff so that the flame doesn't go over it .. */
-	    if (layout.grid[i].w) {
-		SDL_BlitSafe(screen, &layout.grid[i], widget_layer,
-			&layout.grid[i]);
-		SDL_BlitSafe(screen, &layout.next_piece[i], widget_layer,
-			&layout.next_piece[i]);
+	    if (s->layout.grid[i].w) {
+		SDL_BlitSafe(screen, &s->layout.grid[i], widget_layer,
+			&s->layout.grid[i]);
+		SDL_BlitSafe(screen, &s->layout.next_piece[i], widget_layer,
+			&s->layout.next_piece[i]);
 	    }
 	}
     } else {
-	SDL_FillRect(widget_layer, &layout.pause, int_black);
-	SDL_FillRect(screen, &layout.pause, int_black);
-	SDL_BlitSafe(flame_layer, &layout.pause, screen, &layout.pause);
+	SDL_FillRect(widget_layer, &s->layout.pause, int_black);
+	SDL_FillRect(screen, &s->layout.pause, int_black);
+	SDL_BlitSafe(flame_layer, &s->layout.pause, screen, &s->layout.pause);
 	/* no need to paste over it with the widget layer: we know it to
 	 * be all transparent */
-	SDL_UpdateSafe(screen, 1, &layout.pause);
+	SDL_UpdateSafe(screen, 1, &s->layout.pause);
 
-	for (i=0; i<2; i++) 
-	    if (layout.grid[i].w) {
-		SDL_BlitSafe(widget_layer, &layout.grid[i], screen,
-			&layout.grid[i]);
-		SDL_FillRect(widget_layer, &layout.grid[i], int_solid_black);
+	for (i=0; i<s->layout.boards; i++) 
+	    if (s->layout.grid[i].w) {
+		SDL_BlitSafe(widget_layer, &s->layout.grid[i], screen,
+			&s->layout.grid[i]);
+		SDL_FillRect(widget_layer, &s->layout.grid[i], int_solid_black);
 
-		SDL_BlitSafe(widget_layer, &layout.next_piece[i], screen,
-			&layout.next_piece[i]);
-		SDL_FillRect(widget_layer, &layout.next_piece[i], int_solid_black);
+		SDL_BlitSafe(widget_layer, &s->layout.next_piece[i], screen,
+			&s->layout.next_piece[i]);
+		SDL_FillRect(widget_layer, &s->layout.next_piece[i], int_solid_black);
 	    }
     }
 }
@@ -652,17 +707,17 @@ draw_pause(int on)
  * Draws a five-digit (-x:yy) clock in the center of the screen.
  *********************************************************************PROTO*/
 void
-draw_clock(int seconds)
+draw_clock(Session *s, int seconds)
 {
-    static int old_seconds = -111;	/* last time we drew */
     static SDL_Surface * digit[12];
     char buf[16];
     static int w = -1, h= -1; /* max digit width/height */
     int i, c;
 
-    if (seconds == old_seconds || gametype == DEMO) return;
+    if (seconds == s->layout.clock_seconds || s->gametype == DEMO ||
+	    !s->layout.time.w) return;
 
-    if (old_seconds == -111) {
+    if (w == -1) {
 	/* setup code */
 
 	for (i=0;i<10;i++) {
@@ -681,21 +736,21 @@ draw_clock(int seconds)
 	}
     }
 
-    old_seconds = seconds;
+    s->layout.clock_seconds = seconds;
 
     sprintf(buf,"%d:%02d",seconds / 60, seconds % 60);
 
-    c = layout.time.x;
-    layout.time.w = w * 5;
-    layout.time.h = h;
+    c = s->layout.time.x;
+    s->layout.time.w = w * 5;
+    s->layout.time.h = h;
 
-    SDL_FillRect(widget_layer, &layout.time, int_solid_black); 
+    SDL_FillRect(widget_layer, &s->layout.time, int_solid_black); 
 
     if (strlen(buf) > 5)
 	sprintf(buf,"----");
 
     if (strlen(buf) < 5)
-	layout.time.x += ((5 - strlen(buf)) * w) / 2;
+	s->layout.time.x += ((5 - strlen(buf)) * w) / 2;
 
 
     for (i=0;buf[i];i++) {
@@ -710,43 +765,83 @@ draw_clock(int seconds)
 	else PANIC("unknown character in clock string [%s]",buf);
 
 	/* center the letter horizontally */
-	if (w > to_blit->w) layout.time.x += (w - to_blit->w) / 2;
-	layout.time.w = to_blit->w;
-	layout.time.h = to_blit->h;
+	if (w > to_blit->w) s->layout.time.x += (w - to_blit->w) / 2;
+	s->layout.time.w = to_blit->w;
+	s->layout.time.h = to_blit->h;
 	/*
 	Debug("[%d+%d, %d+%d]\n",
 		clockPos.x,clockPos.w,clockPos.y,clockPos.h);
 		*/
-	SDL_BlitSafe(to_blit, NULL, widget_layer, &layout.time);
-	if (w > to_blit->w) layout.time.x -= (w - to_blit->w) / 2;
-	layout.time.x += w;
+	SDL_BlitSafe(to_blit, NULL, widget_layer, &s->layout.time);
+	if (w > to_blit->w) s->layout.time.x -= (w - to_blit->w) / 2;
+	s->layout.time.x += w;
     }
 
-    layout.time.x = c;
+    s->layout.time.x = c;
     /*    clockPos.x = (screen->w - (w * 5)) / 2;*/
-    layout.time.w = w * 5;
-    layout.time.h = h;
-    SDL_BlitSafe(flame_layer, &layout.time, screen, &layout.time);
-    SDL_BlitSafe(widget_layer, &layout.time, screen, &layout.time);
-    SDL_UpdateSafe(screen, 1, &layout.time);
+    s->layout.time.w = w * 5;
+    s->layout.time.h = h;
+    SDL_BlitSafe(flame_layer, &s->layout.time, screen, &s->layout.time);
+    SDL_BlitSafe(widget_layer, &s->layout.time, screen, &s->layout.time);
+    SDL_UpdateSafe(screen, 1, &s->layout.time);
 
     return;
 }
 
 /***************************************************************************
- *      draw_score()
+ *      draw_score_as()
+ * Draws "score" as player i's score, whatever the session says now.
  *********************************************************************PROTO*/
 void
-draw_score(SDL_Surface *screen, int i)
+draw_score_as(Session *s, int i, int score)
 {
     char buf[256];
 
-    sprintf(buf, "%d", Score[i]);
+    sprintf(buf, "%d", score);
     draw_string(buf, color_red, 
-	    layout.score[i].x, layout.score[i].y, DRAW_LEFT | DRAW_CLEAR |
+	    s->layout.score[i].x, s->layout.score[i].y, DRAW_LEFT | DRAW_CLEAR |
 	    DRAW_ABOVE | DRAW_UPDATE);
 }
 
+/***************************************************************************
+ *      draw_score()
+ *********************************************************************PROTO*/
+void
+draw_score(Session *s, SDL_Surface *screen, int i)
+{
+    draw_score_as(s, i, s->score[i]);
+}
+
+/***************************************************************************
+ *      draw_ai_overlay()
+ * The AI debugging overlay: lines of small text under player P's name,
+ * replacing whatever was there before.
+ *********************************************************************PROTO*/
+void
+draw_ai_overlay(Session *s, int P, char *line[], int n)
+{
+    SDL_Rect r;
+    int i, h = TTF_FontLineSkip(sfont);
+
+    if (!s->layout.grid_border[P].w)
+	return;
+    r.x = s->layout.grid_border[P].x;
+    r.w = s->layout.grid_border[P].w;
+    r.y = s->layout.grid_border[P].y + s->layout.grid_border[P].h + 
+	TTF_FontLineSkip(font);
+    if (r.y >= screen->h)
+	return;
+    r.h = min(n * h, screen->h - r.y);
+
+    SDL_FillRect(widget_layer, &r, int_black);
+    SDL_FillRect(screen, &r, int_black);
+    SDL_BlitSafe(flame_layer, &r, screen, &r);
+    for (i=0; i<n && (i+1) * h <= r.h; i++)
+	draw_string(line[i], color_purple, r.x + r.w / 2, r.y + i * h,
+		DRAW_CENTER | DRAW_SMALL);
+    SDL_UpdateSafe(screen, 1, &r);
+}
+
 /***************************************************************************
  *      draw_next_piece()
  * Draws the next piece on the screen.
@@ -755,10 +850,10 @@ draw_score(SDL_Surface *screen, int i)
  * bitmaps. 
  *********************************************************************PROTO*/
 void
-draw_next_piece(SDL_Surface *screen, piece_style *ps, color_style *cs,
-	play_piece *cp, play_piece *np, int P)
+draw_next_piece(Session *s, SDL_Surface *screen, piece_style *ps,
+	color_style *cs, play_piece *cp, play_piece *np, int P)
 {
-    if (gametype != DEMO) {
+    if (s->gametype != DEMO && s->layout.next_piece[P].w) {
 	/* fake-o centering */
 	int cp_right = 5 - cp->base->dim;
 	int cp_down = 5 - cp->base->dim;
@@ -767,11 +862,11 @@ draw_next_piece(SDL_Surface *screen, piece_style *ps, color_style *cs,
 
 	draw_play_piece(screen, cs,
 		cp, 
-		layout.next_piece[P].x + cp_right * cs->w / 2,
-		layout.next_piece[P].y + cp_down * cs->w / 2, 0,
+		s->layout.next_piece[P].x + cp_right * cs->w / 2,
+		s->layout.next_piece[P].y + cp_down * cs->w / 2, 0,
 		np, 
-		layout.next_piece[P].x + np_right * cs->w / 2,
-		layout.next_piece[P].y + np_down * cs->w / 2, 0);
+		s->layout.next_piece[P].x + np_right * cs->w / 2,
+		s->layout.next_piece[P].y + np_down * cs->w / 2, 0);
     }
     return;
 }
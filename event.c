@@ -20,60 +20,150 @@
 #endif
 
 #include "atris.h"
+#include "display.h"
 #include "grid.h"
 #include "piece.h"
 #include "sound.h"
 #include "ai.h"
 #include "options.h"
+#include "sim.h"
+#include "book.h"
+#include "timer.h"
+#include "latency.h"
+#include "render.h"
+#include "session.h"
+#include "idle.h"
 
 #include ".protos/ai.pro"
 #include ".protos/display.pro"
 #include ".protos/xflame.pro"
 
-extern int Score[];
-
-struct state_struct {
-    int 	ai;
-    int 	falling;
-    int 	fall_speed; 
-    int 	accept_input;
-    int 	tetris_handling;
-    int 	limbo;
-    int 	other_in_limbo;
-    int 	limbo_sent;
-    int 	draw;
-    Uint32	collide_time;	/* time when your piece merges with the rest */
-    Uint32 	next_draw;
-    Uint32 	draw_timeout;
-    Uint32 	tv_next_fall;
-    int 	fall_event_interval;
-    Uint32 	tv_next_tetris;
-    int 	tetris_event_interval;
-    Uint32 	tv_next_ai_think;
-    Uint32 	tv_next_ai_move;
-    int		ai_interval;
-    int 	ready_for_fast;
-    int 	ready_for_rotate;
-    int		seed;
-    play_piece	cp, np;		
-    void *	ai_state;
-    /* these two are used by tetris_event() */
-    int		check_result;
-    int		num_lines_cleared;
-} State[2];
-
-/* one position structure per player */
-struct pos_struct {
-    int x;
-    int y;
-    int rot;
-    int old_x;
-    int old_y;
-    int old_rot;
-    Command move;
-} pos[2];
-
-Grid distract_grid[2];
+/* 
+ * Everything in event_loop() that happens at a set time is one of these
+ * timers in the session's "timers", one set of them per board: each pass
+ * handles what is due on the board whose next timer comes first, and the
+ * loop sleeps until the next one. Boards with nothing due are not looked
+ * at. Times are in game ticks, which stand still while the game is paused;
+ * see event_ticks().
+ */
+#define EVENT_FALL	0	/* the piece falls a step */
+#define EVENT_TETRIS	1	/* the next step of clearing lines */
+#define EVENT_AI_THINK	2
+#define EVENT_AI_MOVE	3	/* the AI gets to press a key */
+#define EVENT_BLANK	4	/* the distraction comes down another row */
+#define EVENT_TIMERS	5
+#define EVENT_TIMER(P,which)	((P) * EVENT_TIMERS + (which))
+
+/* 
+ * Falls and tetris animation steps run on a fixed timestep: a pass that
+ * comes late makes up every step it missed, up to this many, so that
+ * how far things move depends on the time and not on the loop.
+ */
+#define EVENT_CATCH_UP	8
+
+/* the turbo clock moves on this much when nothing at all is due */
+#define EVENT_INPUT_POLL	2
+
+/* ... and the real one is slept on at most this long, for the clock */
+#define EVENT_IDLE	100
+
+/* do we draw board P ourselves? not if the render thread does, nor if
+ * draw_background() gave it no place on the screen */
+#define EVENT_DRAWS(s,P)	(!(s)->rendering && (P) < (s)->layout.boards)
+
+/* can anybody see board P as it is? not if it is blanked, off the screen
+ * or only drawn now and then in turbo */
+#define EVENT_WATCHED(s,P)	((s)->state[P].draw && \
+	(P) < (s)->layout.boards && !(s)->turbo.on)
+
+/*
+ * When lines clear, whatever was above them slides down a row in
+ * RENDER_SLIDE ticks, however it is drawn: the render thread works out how
+ * far along it is from the time, and when we draw it ourselves we do so
+ * every TETRIS_SLIDE_STEP. Nobody watching, it all comes down at once.
+ */
+#define TETRIS_SLIDE_STEP	4
+
+/* where F12 writes the event loop's histograms: see event_dump() */
+#define EVENT_LATENCY_FILE	"Atris.Latency"
+
+static const char *phase_name[PHASES] = {
+    "input", "fall", "tetris", "think", "move", "draw", "network", "sleep",
+    "pass", "fall-late"
+};
+
+/***************************************************************************
+ *      event_ticks()
+ * The game clock: SDL_GetTicks(), less the time spent paused. In turbo
+ * it only moves when the loop moves it.
+ ***************************************************************************/
+static Uint32
+event_ticks(Session *s)
+{
+    return s->turbo.on ? s->turbo.clock : SDL_GetTicks() - s->paused_ticks;
+}
+
+/***************************************************************************
+ *      event_piece()
+ * generate_piece() on the session's own random numbers, which it leaves
+ * where generate_piece() would have left ZEROTO()'s.
+ ***************************************************************************/
+static play_piece
+event_piece(Session *s, piece_style *ps, color_style *cs, unsigned int seq)
+{
+    s->random = seq;
+    return generate_piece_r(ps, cs, &s->random);
+}
+
+/***************************************************************************
+ *      input_gather()
+ * Takes everything SDL has waiting (as much as fits) and stamps it.
+ * Returns how much input is waiting now.
+ ***************************************************************************/
+static int
+input_gather(Session *s)
+{
+    while (s->input.n < INPUT_QUEUE) {
+	int i = (s->input.first + s->input.n) % INPUT_QUEUE, got;
+	render_lock();
+	got = SDL_PollEvent(&s->input.event[i]);
+	render_unlock();
+	if (!got)
+	    break;
+	s->input.at[i] = SDL_GetTicks();
+	s->input.n++;
+    }
+    return s->input.n;
+}
+
+/***************************************************************************
+ *      input_next()
+ * The oldest input waiting, in *e, noting how long it waited. Returns 0
+ * if there is none.
+ ***************************************************************************/
+static int
+input_next(Session *s, SDL_Event *e)
+{
+    static const Uint32 bound[INPUT_LAG_BUCKETS - 1] = { 1, 2, 5, 10 };
+    Uint32 lag;
+    int b;
+
+    if (s->input.n == 0 && !input_gather(s))
+	return 0;
+    *e = s->input.event[s->input.first];
+    lag = SDL_GetTicks() - s->input.at[s->input.first];
+    s->input.first = (s->input.first + 1) % INPUT_QUEUE;
+    s->input.n--;
+
+    s->input_lag.events++;
+    s->input_lag.total += lag;
+    if (lag > s->input_lag.worst)
+	s->input_lag.worst = lag;
+    for (b=0; b<INPUT_LAG_BUCKETS - 1 && lag >= bound[b]; b++)
+	;
+    s->input_lag.bucket[b]++;
+    return 1;
+}
 
 /***************************************************************************
  *      paste_on_board()
@@ -135,8 +225,9 @@ screen_to_grid_coords(Grid *g, int blockWidth,
 {
     screen_x -= g->board.x;
     screen_y -= g->board.y;
-    if (screen_x < 0) screen_x -= 19;	/* round up to negative #s */
-    if (screen_y < 0) screen_y -= 19;	/* round up to negative #s */
+    /* round up to negative #s */
+    if (screen_x < 0) screen_x -= blockWidth - 1;
+    if (screen_y < 0) screen_y -= blockWidth - 1;
 
     *row = screen_y / blockWidth;
     *col = screen_x / blockWidth;
@@ -198,7 +289,9 @@ valid_screen_position(play_piece *pp, int blockWidth, Grid *g,
     if (!valid_position(pp, col, row, rot, g))
 	return 0;
 
-    screen_to_grid_coords(g, blockWidth, screen_x, screen_y+19, &row2, &col);
+    /* a piece between two rows covers the lower one too */
+    screen_to_grid_coords(g, blockWidth, screen_x, screen_y + blockWidth - 1,
+	    &row2, &col);
 
     if (row == row2) return 1;	/* no need to recheck, you were aligned */
     else return valid_position(pp, col, row2, rot, g);
@@ -206,23 +299,25 @@ valid_screen_position(play_piece *pp, int blockWidth, Grid *g,
 
 /***************************************************************************
  *      tetris_event()
- * Do some work associated with a collision. Needs the color style to draw
- * the grid.
+ * Do some work associated with a collision, the step "count" of it that
+ * is due at game tick "at": 1 checks for lines, 2 runs gravity and 3
+ * slides what falls down a row (see TETRIS_SLIDE_STEP). Needs the color style
+ * to draw the grid.
  *************************************************************************/
-int tetris_event(int *delay, int count, SDL_Surface * screen, 
+int tetris_event(Session *s, int *delay, int count, SDL_Surface * screen, 
 	piece_style *ps, color_style *cs, sound_style *ss, Grid g[], int
 	level, int fall_event_interval, int sock, int draw,
-	int *blank, int *garbage, int P)
+	int *blank, int *garbage, int P, Uint32 at)
 {
     if (count == 1) { /* determine if anything happened, sounds */
 	int i;
 
-	State[P].check_result = check_tetris(g);
-	State[P].num_lines_cleared += State[P].check_result;
+	s->state[P].check_result = check_tetris(g);
+	s->state[P].num_lines_cleared += s->state[P].check_result;
 
-	if (State[P].check_result >= 3)
+	if (s->state[P].check_result >= 3)
 	    play_sound(ss,SOUND_CLEAR4,256);
-	else for (i=0;i<State[P].check_result;i++)
+	else for (i=0;i<s->state[P].check_result;i++)
 	    play_sound(ss,SOUND_CLEAR1,256+6144*i);
 
 	*delay = 1;
@@ -263,51 +358,69 @@ int tetris_event(int *delay, int count, SDL_Surface * screen,
 	 */
 	draw_grid(screen,cs,&g[0],draw);
 
-	if (determine_falling(&g[0])) {
+	if (determine_falling(&g[0]) && !EVENT_WATCHED(s,P)) {
+	    /* nobody would see it come down: bring it all down now */
+	    int thud = 0;
+
+	    do {
+		fall_down(g);
+		thud |= run_gravity(g);
+	    } while (determine_falling(&g[0]));
+	    draw_grid(screen,cs,g,draw);
+	    if (thud)
+		play_sound(ss,SOUND_THUD,0);
+	    *delay = 0;
+	    return check_tetris(g) ? 1 : 2;
+	} else if (determine_falling(&g[0])) {
+	    s->state[P].slide_at = at + 1;
 	    *delay = 1;
 	    return 3;
 	} else {
-	    Score[P] += State[P].num_lines_cleared *
-		State[P].num_lines_cleared * level;
+	    s->score[P] += s->state[P].num_lines_cleared *
+		s->state[P].num_lines_cleared * level;
 	    if (sock) {
 		char msg = 's'; /* WRW: send update */
 		send(sock,&msg,1,0);
-		send(sock,(char *)&Score[P],sizeof(Score[P]),0);
-		if (State[P].num_lines_cleared >= 5) {
+		send(sock,(char *)&s->score[P],sizeof(s->score[P]),0);
+		if (s->state[P].num_lines_cleared >= 5) {
 		    char msg = 'g'; /* WRW: send garbage! */
 		    send(sock,&msg,1,0);
-		    State[P].num_lines_cleared -= 4; /* might possibly also blank! */
+		    s->state[P].num_lines_cleared -= 4; /* might possibly also blank! */
 		}
-		if (State[P].num_lines_cleared >= 3) {
+		if (s->state[P].num_lines_cleared >= 3) {
 		    int i;
-		    for (i=3;i<=State[P].num_lines_cleared;i++) {
+		    for (i=3;i<=s->state[P].num_lines_cleared;i++) {
 			char msg = 'b'; /* WRW: send blanking! */
 			send(sock,&msg,1,0);
 		    }
 		}
 	    } else {
-		if (State[P].num_lines_cleared >= 5) {
+		if (s->state[P].num_lines_cleared >= 5) {
 		    *garbage = 1;
-		    State[P].num_lines_cleared -= 4;
+		    s->state[P].num_lines_cleared -= 4;
 		}
-		if (State[P].num_lines_cleared >= 3) {
-		    *blank = (State[P].num_lines_cleared - 2);
+		if (s->state[P].num_lines_cleared >= 3) {
+		    *blank = (s->state[P].num_lines_cleared - 2);
 		}
 	    }
-	    draw_score(screen,P);
-	    State[P].num_lines_cleared = 0;
+	    if (EVENT_DRAWS(s,P))
+		draw_score(s, screen,P);
+	    s->state[P].num_lines_cleared = 0;
 	    return 0;
 	}
-    } else if (count >= 3 && count <= 22) {
-	if (draw) 
-	    draw_falling(screen, cs->w , &g[0], count - 2);
-
-	/*
-	*delay = max(fall_event_interval / 5,4);
-	*/
-	*delay = 4;
-	return count + 1;
-    } else if (count == 23) {
+    } else if (count == 3) {
+	Sint32 age = at - s->state[P].slide_at;
+
+	if (age < RENDER_SLIDE && EVENT_WATCHED(s,P)) {
+	    if (draw) {
+		draw_falling(screen, cs->w, &g[0],
+			max(1, age * cs->h / RENDER_SLIDE));
+		*delay = min(TETRIS_SLIDE_STEP, RENDER_SLIDE - age);
+	    } else	/* the render thread does the in-betweens */
+		*delay = RENDER_SLIDE - age;
+	    return 3;
+	}
+	/* down the whole row: it lands */
 	fall_down(g);
 	draw_grid(screen,cs,g,draw);
 	if (run_gravity(g))
@@ -315,9 +428,11 @@ int tetris_event(int *delay, int count, SDL_Surface * screen,
 	/*
 	*delay = max(fall_event_interval / 5,4);
 	*/
-	*delay = 4; 
-	if (determine_falling(&g[0])) 
+	*delay = EVENT_WATCHED(s,P) ? 4 : 0; 
+	if (determine_falling(&g[0])) {
+	    s->state[P].slide_at = at + *delay;
 	    return 3;
+	}
 	if (check_tetris(g))
 	    return 1;
 	else /* cannot be 0: we must redraw without falling */
@@ -331,25 +446,117 @@ int tetris_event(int *delay, int count, SDL_Surface * screen,
  * Blank the visual screen of the given (local) player. 
  ***************************************************************************/
 static void
-do_blank(SDL_Surface *screen, sound_style *ss[2], Grid g[], int P)
+do_blank(Session *s, SDL_Surface *screen, sound_style *ss[], Grid g[], int P)
 {
     play_sound(ss[P],SOUND_GARBAGE1,1);
-    if (State[P].draw) {
-	State[P].next_draw = SDL_GetTicks() + 1000;
-	State[P].draw_timeout = 1000;
-	SDL_FillRect(screen, &g[P].board, 
-		SDL_MapRGB(screen->format,32,32,32));
-	SDL_UpdateSafe(screen, 1, &g[P].board);
+    if (s->state[P].draw) {
+	s->state[P].next_draw = event_ticks(s) + 1000;
+	s->state[P].draw_timeout = 1000;
+	if (EVENT_DRAWS(s,P)) {
+	    SDL_FillRect(screen, &g[P].board, 
+		    SDL_MapRGB(screen->format,32,32,32));
+	    SDL_UpdateSafe(screen, 1, &g[P].board);
+	}
     }  else {
-	State[P].next_draw += 1000;
-	State[P].draw_timeout += 1000;
+	s->state[P].next_draw += 1000;
+	s->state[P].draw_timeout += 1000;
     }
     { int i,j;
 	for (j=0;j<g[0].h;j++)
 	    for (i=0;i<g[0].w;i++)
-		GRID_CHANGED(distract_grid[P],i,j) = 0;
+		GRID_CHANGED(s->distract[P],i,j) = 0;
+    }
+    s->state[P].draw = 0;
+    timer_set(&s->timers, EVENT_TIMER(P, EVENT_BLANK), event_ticks(s));
+}
+
+/***************************************************************************
+ *      event_target()
+ * Whom player P's garbage and blanks go to: the next of the n boards
+ * after the one that got them last that is still in the match, or -1 if
+ * there is nobody left. With two players it is always the other one.
+ ***************************************************************************/
+static int
+event_target(Session *s, int P, int n, int adjust[])
+{
+    int i, Q = s->state[P].target;
+
+    for (i=0; i<n; i++) {
+	Q = (Q + 1) % n;
+	if (Q != P && adjust[Q] == -1)
+	    return s->state[P].target = Q;
+    }
+    return -1;
+}
+
+/***************************************************************************
+ *      event_standing()
+ * How many of the n boards are still in the match.
+ ***************************************************************************/
+static int
+event_standing(int n, int adjust[])
+{
+    int Q, standing = 0;
+
+    for (Q=0; Q<n; Q++)
+	if (adjust[Q] == -1)
+	    standing++;
+    return standing;
+}
+
+/***************************************************************************
+ *      event_retire()
+ * Takes board P out of play: it is knocked out (or waiting on the network
+ * opponent) and nothing more happens to it but the end of a distraction.
+ ***************************************************************************/
+static void
+event_retire(Session *s, int P)
+{
+    int i;
+
+    s->state[P].falling = 0;
+    s->state[P].fall_speed = 0;
+    s->state[P].tetris_handling = 0;
+    s->state[P].accept_input = 0;
+    s->state[P].limbo = 1;
+    for (i=0; i<EVENT_TIMERS; i++)
+	if (i != EVENT_BLANK)
+	    timer_cancel(&s->timers, EVENT_TIMER(P, i));
+}
+
+/***************************************************************************
+ *      event_clock_sound()
+ * Starts or stops the last-thirty-seconds ticking for the n local boards.
+ ***************************************************************************/
+static void
+event_clock_sound(sound_style *ss[], int n, int on)
+{
+    int Q;
+
+    for (Q=0; Q<n; Q++)
+	if (on)
+	    play_sound_unless_already_playing(ss[Q],SOUND_CLOCK,0);
+	else
+	    stop_playing_sound(ss[Q],SOUND_CLOCK);
+}
+
+/***************************************************************************
+ *      event_show_piece()
+ * Draws player P's piece where it has moved to, if it has moved.
+ ***************************************************************************/
+static void
+event_show_piece(Session *s, SDL_Surface *screen, color_style *cs, int P)
+{
+    Player_State *st = &s->state[P];
+    Player_Pos *pos = &s->pos[P];
+
+    if (!st->falling || !st->draw || !EVENT_DRAWS(s,P))
+	return;
+    if (pos->old_x != pos->x || pos->old_y != pos->y || pos->old_rot != pos->rot) {
+	draw_play_piece(screen, cs, &st->cp, pos->old_x, pos->old_y, pos->old_rot,
+		&st->cp, pos->x, pos->y, pos->rot);
+	pos->old_x = pos->x; pos->old_y = pos->y; pos->old_rot = pos->rot;
     }
-    State[P].draw = 0;
 }
 
 /***************************************************************************
@@ -357,15 +564,13 @@ do_blank(SDL_Surface *screen, sound_style *ss[2], Grid g[], int P)
  * Function for the bomb special piece.
  ***************************************************************************/
 static void
-bomb_fun(int x, int y, Grid *g) 
+bomb_fun(int x, int y, Grid *g, int color) 
 {
     if ((x<0 || y<0 || x>=g->w || y>=g->h)) 
 	return;
     GRID_SET(*g,x,y,REMOVE_ME);
 }
 
-static int most_common = 1;
-
 /***************************************************************************
  *      colorkill_fun()
  * Function for the repainting special piece.
@@ -385,7 +590,7 @@ colorkill_recurse(int x, int y, Grid *g, int target_color)
 }
 
 static void
-colorkill_fun(int x, int y, Grid *g)
+colorkill_fun(int x, int y, Grid *g, int color)
 {
     int c;
     if ((x<0 || y<0 || x>=g->w || y>=g->h)) 
@@ -402,22 +607,22 @@ colorkill_fun(int x, int y, Grid *g)
 
 /***************************************************************************
  *      repaint_fun()
- * Function for the repainting special piece.
+ * Function for the repainting special piece: paints in "color".
  ***************************************************************************/
 static void
-repaint_fun(int x, int y, Grid *g) 
+repaint_fun(int x, int y, Grid *g, int color) 
 {
     int c;
     if ((x<0 || y<0 || x>=g->w || y>=g->h)) 
 	return;
     GRID_CHANGED(*g,x,y) = 1;
     c = GRID_CONTENT(*g,x,y);
-    if (c <= 1 || c == most_common) return;
-    GRID_SET(*g,x,y,most_common);
-    repaint_fun(x - 1, y, g);
-    repaint_fun(x + 1, y, g);
-    repaint_fun(x, y - 1, g);
-    repaint_fun(x, y + 1, g);
+    if (c <= 1 || c == color) return;
+    GRID_SET(*g,x,y,color);
+    repaint_fun(x - 1, y, g, color);
+    repaint_fun(x + 1, y, g, color);
+    repaint_fun(x, y - 1, g, color);
+    repaint_fun(x, y + 1, g, color);
 }
 
 /***************************************************************************
@@ -427,7 +632,7 @@ repaint_fun(int x, int y, Grid *g)
  ***************************************************************************/
 static void
 push_down(play_piece *pp, int col, int row, int rot, Grid *g,
-	void (*fun)(int, int, Grid *))
+	void (*fun)(int, int, Grid *, int))
 {
     int i,j,c;
     int place_y, look_y;
@@ -464,11 +669,11 @@ push_down(play_piece *pp, int col, int row, int rot, Grid *g,
 /***************************************************************************
  *      find_on_board()
  * Finds where on the board a piece would go: used by special piece
- * handling routines. 
+ * handling routines. "color" is passed on to fun.
  ***************************************************************************/
 static void
 find_on_board(play_piece *pp, int col, int row, int rot, Grid *g,
-	void (*fun)(int, int, Grid *))
+	void (*fun)(int, int, Grid *, int), int color)
 {
     int i,j,c;
 
@@ -491,10 +696,10 @@ find_on_board(play_piece *pp, int col, int row, int rot, Grid *g,
 		if ((t_x<0 || t_y<0 || t_x>=g->w || t_y>=g->h)) {
 		    continue;
 		}
-		fun(t_x - 1, t_y, g);
-		fun(t_x + 1, t_y, g);
-		fun(t_x, t_y - 1, g);
-		fun(t_x, t_y + 1, g);
+		fun(t_x - 1, t_y, g, color);
+		fun(t_x + 1, t_y, g, color);
+		fun(t_x, t_y - 1, g, color);
+		fun(t_x, t_y + 1, g, color);
 	}
     return;
 }
@@ -504,7 +709,7 @@ find_on_board(play_piece *pp, int col, int row, int rot, Grid *g,
  * Finds the most common (non-zero, non-garbage) color on the board. If
  * none, returns the garbage color. 
  ***************************************************************************/
-static void
+static int
 most_common_color(Grid *g)
 {
     int count[256];
@@ -525,14 +730,14 @@ most_common_color(Grid *g)
 	    max = x;
 	    max_count = count[x];
 	}
-    most_common = max;
-    return;
+    return max;
 }
 
 /***************************************************************************
  *      handle_special()
  * Change the state of the grid based on the magical special piece ...
- * Look in pos[P] for the current position.
+ * pp has just landed at (col, row) in rotation rot on g; ss, if not
+ * NULL, makes the noise.
  *********************************************************************PROTO*/
 void
 handle_special(play_piece *pp, int row, int col, int rot, Grid *g,
@@ -541,13 +746,13 @@ handle_special(play_piece *pp, int row, int col, int rot, Grid *g,
     switch (pp->special) {
 	case No_Special: break;
 	case Special_Bomb: 
-			 find_on_board(pp, col, row, rot, g, bomb_fun);
+			 find_on_board(pp, col, row, rot, g, bomb_fun, 0);
 			 if (ss) 
 			     play_sound(ss,SOUND_CLEAR1,256);
 			 break;
 	case Special_Repaint: 
-			 most_common_color(g);
-			 find_on_board(pp, col, row, rot, g, repaint_fun);
+			 find_on_board(pp, col, row, rot, g, repaint_fun,
+				 most_common_color(g));
 			 if (ss) 
 			     play_sound(ss,SOUND_GARBAGE1,256);
 			 break;
@@ -557,7 +762,7 @@ handle_special(play_piece *pp, int row, int col, int rot, Grid *g,
 			     play_sound(ss,SOUND_THUD,256*2);
 			 break;
 	case Special_Colorkill: 
-			 find_on_board(pp, col, row, rot, g, colorkill_fun);
+			 find_on_board(pp, col, row, rot, g, colorkill_fun, 0);
 			 if (ss) 
 			     play_sound(ss,SOUND_CLEAR1,256);
 			 break;
@@ -567,27 +772,20 @@ handle_special(play_piece *pp, int row, int col, int rot, Grid *g,
 
 /***************************************************************************
  *      do_pause()
- * Change the pause status of the local player.
+ * Change the pause status of the local player. Every deadline is in game
+ * ticks, so unpausing just takes the pause off the game clock.
  ***************************************************************************/
 static void
-do_pause(int paused, Uint32 tv_now, int *pause_begin_time, int *tv_start)
+do_pause(Session *s, int paused, Uint32 *pause_begin_time)
 {
-    int i;
-    draw_pause(paused);
-    if (!paused) {
-	/* fixup times */
-	*tv_start += (tv_now - *pause_begin_time);
-	for (i=0; i<2; i++) {
-	    State[i].collide_time += (tv_now - *pause_begin_time);
-	    State[i].next_draw += (tv_now - *pause_begin_time);
-	    State[i].tv_next_fall += (tv_now - *pause_begin_time);
-	    State[i].tv_next_tetris += (tv_now - *pause_begin_time);
-	    State[i].tv_next_ai_think += (tv_now - *pause_begin_time);
-	    State[i].tv_next_ai_move += (tv_now - *pause_begin_time);
-	}
-    } else {
-	*pause_begin_time = tv_now;
-    }
+    render_lock();
+    render_pause(paused);
+    draw_pause(s, paused);
+    render_unlock();
+    if (!paused) 
+	s->paused_ticks += SDL_GetTicks() - *pause_begin_time;
+    else 
+	*pause_begin_time = SDL_GetTicks();
 }
 
 /***************************************************************************
@@ -599,18 +797,19 @@ do_pause(int paused, Uint32 tv_now, int *pause_begin_time, int *tv_start)
  * Returns 0 on success. 
  ***************************************************************************/
 static int
-place_this_piece(int P, int blockWidth, Grid g[])
+place_this_piece(Session *s, int P, int blockWidth, Grid g[])
 {
     int Y, R;
     /* we'll try Y adjustments from -2 to 0 and rotations from 0 to 3 */
 
-    pos[P].x = pos[P].old_x = g[P].board.x + g[P].board.w / 2;
+    s->pos[P].x = s->pos[P].old_x = g[P].board.x + g[P].board.w / 2;
+    s->state[P].fall_dy = 0;
     for (Y = 0; Y >= -2 ; Y --) {
 	for (R = 0; R <= 3; R++) {
-	    pos[P].y = pos[P].old_y = g[P].board.y + (blockWidth * Y);
-	    pos[P].old_rot = pos[P].rot = R;
-	    if (valid_screen_position(&State[P].cp, blockWidth,
-			&g[P], pos[P].rot, pos[P].x, pos[P].y)) {
+	    s->pos[P].y = s->pos[P].old_y = g[P].board.y + (blockWidth * Y);
+	    s->pos[P].old_rot = s->pos[P].rot = R;
+	    if (valid_screen_position(&s->state[P].cp, blockWidth,
+			&g[P], s->pos[P].rot, s->pos[P].x, s->pos[P].y)) {
 		return 0;
 	    }
 	}
@@ -619,26 +818,383 @@ place_this_piece(int P, int blockWidth, Grid g[])
 }
 
 /***************************************************************************
- *      event_loop()
- * The main event-processing dispatch loop. 
- *
- * Returns 0 on a successful game completion, -1 on a [single-user] quit.
+ *      do_move()
+ * Carries out whatever move player Q has waiting in s->pos[Q].move.
+ ***************************************************************************/
+static void
+do_move(Session *s, int Q, int blockWidth, Grid g[])
+{
+    int i;
+
+    if (s->pos[Q].move != MOVE_NONE)
+	s->state[Q].fall_dy = 0;	/* show it where it is now */
+    switch (s->pos[Q].move) {
+	case MOVE_ROTATE: 
+	    s->state[Q].ready_for_rotate = 0;
+	    if (valid_screen_position(&s->state[Q].cp,blockWidth,&g[Q],(s->pos[Q].rot+1)%4,s->pos[Q].x,s->pos[Q].y)) {
+		s->pos[Q].rot = (s->pos[Q].rot+1)%4; 
+		s->state[Q].collide_time = 0;
+	    } else if (valid_screen_position(&s->state[Q].cp,blockWidth,&g[Q],(s->pos[Q].rot+1)%4,
+			s->pos[Q].x-blockWidth,s->pos[Q].y)) {
+		s->pos[Q].rot = (s->pos[Q].rot+1)%4; 
+		s->pos[Q].x -= blockWidth;
+		s->state[Q].collide_time = 0;
+	    } else if (valid_screen_position(&s->state[Q].cp,blockWidth,&g[Q],(s->pos[Q].rot+1)%4,
+			s->pos[Q].x+blockWidth,s->pos[Q].y)) {
+		s->pos[Q].rot = (s->pos[Q].rot+1)%4; 
+		s->pos[Q].x += blockWidth;
+		s->state[Q].collide_time = 0;
+	    } else if (valid_screen_position(&s->state[Q].cp,blockWidth,&g[Q],(s->pos[Q].rot+1)%4,
+			s->pos[Q].x,s->pos[Q].y+blockWidth)) {
+		s->pos[Q].rot = (s->pos[Q].rot+1)%4; 
+		s->pos[Q].y += blockWidth;
+		s->state[Q].collide_time = 0;
+	    } else if (Options.upward_rotation &&
+		    valid_screen_position(&s->state[Q].cp,blockWidth,
+			&g[Q],(s->pos[Q].rot+1)%4, s->pos[Q].x,
+			s->pos[Q].y-blockWidth)) {
+		s->pos[Q].rot = (s->pos[Q].rot+1)%4; 
+		s->pos[Q].y -= blockWidth;
+		s->state[Q].collide_time = 0;
+	    }
+	    s->pos[Q].move = MOVE_NONE;
+	    break;
+	case MOVE_LEFT:
+	    for (i=0;i<10;i++) 
+		if (valid_screen_position(&s->state[Q].cp,blockWidth,
+			    &g[Q],s->pos[Q].rot,
+			    s->pos[Q].x-blockWidth,
+			    s->pos[Q].y+i)) {
+		    s->pos[Q].x -= blockWidth;
+		    s->pos[Q].y += i;
+		    s->state[Q].collide_time = 0;
+		    break;
+		}
+	    s->pos[Q].move = MOVE_NONE;
+	    break;
+	case MOVE_RIGHT:
+	    for (i=0;i<10;i++)
+		if (valid_screen_position(&s->state[Q].cp,blockWidth,&g[Q],s->pos[Q].rot,
+			    s->pos[Q].x+blockWidth,s->pos[Q].y+i)){
+		    s->pos[Q].x += blockWidth;
+		    s->pos[Q].y += i;
+		    s->state[Q].collide_time = 0;
+		    break;
+		}
+	    s->pos[Q].move = MOVE_NONE;
+	    break;
+	case MOVE_DOWN:
+	    if (valid_screen_position(&s->state[Q].cp,blockWidth,&g[Q],s->pos[Q].rot,
+			s->pos[Q].x, s->pos[Q].y+blockWidth))
+		s->pos[Q].y+=blockWidth;
+	    s->state[Q].fall_speed = 20;
+	    s->state[Q].ready_for_fast = 0;
+	    s->pos[Q].move = MOVE_NONE;
+	    break;
+	default: 
+	    break;
+    }
+}
+
+/***************************************************************************
+ *      ai_overlay()
+ * Puts what player P's AI has been up to under its name (--ai-overlay):
+ * how much work each piece took, how often it had nothing left to do and
+ * how much of the time to spare the AIs have been using.
+ ***************************************************************************/
+static void
+ai_overlay(Session *s, int P, AI_Counters *c)
+{
+    char buf[3][80];
+    char *line[3] = { buf[0], buf[1], buf[2] };
+    double pieces = c->decisions ? c->decisions : 1;
+
+    sprintf(buf[0], "%.0f drops %.0f evals / piece",
+	    c->drops / pieces, c->evals / pieces);
+    sprintf(buf[1], "%lu%% settled  %lu overruns",
+	    c->thinks ? 100 * c->settled / c->thinks : 0, c->overruns);
+    sprintf(buf[2], "%.0f%% of slack used  %lu late",
+	    s->sched.slack > 0 ? 100.0 * s->sched.used / s->sched.slack : 0.0, 
+	    s->sched.late);
+    draw_ai_overlay(s, P, line, 3);
+}
+
+/***************************************************************************
+ *      event_phase()
+ * The event loop goes on to the given phase (see session.h): what it was
+ * doing until now is added to what that took this pass.
+ ***************************************************************************/
+static void
+event_phase(Session *s, int phase)
+{
+    Phase_Stats *p = &s->phases;
+    double now = sim_now();
+
+    if (p->on >= 0)
+	p->spent[p->on] += now - p->since;
+    if (p->spent[phase] < 0)
+	p->spent[phase] = 0;
+    p->on = phase;
+    p->since = now;
+}
+
+/***************************************************************************
+ *      event_pass()
+ * A pass through the event loop is over: into the histograms with what
+ * it took, unless "keep" says it was not a real one (the time since the
+ * last game, say).
+ ***************************************************************************/
+static void
+event_pass(Session *s, int keep)
+{
+    Phase_Stats *p = &s->phases;
+    double now = sim_now();
+    int i;
+
+    if (p->on >= 0 && keep) {
+	p->spent[p->on] += now - p->since;
+	for (i=0; i<PHASE_PASS; i++)
+	    if (p->spent[i] >= 0)
+		latency_add(&p->hist[i], (Uint32) (p->spent[i] * 1000000.0));
+	latency_add(&p->hist[PHASE_PASS], (Uint32) ((now - p->pass) * 1000000.0));
+    }
+    for (i=0; i<PHASE_PASS; i++)
+	p->spent[i] = -1;
+    p->on = -1;
+    p->pass = now;
+}
+
+/***************************************************************************
+ *      event_dump()
+ * Writes every histogram in session s to EVENT_LATENCY_FILE, for whoever
+ * wants to know where the frame time went: see latency_write().
+ ***************************************************************************/
+static void
+event_dump(Session *s)
+{
+    FILE *fout = fopen(EVENT_LATENCY_FILE, "wt");
+    int i;
+
+    if (!fout) {
+	Debug("fopen(%s): cannot write the latencies.\n", EVENT_LATENCY_FILE);
+	return;
+    }
+    fprintf(fout, "# Alizarin Tetris event loop, in microseconds\n"
+	    "# phase\tat most\tcount\tfraction\n");
+    for (i=0; i<PHASES; i++)
+	latency_write(fout, phase_name[i], &s->phases.hist[i]);
+    fclose(fout);
+    Debug("Latencies written to [%s].\n", EVENT_LATENCY_FILE);
+}
+
+/***************************************************************************
+ *      event_report()
+ * Says how the slack was spent, how long input waited before it was
+ * acted on and how long each phase of the event loop took, over every game
+ * in session s; called on the way out.
  *********************************************************************PROTO*/
+void
+event_report(Session *s)
+{
+    unsigned long *b = s->input_lag.bucket;
+    int i;
+
+    if (s->sched.windows)
+	Debug("Slack: %.1f s in %lu gaps, %.0f%% to the AIs; %lu deadlines "
+		"missed by %.2f ms on average, %.2f ms at worst.\n",
+		s->sched.slack, s->sched.windows,
+		100.0 * s->sched.used / s->sched.slack, s->sched.late,
+		s->sched.late ? 1000.0 * s->sched.overrun / s->sched.late : 0.0,
+		1000.0 * s->sched.worst);
+    if (s->input_lag.events)
+	Debug("Input: %lu events waited %.2f ms on average, %u ms at worst "
+		"(<1 ms %lu, <2 %lu, <5 %lu, <10 %lu, more %lu).\n",
+		s->input_lag.events, s->input_lag.total / s->input_lag.events,
+		(unsigned) s->input_lag.worst, b[0], b[1], b[2], b[3], b[4]);
+    for (i=0; i<PHASES; i++) {
+	Latency *h = &s->phases.hist[i];
+
+	if (h->n)
+	    Debug("%-9s %8lu, %6.0f us on average, 50%% %lu, 99%% %lu, "
+		    "99.9%% %lu, worst %lu.\n", phase_name[i], h->n,
+		    h->total / h->n, (unsigned long) latency_at(h, 0.5),
+		    (unsigned long) latency_at(h, 0.99),
+		    (unsigned long) latency_at(h, 0.999),
+		    (unsigned long) h->worst);
+    }
+}
+
+/***************************************************************************
+ *      sched_slack()
+ * Nothing has to happen before game tick "least", the next timer due.
+ * The AIs get that time, a think() at a time and in turn, as long as
+ * each one's recent cost still fits before the deadline and nobody has
+ * pressed a key. Once they are settled we sleep till then, unless a key
+ * or something from sock comes first: see idle_wait().
+ ***************************************************************************/
+static void
+sched_slack(Session *s, Uint32 least, piece_style *ps, color_style *cs[],
+	Grid g[], AI_Player *AI[], int blockWidth, int NUM_PLAYER, int sock)
+{
+    Uint32 tv_now = event_ticks(s);
+    double now = sim_now(), deadline, before;
+    int Q, busy = 1;
+
+    if ((Sint32) (least - tv_now) <= 0)
+	return;
+    deadline = now + (least - tv_now) / 1000.0;
+    s->sched.windows++;
+    s->sched.slack += deadline - now;
+
+    while (busy && !input_gather(s)) {
+	busy = 0;
+	for (Q=0; Q<NUM_PLAYER; Q++) {
+	    int row, col;
+
+	    if (!s->state[Q].ai || !s->state[Q].draw || s->state[Q].book ||
+		    s->state[Q].limbo || now + s->state[Q].think_cost > deadline)
+		continue;
+	    screen_to_grid_coords(&g[Q], blockWidth, s->pos[Q].x, s->pos[Q].y,
+		    &row, &col);
+	    sim_set_styles(ps, cs[Q]);
+	    before = now;
+	    event_phase(s, PHASE_THINK);
+	    busy |= ai_think(AI[Q], &s->state[Q].ai_counters, s->state[Q].ai_state,
+		    &g[Q], &s->state[Q].cp, &s->state[Q].np, col, row, s->pos[Q].rot);
+	    event_phase(s, PHASE_SLEEP);
+	    now = sim_now();
+	    s->state[Q].think_cost += (now - before - s->state[Q].think_cost) / 8;
+	    s->sched.used += now - before;
+	    if (now > deadline) {
+		s->sched.late++;
+		s->sched.overrun += now - deadline;
+		if (now - deadline > s->sched.worst)
+		    s->sched.worst = now - deadline;
+		return;
+	    }
+	}
+    }
+
+    tv_now = event_ticks(s);
+    if ((Sint32) (least - tv_now) > 0 && !input_gather(s))
+	idle_wait(least - tv_now, sock);
+}
+
+/***************************************************************************
+ *      turbo_draw()
+ * Draws the boards over from scratch, for turbo without a render thread.
+ ***************************************************************************/
+static void
+turbo_draw(Session *s, SDL_Surface *screen, color_style *cs[], Grid g[], 
+	int NUM_PLAYER, int seconds)
+{
+    int Q, i, j;
+
+    for (Q=0; Q<NUM_PLAYER && Q<s->layout.boards; Q++) {
+	Grid *b = s->state[Q].draw ? &g[Q] : &s->distract[Q];
+
+	SDL_FillRect(screen, &g[Q].board, s->state[Q].draw ? int_solid_black :
+		SDL_MapRGB(screen->format,32,32,32));
+	for (i=0; i<b->w; i++)
+	    for (j=0; j<b->h; j++)
+		GRID_CHANGED(*b,i,j) = 1;
+	draw_grid(screen, cs[Q], b, 1);
+	if (s->state[Q].draw && s->state[Q].falling)
+	    draw_play_piece(screen, cs[Q], &s->state[Q].cp, s->pos[Q].x, s->pos[Q].y,
+		    s->pos[Q].rot, &s->state[Q].cp, s->pos[Q].x, s->pos[Q].y, s->pos[Q].rot);
+	SDL_UpdateSafe(screen, 1, &g[Q].board);
+	draw_score(s, screen, Q);
+    }
+    draw_clock(s, seconds);
+}
+
+/***************************************************************************
+ *      event_frame()
+ * Copies what the boards look like now into the render thread's next
+ * frame and hands it over. Boards past NUM_PLAYER are the network
+ * opponent's, of which we only ever see the squares. In turbo this only
+ * happens every Options.turbo passes, and draws the next pieces too.
+ ***************************************************************************/
+static void
+event_frame(Session *s, SDL_Surface *screen, piece_style *ps,
+	color_style *cs[], Grid g[], int NUM_PLAYER, int sock, Uint32 tv_now, int seconds)
+{
+    Render_Frame *f = render_frame();
+    int Q, i, nboard = min(NUM_PLAYER + (sock != 0), s->layout.boards);
+
+    if (s->turbo.on) {
+	if (s->turbo.passes++ % Options.turbo)
+	    return;
+	s->turbo.drawn++;
+	render_lock();
+	for (Q=0; Q<NUM_PLAYER; Q++)
+	    draw_next_piece(s, screen, ps, cs[Q], &s->state[Q].cp, &s->state[Q].np, Q);
+	render_unlock();
+	if (f == NULL)
+	    turbo_draw(s, screen, cs, g, NUM_PLAYER, seconds);
+    }
+    if (f == NULL)
+	return;
+    f->seconds = seconds;
+    f->at = SDL_GetTicks();
+    for (Q=0; Q<nboard; Q++) {
+	Render_Board *b = &f->b[Q];
+	int n = g[Q].w * g[Q].h;
+
+	for (i=0; i<n; i++)
+	    b->contents[i] = g[Q].contents[i] == REMOVE_ME ? 0 :
+		g[Q].contents[i];
+	memcpy(b->fall, g[Q].fall, n);
+	b->score = s->score[Q];
+	b->blank = -1;
+	b->slide_age = -1;
+	b->piece = 0;
+	if (Q >= NUM_PLAYER)
+	    continue;
+	if (!s->state[Q].draw) {
+	    /* the distraction comes down a row at a time */
+	    int delta = s->state[Q].next_draw - tv_now;
+	    b->blank = g[Q].h - (g[Q].h * delta) / s->state[Q].draw_timeout;
+	    b->blank = max(1, min(b->blank, g[Q].h));
+	    continue;
+	}
+	/* sliding down a row: see tetris_event() */
+	if (s->state[Q].tetris_handling == 3)
+	    b->slide_age = tv_now - s->state[Q].slide_at;
+	if (s->state[Q].falling) {
+	    b->piece = 1;
+	    b->cp = s->state[Q].cp;
+	    b->x = s->pos[Q].x;
+	    b->y = s->pos[Q].y;
+	    b->rot = s->pos[Q].rot;
+	    b->fall_dy = s->turbo.on ? 0 : s->state[Q].fall_dy;
+	    b->fall_age = tv_now - s->state[Q].fell_at;
+	    b->fall_interval = s->state[Q].fall_event_interval;
+	}
+    }
+    render_publish();
+}
+
+/***************************************************************************
+ *      event_play()
+ * The main event-processing dispatch loop: see event_loop().
+ ***************************************************************************/
 #define		NO_PLAYER	0
 #define		HUMAN_PLAYER	1
 #define		AI_PLAYER	2
 #define		NETWORK_PLAYER	3
-int
-event_loop(SDL_Surface *screen, piece_style *ps, color_style *cs[2], 
-	sound_style *ss[2], Grid g[], int level[2], int sock,
+static int
+event_play(Session *s, SDL_Surface *screen, piece_style *ps,
+	color_style *cs[], sound_style *ss[], Grid g[], int level[], int sock,
 	int *seconds_remaining, int time_is_hard_limit,
 	int adjust[], int (*handle)(const SDL_Event *), 
-	int seed, int p1, int p2, AI_Player *AI[2])
+	int seed, int who[], AI_Player *AI[])
 {
     SDL_Event event;
-    Uint32 tv_now, tv_start; 
+    Uint32 tv_now, tv_start, next; 
     int NUM_PLAYER = 0;
     int NUM_KEYBOARD = 0;
+    int keyboard[2];	/* the boards the wasd and the arrow keys move */
     int last_seconds = -1;
     int minimum_fall_event_interval = 100;
     int paused = 0;
@@ -653,104 +1209,122 @@ event_loop(SDL_Surface *screen, piece_style *ps, color_style *cs[2],
     SDL_EnableKeyRepeat(SDL_DEFAULT_REPEAT_DELAY/Options.key_repeat_delay,
 	    SDL_DEFAULT_REPEAT_INTERVAL/2);
 
-    if (gametype != DEMO)
+    if (s->gametype != DEMO)
 	stop_all_playing(); 
 
-    memset(pos, 0, sizeof(pos[0]) * 2);
-    memset(State, 0, sizeof(State[0]) * 2);
-
-    switch (p1) {
-	case NO_PLAYER: Assert(!handle); break;
-	case HUMAN_PLAYER: Assert(!handle); NUM_PLAYER++; NUM_KEYBOARD++; break;
-	case AI_PLAYER: State[0].ai = 1; NUM_PLAYER++; break;
-	case NETWORK_PLAYER: PANIC("Cannot have player 1 over the network!");
-    }
-    switch (p2) {
-	case NO_PLAYER: break;
-	case HUMAN_PLAYER: Assert(!handle); NUM_PLAYER++; NUM_KEYBOARD++; break;
-	case AI_PLAYER: State[1].ai = 1; NUM_PLAYER++; break;
-	case NETWORK_PLAYER: Assert(sock); break;
-    }
-    Assert(NUM_PLAYER >= 1 && NUM_PLAYER <= 2);
-
-    tv_start = tv_now = SDL_GetTicks();
+    memset(s->pos, 0, sizeof(s->pos));
+    memset(s->state, 0, sizeof(s->state));
+
+    /* the local boards come first, the network opponent's (if any) last */
+    Assert(s->boards >= 1 && s->boards <= MAX_PLAYERS);
+    keyboard[0] = keyboard[1] = 0;
+    for (P=0; P<s->boards; P++)
+	switch (who[P]) {
+	    case HUMAN_PLAYER: Assert(!handle); Assert(NUM_KEYBOARD < 2);
+			       Assert(NUM_PLAYER == P);
+			       keyboard[NUM_KEYBOARD++] = P;
+			       NUM_PLAYER++; break;
+	    case AI_PLAYER: Assert(NUM_PLAYER == P);
+			    s->state[P].ai = 1; NUM_PLAYER++; break;
+	    case NETWORK_PLAYER: Assert(sock && P == 1 && s->boards == 2); break;
+	    default: PANIC("Board %d has nobody to play it!", P);
+	}
+    Assert(NUM_PLAYER >= 1);
+    if (NUM_KEYBOARD == 1)	/* both sets of keys move the one player */
+	keyboard[1] = keyboard[0];
+
+    if (s->timers.max == 0)
+	timer_init(&s->timers, MAX_PLAYERS * EVENT_TIMERS);
+    for (i=0; i<s->timers.max; i++)
+	timer_cancel(&s->timers, i);
+    s->paused_ticks = 0;
+    s->input.first = s->input.n = 0;	/* keys meant for the last game */
+
+    tv_start = tv_now = event_ticks(s);
     tv_start += *seconds_remaining * 1000; 
 
     for (P=0; P<NUM_PLAYER; P++) {
-	State[P].falling = 1;
-	State[P].fall_speed = 1;
-	State[P].tetris_handling = 0;
-	State[P].accept_input = 1;
-	State[P].limbo = 0;
-	State[P].draw = 1;
-	State[P].other_in_limbo = 0;
-	State[P].next_draw = 0;
-	State[P].limbo_sent = 0;
-	State[P].cp = generate_piece(ps, cs[P], seed);
-	State[P].np = generate_piece(ps, cs[P], seed+1);
-	State[P].seed = seed+2;
-	State[P].ready_for_fast = 1;
-	State[P].ready_for_rotate = 1;
-
-	draw_next_piece(screen, ps, cs[P], &State[P].cp, &State[P].np, P);
+	s->state[P].falling = 1;
+	s->state[P].fall_speed = 1;
+	s->state[P].tetris_handling = 0;
+	s->state[P].accept_input = 1;
+	s->state[P].limbo = 0;
+	s->state[P].draw = 1;
+	s->state[P].other_in_limbo = 0;
+	s->state[P].next_draw = 0;
+	s->state[P].limbo_sent = 0;
+	s->state[P].target = P;
+	s->state[P].cp = event_piece(s, ps, cs[P], seed);
+	s->state[P].np = event_piece(s, ps, cs[P], seed+1);
+	s->state[P].seed = seed+2;
+	s->state[P].ready_for_fast = 1;
+	s->state[P].ready_for_rotate = 1;
+
+	render_lock();
+	draw_next_piece(s, screen, ps, cs[P], &s->state[P].cp, &s->state[P].np, P);
+	render_unlock();
 
 	adjust[P] = -1;
 
 	if (SPEED_LEVEL(level[P]) <= 7)
-	    State[P].fall_event_interval = 45 - SPEED_LEVEL(level[P]) * 5;
+	    s->state[P].fall_event_interval = 45 - SPEED_LEVEL(level[P]) * 5;
 	else 
-	    State[P].fall_event_interval = 16 - SPEED_LEVEL(level[P]);
-	if (State[P].fall_event_interval < 1)
-	    State[P].fall_event_interval = 1;
+	    s->state[P].fall_event_interval = 16 - SPEED_LEVEL(level[P]);
+	if (s->state[P].fall_event_interval < 1)
+	    s->state[P].fall_event_interval = 1;
 
-	if (State[P].fall_event_interval < minimum_fall_event_interval)
-	    minimum_fall_event_interval = State[P].fall_event_interval;
+	if (s->state[P].fall_event_interval < minimum_fall_event_interval)
+	    minimum_fall_event_interval = s->state[P].fall_event_interval;
 
-	State[P].tv_next_fall = tv_now + State[P].fall_event_interval;
+	timer_set(&s->timers, EVENT_TIMER(P, EVENT_FALL), 
+		tv_now + s->state[P].fall_event_interval);
 
-	if (place_this_piece(P, blockWidth, g)) {
+	if (place_this_piece(s, P, blockWidth, g)) {
 	    /* failed to place piece initially ... */
-	    pos[P].x = pos[P].old_x = g[P].board.x + g[P].board.w / 2;
-	    pos[P].y = pos[P].old_y = g[P].board.y ;
-	    pos[P].rot = pos[P].old_rot = 0;
+	    s->pos[P].x = s->pos[P].old_x = g[P].board.x + g[P].board.w / 2;
+	    s->pos[P].y = s->pos[P].old_y = g[P].board.y ;
+	    s->pos[P].rot = s->pos[P].old_rot = 0;
 	}
 
-	if (State[P].ai) {
-	    State[P].tv_next_ai_think = tv_now;
-	    State[P].tv_next_ai_move = tv_now;
-	    if (gametype == DEMO || gametype == AI_VS_AI ||
+	if (s->state[P].ai) {
+	    AI_Counters mark;
+	    timer_set(&s->timers, EVENT_TIMER(P, EVENT_AI_THINK), tv_now);
+	    timer_set(&s->timers, EVENT_TIMER(P, EVENT_AI_MOVE), tv_now);
+	    if (s->gametype == DEMO || s->gametype == AI_VS_AI ||
 		    AI[P]->delay_factor == 0) {
-		State[P].ai_interval = State[P].fall_event_interval;
-		if (State[P].ai_interval > 15)
-		    State[P].ai_interval = 15;
+		s->state[P].ai_interval = s->state[P].fall_event_interval;
+		if (s->state[P].ai_interval > 15)
+		    s->state[P].ai_interval = 15;
 	    } else {
 		if (AI[P]->delay_factor < 1)
 		    AI[P]->delay_factor = 1;
 		if (AI[P]->delay_factor > 100)
 		    AI[P]->delay_factor = 100;
-		State[P].ai_interval = AI[P]->delay_factor;
+		s->state[P].ai_interval = AI[P]->delay_factor;
 	    }
-	    State[P].ai_state = AI[P]->reset(State[P].ai_state, &g[P]);
+	    ai_counters_mark(&mark);
+	    s->state[P].ai_state = AI[P]->reset(s->state[P].ai_state, &g[P]);
+	    ai_counters_add(&s->state[P].ai_counters, &mark);
+	    sim_set_styles(ps, cs[P]);
+	    s->state[P].book = book_lookup(&g[P], 0, &s->state[P].cp,
+		    &s->state[P].np, &s->state[P].book_goal);
 	}
     }
 
 
-    /* generate the fake-out grid: shown when the opponent does something
-     * good! */
-    distract_grid[0] = generate_board(g[0].w,g[0].h,g[0].h-2);
-    distract_grid[0].board = g[0].board;
-
-    SeedRandom(seed);
-    for (i=0;i<g[0].w;i++)
-	for (j=0;j<g[0].h;j++) {
-	    GRID_SET(distract_grid[0],i,j,ZEROTO(cs[0]->num_color));
-	}
-    if (NUM_PLAYER == 2) {
-	distract_grid[1] = generate_board(g[1].w,g[1].h,g[1].h-2);
-	distract_grid[1].board = g[1].board;
-	for (i=0;i<g[1].w;i++)
-	    for (j=0;j<g[1].h;j++) {
-		GRID_SET(distract_grid[1],i,j,ZEROTO(cs[1]->num_color));
+    /* generate the fake-out grids: shown when an opponent does something
+     * good! (the last game's go first) */
+    for (P=0; P<NUM_PLAYER; P++) {
+	free_board(&s->distract[P]);
+	s->distract[P] = generate_board_r(g[P].w,g[P].h,g[P].h-2,
+		&s->random);
+	s->distract[P].board = g[P].board;
+	if (P == 0)	/* the colors start over from the seed */
+	    s->random = seed;
+	for (i=0;i<g[P].w;i++)
+	    for (j=0;j<g[P].h;j++) {
+		GRID_SET(s->distract[P],i,j,
+			FastRandom_r(&s->random, cs[P]->num_color));
 	    }
     }
 
@@ -762,31 +1336,37 @@ event_loop(SDL_Surface *screen, piece_style *ps, color_style *cs[2],
 		
     }
 
-    draw_clock(0);
+    if (!s->rendering) {
+	draw_clock(s, 0);
 
-    draw_grid(screen,cs[0],&g[0],1);
-    draw_score(screen, 0);
-    if (NUM_PLAYER == 2) {
-	draw_grid(screen,cs[1],&g[1],1);
-	draw_score(screen,1);
+	for (P=0; P<NUM_PLAYER && EVENT_DRAWS(s,P); P++) {
+	    draw_grid(screen,cs[P],&g[P],1);
+	    draw_score(s, screen, P);
+	}
+	if (sock)
+	    draw_score(s, screen, 1);
     }
-    if (sock)
-	draw_score(screen, 1);
 
     /* 
      * Major State-Machine Event Loop
      */
 
     P = 0;
+    event_pass(s, 0);
 
     while (1) { 
 
-	if (NUM_PLAYER == 2)
-	    P = !P;
+	event_pass(s, 1);
+	tv_now = event_ticks(s);
 
-	tv_now = SDL_GetTicks();
+	/* this pass is for the board with the soonest thing due, if
+	 * anything is due yet */
+	if ((i = timer_next(&s->timers, &next)) >= 0 &&
+		(Sint32) (next - tv_now) <= 0)
+	    P = i / EVENT_TIMERS;
 
 	/* update the on-screen clock */
+	event_phase(s, PHASE_DRAW);
 	if (tv_start >= tv_now)
 	    * seconds_remaining = (tv_start - tv_now) / 1000;
 	else
@@ -794,114 +1374,285 @@ event_loop(SDL_Surface *screen, piece_style *ps, color_style *cs[2],
 
 	if (*seconds_remaining != last_seconds && !paused) {
 	    last_seconds = *seconds_remaining;
-	    draw_clock(*seconds_remaining);
-	    if (last_seconds <= 30 && last_seconds >= 0) {
-		play_sound_unless_already_playing(ss[0],SOUND_CLOCK,0);
-		if (NUM_PLAYER == 2) 
-		    play_sound_unless_already_playing(ss[1],SOUND_CLOCK,0);
+	    if (!s->rendering)
+		draw_clock(s, *seconds_remaining);
+	    if (Options.ai_overlay) {
+		render_lock();
+		for (Q=0; Q<NUM_PLAYER; Q++)
+		    if (s->state[Q].ai) 
+			ai_overlay(s, Q, &s->state[Q].ai_counters);
+		render_unlock();
 	    }
+	    if (last_seconds <= 30 && last_seconds >= 0)
+		event_clock_sound(ss, NUM_PLAYER, 1);
 	}
 
 	/* check for time-out */
 	if (*seconds_remaining < 0 && time_is_hard_limit && !paused) { 
-	    play_sound(ss[0],SOUND_LEVELDOWN,0);
-	    adjust[0] = ADJUST_DOWN;
-	    if (NUM_PLAYER == 2) {
-		play_sound(ss[1],SOUND_LEVELDOWN,0);
-		adjust[1] = ADJUST_DOWN;
+	    for (Q=0; Q<NUM_PLAYER; Q++) {
+		play_sound(ss[Q],SOUND_LEVELDOWN,0);
+		adjust[Q] = ADJUST_DOWN;
 	    }
-	    stop_playing_sound(ss[0],SOUND_CLOCK);
-	    if (NUM_PLAYER == 2) stop_playing_sound(ss[1],SOUND_CLOCK);
+	    event_clock_sound(ss, NUM_PLAYER, 0);
 	    return 0;
 	} 
 
+	/* 
+	 * 	User Interface Events: everything that has come in, in order,
+	 * 	each key acted on before the next one is looked at
+	 */
+
+	event_phase(s, PHASE_INPUT);
+	input_gather(s);
+	while (input_next(s, &event)) {
+
+	    /* special menu handling! */
+	    if (handle) {
+		int quit;
+		render_lock();
+		quit = handle(&event);
+		render_unlock();
+		if (quit)
+		    return -1;
+	    } else switch (event.type) {
+		case SDL_KEYUP:
+		    /* "down" will not affect you again until you release
+		     * the down key and press it again */
+		    if (event.key.keysym.sym == SDLK_DOWN)
+			s->state[keyboard[1]].ready_for_fast = 1;
+		    else if (event.key.keysym.sym == SDLK_UP)
+			s->state[keyboard[1]].ready_for_rotate = 1;
+		    else if (event.key.keysym.sym == SDLK_w)
+			s->state[keyboard[0]].ready_for_rotate = 1;
+		    else if (event.key.keysym.sym == SDLK_s)
+			s->state[keyboard[0]].ready_for_fast = 1;
+		    else if (event.key.keysym.sym == SDLK_1) {
+			P = 0;
+			goto you_win;
+		    }
+		    else if (event.key.keysym.sym == SDLK_2) {
+			P = 0;
+			goto you_lose;
+		    }
+		    else if (event.key.keysym.sym == SDLK_3) {
+			P = 1;
+			goto you_win;
+		    }
+		    else if (event.key.keysym.sym == SDLK_4) {
+			P = 1;
+			goto you_lose;
+		    } else if (event.key.keysym.sym == SDLK_p && s->gametype != DEMO) {
+			/* Pause it! */
+			paused = !paused;
+			if (sock) { 
+			    char msg = 'p'; /* WRW: send pause update */
+			    send(sock,&msg,1,0);
+			}
+			do_pause(s, paused, &pause_begin_time);
+		    }
+
+		    break;
+
+		case SDL_KEYDOWN:
+		    {
+			int ks = event.key.keysym.sym;
+			Q = -1;
+
+			/* the arrows are the second keyboard player's */
+			if (ks == SDLK_UP || ks == SDLK_DOWN ||
+				ks == SDLK_RIGHT || ks == SDLK_LEFT) {
+			    Q = keyboard[1];
+			} else if (ks == SDLK_w || ks == SDLK_s ||
+				ks == SDLK_a || ks == SDLK_d) {
+			    Q = keyboard[0];
+			} else if (ks == SDLK_q) {
+			    if (sock == 0) {
+				for (Q=0; Q<NUM_PLAYER; Q++)
+				    adjust[Q] = -1;
+				event_clock_sound(ss, NUM_PLAYER, 0);
+				return -1;
+			    } else {
+				/*
+				Debug("Entering Limbo: adjust down.\n");
+				*/
+				event_retire(s, 0);
+				adjust[0] = ADJUST_DOWN;
+			    }
+			} else if (ks == SDLK_F12) {
+			    event_dump(s);
+			    break;
+			} else if ((ks == SDLK_RETURN) && 
+                            ((event.key.keysym.mod & KMOD_LCTRL) ||
+                             (event.key.keysym.mod & KMOD_RCTRL))) {
+                          render_lock();
+                          SDL_WM_ToggleFullScreen(screen);
+                          render_unlock();
+                          break; 
+                        } else break;
+			if (NUM_KEYBOARD < 1) break;
+			/* humans cannot modify AI moves! */
+
+			Assert(Q >= 0 && Q < NUM_PLAYER && !s->state[Q].ai);
+
+			if (event.key.keysym.sym != SDLK_DOWN &&
+				event.key.keysym.sym != SDLK_s)
+			    s->state[Q].fall_speed = 1;
+			if (!s->state[Q].accept_input) {
+			    break;
+			}
+		    /* only if we are accepting input */
+			switch (event.key.keysym.sym) {
+			    case SDLK_UP: case SDLK_w: 
+				if (s->state[Q].ready_for_rotate)
+				    s->pos[Q].move = MOVE_ROTATE;
+				break;
+			    case SDLK_DOWN: case SDLK_s: 
+				if (s->state[Q].ready_for_fast)
+				    s->pos[Q].move = MOVE_DOWN;
+				break;
+			    case SDLK_LEFT: case SDLK_a: 
+				s->pos[Q].move = MOVE_LEFT; break;
+			    case SDLK_RIGHT: case SDLK_d: 
+				s->pos[Q].move = MOVE_RIGHT; break;
+			    default: 
+				PANIC("unknown keypress");
+			}
+		    }
+		    break;
+		case SDL_QUIT:
+		    Debug("Window-manager exit request.\n");
+		    for (Q=0; Q<NUM_PLAYER; Q++)
+			adjust[Q] = -1;
+		    event_clock_sound(ss, NUM_PLAYER, 0);
+		    return -1;
+		case SDL_SYSWMEVENT:
+		    break;
+	    } /* end: switch (event.type) */
+	    for (i=0; i<NUM_KEYBOARD; i++)
+		do_move(s, keyboard[i], blockWidth, g);
+	} 
+	for (i=0; i<NUM_KEYBOARD; i++)
+	    if (!paused)
+		event_show_piece(s, screen, cs[keyboard[i]], keyboard[i]);
+
 	/*
 	 * 	Visual Events
 	 */
-	if (!State[P].draw && tv_now > State[P].next_draw && !paused) {
+	event_phase(s, PHASE_DRAW);
+	if (s->state[P].draw)
+	    timer_cancel(&s->timers, EVENT_TIMER(P, EVENT_BLANK));
+	else if (!timer_due(&s->timers, EVENT_TIMER(P, EVENT_BLANK), tv_now) ||
+		paused)
+	    ;	/* nothing to do yet */
+	else if (tv_now > s->state[P].next_draw) {
 	    int i,j;
-	    State[P].draw = 1;
+	    s->state[P].draw = 1;
+	    timer_cancel(&s->timers, EVENT_TIMER(P, EVENT_BLANK));
 	    for (i=0;i<g[P].w;i++)
 		for (j=0;j<g[P].h;j++) {
 		    GRID_CHANGED(g[P],i,j) = 1;
 		    if (GRID_CONTENT(g[P],i,j) == 0)
 			GRID_SET(g[P],i,j,REMOVE_ME);
 		}
-	    draw_grid(screen,cs[P],&g[P],1);
-	} else if (!State[P].draw) {
-	    int delta = State[P].next_draw - tv_now;
-	    int amt = g[P].h - ((g[P].h * delta) / State[P].draw_timeout);
-	    int i,j;
-	    j = amt - 1;
-	    if (j < 0) j = 0;
-	    for (i=0;i<g[P].w;i++)
-		GRID_CHANGED(distract_grid[P],i,j) = 1;
-	    draw_grid(screen,cs[P],&distract_grid[P],1);
+	    draw_grid(screen,cs[P],&g[P],EVENT_DRAWS(s,P));
+	} else {
+	    /* unless we draw it, the rows come down by themselves (or
+	     * unseen): we need only come back when it is over */
+	    Uint32 next = s->state[P].next_draw + 1;
+
+	    if (EVENT_DRAWS(s,P)) {
+		int delta = s->state[P].next_draw - tv_now;
+		int amt = g[P].h - ((g[P].h * delta) / s->state[P].draw_timeout);
+		int i,j;
+		j = amt - 1;
+		if (j < 0) j = 0;
+		for (i=0;i<g[P].w;i++)
+		    GRID_CHANGED(s->distract[P],i,j) = 1;
+		draw_grid(screen,cs[P],&s->distract[P],1);
+		if (next - tv_now > s->state[P].draw_timeout / g[P].h)
+		    next = tv_now + max(1, s->state[P].draw_timeout / g[P].h);
+	    }
+	    timer_set(&s->timers, EVENT_TIMER(P, EVENT_BLANK), next);
 	}
 
 	/* 
 	 *	Falling Events
 	 */
 
-	if (State[P].falling && tv_now >= State[P].tv_next_fall && !paused) {
-	    int try;
+	if (!s->state[P].falling)
+	    timer_cancel(&s->timers, EVENT_TIMER(P, EVENT_FALL));
+	else if (timer_due(&s->timers, EVENT_TIMER(P, EVENT_FALL), tv_now) &&
+		!paused) {
+	    int try, steps = 0;
 	    int we_fell = 0;
+	    Uint32 next = timer_when(&s->timers, EVENT_TIMER(P, EVENT_FALL));
 
+	    event_phase(s, PHASE_FALL);
+	    if (!s->turbo.on)	/* where it is never late */
+		latency_add(&s->phases.hist[PHASE_LATE], (tv_now - next) * 1000);
 #if DEBUG
-	    if (tv_now > State[P].tv_next_fall) 
-		Debug("Fall: %d %d\n", tv_now, tv_now - State[P].tv_next_fall);
+	    if (tv_now > next) 
+		Debug("Fall: %d %d\n", tv_now, tv_now - next);
 #endif
 
-	    /* ok, we had a falling event */
+	    /* ok, we had a falling event: one step for every one due */
+	    s->state[P].fall_dy = 0;
 	    do {
-		State[P].tv_next_fall += State[P].fall_event_interval;
-	    } while (State[P].tv_next_fall <= tv_now); 
-
-	    for (try = State[P].fall_speed; try > 0; try--)
-		if (valid_screen_position(&State[P].cp,blockWidth,&g[P],pos[P].rot,pos[P].x,pos[P].y+try)) {
-		    pos[P].y += try;
-		    State[P].fall_speed = try;
-		    try = 0;
-		    we_fell = 1;
-		}
+		we_fell = 0;
+		for (try = s->state[P].fall_speed; try > 0; try--)
+		    if (valid_screen_position(&s->state[P].cp,blockWidth,&g[P],s->pos[P].rot,s->pos[P].x,s->pos[P].y+try)) {
+			s->pos[P].y += try;
+			s->state[P].fall_dy += try;
+			s->state[P].fall_speed = try;
+			try = 0;
+			we_fell = 1;
+		    }
+		s->state[P].fell_at = next;
+		next += s->state[P].fall_event_interval;
+	    } while (we_fell && (Sint32) (next - tv_now) <= 0 &&
+		    ++steps < EVENT_CATCH_UP);
+	    if ((Sint32) (next - tv_now) <= 0)	/* too far behind: let it go */
+		next = tv_now + s->state[P].fall_event_interval;
+	    timer_set(&s->timers, EVENT_TIMER(P, EVENT_FALL), next);
+
 	    if (!we_fell) {
-		if (!State[P].collide_time) {
-		    State[P].collide_time = tv_now + 
+		if (!s->state[P].collide_time) {
+		    s->state[P].collide_time = tv_now + 
 			(Options.long_settle_delay ? 400 : 200);
 		    continue; /* don't fall */
 		}
-		if (tv_now < State[P].collide_time)
+		if (tv_now < s->state[P].collide_time)
 		    continue; /* don't fall */
 		/* do fall! */
 	    } else continue;
 	    /* collided! */
 
-	    State[P].collide_time = 0;
+	    s->state[P].collide_time = 0;
 
 	    play_sound(ss[P],SOUND_THUD,0);
 
 	    /* this would only come into play if you were halfway
 	     * between levels and suddenly someone added garbage */
-	    while (!valid_screen_position(&State[P].cp,blockWidth,&g[P],pos[P].rot,pos[P].x,pos[P].y) && pos[P].y > 0) 
-		pos[P].y--;
+	    while (!valid_screen_position(&s->state[P].cp,blockWidth,&g[P],s->pos[P].rot,s->pos[P].x,s->pos[P].y) && s->pos[P].y > 0) 
+		s->pos[P].y--;
 
-	    if (State[P].draw) 
-		draw_play_piece(screen, cs[P], &State[P].cp, pos[P].old_x, pos[P].old_y, pos[P].old_rot,
-			&State[P].cp, pos[P].x, pos[P].y, pos[P].rot);
+	    if (s->state[P].draw && EVENT_DRAWS(s,P)) 
+		draw_play_piece(screen, cs[P], &s->state[P].cp, s->pos[P].old_x, s->pos[P].old_y, s->pos[P].old_rot,
+			&s->state[P].cp, s->pos[P].x, s->pos[P].y, s->pos[P].rot);
 
-	    if (State[P].cp.special != No_Special) {
+	    screen_to_exact_grid_coords(&g[P], blockWidth, s->pos[P].x, s->pos[P].y,
+		    &s->state[P].last_drop.row, &s->state[P].last_drop.col);
+	    s->state[P].last_drop.rot = s->pos[P].rot;
+	    if (s->state[P].cp.special != No_Special) {
 		/* handle special powers! */
-		int row, col;
-		screen_to_exact_grid_coords(&g[P], blockWidth, 
-			pos[P].x, pos[P].y, &row, &col);
-		handle_special(&State[P].cp, row, col, pos[P].rot, &g[P], ss[P]);
+		handle_special(&s->state[P].cp, s->state[P].last_drop.row,
+			s->state[P].last_drop.col, s->pos[P].rot, &g[P], ss[P]);
 	    } else { 
 		/* paste the piece on the board */
-		int row, col;
-		screen_to_exact_grid_coords(&g[P], blockWidth, 
-			pos[P].x, pos[P].y, &row, &col);
-		paste_on_board(&State[P].cp, col, row, pos[P].rot, &g[P]);
+		paste_on_board(&s->state[P].cp, s->state[P].last_drop.col,
+			s->state[P].last_drop.row, s->pos[P].rot, &g[P]);
 	    }
+	    s->state[P].pieces++;
 
 	    if (sock) { 
 		char msg = 'c'; /* WRW: send update */
@@ -909,83 +1660,115 @@ event_loop(SDL_Surface *screen, piece_style *ps, color_style *cs[2],
 		send(sock,g[P].contents,sizeof(*g[P].contents)
 			* g[P].h * g[P].w,0); 
 	    }
-	    draw_grid(screen,cs[P],&g[P],State[P].draw);
+	    draw_grid(screen,cs[P],&g[P],s->state[P].draw && EVENT_DRAWS(s,P));
 
 	    /* state change */
-	    State[P].falling = 0;
-	    State[P].fall_speed = 0;
-	    State[P].tetris_handling = 1;
-	    State[P].accept_input = 0;
-	    State[P].tv_next_tetris = tv_now;
+	    s->state[P].falling = 0;
+	    s->state[P].fall_speed = 0;
+	    s->state[P].tetris_handling = 1;
+	    s->state[P].accept_input = 0;
+	    timer_set(&s->timers, EVENT_TIMER(P, EVENT_TETRIS), tv_now);
 	}
 	/* 
 	 *	Tetris Clear Events
 	 */
-	if (State[P].tetris_handling != 0 && tv_now >= State[P].tv_next_tetris && !paused) {
-	    int blank = 0, garbage = 0;
-
+	if (s->state[P].tetris_handling == 0)
+	    timer_cancel(&s->timers, EVENT_TIMER(P, EVENT_TETRIS));
+	else if (timer_due(&s->timers, EVENT_TIMER(P, EVENT_TETRIS), tv_now) &&
+		!paused) {
+	    int steps = 0;
+	    Uint32 next = timer_when(&s->timers, EVENT_TIMER(P, EVENT_TETRIS));
+
+	    event_phase(s, PHASE_TETRIS);
 #if DEBUG 
-	    if (tv_now >= State[P].tv_next_tetris) 
-		Debug("Tetr: %d %d (%d)\n", tv_now, tv_now -
-			State[P].tv_next_tetris, State[P].tetris_handling);
+	    Debug("Tetr: %d %d (%d)\n", tv_now, tv_now - next,
+		    s->state[P].tetris_handling);
 #endif
 
-	    State[P].tetris_handling = tetris_event(
-		    &State[P].tetris_event_interval, 
-		    State[P].tetris_handling, screen, ps, cs[P], ss[P], &g[P], 
-		    level[P], minimum_fall_event_interval, sock, State[P].draw,
-		    &blank, &garbage, P);
-
-	    if (NUM_PLAYER == 2) {
-		if (blank)
-		    do_blank(screen, ss, g, !P);
-		if (garbage) {
-		    add_garbage(&g[!P]);
-		    play_sound(ss[!P],SOUND_GARBAGE1,1);
-		    draw_grid(screen,cs[!P],&g[!P],State[!P].draw);
+	    /* every step that is due, as for falls */
+	    do {
+		int blank = 0, garbage = 0;
+
+		s->state[P].tetris_handling = tetris_event(s, 
+			&s->state[P].tetris_event_interval, 
+			s->state[P].tetris_handling, screen, ps, cs[P], ss[P],
+			&g[P], level[P], minimum_fall_event_interval, sock,
+			s->state[P].draw && EVENT_DRAWS(s,P),
+			&blank, &garbage, P, next);
+
+		if (NUM_PLAYER >= 2 && (blank || garbage) &&
+			(Q = event_target(s, P, NUM_PLAYER, adjust)) >= 0) {
+		    if (blank)
+			do_blank(s, screen, ss, g, Q);
+		    if (garbage) {
+			add_garbage_r(&g[Q], &s->random);
+			play_sound(ss[Q],SOUND_GARBAGE1,1);
+			draw_grid(screen,cs[Q],&g[Q],
+				s->state[Q].draw && EVENT_DRAWS(s,Q));
+		    }
 		}
-	    }
-
-	    tv_now = SDL_GetTicks();
-	    do {  /* just in case we're *way* behind */
-		State[P].tv_next_tetris += State[P].tetris_event_interval;
-	    } while (State[P].tv_next_tetris < tv_now); 
-
-	    if (State[P].tetris_handling == 0) { /* state change */
+		next += s->state[P].tetris_event_interval;
+	    } while (s->state[P].tetris_handling && (Sint32) (next - tv_now) <= 0
+		    && ++steps < EVENT_CATCH_UP);
+
+	    tv_now = event_ticks(s);
+	    if ((Sint32) (next - tv_now) < 0)	/* too far behind */
+		next = tv_now;
+	    if (s->state[P].tetris_handling)
+		timer_set(&s->timers, EVENT_TIMER(P, EVENT_TETRIS), next);
+	    else
+		timer_cancel(&s->timers, EVENT_TIMER(P, EVENT_TETRIS));
+
+	    if (s->state[P].tetris_handling == 0) { /* state change */
 		/* Time for your next piece ...
 		 * Yujia points out that we should try a little harder to
 		 * fit your piece on the board. 
 		 */
-		State[P].cp = State[P].np;
-		State[P].np = generate_piece(ps, cs[P], State[P].seed++);
-		draw_next_piece(screen, ps, cs[P], 
-			&State[P].cp, &State[P].np, P);
+		s->state[P].cp = s->state[P].np;
+		s->state[P].np = event_piece(s, ps, cs[P], s->state[P].seed++);
+		if (!s->turbo.on) {
+		    render_lock();
+		    draw_next_piece(s, screen, ps, cs[P], 
+			    &s->state[P].cp, &s->state[P].np, P);
+		    render_unlock();
+		}
 
-		if (place_this_piece(P, blockWidth, g)) {
+		if (place_this_piece(s, P, blockWidth, g)) {
 		    /* failed to place piece */
 you_lose: 
 		    play_sound(ss[P],SOUND_LEVELDOWN,0);
 		    adjust[P] = ADJUST_DOWN;
-		    if (NUM_PLAYER == 2 && !sock)
-			adjust[!P] = ADJUST_SAME;
+		    if (sock == 0 && event_standing(NUM_PLAYER, adjust) > 1) {
+			/* knocked out: the rest play on without us */
+			event_retire(s, P);
+			continue;
+		    }
 		    if (sock == 0) {
-			stop_playing_sound(ss[0],SOUND_CLOCK);
-			if (NUM_PLAYER == 2) stop_playing_sound(ss[1],SOUND_CLOCK);
+			/* the last one standing has won */
+			for (Q=0; Q<NUM_PLAYER; Q++)
+			    if (adjust[Q] == -1)
+				adjust[Q] = ADJUST_SAME;
+			event_clock_sound(ss, NUM_PLAYER, 0);
 			return 0;
 		    }
 		    /*
 		    Debug("Entering Limbo: adjust down.\n");
 		    */
-		    State[P].falling = 0;
-		    State[P].fall_speed = 0;
-		    State[P].tetris_handling = 0;
-		    State[P].accept_input = 0;
-		    State[P].limbo = 1;
+		    event_retire(s, P);
 		} else {
 		    int x,y,count = 0;
-		    if (State[P].ai) 
-			State[P].ai_state =
-			    AI[P]->reset(State[P].ai_state, &g[P]);
+		    if (s->state[P].ai) {
+			AI_Counters mark;
+			ai_counters_mark(&mark);
+			s->state[P].ai_state = ai_new_piece(AI[P],
+				s->state[P].ai_state, &g[P], &s->state[P].cp,
+				&s->state[P].last_drop);
+			ai_counters_add(&s->state[P].ai_counters, &mark);
+			sim_set_styles(ps, cs[P]);
+			s->state[P].book = book_lookup(&g[P],
+				s->state[P].pieces, &s->state[P].cp,
+				&s->state[P].np, &s->state[P].book_goal);
+		    }
 		    for (y=0;y<g->h;y++)
 			for (x=0;x<g->w;x++)
 			    if (GRID_CONTENT(g[P],x,y) == 1)
@@ -993,36 +1776,31 @@ you_lose:
 		    if (count == 0) {
 you_win: 
 			play_sound(ss[P],SOUND_LEVELUP,256);
-			if (*seconds_remaining <= 0) { 
-			    adjust[P] = ADJUST_SAME;
-			    if (NUM_PLAYER == 2 && !sock)
-				adjust[!P] = ADJUST_DOWN;
-			} else {
-			    adjust[P] = ADJUST_UP;
-			    if (NUM_PLAYER == 2 && !sock)
-				adjust[!P] = ADJUST_SAME;
-			}
+			for (Q=0; Q<NUM_PLAYER && !sock; Q++)
+			    if (Q != P && adjust[Q] == -1)
+				adjust[Q] = *seconds_remaining <= 0 ?
+				    ADJUST_DOWN : ADJUST_SAME;
+			adjust[P] = *seconds_remaining <= 0 ?
+			    ADJUST_SAME : ADJUST_UP;
 			if (sock == 0) {
-			    stop_playing_sound(ss[0],SOUND_CLOCK);
-			    if (NUM_PLAYER == 2) stop_playing_sound(ss[1],SOUND_CLOCK);
+			    event_clock_sound(ss, NUM_PLAYER, 0);
 			    return 0;
 			}
 			/*
 			Debug("Entering Limbo: you win, adjust ?/?.\n");
 			*/
-			State[P].falling = 0;
-			State[P].fall_speed = 0;
-			State[P].tetris_handling = 0;
-			State[P].accept_input = 0;
-			State[P].limbo = 1;
+			event_retire(s, P);
 		    } else {
 			/* keep playing */
-			State[P].falling = 1;
-			State[P].fall_speed = 1;
-			State[P].tetris_handling = 0;
-			State[P].accept_input = 1;
-			State[P].tv_next_fall = SDL_GetTicks() + 
-			    State[P].fall_event_interval;
+			s->state[P].falling = 1;
+			s->state[P].fall_speed = 1;
+			s->state[P].tetris_handling = 0;
+			s->state[P].accept_input = 1;
+			timer_set(&s->timers, EVENT_TIMER(P, EVENT_FALL),
+				event_ticks(s) + s->state[P].fall_event_interval);
+			if (s->state[P].ai)
+			    timer_set(&s->timers, EVENT_TIMER(P, EVENT_AI_MOVE),
+				    tv_now);
 		    }
 		}
 	    } 
@@ -1031,273 +1809,97 @@ you_win:
 	/* 
 	 *	AI Events
 	 */
-	if (State[P].ai && tv_now >= State[P].tv_next_ai_think && !paused) {
+	if (s->state[P].ai && !paused &&
+		timer_due(&s->timers, EVENT_TIMER(P, EVENT_AI_THINK), tv_now)) {
 	    int row, col;
+	    Uint32 next = timer_when(&s->timers, EVENT_TIMER(P, EVENT_AI_THINK));
 #ifdef AI_THINK_TIME
-	    Uint32 tv_before = SDL_GetTicks();
+	    Uint32 tv_before = event_ticks(s);
 #endif
 
-	    screen_to_grid_coords(&g[P], blockWidth, pos[P].x, pos[P].y, &row, &col);
+	    event_phase(s, PHASE_THINK);
+	    screen_to_grid_coords(&g[P], blockWidth, s->pos[P].x, s->pos[P].y, &row, &col);
 
 	    /* simulate blanked screens */
-	    if (State[P].draw) 
-		AI[P]->think(State[P].ai_state, &g[P], &State[P].cp, &State[P].np, col, row, pos[P].rot);
+	    if (s->state[P].draw && !s->state[P].book) {
+		sim_set_styles(ps, cs[P]);
+		ai_think(AI[P], &s->state[P].ai_counters, s->state[P].ai_state,
+			&g[P], &s->state[P].cp, &s->state[P].np, col, row, s->pos[P].rot);
+	    }
 
 #ifdef AI_THINK_TIME
-	    tv_now = SDL_GetTicks();
+	    tv_now = event_ticks(s);
 	    if (tv_now > tv_before + 1)
 		Debug("AI[%s] took too long in think() [%d ticks].\n",
 			AI[P]->name, tv_now - tv_before);
 #endif
 
 	    do {  /* just in case we're *way* behind */
-		State[P].tv_next_ai_think += 
-		    State[P].ai_interval;
-	    } while (State[P].tv_next_ai_think < tv_now); 
+		next += s->state[P].ai_interval;
+	    } while ((Sint32) (next - tv_now) < 0); 
+	    timer_set(&s->timers, EVENT_TIMER(P, EVENT_AI_THINK), next);
 	}
-	if (State[P].ai && State[P].accept_input &&
-		tv_now >= State[P].tv_next_ai_move && !paused) {
-	    int row, col;
+	if (!s->state[P].ai || !s->state[P].accept_input)
+	    timer_cancel(&s->timers, EVENT_TIMER(P, EVENT_AI_MOVE));
+	else if (timer_due(&s->timers, EVENT_TIMER(P, EVENT_AI_MOVE), tv_now) &&
+		!paused) {
+	    Uint32 next = timer_when(&s->timers, EVENT_TIMER(P, EVENT_AI_MOVE));
+	    int row, col, n = 0;
+	    AI_Placement goal;
+	    AI_Plan plan;
+	    AI_Counters mark;
+	    /* pixels we fall between two of these */
+	    int fall = (s->state[P].ai_interval * 5 + 
+		    s->state[P].fall_event_interval - 1) /
+		s->state[P].fall_event_interval * s->state[P].fall_speed;
 #ifdef AI_THINK_TIME
-	    Uint32 tv_before = SDL_GetTicks();
+	    Uint32 tv_before = event_ticks(s);
 #endif
 
-	    screen_to_grid_coords(&g[P], blockWidth, pos[P].x, pos[P].y, &row, &col);
-	    pos[P].move =
-		AI[P]->move(State[P].ai_state, &g[P], &State[P].cp, &State[P].np, 
-			col, row, pos[P].rot);
+	    event_phase(s, PHASE_MOVE);
+	    screen_to_grid_coords(&g[P], blockWidth, s->pos[P].x, s->pos[P].y, &row, &col);
+	    ai_counters_mark(&mark);
+	    if (s->state[P].book) {
+		n = ai_plan(&g[P], &s->state[P].cp, blockWidth, col,
+			s->pos[P].y - g[P].board.y, s->pos[P].rot, 
+			&s->state[P].book_goal, fall, &plan);
+		if (n < 0)	/* the AI will have to think after all */
+		    s->state[P].book = 0;
+	    }
+	    if (s->state[P].book)
+		s->pos[P].move = n > 0 ? plan.move[0] : MOVE_DOWN;
+	    else if (AI[P]->target && AI[P]->target(s->state[P].ai_state, &g[P],
+			&s->state[P].cp, row, &goal) && 
+		    ai_plan(&g[P], &s->state[P].cp, blockWidth, col,
+			s->pos[P].y - g[P].board.y, s->pos[P].rot, &goal, fall,
+			&plan) > 0)
+		s->pos[P].move = plan.move[0];
+	    else 
+		s->pos[P].move =
+		    AI[P]->move(s->state[P].ai_state, &g[P], &s->state[P].cp, &s->state[P].np, 
+			    col, row, s->pos[P].rot);
+	    ai_counters_add(&s->state[P].ai_counters, &mark);
 #ifdef AI_THINK_TIME
-	    tv_now = SDL_GetTicks();
+	    tv_now = event_ticks(s);
 	    if (tv_now > tv_before + 1)
 		Debug("AI[%s] took too long in move() [%d ticks].\n",
 			AI[P]->name, tv_now - tv_before);
 #endif
 
 	    do {  /* just in case we're *way* behind */
-		State[P].tv_next_ai_move += 
-		    State[P].ai_interval * 5;
-	    } while (State[P].tv_next_ai_move < tv_now); 
+		next += s->state[P].ai_interval * 5;
+	    } while ((Sint32) (next - tv_now) < 0); 
+	    timer_set(&s->timers, EVENT_TIMER(P, EVENT_AI_MOVE), next);
 	}
 
-	/* 
-	 * 	User Interface Events 
-	 */
-
-	if (SDL_PollEvent(&event)) {
-
-	    /* special menu handling! */
-	    if (handle) {
-		if (handle(&event)) {
-		    return -1;
-		}
-	    } else switch (event.type) {
-		case SDL_KEYUP:
-		    /* "down" will not affect you again until you release
-		     * the down key and press it again */
-		    if (event.key.keysym.sym == SDLK_DOWN) {
-			State[1].ready_for_fast = 1;
-			if (NUM_KEYBOARD == 1)
-			    State[0].ready_for_fast = 1;
-		    }
-		    else if (event.key.keysym.sym == SDLK_UP) {
-			State[1].ready_for_rotate = 1;
-			if (NUM_KEYBOARD == 1)
-			    State[0].ready_for_rotate = 1;
-		    }
-		    else if (event.key.keysym.sym == SDLK_w)
-			State[0].ready_for_rotate = 1;
-		    else if (event.key.keysym.sym == SDLK_s)
-			State[0].ready_for_fast = 1;
-		    else if (event.key.keysym.sym == SDLK_1) {
-			P = 0;
-			goto you_win;
-		    }
-		    else if (event.key.keysym.sym == SDLK_2) {
-			P = 0;
-			goto you_lose;
-		    }
-		    else if (event.key.keysym.sym == SDLK_3) {
-			P = 1;
-			goto you_win;
-		    }
-		    else if (event.key.keysym.sym == SDLK_4) {
-			P = 1;
-			goto you_lose;
-		    } else if (event.key.keysym.sym == SDLK_p && gametype != DEMO) {
-			/* Pause it! */
-			tv_now = SDL_GetTicks();
-			paused = !paused;
-			if (sock) { 
-			    char msg = 'p'; /* WRW: send pause update */
-			    send(sock,&msg,1,0);
-			}
-			do_pause(paused, tv_now, &pause_begin_time, &tv_start);
-		    }
-
-		    break;
-
-		case SDL_KEYDOWN:
-		    {
-			int ks = event.key.keysym.sym;
-			Q = -1;
-
-			/* keys for P=0 */
-			if (ks == SDLK_UP || ks == SDLK_DOWN ||
-				ks == SDLK_RIGHT || ks == SDLK_LEFT) {
-			    Q = 1;
-			} else if (ks == SDLK_w || ks == SDLK_s ||
-				ks == SDLK_a || ks == SDLK_d) {
-			    Q = 0;
-			} else if (ks == SDLK_q) {
-			    if (sock == 0) {
-				adjust[0] = -1;
-				if (NUM_PLAYER == 2)
-				    adjust[1] = -1;
-				stop_playing_sound(ss[0],SOUND_CLOCK);
-				if (NUM_PLAYER == 2) stop_playing_sound(ss[1],SOUND_CLOCK);
-				return -1;
-			    } else {
-				/*
-				Debug("Entering Limbo: adjust down.\n");
-				*/
-				State[0].falling = 0;
-				State[0].fall_speed = 0;
-				State[0].tetris_handling = 0;
-				State[0].accept_input = 0;
-				State[0].limbo = 1;
-				adjust[0] = ADJUST_DOWN;
-			    }
-			} else if ((ks == SDLK_RETURN) && 
-                            ((event.key.keysym.mod & KMOD_LCTRL) ||
-                             (event.key.keysym.mod & KMOD_RCTRL))) {
-                          SDL_WM_ToggleFullScreen(screen);
-                          break; 
-                        } else break;
-			if (NUM_KEYBOARD == 1) Q = 0;
-			else if (NUM_KEYBOARD < 1) break;
-			/* humans cannot modify AI moves! */
-
-			Assert(Q == 0 || Q == 1);
-
-			if (event.key.keysym.sym != SDLK_DOWN &&
-				event.key.keysym.sym != SDLK_s)
-			    State[Q].fall_speed = 1;
-			if (!State[Q].accept_input) {
-			    break;
-			}
-		    /* only if we are accepting input */
-			switch (event.key.keysym.sym) {
-			    case SDLK_UP: case SDLK_w: 
-				if (State[Q].ready_for_rotate)
-				    pos[Q].move = MOVE_ROTATE;
-				break;
-			    case SDLK_DOWN: case SDLK_s: 
-				if (State[Q].ready_for_fast)
-				    pos[Q].move = MOVE_DOWN;
-				break;
-			    case SDLK_LEFT: case SDLK_a: 
-				pos[Q].move = MOVE_LEFT; break;
-			    case SDLK_RIGHT: case SDLK_d: 
-				pos[Q].move = MOVE_RIGHT; break;
-			    default: 
-				PANIC("unknown keypress");
-			}
-		    }
-		    break;
-		case SDL_QUIT:
-		    Debug("Window-manager exit request.\n");
-		    adjust[0] = -1;
-		    if (NUM_PLAYER == 2)
-			adjust[1] = -1;
-		    stop_playing_sound(ss[0],SOUND_CLOCK);
-		    if (NUM_PLAYER == 2) stop_playing_sound(ss[1],SOUND_CLOCK);
-		    return -1;
-		case SDL_SYSWMEVENT:
-		    break;
-	    } /* end: switch (event.type) */
-	} 
 
 	/* 
-	 *	Handle Movement 
+	 *	Handle Movement (the AI's)
 	 */
-	for (Q=0;Q<NUM_PLAYER;Q++) {
-	    switch (pos[Q].move) {
-		case MOVE_ROTATE: 
-		    State[Q].ready_for_rotate = 0;
-		    if (valid_screen_position(&State[Q].cp,blockWidth,&g[Q],(pos[Q].rot+1)%4,pos[Q].x,pos[Q].y)) {
-			pos[Q].rot = (pos[Q].rot+1)%4; 
-			State[Q].collide_time = 0;
-		    } else if (valid_screen_position(&State[Q].cp,blockWidth,&g[Q],(pos[Q].rot+1)%4,
-				pos[Q].x-blockWidth,pos[Q].y)) {
-			pos[Q].rot = (pos[Q].rot+1)%4; 
-			pos[Q].x -= blockWidth;
-			State[Q].collide_time = 0;
-		    } else if (valid_screen_position(&State[Q].cp,blockWidth,&g[Q],(pos[Q].rot+1)%4,
-				pos[Q].x+blockWidth,pos[Q].y)) {
-			pos[Q].rot = (pos[Q].rot+1)%4; 
-			pos[Q].x += blockWidth;
-			State[Q].collide_time = 0;
-		    } else if (valid_screen_position(&State[Q].cp,blockWidth,&g[Q],(pos[Q].rot+1)%4,
-				pos[Q].x,pos[Q].y+blockWidth)) {
-			pos[Q].rot = (pos[Q].rot+1)%4; 
-			pos[Q].y += blockWidth;
-			State[Q].collide_time = 0;
-		    } else if (Options.upward_rotation &&
-			    valid_screen_position(&State[Q].cp,blockWidth,
-				&g[Q],(pos[Q].rot+1)%4, pos[Q].x,
-				pos[Q].y-blockWidth)) {
-			pos[Q].rot = (pos[Q].rot+1)%4; 
-			pos[Q].y -= blockWidth;
-			State[Q].collide_time = 0;
-		    }
-		    pos[Q].move = MOVE_NONE;
-		    break;
-		case MOVE_LEFT:
-		    for (i=0;i<10;i++) 
-			if (valid_screen_position(&State[Q].cp,blockWidth,
-				    &g[Q],pos[Q].rot,
-				    pos[Q].x-blockWidth,
-				    pos[Q].y+i)) {
-			    pos[Q].x -= blockWidth;
-			    pos[Q].y += i;
-			    State[Q].collide_time = 0;
-			    break;
-			}
-		    pos[Q].move = MOVE_NONE;
-		    break;
-		case MOVE_RIGHT:
-		    for (i=0;i<10;i++)
-			if (valid_screen_position(&State[Q].cp,blockWidth,&g[Q],pos[Q].rot,
-				    pos[Q].x+blockWidth,pos[Q].y+i)){
-			    pos[Q].x += blockWidth;
-			    pos[Q].y += i;
-			    State[Q].collide_time = 0;
-			    break;
-			}
-		    pos[Q].move = MOVE_NONE;
-		    break;
-		case MOVE_DOWN:
-		    if (valid_screen_position(&State[Q].cp,blockWidth,&g[Q],pos[Q].rot,
-				pos[Q].x, pos[Q].y+blockWidth))
-			pos[Q].y+=blockWidth;
-		    State[Q].fall_speed = 20;
-		    State[Q].ready_for_fast = 0;
-		    pos[Q].move = MOVE_NONE;
-		    break;
-		default: 
-		    break;
-	    }
-	} /* endof: for each player, check move */
-
-
-	if (State[P].falling && !paused) { 
-	    if (State[P].draw) 
-		if (pos[P].old_x != pos[P].x || pos[P].old_y != pos[P].y || pos[P].old_rot != pos[P].rot) {
-		    draw_play_piece(screen, cs[P], &State[P].cp, pos[P].old_x, pos[P].old_y, pos[P].old_rot,
-			    &State[P].cp, pos[P].x, pos[P].y, pos[P].rot);
-		    pos[P].old_x = pos[P].x; pos[P].old_y = pos[P].y; pos[P].old_rot = pos[P].rot;
-		}
-	}
+	event_phase(s, PHASE_DRAW);
+	do_move(s, P, blockWidth, g);
+	if (!paused)
+	    event_show_piece(s, screen, cs[P], P);
 
 	/* network connection */
 	if (sock) {
@@ -1305,6 +1907,7 @@ you_win:
 	    struct timeval timeout = { 0, 0 };
 	    int retval;
 
+	    event_phase(s, PHASE_NET);
 	    Assert(P == 0);
 
 	    do { 
@@ -1326,29 +1929,30 @@ you_win:
 		    } else {
 			switch (msg) {
 			    case 'b': 
-				do_blank(screen, ss, g, P);
+				do_blank(s, screen, ss, g, P);
 			    break;
 			    case 'p':
 				paused = !paused;
-				tv_now = SDL_GetTicks();
-				do_pause(paused, tv_now, &pause_begin_time, &tv_start);
+				do_pause(s, paused, &pause_begin_time);
 			    break; 
 
 			    case ADJUST_DOWN: /* other play in limbo */
 			    case ADJUST_SAME:
 			    case ADJUST_UP:
-				State[P].other_in_limbo = 1;
+				s->state[P].other_in_limbo = 1;
 				adjust[!P] = msg;
 				break;
 
 			    case 'g': 
-				add_garbage(&g[P]);
+				add_garbage_r(&g[P], &s->random);
 				play_sound(ss[P],SOUND_GARBAGE1,1);
-				draw_grid(screen,cs[P],&g[P],State[P].draw);
+				draw_grid(screen,cs[P],&g[P],
+					s->state[P].draw && EVENT_DRAWS(s,P));
 				      break;
 			    case 's':
-				  recv(sock,(char *)&Score[1], sizeof(Score[1]),0);
-				  draw_score(screen, 1);
+				  recv(sock,(char *)&s->score[1], sizeof(s->score[1]),0);
+				  if (!s->rendering)
+				      draw_score(s, screen, 1);
 				  break;
 			    case 'c':  { int i,j;
 				      memcpy(g[!P].temp,g[!P].contents,
@@ -1367,7 +1971,7 @@ you_win:
 						  if (i < g[!P].h-1) GRID_CHANGED(g[!P],i,j+1) = 1;
 						  if (GRID_CONTENT(g[!P],i,j) == 0) GRID_SET(g[!P],i,j,REMOVE_ME);
 						  }
-				      draw_grid(screen,cs[!P],&g[!P],1);
+				      draw_grid(screen,cs[!P],&g[!P],EVENT_DRAWS(s,!P));
 				       }
 				      break;
 			    default: break;
@@ -1375,20 +1979,19 @@ you_win:
 		    }
 		}
 	    } while (retval > 0 && 
-		    !(State[P].limbo && State[P].other_in_limbo));
+		    !(s->state[P].limbo && s->state[P].other_in_limbo));
 
 	    /* limbo handling */
-	    if (State[P].limbo && State[P].other_in_limbo) {
+	    if (s->state[P].limbo && s->state[P].other_in_limbo) {
 		Assert(adjust[0] != -1 && adjust[1] != -1);
-		stop_playing_sound(ss[0],SOUND_CLOCK);
-		if (NUM_PLAYER == 2) stop_playing_sound(ss[1],SOUND_CLOCK);
+		event_clock_sound(ss, NUM_PLAYER, 0);
 		return 0;
-	    } else if (State[P].limbo && !State[P].other_in_limbo &&
-		    !State[P].limbo_sent) {
+	    } else if (s->state[P].limbo && !s->state[P].other_in_limbo &&
+		    !s->state[P].limbo_sent) {
 		char msg = adjust[P]; /* WRW: send update */
-		State[P].limbo_sent = 1;
+		s->state[P].limbo_sent = 1;
 		send(sock,&msg,1,0);
-	    } else if (!State[P].limbo && State[P].other_in_limbo) {
+	    } else if (!s->state[P].limbo && s->state[P].other_in_limbo) {
 		char msg; /* WRW: send update */
 		/* hmm, other guy is done ... */
 		if (adjust[!P] == ADJUST_UP || adjust[!P] == ADJUST_SAME) {
@@ -1402,65 +2005,108 @@ you_win:
 		/*
 		Debug("Entering Limbo: adjust same/down.\n");
 		*/
-		State[P].falling = 0;
-		State[P].fall_speed = 0;
-		State[P].tetris_handling = 0;
-		State[P].accept_input = 0;
-		State[P].limbo = 1;
-		State[P].limbo_sent = 1;
+		event_retire(s, P);
+		s->state[P].limbo_sent = 1;
 		msg = adjust[P];
 		send(sock,&msg,1,0);
-		stop_playing_sound(ss[0],SOUND_CLOCK);
-		if (NUM_PLAYER == 2) stop_playing_sound(ss[1],SOUND_CLOCK);
+		event_clock_sound(ss, NUM_PLAYER, 0);
 		return 0;
 	    }
 	}
+	event_phase(s, PHASE_DRAW);
 	if (paused) {
+	    render_lock();
 	    atris_run_flame();
-	}
-
-	tv_now = SDL_GetTicks();
-	{
-	    Uint32 least = State[0].tv_next_fall;
-
-	    if (State[0].tetris_handling && State[0].tv_next_tetris < least)
-		least = State[0].tv_next_tetris;
-	    if (State[0].ai && State[0].tv_next_ai_think < least)
-		least = State[0].tv_next_ai_think;
-	    if (State[0].ai && State[0].tv_next_ai_move < least)
-		least = State[0].tv_next_ai_move;
-	    if (NUM_PLAYER == 2) {
-		if (State[1].tv_next_fall < least)
-		    least = State[1].tv_next_tetris;
-		if (State[1].tetris_handling && State[1].tv_next_tetris < least)
-		    least = State[1].tv_next_tetris;
-		if (State[1].ai && State[1].tv_next_ai_think < least)
-		    least = State[1].tv_next_ai_think;
-		if (State[1].ai && State[1].tv_next_ai_move < least)
-		    least = State[1].tv_next_ai_move;
-	    }
-
-	    if (least >= tv_now + 4 && !SDL_PollEvent(NULL)) {
-		/* hey, we could sleep for two ... */
-		if (State[0].ai || State[1].ai) {
-		    SDL_Delay(1);
-		    if (State[0].ai && State[0].draw) {
-			int row, col;
-			screen_to_grid_coords(&g[0], blockWidth, pos[0].x, pos[0].y, &row, &col);
-			AI[0]->think(State[0].ai_state, &g[0], &State[0].cp, &State[0].np, col, row, pos[0].rot);
-		    } else SDL_Delay(1);
-		    if (State[1].ai && State[1].draw) {
-			int row, col;
-			screen_to_grid_coords(&g[1], blockWidth, pos[1].x, pos[1].y, &row, &col);
-			AI[1]->think(State[1].ai_state, &g[1], &State[1].cp, &State[1].np, col, row, pos[1].rot);
-		    } else SDL_Delay(1);
-		} else SDL_Delay(2);
-	    } else if (least > tv_now && !SDL_PollEvent(NULL))
-		SDL_Delay(least - tv_now);
+	    render_unlock();
+	} else
+	    event_frame(s, screen, ps, cs, g, NUM_PLAYER, sock, tv_now,
+		    *seconds_remaining);
+
+	event_phase(s, PHASE_SLEEP);
+	if (s->turbo.on) {
+	    Uint32 next;
+
+	    /* no waiting: it is simply time for the next thing due */
+	    if (paused)
+		idle_wait(atris_flame_wait(), sock);
+	    else if (timer_next(&s->timers, &next) < 0)
+		s->turbo.clock += EVENT_INPUT_POLL;
+	    else if ((Sint32) (next - s->turbo.clock) > 0)
+		s->turbo.clock = next;
+	} else {
+	    Uint32 next;
+
+	    /* paused or with nothing due, we still come back for the flame
+	     * and the clock */
+	    if (paused)
+		next = event_ticks(s) + atris_flame_wait();
+	    else if (timer_next(&s->timers, &next) < 0)
+		next = event_ticks(s) + EVENT_IDLE;
+	    if (!input_gather(s))
+		sched_slack(s, next, ps, cs, g, AI, blockWidth, NUM_PLAYER,
+			sock);
 	}
     } 
 }
 
+/***************************************************************************
+ *      event_loop()
+ * The main event-processing dispatch loop: plays one game of session s,
+ * which keeps its score, on boards g[0] to g[s->boards-1]. who[] says who
+ * plays each one (HUMAN_PLAYER, AI_PLAYER or NETWORK_PLAYER): at most two
+ * humans, and a network opponent only ever as the second of two boards.
+ * The boards are drawn on the render thread while it runs, if there is
+ * one. AI_VS_AI and DEMO games run in turbo if Options.turbo says so, and
+ * say how fast they went. F12 writes out where the loop's time has gone
+ * so far (see event_phase()).
+ *
+ * Returns 0 on a successful game completion, -1 on a [single-user] quit.
+ *********************************************************************PROTO*/
+int
+event_loop(Session *s, SDL_Surface *screen, piece_style *ps,
+	color_style *cs[], sound_style *ss[], Grid g[], int level[], int sock,
+	int *seconds_remaining, int time_is_hard_limit,
+	int adjust[], int (*handle)(const SDL_Event *), 
+	int seed, int who[], AI_Player *AI[])
+{
+    int retval, seconds = *seconds_remaining;
+    double start = sim_now();
+    int Q;
+
+    memset(&s->turbo, 0, sizeof(s->turbo));
+    s->turbo.on = Options.turbo > 0 && (s->gametype == AI_VS_AI ||
+	    s->gametype == DEMO);
+    for (Q=0; Q<s->boards; Q++)
+	if (who[Q] != AI_PLAYER)
+	    s->turbo.on = 0;
+    if (s->turbo.on) {
+	sound_mute(1);
+	sim_virtual_clock(1);	/* the AIs do not notice either */
+    }
+    s->rendering = render_start(s, g, cs, min(s->boards, s->layout.boards))
+	|| s->turbo.on;
+    retval = event_play(s, screen, ps, cs, ss, g, level, sock,
+	    seconds_remaining, time_is_hard_limit, adjust, handle, seed, who, AI);
+    render_stop();
+    s->rendering = 0;
+    if (s->turbo.on) {
+	double took = sim_now() - start;
+	double played = seconds - *seconds_remaining;
+	char buf[8 * MAX_PLAYERS] = "";
+
+	for (Q=0; Q<s->boards; Q++)
+	    sprintf(buf + strlen(buf), "%s%d", Q ? "/" : "", adjust[Q]);
+	Debug("Turbo: %.0f s of play in %.2f s (%.0fx), %lu steps, "
+		"%lu drawn; adjustments %s.\n", played, took,
+		took > 0 ? played / took : 0.0, s->turbo.passes, s->turbo.drawn,
+		buf);
+	sim_virtual_clock(0);
+	sound_mute(0);
+	s->turbo.on = 0;
+    }
+    return retval;
+}
+
 /*
  * $Log: event.c,v $
  * Revision 1.61  2001/01/05 21:12:32  weimer
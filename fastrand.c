@@ -24,7 +24,8 @@ Uint32 GetRandSeed(void)
 }
 
 /* This magic is wholly the result of Andrew Welch, not me. :-) */
-Uint16 FastRandom(Uint16 range)
+/* -- The same generator, but on a seed of your own (for threads) */
+Uint16 FastRandom_r(Uint32 *seed, Uint16 range)
 {
 	Uint16 result;
 	register Uint32 calc;
@@ -32,7 +33,7 @@ Uint16 FastRandom(Uint16 range)
 	register Uint32 regD1;
 	register Uint32 regD2;
 
-	calc = randomSeed;
+	calc = *seed;
 	regD0 = 0x41A7;
 	regD2 = regD0;
 	
@@ -64,7 +65,7 @@ Uint16 FastRandom(Uint16 range)
 		regD0 += 0x7FFFFFFF;
 	 *************************************/
 	
-	randomSeed = regD0;
+	*seed = regD0;
 	if ((regD0 & 0x0000FFFF) == 0x8000)
 		regD0 &= 0xFFFF0000;
 
@@ -78,3 +79,8 @@ Uint16 FastRandom(Uint16 range)
 	
 	return result;
 }
+
+Uint16 FastRandom(Uint16 range)
+{
+	return FastRandom_r(&randomSeed, range);
+}
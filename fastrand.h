@@ -4,5 +4,6 @@
 #include <SDL/SDL_stdinc.h>
 extern void   SeedRandom(Uint32 seed);
 extern Uint16 FastRandom(Uint16 range);
+extern Uint16 FastRandom_r(Uint32 *seed, Uint16 range);
 extern Uint32 GetRandSeed(void);
 
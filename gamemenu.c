@@ -19,6 +19,8 @@
 #include "sound.h"
 #include "menu.h"
 #include "options.h"
+#include "timer.h"
+#include "session.h"
 
 /* function prototypes */
 #include ".protos/ai.pro"
@@ -45,6 +47,7 @@ typedef enum {
     Opt_LongSettleDelay,
     Opt_UpwardRotation,
     Opt_KeyRepeat,
+    Opt_Turbo,
 } OptionMenuChoice;
 
 #define MAX_MENU_CHOICE	6
@@ -96,6 +99,10 @@ static void OptionsMenu_setup()
 
     sprintf(key_repeat_label,"Key Repeat: %.2d", Options.key_repeat_delay);
     wrg->wr[OptionsMenu].label[Opt_KeyRepeat] = key_repeat_label;
+    if (Options.turbo)
+	wrg->wr[OptionsMenu].label[Opt_Turbo] = "AI Turbo: On";
+    else
+	wrg->wr[OptionsMenu].label[Opt_Turbo] = "AI Turbo: Off";
 }
 
 static int OptionsMenu_action(WalkRadio *wr)
@@ -110,6 +117,7 @@ static int OptionsMenu_action(WalkRadio *wr)
 	case Opt_LongSettleDelay: Options.long_settle_delay = ! Options.long_settle_delay; break;
 	case Opt_UpwardRotation: Options.upward_rotation = ! Options.upward_rotation; break;
 	case Opt_KeyRepeat: Options.key_repeat_delay = pick_key_repeat(screen); break;
+	case Opt_Turbo: Options.turbo = Options.turbo ? 0 : TURBO_EVERY; break;
 	default: 
 	    break;
     }
@@ -234,10 +242,11 @@ play_MENU(color_styles cs, piece_styles ps, sound_styles ss,
     color_style *event_cs[2];	/* pass these to event_loop */
     sound_style *event_ss[2];
     AI_Player *event_ai[2];
-    extern int Score[];
+    int who[1] = { AI_PLAYER };
+    Session s;
 
     level[0] = my_level;	/* starting level */
-    Score[0] = Score[1] = 0;
+    session_init(&s, DEMO);
     SeedRandom(0);
 
     while (1) {	
@@ -250,7 +259,7 @@ play_MENU(color_styles cs, piece_styles ps, sound_styles ss,
 	    /* generate the board */
 	    /* draw the background */
 	    g[0] = generate_board(10,20,level[0]);
-	    draw_background(screen, cs.style[0]->w, g, level, my_adj, NULL,
+	    draw_background(&s, screen, cs.style[0]->w, g, level, my_adj, NULL,
 		    &(aip->name));
 		{
 		    int i;
@@ -264,11 +273,12 @@ play_MENU(color_styles cs, piece_styles ps, sound_styles ss,
 	    event_ai[0] = aip;
 	    event_ai[1] = NULL;
 
-	    result = event_loop(screen, ps.style[ps.choice], 
+	    result = event_loop(&s, screen, ps.style[ps.choice], 
 		    event_cs, event_ss, g,
 		    level, 0, &curtimeleft, 1, adjustment,
-		    menu_handler, time(NULL), AI_PLAYER, NO_PLAYER, event_ai);
+		    menu_handler, time(NULL), who, event_ai);
 	    if (result < 0) { 	/* explicit quit */
+		session_free(&s);
 		return -1;
 	    }
 	    /* reset board */
@@ -332,7 +342,7 @@ int choose_gametype(piece_styles *ps, color_styles *cs,
 	wrg->wr[GameMenu].defaultchoice = 0;
 	wrg->wr[GameMenu].action = GameMenu_action;
 
-	wrg->wr[OptionsMenu].n = 7;
+	wrg->wr[OptionsMenu].n = 8;
 	Malloc(wrg->wr[OptionsMenu].label, char**, sizeof(char*)*wrg->wr[OptionsMenu].n);
 	OptionsMenu_setup();
 	wrg->wr[OptionsMenu].defaultchoice = 0;
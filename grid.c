@@ -30,11 +30,44 @@ cleanup_grid(Grid *g)
 }
 
 /***************************************************************************
- *      generate_board()
- * Creates a new board at the given level.
+ *      grid_masks()
+ * Summarizes the given grid as per-column bitmasks (see Grid_Masks). One
+ * pass over the squares, after which evaluators need never look at them
+ * again.
+ *********************************************************************PROTO*/
+void
+grid_masks(Grid *g, Grid_Masks *m)
+{
+    int x,y;
+
+    Assert(g->w <= GRID_MASK_MAX_W && g->h <= GRID_MASK_MAX_H);
+    m->w = g->w;
+    m->h = g->h;
+    memset(m->occupied, 0, sizeof(m->occupied));
+    memset(m->garbage, 0, sizeof(m->garbage));
+    memset(m->same_left, 0, sizeof(m->same_left));
+
+    for (y=0; y<g->h; y++) {
+	unsigned char *row = &GRID_CONTENT(*g,0,y);
+	Uint32 bit = 1U << y;
+	for (x=0; x<g->w; x++) {
+	    if (!row[x]) continue;
+	    m->occupied[x] |= bit;
+	    if (row[x] == 1)
+		m->garbage[x] |= bit;
+	    if (x > 0 && row[x-1] == row[x])
+		m->same_left[x] |= bit;
+	}
+    }
+}
+
+/***************************************************************************
+ *      generate_board_r()
+ * Creates a new board at the given level, drawing the garbage from *seed
+ * instead of the shared generator.
  *********************************************************************PROTO*/
 Grid
-generate_board(int w, int h, int level)
+generate_board_r(int w, int h, int level, Uint32 *seed)
 {
     int i,j,r;
 
@@ -59,7 +92,7 @@ generate_board(int w, int h, int level)
 	for (j=start_garbage;j<h;j++)
 	    for (r=0;r<w/2;r++) {
 		do {
-		    i = ZEROTO(w);
+		    i = FastRandom_r(seed, w);
 		} while (GRID_CONTENT(retval,i,j) == 1);
 		GRID_SET(retval,i,j,1);
 	    }
@@ -68,12 +101,40 @@ generate_board(int w, int h, int level)
 }
 
 /***************************************************************************
- *      add_garbage()
- * Adds garbage to the given board. Pushes all of the lines up, adds the
- * garbage to the bottom.
+ *      generate_board()
+ * Creates a new board at the given level.
+ *********************************************************************PROTO*/
+Grid
+generate_board(int w, int h, int level)
+{
+    Grid retval;
+    Uint32 seed = GetRandSeed();
+
+    retval = generate_board_r(w, h, level, &seed);
+    SeedRandom(seed);
+    return retval;
+}
+
+/***************************************************************************
+ *      free_board()
+ * Gives back what generate_board() took.
  *********************************************************************PROTO*/
 void
-add_garbage(Grid *g)
+free_board(Grid *g)
+{
+    Free(g->contents);
+    Free(g->fall);
+    Free(g->changed);
+    Free(g->temp);
+}
+
+/***************************************************************************
+ *      add_garbage_r()
+ * Adds garbage to the given board, drawing it from *seed. Pushes all of
+ * the lines up, adds the garbage to the bottom.
+ *********************************************************************PROTO*/
+void
+add_garbage_r(Grid *g, Uint32 *seed)
 {
     int i,j;
     for (j=0;j<g->h-1;j++)
@@ -87,7 +148,7 @@ add_garbage(Grid *g)
 
     j = g->h - 1;
     for (i=0; i<g->w; i++) {
-	    if (ZEROTO(100) < 50) {
+	    if (FastRandom_r(seed, 100) < 50) {
 		GRID_SET(*g,i,j,1);
 		if (GRID_CONTENT(*g,i,j-1) &&
 			GRID_CONTENT(*g,i,j-1) != REMOVE_ME)
@@ -108,19 +169,99 @@ add_garbage(Grid *g)
     return;
 }
 
+/***************************************************************************
+ *      add_garbage()
+ * Adds garbage to the given board. Pushes all of the lines up, adds the
+ * garbage to the bottom.
+ *********************************************************************PROTO*/
+void
+add_garbage(Grid *g)
+{
+    Uint32 seed = GetRandSeed();
+
+    add_garbage_r(g, &seed);
+    SeedRandom(seed);
+}
+
+/***************************************************************************
+ *      draw_grid_block()
+ * Draws the block at (i,j) on the main grid, with its lighting and
+ * shadows, dy pixels below where it belongs.
+ *********************************************************************PROTO*/
+void
+draw_grid_block(SDL_Surface *screen, color_style *cs, Grid *g, int i, int j,
+	int dy)
+{
+    SDL_Rect r,s;
+    int c = GRID_CONTENT(*g,i,j);
+    int fall = FALL_CONTENT(*g,i,j);
+    int that_precolor, that_fall;
+
+    s.x = g->board.x + (i * cs->w);
+    s.y = g->board.y + (j * cs->h) + dy;
+    s.w = cs->w;
+    s.h = cs->h;
+
+    SDL_BlitSafe(cs->color[c], NULL, screen, &s);
+
+    /* light up */
+    that_precolor = (j == 0) ? 0 : GRID_CONTENT(*g,i,j-1);
+    that_fall = (j == 0) ? -1 : FALL_CONTENT(*g,i,j-1);
+    if (that_precolor != c || that_fall != fall) {
+	r.x = s.x;
+	r.y = s.y;
+	r.h = edge[HORIZ_LIGHT]->h;
+	r.w = edge[HORIZ_LIGHT]->w;
+	SDL_BlitSafe(edge[HORIZ_LIGHT],NULL, screen, &r);
+    }
+
+    /* light left */
+    that_precolor = (i == 0) ? 0 : GRID_CONTENT(*g,i-1,j);
+    that_fall = (i == 0) ? -1 : FALL_CONTENT(*g,i-1,j);
+    if (that_precolor != c || that_fall != fall) {
+	r.x = s.x;
+	r.y = s.y;
+	r.h = edge[VERT_LIGHT]->h;
+	r.w = edge[VERT_LIGHT]->w;
+	SDL_BlitSafe(edge[VERT_LIGHT],NULL, screen,&r);
+    }
+
+    /* shadow down */
+    that_precolor = (j == g->h-1) ? 0 : GRID_CONTENT(*g,i,j+1);
+    that_fall = (j == g->h-1) ? -1 : FALL_CONTENT(*g,i,j+1);
+    if (that_precolor != c || that_fall != fall) {
+	r.x = s.x;
+	r.y = s.y + cs->h - edge[HORIZ_DARK]->h;
+	r.h = edge[HORIZ_DARK]->h;
+	r.w = edge[HORIZ_DARK]->w;
+	SDL_BlitSafe(edge[HORIZ_DARK],NULL, screen,&r);
+    }
+
+    /* shadow right */
+    that_precolor = (i == g->w-1) ? 0 : GRID_CONTENT(*g,i+1,j);
+    that_fall = (i == g->w-1) ? -1 : FALL_CONTENT(*g,i+1,j);
+    if (that_precolor != c || that_fall != fall) {
+	r.x = s.x + cs->w - edge[VERT_DARK]->w;
+	r.y = s.y;
+	r.h = edge[VERT_DARK]->h;
+	r.w = edge[VERT_DARK]->w;
+	SDL_BlitSafe(edge[VERT_DARK],NULL, screen,&r);
+    }
+}
+
 /***************************************************************************
  *      draw_grid()
  * Draws the main grid board. This involves drawing all of the pieces (and
  * garbage) currently pasted on to it. This is the function that actually
  * clears out grid pieces marked with "REMOVE_ME". The main bit of work
- * here is calculating the shadows. 
+ * here is calculating the shadows (see draw_grid_block()). 
  *
  * Uses the color style to actually draw the right picture on the screen.
  *********************************************************************PROTO*/
 void
 draw_grid(SDL_Surface *screen, color_style *cs, Grid *g, int draw)
 {
-    SDL_Rect r,s;
+    SDL_Rect s;
     int i,j;
     int mini=20, minj=20, maxi=-1, maxj=-1;
     for (j=g->h-1;j>=0;j--) {
@@ -131,74 +272,7 @@ draw_grid(SDL_Surface *screen, color_style *cs, Grid *g, int draw)
 		if (i > maxi) maxi = i; if (j > maxj) maxj = j;
 		
 
-		s.x = g->board.x + (i * cs->w);
-		s.y = g->board.y + (j * cs->h);
-		s.w = cs->w;
-		s.h = cs->h;
-
-		SDL_BlitSafe(cs->color[c], NULL, screen, &s);
-
-		{
-		    int fall = FALL_CONTENT(*g,i,j);
-
-		    int that_precolor = (j == 0) ? 0 : 
-			GRID_CONTENT(*g,i,j-1);
-		    int that_fall = (j == 0) ? -1 :
-			FALL_CONTENT(*g,i,j-1);
-		    /* light up */
-		    if (that_precolor != c || that_fall != fall) {
-			r.x = g->board.x + i * cs->w;
-			r.y = g->board.y + j * cs->h;
-			r.h = edge[HORIZ_LIGHT]->h;
-			r.w = edge[HORIZ_LIGHT]->w;
-			SDL_BlitSafe(edge[HORIZ_LIGHT],NULL,
-				    screen, &r);
-		    }
-
-		    /* light left */
-		    that_precolor = (i == 0) ? 0 :
-			GRID_CONTENT(*g,i-1,j);
-		    that_fall = (i == 0) ? -1 :
-			FALL_CONTENT(*g,i-1,j);
-		    if (that_precolor != c || that_fall != fall) {
-			r.x = g->board.x + i * cs->w;
-			r.y = g->board.y + j * cs->h;
-			r.h = edge[VERT_LIGHT]->h;
-			r.w = edge[VERT_LIGHT]->w;
-			SDL_BlitSafe(edge[VERT_LIGHT],NULL,
-				    screen,&r);
-		    }
-		    
-		    /* shadow down */
-		    that_precolor = (j == g->h-1) ? 0 :
-			GRID_CONTENT(*g,i,j+1);
-		    that_fall = (j == g->h-1) ? -1 :
-			FALL_CONTENT(*g,i,j+1);
-		    if (that_precolor != c || that_fall != fall) {
-			r.x = g->board.x + i * cs->w;
-			r.y = (g->board.y + (j+1) * cs->h) 
-			    - edge[HORIZ_DARK]->h;
-			r.h = edge[HORIZ_DARK]->h;
-			r.w = edge[HORIZ_DARK]->w;
-			SDL_BlitSafe(edge[HORIZ_DARK],NULL,
-				    screen,&r);
-		    }
-
-		    /* shadow right */
-		    that_precolor = (i == g->w-1) ? 0 :
-			GRID_CONTENT(*g,i+1,j);
-		    that_fall = (i == g->w-1) ? -1 :
-			FALL_CONTENT(*g,i+1,j);
-		    if (that_precolor != c || that_fall != fall) {
-			r.x = (g->board.x + (i+1) * cs->w) 
-			    - edge[VERT_DARK]->w;
-			r.y = (g->board.y + (j) * cs->h);
-			r.h = edge[VERT_DARK]->h;
-			r.w = edge[VERT_DARK]->w;
-			SDL_BlitSafe(edge[VERT_DARK],NULL,
-				    screen,&r);
-		    }
-		} /* endof: hikari to kage */
+		draw_grid_block(screen, cs, g, i, j, 0);
 		/* SDL_UpdateSafe(screen, 1, &s); */
 		GRID_CHANGED(*g,i,j) = 0;
 	    } else if (c == REMOVE_ME) {
@@ -413,7 +487,7 @@ run_gravity(Grid *g)
 	    /* now, run up as far as we can ... */
 	    if (y >= 1) {
 		Y = y;
-		while ((c = GRID_CONTENT(*g,x,Y)) && 
+		while (Y >= 0 && (c = GRID_CONTENT(*g,x,Y)) && 
 			FALL_CONTENT(*g,x,Y) != NOT_FALLING) {
 		    /* mark stable */
 		    f = FALL_CONTENT(*g,x,Y);
@@ -458,7 +532,7 @@ run_gravity(Grid *g)
 
 		if (Y >= 1) {
 		    YY = Y;
-		    while ((c = GRID_CONTENT(*g,X,YY)) && 
+		    while (YY >= 0 && (c = GRID_CONTENT(*g,X,YY)) && 
 			    FALL_CONTENT(*g,X,YY) != NOT_FALLING) {
 			/* mark stable */
 			f = FALL_CONTENT(*g,X,YY);
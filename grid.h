@@ -35,6 +35,26 @@ typedef struct { /* the playing area */
 	    (g).fall[(x)+((y)*((g).w))]=(n))
 #define TEMP_CONTENT(g,x,y) ((g).temp[(x) + ((y)*((g).w))])
 
+/*
+ * A bit-per-row summary of a grid, one word per column: bit y of
+ * occupied[x] is set if (x,y) holds anything at all, bit y of garbage[x]
+ * if it holds garbage and bit y of same_left[x] if it holds the same
+ * color as (x-1,y). The AI evaluators count holes, canyons and garbage
+ * from these with shifts and popcounts instead of walking the squares.
+ */
+#define GRID_MASK_MAX_W	16
+#define GRID_MASK_MAX_H	31	/* keeps "mask >> (y+1)" defined */
+typedef struct {
+    int w;
+    int h;
+    Uint32 occupied[GRID_MASK_MAX_W];
+    Uint32 garbage[GRID_MASK_MAX_W];
+    Uint32 same_left[GRID_MASK_MAX_W];
+} Grid_Masks;
+
+#define MASK_POPCOUNT(m)	(__builtin_popcount(m))
+#define MASK_LOWEST(m)		(__builtin_ctz(m))	/* m != 0 */
+
 #define FALLING 	0
 #define NOT_FALLING	1
 #define UNKNOWN		254
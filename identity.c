@@ -13,6 +13,7 @@
 #include "grid.h"
 #include "identity.h"
 #include "menu.h"
+#include "idle.h"
 
 #include ".protos/xflame.pro"
 #include ".protos/display.pro"
@@ -119,7 +120,12 @@ input_string(SDL_Surface *screen, int x, int y, int opaque)
 			    break;
 		    }
 		}
-	    } else atris_run_flame();
+	    } else {
+		Sint32 blink_wait = flip_when - SDL_GetTicks();
+
+		atris_run_flame();
+		idle_wait(min(atris_flame_wait(), max(blink_wait, 0)), 0);
+	    }
 	}
 	SDL_FreeSurface(text);
     }
@@ -0,0 +1,160 @@
+/*
+ *                               Alizarin Tetris
+ * Sleeping until there is something to do: a key, a deadline or the other
+ * player's move.
+ *
+ * SDL 1.2 has no way to sleep until an event comes: SDL_WaitEvent() is
+ * SDL_PollEvent() every 10 ms, and the events can only be pumped on the
+ * thread that set the video mode, so an input thread of our own is out
+ * too. Under X11 everything SDL hears comes down one connection, though,
+ * so once SDL has taken whatever is there we select() on it, on the
+ * network socket and on a pipe that idle_wake() writes to, until the
+ * deadline. The render thread pokes the pipe whenever it has drawn: its
+ * screen updates can read events off the connection into Xlib's own queue
+ * behind our back, and then only SDL_PumpEvents() would find them.
+ *
+ * Anywhere else, or without select(), we do what we always did: look for
+ * input every IDLE_POLL until the deadline.
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+
+#include "config.h"	/* go autoconf! */
+#include <unistd.h>
+#include <sys/types.h>
+#if HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#if HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+#include "atris.h"
+#include "grid.h"
+#include "render.h"
+#include "idle.h"
+
+#ifdef SDL_VIDEO_DRIVER_X11
+#include <SDL/SDL_syswm.h>
+#endif
+
+#if HAVE_SELECT && !HAVE_WINSOCK_H
+#define IDLE_SELECT	1
+#endif
+
+static int idle_pipe[2] = { -1, -1 };	/* idle_wake() to idle_wait() */
+static int idle_x11 = -1;		/* the X server connection */
+
+/***************************************************************************
+ *      idle_setup()
+ * Finds out how we can hear about input without asking: call it once
+ * the video mode is set.
+ *********************************************************************PROTO*/
+void
+idle_setup(void)
+{
+#if IDLE_SELECT
+#ifdef SDL_VIDEO_DRIVER_X11
+    SDL_SysWMinfo info;
+
+    SDL_VERSION(&info.version);
+    if (SDL_GetWMInfo(&info) > 0 && info.subsystem == SDL_SYSWM_X11)
+	idle_x11 = ConnectionNumber(info.info.x11.display);
+#endif
+    if (idle_x11 < 0 || idle_pipe[0] >= 0)
+	return;
+    if (pipe(idle_pipe)) {
+	Debug("pipe(): %s, looking for input every %d ms instead.\n",
+		strerror(errno), IDLE_POLL);
+	idle_pipe[0] = idle_pipe[1] = -1;
+	idle_x11 = -1;
+	return;
+    }
+#if HAVE_FCNTL_H
+    fcntl(idle_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(idle_pipe[1], F_SETFL, O_NONBLOCK);
+#endif
+#endif
+}
+
+/***************************************************************************
+ *      idle_wake()
+ * Cuts short whatever idle_wait() is sleeping, on any thread.
+ *********************************************************************PROTO*/
+void
+idle_wake(void)
+{
+    char c = 0;
+
+    if (idle_pipe[1] >= 0 && write(idle_pipe[1], &c, 1) < 0) {
+	/* full: it will wake up anyway */
+    }
+}
+
+/***************************************************************************
+ *      idle_key_held()
+ * Is a key down that SDL would repeat? It makes up its repeats only while
+ * we ask for events. The lock keys read as down for as long as the lock
+ * is on, and neither they nor the modifiers ever repeat.
+ ***************************************************************************/
+static int
+idle_key_held(void)
+{
+    int n, i;
+    Uint8 *key = SDL_GetKeyState(&n);
+
+    for (i=0; i<n; i++)
+	if (key[i] && (i < SDLK_NUMLOCK || i > SDLK_COMPOSE))
+	    return 1;
+    return 0;
+}
+
+/***************************************************************************
+ *      idle_wait()
+ * Sleeps for up to ms milliseconds, or until there is input, something
+ * to read on sock (if it is not 0) or an idle_wake(). Leaves the input
+ * where it was. Returns 1 if woken early, as far as it knows.
+ *********************************************************************PROTO*/
+int
+idle_wait(int ms, int sock)
+{
+    SDL_Event event;
+    int got;
+
+    if (ms <= 0)
+	return 1;
+    render_lock();
+    SDL_PumpEvents();		/* SDL takes whatever has come */
+    got = SDL_PeepEvents(&event, 1, SDL_PEEKEVENT, SDL_ALLEVENTS) > 0;
+    if (!got && idle_key_held())
+	ms = min(ms, IDLE_POLL);
+    render_unlock();
+    if (got)
+	return 1;
+
+#if IDLE_SELECT
+    if (idle_x11 >= 0) {
+	fd_set read_fds;
+	struct timeval timeout;
+	int top = max(idle_x11, idle_pipe[0]);
+	char buf[64];
+
+	FD_ZERO(&read_fds);
+	FD_SET(idle_x11, &read_fds);
+	FD_SET(idle_pipe[0], &read_fds);
+	if (sock > 0) {
+	    FD_SET(sock, &read_fds);
+	    top = max(top, sock);
+	}
+	timeout.tv_sec = ms / 1000;
+	timeout.tv_usec = (ms % 1000) * 1000;
+	got = select(top + 1, &read_fds, NULL, NULL, &timeout);
+	if (got > 0 && FD_ISSET(idle_pipe[0], &read_fds))
+	    while (read(idle_pipe[0], buf, sizeof(buf)) > 0)
+		;
+	return got > 0;
+    }
+#endif
+    SDL_Delay(min(ms, IDLE_POLL));
+    return 0;
+}
@@ -0,0 +1,23 @@
+/*
+ *                               Alizarin Tetris
+ * Sleeping until there is something to do.
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+#pragma once
+#ifndef __IDLE_H
+#define __IDLE_H
+
+/*
+ * With nothing better to go on, idle_wait() looks for input this often
+ * (in ms): SDL only hears about it when asked, and only makes up key
+ * repeats when asked, too.
+ */
+#define IDLE_POLL	2
+
+/* the most idle_wait() is ever asked to sleep when there is no deadline */
+#define IDLE_FOREVER	1000
+
+#include ".protos/idle.pro"
+
+#endif
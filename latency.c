@@ -0,0 +1,102 @@
+/*
+ *                               Alizarin Tetris
+ * Histograms of how long things take: see latency.h.
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+
+#include "config.h"
+#include <stdio.h>
+
+#include "atris.h"
+#include "latency.h"
+
+/***************************************************************************
+ *      latency_index()
+ * The bucket value v is counted in.
+ ***************************************************************************/
+static int
+latency_index(Uint32 v)
+{
+    int top = LATENCY_SUB_BITS;
+
+    if (v < LATENCY_SUB)
+	return v;
+    while (v >> (top + 1))
+	top++;
+    /* the LATENCY_SUB_BITS bits under the top one say which bucket */
+    return LATENCY_SUB * (top - LATENCY_SUB_BITS + 1) +
+	(int) ((v >> (top - LATENCY_SUB_BITS)) - LATENCY_SUB);
+}
+
+/***************************************************************************
+ *      latency_top()
+ * The biggest value counted in bucket i.
+ ***************************************************************************/
+static Uint32
+latency_top(int i)
+{
+    int shift;
+
+    if (i < LATENCY_SUB)
+	return i;
+    shift = i / LATENCY_SUB - 1;
+    return (((Uint32) (LATENCY_SUB + i % LATENCY_SUB) + 1) << shift) - 1;
+}
+
+/***************************************************************************
+ *      latency_add()
+ * Counts one more thing that took "us" microseconds.
+ *********************************************************************PROTO*/
+void
+latency_add(Latency *h, Uint32 us)
+{
+    if (us > LATENCY_MAX)
+	us = LATENCY_MAX;
+    h->n++;
+    h->total += us;
+    if (us > h->worst)
+	h->worst = us;
+    h->bucket[latency_index(us)]++;
+}
+
+/***************************************************************************
+ *      latency_at()
+ * How long the given fraction (0.5 for the median) of everything counted
+ * took at most, to within a bucket.
+ *********************************************************************PROTO*/
+Uint32
+latency_at(const Latency *h, double fraction)
+{
+    unsigned long want = (unsigned long) (fraction * h->n + 0.5), seen = 0;
+    int i;
+
+    if (want < 1)
+	want = 1;
+    for (i=0; i<LATENCY_BUCKETS; i++)
+	if ((seen += h->bucket[i]) >= want)
+	    return min(latency_top(i), h->worst);
+    return h->worst;
+}
+
+/***************************************************************************
+ *      latency_write()
+ * Writes histogram h to fout, one line per bucket that has anything in it:
+ * its name, the bucket's top value, the count and the fraction of
+ * everything counted that is that long or less.
+ *********************************************************************PROTO*/
+void
+latency_write(FILE *fout, const char *name, const Latency *h)
+{
+    unsigned long seen = 0;
+    int i;
+
+    for (i=0; i<LATENCY_BUCKETS; i++) {
+	if (!h->bucket[i])
+	    continue;
+	seen += h->bucket[i];
+	fprintf(fout, "%s\t%lu\t%lu\t%.6f\n", name,
+		(unsigned long) min(latency_top(i), h->worst), h->bucket[i],
+		(double) seen / h->n);
+    }
+}
@@ -0,0 +1,35 @@
+/*
+ *                               Alizarin Tetris
+ * Histograms of how long things take.
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+#pragma once
+#ifndef __LATENCY_H
+#define __LATENCY_H
+
+/*
+ * Counts of durations in microseconds, kept the way HDR histograms keep
+ * them: below LATENCY_SUB every value has a bucket of its own, and from
+ * there up every power of two is split into LATENCY_SUB buckets. So any
+ * value is known to within 1/LATENCY_SUB of itself, however big it is,
+ * for a few hundred counters. Anything over LATENCY_MAX (about two
+ * minutes) is counted as that.
+ */
+#define LATENCY_SUB_BITS	4
+#define LATENCY_SUB		(1 << LATENCY_SUB_BITS)
+#define LATENCY_TOP_BIT		26
+#define LATENCY_MAX		((1 << (LATENCY_TOP_BIT + 1)) - 1)
+#define LATENCY_BUCKETS		(LATENCY_SUB * \
+				 (LATENCY_TOP_BIT - LATENCY_SUB_BITS + 2))
+
+typedef struct latency_struct {
+    unsigned long n;
+    double total;		/* microseconds */
+    Uint32 worst;
+    unsigned long bucket[LATENCY_BUCKETS];
+} Latency;
+
+#include ".protos/latency.pro"
+
+#endif
@@ -21,6 +21,15 @@ struct option_struct {
     int long_settle_delay;
     int upward_rotation;
     int key_repeat_delay;
+    int ai_rollouts;	/* games the Monte Carlo AI plays out per choice */
+    int ai_threads;	/* simulation threads, 0 = one per processor */
+    int ai_overlay;	/* show what the AIs are up to under their names */
+    int render_thread;	/* draw the boards on a thread of their own */
+    int turbo;		/* AI-only games flat out, drawn every so many
+			   passes (0 = off) */
+    int players;	/* boards in an AI_VS_AI or SINGLE_VS_AI match,
+			   2 to MAX_PLAYERS; fewer if the screen has no
+			   room for them */
     /* what did ".atrisrc" say about these? */
     int named_color;
     int named_sound;
@@ -28,4 +37,6 @@ struct option_struct {
     int named_game;
 } Options;
 
+#define TURBO_EVERY	64	/* what --turbo and the menu turn it on to */
+
 #endif
@@ -251,6 +251,11 @@ load_color_style(SDL_Surface * screen, const char *filename)
 	if (strchr(buf,'\n'))
 	    *(strchr(buf,'\n')) = 0;
 
+	if (!screen) {	/* headless: we only need to know how many */
+	    retval->color[i] = NULL;
+	    retval->w = retval->h = 20;
+	    continue;
+	}
 	imagebmp = SDL_LoadBMP(buf);
 	if (!imagebmp) 
 	    PANIC("cannot load [%s] in color style [%s]",buf,retval->name);
@@ -384,7 +389,9 @@ load_edges(void)
 
 /***************************************************************************
  *      load_color_styles()
- * Loads all available color styles.
+ * Loads all available color styles. With a NULL screen (the headless
+ * tools) no pictures are loaded: the styles just know how many colors
+ * they have and that each is 20 pixels square.
  *********************************************************************PROTO*/
 color_styles 
 load_color_styles(SDL_Surface * screen)
@@ -394,8 +401,10 @@ load_color_styles(SDL_Surface * screen)
     DIR *my_dir;
     char filespec[2048];
 
-    load_edges();
-    load_special();
+    if (screen) {
+	load_edges();
+	load_special();
+    }
 
     memset(&retval, 0, sizeof(retval));
 
@@ -448,19 +457,37 @@ load_color_styles(SDL_Surface * screen)
 play_piece
 generate_piece(piece_style *ps, color_style *cs, unsigned int seq)
 {
-    unsigned int p,q,r,c;
     play_piece retval;
+    Uint32 seed;
 
     SeedRandom(seq);
+    seed = GetRandSeed();
+    retval = generate_piece_r(ps, cs, &seed);
+    SeedRandom(seed);	/* leave ZEROTO() where it always was */
+    return retval;
+}
+
+/***************************************************************************
+ *      generate_piece_r()
+ * generate_piece() on a random seed of your own: *seed is used and
+ * advanced instead of the global one, so threads can draw pieces from the
+ * same distribution the game does.
+ *********************************************************************PROTO*/
+play_piece
+generate_piece_r(piece_style *ps, color_style *cs, Uint32 *seed)
+{
+    unsigned int p,q,r,c;
+    play_piece retval;
 
-    p = ZEROTO(ps->num_piece);
-    q = 2 + ZEROTO(cs->num_color - 1);
-    r = 2 + ZEROTO(cs->num_color - 1);
+    memset(&retval, 0, sizeof(retval));	/* unused colors compare equal */
+    p = FastRandom_r(seed, ps->num_piece);
+    q = 2 + FastRandom_r(seed, cs->num_color - 1);
+    r = 2 + FastRandom_r(seed, cs->num_color - 1);
     retval.base = &(ps->shape[p]);
 
     retval.special = No_Special;
-    if (Options.special_wanted && ZEROTO(10000) < 2000) {
-	switch (ZEROTO(4)) {
+    if (Options.special_wanted && FastRandom_r(seed, 10000) < 2000) {
+	switch (FastRandom_r(seed, 4)) {
 	    case 0: retval.special = Special_Bomb; /* bomb */
 		    break;
 	    case 1: retval.special = Special_Repaint; /* repaint */
@@ -476,7 +503,7 @@ generate_piece(piece_style *ps, color_style *cs, unsigned int seq)
 	    retval.colormap[c] = (unsigned char) retval.special;
 	}
     } else for (c=1;c<=(unsigned)ps->shape[p].num_color;c++) {
-	if (ZEROTO(100) < 25) 
+	if (FastRandom_r(seed, 100) < 25) 
 	    retval.colormap[c] = q; 
 	else
 	    retval.colormap[c] = r; 
@@ -0,0 +1,323 @@
+/*
+ *                               Alizarin Tetris
+ * Loading AI players from shared objects.
+ *
+ * AI_Player's functions are not told which player they belong to, so a
+ * plugin's reset() and evaluate() go through one of PLUGIN_MAX little
+ * functions that know their slot. Everything else finds the plugin
+ * through the state that reset() handed back.
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+
+#include "config.h"
+#include <dlfcn.h>
+#include <string.h>
+
+/* configure magic for dirent */
+#if HAVE_DIRENT_H
+# include <dirent.h>
+# define NAMLEN(dirent) strlen((dirent)->d_name)
+#else
+# define dirent direct
+# define NAMLEN(dirent) (dirent)->d_namlen
+# if HAVE_SYS_NDIR_H
+#  include <sys/ndir.h>
+# endif
+# if HAVE_SYS_DIR_H
+#  include <sys/dir.h>
+# endif
+# if HAVE_NDIR_H
+#  include <ndir.h>
+# endif
+#endif
+
+#include "atris.h"
+#include "grid.h"
+#include "piece.h"
+#include "sound.h"
+#include "ai.h"
+#include "sim.h"
+#include "ai_plugin.h"
+#include "plugin.h"
+
+#include ".protos/ai.pro"
+#include ".protos/event.pro"
+
+static char *plugin_dir = PLUGIN_DIR;
+static const AI_Plugin *plugin_slot[PLUGIN_MAX];
+static int plugin_n = 0;
+
+/* what a plugin AI_Player's state really is */
+typedef struct plugin_state_struct {
+    const AI_Plugin *p;
+    void *state;	/* the plugin's own */
+} Plugin_State;
+
+/***************************************************************************
+ * The host side: the game's own primitives, with the plugin's views made
+ * const. None of these write to a board the plugin was only shown.
+ ***************************************************************************/
+static void
+host_board_new(Grid *g, const Grid *like)
+{
+    *g = generate_board(like->w, like->h, 0);
+    sim_copy_grid(g, (Grid *) like);
+}
+
+static void
+host_board_copy(Grid *to, const Grid *from)
+{
+    sim_copy_grid(to, (Grid *) from);
+}
+
+static int
+host_valid(const Grid *g, const play_piece *pp, int col, int row, int rot)
+{
+    return valid_position((play_piece *) pp, col, row, rot, (Grid *) g);
+}
+
+static int
+host_drop(Grid *g, const play_piece *pp, int col, int row, int rot)
+{
+    return drop_piece_on_grid(g, (play_piece *) pp, col, row, rot);
+}
+
+static void
+host_masks(const Grid *g, Grid_Masks *m)
+{
+    grid_masks((Grid *) g, m);
+}
+
+static AI_Batch *
+host_batch_new(const Grid *like, int max)
+{
+    return ai_batch_new((Grid *) like, max);
+}
+
+static void
+host_batch_drop(AI_Batch *b, const Grid *g, const play_piece *pp,
+	const AI_Placement *p, int n)
+{
+    ai_batch_drop(b, (Grid *) g, (play_piece *) pp, (AI_Placement *) p, n);
+}
+
+static int
+host_batch_all(AI_Batch *b, const Grid *g, const play_piece *pp, int row)
+{
+    return ai_batch_all(b, (Grid *) g, (play_piece *) pp, row);
+}
+
+static const AI_Host plugin_host = {
+    AI_PLUGIN_ABI,
+    AI_PLUGIN_LAYOUT,
+    host_board_new,
+    host_board_copy,
+    free_board,
+    host_valid,
+    host_drop,
+    host_masks,
+    host_batch_new,
+    ai_batch_free,
+    host_batch_drop,
+    host_batch_all,
+    ai_batch_weigh,
+    ai_batch_eval,
+    sim_ticks,
+};
+
+/***************************************************************************
+ * The player side: AI_Player's functions in terms of the plugin's.
+ ***************************************************************************/
+static void *
+plugin_reset(int slot, void *state, Grid *g)
+{
+    Plugin_State *ps = (Plugin_State *) state;
+
+    if (ps == NULL) {
+	Calloc(ps, Plugin_State *, sizeof(Plugin_State));
+	ps->p = plugin_slot[slot];
+    }
+    ps->state = ps->p->reset(ps->state, g, &plugin_host);
+    return ps;
+}
+
+static void
+plugin_evaluate(int slot, void *state, AI_Batch *b, double *scores)
+{
+    Plugin_State *ps = (Plugin_State *) state;
+
+    plugin_slot[slot]->evaluate(ps ? ps->state : NULL, b, scores);
+}
+
+#define PLUGIN_SLOT(i) \
+static void * plugin_reset_##i(void *s, Grid *g) \
+{ return plugin_reset(i, s, g); } \
+static void plugin_evaluate_##i(void *s, AI_Batch *b, double *scores) \
+{ plugin_evaluate(i, s, b, scores); }
+
+PLUGIN_SLOT(0)  PLUGIN_SLOT(1)  PLUGIN_SLOT(2)  PLUGIN_SLOT(3)
+PLUGIN_SLOT(4)  PLUGIN_SLOT(5)  PLUGIN_SLOT(6)  PLUGIN_SLOT(7)
+PLUGIN_SLOT(8)  PLUGIN_SLOT(9)  PLUGIN_SLOT(10) PLUGIN_SLOT(11)
+PLUGIN_SLOT(12) PLUGIN_SLOT(13) PLUGIN_SLOT(14) PLUGIN_SLOT(15)
+
+static void * (*plugin_resets[PLUGIN_MAX])(void *, Grid *) = {
+    plugin_reset_0,  plugin_reset_1,  plugin_reset_2,  plugin_reset_3,
+    plugin_reset_4,  plugin_reset_5,  plugin_reset_6,  plugin_reset_7,
+    plugin_reset_8,  plugin_reset_9,  plugin_reset_10, plugin_reset_11,
+    plugin_reset_12, plugin_reset_13, plugin_reset_14, plugin_reset_15,
+};
+
+static void (*plugin_evaluates[PLUGIN_MAX])(void *, AI_Batch *, double *) = {
+    plugin_evaluate_0,  plugin_evaluate_1,  plugin_evaluate_2,
+    plugin_evaluate_3,  plugin_evaluate_4,  plugin_evaluate_5,
+    plugin_evaluate_6,  plugin_evaluate_7,  plugin_evaluate_8,
+    plugin_evaluate_9,  plugin_evaluate_10, plugin_evaluate_11,
+    plugin_evaluate_12, plugin_evaluate_13, plugin_evaluate_14,
+    plugin_evaluate_15,
+};
+
+static void
+plugin_think(void *state, Grid *g, play_piece *cp, play_piece *np,
+	int col, int row, int rot)
+{
+    Plugin_State *ps = (Plugin_State *) state;
+    AI_View v = { g, cp, np, col, row, rot };
+
+    ps->p->think(ps->state, &v);
+}
+
+static Command
+plugin_move(void *state, Grid *g, play_piece *cp, play_piece *np,
+	int col, int row, int rot)
+{
+    Plugin_State *ps = (Plugin_State *) state;
+    AI_View v = { g, cp, np, col, row, rot };
+
+    if (ps->p->move == NULL)
+	return MOVE_NONE;
+    return ps->p->move(ps->state, &v);
+}
+
+static int
+plugin_target(void *state, Grid *g, play_piece *cp, int row,
+	AI_Placement *goal)
+{
+    Plugin_State *ps = (Plugin_State *) state;
+    AI_View v = { g, cp, NULL, -1, row, -1 };
+
+    return ps->p->target(ps->state, &v, goal);
+}
+
+static void
+plugin_release(void *state)
+{
+    Plugin_State *ps = (Plugin_State *) state;
+
+    if (ps->p->release && ps->state)
+	ps->p->release(ps->state);
+    free(ps);
+}
+
+/***************************************************************************
+ *      plugin_set_dir()
+ * Look for plugins here instead of PLUGIN_DIR.
+ *********************************************************************PROTO*/
+void
+plugin_set_dir(char *dir)
+{
+    plugin_dir = dir;
+}
+
+/***************************************************************************
+ *      plugin_add()
+ * Makes an AI_Player out of p. Returns 0 if p will not do.
+ ***************************************************************************/
+static int
+plugin_add(AI_Players *ais, const AI_Plugin *p, const char *file)
+{
+    AI_Player *ai;
+
+    if (p->abi != AI_PLUGIN_ABI) {
+	Debug("Plugin [%s] wants interface %d, we have %d.\n", file, p->abi,
+		AI_PLUGIN_ABI);
+	return 0;
+    }
+    if (memcmp(&p->layout, &plugin_host.layout, sizeof(AI_Layout))) {
+	Debug("Plugin [%s] was built against other versions of the game's "
+		"structures.\n", file);
+	return 0;
+    }
+    if (!p->name || !p->reset || !p->think || (!p->move && !p->target)) {
+	Debug("Plugin [%s] is missing something.\n", file);
+	return 0;
+    }
+    if (plugin_n == PLUGIN_MAX) {
+	Debug("No room for plugin AI [%s] (%d at most).\n", p->name,
+		PLUGIN_MAX);
+	return 0;
+    }
+    plugin_slot[plugin_n] = p;
+
+    Realloc(ais->player, AI_Player *, (ais->n + 1) * sizeof(AI_Player));
+    ai = &ais->player[ais->n++];
+    memset(ai, 0, sizeof(*ai));
+    ai->name	= (char *) p->name;
+    ai->msg	= (char *) (p->msg ? p->msg : "A plugin.");
+    ai->move	= plugin_move;
+    ai->think	= plugin_think;
+    ai->reset	= plugin_resets[plugin_n];
+    ai->evaluate = p->evaluate ? plugin_evaluates[plugin_n] : NULL;
+    ai->target	= p->target ? plugin_target : NULL;
+    ai->release	= plugin_release;
+    plugin_n++;
+
+    Debug("Plugin AI [%s] loaded from [%s].\n", p->name, file);
+    return 1;
+}
+
+/***************************************************************************
+ *      plugin_load_all()
+ * Adds an AI_Player for every plugin AI in the plugin directory. It is
+ * fine for there to be no such directory. Returns how many were added.
+ *********************************************************************PROTO*/
+int
+plugin_load_all(AI_Players *ais)
+{
+    DIR *my_dir;
+    char filespec[2048];
+    int added = 0;
+
+    my_dir = opendir(plugin_dir);
+    if (!my_dir)
+	return 0;
+    while (1) {
+	struct dirent *this_file = readdir(my_dir);
+	int len, i;
+	void *handle;
+	AI_Plugin_Entry entry;
+	const AI_Plugin *p;
+
+	if (!this_file) break;
+	len = NAMLEN(this_file);
+	if (len < 4 || strcmp(this_file->d_name + len - 3, ".so"))
+	    continue;
+	sprintf(filespec, "%.1000s/%.1000s", plugin_dir, this_file->d_name);
+	handle = dlopen(filespec, RTLD_NOW | RTLD_LOCAL);
+	if (!handle) {
+	    Debug("Cannot load plugin [%s]: %s\n", filespec, dlerror());
+	    continue;
+	}
+	entry = (AI_Plugin_Entry) dlsym(handle, AI_PLUGIN_ENTRY);
+	if (!entry) {
+	    Debug("Plugin [%s] has no %s().\n", filespec, AI_PLUGIN_ENTRY);
+	    dlclose(handle);
+	    continue;
+	}
+	for (i=0; (p = entry(&plugin_host, i)) != NULL; i++)
+	    added += plugin_add(ais, p, filespec);
+	/* the AIs live as long as we do, so the handle stays open */
+    }
+    closedir(my_dir);
+    return added;
+}
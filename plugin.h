@@ -0,0 +1,22 @@
+/*
+ *                               Alizarin Tetris
+ * Loading AI players from shared objects. See ai_plugin.h for what goes
+ * in one.
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+#pragma once
+#ifndef __PLUGIN_H
+#define __PLUGIN_H
+#include "ai.h"
+#include "ai_plugin.h"
+
+/* how many plugin AIs we have room for */
+#define PLUGIN_MAX	16
+
+/* where they are looked for, relative to ATRIS_LIBDIR */
+#define PLUGIN_DIR	"plugins"
+
+#include ".protos/plugin.pro"
+
+#endif
@@ -0,0 +1,112 @@
+/*
+ *                               Alizarin Tetris
+ * An example AI plugin: tries every column and rotation of the falling
+ * piece with the host's batch primitives, scores the boards with Wes's
+ * evaluator and goes for the best one. Build it with
+ *
+ *	cc -shared -fPIC -I.. `sdl-config --cflags` greedy.c -o greedy.so
+ *
+ * and leave greedy.so in the plugins directory.
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "ai_plugin.h"
+
+typedef struct greedy_state_struct {
+    const AI_Host *host;
+    AI_Batch *b;
+    int *score;
+    int know_what_to_do;
+    AI_Placement goal;
+} Greedy_State;
+
+static void *
+greedy_reset(void *state, const Grid *g, const AI_Host *host)
+{
+    Greedy_State *gs = (Greedy_State *) state;
+
+    if (gs == NULL) {
+	gs = (Greedy_State *) calloc(1, sizeof(Greedy_State));
+	if (gs == NULL)
+	    return NULL;
+	gs->host = host;
+    }
+    if (gs->b == NULL || gs->b->w != g->w || gs->b->h != g->h) {
+	if (gs->b)
+	    host->batch_free(gs->b);
+	/* every rotation in every column, some of them half off the board */
+	gs->b = host->batch_new(g, 4 * (g->w + 4));
+	gs->score = (int *) realloc(gs->score, gs->b->max * sizeof(int));
+    }
+    gs->know_what_to_do = 0;
+    return gs;
+}
+
+static void
+greedy_think(void *state, const AI_View *v)
+{
+    Greedy_State *gs = (Greedy_State *) state;
+    int i, n, best = -1;
+
+    if (gs->know_what_to_do)
+	return;
+    n = gs->host->batch_all(gs->b, v->g, v->cp, v->row);
+    gs->host->batch_weigh(gs->b, gs->score);
+    for (i=0; i<n; i++)
+	if (gs->b->lines[i] >= 0 && (best < 0 || gs->score[i] < gs->score[best]))
+	    best = i;
+    if (best >= 0) {
+	gs->goal = gs->b->place[best];
+	gs->goal.row = -1;
+    } else {
+	gs->goal.col = v->col;
+	gs->goal.rot = v->rot;
+	gs->goal.row = -1;
+    }
+    gs->know_what_to_do = 1;
+}
+
+static int
+greedy_target(void *state, const AI_View *v, AI_Placement *goal)
+{
+    Greedy_State *gs = (Greedy_State *) state;
+
+    *goal = gs->goal;
+    return gs->know_what_to_do;
+}
+
+static void
+greedy_release(void *state)
+{
+    Greedy_State *gs = (Greedy_State *) state;
+
+    if (gs->b)
+	gs->host->batch_free(gs->b);
+    free(gs->score);
+    free(gs);
+}
+
+static const AI_Plugin greedy = {
+    AI_PLUGIN_ABI,
+    AI_PLUGIN_LAYOUT,
+    "Greedy",
+    "One piece at a time, from a plugin.",
+    greedy_reset,
+    greedy_think,
+    NULL,
+    greedy_target,
+    NULL,
+    greedy_release,
+};
+
+const AI_Plugin *
+atris_ai_plugin(const AI_Host *host, int i)
+{
+    if (host->abi != AI_PLUGIN_ABI ||
+	    memcmp(&host->layout, &greedy.layout, sizeof(AI_Layout)))
+	return NULL;
+    return i == 0 ? &greedy : NULL;
+}
@@ -0,0 +1,469 @@
+/*
+ *                               Alizarin Tetris
+ * Drawing the boards on a thread of their own.
+ *
+ * While a game is on, the event loop no longer draws the boards, the
+ * falling pieces, the scores or the clock itself: once a pass it copies
+ * them into a Render_Frame and goes on, and the render thread draws the
+ * newest frame it has been handed RENDER_RATE times a second. A slow
+ * blit or screen update costs frames, not falls or keypresses.
+ *
+ * The event loop moves things on a fixed timestep; between two falls the
+ * render thread slides the piece down by how long it has been since the
+ * last one, so that it does not sit still and then jump.
+ *
+ * SDL is not to be called from two threads at once, so whatever the
+ * event loop still draws itself (the next piece, the pause, the menus
+ * over a demo) and its trips to the event queue go between render_lock()
+ * and render_unlock(). The render thread holds that lock only while it
+ * is drawing a frame.
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+
+#include "config.h"
+#include <string.h>
+
+#include "atris.h"
+#include "display.h"
+#include "grid.h"
+#include "piece.h"
+#include "ai.h"
+#include "options.h"
+#include "sim.h"
+#include "timer.h"
+#include "render.h"
+#include "session.h"
+#include "idle.h"
+
+#include ".protos/display.pro"
+
+#define RENDER_INDEX	3	/* which of the three frames */
+#define RENDER_FRESH	4	/* ... and it has not been taken yet */
+#define RENDER_WAITING()	(__sync_fetch_and_or(&render.middle, 0) & RENDER_FRESH)
+
+static struct render_struct {
+    SDL_Thread *thread;
+    SDL_mutex *lock;		/* around every SDL call during a game */
+    SDL_mutex *wake_lock;	/* only for sleeping on "wake" till the tick */
+    SDL_cond *wake;
+    int running;
+    volatile int quit;
+    int paused;			/* under "lock" */
+
+    int nboard;
+    Grid g[RENDER_MAX_BOARD];	/* the boards: where, and how big */
+    Session *session;		/* whose they are */
+    color_style *cs[RENDER_MAX_BOARD];
+
+    Render_Frame frame[3];
+    int back;			/* the event loop fills this one */
+    int front;			/* the render thread draws this one */
+    int middle;			/* the newest, | RENDER_FRESH */
+    Render_Frame drawn;		/* what the screen shows */
+    int drawn_valid;
+
+    unsigned long published;
+    unsigned long frames;	/* ... of those, drawn */
+    double draw_time;		/* seconds */
+} render;
+
+/***************************************************************************
+ *      render_alloc()
+ * Gives frame f room for every board's squares.
+ ***************************************************************************/
+static void
+render_alloc(Render_Frame *f)
+{
+    int Q;
+
+    memset(f, 0, sizeof(*f));
+    for (Q=0; Q<render.nboard; Q++) {
+	int n = render.g[Q].w * render.g[Q].h;
+	Calloc(f->b[Q].contents, unsigned char *, n);
+	Calloc(f->b[Q].fall, unsigned char *, n);
+	f->b[Q].blank = -1;
+    }
+}
+
+/***************************************************************************
+ *      render_release()
+ ***************************************************************************/
+static void
+render_release(Render_Frame *f)
+{
+    int Q;
+
+    for (Q=0; Q<render.nboard; Q++) {
+	Free(f->b[Q].contents);
+	Free(f->b[Q].fall);
+    }
+}
+
+/***************************************************************************
+ *      render_same()
+ * Would board Q look just the same in frame a as in frame b?
+ ***************************************************************************/
+static int
+render_same(int Q, Render_Board *a, Render_Board *b)
+{
+    int n = render.g[Q].w * render.g[Q].h;
+
+    if (a->blank != b->blank)
+	return 0;
+    if (a->blank >= 0)
+	return 1;	/* the distraction does not change */
+    if (a->fall_offset != b->fall_offset || a->piece != b->piece)
+	return 0;
+    if (a->piece && (a->x != b->x || a->draw_y != b->draw_y ||
+		a->rot != b->rot ||
+		memcmp(&a->cp, &b->cp, sizeof(a->cp))))
+	return 0;
+    return !memcmp(a->contents, b->contents, n) &&
+	!memcmp(a->fall, b->fall, n);
+}
+
+/***************************************************************************
+ *      render_board()
+ * Draws all of board Q as frame board b has it.
+ ***************************************************************************/
+static void
+render_board(int Q, Render_Board *b)
+{
+    Grid view = render.g[Q];
+    color_style *cs = render.cs[Q];
+    SDL_Rect all = view.board;
+    int i, j;
+
+    if (b->blank >= 0) {
+	Grid *d = &render.session->distract[Q];
+	SDL_FillRect(screen, &all, SDL_MapRGB(screen->format,32,32,32));
+	for (j=0; j<b->blank && j<d->h; j++)
+	    for (i=0; i<d->w; i++)
+		if (GRID_CONTENT(*d,i,j))
+		    draw_grid_block(screen, cs, d, i, j, 0);
+	SDL_UpdateSafe(screen, 1, &all);
+	return;
+    }
+
+    view.contents = b->contents;
+    view.fall = b->fall;
+    SDL_FillRect(screen, &all, int_solid_black);
+    /* what stays put, then what is coming down on top of it */
+    for (j=0; j<view.h; j++)
+	for (i=0; i<view.w; i++)
+	    if (GRID_CONTENT(view,i,j) && !(b->fall_offset &&
+			FALL_CONTENT(view,i,j) == FALLING))
+		draw_grid_block(screen, cs, &view, i, j, 0);
+    if (b->fall_offset)
+	for (j=0; j<view.h; j++)
+	    for (i=0; i<view.w; i++)
+		if (GRID_CONTENT(view,i,j) &&
+			FALL_CONTENT(view,i,j) == FALLING)
+		    draw_grid_block(screen, cs, &view, i, j, b->fall_offset);
+    if (b->piece)
+	draw_play_piece(screen, cs, &b->cp, b->x, b->draw_y, b->rot,
+		&b->cp, b->x, b->draw_y, b->rot);
+    SDL_UpdateSafe(screen, 1, &all);
+}
+
+/***************************************************************************
+ *      render_place()
+ * Works out where in between its last fall and the next the piece on
+ * board Q is at tick now, never below where it really is, and how far
+ * down a row whatever is sliding after a clear has come.
+ ***************************************************************************/
+static void
+render_place(int Q, Render_Board *b, Uint32 at, Uint32 now)
+{
+    int age, h = render.cs[Q]->h;
+
+    b->fall_offset = 0;
+    if (b->slide_age >= 0) {
+	age = b->slide_age + (Sint32) (now - at);
+	b->fall_offset = max(1, min(h - 1, age * h / RENDER_SLIDE));
+    }
+
+    b->draw_y = b->y;
+    if (!b->piece || b->fall_dy <= 0 || b->fall_interval <= 0)
+	return;
+    age = b->fall_age + (Sint32) (now - at);
+    if (age < 0) age = 0;
+    if (age < b->fall_interval)
+	b->draw_y = b->y - b->fall_dy + (b->fall_dy * age) / b->fall_interval;
+}
+
+/***************************************************************************
+ *      render_keep()
+ * Remembers frame f as what is on the screen now.
+ ***************************************************************************/
+static void
+render_keep(Render_Frame *f)
+{
+    int Q;
+
+    render.drawn.seconds = f->seconds;
+    for (Q=0; Q<render.nboard; Q++) {
+	Render_Board *d = &render.drawn.b[Q];
+	unsigned char *contents = d->contents, *fall = d->fall;
+	int n = render.g[Q].w * render.g[Q].h;
+
+	*d = f->b[Q];
+	d->contents = contents;
+	d->fall = fall;
+	memcpy(d->contents, f->b[Q].contents, n);
+	memcpy(d->fall, f->b[Q].fall, n);
+    }
+    render.drawn_valid = 1;
+}
+
+/***************************************************************************
+ *      render_draw()
+ * Draws whatever is different in frame f from what is on the screen.
+ * Returns 1 if that was anything.
+ ***************************************************************************/
+static int
+render_draw(Render_Frame *f)
+{
+    double start = sim_now();
+    Uint32 now = SDL_GetTicks();
+    int Q, drew = !render.drawn_valid;
+
+    for (Q=0; Q<render.nboard; Q++) {
+	render_place(Q, &f->b[Q], f->at, now);
+	if (!render.drawn_valid ||
+		!render_same(Q, &f->b[Q], &render.drawn.b[Q])) {
+	    render_board(Q, &f->b[Q]);
+	    drew = 1;
+	}
+	if (!render.drawn_valid || f->b[Q].score != render.drawn.b[Q].score) {
+	    draw_score_as(render.session, Q, f->b[Q].score);
+	    drew = 1;
+	}
+    }
+    if (!render.drawn_valid || f->seconds != render.drawn.seconds) {
+	draw_clock(render.session, f->seconds);
+	drew = 1;
+    }
+    render_keep(f);
+    if (drew) {		/* the rest cost next to nothing */
+	render.frames++;
+	render.draw_time += sim_now() - start;
+    }
+    return drew;
+}
+
+/***************************************************************************
+ *      render_swap()
+ * Puts "with" in the middle and returns what was there. Every frame
+ * written before is seen by whoever swaps it out.
+ ***************************************************************************/
+static int
+render_swap(int with)
+{
+    int old;
+
+    do 
+	old = __sync_fetch_and_or(&render.middle, 0);
+    while (!__sync_bool_compare_and_swap(&render.middle, old, with));
+    return old;
+}
+
+/***************************************************************************
+ *      render_take()
+ * Swaps the render thread's frame for the newest one, if there is a new
+ * one. Returns 1 if there was.
+ ***************************************************************************/
+static int
+render_take(void)
+{
+    int old;
+
+    if (!RENDER_WAITING())
+	return 0;
+    old = render_swap(render.front);
+    render.front = old & RENDER_INDEX;
+    return 1;
+}
+
+/***************************************************************************
+ *      render_thread()
+ * Every 1/RENDER_RATE of a second, draws the newest frame (or the last one
+ * again, with the piece further along), until render_stop().
+ ***************************************************************************/
+static int
+render_thread(void *arg)
+{
+    Uint32 next = SDL_GetTicks();
+    int have = 0, quit;
+
+    for (;;) {
+	Sint32 wait;
+
+	SDL_mutexP(render.wake_lock);
+	while (!render.quit &&
+		(wait = (Sint32) (next - SDL_GetTicks())) > 0)
+	    SDL_CondWaitTimeout(render.wake, render.wake_lock, wait);
+	quit = render.quit;
+	SDL_mutexV(render.wake_lock);
+
+	if (render_take())
+	    have = 1;
+	if (have) {
+	    int drew = 0;
+
+	    SDL_mutexP(render.lock);
+	    if (!render.paused)
+		drew = render_draw(&render.frame[render.front]);
+	    SDL_mutexV(render.lock);
+	    if (drew)	/* it may have read input meant for the event loop */
+		idle_wake();
+	}
+	if (quit)
+	    return 0;
+	next += 1000 / RENDER_RATE;
+	if ((Sint32) (next - SDL_GetTicks()) < 0)
+	    next = SDL_GetTicks();	/* fell behind: do not try to catch up */
+    }
+}
+
+/***************************************************************************
+ *      render_start()
+ * Starts drawing session s's boards g[0] to g[nboard-1] (covered by its
+ * distractions when blanked) on the render thread, unless
+ * Options.render_thread says not to. Returns 1 if the caller must leave
+ * them to it.
+ *********************************************************************PROTO*/
+int
+render_start(Session *s, Grid g[], color_style *cs[], int nboard)
+{
+    int i;
+
+    if (!Options.render_thread || render.running || nboard < 1)
+	return render.running;
+    Assert(nboard <= RENDER_MAX_BOARD);
+    if (!render.lock) {
+	render.lock = SDL_CreateMutex();
+	render.wake_lock = SDL_CreateMutex();
+	render.wake = SDL_CreateCond();
+	if (!render.lock || !render.wake_lock || !render.wake)
+	    PANIC("Cannot create the render locks: %s", SDL_GetError());
+    }
+    render.nboard = nboard;
+    for (i=0; i<nboard; i++) {
+	render.g[i] = g[i];
+	render.cs[i] = cs[i];
+    }
+    render.session = s;
+    for (i=0; i<3; i++)
+	render_alloc(&render.frame[i]);
+    render_alloc(&render.drawn);
+    render.drawn_valid = 0;
+    render.back = 0;
+    render.middle = 1;
+    render.front = 2;
+    render.quit = 0;
+    render.paused = 0;
+    render.published = render.frames = 0;
+    render.draw_time = 0;
+
+    render.thread = SDL_CreateThread(render_thread, NULL);
+    if (!render.thread) {
+	Debug("Cannot create the render thread (%s), drawing in line.\n",
+		SDL_GetError());
+	for (i=0; i<3; i++)
+	    render_release(&render.frame[i]);
+	render_release(&render.drawn);
+	return 0;
+    }
+    render.running = 1;
+    return 1;
+}
+
+/***************************************************************************
+ *      render_stop()
+ * Draws the last frame once more and stops the render thread.
+ *********************************************************************PROTO*/
+void
+render_stop(void)
+{
+    int i;
+
+    if (!render.running)
+	return;
+    SDL_mutexP(render.wake_lock);
+    render.quit = 1;
+    SDL_CondSignal(render.wake);
+    SDL_mutexV(render.wake_lock);
+    SDL_WaitThread(render.thread, NULL);
+    render.running = 0;
+
+    Debug("Render: %lu frames drawn of %lu, %.2f ms each.\n",
+	    render.frames, render.published, render.frames ?
+	    1000.0 * render.draw_time / render.frames : 0.0);
+    for (i=0; i<3; i++)
+	render_release(&render.frame[i]);
+    render_release(&render.drawn);
+}
+
+/***************************************************************************
+ *      render_frame()
+ * The frame for the event loop to fill in and render_publish(). NULL if
+ * the render thread is not running.
+ *********************************************************************PROTO*/
+Render_Frame *
+render_frame(void)
+{
+    return render.running ? &render.frame[render.back] : NULL;
+}
+
+/***************************************************************************
+ *      render_publish()
+ * Hands the frame from render_frame() to the render thread. Never waits
+ * for it to be drawn: if the render thread does not get to it before the
+ * next one comes, it is simply never drawn.
+ *********************************************************************PROTO*/
+void
+render_publish(void)
+{
+    int old;
+
+    if (!render.running)
+	return;
+    old = render_swap(render.back | RENDER_FRESH);
+    render.back = old & RENDER_INDEX;
+    render.published++;
+}
+
+/***************************************************************************
+ *      render_lock()
+ * Keeps the render thread off the screen (and out of SDL) until
+ * render_unlock(). Does nothing if it is not running.
+ *********************************************************************PROTO*/
+void
+render_lock(void)
+{
+    if (render.running)
+	SDL_mutexP(render.lock);
+}
+
+/***************************************************************************
+ *      render_unlock()
+ *********************************************************************PROTO*/
+void
+render_unlock(void)
+{
+    if (render.running)
+	SDL_mutexV(render.lock);
+}
+
+/***************************************************************************
+ *      render_pause()
+ * While the game is paused the screen belongs to the flame and the render
+ * thread draws nothing. Call it between render_lock() and render_unlock().
+ *********************************************************************PROTO*/
+void
+render_pause(int on)
+{
+    render.paused = on;
+}
@@ -0,0 +1,63 @@
+/*
+ *                               Alizarin Tetris
+ * Drawing the boards on a thread of their own.
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+#pragma once
+#ifndef __RENDER_H
+#define __RENDER_H
+#include "grid.h"
+
+#define RENDER_MAX_BOARD	MAX_PLAYERS
+#define RENDER_RATE		60	/* frames a second the thread draws */
+#define RENDER_SLIDE		80	/* ticks squares take to fall a row after
+					   a clear */
+
+/*
+ * What one board looks like at one moment. The squares are the board's
+ * own (REMOVE_ME already taken out); "blank" says how much of a
+ * distraction (see do_blank()) covers them instead. After a clear the
+ * falling squares had been sliding down a row for slide_age ticks: the
+ * render thread works out fall_offset, how many pixels down that takes
+ * them, when it draws.
+ */
+typedef struct render_board_struct {
+    unsigned char *contents;	/* [w*h] */
+    unsigned char *fall;	/* [w*h] */
+    int slide_age;	/* -1 if nothing is sliding */
+    int fall_offset;	/* pixels the falling squares have come down */
+    int blank;		/* -1, or rows of the distraction showing */
+    int piece;		/* is there a piece in play? */
+    play_piece cp;
+    int x, y, rot;	/* ... and where, in screen coordinates */
+    /*
+     * The piece's last fall took it fall_dy pixels down to y, fall_age
+     * ticks ago, and it falls every fall_interval: the render thread slides
+     * it down over that time rather than jumping it. draw_y is where it
+     * was drawn.
+     */
+    int fall_dy;
+    int fall_age;
+    int fall_interval;
+    int draw_y;
+    int score;
+} Render_Board;
+
+/*
+ * Everything the render thread draws, copied out of the event loop once
+ * a pass. The event loop fills one frame while the render thread draws
+ * another, and the third holds the newest finished one: publishing swaps
+ * the event loop's frame with that one and taking swaps the render
+ * thread's, so neither side ever waits for the other or sees a frame
+ * that is half written.
+ */
+typedef struct render_frame_struct {
+    int seconds;	/* on the clock */
+    Uint32 at;		/* SDL_GetTicks() when it was published */
+    Render_Board b[RENDER_MAX_BOARD];
+} Render_Frame;
+
+#include ".protos/render.pro"
+
+#endif
@@ -0,0 +1,367 @@
+/*
+ *                               Alizarin Tetris
+ * Recording headless AI games as training data.
+ *
+ * The games are dealt out to the shards, and each shard is one job on
+ * the worker pool playing its games one after another and writing to
+ * files nobody else touches, so no locking is needed. A game's records
+ * are held until it is over (they need to know who won) and then go out
+ * together with its index entry.
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+
+#include "config.h"
+#include <string.h>
+#include <unistd.h>
+
+#include "atris.h"
+#include "grid.h"
+#include "piece.h"
+#include "ai.h"
+#include "options.h"
+#include "sim.h"
+#include "selfplay.h"
+
+#include ".protos/ai.pro"
+
+/* everything one worker writes */
+typedef struct selfplay_shard_struct {
+    FILE *rec;
+    FILE *idx;
+    Uint64 records;	/* in the file, from this run and earlier ones */
+    Selfplay_Record *game;	/* the game being played */
+    int n;
+    int room;
+    int games;		/* written this run */
+    int written;	/* records written this run */
+    int failed;		/* the files could not be used */
+    AI_Counters *c;	/* per AI */
+} Selfplay_Shard;
+
+/* everything the shard jobs need to see */
+typedef struct selfplay_run_struct {
+    Selfplay *s;
+    AI_Players *ai;
+    piece_style *ps;
+    color_style *cs;
+    int *pick;		/* the AIs that play */
+    int npick;
+    int nshard;
+    int first;		/* the number of this run's first game */
+    Selfplay_Shard *shard;
+} Selfplay_Run;
+
+/* stores a 4-bit value in nibble i of a */
+static void
+selfplay_nibble(Uint8 *a, int i, int v)
+{
+    if (v > 15) v = 15;
+    if (i & 1)
+	a[i/2] |= v << 4;
+    else
+	a[i/2] |= v;
+}
+
+/***************************************************************************
+ *      selfplay_pack_piece()
+ ***************************************************************************/
+static void
+selfplay_pack_piece(piece_style *ps, play_piece *pp, Selfplay_Piece *sp)
+{
+    int c;
+
+    memset(sp, 0, sizeof(*sp));
+    sp->shape = (Uint8) (pp->base - ps->shape);
+    for (c=1; c<=pp->base->num_color && c < 12; c++)
+	selfplay_nibble(sp->colors, c-1, pp->colormap[c]);
+}
+
+/***************************************************************************
+ *      selfplay_record()
+ * The Sim_Game hook: keeps the decision until the game is over.
+ ***************************************************************************/
+static void
+selfplay_record(void *arg, Sim_Game *sg, int P, int col, int row, int rot,
+	int reached)
+{
+    Selfplay_Shard *sh = (Selfplay_Shard *) arg;
+    Sim_Player *me = &sg->p[P];
+    Selfplay_Record *r;
+    int i;
+
+    Assert(me->g.w == SELFPLAY_W && me->g.h == SELFPLAY_H);
+    if (sh->n == sh->room) {
+	sh->room = sh->room ? 2 * sh->room : 256;
+	Realloc(sh->game, Selfplay_Record *,
+		sh->room * sizeof(Selfplay_Record));
+    }
+    r = &sh->game[sh->n++];
+    memset(r, 0, sizeof(*r));
+    for (i=0; i<SELFPLAY_W * SELFPLAY_H; i++)
+	selfplay_nibble(r->board, i, me->g.contents[i]);
+    selfplay_pack_piece(sg->ps, &me->cp, &r->cp);
+    selfplay_pack_piece(sg->ps, &me->np, &r->np);
+    r->col = col;
+    r->row = row;
+    r->rot = rot;
+    r->flags = reached ? 0 : SELFPLAY_UNREACHED;
+    r->player = P;
+    r->ply = me->pieces;
+}
+
+/***************************************************************************
+ *      selfplay_open()
+ * Opens one of a shard's files to append to, writing the header if it is
+ * new and checking it if it is not. A record cut short by a run that
+ * stopped halfway is dropped. *count, if count is not NULL, is how many
+ * records there are already. Returns NULL if the file cannot be used.
+ ***************************************************************************/
+static FILE *
+selfplay_open(const char *filespec, const char *magic, Uint32 size,
+	piece_style *ps, Uint64 *count)
+{
+    FILE *f = fopen(filespec, "r+b");
+    Selfplay_Header want, have;
+    Uint64 n;
+    long end;
+
+    memset(&want, 0, sizeof(want));
+    memcpy(want.magic, magic, 8);
+    want.record_size = size;
+    want.w = SELFPLAY_W;
+    want.h = SELFPLAY_H;
+    strncpy(want.piece_style, ps->name, sizeof(want.piece_style) - 1);
+
+    if (f == NULL) {
+	f = fopen(filespec, "w+b");
+	if (f == NULL) {
+	    Debug("Cannot write [%s]\n", filespec);
+	    return NULL;
+	}
+    }
+    fseek(f, 0, SEEK_END);
+    end = ftell(f);
+    if (end == 0) {
+	fwrite(&want, sizeof(want), 1, f);
+	if (count) *count = 0;
+	return f;
+    }
+    rewind(f);
+    if (fread(&have, sizeof(have), 1, f) != 1 ||
+	    memcmp(&have, &want, sizeof(want))) {
+	Debug("[%s] holds some other kind of records.\n", filespec);
+	fclose(f);
+	return NULL;
+    }
+    n = (end - sizeof(have)) / size;
+    if (count) *count = n;
+    if ((end - sizeof(have)) % size) {
+	Debug("[%s] ends in the middle of a record, dropping it.\n",
+		filespec);
+	fflush(f);
+	if (ftruncate(fileno(f), sizeof(have) + n * size)) {
+	    fclose(f);
+	    return NULL;
+	}
+    }
+    fseek(f, 0, SEEK_END);
+    return f;
+}
+
+/***************************************************************************
+ *      selfplay_recorded()
+ * Reads the index of every shard an earlier run left under s->out and
+ * returns the number the first game of this run should have for its seed
+ * to come after every seed already recorded there. *games is how many
+ * games they hold.
+ ***************************************************************************/
+static int
+selfplay_recorded(Selfplay *s, int *games)
+{
+    char filespec[2048];
+    Uint32 top = 0;
+    int i;
+
+    *games = 0;
+    for (i=0; ; i++) {
+	Selfplay_Game e;
+	FILE *f;
+
+	sprintf(filespec, "%.2000s.%02d.idx", s->out, i);
+	if ((f = fopen(filespec, "rb")) == NULL)
+	    break;
+	if (!fseek(f, sizeof(Selfplay_Header), SEEK_SET))
+	    while (fread(&e, sizeof(e), 1, f) == 1) {
+		if (!*games || e.seed > top)
+		    top = e.seed;
+		(*games)++;
+	    }
+	fclose(f);
+    }
+    if (!*games || top < s->seed)
+	return 0;
+    return top - s->seed + 1;
+}
+
+/***************************************************************************
+ *      selfplay_shard_job()
+ * Plays games i, i + nshard, i + 2*nshard ... of this run and writes them
+ * to shard i. Game k of the run is number sr->first + k: that says its
+ * seed, its level and who plays it.
+ ***************************************************************************/
+static void
+selfplay_shard_job(void *arg, int i)
+{
+    Selfplay_Run *sr = (Selfplay_Run *) arg;
+    Selfplay *s = sr->s;
+    Selfplay_Shard *sh = &sr->shard[i];
+    char filespec[2048];
+    int k;
+
+    sprintf(filespec, "%.2000s.%02d.rec", s->out, i);
+    sh->rec = selfplay_open(filespec, SELFPLAY_MAGIC,
+	    sizeof(Selfplay_Record), sr->ps, &sh->records);
+    sprintf(filespec, "%.2000s.%02d.idx", s->out, i);
+    sh->idx = selfplay_open(filespec, SELFPLAY_INDEX_MAGIC,
+	    sizeof(Selfplay_Game), sr->ps, NULL);
+    if (!sh->rec || !sh->idx) {
+	sh->failed = 1;
+	if (sh->rec) fclose(sh->rec);
+	if (sh->idx) fclose(sh->idx);
+	return;
+    }
+
+    for (k=i; k<s->games; k+=sr->nshard) {
+	Sim_Game sg;
+	Selfplay_Game e;
+	int n = sr->first + k;
+	int a = sr->pick[n % sr->npick];
+	int b = sr->pick[(n / sr->npick) % sr->npick];
+	int j;
+
+	memset(&sg, 0, sizeof(sg));
+	sg.level = s->level ? s->level : 1 + n % 9;
+	sg.seed = s->seed + n;
+	sg.max_pieces = s->max_pieces;
+	sg.ps = sr->ps;
+	sg.cs = sr->cs;
+	sg.p[0].ai = &sr->ai->player[a];
+	sg.p[1].ai = &sr->ai->player[b];
+	sg.record = selfplay_record;
+	sg.record_arg = sh;
+	sh->n = 0;
+	sim_play_game(&sg);
+	ai_counters_sum(&sh->c[a], &sg.p[0].c);
+	ai_counters_sum(&sh->c[b], &sg.p[1].c);
+
+	for (j=0; j<sh->n; j++) {
+	    Selfplay_Record *r = &sh->game[j];
+	    r->outcome = sg.winner < 0 ? 0 : (r->player == sg.winner ? 1 : -1);
+	}
+	memset(&e, 0, sizeof(e));
+	e.first = sh->records;
+	e.records = sh->n;
+	e.seed = sg.seed;
+	e.level = sg.level;
+	e.winner = sg.winner;
+	strncpy(e.ai[0], sg.p[0].ai->name, SELFPLAY_NAME - 1);
+	strncpy(e.ai[1], sg.p[1].ai->name, SELFPLAY_NAME - 1);
+
+	if (fwrite(sh->game, sizeof(Selfplay_Record), sh->n, sh->rec) !=
+		(size_t) sh->n || fwrite(&e, sizeof(e), 1, sh->idx) != 1) {
+	    Debug("Shard %d: write failed, stopping.\n", i);
+	    sh->failed = 1;
+	    break;
+	}
+	sh->records += sh->n;
+	sh->written += sh->n;
+	sh->games++;
+    }
+    fclose(sh->rec);
+    fclose(sh->idx);
+    Free(sh->game);
+}
+
+/***************************************************************************
+ *      selfplay_play()
+ * Plays s->games headless games, spread over s->shards workers, and
+ * appends every decision in them to the shard files. Every AI plays every
+ * AI, itself included, unless s->ai names just one. The games carry on
+ * from those already in the shard files, so no seed is played twice.
+ * Returns 0, or 1 if there was no such AI or nothing could be written.
+ *********************************************************************PROTO*/
+int
+selfplay_play(Selfplay *s, AI_Players *ai, piece_style *ps, color_style *cs)
+{
+    Selfplay_Run sr;
+    AI_Counters *c;
+    double start, elapsed;
+    int i, k, games = 0, records = 0, failed = 0, recorded;
+
+    if (s->max_pieces < 1) s->max_pieces = 1000;
+    sr.s = s;
+    sr.ai = ai;
+    sr.ps = ps;
+    sr.cs = cs;
+    Calloc(sr.pick, int *, ai->n * sizeof(int));
+    sr.npick = 0;
+    for (i=0; i<ai->n; i++)
+	if (!s->ai || !strcasecmp(s->ai, ai->player[i].name))
+	    sr.pick[sr.npick++] = i;
+    if (sr.npick == 0) {
+	Debug("There is no AI called [%s].\n", s->ai);
+	free(sr.pick);
+	return 1;
+    }
+
+    sim_start();
+    sr.nshard = s->shards > 0 ? s->shards : sim_num_cpus();
+    if (sr.nshard > s->games) sr.nshard = s->games;
+    Calloc(sr.shard, Selfplay_Shard *, sr.nshard * sizeof(Selfplay_Shard));
+    for (i=0; i<sr.nshard; i++)
+	Calloc(sr.shard[i].c, AI_Counters *, ai->n * sizeof(AI_Counters));
+
+    sr.first = selfplay_recorded(s, &recorded);
+
+    printf("Self-play: %d games, %d AIs, %d shards, seed %u\n", s->games,
+	    sr.npick, sr.nshard, (unsigned) (s->seed + sr.first));
+    if (recorded)
+	printf("  after the %d games already in [%.2000s.NN.idx]\n",
+		recorded, s->out);
+    fflush(stdout);
+    start = sim_now();
+    sim_run(selfplay_shard_job, &sr, sr.nshard);
+    elapsed = sim_now() - start;
+
+    for (i=0; i<sr.nshard; i++) {
+	Selfplay_Shard *sh = &sr.shard[i];
+	games += sh->games;
+	records += sh->written;
+	failed += sh->failed;
+	printf("  %.2000s.%02d.rec: %d games, %d records (%lu in all)\n",
+		s->out, i, sh->games, sh->written,
+		(unsigned long) sh->records);
+    }
+    printf("%d games, %d records in %.1f seconds (%.0f records/hour)\n",
+	    games, records, elapsed,
+	    elapsed > 0 ? records / elapsed * 3600.0 : 0.0);
+
+    Calloc(c, AI_Counters *, ai->n * sizeof(AI_Counters));
+    for (i=0; i<sr.nshard; i++) {
+	for (k=0; k<ai->n; k++)
+	    ai_counters_sum(&c[k], &sr.shard[i].c[k]);
+	free(sr.shard[i].c);
+    }
+    printf("\n");
+    ai_counters_print(stdout, NULL, NULL);
+    for (k=0; k<sr.npick; k++)
+	ai_counters_print(stdout, ai->player[sr.pick[k]].name,
+		&c[sr.pick[k]]);
+    fflush(stdout);
+
+    free(c);
+    free(sr.shard);
+    free(sr.pick);
+    return failed == sr.nshard;
+}
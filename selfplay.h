@@ -0,0 +1,85 @@
+/*
+ *                               Alizarin Tetris
+ * Recording headless AI games as training data.
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+#pragma once
+#ifndef __SELFPLAY_H
+#define __SELFPLAY_H
+#include "ai.h"
+#include "sim.h"
+
+/* what the command line asked for */
+typedef struct selfplay_struct {
+    int games;		/* 0 = no self-play */
+    int level;		/* 0 = levels 1 through 9 in turn */
+    Uint32 seed;	/* game k is played on seed + k; see selfplay_play() */
+    int max_pieces;	/* per player per game before calling it a draw */
+    int shards;		/* files written side by side, 0 = one per CPU */
+    char *ai;		/* just this AI, against itself; NULL = everybody */
+    char *out;		/* shard i is out.i.rec and out.i.idx */
+} Selfplay;
+
+/*
+ * A shard is two files, both only ever appended to, so a run can pick up
+ * where the last one stopped. The ".rec" file is a Selfplay_Header and
+ * then one Selfplay_Record per decision: record k starts at
+ * sizeof(Selfplay_Header) + k * sizeof(Selfplay_Record), and the whole
+ * file can be mapped and used as an array. The ".idx" file is a
+ * Selfplay_Header and then one Selfplay_Game per game, saying which
+ * records are its. Everything is in the machine's own byte order.
+ *
+ * Boards are packed two cells to a byte, low nibble first, row by row
+ * from the top: 0 is empty, 1 garbage and 2 on up the colors. A piece is
+ * its number in the piece style and the colors of its blocks
+ * (colormap[1] on), packed the same way.
+ */
+#define SELFPLAY_MAGIC		"ATRISSP1"
+#define SELFPLAY_INDEX_MAGIC	"ATRISSX1"
+#define SELFPLAY_W		10	/* the boards sim_play_game() uses */
+#define SELFPLAY_H		20
+#define SELFPLAY_BOARD_BYTES	((SELFPLAY_W * SELFPLAY_H + 1) / 2)
+#define SELFPLAY_NAME		24
+
+typedef struct selfplay_header_struct {
+    char magic[8];
+    Uint32 record_size;	/* of what follows */
+    Uint16 w;
+    Uint16 h;
+    char piece_style[48];
+} Selfplay_Header;
+
+typedef struct selfplay_piece_struct {
+    Uint8 shape;	/* ps->shape[shape] */
+    Uint8 colors[6];	/* colormap[1] through colormap[11] */
+} Selfplay_Piece;
+
+/* Selfplay_Record flags */
+#define SELFPLAY_UNREACHED	1	/* the AI's goal was out of reach */
+
+typedef struct selfplay_record_struct {
+    Uint8 board[SELFPLAY_BOARD_BYTES];	/* before the piece went down */
+    Selfplay_Piece cp;	/* the piece placed */
+    Selfplay_Piece np;	/* the one the AI could see coming */
+    Sint8 col;		/* where it went, as in AI_Placement */
+    Sint8 row;
+    Uint8 rot;
+    Uint8 flags;
+    Sint8 outcome;	/* 1 if this player went on to win, -1 lose, 0 draw */
+    Uint8 player;	/* 0 or 1 */
+    Uint16 ply;		/* pieces this player had placed before */
+} Selfplay_Record;
+
+typedef struct selfplay_game_struct {
+    Uint64 first;	/* its first record */
+    Uint32 records;
+    Uint32 seed;
+    Uint8 level;
+    Sint8 winner;	/* 0, 1 or -1 for a draw */
+    char ai[2][SELFPLAY_NAME];	/* who played */
+} Selfplay_Game;
+
+#include ".protos/selfplay.pro"
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ *                               Alizarin Tetris
+ * A match, and everything it needs to be played alongside any number of
+ * others: see session.h.
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+
+#include "config.h"
+#include <string.h>
+
+#include "atris.h"
+#include "grid.h"
+#include "piece.h"
+#include "sound.h"
+#include "ai.h"
+#include "timer.h"
+#include "session.h"
+
+#include ".protos/event.pro"
+
+/***************************************************************************
+ *      session_init()
+ * A new match of the given game type: no score, nothing drawn yet. It has
+ * as many boards as that game type always has; a free-for-all (AI_VS_AI,
+ * or SINGLE_VS_AI against several AIs) sets "boards" to more before it
+ * draws the background.
+ *********************************************************************PROTO*/
+void
+session_init(Session *s, GT gametype)
+{
+    memset(s, 0, sizeof(*s));
+    s->gametype = gametype;
+    s->boards = (gametype == SINGLE || gametype == MARATHON ||
+	    gametype == DEMO) ? 1 : 2;
+    s->layout.clock_seconds = -111;
+}
+
+/***************************************************************************
+ *      session_free()
+ * Says how the match's time was spent and gives back what it took.
+ *********************************************************************PROTO*/
+void
+session_free(Session *s)
+{
+    int i;
+
+    event_report(s);
+    if (s->timers.max)
+	timer_free(&s->timers);
+    for (i=0; i<MAX_PLAYERS; i++)
+	free_board(&s->distract[i]);
+}
@@ -0,0 +1,198 @@
+/*
+ *                               Alizarin Tetris
+ * Everything that belongs to one match.
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+#pragma once
+#ifndef __SESSION_H
+#define __SESSION_H
+#include "grid.h"
+#include "piece.h"
+#include "ai.h"
+#include "timer.h"
+#include "latency.h"
+
+/*
+ * Where draw_background() put everything for this match's game type.
+ */
+typedef struct layout_struct {
+    int boards;			/* the first so many had room on screen */
+
+    /* the whole board layout */
+    SDL_Rect grid_border[MAX_PLAYERS];
+    SDL_Rect grid[MAX_PLAYERS];
+
+    SDL_Rect score[MAX_PLAYERS];
+
+    SDL_Rect name[MAX_PLAYERS];
+
+    struct adjust_struct {
+	SDL_Rect symbol[3];
+    } adjust[MAX_PLAYERS];
+
+    SDL_Rect time;
+    SDL_Rect time_border;
+
+    SDL_Rect next_piece_border[MAX_PLAYERS];
+    SDL_Rect next_piece[MAX_PLAYERS];
+
+    SDL_Rect 	  pause;
+
+    int clock_seconds;		/* what draw_clock() last drew */
+} Layout;
+
+/*
+ * One player's side of the event loop's state machine.
+ */
+typedef struct player_state_struct {
+    int 	ai;
+    int 	falling;
+    int 	fall_speed;
+    int 	accept_input;
+    int 	tetris_handling;
+    int 	limbo;
+    int 	other_in_limbo;
+    int 	limbo_sent;
+    int		target;		/* who got our last garbage or blank */
+    int 	draw;
+    Uint32	collide_time;	/* time when your piece merges with the rest */
+    Uint32 	next_draw;
+    Uint32 	draw_timeout;
+    int 	fall_event_interval;
+    int		fall_dy;	/* pixels the last fall step(s) moved us */
+    Uint32	fell_at;	/* ... and the step they were for */
+    Uint32	slide_at;	/* when what is falling after a clear set off */
+    int 	tetris_event_interval;
+    int		ai_interval;
+    int 	ready_for_fast;
+    int 	ready_for_rotate;
+    int		seed;
+    play_piece	cp, np;
+    void *	ai_state;
+    AI_Placement last_drop;	/* where the last piece landed */
+    int		pieces;		/* placed since the level began */
+    AI_Counters	ai_counters;	/* this player's AI's share of the work */
+    int		book;		/* the opening book says cp goes to book_goal */
+    AI_Placement book_goal;
+    double	think_cost;	/* seconds a think() call takes, lately */
+    /* these two are used by tetris_event() */
+    int		check_result;
+    int		num_lines_cleared;
+} Player_State;
+
+/* where one player's piece is, in screen coordinates */
+typedef struct player_pos_struct {
+    int x;
+    int y;
+    int rot;
+    int old_x;
+    int old_y;
+    int old_rot;
+    Command move;
+} Player_Pos;
+
+/*
+ * Turbo (Options.turbo, for AI_VS_AI and DEMO): the game clock jumps
+ * straight to the next deadline instead of waiting for it, nothing makes
+ * a sound and the boards are only drawn every Options.turbo passes.
+ */
+typedef struct turbo_struct {
+    int on;
+    Uint32 clock;		/* the game clock, while it is on */
+    unsigned long passes;
+    unsigned long drawn;
+} Turbo;
+
+/*
+ * How the time between deadlines was spent, over every game this session:
+ * see sched_slack(). All of these are in seconds except the counts.
+ */
+typedef struct sched_stats_struct {
+    unsigned long windows;	/* times there was time to spare */
+    double slack;		/* how much there was */
+    double used;		/* ... of that the AIs thought through */
+    unsigned long late;		/* deadlines an AI made us miss */
+    double overrun;		/* by how much, all told */
+    double worst;		/* ... and at most */
+} Sched_Stats;
+
+/*
+ * Input waiting to be acted on. SDL 1.2 events carry no time, so each one
+ * is stamped when it comes off SDL's queue: at the top of every pass
+ * through the loop and every time sched_slack() looks for a key. How
+ * long it then sits here until the loop gets to it is kept in Input_Lag.
+ */
+#define INPUT_QUEUE	64
+typedef struct input_queue_struct {
+    SDL_Event event[INPUT_QUEUE];
+    Uint32 at[INPUT_QUEUE];	/* SDL_GetTicks() when it was taken */
+    int first;
+    int n;
+} Input_Queue;
+
+#define INPUT_LAG_BUCKETS	5	/* < 1, 2, 5, 10 and more ms */
+typedef struct input_lag_struct {
+    unsigned long events;
+    double total;		/* ms */
+    Uint32 worst;
+    unsigned long bucket[INPUT_LAG_BUCKETS];
+} Input_Lag;
+
+/*
+ * Where the event loop's time goes: see event_phase(). Whatever each
+ * phase took in a pass, all told, goes into its histogram at the end of
+ * the pass, if it ran at all, and the whole pass into PHASE_PASS. Also
+ * how late (by the game clock) each fall came, in PHASE_LATE.
+ */
+#define PHASE_INPUT	0
+#define PHASE_FALL	1
+#define PHASE_TETRIS	2
+#define PHASE_THINK	3	/* the AIs thinking, in their turn or the slack */
+#define PHASE_MOVE	4
+#define PHASE_DRAW	5
+#define PHASE_NET	6
+#define PHASE_SLEEP	7
+#define PHASE_PASS	8
+#define PHASE_LATE	9
+#define PHASES		10
+typedef struct phase_stats_struct {
+    int		on;		/* the phase the loop is in, -1 if none */
+    double	since;		/* sim_now() when it went into it */
+    double	pass;		/* ... and into this pass */
+    double	spent[PHASE_PASS];	/* seconds this pass, -1 if not run */
+    Latency	hist[PHASES];
+} Phase_Stats;
+
+/*
+ * A match: the game type it is (the menu's "gametype" may have moved on),
+ * the scores, where things are on the screen and everything the event
+ * loop keeps from one pass to the next. Nothing in here is shared, so
+ * any number of them can be played at once; the screen, the render
+ * thread and SDL's event queue still belong to whichever one is showing.
+ */
+struct session_struct {
+    GT		gametype;
+    int		boards;		/* in play: see session_init() */
+    int		score[MAX_PLAYERS];
+    Layout	layout;
+
+    Player_State state[MAX_PLAYERS];
+    Player_Pos	pos[MAX_PLAYERS];
+    Grid	distract[MAX_PLAYERS];	/* shown when an opponent does something good */
+
+    Uint32	random;		/* the match's own ZEROTO(): see FastRandom_r() */
+    Timer_Queue	timers;		/* see event_play() */
+    Uint32	paused_ticks;	/* spent paused, this game */
+    int		rendering;	/* someone else draws the boards */
+    Turbo	turbo;
+
+    Input_Queue	input;
+    Input_Lag	input_lag;
+    Sched_Stats	sched;
+    Phase_Stats	phases;
+};
+
+#include ".protos/session.pro"
+
+#endif
@@ -0,0 +1,523 @@
+/*
+ *                               Alizarin Tetris
+ * The headless simulation core. 
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+
+#include "config.h"
+#include <unistd.h>
+
+#include "atris.h"
+#include "grid.h"
+#include "piece.h"
+#include "options.h"
+#include "ai.h"
+#include "sim.h"
+#include "book.h"
+
+#include ".protos/ai.pro"
+
+static SDL_mutex *sim_lock = NULL;
+static SDL_cond *sim_work;	/* signalled when a batch is queued */
+static SDL_cond *sim_finished;	/* signalled when a batch completes */
+static Sim_Batch *sim_queue = NULL;
+static int sim_workers = 0;
+
+/* what the game is currently dealing from, per thread */
+static __thread piece_style *sim_ps = NULL;
+static __thread color_style *sim_cs = NULL;
+
+static __thread Grid sim_scratch_grid[SIM_SCRATCH];
+
+/* pool threads and headless games run the batches they start themselves */
+static __thread int sim_inline = 0;
+
+/* the headless clock: see sim_ticks() */
+static __thread int sim_virtual = 0;
+static __thread Uint32 sim_clock = 0;
+static __thread int sim_reads = 0;
+
+/***************************************************************************
+ *      sim_num_cpus()
+ * How many processors can we keep busy?
+ *********************************************************************PROTO*/
+int
+sim_num_cpus(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > 0)
+	return (int) n;
+#endif
+    return 1;
+}
+
+/***************************************************************************
+ *      sim_worker()
+ * Runs jobs off the queue forever.
+ ***************************************************************************/
+static int
+sim_worker(void *unused)
+{
+    sim_inline = 1;
+    SDL_mutexP(sim_lock);
+    for (;;) {
+	Sim_Batch *b;
+	int i;
+
+	while (sim_queue == NULL)
+	    SDL_CondWait(sim_work, sim_lock);
+	b = sim_queue;
+	i = b->next++;
+	if (b->next == b->n)
+	    sim_queue = b->link;
+	SDL_mutexV(sim_lock);
+
+	b->job(b->arg, i);
+
+	SDL_mutexP(sim_lock);
+	if (++b->done == b->n)
+	    SDL_CondBroadcast(sim_finished);
+    }
+    return 0;
+}
+
+/***************************************************************************
+ *      sim_start()
+ * Starts the worker pool if it is not running yet. Options.ai_threads
+ * says how big it should be; 0 means one thread per processor.
+ *********************************************************************PROTO*/
+void
+sim_start(void)
+{
+    int i;
+
+    if (sim_lock)
+	return;
+    sim_lock = SDL_CreateMutex();
+    sim_work = SDL_CreateCond();
+    sim_finished = SDL_CreateCond();
+    if (!sim_lock || !sim_work || !sim_finished)
+	PANIC("Cannot create the simulation locks: %s", SDL_GetError());
+
+    sim_workers = Options.ai_threads > 0 ? Options.ai_threads : sim_num_cpus();
+    for (i=0; i<sim_workers; i++)
+	if (!SDL_CreateThread(sim_worker, NULL))
+	    PANIC("Cannot create simulation thread %d: %s", i, SDL_GetError());
+    Debug("Simulation pool started (%d threads).\n", sim_workers);
+}
+
+/***************************************************************************
+ *      sim_batch_start()
+ * Queues n jobs and returns at once: poll sim_batch_done() or block in
+ * sim_batch_wait(). The batch must stay put until it is done.
+ *
+ * A job that starts a batch of its own (an AI playing inside a headless
+ * game, say) gets it run right there: every other thread may well be
+ * waiting on a job just like it. So does a headless game, which wants
+ * the answer now and the same answer every time.
+ *********************************************************************PROTO*/
+void
+sim_batch_start(Sim_Batch *b, void (*job)(void *arg, int i), void *arg, int n)
+{
+    Sim_Batch **tail;
+
+    b->job = job;
+    b->arg = arg;
+    b->n = n;
+    b->next = 0;
+    b->done = 0;
+    b->link = NULL;
+    if (n <= 0) 
+	return;
+    if (sim_inline) {
+	for (b->next = 0; b->next < n; b->next++) 
+	    job(arg, b->next);
+	b->done = n;
+	return;
+    }
+
+    sim_start();
+
+    SDL_mutexP(sim_lock);
+    for (tail = &sim_queue; *tail; tail = &(*tail)->link)
+	;
+    *tail = b;
+    SDL_CondBroadcast(sim_work);
+    SDL_mutexV(sim_lock);
+}
+
+/***************************************************************************
+ *      sim_batch_done()
+ * Returns 1 if every job in the batch has finished.
+ *********************************************************************PROTO*/
+int
+sim_batch_done(Sim_Batch *b)
+{
+    int retval;
+
+    if (b->n <= 0 || sim_inline)
+	return 1;
+    SDL_mutexP(sim_lock);
+    retval = (b->done == b->n);
+    SDL_mutexV(sim_lock);
+    return retval;
+}
+
+/***************************************************************************
+ *      sim_batch_wait()
+ * Blocks until every job in the batch has finished.
+ *********************************************************************PROTO*/
+void
+sim_batch_wait(Sim_Batch *b)
+{
+    if (b->n <= 0 || sim_inline)
+	return;
+    SDL_mutexP(sim_lock);
+    while (b->done != b->n)
+	SDL_CondWait(sim_finished, sim_lock);
+    SDL_mutexV(sim_lock);
+}
+
+/***************************************************************************
+ *      sim_run()
+ * Runs job(arg, i) for every i in [0,n) across the pool and waits for
+ * all of them.
+ *********************************************************************PROTO*/
+void
+sim_run(void (*job)(void *arg, int i), void *arg, int n)
+{
+    Sim_Batch b;
+
+    sim_batch_start(&b, job, arg, n);
+    sim_batch_wait(&b);
+}
+
+/***************************************************************************
+ *      sim_scratch()
+ * Returns scratch grid "which" (0 to SIM_SCRATCH-1) of the calling thread,
+ * sized w by h. Its contents are whatever the last caller left there.
+ *********************************************************************PROTO*/
+Grid *
+sim_scratch(int which, int w, int h)
+{
+    Grid *g;
+
+    Assert(which >= 0 && which < SIM_SCRATCH);
+    g = &sim_scratch_grid[which];
+    if (g->contents == NULL || g->w != w || g->h != h) {
+	if (g->contents) 
+	    free_board(g);
+	*g = generate_board(w, h, 0);
+    }
+    return g;
+}
+
+/***************************************************************************
+ *      sim_copy_grid()
+ * Makes "to" look like "from" (contents and falling state).
+ *********************************************************************PROTO*/
+void
+sim_copy_grid(Grid *to, Grid *from)
+{
+    Assert(to->w == from->w && to->h == from->h);
+    memcpy(to->contents, from->contents, from->w * from->h * sizeof(from->contents[0]));
+    memcpy(to->fall, from->fall, from->w * from->h * sizeof(from->fall[0]));
+}
+
+/***************************************************************************
+ *      sim_set_styles()
+ * Tells the AIs on this thread which piece and color styles the pieces
+ * they are given come from, so that they can guess at the ones to come.
+ *********************************************************************PROTO*/
+void
+sim_set_styles(piece_style *ps, color_style *cs)
+{
+    sim_ps = ps;
+    sim_cs = cs;
+}
+
+/***************************************************************************
+ *      sim_get_styles()
+ * Returns 0 if nobody has called sim_set_styles() on this thread.
+ *********************************************************************PROTO*/
+int
+sim_get_styles(piece_style **ps, color_style **cs)
+{
+    *ps = sim_ps;
+    *cs = sim_cs;
+    return sim_ps != NULL && sim_cs != NULL;
+}
+
+/***************************************************************************
+ *      sim_virtual_clock()
+ * Switches the calling thread over to the headless clock (on != 0) or
+ * back to SDL_GetTicks(). 
+ *********************************************************************PROTO*/
+void
+sim_virtual_clock(int on)
+{
+    sim_virtual = on;
+    sim_clock = 0;
+    sim_reads = 0;
+}
+
+/***************************************************************************
+ *      sim_ticks()
+ * What the AIs use for a clock. In a game on the screen that is just
+ * SDL_GetTicks(); headless, a "millisecond" passes every SIM_TICK_READS
+ * times somebody looks at the clock, so an AI that thinks "until the
+ * clock ticks" does the same amount of work on every machine and a game
+ * played from a given seed always comes out the same way.
+ *********************************************************************PROTO*/
+Uint32
+sim_ticks(void)
+{
+    if (!sim_virtual)
+	return SDL_GetTicks();
+    if (++sim_reads >= SIM_TICK_READS) {
+	sim_reads = 0;
+	sim_clock++;
+    }
+    return sim_clock;
+}
+
+/***************************************************************************
+ *      sim_peek_ticks()
+ * What sim_ticks() would say, without counting as a look at the headless
+ * clock: for keeping books on the AIs without changing what they do.
+ *********************************************************************PROTO*/
+Uint32
+sim_peek_ticks(void)
+{
+    return sim_virtual ? sim_clock : SDL_GetTicks();
+}
+
+/***************************************************************************
+ *      sim_now()
+ * Wall-clock seconds, for measuring. Only differences mean anything.
+ *********************************************************************PROTO*/
+double
+sim_now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/***************************************************************************
+ *      sim_fall()
+ * How many pixels a piece falls between AI inputs in an AI_VS_AI game at
+ * the given level.
+ *********************************************************************PROTO*/
+int
+sim_fall(int level)
+{
+    int fei, ai_interval;
+
+    if (SPEED_LEVEL(level) <= 7)
+	fei = 45 - SPEED_LEVEL(level) * 5;
+    else 
+	fei = 16 - SPEED_LEVEL(level);
+    if (fei < 1) fei = 1;
+    ai_interval = min(fei, 15);
+    return (ai_interval * 5 + fei - 1) / fei;
+}
+
+/***************************************************************************
+ *      sim_decide()
+ * Has the AI decide where piece cp goes, the way it would in a headless
+ * game: ai_new_piece() (played is where the last piece went, or NULL),
+ * then the opening book (see book_lookup(): "pieces" have been placed on
+ * g so far), then think() until target()
+ * has an answer. Either only counts if ai_plan() can steer the piece
+ * there at "fall" pixels a step.
+ * AIs without target() steer with move() instead, one input per think().
+ * Returns 1 with the placement in *col, *row and *rot; 0 if the goal was
+ * out of reach, in which case the piece drops where it appeared; and -1
+ * if the piece does not fit on the board at all.
+ *********************************************************************PROTO*/
+int
+sim_decide(AI_Player *ai, void **state, Grid *g, play_piece *cp,
+	play_piece *np, AI_Placement *played, int pieces, int bw, int fall,
+	int *col, int *row, int *rot)
+{
+    int y, i, retval = 1;
+    AI_Placement goal;
+    AI_Plan plan;
+
+    if (!ai_spawn(g, cp, bw, col, &y, rot))
+	return -1;
+    *row = y / bw;
+
+    *state = ai_new_piece(ai, *state, g, cp, played);
+    /* the opening book, if it knows this one, saves the AI the trouble */
+    if (book_lookup(g, pieces, cp, np, &goal) &&
+	    ai_plan(g, cp, bw, *col, y, *rot, &goal, fall, &plan) >= 0) {
+	*col = goal.col;
+	*rot = goal.rot;
+	if (goal.row >= 0)
+	    *row = goal.row;
+	return 1;
+    }
+    if (ai->target) {
+	for (i=0; i<SIM_THINK_MAX; i++) {
+	    ai_think(ai, NULL, *state, g, cp, np, *col, *row, *rot);
+	    if (ai->target(*state, g, cp, *row, &goal))
+		break;
+	}
+	/* the piece only goes there if it could have been steered there */
+	if (ai_plan(g, cp, bw, *col, y, *rot, &goal, fall, &plan) >= 0) {
+	    *col = goal.col;
+	    *rot = goal.rot;
+	    if (goal.row >= 0)
+		*row = goal.row;
+	} else 
+	    retval = 0;
+    } else {
+	for (i=0; i<SIM_THINK_MAX; i++) {
+	    Command m;
+	    ai_think(ai, NULL, *state, g, cp, np, *col, y / bw, *rot);
+	    m = ai->move(*state, g, cp, np, *col, y / bw, *rot);
+	    if (ai_step(g, cp, bw, m, fall, col, &y, rot))
+		break;
+	}
+	*row = y / bw;
+    }
+    return retval;
+}
+
+/***************************************************************************
+ *      sim_turn()
+ * Player P gets a piece, decides where it goes and puts it there.
+ * Returns SIM_LOST if the piece did not fit, SIM_WON if that cleared the
+ * last of the garbage and 0 otherwise.
+ ***************************************************************************/
+#define SIM_LOST	1
+#define SIM_WON		2
+static int
+sim_turn(Sim_Game *sg, int P)
+{
+    Sim_Player *me = &sg->p[P];
+    Grid *g = &me->g;
+    int col, row, rot, lines, i, r;
+    Uint32 seed;
+    double start;
+    AI_Counters mark;
+
+    start = sim_now();
+    ai_set_thread_weights(me->weights);
+    ai_counters_mark(&mark);
+    r = sim_decide(me->ai, &me->state, g, &me->cp, &me->np,
+	    me->pieces ? &me->last : NULL, me->pieces, sg->cs->w, sg->fall,
+	    &col, &row, &rot);
+    ai_counters_add(&me->c, &mark);
+    if (r < 0)
+	return SIM_LOST;
+    me->think_time += sim_now() - start;
+    if (r == 0)
+	me->unreachable++;
+    me->decisions++;
+    if (sg->record)
+	sg->record(sg->record_arg, sg, P, col, row, rot, r);
+
+    lines = drop_piece_on_grid(g, &me->cp, col, row, rot);
+    if (lines < 0)
+	return SIM_LOST;
+
+    me->pieces++;
+    me->last.col = col;
+    me->last.row = row;
+    me->last.rot = rot;
+    me->lines += lines;
+    me->score += lines * lines * sg->level;
+    if (lines >= 5) {
+	Grid *them = &sg->p[!P].g;
+	add_garbage_r(them, &sg->garbage_seed);
+	cleanup_grid(them);
+	me->garbage_sent++;
+    }
+
+    for (i=0; i<g->w * g->h; i++)
+	if (g->contents[i] == 1)
+	    break;
+    if (i == g->w * g->h)
+	return SIM_WON;
+
+    me->cp = me->np;
+    seed = me->seq++;
+    me->np = generate_piece_r(sg->ps, sg->cs, &seed);
+    return 0;
+}
+
+/***************************************************************************
+ *      sim_play_game()
+ * Plays one AI_VS_AI game off-screen: both players start on the same
+ * board at sg->level and get the same pieces, and they take turns
+ * placing them. The AIs think on the headless clock for as long as they
+ * like, but the planner must be able to steer the piece to where they
+ * want it at the speed it would fall on the screen. Clearing five lines
+ * or more with one piece sends the other player garbage, as usual.
+ *
+ * The players' ai fields must be set and their state fields are handed
+ * to reset(): NULL gives every game a fresh start. A player whose weights
+ * are not NULL evaluates boards by them instead of the profile. States
+ * are released at the end if the AI knows how.
+ *
+ * Returns the winner (0 or 1), or -1 if nobody had won after
+ * sg->max_pieces pieces each.
+ *********************************************************************PROTO*/
+int
+sim_play_game(Sim_Game *sg)
+{
+    int P, turn;
+    int was_inline = sim_inline;
+    Uint32 seed = sg->seed;
+
+    sim_virtual_clock(1);
+    sim_inline = 1;
+    sim_set_styles(sg->ps, sg->cs);
+
+    sg->fall = sim_fall(sg->level);
+
+    sg->p[0].g = generate_board_r(10, 20, sg->level, &seed);
+    sg->p[1].g = generate_board(10, 20, 0);
+    sim_copy_grid(&sg->p[1].g, &sg->p[0].g);
+    sg->garbage_seed = seed;
+
+    for (P=0; P<2; P++) {
+	Sim_Player *me = &sg->p[P];
+	me->seq = sg->seed;
+	seed = me->seq++;
+	me->cp = generate_piece_r(sg->ps, sg->cs, &seed);
+	seed = me->seq++;
+	me->np = generate_piece_r(sg->ps, sg->cs, &seed);
+	me->score = me->lines = me->pieces = me->decisions = 0;
+	me->garbage_sent = me->unreachable = 0;
+	me->think_time = 0.0;
+	memset(&me->c, 0, sizeof(me->c));
+    }
+
+    sg->winner = -1;
+    for (turn=0; turn < sg->max_pieces && sg->winner < 0; turn++) 
+	for (P=0; P<2; P++) {
+	    int r = sim_turn(sg, P);
+	    if (r == SIM_LOST) { sg->winner = !P; break; }
+	    if (r == SIM_WON) { sg->winner = P; break; }
+	}
+
+    for (P=0; P<2; P++) {
+	Sim_Player *me = &sg->p[P];
+	free_board(&me->g);
+	if (me->ai->release && me->state) {
+	    me->ai->release(me->state);
+	    me->state = NULL;
+	}
+    }
+    ai_set_thread_weights(NULL);
+    sim_virtual_clock(0);
+    sim_inline = was_inline;
+    return sg->winner;
+}
@@ -0,0 +1,82 @@
+/*
+ *                               Alizarin Tetris
+ * The headless simulation core: a pool of worker threads for the AIs and
+ * the off-screen tools, plus the piece source they sample from. 
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+#pragma once
+#ifndef __SIM_H
+#define __SIM_H
+#include "grid.h"
+#include "piece.h"
+#include "ai.h"
+
+/* 
+ * A batch of n independent jobs for the worker pool: job(arg, i) is
+ * called once for every i in [0,n), in no particular order and on no
+ * particular thread. 
+ */
+typedef struct sim_batch_struct {
+    void (*job)(void *arg, int i);
+    void *arg;
+    int n;
+    int next;		/* the next i to hand out */
+    int done;		/* how many have finished */
+    struct sim_batch_struct *link;
+} Sim_Batch;
+
+/* per-thread scratch grids handed out by sim_scratch() */
+#define SIM_SCRATCH	5
+#define SIM_SCRATCH_BATCH	(SIM_SCRATCH-1)	/* ai_batch_drop() uses this one */
+
+/* headless clock: reads per "millisecond", see sim_ticks() */
+#define SIM_TICK_READS	64
+
+/* think() calls an AI gets per piece in a headless game */
+#define SIM_THINK_MAX	(1<<16)
+
+/* One side of a headless game. */
+typedef struct sim_player_struct {
+    AI_Player *ai;
+    void *state;	/* what ai->reset() handed back */
+    const AI_Weights *weights;	/* NULL for the profile */
+    Grid g;
+    play_piece cp;	/* current piece */
+    play_piece np;	/* next piece */
+    Uint32 seq;		/* where the piece sequence is up to */
+    AI_Placement last;	/* where the last piece went */
+
+    int score;
+    int lines;
+    int pieces;		/* placed */
+    int decisions;
+    int garbage_sent;
+    int unreachable;	/* goals the piece could not be steered to */
+    double think_time;	/* wall-clock seconds spent deciding */
+    AI_Counters c;	/* the AI's share of the work */
+} Sim_Player;
+
+/* An AI_VS_AI game played off-screen, see sim_play_game(). */
+typedef struct sim_game_struct {
+    int level;
+    Uint32 seed;	/* the board and the pieces both come from this */
+    int max_pieces;	/* per player, then it is a draw */
+    piece_style *ps;
+    color_style *cs;
+
+    int fall;		/* pixels the piece falls between inputs */
+    Uint32 garbage_seed;
+    Sim_Player p[2];
+    int winner;		/* 0, 1 or -1 for a draw */
+
+    /* if not NULL, told about every decision just before the piece goes
+     * down; reached is 0 if the AI's goal was out of reach */
+    void (*record)(void *arg, struct sim_game_struct *sg, int P,
+	    int col, int row, int rot, int reached);
+    void *record_arg;
+} Sim_Game;
+
+#include ".protos/sim.pro"
+
+#endif
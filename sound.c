@@ -31,6 +31,7 @@
 #include "sound.h"
 
 samples_to_be_played current;	/* what should we play now? */
+static int muted = 0;		/* see sound_mute() */
 
 char *sound_name[NUM_SOUND] = { /* english names */
     "thud", "clear1", "clear4", "levelup", "leveldown" , "garbage1", "clock"
@@ -88,6 +89,8 @@ play_sound_unless_already_playing(sound_style *ss, int which, int delay)
 {
     int i;
 
+    if (muted)
+	return;
     if (ss->WAV[which].audio_len == 0) {
 	if (strcmp(ss->name,"No Sound"))
 		Debug("No [%s] sound in Sound Style [%s]\n", 
@@ -152,6 +155,8 @@ play_sound(sound_style *ss, int which, int delay)
 {
     int i;
 
+    if (muted)
+	return;
     if (ss->WAV[which].audio_len == 0) {
 	if (strcmp(ss->name,"No Sound"))
 		Debug("No [%s] sound in Sound Style [%s]\n", 
@@ -194,6 +199,18 @@ stop_all_playing(void)
     return;
 }
 
+/***************************************************************************
+ *      sound_mute()
+ * While on, nothing new is played (turbo games would only make a din).
+ *********************************************************************PROTO*/
+void
+sound_mute(int on)
+{
+    muted = on;
+    if (on)
+	stop_all_playing();
+}
+
 /***************************************************************************
  *      play_all_sounds()
  * Schedule all of the sounds associated with a given style to be played.
@@ -0,0 +1,175 @@
+/*
+ *                               Alizarin Tetris
+ * A queue of deadlines, soonest first: what the event loop sleeps until.
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+
+#include "config.h"
+#include <string.h>
+
+#include "atris.h"
+#include "timer.h"
+
+/* is tick a before tick b? */
+#define TIMER_BEFORE(a,b)	((Sint32) ((a) - (b)) < 0)
+
+/***************************************************************************
+ *      timer_place()
+ * Puts t at heap[i] and remembers that it is there.
+ ***************************************************************************/
+static void
+timer_place(Timer_Queue *q, int i, Timer t)
+{
+    q->heap[i] = t;
+    q->at[t.id] = i;
+}
+
+/***************************************************************************
+ *      timer_up()
+ * Moves heap[i] towards the top until its parent is not due after it.
+ ***************************************************************************/
+static void
+timer_up(Timer_Queue *q, int i)
+{
+    Timer t = q->heap[i];
+
+    while (i > 0 && TIMER_BEFORE(t.when, q->heap[(i-1)/2].when)) {
+	timer_place(q, i, q->heap[(i-1)/2]);
+	i = (i-1)/2;
+    }
+    timer_place(q, i, t);
+}
+
+/***************************************************************************
+ *      timer_down()
+ * Moves heap[i] towards the bottom until neither child is due before it.
+ ***************************************************************************/
+static void
+timer_down(Timer_Queue *q, int i)
+{
+    Timer t = q->heap[i];
+    int c;
+
+    while ((c = 2*i + 1) < q->n) {
+	if (c+1 < q->n && TIMER_BEFORE(q->heap[c+1].when, q->heap[c].when))
+	    c++;
+	if (!TIMER_BEFORE(q->heap[c].when, t.when))
+	    break;
+	timer_place(q, i, q->heap[c]);
+	i = c;
+    }
+    timer_place(q, i, t);
+}
+
+/***************************************************************************
+ *      timer_init()
+ * Room for timers 0 to max-1, none of them armed.
+ *********************************************************************PROTO*/
+void
+timer_init(Timer_Queue *q, int max)
+{
+    int i;
+
+    q->n = 0;
+    q->max = max;
+    Calloc(q->heap, Timer *, max * sizeof(Timer));
+    Malloc(q->at, int *, max * sizeof(int));
+    for (i=0; i<max; i++)
+	q->at[i] = -1;
+}
+
+/***************************************************************************
+ *      timer_free()
+ * Gives back what timer_init() took.
+ *********************************************************************PROTO*/
+void
+timer_free(Timer_Queue *q)
+{
+    Free(q->heap);
+    Free(q->at);
+    q->n = q->max = 0;
+}
+
+/***************************************************************************
+ *      timer_set()
+ * Arms timer id for tick "when", or moves it there if it was armed.
+ *********************************************************************PROTO*/
+void
+timer_set(Timer_Queue *q, int id, Uint32 when)
+{
+    int i = q->at[id];
+    Timer t;
+
+    Assert(id >= 0 && id < q->max);
+    t.when = when;
+    t.id = id;
+    if (i < 0) {
+	i = q->n++;
+	timer_place(q, i, t);
+	timer_up(q, i);
+    } else if (TIMER_BEFORE(when, q->heap[i].when)) {
+	timer_place(q, i, t);
+	timer_up(q, i);
+    } else {
+	timer_place(q, i, t);
+	timer_down(q, i);
+    }
+}
+
+/***************************************************************************
+ *      timer_cancel()
+ * Disarms timer id, if it was armed.
+ *********************************************************************PROTO*/
+void
+timer_cancel(Timer_Queue *q, int id)
+{
+    int i = q->at[id];
+    Timer last;
+
+    if (i < 0)
+	return;
+    q->at[id] = -1;
+    if (i == --q->n)
+	return;
+    /* the last one takes its place and goes whichever way it must */
+    last = q->heap[q->n];
+    timer_place(q, i, last);
+    timer_up(q, i);
+    if (q->at[last.id] == i)
+	timer_down(q, i);
+}
+
+/***************************************************************************
+ *      timer_when()
+ * When timer id is due. Only means something if it is armed.
+ *********************************************************************PROTO*/
+Uint32
+timer_when(Timer_Queue *q, int id)
+{
+    return q->at[id] < 0 ? 0 : q->heap[q->at[id]].when;
+}
+
+/***************************************************************************
+ *      timer_due()
+ * Is timer id armed and due at tick "now"?
+ *********************************************************************PROTO*/
+int
+timer_due(Timer_Queue *q, int id, Uint32 now)
+{
+    return q->at[id] >= 0 && !TIMER_BEFORE(now, q->heap[q->at[id]].when);
+}
+
+/***************************************************************************
+ *      timer_next()
+ * Returns the id of the next timer due and puts its tick in *when, or
+ * returns -1 if none is armed.
+ *********************************************************************PROTO*/
+int
+timer_next(Timer_Queue *q, Uint32 *when)
+{
+    if (q->n == 0)
+	return -1;
+    *when = q->heap[0].when;
+    return q->heap[0].id;
+}
@@ -0,0 +1,33 @@
+/*
+ *                               Alizarin Tetris
+ * A queue of deadlines, soonest first.
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+#pragma once
+#ifndef __TIMER_H
+#define __TIMER_H
+
+/*
+ * Every timer has an id from 0 to max-1 and is either armed, with the
+ * tick it is due at, or not. The armed ones are kept in a binary heap on
+ * "when", so the next one due is always heap[0] and arming, moving or
+ * disarming one costs log(n). at[id] is where timer id is in the heap.
+ * Ticks are compared as (Sint32) (a - b), so SDL_GetTicks() wrapping
+ * around does no harm.
+ */
+typedef struct timer_struct {
+    Uint32 when;
+    int id;
+} Timer;
+
+typedef struct timer_queue_struct {
+    int n;		/* armed timers */
+    int max;
+    Timer *heap;	/* [max], the first n in use */
+    int *at;		/* [max], -1 if that timer is not armed */
+} Timer_Queue;
+
+#include ".protos/timer.pro"
+
+#endif
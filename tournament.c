@@ -0,0 +1,229 @@
+/*
+ *                               Alizarin Tetris
+ * Headless round-robin tournaments between the AI players.
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+
+#include "config.h"
+#include <math.h>
+
+#include "atris.h"
+#include "grid.h"
+#include "piece.h"
+#include "ai.h"
+#include "options.h"
+#include "sim.h"
+#include "tournament.h"
+
+#include ".protos/ai.pro"
+
+/* everything the game jobs need to see */
+typedef struct tournament_run_struct {
+    Tournament *t;
+    AI_Players *ai;
+    piece_style *ps;
+    color_style *cs;
+    int *first;		/* pairing k is first[k] against second[k] */
+    int *second;
+    Sim_Game *game;	/* t->games per pairing */
+} Tournament_Run;
+
+/***************************************************************************
+ *      tournament_game_job()
+ * Plays game i of the tournament. The games of a pairing come in twos on
+ * the same seed, so each AI gets to move first on every deal.
+ ***************************************************************************/
+static void
+tournament_game_job(void *arg, int i)
+{
+    Tournament_Run *tr = (Tournament_Run *) arg;
+    Tournament *t = tr->t;
+    Sim_Game *sg = &tr->game[i];
+    int k = i / t->games, r = i % t->games;
+    int a = tr->first[k], b = tr->second[k];
+
+    if (r & 1) {
+	int swap = a; a = b; b = swap;
+    }
+
+    sg->level = t->level;
+    sg->seed = t->seed + r / 2;
+    sg->max_pieces = t->max_pieces;
+    sg->ps = tr->ps;
+    sg->cs = tr->cs;
+    sg->p[0].ai = &tr->ai->player[a];
+    sg->p[0].state = NULL;
+    sg->p[1].ai = &tr->ai->player[b];
+    sg->p[1].state = NULL;
+
+    sim_play_game(sg);
+}
+
+/***************************************************************************
+ *      tournament_elo()
+ * Fits Bradley-Terry strengths to the results (score[i*n+j] is what i
+ * scored against j, a draw being half a win, out of games[i*n+j]) and
+ * puts them on the Elo scale around TOURNAMENT_ELO_BASE. Everybody is
+ * given one extra draw against everybody else so that a perfect record
+ * does not come out infinite.
+ ***************************************************************************/
+static void
+tournament_elo(int n, double *score, double *games, Tournament_Record *rec)
+{
+    double *gamma, *next;
+    int i, j, iter;
+
+    Calloc(gamma, double *, n * sizeof(*gamma));
+    Calloc(next, double *, n * sizeof(*next));
+    for (i=0; i<n; i++)
+	gamma[i] = 1.0;
+
+    for (iter=0; iter<1000; iter++) {
+	double change = 0.0, logsum = 0.0;
+
+	for (i=0; i<n; i++) {
+	    double w = 0.0, d = 0.0;
+	    for (j=0; j<n; j++) {
+		if (j == i) continue;
+		w += score[i*n+j] + 0.5;
+		d += (games[i*n+j] + 1.0) / (gamma[i] + gamma[j]);
+	    }
+	    next[i] = d > 0 ? w / d : 1.0;
+	    logsum += log(next[i]);
+	}
+	for (i=0; i<n; i++) {
+	    double g = next[i] / exp(logsum / n);
+	    change = max(change, fabs(g - gamma[i]) / gamma[i]);
+	    gamma[i] = g;
+	}
+	if (change < 1e-9)
+	    break;
+    }
+    for (i=0; i<n; i++)
+	rec[i].elo = TOURNAMENT_ELO_BASE + 400.0 * log10(gamma[i]);
+    free(gamma);
+    free(next);
+}
+
+/***************************************************************************
+ *      tournament_play()
+ * Plays t->games games between every two AIs, spread over the worker
+ * pool, and prints how everybody did. Nothing is drawn and nothing is
+ * heard: the styles may have been loaded without a screen. Returns 0.
+ *********************************************************************PROTO*/
+int
+tournament_play(Tournament *t, AI_Players *ai, piece_style *ps,
+	color_style *cs)
+{
+    Tournament_Run tr;
+    Tournament_Record *rec;
+    double *score, *games;
+    double start, elapsed;
+    int n = ai->n, npair = n * (n-1) / 2, ngame, total_pieces = 0;
+    int i, j, k;
+
+    if (t->games < 1) t->games = 1;
+    if (t->max_pieces < 1) t->max_pieces = 1000;
+    ngame = npair * t->games;
+
+    tr.t = t;
+    tr.ai = ai;
+    tr.ps = ps;
+    tr.cs = cs;
+    Calloc(tr.first, int *, npair * sizeof(int));
+    Calloc(tr.second, int *, npair * sizeof(int));
+    Calloc(tr.game, Sim_Game *, ngame * sizeof(Sim_Game));
+    k = 0;
+    for (i=0; i<n; i++)
+	for (j=i+1; j<n; j++) {
+	    tr.first[k] = i;
+	    tr.second[k] = j;
+	    k++;
+	}
+
+    sim_start();
+    printf("Tournament: %d AIs, %d games per pairing, level %d, seed %u, "
+	    "%d threads\n", n, t->games, t->level, (unsigned) t->seed,
+	    Options.ai_threads > 0 ? Options.ai_threads : sim_num_cpus());
+    fflush(stdout);
+
+    start = sim_now();
+    sim_run(tournament_game_job, &tr, ngame);
+    elapsed = sim_now() - start;
+
+    /* add it all up */
+    Calloc(rec, Tournament_Record *, n * sizeof(*rec));
+    Calloc(score, double *, n * n * sizeof(*score));
+    Calloc(games, double *, n * n * sizeof(*games));
+    for (k=0; k<ngame; k++) {
+	Sim_Game *sg = &tr.game[k];
+	int who[2];
+	int P;
+
+	who[0] = sg->p[0].ai - ai->player;
+	who[1] = sg->p[1].ai - ai->player;
+	for (P=0; P<2; P++) {
+	    Tournament_Record *r = &rec[who[P]];
+	    Sim_Player *sp = &sg->p[P];
+	    r->games++;
+	    if (sg->winner < 0) r->drawn++;
+	    else if (sg->winner == P) r->won++;
+	    else r->lost++;
+	    r->pieces += sp->pieces;
+	    r->lines += sp->lines;
+	    r->decisions += sp->decisions;
+	    r->unreachable += sp->unreachable;
+	    r->think_time += sp->think_time;
+	    ai_counters_sum(&r->c, &sp->c);
+	    total_pieces += sp->pieces;
+
+	    games[who[P]*n + who[!P]] += 1.0;
+	    score[who[P]*n + who[!P]] +=
+		sg->winner < 0 ? 0.5 : (sg->winner == P ? 1.0 : 0.0);
+	}
+    }
+    tournament_elo(n, score, games, rec);
+
+    printf("\n%-16s %6s %6s %6s %6s %7s %7s %9s %11s %6s\n",
+	    "AI", "Games", "Won", "Lost", "Drawn", "Win%", "Elo",
+	    "Lines/pc", "Placed/sec", "Stuck");
+    for (i=0; i<n; i++) {
+	Tournament_Record *r = &rec[i];
+	printf("%-16.16s %6d %6d %6d %6d %6.1f%% %7.0f %9.3f %11.0f %6d\n",
+		ai->player[i].name, r->games, r->won, r->lost, r->drawn,
+		r->games ? 100.0 * (r->won + 0.5 * r->drawn) / r->games : 0.0,
+		r->elo,
+		r->pieces ? (double) r->lines / r->pieces : 0.0,
+		r->think_time > 0 ? r->decisions / r->think_time : 0.0,
+		r->unreachable);
+    }
+
+    printf("\nScore of row against column:\n%-16s", "");
+    for (j=0; j<n; j++)
+	printf(" %7.7s", ai->player[j].name);
+    printf("\n");
+    for (i=0; i<n; i++) {
+	printf("%-16.16s", ai->player[i].name);
+	for (j=0; j<n; j++)
+	    if (i == j || games[i*n+j] == 0)
+		printf(" %7s", "-");
+	    else
+		printf(" %6.1f%%", 100.0 * score[i*n+j] / games[i*n+j]);
+	printf("\n");
+    }
+    printf("\nWhere the time went:\n");
+    ai_counters_print(stdout, NULL, NULL);
+    for (i=0; i<n; i++)
+	ai_counters_print(stdout, ai->player[i].name, &rec[i].c);
+
+    printf("\n%d games, %d placements in %.2f seconds "
+	    "(%.1f games/sec, %.0f placements/sec)\n", ngame, total_pieces,
+	    elapsed, elapsed > 0 ? ngame / elapsed : 0.0,
+	    elapsed > 0 ? total_pieces / elapsed : 0.0);
+    fflush(stdout);
+
+    free(rec); free(score); free(games);
+    free(tr.first); free(tr.second); free(tr.game);
+    return 0;
+}
@@ -0,0 +1,40 @@
+/*
+ *                               Alizarin Tetris
+ * Headless round-robin tournaments between the AI players.
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+#pragma once
+#ifndef __TOURNAMENT_H
+#define __TOURNAMENT_H
+#include "ai.h"
+#include "sim.h"
+
+/* what the command line asked for */
+typedef struct tournament_struct {
+    int games;		/* per pair of AIs, 0 = no tournament */
+    int level;
+    Uint32 seed;
+    int max_pieces;	/* per player per game before calling it a draw */
+} Tournament;
+
+/* how one AI did over the whole tournament */
+typedef struct tournament_record_struct {
+    int games;
+    int won;
+    int lost;
+    int drawn;
+    int pieces;
+    int lines;
+    int decisions;
+    int unreachable;
+    double think_time;
+    double elo;
+    AI_Counters c;
+} Tournament_Record;
+
+#define TOURNAMENT_ELO_BASE	1500.0
+
+#include ".protos/tournament.pro"
+
+#endif
@@ -0,0 +1,271 @@
+/*
+ *                               Alizarin Tetris
+ * Tuning the AI evaluator weights by playing lots of headless games.
+ *
+ * The search is a separable CMA-ES (an evolution strategy that adapts a
+ * step size and one variance per weight): every generation it samples a
+ * handful of weight vectors around its mean, each plays t->games games
+ * against the weights we started from, and the mean moves towards the
+ * ones that won the most.
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+
+#include "config.h"
+#include <math.h>
+
+#include "atris.h"
+#include "grid.h"
+#include "piece.h"
+#include "ai.h"
+#include "options.h"
+#include "sim.h"
+#include "tune.h"
+
+#include ".protos/ai.pro"
+
+/* everything the game jobs need to see */
+typedef struct tune_run_struct {
+    Tuner *t;
+    AI_Player *ai;
+    piece_style *ps;
+    color_style *cs;
+    Uint32 seed;	/* this generation's deals start here */
+    AI_Weights *cand;	/* lambda candidates */
+    Sim_Game *game;	/* t->games per candidate */
+} Tune_Run;
+
+/***************************************************************************
+ *      tune_normal()
+ * A standard normal deviate (Box-Muller).
+ ***************************************************************************/
+static double
+tune_normal(Uint32 *seed)
+{
+    double u, v;
+
+    u = (FastRandom_r(seed, 65535) * 65536.0 + FastRandom_r(seed, 65535)
+	    + 1.0) / 4294967296.0;
+    v = (FastRandom_r(seed, 65535) * 65536.0 + FastRandom_r(seed, 65535))
+	/ 4294967296.0;
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+/***************************************************************************
+ *      tune_game_job()
+ * Game i of a generation: candidate i / t->games against the starting
+ * weights. The games of a candidate come in twos on the same deal, one
+ * from each side, and every candidate gets the same deals.
+ ***************************************************************************/
+static void
+tune_game_job(void *arg, int i)
+{
+    Tune_Run *tr = (Tune_Run *) arg;
+    Tuner *t = tr->t;
+    Sim_Game *sg = &tr->game[i];
+    int c = i / t->games, r = i % t->games;
+    int us = r & 1;
+
+    sg->level = t->level;
+    sg->seed = tr->seed + r / 2;
+    sg->max_pieces = t->max_pieces;
+    sg->ps = tr->ps;
+    sg->cs = tr->cs;
+    sg->p[0].ai = sg->p[1].ai = tr->ai;
+    sg->p[0].state = sg->p[1].state = NULL;
+    sg->p[us].weights = &tr->cand[c];
+    sg->p[!us].weights = NULL;
+
+    sim_play_game(sg);
+}
+
+/***************************************************************************
+ *      tune_play()
+ * Runs the tuner and writes the best weights found to t->out as a
+ * profile for --profile. The weights not being tuned stay as they are in
+ * the current profile. Returns 0, or 1 if there was nothing to tune.
+ *********************************************************************PROTO*/
+int
+tune_play(Tuner *t, AI_Players *ais, piece_style *ps, color_style *cs)
+{
+    Tune_Run tr;
+    AI_Weights start_w, best_w;
+    double start_v[AI_WEIGHTS_N], scale[AI_WEIGHTS_N];
+    int dim[AI_WEIGHTS_N];
+    double *mean, *C, *pc, *ps_path, *z, *y, *yw, *fit, *wgt;
+    int *order;
+    int n = 0, lambda, mu, ngame, gen, i, j, k;
+    double mueff, c_sigma, d_sigma, c_c, c_1, c_mu, chi_n, sigma = 0.15;
+    double best_fit = -1.0;
+    Uint32 rng = t->seed;
+    char *who = (t->family == TUNE_ALIZ) ? TUNE_ALIZ_AI : TUNE_WES_AI;
+
+    tr.ai = NULL;
+    for (i=0; i<ais->n; i++)
+	if (!strcmp(ais->player[i].name, who))
+	    tr.ai = &ais->player[i];
+    if (!tr.ai) {
+	printf("Tuner: there is no [%s] to tune.\n", who);
+	return 1;
+    }
+
+    /* the weights in play, measured in units of their starting values */
+    ai_get_profile(&start_w);
+    best_w = start_w;
+    ai_weights_get(&start_w, start_v);
+    for (i=0; i<AI_WEIGHTS_N; i++) {
+	int wes = (i < AI_BADNESS_W + 2);
+	if (wes == (t->family == TUNE_WES)) {
+	    scale[n] = start_v[i] != 0 ? fabs(start_v[i]) : 1.0;
+	    dim[n++] = i;
+	}
+    }
+
+    /* the usual CMA-ES constants, with the separable learning rates */
+    lambda = 4 + (int) (3 * log(n));
+    mu = lambda / 2;
+    Calloc(wgt, double *, mu * sizeof(double));
+    for (i=0, mueff=0; i<mu; i++) {
+	wgt[i] = log(mu + 0.5) - log(i + 1.0);
+	mueff += wgt[i];
+    }
+    for (i=0; i<mu; i++)
+	wgt[i] /= mueff;
+    for (i=0, mueff=0; i<mu; i++)
+	mueff += wgt[i] * wgt[i];
+    mueff = 1.0 / mueff;
+    c_sigma = (mueff + 2) / (n + mueff + 5);
+    d_sigma = 1 + 2 * max(0.0, sqrt((mueff - 1) / (n + 1)) - 1) + c_sigma;
+    c_c = (4 + mueff / n) / (n + 4 + 2 * mueff / n);
+    c_1 = 2 / ((n + 1.3) * (n + 1.3) + mueff) * (n + 2) / 3.0;
+    c_mu = min(1 - c_1, 2 * (mueff - 2 + 1 / mueff) /
+	    ((n + 2) * (n + 2) + mueff) * (n + 2) / 3.0);
+    chi_n = sqrt(n) * (1 - 1.0 / (4 * n) + 1.0 / (21.0 * n * n));
+
+    Calloc(mean, double *, n * sizeof(double));
+    Calloc(C, double *, n * sizeof(double));
+    Calloc(pc, double *, n * sizeof(double));
+    Calloc(ps_path, double *, n * sizeof(double));
+    Calloc(z, double *, lambda * n * sizeof(double));
+    Calloc(y, double *, lambda * n * sizeof(double));
+    Calloc(yw, double *, n * sizeof(double));
+    Calloc(fit, double *, lambda * sizeof(double));
+    Calloc(order, int *, lambda * sizeof(int));
+    for (j=0; j<n; j++)
+	C[j] = 1.0;
+
+    if (t->games < 2) t->games = 2;
+    t->games &= ~1;
+    if (t->max_pieces < 1) t->max_pieces = 1000;
+    ngame = lambda * t->games;
+    tr.t = t;
+    tr.ps = ps;
+    tr.cs = cs;
+    Calloc(tr.cand, AI_Weights *, lambda * sizeof(AI_Weights));
+    Calloc(tr.game, Sim_Game *, ngame * sizeof(Sim_Game));
+
+    sim_start();
+    printf("Tuner: %d %s weights with %s, %d candidates x %d games per "
+	    "generation, level %d\n", n,
+	    t->family == TUNE_ALIZ ? "evalBoard()" : "weight_board()",
+	    who, lambda, t->games, t->level);
+    fflush(stdout);
+
+    for (gen=0; gen<t->generations; gen++) {
+	double ps_norm = 0, start, elapsed, sum_fit = 0;
+	int h_sigma;
+
+	/* sample lambda candidates around the mean */
+	for (k=0; k<lambda; k++) {
+	    double v[AI_WEIGHTS_N];
+	    memcpy(v, start_v, sizeof(v));
+	    for (j=0; j<n; j++) {
+		z[k*n+j] = tune_normal(&rng);
+		y[k*n+j] = sqrt(C[j]) * z[k*n+j];
+		v[dim[j]] = start_v[dim[j]] +
+		    scale[j] * (mean[j] + sigma * y[k*n+j]);
+	    }
+	    tr.cand[k] = start_w;
+	    ai_weights_set(&tr.cand[k], v);
+	}
+
+	/* play them all at once */
+	memset(tr.game, 0, ngame * sizeof(Sim_Game));
+	tr.seed = t->seed + gen * t->games;
+	start = sim_now();
+	sim_run(tune_game_job, &tr, ngame);
+	elapsed = sim_now() - start;
+
+	/*
+	 * Fitness is the score against the starting weights, a draw being
+	 * half a win, with lines per piece to break ties.
+	 */
+	for (k=0; k<lambda; k++) {
+	    double score = 0;
+	    int lines = 0, pieces = 0;
+	    for (i=k*t->games; i<(k+1)*t->games; i++) {
+		Sim_Game *sg = &tr.game[i];
+		int us = (i % t->games) & 1;
+		score += sg->winner < 0 ? 0.5 : (sg->winner == us);
+		lines += sg->p[us].lines;
+		pieces += sg->p[us].pieces;
+	    }
+	    fit[k] = score / t->games +
+		0.01 * (pieces ? (double) lines / pieces : 0);
+	    sum_fit += fit[k];
+	    for (j=k; j>0 && fit[order[j-1]] < fit[k]; j--)
+		order[j] = order[j-1];
+	    order[j] = k;
+	}
+	if (fit[order[0]] > best_fit) {
+	    char comment[256];
+	    best_fit = fit[order[0]];
+	    best_w = tr.cand[order[0]];
+	    sprintf(comment, "%s: fitness %.3f against the starting weights "
+		    "(generation %d, %d games at level %d)", who, best_fit,
+		    gen, t->games, t->level);
+	    ai_save_weights(t->out, &best_w, comment);
+	}
+
+	/* move the mean and adapt the step size and the variances */
+	for (j=0; j<n; j++) {
+	    double zw = 0;
+	    yw[j] = 0;
+	    for (i=0; i<mu; i++) {
+		yw[j] += wgt[i] * y[order[i]*n+j];
+		zw += wgt[i] * z[order[i]*n+j];
+	    }
+	    mean[j] += sigma * yw[j];
+	    ps_path[j] = (1 - c_sigma) * ps_path[j] +
+		sqrt(c_sigma * (2 - c_sigma) * mueff) * zw;
+	    ps_norm += ps_path[j] * ps_path[j];
+	}
+	ps_norm = sqrt(ps_norm);
+	h_sigma = ps_norm / sqrt(1 - pow(1 - c_sigma, 2 * (gen + 1)))
+	    < (1.4 + 2.0 / (n + 1)) * chi_n;
+	for (j=0; j<n; j++) {
+	    double rank_mu = 0;
+	    pc[j] = (1 - c_c) * pc[j] +
+		h_sigma * sqrt(c_c * (2 - c_c) * mueff) * yw[j];
+	    for (i=0; i<mu; i++) {
+		double d = y[order[i]*n+j];
+		rank_mu += wgt[i] * d * d;
+	    }
+	    C[j] = (1 - c_1 - c_mu) * C[j] +
+		c_1 * (pc[j] * pc[j] + (1 - h_sigma) * c_c * (2 - c_c) * C[j]) +
+		c_mu * rank_mu;
+	}
+	sigma *= exp((c_sigma / d_sigma) * (ps_norm / chi_n - 1));
+
+	printf("gen %3d  sigma %.3f  best %.3f  mean %.3f  so far %.3f  "
+		"(%.1f games/sec)\n", gen, sigma, fit[order[0]],
+		sum_fit / lambda, best_fit,
+		elapsed > 0 ? ngame / elapsed : 0.0);
+	fflush(stdout);
+    }
+
+    printf("Best weights (fitness %.3f) are in [%s].\n", best_fit, t->out);
+    free(mean); free(C); free(pc); free(ps_path); free(z); free(y); free(yw);
+    free(fit); free(order); free(wgt); free(tr.cand); free(tr.game);
+    return 0;
+}
@@ -0,0 +1,36 @@
+/*
+ *                               Alizarin Tetris
+ * Tuning the AI evaluator weights by playing lots of headless games.
+ *
+ * Copyright 2000, Westley Weimer & Kiri Wagstaff
+ */
+#pragma once
+#ifndef __TUNE_H
+#define __TUNE_H
+#include "ai.h"
+#include "sim.h"
+
+/* which weights to tune, and who plays with them */
+typedef enum {
+    TUNE_NONE,
+    TUNE_WES,		/* weight_board(), played by TUNE_WES_AI */
+    TUNE_ALIZ,		/* evalBoard(), played by TUNE_ALIZ_AI */
+} Tune_Family;
+
+#define TUNE_WES_AI	"Lightning"
+#define TUNE_ALIZ_AI	"Aliz"
+
+/* what the command line asked for */
+typedef struct tuner_struct {
+    Tune_Family family;
+    int generations;
+    int games;		/* per candidate per generation */
+    int level;
+    Uint32 seed;
+    int max_pieces;
+    char *out;		/* where the best profile goes */
+} Tuner;
+
+#include ".protos/tune.pro"
+
+#endif
@@ -33,6 +33,7 @@
 #include "config.h"
 #include "atris.h"
 #include "options.h"
+#include "idle.h"
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -53,6 +54,9 @@
 #define DELT 0x08		/* Delta code is broken -- Rasterman? */
 #define BLOK 0x20
 #define LACE 0x40
+
+/* frames a second, at most: it used to be as many as the machine could */
+#define FLAME_RATE 30
 /*This structure contains all of the "Global" variables for my program so */
 /*that I just pass a pointer to my functions, not a million parameters */
 struct globaldata
@@ -439,13 +443,36 @@ XFDrawFlame(struct globaldata *g,int *f, int w, int ws, int h, int *ctab)
 static int *flame,flamesize,ws,flamewidth,flameheight,*flame2;
 static struct globaldata *g;
 static int w, h, f, *ctab;
+static Uint32 flame_next;	/* when the next frame is due */
+
+/***************************************************************************
+ *      atris_flame_wait()
+ * How many ms until atris_run_flame() has another frame to draw: how long
+ * whoever runs it can sleep.
+ *********************************************************************PROTO*/
+int
+atris_flame_wait(void)
+{
+    Sint32 wait = flame_next - SDL_GetTicks();
+
+    if (!Options.flame_wanted) return IDLE_FOREVER;
+    return wait > 0 ? wait : 0;
+}
 
 /***************************************************************************
+ *      atris_run_flame()
+ * Draws the next frame of the flame, if it is time for one.
  *********************************************************************PROTO*/
 void 
 atris_run_flame(void)
 {
+    Uint32 now = SDL_GetTicks();
+
     if (!Options.flame_wanted) return;
+    if ((Sint32) (now - flame_next) < 0) return;
+    flame_next += 1000 / FLAME_RATE;
+    if ((Sint32) (flame_next - now) <= 0)	/* behind: do not catch up */
+	flame_next = now + 1000 / FLAME_RATE;
 
     /* modify the bas of the flame */
     XFModifyFlameBase(flame,w>>1,ws,h>>1);